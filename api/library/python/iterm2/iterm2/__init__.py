@@ -49,7 +49,7 @@ from iterm2.prompt import (
 
 from iterm2.registration import RPC, ContextMenuProviderRPC, TitleProviderRPC, StatusBarRPC, Reference
 
-from iterm2.screen import ScreenStreamer, LineContents, ScreenContents
+from iterm2.screen import ScreenStreamer, LineContents, ScreenContents, PackedLineContents, PackedScreenChunk, CellStyle
 
 from iterm2.selection import SelectionMode, SubSelection, Selection
 
@@ -1,2 +1,2 @@
 """Gives the module version."""
-__version__ = "1.17"
+__version__ = "1.18"
@@ -2826,7 +2826,21 @@ type___LayoutChangedNotification = LayoutChangedNotification
 
 class GetBufferRequest(google___protobuf___message___Message):
     DESCRIPTOR: google___protobuf___descriptor___Descriptor = ...
+    EncodingValue = typing___NewType('EncodingValue', builtin___int)
+    type___EncodingValue = EncodingValue
+    Encoding: _Encoding
+    class _Encoding(google___protobuf___internal___enum_type_wrapper____EnumTypeWrapper[GetBufferRequest.EncodingValue]):
+        DESCRIPTOR: google___protobuf___descriptor___EnumDescriptor = ...
+        LINE_CONTENTS = typing___cast(GetBufferRequest.EncodingValue, 0)
+        PACKED = typing___cast(GetBufferRequest.EncodingValue, 1)
+    LINE_CONTENTS = typing___cast(GetBufferRequest.EncodingValue, 0)
+    PACKED = typing___cast(GetBufferRequest.EncodingValue, 1)
+    type___Encoding = Encoding
+
     session: typing___Text = ...
+    encoding: type___GetBufferRequest.EncodingValue = ...
+    max_packed_size: builtin___int = ...
+    since_generation: builtin___int = ...
 
     @property
     def line_range(self) -> type___LineRange: ...
@@ -2835,9 +2849,12 @@ class GetBufferRequest(google___protobuf___message___Message):
         *,
         session : typing___Optional[typing___Text] = None,
         line_range : typing___Optional[type___LineRange] = None,
+        encoding : typing___Optional[type___GetBufferRequest.EncodingValue] = None,
+        max_packed_size : typing___Optional[builtin___int] = None,
+        since_generation : typing___Optional[builtin___int] = None,
         ) -> None: ...
-    def HasField(self, field_name: typing_extensions___Literal[u"line_range",b"line_range",u"session",b"session"]) -> builtin___bool: ...
-    def ClearField(self, field_name: typing_extensions___Literal[u"line_range",b"line_range",u"session",b"session"]) -> None: ...
+    def HasField(self, field_name: typing_extensions___Literal[u"encoding",b"encoding",u"line_range",b"line_range",u"max_packed_size",b"max_packed_size",u"session",b"session",u"since_generation",b"since_generation"]) -> builtin___bool: ...
+    def ClearField(self, field_name: typing_extensions___Literal[u"encoding",b"encoding",u"line_range",b"line_range",u"max_packed_size",b"max_packed_size",u"session",b"session",u"since_generation",b"since_generation"]) -> None: ...
 type___GetBufferRequest = GetBufferRequest
 
 class GetBufferResponse(google___protobuf___message___Message):
@@ -2859,6 +2876,10 @@ class GetBufferResponse(google___protobuf___message___Message):
 
     status: type___GetBufferResponse.StatusValue = ...
     num_lines_above_screen: builtin___int = ...
+    packed_contents: builtin___bytes = ...
+    more_available: builtin___bool = ...
+    generation: builtin___int = ...
+    incremental: builtin___bool = ...
 
     @property
     def range(self) -> type___Range: ...
@@ -2880,9 +2901,13 @@ class GetBufferResponse(google___protobuf___message___Message):
         cursor : typing___Optional[type___Coord] = None,
         num_lines_above_screen : typing___Optional[builtin___int] = None,
         windowed_coord_range : typing___Optional[type___WindowedCoordRange] = None,
+        packed_contents : typing___Optional[builtin___bytes] = None,
+        more_available : typing___Optional[builtin___bool] = None,
+        generation : typing___Optional[builtin___int] = None,
+        incremental : typing___Optional[builtin___bool] = None,
         ) -> None: ...
-    def HasField(self, field_name: typing_extensions___Literal[u"cursor",b"cursor",u"num_lines_above_screen",b"num_lines_above_screen",u"range",b"range",u"status",b"status",u"windowed_coord_range",b"windowed_coord_range"]) -> builtin___bool: ...
-    def ClearField(self, field_name: typing_extensions___Literal[u"contents",b"contents",u"cursor",b"cursor",u"num_lines_above_screen",b"num_lines_above_screen",u"range",b"range",u"status",b"status",u"windowed_coord_range",b"windowed_coord_range"]) -> None: ...
+    def HasField(self, field_name: typing_extensions___Literal[u"cursor",b"cursor",u"generation",b"generation",u"incremental",b"incremental",u"more_available",b"more_available",u"num_lines_above_screen",b"num_lines_above_screen",u"packed_contents",b"packed_contents",u"range",b"range",u"status",b"status",u"windowed_coord_range",b"windowed_coord_range"]) -> builtin___bool: ...
+    def ClearField(self, field_name: typing_extensions___Literal[u"contents",b"contents",u"cursor",b"cursor",u"generation",b"generation",u"incremental",b"incremental",u"more_available",b"more_available",u"num_lines_above_screen",b"num_lines_above_screen",u"packed_contents",b"packed_contents",u"range",b"range",u"status",b"status",u"windowed_coord_range",b"windowed_coord_range"]) -> None: ...
 type___GetBufferResponse = GetBufferResponse
 
 class GetPromptRequest(google___protobuf___message___Message):
@@ -121,3 +121,16 @@ def check_supports_add_annotation(connection):
         raise AppVersionTooOld(
             "This version of iTerm2 is too old to add an annotation. " +
             "You should upgrade to run this script.")
+
+def supports_packed_buffer(connection):
+    """Can you fetch screen contents in the packed encoding?"""
+    min_ver = (1, 9)
+    return ge(connection.iterm2_protocol_version, min_ver)
+
+def check_supports_packed_buffer(connection):
+    """Die if you can't fetch packed screen contents."""
+    if not supports_packed_buffer(connection):
+        raise AppVersionTooOld(
+            "This version of iTerm2 is too old to fetch screen " +
+            "contents in the packed encoding. You should upgrade to " +
+            "run this script.")
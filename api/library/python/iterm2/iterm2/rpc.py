@@ -201,13 +201,19 @@ async def async_create_tab(
 async def async_get_screen_contents(
         connection,
         session,
-        windowed_coord_range=None):
+        windowed_coord_range=None,
+        packed=False,
+        max_packed_size=0,
+        since_generation=None):
     """
     Gets screen contents, including both the mutable area and history.
 
     connection: A connected iterm2.Connection.
     session: Session ID
     windowed_coord_range: The range of characters to fetch.
+    packed: Request the PACKED encoding instead of LineContents.
+    max_packed_size: Approximate limit on the size of packed contents.
+    since_generation: Skip lines unchanged since this generation.
 
     Returns: iterm2.api_pb2.ServerOriginatedMessage
     """
@@ -219,6 +225,14 @@ async def async_get_screen_contents(
             windowed_coord_range.proto)
     else:
         request.get_buffer_request.line_range.screen_contents_only = True
+    if packed:
+        # pylint: disable=no-member
+        request.get_buffer_request.encoding = (
+            iterm2.api_pb2.GetBufferRequest.Encoding.Value("PACKED"))
+        if max_packed_size:
+            request.get_buffer_request.max_packed_size = max_packed_size
+    if since_generation is not None:
+        request.get_buffer_request.since_generation = since_generation
     return await _async_call(connection, request)
 
 
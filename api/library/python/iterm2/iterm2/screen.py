@@ -1,8 +1,10 @@
 """Provides access to screen contents."""
 import asyncio
+import struct
 import typing
 
 import iterm2.api_pb2
+import iterm2.capabilities
 import iterm2.notifications
 import iterm2.rpc
 import iterm2.util
@@ -51,6 +53,247 @@ class LineContents:
                 "CONTINUATION_HARD_EOL"))
 
 
+class CellStyle:
+    """Describes the appearance of a run of cells in packed screen contents.
+
+    Colors are encoded as `(mode << 24) | (red << 16) | (green << 8) | blue`.
+    See `GetBufferResponse.packed_contents` in api.proto for details."""
+    BOLD = 1
+    FAINT = 2
+    ITALIC = 4
+    BLINK = 8
+    UNDERLINE = 16
+    STRIKETHROUGH = 32
+    IMAGE = 64
+    CURLY_UNDERLINE = 128
+
+    def __init__(self, length, foreground, background, flags):
+        self.length = length
+        self.foreground = foreground
+        self.background = background
+        self.flags = flags
+
+    def __repr__(self):
+        return "<CellStyle length={} fg={:08x} bg={:08x} flags={}>".format(
+            self.length, self.foreground, self.background, self.flags)
+
+
+class PackedLineContents:
+    """Describes the contents of a line fetched with the packed encoding.
+
+    Provides the same interface as :class:`LineContents` plus styles."""
+    def __init__(self, text, continuation, number_of_cells, cpp_runs, styles):
+        self.__text = text
+        self.__continuation = continuation
+        self.__number_of_cells = number_of_cells
+        self.__cpp_runs = cpp_runs
+        self.__styles = styles
+        self.__offset_of_cell = None
+
+    def __offsets(self):
+        if self.__offset_of_cell is None:
+            offsets = [0]
+            offset = 0
+            for repeats, count in self.__cpp_runs:
+                for _ in range(repeats):
+                    offset += count
+                    offsets.append(offset)
+            self.__offset_of_cell = offsets
+        return self.__offset_of_cell
+
+    @property
+    def string(self) -> str:
+        """
+        :returns: The line's contents as a string.
+        """
+        return self.__text
+
+    def string_at(self, x: int) -> str:  # pylint: disable=invalid-name
+        """Returns the string of the cell at index `x`.
+
+        :param x: The index to look up.
+        :returns: A string giving the contents of the cell at that index, or
+            empty string if none.
+        """
+        offsets = self.__offsets()
+        if x + 1 >= len(offsets):
+            return ""
+        return self.__text[offsets[x]:offsets[x + 1]]
+
+    @property
+    def hard_eol(self) -> bool:
+        """
+        :returns: True if the line has a hard newline. If False, the text of a
+            longer line wraps onto the next line."""
+        return self.__continuation == 0
+
+    @property
+    def number_of_cells(self) -> int:
+        """
+        :returns: The number of cells in the line, excluding trailing empty
+            cells."""
+        return self.__number_of_cells
+
+    @property
+    def styles(self) -> typing.List[CellStyle]:
+        """
+        :returns: The appearance of the line's cells as a list of runs."""
+        return self.__styles
+
+
+_PACKED_MAGIC = 0x42505469
+_PACKED_VERSION = 1
+_PACKED_HEADER = struct.Struct("<III")
+_PACKED_LINE_HEADER = struct.Struct("<BII")
+_PACKED_COUNT = struct.Struct("<I")
+_PACKED_CPP_RUN = struct.Struct("<IB")
+_PACKED_STYLE_RUN = struct.Struct("<IIIH")
+
+
+def decode_packed_contents(data: bytes) -> typing.List[PackedLineContents]:
+    """Decodes `GetBufferResponse.packed_contents`.
+
+    :param data: The packed contents.
+    :returns: A list of :class:`PackedLineContents`.
+    :throws: ValueError if the data is malformed or of an unknown version.
+    """
+    try:
+        magic, version, count = _PACKED_HEADER.unpack_from(data, 0)
+    except struct.error as exception:
+        raise ValueError("Packed contents too short") from exception
+    if magic != _PACKED_MAGIC or version != _PACKED_VERSION:
+        raise ValueError("Unsupported packed contents")
+    offset = _PACKED_HEADER.size
+    lines = []
+    view = memoryview(data)
+    try:
+        for _ in range(count):
+            continuation, cells, text_length = (
+                _PACKED_LINE_HEADER.unpack_from(data, offset))
+            offset += _PACKED_LINE_HEADER.size
+            text = str(view[offset:offset + text_length], "utf-8")
+            offset += text_length
+
+            (number_of_runs,) = _PACKED_COUNT.unpack_from(data, offset)
+            offset += _PACKED_COUNT.size
+            cpp_runs = list(
+                _PACKED_CPP_RUN.iter_unpack(
+                    view[offset:offset + number_of_runs * _PACKED_CPP_RUN.size]))
+            offset += number_of_runs * _PACKED_CPP_RUN.size
+
+            (number_of_runs,) = _PACKED_COUNT.unpack_from(data, offset)
+            offset += _PACKED_COUNT.size
+            styles = [
+                CellStyle(*run) for run in _PACKED_STYLE_RUN.iter_unpack(
+                    view[offset:offset +
+                         number_of_runs * _PACKED_STYLE_RUN.size])]
+            offset += number_of_runs * _PACKED_STYLE_RUN.size
+
+            lines.append(
+                PackedLineContents(
+                    text, continuation, cells, cpp_runs, styles))
+    except struct.error as exception:
+        raise ValueError("Packed contents truncated") from exception
+    return lines
+
+
+class PackedScreenChunk:
+    """One response's worth of lines from
+    :func:`async_stream_packed_contents`."""
+    def __init__(self, proto):
+        self.__proto = proto
+        self.__lines = None
+
+    @property
+    def lines(self) -> typing.List[PackedLineContents]:
+        """The lines in this chunk, decoded on first use."""
+        if self.__lines is None:
+            self.__lines = decode_packed_contents(self.__proto.packed_contents)
+        return self.__lines
+
+    @property
+    def first_line(self) -> int:
+        """The absolute line number of the first line in this chunk."""
+        return self.__proto.windowed_coord_range.coord_range.start.y
+
+    @property
+    def generation(self) -> int:
+        """Pass the first chunk's generation as `since_generation` to a later
+        fetch to skip lines that can't have changed."""
+        return self.__proto.generation
+
+    @property
+    def incremental(self) -> bool:
+        """True if lines were skipped because of `since_generation`."""
+        return self.__proto.incremental
+
+    @property
+    def cursor_coord(self) -> iterm2.util.Point:
+        """Returns the location of the cursor.
+
+        :returns: A :class:`~iterm2.Point`"""
+        return iterm2.util.Point(self.__proto.cursor.x, self.__proto.cursor.y)
+
+
+async def async_stream_packed_contents(
+        connection,
+        session_id: str,
+        first_line: int,
+        number_of_lines: int,
+        since_generation: typing.Optional[int] = None,
+        max_packed_size: int = 0) -> typing.AsyncIterator[PackedScreenChunk]:
+    """Fetches a range of lines in chunks using the packed encoding.
+
+    This is much faster than :meth:`~iterm2.Session.async_get_contents` for
+    large ranges of scrollback history. Run it in a
+    :class:`~iterm2.transaction.Transaction` if the session must not change
+    between chunks.
+
+    :param connection: The connection to iTerm2.
+    :param session_id: The session to read from.
+    :param first_line: The absolute line number of the first line to fetch.
+    :param number_of_lines: The number of lines to fetch.
+    :param since_generation: The `generation` of an earlier chunk. Lines that
+        can't have changed since then are skipped.
+    :param max_packed_size: Approximate size limit of each chunk in bytes.
+        0 lets iTerm2 pick.
+
+    :returns: An async iterator of :class:`PackedScreenChunk`.
+
+    :throws: :class:`~iterm2.rpc.RPCException` if something goes wrong.
+    """
+    iterm2.capabilities.check_supports_packed_buffer(connection)
+    start = first_line
+    end = first_line + number_of_lines
+    while True:
+        coord_range = iterm2.util.WindowedCoordRange(
+            iterm2.util.CoordRange(
+                iterm2.util.Point(0, start),
+                iterm2.util.Point(0, end)))
+        result = await iterm2.rpc.async_get_screen_contents(
+            connection,
+            session_id,
+            coord_range,
+            packed=True,
+            max_packed_size=max_packed_size,
+            since_generation=since_generation)
+        response = result.get_buffer_response
+        # pylint: disable=no-member
+        if (response.status !=
+                iterm2.api_pb2.GetBufferResponse.Status.Value("OK")):
+            raise iterm2.rpc.RPCException(
+                iterm2.api_pb2.GetBufferResponse.Status.Name(
+                    response.status))
+        yield PackedScreenChunk(response)
+        next_start = response.windowed_coord_range.coord_range.end.y
+        if not response.more_available or next_start <= start:
+            return
+        start = next_start
+        # Lines skipped by since_generation come before the first chunk, so
+        # later chunks don't need it.
+        since_generation = None
+
+
 class ScreenContents:
     """Describes screen contents."""
     def __init__(self, proto):
@@ -409,6 +409,46 @@ class Session:
             iterm2.api_pb2.GetBufferResponse.Status.Name(
                 response.get_buffer_response.status))
 
+    def stream_contents(
+            self,
+            first_line: int,
+            number_of_lines: int,
+            since_generation: typing.Optional[int] = None
+    ) -> typing.AsyncIterator['iterm2.screen.PackedScreenChunk']:
+        """
+        Fetches a large range of lines in chunks using a compact encoding.
+
+        This is much faster than `async_get_contents` for large ranges, such
+        as the whole scrollback history.
+
+        :param first_line: The first line number to fetch.
+        :param number_of_lines: The number of lines to fetch.
+        :param since_generation: The `generation` of the first chunk of an
+            earlier fetch. Lines that can't have changed since then are
+            skipped and the first chunk has `incremental` set.
+        :returns: An async iterator of
+            :class:`iterm2.screen.PackedScreenChunk`.
+
+        :throws: :class:`~iterm2.rpc.RPCException` if something goes wrong.
+
+        .. code-block:: python
+          :caption: Example that prints all of `session`'s lines.
+
+          async with iterm2.Transaction(connection) as txn:
+            li = await session.async_get_line_info()
+            count = (li.scrollback_buffer_height +
+                     li.mutable_area_height)
+            async for chunk in session.stream_contents(li.overflow, count):
+              for line in chunk.lines:
+                print(line.string)
+        """
+        return iterm2.screen.async_stream_packed_contents(
+            self.connection,
+            self.session_id,
+            first_line,
+            number_of_lines,
+            since_generation)
+
     def get_screen_streamer(
             self, want_contents: bool = True) -> iterm2.screen.ScreenStreamer:
         """
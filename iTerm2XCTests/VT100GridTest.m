@@ -2491,6 +2491,63 @@ do { \
                                        expectDropped:0];
 }
 
+- (void)testAppendASCIIBytesAtCursorMatchesAppendCharsAtCursor {
+    NSArray<NSString *> *initialBuffers = @[ @"abc!\n"
+                                             @"d..!",
+                                             @"abc>>\n"
+                                             @"D-..!" ];
+    NSString *stringToAppend = @"efghijklm";
+    screen_char_t templateChar = { 0 };
+    templateChar.foregroundColor = 3;
+    templateChar.backgroundColor = 4;
+    templateChar.bold = YES;
+    for (NSString *initialBuffer in initialBuffers) {
+        VT100Grid *expectedGrid = [self gridFromCompactLinesWithContinuationMarks:initialBuffer];
+        VT100Grid *actualGrid = [self gridFromCompactLinesWithContinuationMarks:initialBuffer];
+        LineBuffer *expectedLineBuffer = [[[LineBuffer alloc] initWithBlockSize:1000] autorelease];
+        LineBuffer *actualLineBuffer = [[[LineBuffer alloc] initWithBlockSize:1000] autorelease];
+        expectedGrid.cursor = VT100GridCoordMake(1, 1);
+        actualGrid.cursor = VT100GridCoordMake(1, 1);
+
+        screen_char_t *line = [self screenCharLineForString:stringToAppend];
+        for (int i = 0; i < stringToAppend.length; i++) {
+            const unichar code = line[i].code;
+            line[i] = templateChar;
+            line[i].code = code;
+        }
+        int expectedDropped = [expectedGrid appendCharsAtCursor:line
+                                                         length:stringToAppend.length
+                                        scrollingIntoLineBuffer:expectedLineBuffer
+                                            unlimitedScrollback:NO
+                                        useScrollbackWithRegion:YES
+                                                     wraparound:YES
+                                                           ansi:NO
+                                                         insert:NO];
+        int actualDropped = [actualGrid appendASCIIBytesAtCursor:stringToAppend.UTF8String
+                                                          length:stringToAppend.length
+                                                    templateChar:templateChar
+                                                        graphics:NO
+                                         scrollingIntoLineBuffer:actualLineBuffer
+                                             unlimitedScrollback:NO
+                                         useScrollbackWithRegion:YES
+                                                      wraparound:YES
+                                                            ansi:NO
+                                                          insert:NO];
+        XCTAssertEqualObjects([actualGrid compactLineDumpWithContinuationMarks],
+                              [expectedGrid compactLineDumpWithContinuationMarks]);
+        XCTAssertEqualObjects([actualLineBuffer debugString], [expectedLineBuffer debugString]);
+        XCTAssertEqual(actualDropped, expectedDropped);
+        XCTAssertEqual(actualGrid.cursorX, expectedGrid.cursorX);
+        XCTAssertEqual(actualGrid.cursorY, expectedGrid.cursorY);
+        for (int y = 0; y < actualGrid.size.height; y++) {
+            XCTAssertEqual(memcmp([actualGrid screenCharsAtLineNumber:y],
+                                  [expectedGrid screenCharsAtLineNumber:y],
+                                  sizeof(screen_char_t) * actualGrid.size.width),
+                           0);
+        }
+    }
+}
+
 - (void)testCoordinateBefore {
     VT100Grid *grid = [self smallGrid];
     // Test basic case
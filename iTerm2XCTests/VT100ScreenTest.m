@@ -2232,6 +2232,19 @@ NSLog(@"Known bug: %s should be true, but %s is.", #expressionThatShouldBeTrue,
     XCTAssert(screen.cursorY == 1);
 }
 
+// Global search reads the snapshot on another thread while the session keeps scrolling.
+- (void)testLineBufferSnapshotIsUnaffectedByLaterOutput {
+    VT100Screen *screen = [self screenWithWidth:5 height:2];
+    screen.maxScrollbackLines = 4;
+    [self appendLines:@[@"abcdefgh", @"ijkl", @"mnopqrstuvwxyz", @"012"] toScreen:screen];
+    LineBuffer *snapshot = [[screen newLineBufferSnapshotIncludingScreen] autorelease];
+    NSString *before = [snapshot compactLineDumpWithWidth:5 andContinuationMarks:NO];
+    XCTAssertTrue([before rangeOfString:@"rstuv\nwxyz.\n012.."].location != NSNotFound);
+
+    [self appendLines:@[@"34567890", @"more", @"and more"] toScreen:screen];
+    XCTAssertEqualObjects([snapshot compactLineDumpWithWidth:5 andContinuationMarks:NO], before);
+}
+
 // Perform a search, append some stuff, and continue searching from the end of scrollback history
 // prior to the appending, finding a match in the stuff that was appended. This is what PTYSession
 // does for tail-find.
@@ -2868,6 +2881,35 @@ NSLog(@"Known bug: %s should be true, but %s is.", #expressionThatShouldBeTrue,
     XCTAssert([s isEqualToString:@"Line 2"]);
 }
 
+- (void)testSaveToFileBackedDvr {
+    VT100Screen *screen = [self screenWithWidth:20 height:3];
+    screen.delegate = (id<VT100ScreenDelegate>)self;
+    DVR *dvr = [[[DVR alloc] initWithTemporaryFileOfCapacity:64 * 1024 * 1024] autorelease];
+    XCTAssertNotNil(dvr);
+    screen.dvr = dvr;
+    [self appendLines:@[ @"Line 1", @"Line 2"] toScreen:screen];
+    [screen saveToDvr:nil];
+
+    [self appendLines:@[ @"Line 3"] toScreen:screen];
+    [screen saveToDvr:nil];
+
+    // Exporting copies only the frames in use into an in-memory DVR.
+    DVR *copy = [[[DVR alloc] initWithBufferCapacity:1024] autorelease];
+    XCTAssert([copy loadDictionary:dvr.dictionaryValue]);
+
+    for (DVR *theDvr in @[ dvr, copy ]) {
+        DVRDecoder *decoder = [theDvr getDecoder];
+        XCTAssert([decoder seek:0]);
+        screen_char_t *frame = (screen_char_t *)[decoder decodedFrame];
+        XCTAssertEqualObjects(ScreenCharArrayToStringDebug(frame, [screen width]), @"Line 1");
+
+        XCTAssert([decoder next]);
+        frame = (screen_char_t *)[decoder decodedFrame];
+        XCTAssertEqualObjects(ScreenCharArrayToStringDebug(frame, [screen width]), @"Line 2");
+        [theDvr releaseDecoder:decoder];
+    }
+}
+
 - (void)testContentsChangedNotification {
     shouldSendContentsChangedNotification_ = NO;
     VT100Screen *screen = [self screenWithWidth:20 height:3];
@@ -0,0 +1,255 @@
+//
+//  iTermBufferPackerTest.m
+//  iTerm2XCTests
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "Api.pbobjc.h"
+#import "iTermBufferPacker.h"
+#import "ScreenChar.h"
+
+static const NSInteger kUnicodeVersion = 9;
+
+// One line decoded from GetBufferResponse.packed_contents.
+@interface iTermBufferPackerTestLine : NSObject
+@property (nonatomic) unichar continuation;
+@property (nonatomic, retain) NSMutableArray<NSString *> *cells;
+// Each element is @[ length, foreground, background, flags ].
+@property (nonatomic, retain) NSMutableArray<NSArray<NSNumber *> *> *styleRuns;
+@end
+
+@implementation iTermBufferPackerTestLine
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _cells = [[NSMutableArray alloc] init];
+        _styleRuns = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_cells release];
+    [_styleRuns release];
+    [super dealloc];
+}
+
+@end
+
+@interface iTermBufferPackerTest : XCTestCase
+@end
+
+@implementation iTermBufferPackerTest {
+    const uint8_t *_bytes;
+    NSUInteger _length;
+    NSUInteger _offset;
+    BOOL _truncated;
+}
+
+#pragma mark - Decoding
+
+- (const uint8_t *)take:(NSUInteger)count {
+    if (_truncated || _length - _offset < count) {
+        _truncated = YES;
+        return NULL;
+    }
+    const uint8_t *p = _bytes + _offset;
+    _offset += count;
+    return p;
+}
+
+- (uint32_t)uint32 {
+    const uint8_t *p = [self take:4];
+    return p ? (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24)) : 0;
+}
+
+- (uint16_t)uint16 {
+    const uint8_t *p = [self take:2];
+    return p ? (p[0] | (p[1] << 8)) : 0;
+}
+
+- (uint8_t)uint8 {
+    const uint8_t *p = [self take:1];
+    return p ? p[0] : 0;
+}
+
+// Mirrors decode_packed_contents in the Python library.
+- (NSArray<iTermBufferPackerTestLine *> *)decode:(NSData *)data {
+    _bytes = data.bytes;
+    _length = data.length;
+    _offset = 0;
+    _truncated = NO;
+
+    XCTAssertEqual([self uint32], 0x42505469);
+    XCTAssertEqual([self uint32], 1);
+    const uint32_t numberOfLines = [self uint32];
+    NSMutableArray<iTermBufferPackerTestLine *> *lines = [NSMutableArray array];
+    for (uint32_t i = 0; i < numberOfLines && !_truncated; i++) {
+        iTermBufferPackerTestLine *line = [[[iTermBufferPackerTestLine alloc] init] autorelease];
+        line.continuation = [self uint8];
+        const uint32_t numberOfCells = [self uint32];
+        const uint32_t textLength = [self uint32];
+        const uint8_t *text = [self take:textLength];
+        NSUInteger textOffset = 0;
+
+        uint32_t cellsFromCodePointRuns = 0;
+        const uint32_t numberOfCodePointRuns = [self uint32];
+        for (uint32_t j = 0; j < numberOfCodePointRuns && !_truncated; j++) {
+            const uint32_t repeats = [self uint32];
+            const uint8_t codePoints = [self uint8];
+            for (uint32_t k = 0; k < repeats; k++) {
+                // Each code point's length in bytes follows from its UTF-8 lead byte.
+                const NSUInteger start = textOffset;
+                for (int c = 0; c < codePoints && textOffset < textLength; c++) {
+                    const uint8_t lead = text[textOffset];
+                    textOffset += (lead < 0x80) ? 1 : (lead < 0xe0) ? 2 : (lead < 0xf0) ? 3 : 4;
+                }
+                NSString *cell = [[[NSString alloc] initWithBytes:text + start
+                                                           length:MIN(textOffset, textLength) - start
+                                                         encoding:NSUTF8StringEncoding] autorelease];
+                [line.cells addObject:cell ?: @"<invalid>"];
+            }
+            cellsFromCodePointRuns += repeats;
+        }
+        XCTAssertEqual(cellsFromCodePointRuns, numberOfCells);
+        XCTAssertEqual(textOffset, textLength);
+
+        uint32_t cellsFromStyleRuns = 0;
+        const uint32_t numberOfStyleRuns = [self uint32];
+        for (uint32_t j = 0; j < numberOfStyleRuns && !_truncated; j++) {
+            const uint32_t length = [self uint32];
+            const uint32_t foreground = [self uint32];
+            const uint32_t background = [self uint32];
+            const uint16_t flags = [self uint16];
+            [line.styleRuns addObject:@[ @(length), @(foreground), @(background), @(flags) ]];
+            cellsFromStyleRuns += length;
+        }
+        XCTAssertEqual(cellsFromStyleRuns, numberOfCells);
+        [lines addObject:line];
+    }
+    XCTAssertFalse(_truncated);
+    XCTAssertEqual(_offset, _length);
+    return lines;
+}
+
+#pragma mark - Helpers
+
+- (NSData *)lineForString:(NSString *)string {
+    screen_char_t fg = { 0 };
+    fg.foregroundColor = ALTSEM_DEFAULT;
+    fg.foregroundColorMode = ColorModeAlternate;
+    screen_char_t bg = { 0 };
+    bg.backgroundColor = ALTSEM_DEFAULT;
+    bg.backgroundColorMode = ColorModeAlternate;
+    NSMutableData *data = [NSMutableData dataWithLength:string.length * 2 * sizeof(screen_char_t)];
+    int length;
+    StringToScreenChars(string,
+                        data.mutableBytes,
+                        fg,
+                        bg,
+                        &length,
+                        NO,
+                        NULL,
+                        NULL,
+                        iTermUnicodeNormalizationNone,
+                        kUnicodeVersion);
+    data.length = length * sizeof(screen_char_t);
+    return data;
+}
+
+// The text the packer should produce for each cell.
+- (NSArray<NSString *> *)expectedCellsForLine:(NSData *)data {
+    NSMutableArray<NSString *> *cells = [NSMutableArray array];
+    screen_char_t *line = (screen_char_t *)data.bytes;
+    const int length = (int)(data.length / sizeof(screen_char_t));
+    for (int i = 0; i < length; i++) {
+        if (!line[i].complexChar && line[i].code == DWC_RIGHT) {
+            [cells addObject:@""];
+        } else if (!line[i].complexChar && line[i].code == 0) {
+            [cells addObject:@" "];
+        } else {
+            unichar characters[kMaxParts];
+            const int count = ExpandScreenChar(&line[i], characters);
+            [cells addObject:[NSString stringWithCharacters:characters length:count]];
+        }
+    }
+    return cells;
+}
+
+#pragma mark - Tests
+
+- (void)testResponseRoundTrip {
+    NSMutableData *styled = [[[self lineForString:@"hello world"] mutableCopy] autorelease];
+    screen_char_t *cells = styled.mutableBytes;
+    for (int i = 0; i < 5; i++) {
+        cells[i].foregroundColor = 1;
+        cells[i].foregroundColorMode = ColorModeNormal;
+        cells[i].bold = YES;
+    }
+    NSData *wide = [self lineForString:@"中文 ok"];
+    NSData *combining = [self lineForString:@"e\u0301 \U0001F642"];
+    NSMutableData *trailingNuls = [[[self lineForString:@"ls"] mutableCopy] autorelease];
+    [trailingNuls increaseLengthBy:2 * sizeof(screen_char_t)];
+
+    NSArray<NSData *> *lines = @[ styled, wide, combining, trailingNuls ];
+    const unichar continuations[] = { EOL_HARD, EOL_SOFT, EOL_HARD, EOL_HARD };
+    iTermBufferPacker *packer = [[[iTermBufferPacker alloc] init] autorelease];
+    for (NSUInteger i = 0; i < lines.count; i++) {
+        [packer appendLine:lines[i].bytes
+                    length:(int)(lines[i].length / sizeof(screen_char_t))
+              continuation:continuations[i]];
+    }
+    XCTAssertEqual(packer.numberOfLines, lines.count);
+
+    ITMGetBufferResponse *response = [[[ITMGetBufferResponse alloc] init] autorelease];
+    response.status = ITMGetBufferResponse_Status_Ok;
+    response.packedContents = packer.data;
+    response.moreAvailable = YES;
+    response.generation = 42;
+    NSError *error = nil;
+    ITMGetBufferResponse *parsed = [ITMGetBufferResponse parseFromData:response.data error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqual(parsed.contentsArray_Count, 0);
+    XCTAssertTrue(parsed.moreAvailable);
+    XCTAssertEqual(parsed.generation, 42);
+    XCTAssertEqualObjects(parsed.packedContents, packer.data);
+
+    NSArray<iTermBufferPackerTestLine *> *decoded = [self decode:parsed.packedContents];
+    XCTAssertEqual(decoded.count, lines.count);
+    for (NSUInteger i = 0; i < MIN(decoded.count, lines.count); i++) {
+        XCTAssertEqual(decoded[i].continuation, continuations[i]);
+        XCTAssertEqualObjects(decoded[i].cells, [self expectedCellsForLine:lines[i]]);
+    }
+
+    // "hello" is bold in color 1, " world" uses the default colors.
+    const uint32_t defaultColor = (ColorModeAlternate << 24) | (ALTSEM_DEFAULT << 16);
+    NSArray *expectedStyleRuns = @[ @[ @5, @((ColorModeNormal << 24) | (1 << 16)), @(defaultColor), @1 ],
+                                    @[ @6, @(defaultColor), @(defaultColor), @0 ] ];
+    XCTAssertEqualObjects(decoded[0].styleRuns, expectedStyleRuns);
+    XCTAssertEqualObjects(decoded[1].cells[1], @"");
+}
+
+- (void)testEncodingDefaultsToLineContents {
+    ITMGetBufferRequest *request = [[[ITMGetBufferRequest alloc] init] autorelease];
+    XCTAssertFalse(request.hasEncoding);
+    XCTAssertEqual(request.encoding, ITMGetBufferRequest_Encoding_LineContents);
+
+    NSError *error = nil;
+    ITMGetBufferRequest *parsed = [ITMGetBufferRequest parseFromData:request.data error:&error];
+    XCTAssertNil(error);
+    XCTAssertFalse(parsed.hasEncoding);
+    XCTAssertEqual(parsed.encoding, ITMGetBufferRequest_Encoding_LineContents);
+
+    request.encoding = ITMGetBufferRequest_Encoding_Packed;
+    request.maxPackedSize = 1024;
+    parsed = [ITMGetBufferRequest parseFromData:request.data error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue(parsed.hasEncoding);
+    XCTAssertEqual(parsed.encoding, ITMGetBufferRequest_Encoding_Packed);
+    XCTAssertEqual(parsed.maxPackedSize, 1024);
+}
+
+@end
@@ -1242,6 +1242,47 @@
     XCTAssertEqualObjects(db.commands, expectedCommands);
 }
 
+- (void)testGraphDatabase_UnchangedSubtreeIsSkipped {
+    NSMutableDictionary<NSString *,id<iTermDatabaseResultSet>> *results = [NSMutableDictionary dictionary];
+    results[@"select key, identifier, parent, rowid, data from Node"] = [iTermMockDatabaseResultSet withRows:@[]];
+
+    iTermMockDatabaseFactory *mockDB = [[iTermMockDatabaseFactory alloc] initWithResults:results
+                                                                                database:nil];
+    iTermGraphDatabase *gdb = [[iTermGraphDatabase alloc] initWithURL:[NSURL fileURLWithPath:@"/db"]
+                                                      databaseFactory:mockDB];
+    iTermMockDatabase *db = mockDB.database;
+
+    void (^update)(void) = ^{
+        [gdb.thread performDeferredBlocksAfter:^{
+            [gdb update:^(iTermGraphEncoder * _Nonnull encoder) {
+                [encoder encodeChildWithKey:@"wrapper"
+                                 identifier:@""
+                                 generation:iTermGenerationAlwaysEncode
+                                      block:^BOOL(iTermGraphEncoder * _Nonnull subencoder) {
+                    return [subencoder encodeChildWithKey:@"mynode"
+                                               identifier:@""
+                                               generation:1
+                                                    block:^BOOL(iTermGraphEncoder * _Nonnull subencoder) {
+                        [subencoder encodeString:@"Hello" forKey:@"World"];
+                        return YES;
+                    }];
+                }];
+            }
+             completion:nil];
+        }];
+    };
+    update();
+    iTermEncoderGraphRecord *wrapper = [gdb.record childRecordWithKey:@"wrapper" identifier:@""];
+    XCTAssertNotNil(wrapper);
+    [db.commands removeAllObjects];
+
+    // The wrapper is always encoded but nothing in it changed, so the previous record is kept and
+    // nothing is written.
+    update();
+    XCTAssertEqualObjects(db.commands, @[]);
+    XCTAssertTrue([gdb.record childRecordWithKey:@"wrapper" identifier:@""] == wrapper);
+}
+
 - (void)testGraphDatabase_InsertNode {
     NSMutableDictionary<NSString *,id<iTermDatabaseResultSet>> *results = [NSMutableDictionary dictionary];
     results[@"select key, identifier, parent, rowid, data from Node"] = [iTermMockDatabaseResultSet withRows:@[]];
@@ -0,0 +1,182 @@
+//
+//  iTermCommandHistoryPrefixIndexTest.m
+//  iTerm2XCTests
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "iTermCommandHistoryPrefixIndex.h"
+#import "NSStringITerm.h"
+
+@interface iTermCommandHistoryPrefixIndexTestCommand : NSObject
+@property (nonatomic, copy) NSString *command;
+@property (nonatomic) NSInteger uses;
+@property (nonatomic) NSTimeInterval lastUse;
+@end
+
+@implementation iTermCommandHistoryPrefixIndexTestCommand
+
+- (void)dealloc {
+    [_command release];
+    [super dealloc];
+}
+
+@end
+
+@interface iTermCommandHistoryPrefixIndexTest : XCTestCase
+@end
+
+@implementation iTermCommandHistoryPrefixIndexTest
+
+// What iTermShellHistoryController did before it had an index: filter everything, then sort.
+- (NSArray<NSString *> *)bruteForceCommandsWithPrefix:(NSString *)prefix
+                                                   in:(NSArray<iTermCommandHistoryPrefixIndexTestCommand *> *)commands
+                                                limit:(NSUInteger)limit {
+    NSMutableArray<iTermCommandHistoryPrefixIndexTestCommand *> *matches = [NSMutableArray array];
+    for (iTermCommandHistoryPrefixIndexTestCommand *command in commands) {
+        if (prefix.length == 0 || [command.command caseInsensitiveHasPrefix:prefix]) {
+            [matches addObject:command];
+        }
+    }
+    [matches sortUsingComparator:^NSComparisonResult(iTermCommandHistoryPrefixIndexTestCommand *a,
+                                                     iTermCommandHistoryPrefixIndexTestCommand *b) {
+        if (a.uses != b.uses) {
+            return a.uses > b.uses ? NSOrderedAscending : NSOrderedDescending;
+        }
+        return [@(b.lastUse) compare:@(a.lastUse)];
+    }];
+    NSMutableArray<NSString *> *result = [NSMutableArray array];
+    for (iTermCommandHistoryPrefixIndexTestCommand *command in matches) {
+        if (result.count == limit) {
+            break;
+        }
+        [result addObject:command.command];
+    }
+    return result;
+}
+
+- (NSArray<NSString *> *)commandsWithPrefix:(NSString *)prefix
+                                         in:(iTermCommandHistoryPrefixIndex<iTermCommandHistoryPrefixIndexTestCommand *> *)index
+                                      limit:(NSUInteger)limit {
+    NSMutableArray<NSString *> *result = [NSMutableArray array];
+    for (iTermCommandHistoryPrefixIndexTestCommand *command in [index objectsWithPrefix:prefix limit:limit]) {
+        [result addObject:command.command];
+    }
+    return result;
+}
+
+- (iTermCommandHistoryPrefixIndexTestCommand *)addCommand:(NSString *)string
+                                                     uses:(NSInteger)uses
+                                                  lastUse:(NSTimeInterval)lastUse
+                                                  toIndex:(iTermCommandHistoryPrefixIndex *)index {
+    iTermCommandHistoryPrefixIndexTestCommand *command = [[[iTermCommandHistoryPrefixIndexTestCommand alloc] init] autorelease];
+    command.command = string;
+    command.uses = uses;
+    command.lastUse = lastUse;
+    [index setObject:command forCommand:string uses:uses lastUse:lastUse];
+    return command;
+}
+
+- (void)testOrdersByUsesThenRecency {
+    iTermCommandHistoryPrefixIndex *index = [[[iTermCommandHistoryPrefixIndex alloc] init] autorelease];
+    [self addCommand:@"git status" uses:3 lastUse:10 toIndex:index];
+    [self addCommand:@"git stash" uses:3 lastUse:20 toIndex:index];
+    [self addCommand:@"git log" uses:5 lastUse:1 toIndex:index];
+    [self addCommand:@"ls" uses:100 lastUse:100 toIndex:index];
+
+    XCTAssertEqualObjects([self commandsWithPrefix:@"git" in:index limit:10],
+                          (@[ @"git log", @"git stash", @"git status" ]));
+    XCTAssertEqualObjects([self commandsWithPrefix:@"git st" in:index limit:1],
+                          (@[ @"git stash" ]));
+    XCTAssertEqualObjects([self commandsWithPrefix:@"" in:index limit:2],
+                          (@[ @"ls", @"git log" ]));
+    XCTAssertEqualObjects([self commandsWithPrefix:@"x" in:index limit:10], (@[]));
+}
+
+- (void)testIgnoresCase {
+    iTermCommandHistoryPrefixIndex *index = [[[iTermCommandHistoryPrefixIndex alloc] init] autorelease];
+    [self addCommand:@"Make" uses:1 lastUse:1 toIndex:index];
+    [self addCommand:@"make" uses:2 lastUse:1 toIndex:index];
+    [self addCommand:@"MAKE install" uses:3 lastUse:1 toIndex:index];
+
+    XCTAssertEqualObjects([self commandsWithPrefix:@"mA" in:index limit:10],
+                          (@[ @"MAKE install", @"make", @"Make" ]));
+}
+
+- (void)testUpdatesAndRemovals {
+    iTermCommandHistoryPrefixIndex *index = [[[iTermCommandHistoryPrefixIndex alloc] init] autorelease];
+    [self addCommand:@"cd a" uses:1 lastUse:1 toIndex:index];
+    iTermCommandHistoryPrefixIndexTestCommand *b = [self addCommand:@"cd b" uses:2 lastUse:2 toIndex:index];
+    XCTAssertEqualObjects([self commandsWithPrefix:@"cd" in:index limit:10], (@[ @"cd b", @"cd a" ]));
+
+    // Querying builds the tree; this update must patch it in place.
+    [self addCommand:@"cd a" uses:3 lastUse:3 toIndex:index];
+    XCTAssertEqual(index.count, 2);
+    XCTAssertEqualObjects([self commandsWithPrefix:@"cd" in:index limit:10], (@[ @"cd a", @"cd b" ]));
+    XCTAssertEqual([index objectForCommand:@"cd b"], b);
+
+    [index removeCommand:@"cd a"];
+    XCTAssertNil([index objectForCommand:@"cd a"]);
+    XCTAssertEqualObjects([self commandsWithPrefix:@"cd" in:index limit:10], (@[ @"cd b" ]));
+
+    [index removeAllCommands];
+    XCTAssertEqual(index.count, 0);
+    XCTAssertEqualObjects([self commandsWithPrefix:@"" in:index limit:10], (@[]));
+}
+
+// Items whose folded form has the prefix but that fail -caseInsensitiveHasPrefix: don't produce a
+// result when popped, but they still split their interval. This used to overflow the heap.
+- (void)testManyItemsRejectedByPrefixCheck {
+    iTermCommandHistoryPrefixIndex *index = [[[iTermCommandHistoryPrefixIndex alloc] init] autorelease];
+    NSMutableArray<iTermCommandHistoryPrefixIndexTestCommand *> *commands = [NSMutableArray array];
+    for (int i = 0; i < 500; i++) {
+        [commands addObject:[self addCommand:[NSString stringWithFormat:@"\u0130stanbul %d", i]
+                                        uses:1000 - (i * 7919) % 1000
+                                     lastUse:i
+                                     toIndex:index]];
+    }
+    [commands addObject:[self addCommand:@"id" uses:1 lastUse:0 toIndex:index]];
+    [commands addObject:[self addCommand:@"ifconfig" uses:2 lastUse:0 toIndex:index]];
+    for (NSNumber *limit in @[ @1, @2, @3, @600 ]) {
+        XCTAssertEqualObjects([self commandsWithPrefix:@"i" in:index limit:limit.unsignedIntegerValue],
+                              [self bruteForceCommandsWithPrefix:@"i" in:commands limit:limit.unsignedIntegerValue],
+                              @"limit=%@", limit);
+    }
+}
+
+- (void)testMatchesBruteForceOnRandomHistory {
+    srandom(1);
+    NSArray<NSString *> *words = @[ @"git", @"Git", @"ls", @"l", @"make", @"cd", @"c", @"ssh", @"é", @"É" ];
+    NSMutableDictionary<NSString *, iTermCommandHistoryPrefixIndexTestCommand *> *commands = [NSMutableDictionary dictionary];
+    iTermCommandHistoryPrefixIndex *index = [[[iTermCommandHistoryPrefixIndex alloc] init] autorelease];
+    for (int i = 0; i < 2000; i++) {
+        NSMutableString *string = [NSMutableString string];
+        const int numberOfWords = 1 + random() % 3;
+        for (int j = 0; j < numberOfWords; j++) {
+            [string appendString:words[random() % words.count]];
+        }
+        if (random() % 10 == 0) {
+            [index removeCommand:string];
+            [commands removeObjectForKey:string];
+        } else {
+            const NSInteger uses = commands[string].uses + 1;
+            commands[string] = [self addCommand:string uses:uses lastUse:i toIndex:index];
+        }
+
+        if (i % 50 == 0) {
+            XCTAssertEqual(index.count, commands.count);
+            for (NSString *prefix in @[ @"", @"g", @"GI", @"gitl", @"l", @"ls", @"c", @"cdcd", @"é", @"zzz" ]) {
+                for (NSNumber *limit in @[ @1, @5, @200 ]) {
+                    XCTAssertEqualObjects([self commandsWithPrefix:prefix in:index limit:limit.unsignedIntegerValue],
+                                          [self bruteForceCommandsWithPrefix:prefix
+                                                                          in:commands.allValues
+                                                                       limit:limit.unsignedIntegerValue],
+                                          @"prefix=%@ limit=%@ i=%d", prefix, limit, i);
+                }
+            }
+        }
+    }
+}
+
+@end
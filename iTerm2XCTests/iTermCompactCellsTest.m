@@ -0,0 +1,426 @@
+//
+//  iTermCompactCellsTest.m
+//  iTerm2XCTests
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import <malloc/malloc.h>
+#import "iTermCompactCells.h"
+#import "iTermScrollbackSegmentFile.h"
+#import "LineBlock.h"
+
+@interface iTermCompactCellsTest : XCTestCase
+@end
+
+// Bytes in use in all malloc zones. Other work in the process allocates too, so only compare
+// values taken close together with generous margins.
+static size_t iTermCompactCellsTestAllocatedBytes(void) {
+    malloc_statistics_t statistics;
+    malloc_zone_statistics(NULL, &statistics);
+    return statistics.size_in_use;
+}
+
+@implementation iTermCompactCellsTest
+
+// Resembles colored build output: a short highlighted tag followed by plain text and the occasional
+// 24-bit colored word.
+- (NSMutableData *)logOutputWithLines:(int)numberOfLines lineLengths:(NSMutableArray<NSNumber *> *)lineLengths {
+    NSMutableData *data = [NSMutableData data];
+    srandom(1);
+    for (int line = 0; line < numberOfLines; line++) {
+        NSString *text = [NSString stringWithFormat:@"[%5d/%5d] Compiling sources/module_%d.m -o build/module_%d.o",
+                          line, numberOfLines, (int)(random() % 500), line];
+        const int length = (int)text.length;
+        screen_char_t cells[length];
+        memset(cells, 0, sizeof(cells));
+        for (int i = 0; i < length; i++) {
+            cells[i].code = [text characterAtIndex:i];
+            cells[i].foregroundColor = ALTSEM_DEFAULT;
+            cells[i].foregroundColorMode = ColorModeAlternate;
+            cells[i].backgroundColor = ALTSEM_DEFAULT;
+            cells[i].backgroundColorMode = ColorModeAlternate;
+            if (i < 13) {
+                cells[i].foregroundColor = 2;
+                cells[i].foregroundColorMode = ColorModeNormal;
+                cells[i].bold = YES;
+            } else if (line % 7 == 0 && i >= 23 && i < 29) {
+                cells[i].foregroundColor = 255;
+                cells[i].fgGreen = 128;
+                cells[i].fgBlue = 0;
+                cells[i].foregroundColorMode = ColorMode24bit;
+            }
+        }
+        [data appendBytes:cells length:sizeof(cells)];
+        [lineLengths addObject:@(length)];
+    }
+    return data;
+}
+
+- (void)testRoundTrip {
+    NSMutableArray<NSNumber *> *lengths = [NSMutableArray array];
+    NSData *data = [self logOutputWithLines:100 lineLengths:lengths];
+    const int count = (int)(data.length / sizeof(screen_char_t));
+    iTermCompactCells *compact = iTermCompactCellsCreate(data.bytes, count);
+    NSMutableData *expanded = [NSMutableData dataWithLength:data.length];
+    iTermCompactCellsExpand(compact, expanded.mutableBytes);
+    XCTAssertEqualObjects(expanded, data);
+
+    // Ranges that start and end in the middle of runs.
+    const int start = lengths[0].intValue + 5;
+    const int rangeLength = lengths[1].intValue + lengths[2].intValue;
+    NSMutableData *range = [NSMutableData dataWithLength:rangeLength * sizeof(screen_char_t)];
+    iTermCompactCellsExpandRange(compact, start, rangeLength, range.mutableBytes);
+    XCTAssertEqualObjects(range, [data subdataWithRange:NSMakeRange(start * sizeof(screen_char_t),
+                                                                   range.length)]);
+
+    iTermCompactCells *copy = iTermCompactCellsCopy(compact);
+    iTermCompactCellsFree(compact);
+    memset(expanded.mutableBytes, 0, expanded.length);
+    iTermCompactCellsExpand(copy, expanded.mutableBytes);
+    XCTAssertEqualObjects(expanded, data);
+    iTermCompactCellsFree(copy);
+}
+
+- (void)testEmpty {
+    screen_char_t unused = { 0 };
+    iTermCompactCells *compact = iTermCompactCellsCreate(&unused, 0);
+    XCTAssertEqual(compact->numberOfCells, 0);
+    XCTAssertEqual(compact->numberOfRuns, 0);
+    iTermCompactCellsFree(compact);
+}
+
+- (void)testCompactLineBlockReturnsSameWrappedLines {
+    NSMutableArray<NSNumber *> *lengths = [NSMutableArray array];
+    NSData *data = [self logOutputWithLines:50 lineLengths:lengths];
+    LineBlock *block = [[[LineBlock alloc] initWithRawBufferSize:(int)(data.length / sizeof(screen_char_t))] autorelease];
+    const screen_char_t *cells = data.bytes;
+    const int width = 20;
+    screen_char_t continuation = { 0 };
+    continuation.code = EOL_HARD;
+    for (NSNumber *length in lengths) {
+        XCTAssertTrue([block appendLine:(screen_char_t *)cells
+                                 length:length.intValue
+                                partial:NO
+                                  width:width
+                              timestamp:0
+                           continuation:continuation]);
+        cells += length.intValue;
+    }
+    LineBlock *expected = [[block copy] autorelease];
+    const int numLines = [block getNumLinesWithWrapWidth:width];
+
+    [block compact];
+    XCTAssertTrue(block.isCompact);
+    XCTAssertEqual([block getNumLinesWithWrapWidth:width], numLines);
+    XCTAssertTrue(block.isCompact);
+
+    for (int i = 0; i < numLines; i++) {
+        int expectedLineNum = i;
+        int actualLineNum = i;
+        int expectedLength = 0;
+        int actualLength = 0;
+        int expectedEOL = 0;
+        int actualEOL = 0;
+        screen_char_t *expectedLine = [expected getWrappedLineWithWrapWidth:width
+                                                                    lineNum:&expectedLineNum
+                                                                 lineLength:&expectedLength
+                                                          includesEndOfLine:&expectedEOL
+                                                               continuation:NULL];
+        screen_char_t *actualLine = [block getWrappedLineWithWrapWidth:width
+                                                               lineNum:&actualLineNum
+                                                            lineLength:&actualLength
+                                                     includesEndOfLine:&actualEOL
+                                                          continuation:NULL];
+        XCTAssertEqual(actualLength, expectedLength);
+        XCTAssertEqual(actualEOL, expectedEOL);
+        XCTAssertEqual(memcmp(actualLine, expectedLine, sizeof(screen_char_t) * actualLength), 0);
+    }
+    // Reading wrapped lines decodes them one at a time instead of expanding the block.
+    XCTAssertTrue(block.isCompact);
+    XCTAssertEqualObjects(block.dictionary[@"Binary"], expected.dictionary[@"Binary"]);
+}
+
+- (void)testLineBlockDictionaryRoundTrip {
+    NSMutableArray<NSNumber *> *lengths = [NSMutableArray array];
+    NSData *data = [self logOutputWithLines:50 lineLengths:lengths];
+    const int width = 80;
+    LineBlock *block = [[[LineBlock alloc] initWithRawBufferSize:(int)(data.length / sizeof(screen_char_t))] autorelease];
+    const screen_char_t *cells = data.bytes;
+    screen_char_t continuation = { 0 };
+    continuation.code = EOL_HARD;
+    for (NSNumber *length in lengths) {
+        [block appendLine:(screen_char_t *)cells
+                   length:length.intValue
+                  partial:NO
+                    width:width
+                timestamp:12345
+             continuation:continuation];
+        cells += length.intValue;
+    }
+    NSDictionary *dictionary = block.dictionary;
+    XCTAssertEqualObjects([dictionary.allKeys sortedArrayUsingSelector:@selector(compare:)], (@[ @"Binary", @"GUID" ]));
+
+    LineBlock *restored = [LineBlock blockWithDictionary:dictionary];
+    XCTAssertNotNil(restored);
+    XCTAssertEqualObjects(restored.dictionary, dictionary);
+    XCTAssertEqual([restored getNumLinesWithWrapWidth:width], [block getNumLinesWithWrapWidth:width]);
+    [self assertFirstLineOfBlock:restored width:width equals:data.bytes length:lengths[0].intValue];
+
+    // A compact block saves the same bytes without staying expanded.
+    [block compact];
+    XCTAssertEqualObjects(block.dictionary, dictionary);
+    XCTAssertTrue(block.isCompact);
+
+    // Damaged input is rejected rather than read out of bounds.
+    NSData *binary = dictionary[@"Binary"];
+    NSDictionary *truncated = @{ @"Binary": [binary subdataWithRange:NSMakeRange(0, binary.length - 1)],
+                                 @"GUID": dictionary[@"GUID"] };
+    XCTAssertNil([LineBlock blockWithDictionary:truncated]);
+}
+
+- (void)testCompressRoundTrip {
+    NSMutableArray<NSNumber *> *lengths = [NSMutableArray array];
+    NSData *data = [self logOutputWithLines:1000 lineLengths:lengths];
+    const int count = (int)(data.length / sizeof(screen_char_t));
+    iTermCompactCells *compact = iTermCompactCellsCreate(data.bytes, count);
+    NSData *compressed = iTermCompactCellsCompress(compact);
+    XCTAssertNotNil(compressed);
+    XCTAssertLessThan(compressed.length, iTermCompactCellsSize(compact));
+    iTermCompactCellsFree(compact);
+
+    iTermCompactCells *decompressed = iTermCompactCellsDecompress(compressed);
+    NSMutableData *expanded = [NSMutableData dataWithLength:data.length];
+    iTermCompactCellsExpand(decompressed, expanded.mutableBytes);
+    XCTAssertEqualObjects(expanded, data);
+    iTermCompactCellsFree(decompressed);
+
+    XCTAssertTrue(iTermCompactCellsDecompress([NSData data]) == NULL);
+}
+
+- (LineBlock *)newBlockWithData:(NSData *)data lengths:(NSArray<NSNumber *> *)lengths width:(int)width {
+    LineBlock *block = [[LineBlock alloc] initWithRawBufferSize:(int)(data.length / sizeof(screen_char_t))];
+    const screen_char_t *cells = data.bytes;
+    screen_char_t continuation = { 0 };
+    continuation.code = EOL_HARD;
+    for (NSNumber *length in lengths) {
+        [block appendLine:(screen_char_t *)cells
+                   length:length.intValue
+                  partial:NO
+                    width:width
+                timestamp:0
+             continuation:continuation];
+        cells += length.intValue;
+    }
+    return block;
+}
+
+- (LineBlock *)compressedBlockWithData:(NSData *)data lengths:(NSArray<NSNumber *> *)lengths width:(int)width {
+    LineBlock *block = [[self newBlockWithData:data lengths:lengths width:width] autorelease];
+    [block compact];
+    dispatch_queue_t queue = dispatch_queue_create("com.iterm2.compact-cells-test", DISPATCH_QUEUE_SERIAL);
+    [block compressOnQueue:queue];
+    [self expectationForPredicate:[NSPredicate predicateWithBlock:^BOOL(LineBlock *evaluatedObject, NSDictionary *bindings) {
+        return evaluatedObject.isCompressed;
+    }]
+              evaluatedWithObject:block
+                          handler:nil];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    dispatch_release(queue);
+    return block;
+}
+
+- (void)assertFirstLineOfBlock:(LineBlock *)block width:(int)width equals:(const screen_char_t *)expected length:(int)expectedLength {
+    int lineNum = 0;
+    int length = 0;
+    int eol = 0;
+    screen_char_t *line = [block getWrappedLineWithWrapWidth:width
+                                                     lineNum:&lineNum
+                                                  lineLength:&length
+                                           includesEndOfLine:&eol
+                                                continuation:NULL];
+    XCTAssertEqual(length, expectedLength);
+    XCTAssertEqual(memcmp(line, expected, length * sizeof(screen_char_t)), 0);
+}
+
+- (void)testCompressedLineBlockExpandsTransparently {
+    NSMutableArray<NSNumber *> *lengths = [NSMutableArray array];
+    NSData *data = [self logOutputWithLines:200 lineLengths:lengths];
+    const int width = 80;
+    LineBlock *block = [self compressedBlockWithData:data lengths:lengths width:width];
+
+    // Saving state and counting lines don't need the cells.
+    const int numLines = [block getNumLinesWithWrapWidth:width];
+    XCTAssertGreaterThan(numLines, 0);
+    XCTAssertNotNil(block.dictionary);
+    XCTAssertTrue(block.isCompressed);
+    XCTAssertGreaterThan(block.compressedSize, 0);
+
+    [self assertFirstLineOfBlock:block width:width equals:data.bytes length:lengths[0].intValue];
+    XCTAssertFalse(block.isCompressed);
+    XCTAssertTrue(block.isCompact);
+    XCTAssertEqual([block getNumLinesWithWrapWidth:width], numLines);
+}
+
+- (void)testSpilledLineBlockExpandsTransparently {
+    NSMutableArray<NSNumber *> *lengths = [NSMutableArray array];
+    NSData *data = [self logOutputWithLines:200 lineLengths:lengths];
+    const int width = 80;
+    LineBlock *block = [self compressedBlockWithData:data lengths:lengths width:width];
+    NSDictionary *expected = block.dictionary;
+
+    iTermScrollbackSegmentFile *segmentFile = [[[iTermScrollbackSegmentFile alloc] init] autorelease];
+    XCTAssertNotNil(segmentFile);
+    // Put something in front of it so the mapping doesn't start on a page boundary.
+    XCTAssertNotNil([segmentFile appendData:[@"x" dataUsingEncoding:NSUTF8StringEncoding]]);
+    XCTAssertTrue([block spillToSegmentFile:segmentFile]);
+    XCTAssertTrue(block.isSpilled);
+    XCTAssertEqual(block.compressedSize, 0);
+    XCTAssertFalse([block spillToSegmentFile:segmentFile]);
+    XCTAssertEqualObjects(block.dictionary, expected);
+
+    LineBlock *copy = [[block copy] autorelease];
+    XCTAssertTrue(copy.isSpilled);
+
+    [self assertFirstLineOfBlock:block width:width equals:data.bytes length:lengths[0].intValue];
+    XCTAssertFalse(block.isSpilled);
+    [self assertFirstLineOfBlock:copy width:width equals:data.bytes length:lengths[0].intValue];
+}
+
+- (NSData *)retainedMappingOfBytes:(int)length value:(char)value segmentFile:(iTermScrollbackSegmentFile *)segmentFile {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    memset(data.mutableBytes, value, length);
+    NSData *mapping;
+    @autoreleasepool {
+        mapping = [[segmentFile appendData:data] retain];
+    }
+    XCTAssertEqualObjects(mapping, data);
+    return mapping;
+}
+
+- (void)testSegmentFileReusesSpace {
+    iTermScrollbackSegmentFile *segmentFile = [[[iTermScrollbackSegmentFile alloc] init] autorelease];
+    NSData *a = [self retainedMappingOfBytes:1000 value:'a' segmentFile:segmentFile];
+    NSData *b = [self retainedMappingOfBytes:1000 value:'b' segmentFile:segmentFile];
+    NSData *c = [self retainedMappingOfBytes:1000 value:'c' segmentFile:segmentFile];
+    XCTAssertEqual(segmentFile.length, 3000);
+
+    [b release];
+    XCTAssertEqual(segmentFile.length, 3000);
+    XCTAssertEqual(segmentFile.liveLength, 2000);
+
+    // Goes where b was.
+    NSData *d = [self retainedMappingOfBytes:500 value:'d' segmentFile:segmentFile];
+    XCTAssertEqual(segmentFile.length, 3000);
+    XCTAssertEqual(segmentFile.liveLength, 2500);
+
+    // The rest of b's space and c's are at the end, so the file shrinks.
+    [c release];
+    XCTAssertEqual(segmentFile.length, 1500);
+    XCTAssertEqual(a.length, 1000);
+    XCTAssertEqual(((const char *)a.bytes)[999], 'a');
+    XCTAssertEqual(((const char *)d.bytes)[499], 'd');
+
+    [a release];
+    [d release];
+    XCTAssertEqual(segmentFile.length, 0);
+    XCTAssertEqual(segmentFile.liveLength, 0);
+}
+
+- (void)testDeferredCopyKeepsContentsFromBeforeChange {
+    NSMutableArray<NSNumber *> *lengths = [NSMutableArray array];
+    NSData *data = [self logOutputWithLines:200 lineLengths:lengths];
+    const int width = 80;
+    LineBlock *block = [self compressedBlockWithData:data lengths:lengths width:width];
+    NSData *expected = block.dictionary[@"Binary"];
+    iTermDeferredLineBlockCopy *deferredCopy = [[block newDeferredCopy] autorelease];
+
+    // Popping expands the block and changes it, so the copy has to be made first.
+    screen_char_t *ptr = NULL;
+    int length = 0;
+    XCTAssertTrue([block popLastLineInto:&ptr withLength:&length upToWidth:width timestamp:NULL continuation:NULL]);
+    XCTAssertNotEqualObjects(block.dictionary[@"Binary"], expected);
+
+    LineBlock *copy = deferredCopy.lineBlock;
+    XCTAssertEqual(deferredCopy.lineBlock, copy);
+    XCTAssertEqualObjects(copy.dictionary[@"Binary"], expected);
+    [self assertFirstLineOfBlock:copy width:width equals:data.bytes length:lengths[0].intValue];
+}
+
+- (void)testDeferredCopyMadeOnAnotherThread {
+    NSMutableArray<NSNumber *> *lengths = [NSMutableArray array];
+    NSData *data = [self logOutputWithLines:200 lineLengths:lengths];
+    const int width = 80;
+    LineBlock *block = [self compressedBlockWithData:data lengths:lengths width:width];
+    NSData *expected = block.dictionary[@"Binary"];
+    iTermDeferredLineBlockCopy *deferredCopy = [[block newDeferredCopy] autorelease];
+
+    __block NSData *actual = nil;
+    dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        actual = [deferredCopy.lineBlock.dictionary[@"Binary"] retain];
+    });
+    XCTAssertEqualObjects(actual, expected);
+    [actual release];
+
+    // Changing the original afterwards doesn't affect the copy.
+    [self assertFirstLineOfBlock:block width:width equals:data.bytes length:lengths[0].intValue];
+    screen_char_t *ptr = NULL;
+    int length = 0;
+    XCTAssertTrue([block popLastLineInto:&ptr withLength:&length upToWidth:width timestamp:NULL continuation:NULL]);
+    XCTAssertEqualObjects(deferredCopy.lineBlock.dictionary[@"Binary"], expected);
+}
+
+- (void)testCompactCellsAreSmallForLogOutput {
+    NSMutableArray<NSNumber *> *lengths = [NSMutableArray array];
+    NSData *data = [self logOutputWithLines:10000 lineLengths:lengths];
+    const int count = (int)(data.length / sizeof(screen_char_t));
+    iTermCompactCells *compact = iTermCompactCellsCreate(data.bytes, count);
+    // About two bytes per cell instead of sizeof(screen_char_t).
+    XCTAssertLessThan(iTermCompactCellsSize(compact), data.length / 3);
+    XCTAssertLessThan(iTermCompactCellsCompress(compact).length, iTermCompactCellsSize(compact));
+    iTermCompactCellsFree(compact);
+}
+
+- (void)testReadingCompactBlockDecodesOnlyLinesRead {
+    NSMutableArray<NSNumber *> *lengths = [NSMutableArray array];
+    NSData *data = [self logOutputWithLines:10000 lineLengths:lengths];
+    const int width = 80;
+    LineBlock *block = [[self newBlockWithData:data lengths:lengths width:width] autorelease];
+    const int numLines = [block getNumLinesWithWrapWidth:width];
+
+    const size_t expandedBytes = iTermCompactCellsTestAllocatedBytes();
+    [block compact];
+    const size_t compactBytes = iTermCompactCellsTestAllocatedBytes();
+    // Most of the raw buffer is freed.
+    XCTAssertLessThan(compactBytes + data.length / 2, expandedBytes);
+
+    // A screenful of lines from the middle, like scrolling back.
+    size_t readBytes;
+    @autoreleasepool {
+        screen_char_t *previous = NULL;
+        for (int i = numLines / 2; i < numLines / 2 + 50; i++) {
+            int lineNum = i;
+            int length = 0;
+            int eol = 0;
+            screen_char_t *line = [block getWrappedLineWithWrapWidth:width
+                                                             lineNum:&lineNum
+                                                          lineLength:&length
+                                                   includesEndOfLine:&eol
+                                                        continuation:NULL];
+            XCTAssertTrue(line != NULL);
+            XCTAssertNotEqual(line, previous);
+            previous = line;
+        }
+        readBytes = iTermCompactCellsTestAllocatedBytes();
+    }
+    XCTAssertTrue(block.isCompact);
+    // Each line is at most 80 cells, so 50 of them are a tiny fraction of the block.
+    XCTAssertLessThan(readBytes, compactBytes + data.length / 20);
+
+    // Compacting again drops the decoded lines.
+    [block compact];
+    XCTAssertLessThan(iTermCompactCellsTestAllocatedBytes(), readBytes);
+}
+
+@end
@@ -0,0 +1,258 @@
+//
+//  iTermProcessTreeTest.m
+//  iTerm2XCTests
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "iTermProcessTree.h"
+
+#define FAKE_MAX_PROCESSES 32
+#define FAKE_MAX_EVENTS 32
+
+// A process table the test edits by hand. Events are only delivered when the test posts them.
+typedef struct {
+    struct {
+        pid_t pid;
+        iTermProcessTreeProcess process;
+    } processes[FAKE_MAX_PROCESSES];
+    int numberOfProcesses;
+    iTermProcessTreeEvent events[FAKE_MAX_EVENTS];
+    int numberOfEvents;
+    int numberOfWatches;
+    int numberOfUnwatches;
+    uint32_t watchedEvents;
+} FakeProcessTable;
+
+static int FakeIndex(FakeProcessTable *table, pid_t pid) {
+    for (int i = 0; i < table->numberOfProcesses; i++) {
+        if (table->processes[i].pid == pid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int FakeListChildren(void *context, pid_t pid, pid_t *children, int capacity) {
+    FakeProcessTable *table = context;
+    int count = 0;
+    for (int i = 0; i < table->numberOfProcesses; i++) {
+        if (table->processes[i].process.parentProcessID == pid) {
+            if (count < capacity) {
+                children[count] = table->processes[i].pid;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+static bool FakeReadProcess(void *context, pid_t pid, iTermProcessTreeProcess *process) {
+    FakeProcessTable *table = context;
+    const int i = FakeIndex(table, pid);
+    if (i < 0) {
+        return false;
+    }
+    *process = table->processes[i].process;
+    return true;
+}
+
+static uint32_t FakeWatch(void *context, pid_t pid) {
+    FakeProcessTable *table = context;
+    table->numberOfWatches++;
+    return table->watchedEvents;
+}
+
+static void FakeUnwatch(void *context, pid_t pid) {
+    FakeProcessTable *table = context;
+    table->numberOfUnwatches++;
+}
+
+static int FakeReadEvents(void *context, iTermProcessTreeEvent *events, int capacity) {
+    FakeProcessTable *table = context;
+    const int count = MIN(capacity, table->numberOfEvents);
+    memcpy(events, table->events, sizeof(*events) * count);
+    memmove(table->events, table->events + count, sizeof(*events) * (table->numberOfEvents - count));
+    table->numberOfEvents -= count;
+    return count;
+}
+
+static void FakeRootDidChange(void *context, pid_t root) {
+    NSMutableIndexSet *changed = (__bridge NSMutableIndexSet *)context;
+    [changed addIndex:root];
+}
+
+static void FakeAddToArray(void *context, pid_t pid, pid_t parentPid) {
+    NSMutableArray<NSNumber *> *array = (__bridge NSMutableArray *)context;
+    [array addObject:@(pid)];
+}
+
+@interface iTermProcessTreeTest : XCTestCase
+@end
+
+@implementation iTermProcessTreeTest {
+    FakeProcessTable _table;
+    iTermProcessTree *_tree;
+}
+
+- (void)setUp {
+    memset(&_table, 0, sizeof(_table));
+    _table.watchedEvents = iTermProcessTreeEventFork | iTermProcessTreeEventExec | iTermProcessTreeEventExit;
+    iTermProcessTreeSource source;
+    memset(&source, 0, sizeof(source));
+    source.context = &_table;
+    source.listChildren = FakeListChildren;
+    source.readProcess = FakeReadProcess;
+    source.watch = FakeWatch;
+    source.unwatch = FakeUnwatch;
+    source.readEvents = FakeReadEvents;
+    source.fileDescriptor = -1;
+    _tree = iTermProcessTreeCreate(&source);
+}
+
+- (void)tearDown {
+    iTermProcessTreeFree(_tree);
+}
+
+// A process is in the foreground if its group is the terminal's foreground group, which is 100.
+- (void)addProcess:(pid_t)pid parent:(pid_t)parent foreground:(BOOL)foreground {
+    const int i = _table.numberOfProcesses++;
+    _table.processes[i].pid = pid;
+    _table.processes[i].process.parentProcessID = parent;
+    _table.processes[i].process.processGroupID = foreground ? 100 : pid;
+    _table.processes[i].process.terminalProcessGroupID = 100;
+    _table.processes[i].process.startTime = 1;
+}
+
+- (void)removeProcess:(pid_t)pid {
+    const int i = FakeIndex(&_table, pid);
+    _table.processes[i] = _table.processes[--_table.numberOfProcesses];
+}
+
+- (void)postEvents:(uint32_t)events forProcess:(pid_t)pid {
+    _table.events[_table.numberOfEvents].processID = pid;
+    _table.events[_table.numberOfEvents].events = events;
+    _table.numberOfEvents++;
+}
+
+- (NSArray<NSNumber *> *)subtreeOf:(pid_t)pid {
+    NSMutableArray<NSNumber *> *result = [NSMutableArray array];
+    iTermProcessTreeEnumerateSubtree(_tree, pid, (__bridge void *)result, FakeAddToArray);
+    return result;
+}
+
+// Same tree as -[iTermProcessCollectionTest testMultipleChildren].
+- (void)testDeepestForegroundJobMatchesProcessCollection {
+    // 0 -> a -> b
+    //        -> c -> d+
+    //        -> e -> f -> g+
+    const pid_t a=1, b=2, c=3, d=4, e=5, f=6, g=8;
+    [self addProcess:a parent:0 foreground:NO];
+    [self addProcess:b parent:a foreground:NO];
+    [self addProcess:c parent:a foreground:NO];
+    [self addProcess:d parent:c foreground:YES];
+    [self addProcess:e parent:a foreground:NO];
+    [self addProcess:f parent:e foreground:NO];
+    [self addProcess:g parent:f foreground:YES];
+    iTermProcessTreeAddRoot(_tree, a);
+    iTermProcessTreeUpdate(_tree, NULL, NULL);
+
+    XCTAssertEqual(iTermProcessTreeDeepestForegroundJob(_tree, a), g);
+    NSArray<NSNumber *> *expected = @[ @(a), @(b), @(c), @(d), @(e), @(f), @(g) ];
+    XCTAssertEqualObjects([self subtreeOf:a], expected);
+}
+
+- (void)testOnlyProcessesThatForkedAreRelisted {
+    [self addProcess:1 parent:0 foreground:NO];
+    [self addProcess:2 parent:1 foreground:YES];
+    [self addProcess:3 parent:2 foreground:YES];
+    iTermProcessTreeAddRoot(_tree, 1);
+    XCTAssertEqual(iTermProcessTreeUpdate(_tree, NULL, NULL), 3);
+    XCTAssertEqual(iTermProcessTreeDeepestForegroundJob(_tree, 1), 3);
+
+    NSMutableIndexSet *changed = [NSMutableIndexSet indexSet];
+    XCTAssertEqual(iTermProcessTreeUpdate(_tree, (__bridge void *)changed, FakeRootDidChange), 0);
+    XCTAssertEqual(changed.count, 0);
+
+    [self addProcess:4 parent:3 foreground:YES];
+    [self postEvents:iTermProcessTreeEventFork forProcess:3];
+    // 3's children are listed, then 4's because it's new.
+    XCTAssertEqual(iTermProcessTreeUpdate(_tree, (__bridge void *)changed, FakeRootDidChange), 2);
+    XCTAssertEqualObjects(changed, [NSIndexSet indexSetWithIndex:1]);
+    XCTAssertEqual(iTermProcessTreeDeepestForegroundJob(_tree, 1), 4);
+}
+
+- (void)testExit {
+    [self addProcess:1 parent:0 foreground:NO];
+    [self addProcess:2 parent:1 foreground:YES];
+    [self addProcess:3 parent:2 foreground:YES];
+    iTermProcessTreeAddRoot(_tree, 1);
+    iTermProcessTreeUpdate(_tree, NULL, NULL);
+
+    [self removeProcess:3];
+    [self postEvents:iTermProcessTreeEventExit forProcess:3];
+    NSMutableIndexSet *changed = [NSMutableIndexSet indexSet];
+    iTermProcessTreeUpdate(_tree, (__bridge void *)changed, FakeRootDidChange);
+    XCTAssertEqualObjects(changed, [NSIndexSet indexSetWithIndex:1]);
+    XCTAssertEqual(iTermProcessTreeDeepestForegroundJob(_tree, 1), 2);
+    XCTAssertEqualObjects([self subtreeOf:1], (@[ @1, @2 ]));
+    XCTAssertEqual(_table.numberOfUnwatches, 1);
+}
+
+- (void)testForegroundChangeWithoutEvents {
+    [self addProcess:1 parent:0 foreground:NO];
+    [self addProcess:2 parent:1 foreground:YES];
+    iTermProcessTreeAddRoot(_tree, 1);
+    iTermProcessTreeUpdate(_tree, NULL, NULL);
+    XCTAssertEqual(iTermProcessTreeDeepestForegroundJob(_tree, 1), 2);
+
+    // Like the shell calling tcsetpgrp() to take back the terminal.
+    _table.processes[FakeIndex(&_table, 1)].process.processGroupID = 100;
+    _table.processes[FakeIndex(&_table, 2)].process.processGroupID = 2;
+    NSMutableIndexSet *changed = [NSMutableIndexSet indexSet];
+    XCTAssertEqual(iTermProcessTreeUpdate(_tree, (__bridge void *)changed, FakeRootDidChange), 0);
+    XCTAssertEqualObjects(changed, [NSIndexSet indexSetWithIndex:1]);
+    XCTAssertEqual(iTermProcessTreeDeepestForegroundJob(_tree, 1), 1);
+}
+
+- (void)testReusedProcessIDIsRelisted {
+    [self addProcess:1 parent:0 foreground:NO];
+    [self addProcess:2 parent:1 foreground:YES];
+    [self addProcess:3 parent:2 foreground:YES];
+    iTermProcessTreeAddRoot(_tree, 1);
+    iTermProcessTreeUpdate(_tree, NULL, NULL);
+
+    // 2 exited without an event reaching us and another process got its ID.
+    [self removeProcess:3];
+    _table.processes[FakeIndex(&_table, 2)].process.startTime = 2;
+    iTermProcessTreeUpdate(_tree, NULL, NULL);
+    XCTAssertEqualObjects([self subtreeOf:1], (@[ @1, @2 ]));
+    XCTAssertEqual(iTermProcessTreeDeepestForegroundJob(_tree, 1), 2);
+}
+
+- (void)testWithoutForkEventsChildrenArePolled {
+    _table.watchedEvents = iTermProcessTreeEventExit;
+    [self addProcess:1 parent:0 foreground:NO];
+    iTermProcessTreeAddRoot(_tree, 1);
+    iTermProcessTreeUpdate(_tree, NULL, NULL);
+
+    [self addProcess:2 parent:1 foreground:YES];
+    iTermProcessTreeUpdate(_tree, NULL, NULL);
+    XCTAssertEqual(iTermProcessTreeDeepestForegroundJob(_tree, 1), 2);
+}
+
+- (void)testRemoveRootForgetsItsProcesses {
+    [self addProcess:1 parent:0 foreground:NO];
+    [self addProcess:2 parent:1 foreground:YES];
+    iTermProcessTreeAddRoot(_tree, 1);
+    iTermProcessTreeUpdate(_tree, NULL, NULL);
+
+    iTermProcessTreeRemoveRoot(_tree, 1);
+    iTermProcessTreeUpdate(_tree, NULL, NULL);
+    XCTAssertFalse(iTermProcessTreeHasRoot(_tree, 1));
+    XCTAssertEqual([self subtreeOf:1].count, 0);
+    XCTAssertEqual(_table.numberOfUnwatches, 2);
+}
+
+@end
@@ -0,0 +1,74 @@
+//
+//  iTermRegexPrefilterTest.m
+//  iTerm2XCTests
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "iTermRegexPrefilter.h"
+#import "RegexKitLite.h"
+
+@interface iTermRegexPrefilterTest : XCTestCase
+@end
+
+@implementation iTermRegexPrefilterTest
+
+// The prefilter may let through regexes that don't match but must never rule out one that does.
+- (void)testNeverRulesOutAMatch {
+    NSArray<NSString *> *regexes = @[ @"error: (.*)",
+                                      @"(?i)password:",
+                                      @"\\[job \\d+\\] (done|failed)",
+                                      @"colou?r",
+                                      @"foo|bar",
+                                      @"\\x41BC",
+                                      @"[0-9]+\\.[0-9]+ released",
+                                      @"café",
+                                      @"abc\U0001F600?def" ];
+    NSArray<NSString *> *strings = @[ @"make: error: no rule",
+                                      @"Password: ",
+                                      @"PASSWORD:",
+                                      @"[job 12] failed",
+                                      @"the color red",
+                                      @"foo",
+                                      @"ABC",
+                                      @"1.2 released",
+                                      @"un café",
+                                      @"abcdef",
+                                      @"nothing interesting" ];
+    iTermRegexPrefilter *prefilter = [[[iTermRegexPrefilter alloc] initWithRegexes:regexes] autorelease];
+    // "foo|bar" has no required literal and "BC" is too short to be worth looking for.
+    XCTAssertEqual(prefilter.numberOfPrefilteredRegexes, (NSInteger)regexes.count - 2);
+    for (NSString *string in strings) {
+        [prefilter enumerateRegexesForString:string block:^(NSUInteger index, BOOL mayMatch, BOOL *stop) {
+            if ([string isMatchedByRegex:regexes[index]]) {
+                XCTAssertTrue(mayMatch, @"%@ ruled out for %@", regexes[index], string);
+            }
+        }];
+    }
+}
+
+- (void)testRulesOutNonMatches {
+    NSArray<NSString *> *regexes = @[ @"error: (.*)", @"warning: (.*)", @"(?i)password:", @"\\[job \\d+\\]", @".*" ];
+    iTermRegexPrefilter *prefilter = [[[iTermRegexPrefilter alloc] initWithRegexes:regexes] autorelease];
+    NSMutableArray<NSNumber *> *candidates = [NSMutableArray array];
+    [prefilter enumerateRegexesForString:@"all good" block:^(NSUInteger index, BOOL mayMatch, BOOL *stop) {
+        if (mayMatch) {
+            [candidates addObject:@(index)];
+        }
+    }];
+    XCTAssertEqualObjects(candidates, @[ @4 ]);
+}
+
+// Running a few regexes is cheaper than scanning for their literals.
+- (void)testDoesNotPrefilterFewRegexes {
+    iTermRegexPrefilter *prefilter = [[[iTermRegexPrefilter alloc] initWithRegexes:@[ @"error: (.*)", @"warning: (.*)" ]] autorelease];
+    XCTAssertEqual(prefilter.numberOfPrefilteredRegexes, 0);
+    __block NSInteger numberOfCandidates = 0;
+    [prefilter enumerateRegexesForString:@"all good" block:^(NSUInteger index, BOOL mayMatch, BOOL *stop) {
+        numberOfCandidates += mayMatch ? 1 : 0;
+    }];
+    XCTAssertEqual(numberOfCandidates, 2);
+}
+
+@end
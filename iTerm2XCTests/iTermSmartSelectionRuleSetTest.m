@@ -0,0 +1,141 @@
+//
+//  iTermSmartSelectionRuleSetTest.m
+//  iTerm2XCTests
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "iTermSmartSelectionRuleSet.h"
+#import "RegexKitLite.h"
+#import "SmartSelectionController.h"
+
+@interface iTermSmartSelectionRuleSetTest : XCTestCase
+@end
+
+@implementation iTermSmartSelectionRuleSetTest
+
+// Lines of tests/smart_selection_cases.txt, which was written for trying smart selection by hand.
+- (NSArray<NSString *> *)cases {
+    NSString *path = [[[[NSString stringWithUTF8String:__FILE__] stringByDeletingLastPathComponent]
+                       stringByDeletingLastPathComponent] stringByAppendingPathComponent:@"tests/smart_selection_cases.txt"];
+    NSString *contents = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:nil];
+    XCTAssertNotNil(contents);
+    NSMutableArray<NSString *> *lines = [NSMutableArray array];
+    for (NSString *line in [contents componentsSeparatedByString:@"\n"]) {
+        if (line.length) {
+            [lines addObject:line];
+        }
+    }
+    return lines;
+}
+
+// The algorithm iTermTextExtractor used before iTermSmartSelectionRuleSet: copy the suffix of the
+// text at each starting offset and match each rule against it. Returns descriptions of matches.
+- (NSArray<NSString *> *)legacyMatchesInString:(NSString *)textWindow
+                                  targetOffset:(int)targetOffset
+                                         rules:(NSArray<NSDictionary *> *)rules {
+    NSMutableArray<NSString *> *matches = [NSMutableArray array];
+    for (NSDictionary *rule in rules) {
+        NSString *regex = [SmartSelectionController regexInRule:rule];
+        double precision = [SmartSelectionController precisionInRule:rule];
+        for (int i = 0; i <= targetOffset; i++) {
+            NSString *substring = [textWindow substringWithRange:NSMakeRange(i, [textWindow length] - i)];
+            NSError *regexError = nil;
+            NSRange temp = [substring rangeOfRegex:regex
+                                           options:0
+                                           inRange:NSMakeRange(0, [substring length])
+                                           capture:0
+                                             error:&regexError];
+            if (temp.location == NSNotFound) {
+                break;
+            }
+            if (i + temp.location <= targetOffset && i + temp.location + temp.length > targetOffset) {
+                NSArray *components = [substring captureComponentsMatchedByRegex:regex
+                                                                         options:0
+                                                                           range:NSMakeRange(0, [substring length])
+                                                                           error:&regexError];
+                [matches addObject:[self describeRule:rule
+                                                range:NSMakeRange(i + temp.location, temp.length)
+                                                score:precision * temp.length
+                                           components:components]];
+                i += temp.location + temp.length - 1;
+            } else {
+                i += temp.location;
+            }
+        }
+    }
+    return matches;
+}
+
+- (NSArray<NSString *> *)matchesInString:(NSString *)textWindow
+                            targetOffset:(int)targetOffset
+                                 ruleSet:(iTermSmartSelectionRuleSet *)ruleSet {
+    NSMutableArray<NSString *> *matches = [NSMutableArray array];
+    [ruleSet enumerateMatchesInString:textWindow
+                       coveringOffset:targetOffset
+                       actionRequired:NO
+                                block:^(NSDictionary *rule, NSRange range, double score, NSArray<NSString *> *components) {
+        [matches addObject:[self describeRule:rule range:range score:score components:components]];
+    }];
+    return matches;
+}
+
+- (NSString *)describeRule:(NSDictionary *)rule
+                     range:(NSRange)range
+                     score:(double)score
+                components:(NSArray<NSString *> *)components {
+    return [NSString stringWithFormat:@"%@ %@ %f %@",
+            [SmartSelectionController regexInRule:rule], NSStringFromRange(range), score, components];
+}
+
+- (NSString *)longWrappedLine {
+    return [[self cases] componentsJoinedByString:@" "];
+}
+
+- (void)testMatchesLegacyAlgorithmOnCases {
+    NSArray<NSDictionary *> *rules = [SmartSelectionController defaultRules];
+    iTermSmartSelectionRuleSet *ruleSet = [iTermSmartSelectionRuleSet ruleSetWithRules:rules];
+    for (NSString *line in [self cases]) {
+        for (int offset = 0; offset < line.length; offset++) {
+            XCTAssertEqualObjects([self matchesInString:line targetOffset:offset ruleSet:ruleSet],
+                                  [self legacyMatchesInString:line targetOffset:offset rules:rules],
+                                  @"Line %@ offset %d", line, offset);
+        }
+    }
+}
+
+- (void)testAnchorsAreRelativeToEachStartingOffset {
+    NSArray<NSDictionary *> *rules = @[ @{ kRegexKey: @"^\\w+",
+                                           kPrecisionKey: kNormalPrecision } ];
+    iTermSmartSelectionRuleSet *ruleSet = [iTermSmartSelectionRuleSet ruleSetWithRules:rules];
+    NSString *text = @"abc def";
+    XCTAssertEqualObjects([self matchesInString:text targetOffset:5 ruleSet:ruleSet],
+                          [self legacyMatchesInString:text targetOffset:5 rules:rules]);
+}
+
+- (void)testCachesRuleSets {
+    NSArray<NSDictionary *> *rules = [SmartSelectionController defaultRules];
+    XCTAssertEqual([iTermSmartSelectionRuleSet ruleSetWithRules:rules],
+                   [iTermSmartSelectionRuleSet ruleSetWithRules:[[rules mutableCopy] autorelease]]);
+}
+
+// Double-clicking in the middle of a long wrapped line. Compare with the next test.
+- (void)testPerformanceOnLongLine {
+    NSString *line = [self longWrappedLine];
+    NSArray<NSDictionary *> *rules = [SmartSelectionController defaultRules];
+    [self measureBlock:^{
+        iTermSmartSelectionRuleSet *ruleSet = [iTermSmartSelectionRuleSet ruleSetWithRules:rules];
+        [self matchesInString:line targetOffset:line.length / 2 ruleSet:ruleSet];
+    }];
+}
+
+- (void)testPerformanceOfLegacyAlgorithmOnLongLine {
+    NSString *line = [self longWrappedLine];
+    NSArray<NSDictionary *> *rules = [SmartSelectionController defaultRules];
+    [self measureBlock:^{
+        [self legacyMatchesInString:line targetOffset:line.length / 2 rules:rules];
+    }];
+}
+
+@end
@@ -0,0 +1,190 @@
+//
+//  iTermTriggerEvaluatorTest.m
+//  iTerm2XCTests
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "iTermRegexPrefilter.h"
+#import "iTermTriggerEvaluator.h"
+#import "ScreenChar.h"
+#import "Trigger.h"
+
+// Records each action it's asked to perform instead of performing it.
+@interface iTermRecordingTrigger : Trigger
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, retain) NSMutableArray<NSString *> *log;
+// Value returned from -performActionWithCapturedStrings:..., which allows further matches on the
+// same line when YES.
+@property (nonatomic) BOOL canFireAgain;
+// Stops later triggers from running on the line.
+@property (nonatomic) BOOL stopsLaterTriggers;
+@end
+
+@implementation iTermRecordingTrigger
+
+- (void)dealloc {
+    [_name release];
+    [_log release];
+    [super dealloc];
+}
+
+- (BOOL)performActionWithCapturedStrings:(NSString *const *)capturedStrings
+                          capturedRanges:(const NSRange *)capturedRanges
+                            captureCount:(NSInteger)captureCount
+                               inSession:(PTYSession *)aSession
+                                onString:(iTermStringLine *)stringLine
+                    atAbsoluteLineNumber:(long long)lineNumber
+                        useInterpolation:(BOOL)useInterpolation
+                                    stop:(BOOL *)stop {
+    NSMutableArray<NSString *> *captures = [NSMutableArray array];
+    for (NSInteger i = 0; i < captureCount; i++) {
+        [captures addObject:[NSString stringWithFormat:@"%@@%@",
+                             capturedStrings[i], NSStringFromRange(capturedRanges[i])]];
+    }
+    [_log addObject:[NSString stringWithFormat:@"%@ line %lld: %@",
+                     _name, lineNumber, [captures componentsJoinedByString:@" "]]];
+    if (_stopsLaterTriggers) {
+        *stop = YES;
+    }
+    return _canFireAgain;
+}
+
+- (BOOL)instantTriggerCanFireMultipleTimesPerLine {
+    return NO;
+}
+
+@end
+
+@interface iTermTriggerEvaluatorTest : XCTestCase
+@end
+
+@implementation iTermTriggerEvaluatorTest
+
+- (NSArray<Trigger *> *)triggersWithLog:(NSMutableArray<NSString *> *)log {
+    NSArray<NSArray *> *specs = @[ @[ @"address", @"(\\w+)@(\\w+)", @YES, @NO, @NO ],
+                                   @[ @"error", @"error: (.*)", @YES, @NO, @NO ],
+                                   @[ @"never", @"zzz", @YES, @NO, @NO ],
+                                   @[ @"firstNumber", @"\\d+", @NO, @NO, @NO ],
+                                   @[ @"prompt", @"^\\$ ", @YES, @NO, @YES ],
+                                   @[ @"stopper", @"STOP", @YES, @YES, @NO ],
+                                   @[ @"afterStop", @"STOP|error", @YES, @NO, @NO ] ];
+    NSMutableArray<Trigger *> *triggers = [NSMutableArray array];
+    for (NSArray *spec in specs) {
+        iTermRecordingTrigger *trigger = [[[iTermRecordingTrigger alloc] init] autorelease];
+        trigger.name = spec[0];
+        trigger.regex = spec[1];
+        trigger.canFireAgain = [spec[2] boolValue];
+        trigger.stopsLaterTriggers = [spec[3] boolValue];
+        trigger.partialLine = [spec[4] boolValue];
+        trigger.log = log;
+        [triggers addObject:trigger];
+    }
+    return triggers;
+}
+
+// Line number, partial line, text. The prompt is seen as a partial line before the command is
+// typed, and again once the line ends.
+- (NSArray<NSArray *> *)lines {
+    return @[ @[ @1, @NO, @"mail alice@example and bob@example" ],
+              @[ @2, @NO, @"error: 12 files, 3 dirs" ],
+              @[ @3, @YES, @"$ " ],
+              @[ @3, @NO, @"$ make 2>&1" ],
+              @[ @4, @NO, @"STOP error: 5" ],
+              @[ @5, @NO, @"nothing interesting here" ],
+              @[ @6, @YES, @"$ " ],
+              @[ @6, @YES, @"$ ls" ],
+              @[ @6, @NO, @"$ ls 7" ] ];
+}
+
+// Same as PTYSession when evaluateTriggersInBackground is off.
+- (void)evaluateSynchronouslyWithTriggers:(NSArray<Trigger *> *)triggers {
+    iTermTriggerEvaluator *evaluator = [[[iTermTriggerEvaluator alloc] initWithTriggers:triggers] autorelease];
+    for (NSArray *line in self.lines) {
+        const long long lineNumber = [line[0] longLongValue];
+        const BOOL partial = [line[1] boolValue];
+        iTermStringLine *stringLine = [iTermStringLine stringLineWithString:line[2]];
+        [evaluator.prefilter enumerateRegexesForString:stringLine.stringValue
+                                                 block:^(NSUInteger i, BOOL mayMatch, BOOL *stopPtr) {
+            Trigger *trigger = triggers[i];
+            if (!mayMatch) {
+                [trigger didNotMatchLineNumber:lineNumber partialLine:partial];
+                return;
+            }
+            if ([trigger tryString:stringLine
+                         inSession:nil
+                       partialLine:partial
+                        lineNumber:lineNumber
+                  useInterpolation:NO]) {
+                *stopPtr = YES;
+            }
+        }];
+    }
+}
+
+// Same as PTYSession when evaluateTriggersInBackground is on.
+- (iTermTriggerEvaluator *)evaluateInBackgroundWithTriggers:(NSArray<Trigger *> *)triggers {
+    iTermTriggerEvaluator *evaluator = [[[iTermTriggerEvaluator alloc] initWithTriggers:triggers] autorelease];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All lines evaluated"];
+    NSArray<NSArray *> *lines = self.lines;
+    __block NSUInteger numberOfCompletions = 0;
+    for (NSArray *line in lines) {
+        const long long lineNumber = [line[0] longLongValue];
+        const BOOL partial = [line[1] boolValue];
+        iTermStringLine *stringLine = [iTermStringLine stringLineWithString:line[2]];
+        [evaluator findMatchesInStringLine:stringLine
+                               partialLine:partial
+                                completion:^(NSArray<NSArray<iTermTriggerMatch *> *> *matches) {
+            XCTAssertTrue([NSThread isMainThread]);
+            XCTAssertEqual(matches.count, triggers.count);
+            [triggers enumerateObjectsUsingBlock:^(Trigger *trigger, NSUInteger i, BOOL *stopPtr) {
+                if (matches[i].count == 0) {
+                    [trigger didNotMatchLineNumber:lineNumber partialLine:partial];
+                    return;
+                }
+                if ([trigger performActionsForMatches:matches[i]
+                                             onString:stringLine
+                                            inSession:nil
+                                          partialLine:partial
+                                           lineNumber:lineNumber
+                                     useInterpolation:NO]) {
+                    *stopPtr = YES;
+                }
+            }];
+            numberOfCompletions += 1;
+            if (numberOfCompletions == lines.count) {
+                [expectation fulfill];
+            }
+        }];
+    }
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    return evaluator;
+}
+
+- (void)testBackgroundEvaluationPerformsSameActionsAsSynchronous {
+    NSMutableArray<NSString *> *synchronousLog = [NSMutableArray array];
+    [self evaluateSynchronouslyWithTriggers:[self triggersWithLog:synchronousLog]];
+
+    NSMutableArray<NSString *> *backgroundLog = [NSMutableArray array];
+    NSArray<Trigger *> *triggers = [self triggersWithLog:backgroundLog];
+    iTermTriggerEvaluator *evaluator = [self evaluateInBackgroundWithTriggers:triggers];
+
+    XCTAssertEqualObjects(backgroundLog, synchronousLog);
+
+    // Guard against both paths agreeing because neither did anything.
+    XCTAssertTrue([synchronousLog containsObject:@"address line 1: alice@example@{5, 13} alice@{5, 5} example@{11, 7}"]);
+    XCTAssertTrue([synchronousLog containsObject:@"address line 1: bob@example@{23, 11} bob@{23, 3} example@{27, 7}"]);
+    // Only the first number is reported because the trigger can't fire again on the same line.
+    XCTAssertTrue([synchronousLog containsObject:@"firstNumber line 2: 12@{7, 2}"]);
+    XCTAssertFalse([synchronousLog containsObject:@"firstNumber line 2: 3@{17, 1}"]);
+    // The stopper keeps later triggers from running on its line.
+    XCTAssertTrue([synchronousLog containsObject:@"stopper line 4: STOP@{0, 4}"]);
+    XCTAssertFalse([synchronousLog containsObject:@"afterStop line 4: STOP@{0, 4}"]);
+
+    // The prefilter keeps the regex that can't match from running at all.
+    XCTAssertEqual([evaluator timingForTriggerAtIndex:2].numberOfEvaluations, 0);
+    XCTAssertGreaterThan([evaluator timingForTriggerAtIndex:0].numberOfEvaluations, 0);
+}
+
+@end
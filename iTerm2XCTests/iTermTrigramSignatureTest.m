@@ -0,0 +1,124 @@
+//
+//  iTermTrigramSignatureTest.m
+//  iTerm2XCTests
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "iTermTrigramSignature.h"
+#import "RegexKitLite.h"
+#import "ScreenChar.h"
+
+static const NSInteger kUnicodeVersion = 9;
+
+@interface iTermTrigramSignatureTest : XCTestCase
+@end
+
+@implementation iTermTrigramSignatureTest
+
+// Indexes each string as one raw line, appending it in pieces of |pieceLength| cells to exercise
+// the chain.
+- (iTermTrigramSignature)signatureForLines:(NSArray<NSString *> *)lines pieceLength:(int)pieceLength {
+    iTermTrigramSignature signature;
+    memset(&signature, 0, sizeof(signature));
+    for (NSString *line in lines) {
+        NSMutableData *data = [NSMutableData dataWithLength:(line.length * 2 + 1) * sizeof(screen_char_t)];
+        screen_char_t color = { 0 };
+        int len = 0;
+        StringToScreenChars(line,
+                            data.mutableBytes,
+                            color,
+                            color,
+                            &len,
+                            NO,
+                            NULL,
+                            NULL,
+                            iTermUnicodeNormalizationNone,
+                            kUnicodeVersion);
+        const screen_char_t *cells = data.bytes;
+        iTermTrigramChain chain;
+        iTermTrigramChainReset(&chain);
+        for (int i = 0; i < len; i += pieceLength) {
+            iTermTrigramSignatureAddCells(&signature, &chain, cells + i, MIN(pieceLength, len - i));
+        }
+    }
+    return signature;
+}
+
+- (BOOL)line:(NSString *)line matchesNeedle:(NSString *)needle mode:(iTermFindMode)mode {
+    const NSStringCompareOptions insensitive = (NSCaseInsensitiveSearch |
+                                                NSDiacriticInsensitiveSearch |
+                                                NSWidthInsensitiveSearch);
+    switch (mode) {
+        case iTermFindModeSmartCaseSensitivity:
+        case iTermFindModeCaseInsensitiveSubstring:
+            return [line rangeOfString:needle options:insensitive].location != NSNotFound;
+        case iTermFindModeCaseSensitiveSubstring:
+            return [line rangeOfString:needle].location != NSNotFound;
+        case iTermFindModeCaseSensitiveRegex:
+            return [line isMatchedByRegex:needle];
+        case iTermFindModeCaseInsensitiveRegex:
+            return [line isMatchedByRegex:needle options:RKLCaseless inRange:NSMakeRange(0, line.length) error:nil];
+    }
+    return NO;
+}
+
+// A signature may let through blocks that don't match but must never rule out one that does.
+- (void)testNeverRulesOutAMatch {
+    NSArray<NSString *> *lines = @[ @"make: *** [all] Error 2",
+                                    @"Résumé of CAFÉ visits",
+                                    @"Re\u0301sume\u0301 decomposed",
+                                    @"ＦＵＬＬＷＩＤＴＨ text",
+                                    @"Straße und ﬁnale",
+                                    @"emoji 👍🏽 between words",
+                                    @"中文 mixed 中文字 text",
+                                    @"" ];
+    NSArray<NSString *> *needles = @[ @"error", @"Error 2", @"ERROR", @"resume", @"Résumé",
+                                      @"café", @"CAFE", @"fullwidth", @"ＷＩＤ", @"strasse",
+                                      @"STRASSE", @"finale", @"s 👍🏽 b", @"mixed 中", @"文 mix",
+                                      @"é d", @"nothing" ];
+    NSArray<NSString *> *regexes = @[ @"Error \\d", @"err(or)?", @"^make", @"visits$",
+                                      @"straße", @"caf.", @"[Rr]ésumé", @"(?i)error" ];
+    for (int pieceLength = 1; pieceLength <= 7; pieceLength += 3) {
+        iTermTrigramSignature signature = [self signatureForLines:lines pieceLength:pieceLength];
+        for (NSString *line in lines) {
+            for (iTermFindMode mode = iTermFindModeSmartCaseSensitivity; mode <= iTermFindModeCaseInsensitiveRegex; mode++) {
+                const BOOL isRegex = (mode == iTermFindModeCaseSensitiveRegex ||
+                                      mode == iTermFindModeCaseInsensitiveRegex);
+                for (NSString *needle in isRegex ? regexes : needles) {
+                    if (![self line:line matchesNeedle:needle mode:mode]) {
+                        continue;
+                    }
+                    iTermTrigramQuery *query = [iTermTrigramQuery queryWithNeedle:needle mode:mode];
+                    if (query) {
+                        XCTAssertTrue([query mayMatchSignature:&signature],
+                                      @"%@ (mode %@) ruled out for %@", needle, @(mode), line);
+                    }
+                }
+            }
+        }
+    }
+}
+
+- (void)testRulesOutNonMatches {
+    iTermTrigramSignature signature = [self signatureForLines:@[ @"hello world", @"lorem ipsum" ] pieceLength:4];
+    XCTAssertTrue([[iTermTrigramQuery queryWithNeedle:@"LO WOR" mode:iTermFindModeCaseInsensitiveSubstring] mayMatchSignature:&signature]);
+    XCTAssertFalse([[iTermTrigramQuery queryWithNeedle:@"goodbye" mode:iTermFindModeCaseInsensitiveSubstring] mayMatchSignature:&signature]);
+    XCTAssertFalse([[iTermTrigramQuery queryWithNeedle:@"worlds" mode:iTermFindModeCaseSensitiveSubstring] mayMatchSignature:&signature]);
+    // Trigrams don't span lines.
+    XCTAssertFalse([[iTermTrigramQuery queryWithNeedle:@"ldlor" mode:iTermFindModeCaseSensitiveSubstring] mayMatchSignature:&signature]);
+    XCTAssertFalse([[iTermTrigramQuery queryWithNeedle:@"dolor.*ipsum" mode:iTermFindModeCaseSensitiveRegex] mayMatchSignature:&signature]);
+}
+
+- (void)testQueryIsNilWhenNothingIsRequired {
+    XCTAssertNil([iTermTrigramQuery queryWithNeedle:@"ab" mode:iTermFindModeCaseSensitiveSubstring]);
+    XCTAssertNil([iTermTrigramQuery queryWithNeedle:@"中文字" mode:iTermFindModeCaseSensitiveSubstring]);
+    XCTAssertNil([iTermTrigramQuery queryWithNeedle:@".*foo" mode:iTermFindModeCaseSensitiveRegex]);
+    XCTAssertNil([iTermTrigramQuery queryWithNeedle:@"foo|bar" mode:iTermFindModeCaseSensitiveRegex]);
+    XCTAssertNil([iTermTrigramQuery queryWithNeedle:@"abc?" mode:iTermFindModeCaseSensitiveRegex]);
+    XCTAssertNotNil([iTermTrigramQuery queryWithNeedle:@"^foo.*" mode:iTermFindModeCaseSensitiveRegex]);
+    XCTAssertNotNil([iTermTrigramQuery queryWithNeedle:@"abcd?" mode:iTermFindModeCaseSensitiveRegex]);
+}
+
+@end
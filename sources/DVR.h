@@ -45,6 +45,10 @@
 // contents. Somewhat more memory is used because there's some per-frame
 // storage, but it should be small in comparison.
 - (instancetype)initWithBufferCapacity:(int)bytes;
+
+// Stores frames in a memory-mapped temporary file instead, so hours of history can be kept
+// without using much RAM. Returns nil if the file can't be created.
+- (instancetype)initWithTemporaryFileOfCapacity:(long long)bytes;
 - (BOOL)loadDictionary:(NSDictionary *)dict;
 
 // Save the screen state into the DVR.
@@ -35,7 +35,7 @@
 
 @implementation DVR {
     DVRBuffer* buffer_;
-    int capacity_;
+    long long capacity_;
     NSMutableArray* decoders_;
     DVREncoder* encoder_;
 }
@@ -55,6 +55,21 @@
     return self;
 }
 
+- (instancetype)initWithTemporaryFileOfCapacity:(long long)bytes {
+    self = [super init];
+    if (self) {
+        buffer_ = [[DVRBuffer alloc] initWithTemporaryFileOfCapacity:bytes];
+        if (!buffer_) {
+            [self release];
+            return nil;
+        }
+        capacity_ = bytes;
+        decoders_ = [[NSMutableArray alloc] init];
+        encoder_ = [[DVREncoder alloc] initWithBuffer:buffer_];
+    }
+    return self;
+}
+
 - (void)dealloc
 {
     [decoders_ release];
@@ -137,12 +152,14 @@
 
 - (NSDictionary *)dictionaryValueFrom:(long long)from to:(long long)to {
     DVR *dvr;
-    if (from == self.firstTimeStamp && to == self.lastTimeStamp) {
+    // A file-backed buffer is too big to export whole, so copy just the frames in use.
+    if (from == self.firstTimeStamp && to == self.lastTimeStamp && !buffer_.fileBacked) {
         dvr = self;
     } else {
         dvr = [[self copyWithFramesFrom:from to:to] autorelease];
     }
-    return @{ @"version": @1,
+    // Version 2 may contain compact or deflated frames, which older versions can't decode.
+    return @{ @"version": @2,
               @"capacity": @(dvr->capacity_),
               @"buffer": dvr->buffer_.dictionaryValue };
 }
@@ -151,7 +168,8 @@
     if (!dict) {
         return NO;
     }
-    if ([dict[@"version"] integerValue] != 1) {
+    const NSInteger version = [dict[@"version"] integerValue];
+    if (version != 1 && version != 2) {
         return NO;
     }
     int capacity = [dict[@"capacity"] intValue];
@@ -182,33 +200,60 @@
     return YES;
 }
 
+// The first frame is decoded and stored as a key frame. The rest are copied without re-encoding.
 - (instancetype)copyWithFramesFrom:(long long)from to:(long long)to {
-    DVR *theCopy = [[DVR alloc] initWithBufferCapacity:capacity_];
-    DVRDecoder *decoder = [self getDecoder];
-    if ([decoder seek:from]) {
-        while (decoder.timestamp <= to || to == -1) {
-            screen_char_t *frame = (screen_char_t *)[decoder decodedFrame];
-            NSMutableArray *lines = [NSMutableArray array];
-            DVRFrameInfo info = [decoder info];
-            int offset = 0;
-            const int lineLength = info.width + 1;
-            for (int i = 0; i < info.height; i++) {
-                NSMutableData *data = [NSMutableData dataWithBytes:frame + offset length:lineLength * sizeof(screen_char_t)];
-                [lines addObject:data];
-                offset += lineLength;
-            }
-            [theCopy appendFrame:lines
-                          length:[decoder length]
-                      cleanLines:nil
-                            info:&info];
-            if (![decoder next]) {
-                break;
-            }
+    const long long firstKey = [buffer_ firstKeyWithTimestampAtLeast:from];
+    long long lastKey = firstKey;
+    if (firstKey >= 0) {
+        while (lastKey < [buffer_ lastKey] &&
+               (to == -1 || [buffer_ entryForKey:lastKey + 1]->info.timestamp <= to)) {
+            lastKey++;
         }
     }
+
+    if (firstKey < 0 || (to != -1 && [buffer_ entryForKey:firstKey]->info.timestamp > to)) {
+        return [[DVR alloc] initWithBufferCapacity:(int)MIN(capacity_, 1024 * 1024)];
+    }
+    DVRDecoder *decoder = [self getDecoder];
+    [decoder seek:from];
+
+    // Leave room for the first frame to be stored raw and for DVR's half-capacity limit.
+    long long capacity = 2 * (long long)[decoder length] + 1;
+    for (long long key = firstKey + 1; key <= lastKey; key++) {
+        capacity += [buffer_ entryForKey:key]->frameLength;
+    }
+    DVR *theCopy = [[DVR alloc] initWithBufferCapacity:MIN(capacity, INT_MAX)];
+
+    screen_char_t *frame = (screen_char_t *)[decoder decodedFrame];
+    NSMutableArray *lines = [NSMutableArray array];
+    DVRFrameInfo info = [decoder info];
+    int offset = 0;
+    const int lineLength = info.width + 1;
+    for (int i = 0; i < info.height; i++) {
+        NSMutableData *data = [NSMutableData dataWithBytes:frame + offset length:lineLength * sizeof(screen_char_t)];
+        [lines addObject:data];
+        offset += lineLength;
+    }
+    [theCopy appendFrame:lines
+                  length:[decoder length]
+              cleanLines:nil
+                    info:&info];
     [self releaseDecoder:decoder];
+
+    for (long long key = firstKey + 1; key <= lastKey; key++) {
+        DVRIndexEntry *entry = [buffer_ entryForKey:key];
+        info = entry->info;
+        [theCopy appendEncodedFrame:[buffer_ blockForKey:key]
+                             length:entry->frameLength
+                               info:&info];
+    }
     return theCopy;
 }
 
+- (void)appendEncodedFrame:(const char *)bytes length:(int)length info:(DVRFrameInfo *)info {
+    [encoder_ reserve:length];
+    [encoder_ appendEncodedFrame:bytes length:length info:info];
+}
+
 @end
 
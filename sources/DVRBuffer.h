@@ -41,9 +41,23 @@ enum {
 struct timeval;
 typedef enum {
     DVRFrameTypeKeyFrame,
-    DVRFrameTypeDiffFrame
+    DVRFrameTypeDiffFrame,
+
+    // Encoded with iTermDVRCodec.
+    DVRFrameTypeCompactKeyFrame,
+    DVRFrameTypeCompactDiffFrame,
+
+    // A compact key frame deflated with iTermDVRDeflateKeyFrame().
+    DVRFrameTypeDeflatedKeyFrame
 } DVRFrameType;
 
+// Can a frame of this type be decoded without looking at earlier frames?
+NS_INLINE BOOL DVRFrameTypeIsKeyFrame(int frameType) {
+    return (frameType == DVRFrameTypeKeyFrame ||
+            frameType == DVRFrameTypeCompactKeyFrame ||
+            frameType == DVRFrameTypeDeflatedKeyFrame);
+}
+
 @interface DVRBuffer : NSObject
 
 // Returns first/last used keys.
@@ -57,8 +71,16 @@ typedef enum {
 @property(nonatomic, readonly, getter=isEmpty) BOOL empty;
 @property(nonatomic, readonly) NSDictionary *dictionaryValue;
 
+// Is storage a memory-mapped temporary file rather than malloced memory?
+@property(nonatomic, readonly, getter=isFileBacked) BOOL fileBacked;
+
 - (instancetype)initWithBufferCapacity:(long long)capacity;
 
+// Keeps frames in an unlinked temporary file of |capacity| bytes that's mapped into memory. The
+// kernel pages it in and out as needed, so a large capacity doesn't cost a large amount of RAM.
+// Returns nil if the file can't be created.
+- (instancetype)initWithTemporaryFileOfCapacity:(long long)capacity;
+
 // Reserve a chunk of memory. Returns true if blocks had to be freed to make room.
 // You can get a pointer to the reserved memory with -[scratch].
 - (BOOL)reserve:(long long)length;
@@ -84,5 +106,9 @@ typedef enum {
 - (BOOL)loadFromDictionary:(NSDictionary *)dict;
 - (DVRIndexEntry *)firstEntryWithTimestampAfter:(long long)timestamp;
 
+// Binary searches for the first frame whose timestamp is at least |timestamp|. Returns -1 if there
+// is none.
+- (long long)firstKeyWithTimestampAtLeast:(long long)timestamp;
+
 @end
 
@@ -28,10 +28,13 @@
 
 #import "DVRBuffer.h"
 
+#import "DebugLogging.h"
 #import "iTermMalloc.h"
-#import "NSArray+iTerm.h"
 #import "NSDictionary+iTerm.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 @implementation DVRBuffer {
     // Points to start of large circular buffer.
     char* store_;
@@ -42,6 +45,9 @@
     // Total size of storage in bytes.
     long long capacity_;
 
+    // If set, store_ is a mapping of a temporary file rather than malloced.
+    BOOL fileBacked_;
+
     // Maps a frame key number to DVRIndexEntry*.
     NSMutableDictionary* index_;
 
@@ -79,11 +85,53 @@
     return self;
 }
 
+- (instancetype)initWithTemporaryFileOfCapacity:(long long)capacity {
+    self = [super init];
+    if (self) {
+        NSString *template = [NSTemporaryDirectory() stringByAppendingPathComponent:@"iTerm2-replay.XXXXXX"];
+        char *path = strdup(template.fileSystemRepresentation);
+        const int fd = mkstemp(path);
+        if (fd < 0) {
+            XLog(@"mkstemp failed with template %s: %s", path, strerror(errno));
+            free(path);
+            [self release];
+            return nil;
+        }
+        // Nothing else ever needs to open it by name.
+        unlink(path);
+        free(path);
+
+        // The file is sparse, so disk space is only used as frames are written.
+        void *mapping = MAP_FAILED;
+        if (ftruncate(fd, capacity) == 0) {
+            mapping = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (mapping == MAP_FAILED) {
+            XLog(@"Failed to map a %lld byte replay file: %s", capacity, strerror(errno));
+            close(fd);
+            [self release];
+            return nil;
+        }
+        // The mapping keeps the file alive.
+        close(fd);
+
+        store_ = mapping;
+        fileBacked_ = YES;
+        capacity_ = capacity;
+        index_ = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
 - (void)dealloc
 {
     [index_ release];
     index_ = nil;
-    free(store_);
+    if (fileBacked_) {
+        munmap(store_, capacity_);
+    } else {
+        free(store_);
+    }
     [super dealloc];
 }
 
@@ -228,22 +276,26 @@
 }
 
 - (DVRIndexEntry *)firstEntryWithTimestampAfter:(long long)timestamp {
-    NSArray<NSNumber *> *frameNumbers = [[index_ allKeys] sortedArrayUsingSelector:@selector(compare:)];
-    NSArray<NSNumber *> *timestamps = [frameNumbers mapWithBlock:^NSNumber *(NSNumber *frameNumber) {
-        DVRIndexEntry *entry = index_[frameNumber];
-        return @(entry->info.timestamp);
-    }];
-    NSUInteger frameNumberIndex = [timestamps indexOfObject:@(timestamp + 1)
-                                              inSortedRange:NSMakeRange(0, frameNumbers.count)
-                                                    options:NSBinarySearchingInsertionIndex
-                                            usingComparator:
-                                   ^NSComparisonResult(NSNumber * _Nonnull timestamp1, NSNumber * _Nonnull timestamp2) {
-                                       return [timestamp1 compare:timestamp2];
-                                   }];
-    if (frameNumberIndex == NSNotFound || frameNumberIndex == index_.count) {
+    const long long key = [self firstKeyWithTimestampAtLeast:timestamp + 1];
+    if (key < 0) {
         return nil;
     }
-    return index_[frameNumbers[frameNumberIndex]];
+    return [self entryForKey:key];
+}
+
+- (long long)firstKeyWithTimestampAtLeast:(long long)timestamp {
+    // Keys are contiguous and frames are appended in time order.
+    long long lo = firstKey_;
+    long long hi = nextKey_;
+    while (lo < hi) {
+        const long long mid = lo + (hi - lo) / 2;
+        if ([self entryForKey:mid]->info.timestamp < timestamp) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < nextKey_ ? lo : -1;
 }
 
 - (char*)scratch
@@ -266,6 +318,10 @@
     return capacity_;
 }
 
+- (BOOL)isFileBacked {
+    return fileBacked_;
+}
+
 - (BOOL)isEmpty
 {
     return [index_ count] == 0;
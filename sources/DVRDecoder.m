@@ -30,6 +30,7 @@
 
 #import "DebugLogging.h"
 #import "DVRIndexEntry.h"
+#import "iTermDVRCodec.h"
 #import "iTermMalloc.h"
 #import "LineBuffer.h"
 
@@ -75,16 +76,12 @@
 
 - (BOOL)seek:(long long)timestamp
 {
-    // TODO(georgen): Do a binary search
-    long long lastKey = [buffer_ lastKey];
-    for (long long key = [buffer_ firstKey]; key <= lastKey; ++key) {
-        DVRIndexEntry* entry = [buffer_ entryForKey:key];
-        if (entry->info.timestamp >= timestamp) {
-            [self _seekToEntryWithKey:key];
-            return YES;
-        }
+    const long long key = [buffer_ firstKeyWithTimestampAtLeast:timestamp];
+    if (key < 0) {
+        return NO;
     }
-    return NO;
+    [self _seekToEntryWithKey:key];
+    return YES;
 }
 
 - (char*)decodedFrame
@@ -189,14 +186,19 @@
 #endif
         key = [buffer_ firstKey];
     }
-    // Find the key frame before 'key'.
+    // Find the key frame before 'key'. If the frame that's already decoded comes after it, start
+    // from there instead so stepping forward only applies one diff.
+    const long long decodedKey = key_;
+    key_ = -1;
     long long j = key;
-    while ([buffer_ entryForKey:j]->info.frameType != DVRFrameTypeKeyFrame) {
+    while (j != decodedKey && !DVRFrameTypeIsKeyFrame([buffer_ entryForKey:j]->info.frameType)) {
         assert(j != [buffer_ firstKey]);
         --j;
     }
 
-    [self _loadKeyFrameWithKey:j];
+    if (j != decodedKey && ![self _loadKeyFrameWithKey:j]) {
+        return;
+    }
 
 #ifdef DVRDEBUG
     [self debug:@"Key frame:" buffer:frame_ length:length_];
@@ -218,24 +220,50 @@
 #endif
 }
 
-- (void)_loadKeyFrameWithKey:(long long)key
+// Returns NO if the input was broken.
+- (BOOL)_loadKeyFrameWithKey:(long long)key
 {
     DVRIndexEntry* entry = [buffer_ entryForKey:key];
-    if (length_ != entry->frameLength && frame_) {
+    char* data = [buffer_ blockForKey:key];
+    const BOOL deflated = (entry->info.frameType == DVRFrameTypeDeflatedKeyFrame);
+    const BOOL compact = (deflated || entry->info.frameType == DVRFrameTypeCompactKeyFrame);
+    int length = entry->frameLength;
+    if (compact) {
+        const int cellCount = iTermDVRKeyFrameCellCount(data, entry->frameLength);
+        if (cellCount < 0 || cellCount > INT_MAX / (int)sizeof(screen_char_t)) {
+            return NO;
+        }
+        length = cellCount * sizeof(screen_char_t);
+    }
+    if (length_ != length && frame_) {
         free(frame_);
         frame_ = 0;
     }
-    length_ = entry->frameLength;
+    length_ = length;
 #ifdef DVRDEBUG
     NSLog(@"Frame length is %d", length_);
 #endif
     if (!frame_) {
-        frame_ = iTermMalloc(length_);
+        frame_ = iTermMalloc(MAX(1, length_));
     }
-    char* data = [buffer_ blockForKey:key];
     info_ = entry->info;
     DLog(@"Frame with key %lld has size %dx%d", key, info_.width, info_.height);
+    if (deflated) {
+        return iTermDVRDecodeDeflatedKeyFrame(data,
+                                              entry->frameLength,
+                                              sizeof(screen_char_t),
+                                              frame_,
+                                              length_ / sizeof(screen_char_t));
+    }
+    if (compact) {
+        return iTermDVRDecodeKeyFrame(data,
+                                      entry->frameLength,
+                                      sizeof(screen_char_t),
+                                      frame_,
+                                      length_ / sizeof(screen_char_t));
+    }
     memcpy(frame_,  data, length_);
+    return YES;
 }
 
 // Add two positive ints. Returns NO if it can't be done. Returns YES and places the result in
@@ -266,6 +294,13 @@ static BOOL NS_WARN_UNUSED_RESULT SafeIncr(int summand, int addend, int *sum) {
     DVRIndexEntry* entry = [buffer_ entryForKey:key];
     info_ = entry->info;
     char* diff = [buffer_ blockForKey:key];
+    if (entry->info.frameType == DVRFrameTypeCompactDiffFrame) {
+        return iTermDVRApplyDiffFrame(diff,
+                                      entry->frameLength,
+                                      sizeof(screen_char_t),
+                                      frame_,
+                                      length_ / sizeof(screen_char_t));
+    }
     int o = 0;
     for (int i = 0; i < entry->frameLength; ) {
 #ifdef DVRDEBUG
@@ -43,6 +43,12 @@
          cleanLines:(NSIndexSet *)cleanLines
                info:(DVRFrameInfo *)info;
 
+// Copies a frame that was encoded by another DVREncoder. It must follow the frame most recently
+// added to this encoder's buffer since it may be a diff against it. Call -[reserve:] first.
+- (void)appendEncodedFrame:(const char *)bytes
+                    length:(int)length
+                      info:(DVRFrameInfo *)info;
+
 // Allocate some number of bytes for an upcoming appendFrame call.
 // Returns true if some frames were freed to make room. The caller should
 // invalidate nonexistent leading frames in all decoders.
@@ -28,6 +28,9 @@
 #import "DVREncoder.h"
 #import "DebugLogging.h"
 #import "DVRIndexEntry.h"
+#import "iTermAdvancedSettingsModel.h"
+#import "iTermDVRCodec.h"
+#import "iTermMalloc.h"
 #include "LineBuffer.h"
 #include <sys/time.h>
 
@@ -50,8 +53,21 @@ static long long now()
     // Underlying buffer to write to. Not owned by us.
     DVRBuffer* buffer_;
 
-    // The last encoded frame.
-    NSMutableData* lastFrame_;
+    // The last encoded frame and how each of its rows was encoded, so key frames can copy rows
+    // that haven't changed or have only scrolled. Diffs update it in place.
+    iTermDVRRowCache *rowCache_;
+
+    // Length of the frame in rowCache_ in bytes, or 0 if the last frame wasn't encoded from lines.
+    int frameLength_;
+
+    // Row pointers handed to the encoders. Reused from frame to frame.
+    const void **rows_;
+    int rowsCapacity_;
+
+    // Key frames are encoded here before being deflated into the DVR buffer. Reused from frame to
+    // frame.
+    char *keyFrameEncoding_;
+    int keyFrameEncodingCapacity_;
 
     // Info from the last frame.
     DVRFrameInfo lastInfo_;
@@ -73,16 +89,18 @@ static long long now()
     self = [super init];
     if (self) {
         buffer_ = [buffer retain];
-        lastFrame_ = nil;
         count_ = 0;
         haveReservation_ = NO;
+        rowCache_ = iTermDVRRowCacheCreate();
     }
     return self;
 }
 
 - (void)dealloc
 {
-    [lastFrame_ release];
+    free(rows_);
+    free(keyFrameEncoding_);
+    iTermDVRRowCacheFree(rowCache_);
     [buffer_ release];
     [super dealloc];
 }
@@ -106,8 +124,8 @@ static long long now()
                info:(DVRFrameInfo*)info {
     BOOL eligibleForDiff;
     if (cleanLines.count > info->height * 0.8 &&
-        lastFrame_ &&
-        length == [lastFrame_ length] &&
+        frameLength_ > 0 &&
+        length == frameLength_ &&
         info->width == lastInfo_.width &&
         info->height == lastInfo_.height &&
         bytesSinceLastKeyFrame_ < [buffer_ capacity] / 2) {
@@ -119,12 +137,27 @@ static long long now()
     const int kKeyFrameFrequency = 100;
 
     if (!eligibleForDiff || count_++ % kKeyFrameFrequency == 0) {
-        [self _appendKeyFrame:frameLines length:length info:info];
+        [self _appendKeyFrame:frameLines length:length cleanLines:cleanLines info:info];
     } else {
         [self _appendDiffFrame:frameLines length:length cleanLines:cleanLines info:info];
     }
 }
 
+- (void)appendEncodedFrame:(const char *)bytes
+                    length:(int)length
+                      info:(DVRFrameInfo *)info {
+    char *scratch = [buffer_ scratch];
+    memcpy(scratch, bytes, length);
+    [self _appendFrameImpl:scratch length:length type:(DVRFrameType)info->frameType info:info];
+    if (DVRFrameTypeIsKeyFrame(info->frameType)) {
+        bytesSinceLastKeyFrame_ = 0;
+    } else {
+        bytesSinceLastKeyFrame_ += length;
+    }
+    // The frame wasn't decoded so the next call to appendFrame can't diff against it.
+    frameLength_ = 0;
+}
+
 - (BOOL)reserve:(int)length
 {
     haveReservation_ = YES;
@@ -136,7 +169,7 @@ static long long now()
     while (![buffer_ isEmpty] && hadToFree) {
         DVRIndexEntry* entry = [buffer_ entryForKey:[buffer_ firstKey]];
         assert(entry);
-        if (entry->info.frameType == DVRFrameTypeKeyFrame) {
+        if (DVRFrameTypeIsKeyFrame(entry->info.frameType)) {
             break;
         } else {
             [buffer_ deallocateBlock];
@@ -165,57 +198,109 @@ static long long now()
 #endif
 }
 
-- (NSMutableData *)combinedFrameLines:(NSArray *)frameLines {
-    NSMutableData *data = [[[NSMutableData alloc] init] autorelease];
-    for (NSData *line in frameLines) {
-        [data appendData:line];
-    }
-    return data;
-}
-
 // Save a key frame into DVRBuffer.
-- (void)_appendKeyFrame:(NSArray *)frameLines length:(int)length info:(DVRFrameInfo*)info
+- (void)_appendKeyFrame:(NSArray<NSData *> *)frameLines
+                 length:(int)length
+             cleanLines:(NSIndexSet *)cleanLines
+                   info:(DVRFrameInfo*)info
 {
-    [lastFrame_ release];
-    lastFrame_ = [[self combinedFrameLines:frameLines] retain];
-    assert(lastFrame_.length == length);
+    const int numLines = frameLines.count;
+    const int lineLength = numLines > 0 ? frameLines[0].length : 0;
+    assert(numLines * lineLength == length);
+    // Clean lines are the same as in the last frame, which rowCache_ only holds if it was
+    // encoded from lines of the same size.
+    const BOOL sameSize = (frameLength_ == length &&
+                           info->width == lastInfo_.width &&
+                           info->height == lastInfo_.height);
+    [self _setRowsFromLines:frameLines cleanLines:sameSize ? cleanLines : nil];
+    frameLength_ = length;
+
     char* scratch = [buffer_ scratch];
-    memcpy(scratch, [lastFrame_ mutableBytes], length);
-    [self _appendFrameImpl:scratch length:length type:DVRFrameTypeKeyFrame info:info];
+    const BOOL deflate = [iTermAdvancedSettingsModel compressInstantReplayKeyFrames];
+    if (deflate && keyFrameEncodingCapacity_ < reservation_) {
+        free(keyFrameEncoding_);
+        keyFrameEncoding_ = iTermMalloc(reservation_);
+        keyFrameEncodingCapacity_ = reservation_;
+    }
+    char *encoding = deflate ? keyFrameEncoding_ : scratch;
+    const size_t encodedLength = iTermDVREncodeKeyFrameRows(rowCache_,
+                                                            rows_,
+                                                            numLines,
+                                                            lineLength / sizeof(screen_char_t),
+                                                            sizeof(screen_char_t),
+                                                            encoding,
+                                                            reservation_);
+    if (encodedLength == 0) {
+        // Pathological content that doesn't compress. Store it as-is.
+        iTermDVRRowCacheCopyFrame(rowCache_, scratch);
+        [self _appendFrameImpl:scratch length:length type:DVRFrameTypeKeyFrame info:info];
+        bytesSinceLastKeyFrame_ = 0;
+        return;
+    }
+    if (deflate) {
+        const size_t deflatedLength = iTermDVRDeflateKeyFrame(encoding, encodedLength, scratch, reservation_);
+        if (deflatedLength > 0) {
+            [self _appendFrameImpl:scratch
+                            length:(int)deflatedLength
+                              type:DVRFrameTypeDeflatedKeyFrame
+                              info:info];
+            bytesSinceLastKeyFrame_ = 0;
+            return;
+        }
+        memcpy(scratch, encoding, encodedLength);
+    }
+    [self _appendFrameImpl:scratch
+                    length:(int)encodedLength
+                      type:DVRFrameTypeCompactKeyFrame
+                      info:info];
     bytesSinceLastKeyFrame_ = 0;
 }
 
+// Points rows_ at each line, or NULL for clean lines.
+- (void)_setRowsFromLines:(NSArray<NSData *> *)frameLines cleanLines:(NSIndexSet *)cleanLines {
+    const int numLines = frameLines.count;
+    if (numLines > rowsCapacity_) {
+        free(rows_);
+        rows_ = iTermMalloc(sizeof(*rows_) * numLines);
+        rowsCapacity_ = numLines;
+    }
+    for (int y = 0; y < numLines; y++) {
+        rows_[y] = [cleanLines containsIndex:y] ? NULL : frameLines[y].bytes;
+    }
+}
+
 // Save a diff frame into DVRBuffer.
-- (void)_appendDiffFrame:(NSArray *)frameLines
+- (void)_appendDiffFrame:(NSArray<NSData *> *)frameLines
                   length:(int)length
               cleanLines:(NSIndexSet *)cleanLines
                     info:(DVRFrameInfo *)info {
+    assert(length == frameLength_);
+    const int numLines = frameLines.count;
+    const int lineLength = numLines > 0 ? frameLines[0].length : 0;
+    [self _setRowsFromLines:frameLines cleanLines:cleanLines];
+
     char* scratch = [buffer_ scratch];
 #ifdef DVRDEBUG
     NSLog(@"Compute diff…");
 #endif
-    int diffBytes = [self _computeDiff:frameLines
-                                length:length
-                            cleanLines:cleanLines
-                                  dest:scratch
-                               maxSize:reservation_];
-    if (diffBytes < 0) {
+    const size_t diffBytes = iTermDVREncodeDiffFrame(rowCache_,
+                                                     rows_,
+                                                     numLines,
+                                                     lineLength / sizeof(screen_char_t),
+                                                     sizeof(screen_char_t),
+                                                     scratch,
+                                                     reservation_);
+    if (diffBytes == 0) {
 #ifdef DVRDEBUG
         NSLog(@"Abandon diff and append a key frame instead");
 #endif
-        // Diff ended up being larger than a key frame would be.
-        [self _appendKeyFrame:frameLines length:length info:info];
+        // Diff ended up being larger than the reservation. Clean lines are still unchanged in
+        // rowCache_.
+        [self _appendKeyFrame:frameLines length:length cleanLines:cleanLines info:info];
         return;
     }
 
-#ifdef DVRDEBUG2
-    int i;
-    screen_char_t* s = scratch;
-    for (i = 0; i < diffBytes; ++i) {
-        NSLog(@"Offset %d: %d (%c)", i, (int)scratch[i], scratch[i]);
-    }
-#endif
-    [self _appendFrameImpl:scratch length:diffBytes type:DVRFrameTypeDiffFrame info:info];
+    [self _appendFrameImpl:scratch length:(int)diffBytes type:DVRFrameTypeCompactDiffFrame info:info];
     bytesSinceLastKeyFrame_ += diffBytes;
 }
 
@@ -243,59 +328,4 @@ static long long now()
     DLog(@"Append frame with key %lld, size %dx%d", key, info->width, info->height);
 }
 
-// Calculate the diff between buffer,length and the previous frame. Saves results into
-// scratch. Won't use more than maxSize bytes in scratch. Returns number of bytes used or
-// -1 if the diff was larger than maxSize.
-- (int)_computeDiff:(NSArray<NSData *> *)frameLines
-             length:(int)length
-         cleanLines:(NSIndexSet *)cleanLines
-               dest:(char *)scratch
-            maxSize:(int)maxBytes {
-    assert(length == [lastFrame_ length]);
-
-    int o = 0;
-
-#ifdef DVRDEBUG
-    NSLog(@"Computing diff");
-#endif
-    const int numLines = [frameLines count];
-    const int numChars = numLines > 0 ? frameLines[0].length : 0;
-    for (int y = 0; y < numLines; y++) {
-        if ([cleanLines containsIndex:y]) {
-            if (o + 1 + sizeof(numChars) > maxBytes) {
-                // Diff is too big.
-                return -1;
-            }
-#ifdef DVRDEBUG
-            NSLog(@"Append samesequence at offset %@, address %p. No data is appended for samesequence.", @(o), scratch+o);
-#endif
-            scratch[o++] = kSameSequence;
-            memcpy(scratch + o, &numChars, sizeof(numChars));
-            o += sizeof(numChars);
-        } else {
-            if (o + 1 + sizeof(numChars) + numChars > maxBytes) {
-                // Diff is too big.
-                return -1;
-            }
-#ifdef DVRDEBUG
-            NSLog(@"Append diffsequence at offset %@ of length %@", @(o), @(numChars));
-#endif
-            scratch[o++] = kDiffSequence;
-            memcpy(scratch + o, &numChars, sizeof(numChars));
-            o += sizeof(numChars);
-            NSData *lineData = frameLines[y];
-            const char *frameLine = [lineData bytes];
-            memcpy(scratch + o, frameLine, numChars);
-            o += numChars;
-#ifdef DVRDEBUG
-            [self debug:@"Encoder: diff " buffer:frameLine length:numChars];
-#endif
-        }
-    }
-#ifdef DVRDEBUG
-    NSLog(@"Done computing diff");
-#endif
-    return o;
-}
-
 @end
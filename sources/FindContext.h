@@ -9,6 +9,8 @@
 #import <Foundation/Foundation.h>
 #import "iTermFindDriver.h"
 
+@class iTermTrigramQuery;
+
 typedef NS_OPTIONS(NSUInteger, FindOptions) {
     FindOptBackwards        = (1 << 0),
     FindMultipleResults     = (1 << 1)
@@ -60,6 +62,10 @@ typedef NS_ENUM(NSInteger, FindContextStatus) {
 
 @property(nonatomic, assign) NSTimeInterval maxTime;
 
+// Trigrams that a block must contain to hold a match, or nil to search every block. Set by
+// LineBuffer when preparing to search and cleared when the substring changes.
+@property(nonatomic, retain) iTermTrigramQuery *trigramQuery;
+
 // Estimate of fraction of work done.
 @property(nonatomic, assign) double progress;
 
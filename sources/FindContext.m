@@ -7,6 +7,7 @@
 //
 
 #import "FindContext.h"
+#import "iTermTrigramSignature.h"
 
 // Default max time per iteration of search.
 static const NSTimeInterval kDefaultMaxTime = 0.1;
@@ -48,6 +49,7 @@ static const NSTimeInterval kDefaultMaxTime = 0.1;
 - (void)dealloc {
     [results_ release];
     [substring_ release];
+    [_trigramQuery release];
     [super dealloc];
 }
 
@@ -69,6 +71,7 @@ static const NSTimeInterval kDefaultMaxTime = 0.1;
     self.results = other.results;
     self.hasWrapped = other.hasWrapped;
     self.maxTime = other.maxTime;
+    self.trigramQuery = other.trigramQuery;
 }
 
 - (void)reset {
@@ -77,6 +80,9 @@ static const NSTimeInterval kDefaultMaxTime = 0.1;
 }
 
 - (void)setSubstring:(NSString *)substring {
+    if (![substring isEqualToString:substring_]) {
+        self.trigramQuery = nil;
+    }
     [substring_ autorelease];
     substring_ = [substring copy];
 }
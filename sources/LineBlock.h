@@ -25,14 +25,33 @@ typedef struct {
     NSInteger generation;
 } LineBlockMetadata;
 
+@class iTermScrollbackSegmentFile;
+@class iTermTrigramQuery;
 @class LineBlock;
+@class iTermDeferredLineBlockCopy;
 
 @protocol iTermLineBlockObserver<NSObject>
 - (void)lineBlockDidChange:(LineBlock *)lineBlock;
+
+@optional
+// Called when a compact or compressed block had to be expanded, in whole or one line at a time,
+// because its cells were needed.
+- (void)lineBlockDidExpand:(LineBlock *)lineBlock;
+
+// Called when a block switches to its compressed representation after -compressOnQueue:.
+- (void)lineBlockDidCompress:(LineBlock *)lineBlock;
 @end
 
 // LineBlock represents an ordered collection of lines of text. It stores them contiguously
 // in a buffer.
+//
+// Threading: a block is used by one thread at a time, and even methods that only read it may
+// update caches or expand it. The blocks of a session's line buffer belong to the main thread.
+// A detached copy of a line buffer (see -[LineBuffer newDetachedCopy]) gets its own blocks,
+// which belong to whatever thread calls -finishDetachedCopy. The exceptions are:
+// - -compressOnQueue: works on another queue and installs its result on the main queue, so it
+//   does nothing for blocks that don't belong to the main thread.
+// - -[iTermDeferredLineBlockCopy lineBlock] may be called on any thread.
 @interface LineBlock : NSObject <NSCopying, iTermUniquelyIdentifiable>
 
 // Once this is set to true, it stays true. If double width characters are
@@ -79,6 +98,10 @@ typedef struct {
 // Get the number of lines in this block at a given screen width.
 - (int)getNumLinesWithWrapWidth:(int)width;
 
+// Like getNumLinesWithWrapWidth: but doesn't replace the cached count for the display width. The
+// result is cached until the block's generation changes.
+- (int)numLinesForEncodingWithWrapWidth:(int)width;
+
 // Returns whether getNumLinesWithWrapWidth will be fast.
 - (BOOL)hasCachedNumLinesForWidth:(int)width;
 
@@ -117,6 +140,36 @@ typedef struct {
 // Remove extra space from the end of the buffer. Future appends will fail.
 - (void)shrinkToFit;
 
+// Replace the raw buffer with a compact encoding (see iTermCompactCells.h). Line lengths and
+// metadata are unaffected. -getWrappedLineWithWrapWidth:... and -convertPosition:... decode only
+// the raw lines they look at. Other methods that need cells, such as searching or appending,
+// transparently expand the whole block again.
+- (void)compact;
+
+// Is the block currently stored in compact form? This includes compressed blocks.
+- (BOOL)isCompact;
+
+// Deflate the compact cells of a block that is not expected to be used soon. The work happens on
+// |queue|; the block switches to the compressed representation on the main queue afterwards,
+// unless it was expanded or modified in the meantime. Does nothing if the block isn't compact or
+// this isn't the main thread, since the block must belong to the main thread (see above).
+- (void)compressOnQueue:(dispatch_queue_t)queue;
+
+// Is the block currently compressed? This includes spilled blocks.
+- (BOOL)isCompressed;
+
+// Number of bytes of heap used by compressed cells. 0 if not compressed or spilled.
+- (NSUInteger)compressedSize;
+
+// Moves the compressed cells of a compressed block to the end of |segmentFile| and reads them back
+// through a memory mapping from then on. Returns NO if the block isn't compressed, is already
+// spilled, or the write fails, in which case the block is unchanged. Main thread only, like
+// compression.
+- (BOOL)spillToSegmentFile:(iTermScrollbackSegmentFile *)segmentFile;
+
+// Are the block's cells stored in a segment file?
+- (BOOL)isSpilled;
+
 // Return a raw line
 - (screen_char_t *)rawLine:(int)linenum;
 
@@ -144,6 +197,10 @@ typedef struct {
               results:(NSMutableArray*)results
       multipleResults:(BOOL)multipleResults;
 
+// Returns NO if the block's trigram signature proves that no line in it can match |query|. Returns
+// YES when there is no query or the block isn't indexed. Doesn't expand a compacted block.
+- (BOOL)mayContainMatchesForQuery:(iTermTrigramQuery *)query;
+
 // Tries to convert a byte offset into the block to an x,y coordinate relative to the first char
 // in the block. Returns YES on success, NO if the position is out of range.
 //
@@ -203,8 +260,9 @@ int iTermLineBlockNumberOfFullLinesImpl(screen_char_t *buffer,
 // The slow code for dealing with DWCs is run only if mayHaveDwc is YES.
 int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL mayHaveDwc);
 
-// Returns a dictionary with the contents of this block. The data is a weak reference and will be
-// invalid if the block is changed.
+// Returns a dictionary with the contents of this block. The cells, line lengths, and metadata are
+// packed into a single NSData in a versioned binary format. Dictionaries in the older format, with
+// a value per field, can still be passed to +blockWithDictionary:.
 - (NSDictionary *)dictionary;
 
 // Number of empty lines at the end of the block.
@@ -219,4 +277,17 @@ void EnableDoubleWidthCharacterLineCache(void);
 
 - (void)setPartial:(BOOL)partial;
 
+// Main thread only. Cheap regardless of the size of the block. See iTermDeferredLineBlockCopy.
+- (iTermDeferredLineBlockCopy *)newDeferredCopy;
+
+@end
+
+// A copy of a line block as it was when -newDeferredCopy was called. The cells, line lengths, and
+// metadata are copied the first time -lineBlock is called, which may be on any thread, or on the
+// main thread just before the block changes, whichever comes first.
+@interface iTermDeferredLineBlockCopy : NSObject
+
+// Always returns the same copy. Nothing else may use it until this returns.
+- (LineBlock *)lineBlock;
+
 @end
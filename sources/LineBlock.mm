@@ -11,12 +11,34 @@ extern "C" {
 
 #import "DebugLogging.h"
 #import "FindContext.h"
+#import "iTermCompactCells.h"
+#import "iTermLineSearchKernel.h"
 #import "iTermMalloc.h"
+#import "iTermScrollbackSegmentFile.h"
+#import "iTermTrigramSignature.h"
 #import "LineBufferHelpers.h"
 #import "NSBundle+iTerm.h"
 #import "RegexKitLite.h"
 #import "iTermAdvancedSettingsModel.h"
+
+// ICU's regex API, which find uses directly so it can search the text in its scratch buffer
+// without making a string of it. libicucore's headers aren't in the SDK, so these are declared
+// here the way RegexKitLite declares them.
+typedef struct URegularExpression URegularExpression;
+URegularExpression *uregex_open(const unichar *pattern,
+                                int32_t patternLength,
+                                uint32_t flags,
+                                void *parseError,
+                                int32_t *status);
+void uregex_close(URegularExpression *regexp);
+void uregex_setText(URegularExpression *regexp, const unichar *text, int32_t textLength, int32_t *status);
+BOOL uregex_findNext(URegularExpression *regexp, int32_t *status);
+int32_t uregex_start(URegularExpression *regexp, int32_t groupNum, int32_t *status);
+int32_t uregex_end(URegularExpression *regexp, int32_t groupNum, int32_t *status);
 }
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -33,6 +55,40 @@ NSString *const kLineBlockIsPartialKey = @"Is Partial";
 NSString *const kLineBlockMetadataKey = @"Metadata";
 NSString *const kLineBlockMayHaveDWCKey = @"May Have Double Width Character";
 NSString *const kLineBlockGuid = @"GUID";
+NSString *const kLineBlockBinaryKey = @"Binary";
+
+// Blocks are saved as an iTermLineBlockBinaryHeader followed by numberOfLines int32 cumulative line
+// lengths, numberOfLines iTermLineBlockBinaryMetadata records, and the cells up to the last
+// cumulative line length. Everything is in host byte order.
+static const uint32_t iTermLineBlockBinaryMagic = 0x424c5469;  // "iTLB" in little-endian order
+static const uint32_t iTermLineBlockBinaryVersion = 1;
+
+typedef NS_OPTIONS(uint32_t, iTermLineBlockBinaryFlags) {
+    iTermLineBlockBinaryFlagPartial = 1 << 0,
+    iTermLineBlockBinaryFlagMayHaveDoubleWidthCharacter = 1 << 1
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    // Guards against reading cells saved with a different screen_char_t layout.
+    uint32_t cellSize;
+    iTermLineBlockBinaryFlags flags;
+    int32_t bufferSize;
+    int32_t startOffset;
+    int32_t firstEntry;
+    int32_t numberOfLines;
+} iTermLineBlockBinaryHeader;
+
+typedef struct {
+    double timestamp;
+    uint16_t continuationCode;
+    uint8_t continuationBackgroundColor;
+    uint8_t continuationBgGreen;
+    uint8_t continuationBgBlue;
+    uint8_t continuationBackgroundColorMode;
+    uint8_t unused[2];
+} iTermLineBlockBinaryMetadata;
 
 static NSInteger LineBlockNextGeneration = -1;
 
@@ -73,6 +129,33 @@ struct iTermNumFullLinesCacheKeyHasher {
     }
 };
 
+@interface LineBlock ()
+- (void)expandCompactCells;
+- (void)makeDeferredCopies;
+- (LineBlock *)lineBlockForDeferredCopy:(iTermDeferredLineBlockCopy *)deferredCopy;
+- (void)forgetDeferredCopy:(iTermDeferredLineBlockCopy *)deferredCopy;
+@end
+
+@implementation iTermDeferredLineBlockCopy {
+@package
+    LineBlock *_source;
+    // Set while holding _source's deferred copies lock.
+    LineBlock *_copy;
+}
+
+- (void)dealloc {
+    [_source forgetDeferredCopy:self];
+    [_source release];
+    [_copy release];
+    [super dealloc];
+}
+
+- (LineBlock *)lineBlock {
+    return [_source lineBlockForDeferredCopy:self];
+}
+
+@end
+
 @implementation LineBlock {
     // The raw lines, end-to-end. There is no delimiter between each line.
     screen_char_t* raw_buffer;
@@ -106,11 +189,59 @@ struct iTermNumFullLinesCacheKeyHasher {
     // cached_numlines is correct.
     int cached_numlines_width;
 
+    // A second line count used when saving state, which wraps at a fixed width that is rarely the
+    // display width. It's valid while _generation equals _encodingNumLinesGeneration.
+    int _encodingNumLines;
+    int _encodingNumLinesWidth;
+    NSInteger _encodingNumLinesGeneration;
+
     // Keys are (offset from raw_buffer, length to examine, width).
     std::unordered_map<iTermNumFullLinesCacheKey, int, iTermNumFullLinesCacheKeyHasher> _numberOfFullLinesCache;
 
     std::vector<void *> _observers;
     NSString *_guid;
+
+    // When the block has been compacted, raw_buffer and buffer_start are NULL and the cells from
+    // start_offset to the end of the used space are stored here instead. Line lengths and metadata
+    // are never compacted so wrapped-line arithmetic doesn't need the cells (except to look for
+    // double-width characters). Cold blocks are further compressed into _compressedCells.
+    iTermCompactCells *_compactCells;
+
+    // A cold block's compact cells, deflated. When this is set, _compactCells is NULL.
+    NSData *_compressedCells;
+
+    // Raw lines of a compact block that have been read, keyed by entry. Each is decoded the first
+    // time it's needed so that showing a few lines doesn't expand the whole block. Like pointers
+    // into raw_buffer they stay valid until the block is compacted again.
+    std::unordered_map<int, screen_char_t *> _expandedLines;
+
+    // If set, _compressedCells is a mapping of a scrollback segment file rather than heap memory.
+    BOOL _spilled;
+
+    // Set while a copy of _compactCells is being compressed on a background queue.
+    BOOL _compressionPending;
+
+    // Trigrams of every line ever appended since the block was last emptied, or NULL if scrollback
+    // isn't indexed. _trigramChain holds the tail of line _trigramChainEntry so appending to a
+    // partial line doesn't need to index it from the start. -1 means the chain is invalid.
+    iTermTrigramSignature *_trigramSignature;
+    iTermTrigramChain _trigramChain;
+    int _trigramChainEntry;
+
+    // Deferred copies that haven't been made yet. These are unretained; each one removes itself
+    // when it is deallocated. Another thread may make a copy while holding the lock, so the main
+    // thread makes them all before changing anything they would read.
+    std::mutex _deferredCopiesLock;
+    std::vector<void *> _deferredCopies;
+    std::atomic<int> _numberOfDeferredCopies;
+}
+
+// Call before changing anything -copyWithoutCaches reads. Only the main thread adds deferred
+// copies, so when it sees none there is nobody to wait for.
+NS_INLINE void iTermLineBlockWillChange(__unsafe_unretained LineBlock *lineBlock) {
+    if (lineBlock->_numberOfDeferredCopies.load(std::memory_order_acquire) > 0) {
+        [lineBlock makeDeferredCopies];
+    }
 }
 
 NS_INLINE void iTermLineBlockDidChange(__unsafe_unretained LineBlock *lineBlock) {
@@ -121,6 +252,12 @@ NS_INLINE void iTermLineBlockDidChange(__unsafe_unretained LineBlock *lineBlock)
     }
 }
 
+NS_INLINE void iTermLineBlockExpandIfNeeded(__unsafe_unretained LineBlock *lineBlock) {
+    if (lineBlock->_compactCells || lineBlock->_compressedCells) {
+        [lineBlock expandCompactCells];
+    }
+}
+
 - (instancetype)init {
     self = [super init];
     if (self) {
@@ -156,9 +293,14 @@ NS_INLINE void iTermLineBlockDidChange(__unsafe_unretained LineBlock *lineBlock)
         _guid = [[[NSUUID UUID] UUIDString] retain];
     }
     cached_numlines_width = -1;
+    _encodingNumLinesWidth = -1;
     if (cll_capacity > 0) {
         metadata_ = (LineBlockMetadata *)iTermCalloc(sizeof(LineBlockMetadata), cll_capacity);
     }
+    if ([iTermAdvancedSettingsModel indexScrollbackForSearch]) {
+        _trigramSignature = (iTermTrigramSignature *)iTermCalloc(1, sizeof(iTermTrigramSignature));
+    }
+    _trigramChainEntry = -1;
 }
 
 + (instancetype)blockWithDictionary:(NSDictionary *)dictionary {
@@ -166,6 +308,10 @@ NS_INLINE void iTermLineBlockDidChange(__unsafe_unretained LineBlock *lineBlock)
 }
 
 - (instancetype)initWithDictionary:(NSDictionary *)dictionary {
+    NSData *binary = dictionary[kLineBlockBinaryKey];
+    if (binary) {
+        return [self initWithBinaryRepresentation:binary guid:dictionary[kLineBlockGuid]];
+    }
     self = [super init];
     if (self) {
         NSArray *requiredKeys = @[ kLineBlockRawBufferKey,
@@ -222,6 +368,100 @@ NS_INLINE void iTermLineBlockDidChange(__unsafe_unretained LineBlock *lineBlock)
         cll_entries = cll_capacity;
         is_partial = [dictionary[kLineBlockIsPartialKey] boolValue];
         _mayHaveDoubleWidthCharacter = [dictionary[kLineBlockMayHaveDWCKey] boolValue];
+        for (int i = first_entry; i < cll_entries; i++) {
+            [self addTrigramsOfLine:i];
+        }
+    }
+    return self;
+}
+
+// Decodes the output of -binaryRepresentation. The cells are copied once, straight into the new
+// raw buffer.
+- (instancetype)initWithBinaryRepresentation:(NSData *)data guid:(NSString *)guid {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+    const unsigned char *bytes = (const unsigned char *)data.bytes;
+    const NSUInteger length = data.length;
+    iTermLineBlockBinaryHeader header;
+    if (![data isKindOfClass:[NSData class]] || length < sizeof(header)) {
+        [self autorelease];
+        return nil;
+    }
+    memcpy(&header, bytes, sizeof(header));
+    if (header.magic != iTermLineBlockBinaryMagic ||
+        header.version != iTermLineBlockBinaryVersion ||
+        header.cellSize != sizeof(screen_char_t) ||
+        header.numberOfLines < 0 ||
+        header.bufferSize < 0 ||
+        header.firstEntry < 0 ||
+        header.firstEntry > header.numberOfLines) {
+        DLog(@"Bad line block header");
+        [self autorelease];
+        return nil;
+    }
+    const NSUInteger cllOffset = sizeof(header);
+    const NSUInteger metadataOffset = cllOffset + sizeof(int32_t) * (NSUInteger)header.numberOfLines;
+    const NSUInteger cellsOffset = metadataOffset + sizeof(iTermLineBlockBinaryMetadata) * (NSUInteger)header.numberOfLines;
+    if (length < cellsOffset) {
+        [self autorelease];
+        return nil;
+    }
+
+    cll_capacity = header.numberOfLines;
+    cumulative_line_lengths = (int *)iTermMalloc(sizeof(int) * MAX(1, cll_capacity));
+    memcpy(cumulative_line_lengths, bytes + cllOffset, sizeof(int32_t) * cll_capacity);
+    int previous = 0;
+    for (int i = 0; i < cll_capacity; i++) {
+        if (cumulative_line_lengths[i] < previous) {
+            DLog(@"Cumulative line lengths aren't monotonic");
+            [self autorelease];
+            return nil;
+        }
+        previous = cumulative_line_lengths[i];
+    }
+    const int rawSpaceUsed = previous;
+    if (rawSpaceUsed > header.bufferSize ||
+        header.startOffset < 0 ||
+        header.startOffset > rawSpaceUsed ||
+        length != cellsOffset + sizeof(screen_char_t) * (NSUInteger)rawSpaceUsed) {
+        DLog(@"Line block cells don't match its header");
+        [self autorelease];
+        return nil;
+    }
+
+    buffer_size = header.bufferSize;
+    raw_buffer = (screen_char_t *)iTermMalloc(MAX(1, buffer_size) * sizeof(screen_char_t));
+    memcpy(raw_buffer, bytes + cellsOffset, sizeof(screen_char_t) * rawSpaceUsed);
+    start_offset = header.startOffset;
+    buffer_start = raw_buffer + start_offset;
+    first_entry = header.firstEntry;
+    if ([guid isKindOfClass:[NSString class]]) {
+        _guid = [guid copy];
+        DLog(@"Restore block %p with guid %@", self, _guid);
+    }
+    [self commonInit];
+
+    const unsigned char *metadataBytes = bytes + metadataOffset;
+    for (int i = 0; i < cll_capacity; i++) {
+        iTermLineBlockBinaryMetadata record;
+        memcpy(&record, metadataBytes + i * sizeof(record), sizeof(record));
+        metadata_[i].continuation.code = record.continuationCode;
+        metadata_[i].continuation.backgroundColor = record.continuationBackgroundColor;
+        metadata_[i].continuation.bgGreen = record.continuationBgGreen;
+        metadata_[i].continuation.bgBlue = record.continuationBgBlue;
+        metadata_[i].continuation.backgroundColorMode = record.continuationBackgroundColorMode;
+        metadata_[i].timestamp = record.timestamp;
+        metadata_[i].number_of_wrapped_lines = 0;
+        metadata_[i].generation = LineBlockNextGeneration--;
+    }
+
+    cll_entries = cll_capacity;
+    is_partial = !!(header.flags & iTermLineBlockBinaryFlagPartial);
+    _mayHaveDoubleWidthCharacter = !!(header.flags & iTermLineBlockBinaryFlagMayHaveDoubleWidthCharacter);
+    for (int i = first_entry; i < cll_entries; i++) {
+        [self addTrigramsOfLine:i];
     }
     return self;
 }
@@ -231,6 +471,11 @@ NS_INLINE void iTermLineBlockDidChange(__unsafe_unretained LineBlock *lineBlock)
     if (raw_buffer) {
         free(raw_buffer);
     }
+    if (_compactCells) {
+        iTermCompactCellsFree(_compactCells);
+    }
+    [_compressedCells release];
+    [self freeExpandedLines];
     if (cumulative_line_lengths) {
         free(cumulative_line_lengths);
     }
@@ -242,41 +487,236 @@ NS_INLINE void iTermLineBlockDidChange(__unsafe_unretained LineBlock *lineBlock)
         }
         free(metadata_);
     }
+    if (_trigramSignature) {
+        free(_trigramSignature);
+    }
     [_guid release];
     [super dealloc];
 }
 
 - (LineBlock *)copyWithZone:(NSZone *)zone {
+    LineBlock *theCopy = [self copyWithoutCaches];
+    theCopy->cached_numlines = cached_numlines;
+    theCopy->cached_numlines_width = cached_numlines_width;
+    return theCopy;
+}
+
+// Copies everything except caches that reads fill in, so it's safe to do on another thread while
+// the main thread reads (but doesn't change) this block.
+- (LineBlock *)copyWithoutCaches {
     LineBlock *theCopy = [[LineBlock alloc] init];
-    theCopy->raw_buffer = (screen_char_t*)iTermMalloc(sizeof(screen_char_t) * buffer_size);
-    memmove(theCopy->raw_buffer, raw_buffer, sizeof(screen_char_t) * buffer_size);
-    size_t bufferStartOffset = (buffer_start - raw_buffer);
-    theCopy->buffer_start = theCopy->raw_buffer + bufferStartOffset;
+    if (_compressedCells) {
+        theCopy->_compressedCells = [_compressedCells retain];
+        theCopy->_spilled = _spilled;
+    } else if (_compactCells) {
+        theCopy->_compactCells = iTermCompactCellsCopy(_compactCells);
+    } else {
+        theCopy->raw_buffer = (screen_char_t*)iTermMalloc(sizeof(screen_char_t) * buffer_size);
+        memmove(theCopy->raw_buffer, raw_buffer, sizeof(screen_char_t) * buffer_size);
+        theCopy->buffer_start = theCopy->raw_buffer + start_offset;
+    }
     theCopy->start_offset = start_offset;
     theCopy->first_entry = first_entry;
     theCopy->buffer_size = buffer_size;
-    size_t cll_size = sizeof(int) * cll_capacity;
-    theCopy->cumulative_line_lengths = (int*)iTermMalloc(cll_size);
-    memmove(theCopy->cumulative_line_lengths, cumulative_line_lengths, cll_size);
-    theCopy->metadata_ = (LineBlockMetadata *)iTermMalloc(sizeof(LineBlockMetadata) * cll_capacity);
-    memmove(theCopy->metadata_, metadata_, sizeof(LineBlockMetadata) * cll_capacity);
-    for (int i = 0; i < cll_capacity; i++) {
-        theCopy->metadata_[i].width_for_number_of_wrapped_lines = 0;
-        theCopy->metadata_[i].number_of_wrapped_lines = 0;
-        if (gEnableDoubleWidthCharacterLineCache) {
-            theCopy->metadata_[i].double_width_characters = nil;
-        }
+    theCopy->cumulative_line_lengths = (int*)iTermMalloc(sizeof(int) * cll_capacity);
+    memmove(theCopy->cumulative_line_lengths, cumulative_line_lengths, sizeof(int) * cll_entries);
+    // Field by field because the others are caches.
+    theCopy->metadata_ = (LineBlockMetadata *)iTermCalloc(cll_capacity, sizeof(LineBlockMetadata));
+    for (int i = 0; i < cll_entries; i++) {
+        theCopy->metadata_[i].timestamp = metadata_[i].timestamp;
+        theCopy->metadata_[i].continuation = metadata_[i].continuation;
+        theCopy->metadata_[i].generation = metadata_[i].generation;
     }
     theCopy->cll_capacity = cll_capacity;
     theCopy->cll_entries = cll_entries;
     theCopy->is_partial = is_partial;
-    theCopy->cached_numlines = cached_numlines;
-    theCopy->cached_numlines_width = cached_numlines_width;
     theCopy->_generation = _generation;
-    
+    theCopy->_mayHaveDoubleWidthCharacter = _mayHaveDoubleWidthCharacter;
+    if (_trigramSignature && theCopy->_trigramSignature) {
+        memcpy(theCopy->_trigramSignature, _trigramSignature, sizeof(*_trigramSignature));
+        theCopy->_trigramChain = _trigramChain;
+        theCopy->_trigramChainEntry = _trigramChainEntry;
+    } else if (theCopy->_trigramSignature) {
+        // Can't index a copy of an unindexed block without expanding it, so leave it unindexed.
+        free(theCopy->_trigramSignature);
+        theCopy->_trigramSignature = NULL;
+    }
+
     return theCopy;
 }
 
+#pragma mark - Compaction
+
+- (void)compact {
+    // Lines read since the block was last compacted are dropped along with the raw buffer.
+    [self freeExpandedLines];
+    if (_compactCells || _compressedCells || !raw_buffer) {
+        return;
+    }
+    iTermLineBlockWillChange(self);
+    _compactCells = iTermCompactCellsCreate(buffer_start, [self rawSpaceUsed] - start_offset);
+    free(raw_buffer);
+    raw_buffer = NULL;
+    buffer_start = NULL;
+}
+
+- (BOOL)isCompact {
+    return _compactCells != NULL || _compressedCells != nil;
+}
+
+- (BOOL)isCompressed {
+    return _compressedCells != nil;
+}
+
+- (void)compressOnQueue:(dispatch_queue_t)queue {
+    if (!_compactCells || _compressionPending) {
+        return;
+    }
+    if (![NSThread isMainThread]) {
+        // The result is installed on the main queue, which doesn't own this block.
+        return;
+    }
+    // The background queue gets its own copy because the block may be expanded (freeing
+    // _compactCells) before compression finishes.
+    iTermCompactCells *snapshot = iTermCompactCellsCopy(_compactCells);
+    const NSInteger generation = _generation;
+    _compressionPending = YES;
+    dispatch_async(queue, ^{
+        NSData *compressed = iTermCompactCellsCompress(snapshot);
+        const size_t uncompressedSize = iTermCompactCellsSize(snapshot);
+        iTermCompactCellsFree(snapshot);
+        [compressed retain];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            _compressionPending = NO;
+            // Install the result only if the block still holds exactly the cells that were
+            // compressed and compression actually saved memory.
+            if (compressed &&
+                _compactCells &&
+                _generation == generation &&
+                compressed.length < uncompressedSize) {
+                iTermLineBlockWillChange(self);
+                iTermCompactCellsFree(_compactCells);
+                _compactCells = NULL;
+                _compressedCells = [compressed retain];
+                for (auto &observer : _observers) {
+                    __unsafe_unretained id<iTermLineBlockObserver> obj = static_cast<id<iTermLineBlockObserver> >(observer);
+                    if ([obj respondsToSelector:@selector(lineBlockDidCompress:)]) {
+                        [obj lineBlockDidCompress:self];
+                    }
+                }
+            }
+            [compressed release];
+        });
+    });
+}
+
+- (NSUInteger)compressedSize {
+    return _spilled ? 0 : _compressedCells.length;
+}
+
+- (BOOL)isSpilled {
+    return _spilled;
+}
+
+- (BOOL)spillToSegmentFile:(iTermScrollbackSegmentFile *)segmentFile {
+    if (!_compressedCells || _spilled) {
+        return NO;
+    }
+    iTermLineBlockWillChange(self);
+    NSData *mapped = [segmentFile appendData:_compressedCells];
+    if (!mapped) {
+        return NO;
+    }
+    [_compressedCells release];
+    _compressedCells = mapped;
+    _spilled = YES;
+    return YES;
+}
+
+- (iTermCompactCells *)decompressedCells {
+    iTermCompactCells *compact = iTermCompactCellsDecompress(_compressedCells);
+    ITAssertWithMessage(compact, @"Failed to decompress %@ bytes of scrollback", @(_compressedCells.length));
+    return compact;
+}
+
+- (void)decompressIfNeeded {
+    if (!_compressedCells) {
+        return;
+    }
+    iTermLineBlockWillChange(self);
+    assert(!_compactCells);
+    _compactCells = [self decompressedCells];
+    [_compressedCells release];
+    _compressedCells = nil;
+    _spilled = NO;
+}
+
+- (void)freeExpandedLines {
+    for (auto &pair : _expandedLines) {
+        free(pair.second);
+    }
+    _expandedLines.clear();
+}
+
+- (void)notifyObserversOfExpansion {
+    for (auto &observer : _observers) {
+        __unsafe_unretained id<iTermLineBlockObserver> obj = static_cast<id<iTermLineBlockObserver> >(observer);
+        if ([obj respondsToSelector:@selector(lineBlockDidExpand:)]) {
+            [obj lineBlockDidExpand:self];
+        }
+    }
+}
+
+// Returns the cells of raw line |entry| of a compact block, decoding only that line.
+- (screen_char_t *)cellsOfCompactLine:(int)entry {
+    auto it = _expandedLines.find(entry);
+    if (it != _expandedLines.end()) {
+        return it->second;
+    }
+    const BOOL wasCompressed = (_compressedCells != nil);
+    [self decompressIfNeeded];
+    const int start = [self _lineRawOffset:entry];
+    const int length = cumulative_line_lengths[entry] - start;
+    screen_char_t *cells = (screen_char_t *)iTermMalloc(sizeof(screen_char_t) * MAX(1, length));
+    iTermCompactCellsExpandRange(_compactCells, start - start_offset, length, cells);
+    const BOOL isFirst = _expandedLines.empty();
+    _expandedLines[entry] = cells;
+    if (isFirst || wasCompressed) {
+        // Lets the owner recompact it once it's no longer being looked at.
+        [self notifyObserversOfExpansion];
+    }
+    return cells;
+}
+
+// Returns the cells from raw offset |offset| on, which must be within a non-empty raw line.
+- (screen_char_t *)cellsAtRawOffset:(int)offset {
+    if (raw_buffer) {
+        return raw_buffer + offset;
+    }
+    // The line containing |offset| is the first one that ends after it.
+    const int entry = (int)(std::upper_bound(cumulative_line_lengths + first_entry,
+                                             cumulative_line_lengths + cll_entries,
+                                             offset) - cumulative_line_lengths);
+    assert(entry < cll_entries);
+    return [self cellsOfCompactLine:entry] + (offset - [self _lineRawOffset:entry]);
+}
+
+- (void)expandCompactCells {
+    iTermLineBlockWillChange(self);
+    [self decompressIfNeeded];
+    assert(_compactCells);
+    raw_buffer = (screen_char_t *)iTermMalloc(sizeof(screen_char_t) * MAX(1, buffer_size));
+    // Dropped cells are never read but don't leave uninitialized memory where -dictionary can see it.
+    memset(raw_buffer, 0, sizeof(screen_char_t) * start_offset);
+    buffer_start = raw_buffer + start_offset;
+    iTermCompactCellsExpand(_compactCells, buffer_start);
+    iTermCompactCellsFree(_compactCells);
+    _compactCells = NULL;
+    [self notifyObserversOfExpansion];
+}
+
+#pragma mark -
+
 - (int)rawSpaceUsed {
     if (cll_entries == 0) {
         return 0;
@@ -322,6 +762,7 @@ static char* formatsct(screen_char_t* src, int len, char* dest) {
 
 - (void)appendToDebugString:(NSMutableString *)s
 {
+    iTermLineBlockExpandIfNeeded(self);
     char temp[1000];
     int i;
     int prev;
@@ -343,6 +784,7 @@ static char* formatsct(screen_char_t* src, int len, char* dest) {
 }
 
 - (void)dump:(int)rawOffset toDebugLog:(BOOL)toDebugLog {
+    iTermLineBlockExpandIfNeeded(self);
     if (toDebugLog) {
         DLog(@"numRawLines=%@", @([self numRawLines]));
     } else {
@@ -378,7 +820,12 @@ static char* formatsct(screen_char_t* src, int len, char* dest) {
     auto it = insertResult.first;
     auto wasInserted = insertResult.second;
     if (wasInserted) {
-        result = iTermLineBlockNumberOfFullLinesImpl(raw_buffer + offset,
+        screen_char_t *cells = NULL;
+        if (_mayHaveDoubleWidthCharacter && width > 1 && length > width) {
+            // Where lines wrap depends on where the DWC_RIGHTs are, so the cells are needed.
+            cells = [self cellsAtRawOffset:offset];
+        }
+        result = iTermLineBlockNumberOfFullLinesImpl(cells,
                                                      length,
                                                      width,
                                                      _mayHaveDoubleWidthCharacter);
@@ -436,6 +883,8 @@ extern "C" int iTermLineBlockNumberOfFullLinesImpl(screen_char_t *buffer,
              width:(int)width
          timestamp:(NSTimeInterval)timestamp
       continuation:(screen_char_t)continuation {
+    iTermLineBlockWillChange(self);
+    iTermLineBlockExpandIfNeeded(self);
     _numberOfFullLinesCache.clear();
     const int space_used = [self rawSpaceUsed];
     const int free_space = buffer_size - space_used - start_offset;
@@ -469,16 +918,17 @@ extern "C" int iTermLineBlockNumberOfFullLinesImpl(screen_char_t *buffer,
             int prev_cll = cll_entries > first_entry + 1 ? cumulative_line_lengths[cll_entries - 2] - start_offset : 0;
             int cll = cumulative_line_lengths[cll_entries - 1] - start_offset;
             int old_length = cll - prev_cll;
-            int oldnum = [self numberOfFullLinesFromOffset:(buffer_start - raw_buffer) + prev_cll
+            int oldnum = [self numberOfFullLinesFromOffset:start_offset + prev_cll
                                                     length:old_length
                                                      width:width];
-            int newnum = [self numberOfFullLinesFromOffset:(buffer_start - raw_buffer) + prev_cll
+            int newnum = [self numberOfFullLinesFromOffset:start_offset + prev_cll
                                                     length:old_length + length
                                                      width:width];
             cached_numlines += newnum - oldnum;
         }
 
         cumulative_line_lengths[cll_entries - 1] += length;
+        [self addTrigramsOfCells:buffer length:length continuingLastLine:YES];
         metadata_[cll_entries - 1].timestamp = timestamp;
         metadata_[cll_entries - 1].continuation = continuation;
         metadata_[cll_entries - 1].number_of_wrapped_lines = 0;
@@ -496,6 +946,7 @@ extern "C" int iTermLineBlockNumberOfFullLinesImpl(screen_char_t *buffer,
         [self _appendCumulativeLineLength:(space_used + length)
                                 timestamp:timestamp
                              continuation:continuation];
+        [self addTrigramsOfCells:buffer length:length continuingLastLine:NO];
         if (width != cached_numlines_width) {
             cached_numlines_width = -1;
         } else {
@@ -648,7 +1099,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
     for (i = first_entry; i < cll_entries; ++i) {
         int cll = cumulative_line_lengths[i] - start_offset;
         length = cll - prev;
-        const int spans = [self numberOfFullLinesFromOffset:(buffer_start - raw_buffer) + prev
+        const int spans = [self numberOfFullLinesFromOffset:start_offset + prev
                                                      length:length
                                                       width:width];
         if (lineNum > spans) {
@@ -670,7 +1121,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
     for (i = first_entry; i < cll_entries; ++i) {
         int cll = cumulative_line_lengths[i] - start_offset;
         length = cll - prev;
-        const int spans = [self numberOfFullLinesFromOffset:(buffer_start - raw_buffer) + prev
+        const int spans = [self numberOfFullLinesFromOffset:start_offset + prev
                                                      length:length
                                                       width:width];
         if (lineNum > spans) {
@@ -728,14 +1179,14 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
                 metadata->number_of_wrapped_lines > 0) {
                 spans = metadata->number_of_wrapped_lines;
             } else {
-                spans = [self numberOfFullLinesFromOffset:(buffer_start - raw_buffer) + prev
+                spans = [self numberOfFullLinesFromOffset:start_offset + prev
                                                    length:length
                                                     width:width];
                 metadata->number_of_wrapped_lines = spans;
                 metadata->width_for_number_of_wrapped_lines = width;
              }
         } else {
-            spans = [self numberOfFullLinesFromOffset:(buffer_start - raw_buffer) + prev
+            spans = [self numberOfFullLinesFromOffset:start_offset + prev
                                                length:length
                                                 width:width];
         }
@@ -747,15 +1198,16 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
         } else {  // *lineNum <= spans
             // We found the raw line that includes the wrapped line we're searching for.
             // eat up *lineNum many width-sized wrapped lines from this start of the current full line
+            screen_char_t *lineCells = raw_buffer ? buffer_start + prev : [self cellsOfCompactLine:i];
             int offset;
             if (gEnableDoubleWidthCharacterLineCache) {
-                offset = [self offsetOfWrappedLineInBuffer:buffer_start + prev
+                offset = [self offsetOfWrappedLineInBuffer:lineCells
                                          wrappedLineNumber:*lineNum
                                               bufferLength:length
                                                      width:width
                                                   metadata:&metadata_[i]];
             } else {
-                offset = OffsetOfWrappedLine(buffer_start + prev,
+                offset = OffsetOfWrappedLine(lineCells,
                                              *lineNum,
                                              length,
                                              width,
@@ -767,7 +1219,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
             *lineLength = length - offset;  // the length of the suffix of the raw line, beginning at the wrapped line we want
             if (*lineLength > width) {
                 // return an infix of the full line
-                if (width > 1 && buffer_start[prev + offset + width].code == DWC_RIGHT) {
+                if (width > 1 && lineCells[offset + width].code == DWC_RIGHT) {
                     // Result would end with the first half of a double-width character
                     *lineLength = width - 1;
                     *includesEndOfLine = EOL_DWC;
@@ -796,7 +1248,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
             if (isStartOfWrappedLine) {
                 *isStartOfWrappedLine = (offset == 0);
             }
-            return buffer_start + prev + offset;
+            return lineCells + offset;
         }
         prev = cll;
     }
@@ -810,6 +1262,27 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
         return cached_numlines;
     }
 
+    // Save the result so it doesn't have to be recalculated until some relatively rare operation
+    // occurs that invalidates the cache.
+    cached_numlines_width = width;
+    cached_numlines = [self uncachedNumLinesWithWrapWidth:width];
+
+    return cached_numlines;
+}
+
+- (int)numLinesForEncodingWithWrapWidth:(int)width {
+    if (width == cached_numlines_width) {
+        return cached_numlines;
+    }
+    if (width != _encodingNumLinesWidth || _generation != _encodingNumLinesGeneration) {
+        _encodingNumLines = [self uncachedNumLinesWithWrapWidth:width];
+        _encodingNumLinesWidth = width;
+        _encodingNumLinesGeneration = _generation;
+    }
+    return _encodingNumLines;
+}
+
+- (int)uncachedNumLinesWithWrapWidth:(int)width {
     int count = 0;
     int prev = 0;
     int i;
@@ -818,18 +1291,12 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
     for (i = first_entry; i < cll_entries; ++i) {
         int cll = cumulative_line_lengths[i] - start_offset;
         int length = cll - prev;
-        const int marginalLines = [self numberOfFullLinesFromOffset:(buffer_start - raw_buffer) + prev
+        const int marginalLines = [self numberOfFullLinesFromOffset:start_offset + prev
                                                              length:length
                                                               width:width] + 1;
         count += marginalLines;
         prev = cll;
     }
-
-    // Save the result so it doesn't have to be recalculated until some relatively rare operation
-    // occurs that invalidates the cache.
-    cached_numlines_width = width;
-    cached_numlines = count;
-
     return count;
 }
 
@@ -847,6 +1314,8 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
         // There is no last line to pop.
         return NO;
     }
+    iTermLineBlockWillChange(self);
+    iTermLineBlockExpandIfNeeded(self);
     _numberOfFullLinesCache.clear();
     int start;
     if (cll_entries == first_entry + 1) {
@@ -868,7 +1337,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
         // If the width is four and the last line is "0123456789" then return "89". It would
         // wrap as: 0123/4567/89. If there are double-width characters, this ensures they are
         // not split across lines when computing the wrapping.
-        const int numLines = [self numberOfFullLinesFromOffset:(buffer_start - raw_buffer) + start
+        const int numLines = [self numberOfFullLinesFromOffset:start_offset + start
                                                         length:available_len
                                                          width:width];
         int offset_from_start = OffsetOfWrappedLine(buffer_start + start,
@@ -879,6 +1348,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
         *length = available_len - offset_from_start;
         *ptr = buffer_start + start + offset_from_start;
         cumulative_line_lengths[cll_entries - 1] -= *length;
+        _trigramChainEntry = -1;
         metadata_[cll_entries - 1].number_of_wrapped_lines = 0;
         if (gEnableDoubleWidthCharacterLineCache) {
             [metadata_[cll_entries - 1].double_width_characters release];
@@ -900,6 +1370,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
         start_offset = 0;
         first_entry = 0;
         cll_entries = 0;
+        [self resetTrigramSignature];
     }
     // refresh cache
     cached_numlines_width = -1;
@@ -941,6 +1412,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
 
 - (screen_char_t*)rawLine:(int)linenum
 {
+    iTermLineBlockExpandIfNeeded(self);
     int start;
     if (linenum == 0) {
         start = 0;
@@ -951,6 +1423,8 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
 }
 
 - (void)changeBufferSize:(int)capacity {
+    iTermLineBlockWillChange(self);
+    iTermLineBlockExpandIfNeeded(self);
     ITAssertWithMessage(capacity >= [self rawSpaceUsed], @"Truncating used space");
     capacity = MAX(1, capacity);
     raw_buffer = (screen_char_t*) iTermRealloc((void*) raw_buffer, sizeof(screen_char_t), capacity);
@@ -973,6 +1447,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
     if (partial == is_partial) {
         return;
     }
+    iTermLineBlockWillChange(self);
     is_partial = partial;
     iTermLineBlockDidChange(self);
 }
@@ -983,6 +1458,8 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
 }
 
 - (int)dropLines:(int)n withWidth:(int)width chars:(int *)charsDropped {
+    iTermLineBlockWillChange(self);
+    iTermLineBlockExpandIfNeeded(self);
     int orig_n = n;
     int prev = 0;
     int length;
@@ -997,7 +1474,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
         // Get the number of full-length wrapped lines in this raw line. If there
         // were only single-width characters the formula would be:
         //     (length - 1) / width;
-        int spans = [self numberOfFullLinesFromOffset:(buffer_start - raw_buffer) + prev
+        int spans = [self numberOfFullLinesFromOffset:start_offset + prev
                                                length:length
                                                 width:width];
         if (n > spans) {
@@ -1044,6 +1521,7 @@ int OffsetOfWrappedLine(screen_char_t* p, int n, int length, int width, BOOL may
     buffer_start = raw_buffer;
     start_offset = 0;
     first_entry = 0;
+    [self resetTrigramSignature];
     *charsDropped = [self rawSpaceUsed];
     iTermLineBlockDidChange(self);
     return orig_n - n;
@@ -1125,168 +1603,297 @@ static NSString* RewrittenRegex(NSString* originalRegex) {
     return rewritten;
 }
 
-static int CoreSearch(NSString *needle,
-                      screen_char_t *rawline,
-                      int raw_line_length,
-                      int start,
-                      int end,
-                      FindOptions options,
-                      iTermFindMode mode,
-                      int *resultLength,
-                      NSString *haystack,
-                      unichar *charHaystack,
-                      int *deltas,
-                      int deltaOffset) {
-    RKLRegexOptions apiOptions = RKLNoOptions;
-    NSRange range;
-    const BOOL regex = (mode == iTermFindModeCaseInsensitiveRegex ||
-                        mode == iTermFindModeCaseSensitiveRegex);
-    if (regex) {
-        BOOL backwards = NO;
-        if (options & FindOptBackwards) {
-            backwards = YES;
-        }
-        if (mode == iTermFindModeCaseInsensitiveRegex) {
-            apiOptions = static_cast<RKLRegexOptions>(apiOptions | RKLCaseless);
+// State shared by every line searched in one call to -findSubstring:... so that lines can be
+// searched without allocating anything per line.
+typedef struct iTermLineBlockSearch {
+    NSString *needle;
+    FindOptions options;
+    BOOL regex;
+
+    // Regex modes only. The needle with ^ and $ rewritten to match kPrefixChar and kSuffixChar,
+    // compiled once. NULL if it didn't compile, in which case nothing matches.
+    URegularExpression *icuRegex;
+    // Every match in the current line, for searching backwards. Reused for each line.
+    std::vector<NSRange> regexMatches;
+
+    // Substring modes only. If |literal| is set the needle is printable ASCII, and lines that are
+    // also printable ASCII are searched without NSString.
+    NSStringCompareOptions compareOptions;
+    iTermLiteralNeedle *literal;
+
+    // Holds the current line's UTF-16 text at units + 1, leaving room for the regex sandwich.
+    iTermSearchScratch scratch;
+} iTermLineBlockSearch;
+
+static void iTermLineBlockSearchInit(iTermLineBlockSearch *search,
+                                     NSString *needle,
+                                     FindOptions options,
+                                     iTermFindMode mode) {
+    search->needle = needle;
+    search->options = options;
+    search->regex = (mode == iTermFindModeCaseInsensitiveRegex ||
+                     mode == iTermFindModeCaseSensitiveRegex);
+    search->icuRegex = NULL;
+    search->compareOptions = 0;
+    search->literal = NULL;
+    iTermSearchScratchInit(&search->scratch);
+
+    if (search->regex) {
+        NSString *rewrittenRegex = RewrittenRegex(needle);
+        std::vector<unichar> pattern(rewrittenRegex.length);
+        [rewrittenRegex getCharacters:pattern.data() range:NSMakeRange(0, pattern.size())];
+        const RKLRegexOptions regexOptions = (mode == iTermFindModeCaseInsensitiveRegex) ? RKLCaseless : RKLNoOptions;
+        int32_t status = 0;
+        search->icuRegex = uregex_open(pattern.data(), (int32_t)pattern.size(), regexOptions, NULL, &status);
+        if (status > 0) {
+            NSLog(@"regex error %d compiling %@", (int)status, needle);
+            if (search->icuRegex) {
+                uregex_close(search->icuRegex);
+            }
+            search->icuRegex = NULL;
         }
+        return;
+    }
+    BOOL caseInsensitive = (mode == iTermFindModeCaseInsensitiveSubstring);
+    if (mode == iTermFindModeSmartCaseSensitivity &&
+        [needle rangeOfCharacterFromSet:[NSCharacterSet uppercaseLetterCharacterSet]].location == NSNotFound) {
+        caseInsensitive = YES;
+    }
+    if (caseInsensitive) {
+        search->compareOptions = (NSCaseInsensitiveSearch |
+                                  NSDiacriticInsensitiveSearch |
+                                  NSWidthInsensitiveSearch);
+    }
+    if (options & FindOptBackwards) {
+        search->compareOptions |= NSBackwardsSearch;
+    }
+    std::vector<unichar> units(needle.length);
+    [needle getCharacters:units.data() range:NSMakeRange(0, needle.length)];
+    search->literal = iTermLiteralNeedleCreate(units.data(), (int)units.size(), caseInsensitive);
+}
 
-        NSError* regexError = nil;
-        NSRange temp;
-        NSString* rewrittenRegex = RewrittenRegex(needle);
-        NSString* sanitizedHaystack = [haystack stringByReplacingOccurrencesOfString:[NSString stringWithFormat:@"%c", kPrefixChar]
-                                                                          withString:[NSString stringWithFormat:@"%c", 3]];
-        sanitizedHaystack = [sanitizedHaystack stringByReplacingOccurrencesOfString:[NSString stringWithFormat:@"%c", kSuffixChar]
-                                                                         withString:[NSString stringWithFormat:@"%c", 3]];
-
-        NSString* sandwich;
-        BOOL hasPrefix = YES;
-        BOOL hasSuffix = YES;
-        if (end == raw_line_length) {
-            if (start == 0) {
-                sandwich = [NSString stringWithFormat:@"%C%@%C", kPrefixChar, sanitizedHaystack, kSuffixChar];
-            } else {
-                hasPrefix = NO;
-                sandwich = [NSString stringWithFormat:@"%@%C", sanitizedHaystack, kSuffixChar];
-            }
+static void iTermLineBlockSearchFree(iTermLineBlockSearch *search) {
+    if (search->icuRegex) {
+        uregex_close(search->icuRegex);
+    }
+    iTermLiteralNeedleFree(search->literal);
+    iTermSearchScratchFree(&search->scratch);
+}
+
+// Like ScreenCharArrayToString, but writes the text of cells [start, end) to search->scratch
+// and returns the number of code units.
+static int iTermLineBlockSearchLoadLine(iTermLineBlockSearch *search,
+                                        screen_char_t *cells,
+                                        int start,
+                                        int end) {
+    // One unit before the text for kPrefixChar and one after for kSuffixChar.
+    iTermSearchScratchReserve(&search->scratch, (end - start) * kMaxParts + 2);
+    unichar *haystack = search->scratch.units + 1;
+    int *deltas = search->scratch.deltas;
+
+    // screen_char_t[i + deltas[i]] begins its run at haystack[i]. See ScreenCharArrayToString.
+    int delta = 0;
+    int o = 0;
+    for (int i = start; i < end; ++i) {
+        const unichar c = cells[i].code;
+        if (c >= ITERM2_PRIVATE_BEGIN && c <= ITERM2_PRIVATE_END) {
+            // Skip private-use characters which signify things like double-width characters and
+            // tab fillers.
+            ++delta;
+        } else if (!cells[i].complexChar && c != UNICODE_REPLACEMENT_CHAR) {
+            deltas[o] = delta;
+            haystack[o++] = c;
         } else {
-            hasSuffix = NO;
-            sandwich = [NSString stringWithFormat:@"%C%@", kPrefixChar, sanitizedHaystack];
+            const int len = ExpandScreenChar(&cells[i], haystack + o);
+            ++delta;
+            for (int j = o; j < o + len; ++j) {
+                deltas[j] = --delta;
+            }
+            o += len;
         }
+    }
+    deltas[o] = delta;
 
-        temp = [sandwich rangeOfRegex:rewrittenRegex
-                              options:apiOptions
-                              inRange:NSMakeRange(0, [sandwich length])
-                              capture:0
-                                error:&regexError];
-        range = temp;
-
-        if (backwards) {
-            int locationAdjustment = hasSuffix ? 1 : 0;
-            // keep searching from one char after the start of the match until we don't find anything.
-            // regexes aren't good at searching backwards.
-            while (!regexError && temp.location != NSNotFound && temp.location+locationAdjustment < [sandwich length]) {
-                if (temp.length != 0) {
-                    range = temp;
-                }
-                temp.location += MAX(1, temp.length);
-                temp = [sandwich rangeOfRegex:rewrittenRegex
-                                      options:apiOptions
-                                      inRange:NSMakeRange(temp.location, [sandwich length] - temp.location)
-                                      capture:0
-                                        error:&regexError];
+    if (search->regex) {
+        // Make sure the text can't match ^ or $.
+        for (int i = 0; i < o; i++) {
+            if (haystack[i] == kPrefixChar || haystack[i] == kSuffixChar) {
+                haystack[i] = 3;
             }
         }
-        if (range.length == 0) {
-            range.location = NSNotFound;
-        }
-        if (!regexError && range.location != NSNotFound) {
-            if (hasSuffix && range.location + range.length == [sandwich length]) {
-                // match includes $
-                if (range.length > 0) {
-                    --range.length;
-                }
-                if (range.length == 0 && range.location > 0) {
-                    // matched only on $
-                    --range.location;
-                }
-            }
-            if (hasPrefix && range.location == 0) {
-                if (range.length > 0) {
-                    --range.length;
-                }
-            } else if (hasPrefix) {
-                if (range.location > 0) {
-                    --range.location;
-                }
-            }
+    }
+    return o;
+}
+
+// The text loaded into search->scratch as the regex sees it: with kPrefixChar before it if it
+// begins the raw line and kSuffixChar after it if it ends the raw line.
+typedef struct {
+    int length;
+    BOOL hasPrefix;
+    BOOL hasSuffix;
+} iTermRegexSandwich;
+
+// Builds the sandwich around the |count| units loaded from cells [start, end) in place and points
+// the regex at it. Returns NO if there's nothing to search.
+static BOOL iTermLineBlockSearchSetRegexText(iTermLineBlockSearch *search,
+                                             int raw_line_length,
+                                             int start,
+                                             int end,
+                                             int count,
+                                             iTermRegexSandwich *sandwich) {
+    if (!search->icuRegex) {
+        return NO;
+    }
+    unichar *haystack = search->scratch.units + 1;
+    unichar *sandwichStart = haystack;
+    sandwich->length = count;
+    sandwich->hasPrefix = YES;
+    sandwich->hasSuffix = YES;
+    if (end == raw_line_length) {
+        if (start != 0) {
+            sandwich->hasPrefix = NO;
         }
-        if (range.length <= 0) {
-            // match on ^ or $
-            range.location = NSNotFound;
+    } else {
+        sandwich->hasSuffix = NO;
+    }
+    if (sandwich->hasPrefix) {
+        --sandwichStart;
+        *sandwichStart = kPrefixChar;
+        ++sandwich->length;
+    }
+    if (sandwich->hasSuffix) {
+        haystack[count] = kSuffixChar;
+        ++sandwich->length;
+    }
+    int32_t status = 0;
+    uregex_setText(search->icuRegex, sandwichStart, sandwich->length, &status);
+    return status <= 0;
+}
+
+// Finds the next match in the sandwich. Returns NO when there are no more.
+static BOOL iTermLineBlockSearchNextRegexMatch(iTermLineBlockSearch *search, NSRange *rangePtr) {
+    int32_t status = 0;
+    if (!uregex_findNext(search->icuRegex, &status) || status > 0) {
+        if (status > 0) {
+            NSLog(@"regex error: %d", (int)status);
         }
-        if (regexError) {
-            NSLog(@"regex error: %@", regexError);
-            range.length = 0;
-            range.location = NSNotFound;
+        return NO;
+    }
+    const int32_t start = uregex_start(search->icuRegex, 0, &status);
+    const int32_t end = uregex_end(search->icuRegex, 0, &status);
+    if (status > 0) {
+        NSLog(@"regex error: %d", (int)status);
+        return NO;
+    }
+    *rangePtr = NSMakeRange(start, end - start);
+    return YES;
+}
+
+// Converts a match in the sandwich to a range in the loaded text. Returns NO if it's empty or
+// matched only ^ or $.
+static BOOL iTermRegexSandwichUnwrapRange(const iTermRegexSandwich *sandwich, NSRange *rangePtr) {
+    NSRange range = *rangePtr;
+    if (range.length == 0) {
+        return NO;
+    }
+    if (sandwich->hasSuffix && range.location + range.length == (NSUInteger)sandwich->length) {
+        // match includes $
+        if (range.length > 0) {
+            --range.length;
         }
-    } else {
-        // Substring (not regex)
-        if (options & FindOptBackwards) {
-            apiOptions = static_cast<RKLRegexOptions>(apiOptions | NSBackwardsSearch);
+        if (range.length == 0 && range.location > 0) {
+            // matched only on $
+            --range.location;
         }
-        BOOL caseInsensitive = (mode == iTermFindModeCaseInsensitiveSubstring);
-        if (mode == iTermFindModeSmartCaseSensitivity &&
-            [needle rangeOfCharacterFromSet:[NSCharacterSet uppercaseLetterCharacterSet]].location == NSNotFound) {
-            caseInsensitive = YES;
+    }
+    if (sandwich->hasPrefix && range.location == 0) {
+        if (range.length > 0) {
+            --range.length;
         }
-        if (caseInsensitive) {
-            apiOptions = static_cast<RKLRegexOptions>(apiOptions | NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch | NSWidthInsensitiveSearch);
+    } else if (sandwich->hasPrefix) {
+        if (range.location > 0) {
+            --range.location;
         }
-        range = [haystack rangeOfString:needle options:apiOptions];
-    }
-    int result = -1;
-    if (range.location != NSNotFound) {
-        int adjustedLocation;
-        int adjustedLength;
-        adjustedLocation = range.location + deltas[range.location] + deltaOffset;
-        adjustedLength = range.length + deltas[range.location + range.length] -
+    }
+    *rangePtr = range;
+    // A zero length means the match was on ^ or $.
+    return range.length > 0;
+}
+
+// Converts a range in the loaded text, which holds cells from |start| on, to a position in cells
+// and sets *resultLength to its length in cells.
+static int iTermLineBlockSearchCellPosition(const iTermLineBlockSearch *search,
+                                            NSRange range,
+                                            int start,
+                                            int deltaOffset,
+                                            int *resultLength) {
+    const int *deltas = search->scratch.deltas;
+    const int adjustedLocation = range.location + deltas[range.location] + deltaOffset;
+    *resultLength = range.length + deltas[range.location + range.length] -
         (deltas[range.location] + deltaOffset);
-        *resultLength = adjustedLength;
-        result = adjustedLocation + start;
+    return adjustedLocation + start;
+}
+
+// Searches the first |count| units of the line loaded into search->scratch, which hold the text
+// of cells [start, end) of a raw line. |printableASCII| says whether those units are all printable
+// ASCII. Regexes are always searched forwards; see -_findInRawLine:... for backwards. Returns the
+// position of the match in cells or -1.
+static int CoreSearch(iTermLineBlockSearch *search,
+                      int raw_line_length,
+                      int start,
+                      int end,
+                      int count,
+                      BOOL printableASCII,
+                      int *resultLength,
+                      int deltaOffset) {
+    unichar *haystack = search->scratch.units + 1;
+    NSRange range;
+    if (search->regex) {
+        iTermRegexSandwich sandwich;
+        if (!iTermLineBlockSearchSetRegexText(search, raw_line_length, start, end, count, &sandwich) ||
+            !iTermLineBlockSearchNextRegexMatch(search, &range) ||
+            !iTermRegexSandwichUnwrapRange(&sandwich, &range)) {
+            range = NSMakeRange(NSNotFound, 0);
+        }
+    } else if (search->literal && printableASCII) {
+        // Substring of printable ASCII in printable ASCII. No need for NSString.
+        const int location = iTermLiteralNeedleFind(search->literal,
+                                                    haystack,
+                                                    count,
+                                                    (search->options & FindOptBackwards) != 0);
+        if (location < 0) {
+            range = NSMakeRange(NSNotFound, 0);
+        } else {
+            range = NSMakeRange(location, iTermLiteralNeedleLength(search->literal));
+        }
+    } else {
+        // Substring (not regex)
+        range = [CharArrayToString(haystack, count) rangeOfString:search->needle
+                                                          options:search->compareOptions];
     }
-    return result;
+    if (range.location == NSNotFound) {
+        return -1;
+    }
+    return iTermLineBlockSearchCellPosition(search, range, start, deltaOffset, resultLength);
 }
 
-static int Search(NSString* needle,
+static int Search(iTermLineBlockSearch *search,
                   screen_char_t* rawline,
                   int raw_line_length,
                   int start,
                   int end,
-                  int options,
-                  iTermFindMode mode,
                   int* resultLength)
 {
-    NSString* haystack;
-    unichar* charHaystack;
-    int* deltas;
-    haystack = ScreenCharArrayToString(rawline,
-                                       start,
-                                       end,
-                                       &charHaystack,
-                                       &deltas);
-    // screen_char_t[i + deltas[i]] begins its run at charHaystack[i]
-    int result = CoreSearch(needle, rawline, raw_line_length, start, end, options, mode, resultLength,
-                            haystack, charHaystack, deltas, deltas[0]);
-
-    free(deltas);
-    free(charHaystack);
-    return result;
+    const int count = iTermLineBlockSearchLoadLine(search, rawline, start, end);
+    const BOOL printableASCII = (search->literal &&
+                                 iTermSearchUnitsArePrintableASCII(search->scratch.units + 1, count));
+    // screen_char_t[i + deltas[i]] begins its run at haystack[i]
+    return CoreSearch(search, raw_line_length, start, end, count, printableASCII, resultLength,
+                      search->scratch.deltas[0]);
 }
 
 - (void)_findInRawLine:(int)entry
-                needle:(NSString*)needle
-               options:(int)options
-                  mode:(iTermFindMode)mode
+                search:(iTermLineBlockSearch *)search
                   skip:(int)skip
                 length:(int)raw_line_length
        multipleResults:(BOOL)multipleResults
@@ -1298,7 +1905,37 @@ static int Search(NSString* needle,
     if (skip < 0) {
         skip = 0;
     }
-    if (options & FindOptBackwards) {
+    if ((search->options & FindOptBackwards) && search->regex) {
+        // Regexes can't search backwards, so find every match in one forward pass over the whole
+        // line and take them from the right. The rightmost acceptable match is one that begins
+        // not after 'skip' (see below).
+        const int count = iTermLineBlockSearchLoadLine(search, rawline, 0, raw_line_length);
+        std::vector<NSRange> &matches = search->regexMatches;
+        matches.clear();
+        iTermRegexSandwich sandwich;
+        if (iTermLineBlockSearchSetRegexText(search, raw_line_length, 0, raw_line_length, count, &sandwich)) {
+            NSRange range;
+            while (iTermLineBlockSearchNextRegexMatch(search, &range)) {
+                if (iTermRegexSandwichUnwrapRange(&sandwich, &range)) {
+                    matches.push_back(range);
+                }
+            }
+        }
+        for (auto it = matches.rbegin(); it != matches.rend(); ++it) {
+            int length = 0;
+            const int position = iTermLineBlockSearchCellPosition(search, *it, 0, 0, &length);
+            if (position > skip) {
+                continue;
+            }
+            ResultRange* r = [[[ResultRange alloc] init] autorelease];
+            r->position = position;
+            r->length = length;
+            [results addObject:r];
+            if (!multipleResults) {
+                break;
+            }
+        }
+    } else if (search->options & FindOptBackwards) {
         // This algorithm is wacky and slow but stay with me here:
         // When you search backward, the most common case is that you are
         // repeating the previous search but with a one-character longer
@@ -1343,27 +1980,16 @@ static int Search(NSString* needle,
         int tempResultLength = 0;
         int tempPosition;
 
-        NSString* haystack;
-        unichar* charHaystack;
-        int* deltas;
-        haystack = ScreenCharArrayToString(rawline,
-                                           0,
-                                           limit,
-                                           &charHaystack,
-                                           &deltas);
-        int numUnichars = [haystack length];
-        const unsigned long long kMaxSaneStringLength = 1000000000LL;
+        // The line is converted once. Each iteration searches a shorter prefix of it.
+        int numUnichars = iTermLineBlockSearchLoadLine(search, rawline, 0, limit);
+        const int *deltas = search->scratch.deltas;
+        const BOOL printableASCII = (search->literal &&
+                                     iTermSearchUnitsArePrintableASCII(search->scratch.units + 1,
+                                                                       numUnichars));
         NSRange previousRange = NSMakeRange(NSNotFound, 0);
         do {
-            haystack = CharArrayToString(charHaystack, numUnichars);
-            if ([haystack length] >= kMaxSaneStringLength) {
-                // There's a bug in OS 10.9.0 (and possibly other versions) where the string
-                // @"a⃑" reports a length of 0x7fffffffffffffff, which causes this loop to never
-                // terminate.
-                break;
-            }
-            tempPosition = CoreSearch(needle, rawline, raw_line_length, 0, limit, options,
-                                      mode, &tempResultLength, haystack, charHaystack, deltas, 0);
+            tempPosition = CoreSearch(search, raw_line_length, 0, limit, MAX(0, numUnichars),
+                                      printableASCII, &tempResultLength, 0);
 
             limit = tempPosition + tempResultLength - 1;
             // find i so that i-deltas[i] == limit
@@ -1381,16 +2007,14 @@ static int Search(NSString* needle,
                 [results addObject:r];
             }
         } while (tempPosition != -1 && (multipleResults || tempPosition > skip));
-        free(deltas);
-        free(charHaystack);
     } else {
         // Search forward
         // TODO: test this
         int tempResultLength;
         int tempPosition;
         while (skip < raw_line_length) {
-            tempPosition = Search(needle, rawline, raw_line_length, skip, raw_line_length,
-                                  options, mode, &tempResultLength);
+            tempPosition = Search(search, rawline, raw_line_length, skip, raw_line_length,
+                                  &tempResultLength);
             if (tempPosition != -1) {
                 ResultRange* r = [[[ResultRange alloc] init] autorelease];
                 r->position = tempPosition;
@@ -1439,6 +2063,7 @@ static int Search(NSString* needle,
              atOffset:(int)offset
               results:(NSMutableArray *)results
       multipleResults:(BOOL)multipleResults {
+    iTermLineBlockExpandIfNeeded(self);
     if (offset == -1) {
         offset = [self rawSpaceUsed] - 1;
     }
@@ -1458,34 +2083,85 @@ static int Search(NSString* needle,
         limit = cll_entries;
         dir = 1;
     }
+    iTermLineBlockSearch search;
+    iTermLineBlockSearchInit(&search, substring, options, mode);
     while (entry != limit) {
         int line_raw_offset = [self _lineRawOffset:entry];
         int skipped = offset - line_raw_offset;
         if (skipped < 0) {
             skipped = 0;
         }
-        NSMutableArray* newResults = [NSMutableArray arrayWithCapacity:1];
+        const NSUInteger numberOfPreviousResults = results.count;
 
         // Don't search arbitrarily long lines. If someone has a 10 million character long line then
         // it'll hang for a long time.
         static const int MAX_SEARCHABLE_LINE_LENGTH = 500000;
-        [self _findInRawLine:entry
-                      needle:substring
-                     options:options
-                        mode:mode
-                        skip:skipped
-                      length:MIN(MAX_SEARCHABLE_LINE_LENGTH, [self _lineLength: entry])
-             multipleResults:multipleResults
-                     results:newResults];
-        for (ResultRange* r in newResults) {
+        @autoreleasepool {
+            [self _findInRawLine:entry
+                          search:&search
+                            skip:skipped
+                          length:MIN(MAX_SEARCHABLE_LINE_LENGTH, [self _lineLength: entry])
+                 multipleResults:multipleResults
+                         results:results];
+        }
+        for (NSUInteger i = numberOfPreviousResults; i < results.count; i++) {
+            ResultRange *r = results[i];
             r->position += line_raw_offset;
-            [results addObject:r];
         }
-        if ([newResults count] && !multipleResults) {
-            return;
+        if (results.count > numberOfPreviousResults && !multipleResults) {
+            break;
         }
         entry += dir;
     }
+    iTermLineBlockSearchFree(&search);
+}
+
+#pragma mark - Trigram Signature
+
+- (void)addTrigramsOfLine:(int)entry {
+    if (!_trigramSignature) {
+        return;
+    }
+    const int offset = [self _lineRawOffset:entry];
+    iTermTrigramChainReset(&_trigramChain);
+    iTermTrigramSignatureAddCells(_trigramSignature,
+                                  &_trigramChain,
+                                  raw_buffer + offset,
+                                  cumulative_line_lengths[entry] - offset);
+    _trigramChainEntry = entry;
+}
+
+// Call after appending |cells| to the buffer and updating cumulative_line_lengths.
+- (void)addTrigramsOfCells:(const screen_char_t *)cells
+                    length:(int)length
+        continuingLastLine:(BOOL)continuing {
+    if (!_trigramSignature) {
+        return;
+    }
+    if (continuing && _trigramChainEntry != cll_entries - 1) {
+        // Part of the line was popped, so the chain doesn't end where the line does now.
+        [self addTrigramsOfLine:cll_entries - 1];
+        return;
+    }
+    if (!continuing) {
+        iTermTrigramChainReset(&_trigramChain);
+    }
+    iTermTrigramSignatureAddCells(_trigramSignature, &_trigramChain, cells, length);
+    _trigramChainEntry = cll_entries - 1;
+}
+
+- (void)resetTrigramSignature {
+    if (_trigramSignature) {
+        memset(_trigramSignature, 0, sizeof(*_trigramSignature));
+    }
+    _trigramChainEntry = -1;
+}
+
+- (BOOL)mayContainMatchesForQuery:(iTermTrigramQuery *)query {
+    if (!query || !_trigramSignature) {
+        return YES;
+    }
+    return [query mayMatchSignature:_trigramSignature];
 }
 
 // Returns YES if the position is valid for this block.
@@ -1524,7 +2200,7 @@ static int Search(NSString* needle,
             if (bytes_to_consume_in_this_line < line_length &&
                 prev + bytes_to_consume_in_this_line + 1 < eol) {
                 assert(prev + bytes_to_consume_in_this_line + 1 < buffer_size);
-                if (width > 1 && raw_buffer[prev + bytes_to_consume_in_this_line + 1].code == DWC_RIGHT) {
+                if (width > 1 && [self cellsAtRawOffset:prev][bytes_to_consume_in_this_line + 1].code == DWC_RIGHT) {
                     ++dwc_peek;
                 }
             }
@@ -1534,7 +2210,8 @@ static int Search(NSString* needle,
             *y += consume;
             if (consume > 0) {
                 // Offset from prev where the consume'th line begin.
-                int offset = OffsetOfWrappedLine(raw_buffer + prev,
+                // The cells are only looked at if there may be double-width characters.
+                int offset = OffsetOfWrappedLine(_mayHaveDoubleWidthCharacter ? [self cellsAtRawOffset:prev] : NULL,
                                                  consume,
                                                  line_length,
                                                  width,
@@ -1555,39 +2232,61 @@ static int Search(NSString* needle,
     return NO;
 }
 
-- (NSArray *)cumulativeLineLengthsArray {
-    NSMutableArray *cllArray = [NSMutableArray array];
-    for (int i = 0; i < cll_entries; i++) {
-        [cllArray addObject:@(cumulative_line_lengths[i])];
+// Produces one buffer holding everything needed to restore the block. Nothing else is allocated,
+// and compact or compressed cells are expanded directly into it.
+- (NSData *)binaryRepresentation {
+    const int rawSpaceUsed = [self rawSpaceUsed];
+    const NSUInteger cllOffset = sizeof(iTermLineBlockBinaryHeader);
+    const NSUInteger metadataOffset = cllOffset + sizeof(int32_t) * cll_entries;
+    const NSUInteger cellsOffset = metadataOffset + sizeof(iTermLineBlockBinaryMetadata) * cll_entries;
+    NSMutableData *data = [NSMutableData dataWithLength:cellsOffset + sizeof(screen_char_t) * rawSpaceUsed];
+    unsigned char *bytes = (unsigned char *)data.mutableBytes;
+
+    iTermLineBlockBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = iTermLineBlockBinaryMagic;
+    header.version = iTermLineBlockBinaryVersion;
+    header.cellSize = sizeof(screen_char_t);
+    if (is_partial) {
+        header.flags |= iTermLineBlockBinaryFlagPartial;
     }
-    return cllArray;
-}
-
-- (NSArray *)metadataArray {
-    NSMutableArray *metadataArray = [NSMutableArray array];
+    if (_mayHaveDoubleWidthCharacter) {
+        header.flags |= iTermLineBlockBinaryFlagMayHaveDoubleWidthCharacter;
+    }
+    header.bufferSize = buffer_size;
+    header.startOffset = start_offset;
+    header.firstEntry = first_entry;
+    header.numberOfLines = cll_entries;
+    memcpy(bytes, &header, sizeof(header));
+    memcpy(bytes + cllOffset, cumulative_line_lengths, sizeof(int32_t) * cll_entries);
     for (int i = 0; i < cll_entries; i++) {
-        [metadataArray addObject:@[ @(metadata_[i].continuation.code),
-                                    @(metadata_[i].continuation.backgroundColor),
-                                    @(metadata_[i].continuation.bgGreen),
-                                    @(metadata_[i].continuation.bgBlue),
-                                    @(metadata_[i].continuation.backgroundColorMode),
-                                    @(metadata_[i].timestamp) ]];
+        iTermLineBlockBinaryMetadata record;
+        memset(&record, 0, sizeof(record));
+        record.timestamp = metadata_[i].timestamp;
+        record.continuationCode = metadata_[i].continuation.code;
+        record.continuationBackgroundColor = metadata_[i].continuation.backgroundColor;
+        record.continuationBgGreen = metadata_[i].continuation.bgGreen;
+        record.continuationBgBlue = metadata_[i].continuation.bgBlue;
+        record.continuationBackgroundColorMode = metadata_[i].continuation.backgroundColorMode;
+        memcpy(bytes + metadataOffset + i * sizeof(record), &record, sizeof(record));
+    }
+
+    screen_char_t *cells = (screen_char_t *)(bytes + cellsOffset);
+    if (_compactCells || _compressedCells) {
+        // Don't leave the block expanded just because state is being saved.
+        iTermCompactCells *compact = _compactCells ?: [self decompressedCells];
+        iTermCompactCellsExpand(compact, cells + start_offset);
+        if (compact != _compactCells) {
+            iTermCompactCellsFree(compact);
+        }
+    } else {
+        memcpy(cells, raw_buffer, sizeof(screen_char_t) * rawSpaceUsed);
     }
-    return metadataArray;
+    return data;
 }
 
 - (NSDictionary *)dictionary {
-    NSData *rawBufferData = [NSData dataWithBytes:raw_buffer
-                                           length:[self rawSpaceUsed] * sizeof(screen_char_t)];
-    return @{ kLineBlockRawBufferKey: rawBufferData,
-              kLineBlockBufferStartOffsetKey: @(buffer_start - raw_buffer),
-              kLineBlockStartOffsetKey: @(start_offset),
-              kLineBlockFirstEntryKey: @(first_entry),
-              kLineBlockBufferSizeKey: @(buffer_size),
-              kLineBlockCLLKey: [self cumulativeLineLengthsArray],
-              kLineBlockIsPartialKey: @(is_partial),
-              kLineBlockMetadataKey: [self metadataArray],
-              kLineBlockMayHaveDWCKey: @(_mayHaveDoubleWidthCharacter),
+    return @{ kLineBlockBinaryKey: [self binaryRepresentation],
               kLineBlockGuid: _guid };
 }
 
@@ -1633,6 +2332,63 @@ static int Search(NSString* needle,
     return it != _observers.end();
 }
 
+- (void)setMayHaveDoubleWidthCharacter:(BOOL)mayHaveDoubleWidthCharacter {
+    if (mayHaveDoubleWidthCharacter == _mayHaveDoubleWidthCharacter) {
+        return;
+    }
+    iTermLineBlockWillChange(self);
+    _mayHaveDoubleWidthCharacter = mayHaveDoubleWidthCharacter;
+}
+
+#pragma mark - Deferred Copies
+
+- (iTermDeferredLineBlockCopy *)newDeferredCopy {
+    iTermDeferredLineBlockCopy *deferredCopy = [[iTermDeferredLineBlockCopy alloc] init];
+    deferredCopy->_source = [self retain];
+    std::lock_guard<std::mutex> lock(_deferredCopiesLock);
+    _deferredCopies.push_back((void *)deferredCopy);
+    _numberOfDeferredCopies.store((int)_deferredCopies.size(), std::memory_order_release);
+    return deferredCopy;
+}
+
+// Main thread only. Runs when the block is about to change, so deferred copies take this block's
+// current state. Usually it's a no-op because they were made long ago on another thread.
+- (void)makeDeferredCopies {
+    std::lock_guard<std::mutex> lock(_deferredCopiesLock);
+    for (void *pointer : _deferredCopies) {
+        iTermDeferredLineBlockCopy *deferredCopy = static_cast<iTermDeferredLineBlockCopy *>(pointer);
+        deferredCopy->_copy = [self copyWithoutCaches];
+    }
+    _deferredCopies.clear();
+    _numberOfDeferredCopies.store(0, std::memory_order_release);
+}
+
+// Any thread.
+- (LineBlock *)lineBlockForDeferredCopy:(iTermDeferredLineBlockCopy *)deferredCopy {
+    std::lock_guard<std::mutex> lock(_deferredCopiesLock);
+    if (!deferredCopy->_copy) {
+        deferredCopy->_copy = [self copyWithoutCaches];
+        [self removeDeferredCopy:deferredCopy];
+    }
+    return deferredCopy->_copy;
+}
+
+// Any thread.
+- (void)forgetDeferredCopy:(iTermDeferredLineBlockCopy *)deferredCopy {
+    std::lock_guard<std::mutex> lock(_deferredCopiesLock);
+    [self removeDeferredCopy:deferredCopy];
+}
+
+// Call while holding _deferredCopiesLock. The release store is what lets the main thread change
+// the block without locking once it sees the count drop to 0.
+- (void)removeDeferredCopy:(iTermDeferredLineBlockCopy *)deferredCopy {
+    auto it = std::find(_deferredCopies.begin(), _deferredCopies.end(), static_cast<void *>(deferredCopy));
+    if (it != _deferredCopies.end()) {
+        _deferredCopies.erase(it);
+        _numberOfDeferredCopies.store((int)_deferredCopies.size(), std::memory_order_release);
+    }
+}
+
 #pragma mark - iTermUniquelyIdentifiable
 
 - (NSString *)stringUniqueIdentifier {
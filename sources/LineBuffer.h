@@ -66,6 +66,17 @@
 // all earlier blocks.
 - (LineBuffer *)newAppendOnlyCopy;
 
+// Like -newAppendOnlyCopy, but the result can be handed to another thread
+// while this buffer keeps changing. Blocks are copied lazily: call
+// -finishDetachedCopy on the other thread before using it there. Until then
+// it may only be appended to on the main thread. Compressed blocks share
+// their immutable bytes, so cold scrollback is cheap to copy.
+- (LineBuffer *)newDetachedCopy;
+
+// Copies whatever blocks a buffer made by -newDetachedCopy still shares with
+// the original. Call on the thread that will use it.
+- (void)finishDetachedCopy;
+
 // Call this immediately after init. Otherwise the buffer will hold unlimited lines (until you
 // run out of memory).
 - (void)setMaxLines:(int)maxLines;
@@ -34,7 +34,7 @@
 #import "iTermAdvancedSettingsModel.h"
 #import "iTermLineBlockArray.h"
 #import "iTermMalloc.h"
-#import "iTermOrderedDictionary.h"
+#import "iTermTrigramSignature.h"
 #import "LineBlock.h"
 #import "NSArray+iTerm.h"
 #import "NSData+iTerm.h"
@@ -52,7 +52,8 @@ static NSString *const kLineBufferTruncatedKey = @"Truncated";
 static NSString *const kLineBufferMayHaveDWCKey = @"May Have Double Width Character";
 static NSString *const kLineBufferBlockWrapperKey = @"Block Wrapper";
 
-static const int kLineBufferVersion = 1;
+// Version 2 saves blocks in LineBlock's binary format. Version 1 blocks can still be loaded.
+static const int kLineBufferVersion = 2;
 static const NSInteger kUnicodeVersion = 9;
 
 @implementation LineBuffer {
@@ -127,7 +128,8 @@ static const NSInteger kUnicodeVersion = 9;
     self = [super init];
     if (self) {
         [self commonInit];
-        if ([dictionary[kLineBufferVersionKey] intValue] != kLineBufferVersion) {
+        const int version = [dictionary[kLineBufferVersionKey] intValue];
+        if (version < 1 || version > kLineBufferVersion) {
             [self autorelease];
             return nil;
         }
@@ -371,8 +373,12 @@ static int RawNumLines(LineBuffer* buffer, int width) {
             }
         } else {
             // The existing buffer can't hold this line, but it has preceding line(s). Shrink it and
-            // allocate a new buffer that is large enough to hold this line.
+            // allocate a new buffer that is large enough to hold this line. The old block won't be
+            // appended to again so it can be stored compactly.
             [block shrinkToFit];
+            if ([iTermAdvancedSettingsModel compactScrollback]) {
+                [block compact];
+            }
             if (length + prefix_len > block_size) {
                 block = [self _addBlockOfSize:length + prefix_len];
             } else {
@@ -682,6 +688,7 @@ NS_INLINE int TotalNumberOfRawLines(LineBuffer *self) {
         context.dir = 1;
     }
     context.mode = mode;
+    context.trigramQuery = [iTermTrigramQuery queryWithNeedle:substring mode:mode];
     int offset = context.offset;
     int absBlockNum = context.absBlockNum;
     if ([self _findPosition:start inBlock:&absBlockNum inOffset:&offset]) {
@@ -751,31 +758,34 @@ NS_INLINE int TotalNumberOfRawLines(LineBuffer *self) {
 
     // NSLog(@"search block %d starting at offset %d", context.absBlockNum - num_dropped_blocks, context.offset);
 
-    [block findSubstring:context.substring
-                 options:context.options
-                    mode:context.mode
-                atOffset:context.offset
-                 results:context.results
-         multipleResults:((context.options & FindMultipleResults) != 0)];
-    NSMutableArray* filtered = [NSMutableArray arrayWithCapacity:[context.results count]];
-    BOOL haveOutOfRangeResults = NO;
-    int blockPosition = [self _blockPosition:context.absBlockNum - num_dropped_blocks];
-    const int stopAt = stopPosition.absolutePosition - droppedChars;
-    for (ResultRange* range in context.results) {
-        range->position += blockPosition;
-        if (context.dir * (range->position - stopAt) > 0 ||
-            context.dir * (range->position + context.matchLength - stopAt) > 0) {
-            // result was outside the range to be searched
-            haveOutOfRangeResults = YES;
-        } else {
-            // Found a good result.
-            context.status = Matched;
-            [filtered addObject:range];
+    // Blocks whose trigram signature rules out a match are skipped without being expanded.
+    if ([block mayContainMatchesForQuery:context.trigramQuery]) {
+        [block findSubstring:context.substring
+                     options:context.options
+                        mode:context.mode
+                    atOffset:context.offset
+                     results:context.results
+             multipleResults:((context.options & FindMultipleResults) != 0)];
+        NSMutableArray* filtered = [NSMutableArray arrayWithCapacity:[context.results count]];
+        BOOL haveOutOfRangeResults = NO;
+        int blockPosition = [self _blockPosition:context.absBlockNum - num_dropped_blocks];
+        const int stopAt = stopPosition.absolutePosition - droppedChars;
+        for (ResultRange* range in context.results) {
+            range->position += blockPosition;
+            if (context.dir * (range->position - stopAt) > 0 ||
+                context.dir * (range->position + context.matchLength - stopAt) > 0) {
+                // result was outside the range to be searched
+                haveOutOfRangeResults = YES;
+            } else {
+                // Found a good result.
+                context.status = Matched;
+                [filtered addObject:range];
+            }
+        }
+        context.results = filtered;
+        if ([filtered count] == 0 && haveOutOfRangeResults) {
+            context.status = NotFound;
         }
-    }
-    context.results = filtered;
-    if ([filtered count] == 0 && haveOutOfRangeResults) {
-        context.status = NotFound;
     }
 
     // Prepare to continue searching next block.
@@ -1087,6 +1097,16 @@ NS_INLINE int TotalNumberOfRawLines(LineBuffer *self) {
     return theCopy;
 }
 
+- (LineBuffer *)newDetachedCopy {
+    LineBuffer *theCopy = [self newAppendOnlyCopy];
+    [theCopy->_lineBlocks detachBlocks];
+    return theCopy;
+}
+
+- (void)finishDetachedCopy {
+    [_lineBlocks finishDetaching];
+}
+
 - (int)numberOfDroppedBlocks {
     return num_dropped_blocks;
 }
@@ -1098,38 +1118,38 @@ NS_INLINE int TotalNumberOfRawLines(LineBuffer *self) {
 // Returns whether we truncated lines.
 - (BOOL)encodeBlocks:(id<iTermEncoderAdapter>)encoder
             maxLines:(NSInteger)maxLines {
-    __block BOOL truncated = NO;
-    __block NSInteger numLines = 0;
-
-    iTermOrderedDictionary<NSString *, LineBlock *> *index =
-    [iTermOrderedDictionary byMappingEnumerator:_lineBlocks.blocks.reverseObjectEnumerator
-                                          block:^id _Nonnull(NSUInteger index,
-                                                             LineBlock *_Nonnull block) {
-        DLog(@"Maybe encode block %p with guid %@", block, block.stringUniqueIdentifier);
-        return block.stringUniqueIdentifier;
-    }];
+    // Decide which blocks to keep before encoding anything so that blocks whose generation hasn't
+    // changed since the last save can be skipped without losing count of their lines.
+    BOOL truncated = NO;
+    NSInteger numLines = 0;
+    NSMutableArray<NSString *> *identifiers = [NSMutableArray array];
+    NSMutableDictionary<NSString *, LineBlock *> *blocks = [NSMutableDictionary dictionary];
+    for (LineBlock *block in _lineBlocks.blocks.reverseObjectEnumerator) {
+        NSString *identifier = block.stringUniqueIdentifier;
+        [identifiers addObject:identifier];
+        blocks[identifier] = block;
+        // This caps the amount of data at a reasonable but arbitrary size.
+        numLines += [block numLinesForEncodingWithWrapWidth:80];
+        if (numLines >= maxLines) {
+            truncated = YES;
+            break;
+        }
+    }
     [encoder encodeArrayWithKey:kLineBufferBlocksKey
-                    identifiers:index.keys
+                    identifiers:identifiers
                      generation:iTermGenerationAlwaysEncode
                         options:iTermGraphEncoderArrayOptionsReverse
                           block:^BOOL(id<iTermEncoderAdapter> _Nonnull encoder,
                                       NSInteger i,
                                       NSString * _Nonnull identifier,
                                       BOOL *stop) {
-        LineBlock *block = index[identifier];
+        LineBlock *block = blocks[identifier];
         DLog(@"Encode %@ with identifier %@ and generation %@", block, identifier, @(block.generation));
         return [encoder encodeDictionaryWithKey:kLineBufferBlockWrapperKey
                                      generation:block.generation
                                           block:^BOOL(id<iTermEncoderAdapter>  _Nonnull encoder) {
-            assert(!truncated);
             DLog(@"Really encode block %p with guid %@", block, block.stringUniqueIdentifier);
-            [encoder mergeDictionary:block.dictionary]; 
-            // This caps the amount of data at a reasonable but arbitrary size.
-            numLines += [block getNumLinesWithWrapWidth:80];
-            if (numLines >= maxLines) {
-                truncated = YES;
-                *stop = YES;
-            }
+            [encoder mergeDictionary:block.dictionary];
             return YES;
         }];
     }];
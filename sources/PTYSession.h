@@ -874,6 +874,9 @@ backgroundColor:(NSColor *)backgroundColor;
 // Call this when a session moves to a different tab or window to update the session ID.
 - (void)didMoveSession;
 - (void)triggerDidChangeNameTo:(NSString *)newName;
+
+// Time spent matching each trigger's regex, most expensive first. For debug logs.
+- (NSString *)triggerTimingReport;
 - (void)didInitializeSessionWithName:(NSString *)name;
 - (void)profileNameDidChangeTo:(NSString *)name;
 - (void)profileDidChangeToProfileWithName:(NSString *)name;
@@ -19,6 +19,7 @@
 #import "iTermBackgroundDrawingHelper.h"
 #import "iTermBadgeLabel.h"
 #import "iTermBuriedSessions.h"
+#import "iTermBufferPacker.h"
 #import "iTermBuiltInFunctions.h"
 #import "iTermCacheableImage.h"
 #import "iTermCarbonHotKeyController.h"
@@ -77,6 +78,8 @@
 #import "iTermProfilePreferences.h"
 #import "iTermPromptOnCloseReason.h"
 #import "iTermRecentDirectoryMO.h"
+#import "iTermRegexPrefilter.h"
+#import "iTermTriggerEvaluator.h"
 #import "iTermRestorableSession.h"
 #import "iTermRule.h"
 #import "iTermSavePanel.h"
@@ -414,6 +417,16 @@ static const NSUInteger kMaxHosts = 100;
     // The current triggers.
     NSMutableArray *_triggers;
 
+    // Matches _triggers' regexes, usually on a background queue. Rebuilt with _triggers.
+    iTermTriggerEvaluator *_triggerEvaluator;
+
+    // Same for the regexes of _expect's expectations. Rebuilt when they change.
+    iTermRegexPrefilter *_expectationPrefilter;
+
+    // Incremented whenever lines in scrollback may have changed (e.g., reflow on resize or
+    // clearing scrollback). Part of the generation reported to API clients by GetBuffer.
+    long long _apiBufferEpoch;
+
     // Does the terminal think this session is focused?
     BOOL _focused;
 
@@ -850,6 +863,8 @@ ITERM_WEAKLY_REFERENCEABLE
     dispatch_release(_executionSemaphore);
     [_colorMap release];
     [_triggers release];
+    [_triggerEvaluator release];
+    [_expectationPrefilter release];
     [_pasteboard release];
     [_pbtext release];
     [_creationDate release];
@@ -2957,6 +2972,8 @@ ITERM_WEAKLY_REFERENCEABLE
         DLog(@"Execute token %@ cursor=(%d, %d)", token, _screen.cursorX - 1, _screen.cursorY - 1);
         [_terminal executeToken:token];
     }
+    // %output notifications for a pane are coalesced until the end of the read.
+    [_tmuxGateway flushPendingOutput];
 
     [self finishedHandlingNewOutputOfLength:length];
 
@@ -3028,27 +3045,105 @@ ITERM_WEAKLY_REFERENCEABLE
     // If the trigger causes the session to get released, don't crash.
     [[self retain] autorelease];
 
-    for (iTermExpectation *expectation in [[_expect.expectations copy] autorelease]) {
-        NSArray<NSString *> *capture = [stringLine.stringValue captureComponentsMatchedByRegex:expectation.regex];
+    // Each prefilter finds the regexes that could match the line in one pass so the rest don't
+    // have to be run.
+    NSString *string = stringLine.stringValue;
+    NSArray<iTermExpectation *> *expectations = [[_expect.expectations copy] autorelease];
+    [[self prefilterForExpectations:expectations] enumerateRegexesForString:string
+                                                                      block:^(NSUInteger i, BOOL mayMatch, BOOL *stop) {
+        if (!mayMatch) {
+            return;
+        }
+        iTermExpectation *expectation = expectations[i];
+        NSArray<NSString *> *capture = [string captureComponentsMatchedByRegex:expectation.regex];
         if (capture.count) {
             [expectation didMatchWithCaptureGroups:capture];
         }
-    }
+    }];
 
+    if (!_triggers.count) {
+        return;
+    }
     // If a trigger changes the current profile then _triggers gets released and we should stop
     // processing triggers. This can happen with automatic profile switching.
     NSArray<Trigger *> *triggers = [[_triggers retain] autorelease];
+    iTermTriggerEvaluator *evaluator = [[_triggerEvaluator retain] autorelease];
+
+    // Off by default: the actions run after later tokens may have moved the cursor or changed
+    // the screen, which instant triggers and actions like highlighting depend on.
+    if ([iTermAdvancedSettingsModel evaluateTriggersInBackground]) {
+        [evaluator findMatchesInStringLine:stringLine
+                               partialLine:partial
+                                completion:^(NSArray<NSArray<iTermTriggerMatch *> *> *matches) {
+            [self performTriggerActionsForMatches:matches
+                                         triggers:triggers
+                                       stringLine:stringLine
+                                      partialLine:partial
+                                       lineNumber:startAbsLineNumber];
+        }];
+        return;
+    }
 
-    for (Trigger *trigger in triggers) {
+    [evaluator.prefilter enumerateRegexesForString:string block:^(NSUInteger i, BOOL mayMatch, BOOL *stopPtr) {
+        Trigger *trigger = triggers[i];
+        if (!mayMatch) {
+            [trigger didNotMatchLineNumber:startAbsLineNumber partialLine:partial];
+            return;
+        }
+        // This includes the time to perform actions, unlike background evaluation.
+        const NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
         BOOL stop = [trigger tryString:stringLine
                              inSession:self
                            partialLine:partial
                             lineNumber:startAbsLineNumber
                       useInterpolation:_triggerParametersUseInterpolatedStrings];
+        [evaluator recordTime:[NSDate timeIntervalSinceReferenceDate] - start forTriggerAtIndex:i];
         if (stop || _exited || (_triggers != triggers)) {
-            break;
+            *stopPtr = YES;
+        }
+    }];
+}
+
+// Main queue. Called with matches found on the trigger evaluator's queue.
+- (void)performTriggerActionsForMatches:(NSArray<NSArray<iTermTriggerMatch *> *> *)matches
+                               triggers:(NSArray<Trigger *> *)triggers
+                             stringLine:(iTermStringLine *)stringLine
+                            partialLine:(BOOL)partial
+                             lineNumber:(long long)startAbsLineNumber {
+    [triggers enumerateObjectsUsingBlock:^(Trigger *trigger, NSUInteger i, BOOL *stopPtr) {
+        if (_exited || _triggers != triggers) {
+            // The session ended or the profile changed while matching was in progress.
+            *stopPtr = YES;
+            return;
         }
+        if (matches[i].count == 0) {
+            [trigger didNotMatchLineNumber:startAbsLineNumber partialLine:partial];
+            return;
+        }
+        if ([trigger performActionsForMatches:matches[i]
+                                     onString:stringLine
+                                    inSession:self
+                                  partialLine:partial
+                                   lineNumber:startAbsLineNumber
+                             useInterpolation:_triggerParametersUseInterpolatedStrings]) {
+            *stopPtr = YES;
+        }
+    }];
+}
+
+- (NSString *)triggerTimingReport {
+    return [_triggerEvaluator timingReport];
+}
+
+- (iTermRegexPrefilter *)prefilterForExpectations:(NSArray<iTermExpectation *> *)expectations {
+    NSArray<NSString *> *regexes = [expectations mapWithBlock:^id(iTermExpectation *expectation) {
+        return expectation.regex;
+    }];
+    if (![_expectationPrefilter.regexes isEqualToArray:regexes]) {
+        [_expectationPrefilter release];
+        _expectationPrefilter = [[iTermRegexPrefilter alloc] initWithRegexes:regexes];
     }
+    return _expectationPrefilter;
 }
 
 - (void)appendStringToTriggerLine:(NSString *)s {
@@ -3934,6 +4029,8 @@ ITERM_WEAKLY_REFERENCEABLE
             [_triggers addObject:trigger];
         }
     }
+    [_triggerEvaluator release];
+    _triggerEvaluator = [[iTermTriggerEvaluator alloc] initWithTriggers:_triggers];
     _triggerParametersUseInterpolatedStrings = [iTermProfilePreferences boolForKey:KEY_TRIGGERS_USE_INTERPOLATED_STRINGS
                                                                          inProfile:aDict];
 
@@ -9779,6 +9876,7 @@ scrollToFirstResult:(BOOL)scrollToFirstResult {
 }
 
 - (void)screenSizeDidChangeWithNewTopLineAt:(int)newTop {
+    _apiBufferEpoch++;
     if ([(PTYScroller*)([_view.scrollview verticalScroller]) userScroll] && newTop >= 0) {
         const VT100GridRange range = VT100GridRangeMake(newTop,
                                                         _textview.rangeOfVisibleLines.length);
@@ -10060,6 +10158,7 @@ scrollToFirstResult:(BOOL)scrollToFirstResult {
 }
 
 - (void)screenDidClearScrollbackBuffer:(VT100Screen *)screen {
+    _apiBufferEpoch++;
     [_delegate sessionDidClearScrollbackBuffer:self];
 }
 
@@ -12499,14 +12598,108 @@ scrollToFirstResult:(BOOL)scrollToFirstResult {
     return VT100GridAbsWindowedRangeMake(VT100GridAbsCoordRangeMake(0, range.location, 0, NSMaxRange(range)), 0, 0);
 }
 
+// The low bits of a GetBuffer generation hold the absolute line number of the first line on the
+// screen and the high bits hold _apiBufferEpoch.
+static const int kAPIBufferGenerationLineBits = 40;
+
+- (long long)apiBufferGeneration {
+    const long long firstScreenLine = _screen.numberOfScrollbackLines + _screen.totalScrollbackOverflow;
+    return (_apiBufferEpoch << kAPIBufferGenerationLineBits) | (firstScreenLine & ((1LL << kAPIBufferGenerationLineBits) - 1));
+}
+
+// Returns the absolute line number before which nothing can have changed since |generation| was
+// reported, or -1 if anything might have changed.
+- (long long)firstPossiblyChangedLineSinceAPIBufferGeneration:(long long)generation {
+    if ((generation >> kAPIBufferGenerationLineBits) != _apiBufferEpoch) {
+        return -1;
+    }
+    const long long firstScreenLine = generation & ((1LL << kAPIBufferGenerationLineBits) - 1);
+    if (firstScreenLine > _screen.numberOfScrollbackLines + _screen.totalScrollbackOverflow) {
+        return -1;
+    }
+    return firstScreenLine;
+}
+
+- (void)setCursorAndRange:(VT100GridAbsWindowedRange)windowedRange
+               inResponse:(ITMGetBufferResponse *)response {
+    response.cursor = [[[ITMCoord alloc] init] autorelease];
+    response.cursor.x = _screen.currentGrid.cursor.x;
+    response.cursor.y = _screen.currentGrid.cursor.y + _screen.numberOfScrollbackLines + _screen.totalScrollbackOverflow;
+
+    response.windowedCoordRange.coordRange.start.x = windowedRange.coordRange.start.x;
+    response.windowedCoordRange.coordRange.start.y = windowedRange.coordRange.start.y;
+    response.windowedCoordRange.coordRange.end.x = windowedRange.coordRange.end.x;
+    response.windowedCoordRange.coordRange.end.y = windowedRange.coordRange.end.y;
+    response.windowedCoordRange.columns.location = windowedRange.columnWindow.location;
+    response.windowedCoordRange.columns.length = windowedRange.columnWindow.length;
+    response.generation = [self apiBufferGeneration];
+}
+
+// Packs whole lines (the column window is ignored) until the range or max_packed_size is
+// exhausted. The returned range ends where the next request should begin.
+- (ITMGetBufferResponse *)packedBufferResponseForRequest:(ITMGetBufferRequest *)request
+                                           windowedRange:(VT100GridAbsWindowedRange)windowedRange {
+    ITMGetBufferResponse *response = [[[ITMGetBufferResponse alloc] init] autorelease];
+    const long long overflow = _screen.totalScrollbackOverflow;
+    long long firstLine = MAX(windowedRange.coordRange.start.y, overflow);
+    long long endLine = windowedRange.coordRange.end.y;
+    if (windowedRange.coordRange.end.x > 0) {
+        endLine++;
+    }
+    endLine = MIN(endLine, overflow + _screen.numberOfLines);
+    if (request.hasSinceGeneration) {
+        const long long unchangedBefore = [self firstPossiblyChangedLineSinceAPIBufferGeneration:request.sinceGeneration];
+        if (unchangedBefore > firstLine) {
+            firstLine = MIN(unchangedBefore, MAX(firstLine, endLine));
+            response.incremental = YES;
+        }
+    }
+
+    const NSUInteger maxSize = request.maxPackedSize > 0 ? request.maxPackedSize : 1024 * 1024;
+    iTermBufferPacker *packer = [[[iTermBufferPacker alloc] init] autorelease];
+    const int width = _screen.width;
+    screen_char_t *buffer = iTermMalloc(sizeof(screen_char_t) * (width + 1));
+    long long y;
+    for (y = firstLine; y < endLine; y++) {
+        if (packer.numberOfLines > 0 && packer.length >= maxSize) {
+            break;
+        }
+        const screen_char_t *line = [_screen getLineAtIndex:y - overflow withBuffer:buffer];
+        int length = width;
+        while (length > 0 && line[length - 1].code == 0 && !line[length - 1].complexChar) {
+            length--;
+        }
+        [packer appendLine:line length:length continuation:line[width].code];
+    }
+    free(buffer);
+
+    response.packedContents = packer.data;
+    response.moreAvailable = (y < endLine);
+    response.status = ITMGetBufferResponse_Status_Ok;
+    [self setCursorAndRange:VT100GridAbsWindowedRangeMake(VT100GridAbsCoordRangeMake(0, firstLine, 0, y), 0, 0)
+                 inResponse:response];
+    return response;
+}
+
 - (ITMGetBufferResponse *)handleGetBufferRequest:(ITMGetBufferRequest *)request {
     ITMGetBufferResponse *response = [[[ITMGetBufferResponse alloc] init] autorelease];
 
-    const VT100GridAbsWindowedRange windowedRange = [self absoluteWindowedCoordRangeFromLineRange:request.lineRange];
+    VT100GridAbsWindowedRange windowedRange = [self absoluteWindowedCoordRangeFromLineRange:request.lineRange];
     if (windowedRange.coordRange.start.x < 0) {
         response.status = ITMGetBufferResponse_Status_InvalidLineRange;
         return nil;
     }
+    if (request.encoding == ITMGetBufferRequest_Encoding_Packed) {
+        return [self packedBufferResponseForRequest:request windowedRange:windowedRange];
+    }
+    if (request.hasSinceGeneration) {
+        const long long unchangedBefore = [self firstPossiblyChangedLineSinceAPIBufferGeneration:request.sinceGeneration];
+        if (unchangedBefore > windowedRange.coordRange.start.y) {
+            windowedRange.coordRange.start = VT100GridAbsCoordMake(0, MIN(unchangedBefore, MAX(windowedRange.coordRange.start.y,
+                                                                                                windowedRange.coordRange.end.y)));
+            response.incremental = YES;
+        }
+    }
 
     const VT100GridWindowedRange range = VT100GridWindowedRangeFromVT100GridAbsWindowedRange(windowedRange, _screen.totalScrollbackOverflow);
     iTermTextExtractor *extractor = [iTermTextExtractor textExtractorWithDataSource:_screen];
@@ -12549,17 +12742,8 @@ scrollToFirstResult:(BOOL)scrollToFirstResult {
     if (line) {
         handleEol(EOL_SOFT, 0, 0);
     }
-    response.cursor = [[[ITMCoord alloc] init] autorelease];
-    response.cursor.x = _screen.currentGrid.cursor.x;
-    response.cursor.y = _screen.currentGrid.cursor.y + _screen.numberOfScrollbackLines + _screen.totalScrollbackOverflow;
-
     response.status = ITMGetBufferResponse_Status_Ok;
-    response.windowedCoordRange.coordRange.start.x = windowedRange.coordRange.start.x;
-    response.windowedCoordRange.coordRange.start.y = windowedRange.coordRange.start.y;
-    response.windowedCoordRange.coordRange.end.x = windowedRange.coordRange.end.x;
-    response.windowedCoordRange.coordRange.end.y = windowedRange.coordRange.end.y;
-    response.windowedCoordRange.columns.location = windowedRange.columnWindow.location;
-    response.windowedCoordRange.columns.length = windowedRange.columnWindow.length;
+    [self setCursorAndRange:windowedRange inResponse:response];
 
     return response;
 }
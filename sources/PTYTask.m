@@ -18,7 +18,9 @@
 #import "iTermMultiServerJobManager.h"
 #import "iTermOpenDirectory.h"
 #import "iTermOrphanServerAdopter.h"
+#import "iTermPTYReadBuffer.h"
 #import "iTermThreadSafety.h"
+#import "iTermThroughputEstimator.h"
 #import "iTermTmuxJobManager.h"
 #import "NSDictionary+iTerm.h"
 
@@ -78,6 +80,10 @@ static void HandleSigChld(int n) {
     BOOL _haveBumpedProcessCache;
     dispatch_queue_t _jobManagerQueue;
     BOOL _isTmuxTask;
+
+    // These are only used on the TaskNotifier thread, in processRead.
+    size_t _readSize;
+    iTermThroughputEstimator *_readThroughputEstimator;
 }
 
 - (instancetype)init {
@@ -101,6 +107,9 @@ static void HandleSigChld(int n) {
             self.jobManager = [[iTermLegacyJobManager alloc] initWithQueue:_jobManagerQueue];
         }
         self.fd = -1;
+        _readSize = ITERM_PTY_READ_MINIMUM_SIZE;
+        _readThroughputEstimator = [[iTermThroughputEstimator alloc] initWithHistoryOfDuration:5.0 / 30.0
+                                                                              secondsPerBucket:1 / 30.0];
     }
     return self;
 }
@@ -441,40 +450,29 @@ static void HandleSigChld(int n) {
     [self.delegate threadedTaskBrokenPipe];
 }
 
+// Drains as much as is available, up to _readSize bytes, into one batch so that heavy output costs
+// one parser pass and one main-thread dispatch per batch rather than per 1 KB read. _readSize
+// grows toward ITERM_PTY_READ_MAXIMUM_SIZE while throughput is high and shrinks back when it falls.
 - (void)processRead {
-    int iterations = 4;
-    int bytesRead = 0;
-
-    char buffer[MAXRW * iterations];
-    for (int i = 0; i < iterations; ++i) {
-        // Only read up to MAXRW*iterations bytes, then release control
-        ssize_t n = read(self.fd, buffer + bytesRead, MAXRW);
-        if (n < 0) {
-            // There was a read error.
-            if (errno != EAGAIN && errno != EINTR) {
-                // It was a serious error.
-                [self brokenPipe];
-                return;
-            } else {
-                // We could read again in the case of EINTR but it would
-                // complicate the code with little advantage. Just bail out.
-                n = 0;
-            }
-        }
-        bytesRead += n;
-        if (n < MAXRW) {
-            // If we read fewer bytes than expected, return. For some apparently
-            // undocumented reason, read() never returns more than 1024 bytes
-            // (at least on OS 10.6), so that's what MAXRW is set to. If that
-            // ever goes down this'll break.
-            break;
-        }
+    const size_t size = _readSize;
+    char *buffer = iTermPTYReadBufferAcquire(size);
+    const ssize_t bytesRead = iTermPTYReadCoalesced(self.fd, buffer, size);
+    if (bytesRead < 0) {
+        // There was a serious read error.
+        iTermPTYReadBufferRelease(buffer, size);
+        [self brokenPipe];
+        return;
     }
 
+    [_readThroughputEstimator addByteCount:bytesRead];
+    _readSize = iTermPTYReadSizeAdapt(size, bytesRead, _readThroughputEstimator.estimatedThroughput);
+
     hasOutput = YES;
 
-    // Send data to the terminal
-    [self readTask:buffer length:bytesRead];
+    // Send data to the terminal. Everything downstream copies what it keeps, so the buffer can go
+    // back to the pool afterwards.
+    [self readTask:buffer length:(int)bytesRead];
+    iTermPTYReadBufferRelease(buffer, size);
 }
 
 - (void)processWrite {
@@ -163,8 +163,9 @@ typedef struct screen_char_t
 
     // If set, the 'code' field does not give a utf-16 value but is instead a
     // key into a string table of more complex chars (combined, surrogate pairs,
-    // etc.). Valid 'code' values for a complex char are in [1, 0xefff] and will
-    // be recycled as needed.
+    // etc.). Valid 'code' values for a complex char are in [1, 0xefff] and are
+    // never reused. Once they run out, new complex chars become
+    // UNICODE_REPLACEMENT_CHAR.
     unsigned int complexChar : 1;
 
     // Various bits affecting text appearance. The bold flag here is semantic
@@ -436,6 +437,15 @@ void InitializeScreenChar(screen_char_t *s, screen_char_t fg, screen_char_t bg);
 // complex characters.
 void ConvertCharsToGraphicsCharset(screen_char_t *s, int len);
 
+// Fills |dest| with |length| copies of |templateChar| whose codes are taken from the ASCII bytes
+// in |bytes|. If |graphics| is set the codes are translated as by ConvertCharsToGraphicsCharset.
+// This lets ASCII output be expanded directly into its final destination.
+void ExpandASCIIToScreenChars(const char *bytes,
+                              int length,
+                              screen_char_t templateChar,
+                              BOOL graphics,
+                              screen_char_t *dest);
+
 // Indicates if s contains any combining marks.
 BOOL StringContainsCombiningMark(NSString *s);
 
@@ -34,6 +34,7 @@
 #import "charmaps.h"
 #import "iTermAdvancedSettingsModel.h"
 #import "iTermImageInfo.h"
+#import "iTermInternedStringTable.h"
 #import "iTermMalloc.h"
 #import "NSArray+iTerm.h"
 #import "NSCharacterSet+iTerm.h"
@@ -44,22 +45,24 @@ static NSString *const kScreenCharInverseComplexCharMapKey = @"Inverse Complex C
 static NSString *const kScreenCharImageMapKey = @"Image Map";
 static NSString *const kScreenCharCCMNextKeyKey = @"Next Key";
 static NSString *const kScreenCharHasWrappedKey = @"Has Wrapped";
+static NSString *const kScreenCharComplexCharNextKeyKey = @"Next Complex Char Key";
 
-static NSInteger gScreenCharGeneration;
+// Complex chars are assigned codes below this.
+static const int kComplexCharCodeLimit = 0xf000;
 
-// Maps codes to strings
-static NSMutableDictionary* complexCharMap;
-static NSMutableSet<NSNumber *> *spacingCombiningMarkCodeNumbers;
-// Maps strings to codes.
-static NSMutableDictionary* inverseComplexCharMap;
+// Flags for strings in the complex char table.
+static const uint32_t kComplexCharFlagSpacingCombiningMark = 1;
+
+static _Atomic NSInteger gScreenCharGeneration;
+
+// Maps codes to strings and strings to codes. Each entry's object is an NSString with the same
+// contents, which the table owns and never releases. Safe to use from any thread.
+static iTermInternedStringTable *gComplexCharTable;
 // Image info. Maps a NSNumber with the image's code to an ImageInfo object.
 static NSMutableDictionary<NSNumber *, iTermImageInfo *> *gImages;
 static NSMutableDictionary* gEncodableImageMap;
-// Next available code.
+// Next available image code.
 static int ccmNextKey = 1;
-// If ccmNextKey has wrapped then this is set to true and we have to delete old
-// strings before creating a new one with a recycled code.
-static BOOL hasWrapped = NO;
 
 typedef NS_ENUM(int, iTermTriState) {
     iTermTriStateFalse,
@@ -169,13 +172,45 @@ iTermTriState iTermTriStateFromBool(BOOL b) {
 
 @end
 
-static void CreateComplexCharMapIfNeeded() {
-    if (!complexCharMap) {
-        complexCharMap = [[NSMutableDictionary alloc] initWithCapacity:1000];
-        spacingCombiningMarkCodeNumbers = [[NSMutableSet alloc] initWithCapacity:1000];
-        inverseComplexCharMap = [[NSMutableDictionary alloc] initWithCapacity:1000];
+static iTermInternedStringTable *ComplexCharTable(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        gComplexCharTable = iTermInternedStringTableCreate(1,
+                                                           kComplexCharCodeLimit - 1,
+                                                           iTermBoxDrawingCodeMin,
+                                                           iTermBoxDrawingCodeMax);
         gScreenCharGeneration++;
+    });
+    return gComplexCharTable;
+}
+
+// Converts a string to UTF-32 for the complex char table. Uses |stackBuffer| if it's big enough
+// and mallocs a buffer otherwise; free the result if it isn't |stackBuffer|.
+static uint32_t *ComplexCharCodePointsFromString(NSString *str,
+                                                 uint32_t *stackBuffer,
+                                                 NSUInteger stackCapacity,
+                                                 uint32_t *lengthPtr) {
+    const NSUInteger length = str.length;
+    uint32_t *dest = length <= stackCapacity ? stackBuffer : iTermMalloc(sizeof(uint32_t) * length);
+    // Convert in place: UTF-16 units go in the second half of |dest|'s bytes, which is never
+    // overwritten before it's read since each code point takes at least one unit.
+    unichar *units = (unichar *)dest + length;
+    [str getCharacters:units range:NSMakeRange(0, length)];
+    uint32_t n = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        if (IsHighSurrogate(units[i]) && i + 1 < length && IsLowSurrogate(units[i + 1])) {
+            dest[n++] = DecodeSurrogatePair(units[i], units[i + 1]);
+            i++;
+        } else {
+            dest[n++] = units[i];
+        }
     }
+    *lengthPtr = n;
+    return dest;
+}
+
+static const iTermInternedString *ComplexCharEntry(int key) {
+    return iTermInternedStringTableGet(ComplexCharTable(), key);
 }
 
 NSString *ComplexCharToStr(int key) {
@@ -183,12 +218,14 @@ NSString *ComplexCharToStr(int key) {
         return ReplacementString();
     }
 
-    CreateComplexCharMapIfNeeded();
-    return [complexCharMap objectForKey:[NSNumber numberWithInt:key]];
+    // Codes are never reused, so the table's string is immortal and can be returned as is.
+    const iTermInternedString *entry = ComplexCharEntry(key);
+    return entry ? (NSString *)entry->object : nil;
 }
 
 BOOL ComplexCharCodeIsSpacingCombiningMark(unichar code) {
-    return [spacingCombiningMarkCodeNumbers containsObject:@(code)];
+    const iTermInternedString *entry = ComplexCharEntry(code);
+    return entry && (entry->flags & kComplexCharFlagSpacingCombiningMark);
 }
 
 NSString *ScreenCharToStr(const screen_char_t *const sct) {
@@ -208,21 +245,28 @@ NSString *CharToStr(unichar code, BOOL isComplex) {
 }
 
 int ExpandScreenChar(screen_char_t* sct, unichar* dest) {
-    NSString* value = nil;
     if (sct->code == UNICODE_REPLACEMENT_CHAR) {
-        value = ReplacementString();
-    } else if (sct->complexChar) {
-        value = ComplexCharToStr(sct->code);
-    } else {
+        NSString *value = ReplacementString();
+        [value getCharacters:dest];
+        return (int)[value length];
+    } else if (!sct->complexChar) {
         *dest = sct->code;
         return 1;
     }
-    if (!value) {
-        // This can happen if state restoration goes awry.
-        return 0;
+    const iTermInternedString *entry = ComplexCharEntry(sct->code);
+    // Convert straight from the table's UTF-32 so no string object is involved. A missing entry can
+    // happen if state restoration goes awry.
+    int n = 0;
+    for (uint32_t i = 0; entry && i < entry->length; i++) {
+        const uint32_t c = entry->codePoints[i];
+        if (c >= 0x10000) {
+            dest[n++] = 0xd800 + ((c - 0x10000) >> 10);
+            dest[n++] = 0xdc00 + ((c - 0x10000) & 0x3ff);
+        } else {
+            dest[n++] = c;
+        }
     }
-    [value getCharacters:dest];
-    return (int)[value length];
+    return n;
 }
 
 UTF32Char CharToLongChar(unichar code, BOOL isComplex)
@@ -258,6 +302,9 @@ screen_char_t ImageCharForNewImage(NSString *name,
     int newKey;
     do {
         newKey = ccmNextKey++;
+        if (ccmNextKey == kComplexCharCodeLimit) {
+            ccmNextKey = 1;
+        }
     } while (ComplexCharKeyIsReserved(newKey));
 
     screen_char_t c;
@@ -312,49 +359,63 @@ VT100GridCoord GetPositionOfImageInChar(screen_char_t c) {
 
 int GetOrSetComplexChar(NSString *str,
                         iTermTriState isSpacingCombiningMark) {
-    CreateComplexCharMapIfNeeded();
-    NSNumber *number = inverseComplexCharMap[str];
-    if (number) {
-        return [number intValue];
-    }
-
-    gScreenCharGeneration++;
-    int newKey;
-    do {
-        newKey = ccmNextKey++;
-    } while (ComplexCharKeyIsReserved(newKey));
-
-    number = @(newKey);
-    if (hasWrapped) {
-        NSString* oldStr = complexCharMap[number];
-        if (oldStr) {
-            [inverseComplexCharMap removeObjectForKey:oldStr];
-            [spacingCombiningMarkCodeNumbers removeObject:number];
+    iTermInternedStringTable *table = ComplexCharTable();
+    uint32_t stackCodePoints[kMaxParts * 2];
+    uint32_t length = 0;
+    uint32_t *codePoints = ComplexCharCodePointsFromString(str,
+                                                           stackCodePoints,
+                                                           sizeof(stackCodePoints) / sizeof(*stackCodePoints),
+                                                           &length);
+    int code = iTermInternedStringTableFind(table, codePoints, length);
+    if (code) {
+        if (codePoints != stackCodePoints) {
+            free(codePoints);
         }
+        return code;
     }
+
+    uint32_t flags = 0;
     switch (isSpacingCombiningMark) {
         case iTermTriStateTrue:
-            [spacingCombiningMarkCodeNumbers addObject:number];
+            flags |= kComplexCharFlagSpacingCombiningMark;
             break;
         case iTermTriStateFalse:
             break;
         case iTermTriStateOther: {
             NSCharacterSet *scmSet = [NSCharacterSet spacingCombiningMarksForUnicodeVersion:12];
             if ([str rangeOfCharacterFromSet:scmSet].location != NSNotFound) {
-                [spacingCombiningMarkCodeNumbers addObject:number];
+                flags |= kComplexCharFlagSpacingCombiningMark;
             }
         }
     }
-    complexCharMap[number] = str;
-    inverseComplexCharMap[str] = number;
-    if ([iTermAdvancedSettingsModel restoreWindowContents]) {
-        [NSApp invalidateRestorableState];
+    // The table keeps this reference forever if the string is added.
+    NSString *object = [str copy];
+    bool added = false;
+    code = iTermInternedStringTableIntern(table, codePoints, length, flags, object, &added);
+    if (codePoints != stackCodePoints) {
+        free(codePoints);
+    }
+    if (!added) {
+        [object release];
+        if (!code) {
+            // Every code is taken. Reusing one would change what existing cells say, so show a
+            // replacement character instead.
+            DLog(@"Out of complex char codes for %@", str);
+            return UNICODE_REPLACEMENT_CHAR;
+        }
+        return code;
     }
-    if (ccmNextKey == 0xf000) {
-        ccmNextKey = 1;
-        hasWrapped = YES;
+    gScreenCharGeneration++;
+    if ([iTermAdvancedSettingsModel restoreWindowContents]) {
+        if ([NSThread isMainThread]) {
+            [NSApp invalidateRestorableState];
+        } else {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [NSApp invalidateRestorableState];
+            });
+        }
     }
-    return newKey;
+    return code;
 }
 
 int AppendToComplexChar(int key, unichar codePoint) {
@@ -362,7 +423,7 @@ int AppendToComplexChar(int key, unichar codePoint) {
         return UNICODE_REPLACEMENT_CHAR;
     }
 
-    NSString* str = [complexCharMap objectForKey:[NSNumber numberWithInt:key]];
+    NSString* str = ComplexCharToStr(key);
     if ([str length] == kMaxParts) {
         NSLog(@"Warning: char <<%@>> with key %d reached max length %d", str,
               key, kMaxParts);
@@ -727,17 +788,64 @@ void ConvertCharsToGraphicsCharset(screen_char_t *s, int len)
     }
 }
 
+void ExpandASCIIToScreenChars(const char *bytes,
+                              int length,
+                              screen_char_t templateChar,
+                              BOOL graphics,
+                              screen_char_t *dest) {
+    templateChar.complexChar = NO;
+    if (graphics) {
+        for (int i = 0; i < length; i++) {
+            dest[i] = templateChar;
+            dest[i].code = charmap[(unsigned char)bytes[i]];
+        }
+    } else {
+        for (int i = 0; i < length; i++) {
+            dest[i] = templateChar;
+            dest[i].code = (unsigned char)bytes[i];
+        }
+    }
+}
+
 NSInteger ScreenCharGeneration(void) {
     return gScreenCharGeneration;
 }
 
+typedef struct {
+    NSMutableDictionary *complexCharMap;
+    NSMutableDictionary *inverseComplexCharMap;
+    NSMutableArray<NSNumber *> *spacingCombiningMarks;
+} ScreenCharEncodingContext;
+
+static void ScreenCharEncodeComplexChar(void *context, uint32_t code, const iTermInternedString *entry) {
+    ScreenCharEncodingContext *encodingContext = context;
+    NSNumber *number = @(code);
+    NSString *string = (NSString *)entry->object;
+    encodingContext->complexCharMap[number] = string;
+    encodingContext->inverseComplexCharMap[string] = number;
+    if (entry->flags & kComplexCharFlagSpacingCombiningMark) {
+        [encodingContext->spacingCombiningMarks addObject:number];
+    }
+}
+
 NSDictionary *ScreenCharEncodedRestorableState(void) {
-    return @{ kScreenCharComplexCharMapKey: complexCharMap ?: @{},
-              kScreenCharSpacingCombiningMarksKey: spacingCombiningMarkCodeNumbers.allObjects ?: @[],
-              kScreenCharInverseComplexCharMapKey: inverseComplexCharMap ?: @{},
+    // The inverse map is redundant but older versions expect it.
+    ScreenCharEncodingContext context = {
+        .complexCharMap = [NSMutableDictionary dictionary],
+        .inverseComplexCharMap = [NSMutableDictionary dictionary],
+        .spacingCombiningMarks = [NSMutableArray array]
+    };
+    iTermInternedStringTableEnumerate(ComplexCharTable(), &context, ScreenCharEncodeComplexChar);
+    uint32_t nextComplexCharKey = 1;
+    bool isFull = false;
+    iTermInternedStringTableGetAllocationState(ComplexCharTable(), &nextComplexCharKey, &isFull);
+    return @{ kScreenCharComplexCharMapKey: context.complexCharMap,
+              kScreenCharSpacingCombiningMarksKey: context.spacingCombiningMarks,
+              kScreenCharInverseComplexCharMapKey: context.inverseComplexCharMap,
               kScreenCharImageMapKey: gEncodableImageMap ?: @{},
               kScreenCharCCMNextKeyKey: @(ccmNextKey),
-              kScreenCharHasWrappedKey: @(hasWrapped) };
+              kScreenCharComplexCharNextKeyKey: @(nextComplexCharKey),
+              kScreenCharHasWrappedKey: @(isFull) };
 }
 
 void ScreenCharGarbageCollectImages(void) {
@@ -755,21 +863,27 @@ void ScreenCharClearProvisionalFlagForImageWithCode(int code) {
 
 void ScreenCharDecodeRestorableState(NSDictionary *state) {
     NSDictionary *stateComplexCharMap = state[kScreenCharComplexCharMapKey];
-    CreateComplexCharMapIfNeeded();
-    for (id key in stateComplexCharMap) {
-        if (!complexCharMap[key]) {
-            complexCharMap[key] = stateComplexCharMap[key];
+    NSSet<NSNumber *> *spacingCombiningMarks =
+        [NSSet setWithArray:state[kScreenCharSpacingCombiningMarksKey] ?: @[]];
+    iTermInternedStringTable *table = ComplexCharTable();
+    for (NSNumber *key in stateComplexCharMap) {
+        NSString *string = stateComplexCharMap[key];
+        if (![key isKindOfClass:[NSNumber class]] || ![string isKindOfClass:[NSString class]]) {
+            continue;
         }
-    }
-    NSArray<NSString *> *spacingCombiningMarksArray = state[kScreenCharSpacingCombiningMarksKey];
-    for (NSNumber *number in spacingCombiningMarksArray) {
-        [spacingCombiningMarkCodeNumbers addObject:number];
-    }
-
-    NSDictionary *stateInverseMap = state[kScreenCharInverseComplexCharMapKey];
-    for (id key in stateInverseMap) {
-        if (!inverseComplexCharMap[key]) {
-            inverseComplexCharMap[key] = stateInverseMap[key];
+        uint32_t stackCodePoints[kMaxParts * 2];
+        uint32_t length = 0;
+        uint32_t *codePoints = ComplexCharCodePointsFromString(string,
+                                                               stackCodePoints,
+                                                               sizeof(stackCodePoints) / sizeof(*stackCodePoints),
+                                                               &length);
+        const uint32_t flags = [spacingCombiningMarks containsObject:key] ? kComplexCharFlagSpacingCombiningMark : 0;
+        NSString *object = [string copy];
+        if (!iTermInternedStringTableSet(table, key.unsignedIntValue, codePoints, length, flags, object)) {
+            [object release];
+        }
+        if (codePoints != stackCodePoints) {
+            free(codePoints);
         }
     }
     NSDictionary *imageMap = state[kScreenCharImageMapKey];
@@ -783,8 +897,12 @@ void ScreenCharDecodeRestorableState(NSDictionary *state) {
             DLog(@"Decoded restorable state for image %@: %@", key, info);
         }
     }
-    ccmNextKey = [state[kScreenCharCCMNextKeyKey] intValue];
-    hasWrapped = [state[kScreenCharHasWrappedKey] boolValue];
+    ccmNextKey = MAX(1, [state[kScreenCharCCMNextKeyKey] intValue] % kComplexCharCodeLimit);
+    // Older versions shared one counter between images and complex chars.
+    NSNumber *nextComplexCharKey = state[kScreenCharComplexCharNextKeyKey] ?: state[kScreenCharCCMNextKeyKey];
+    // Older versions recycled codes once they ran out and saved whether they had. Codes aren't
+    // recycled anymore, so only the next key matters.
+    iTermInternedStringTableSetNextCode(table, nextComplexCharKey.unsignedIntValue);
 }
 
 static NSString *ScreenCharColorDescription(unsigned int red,
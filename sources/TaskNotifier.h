@@ -1,4 +1,5 @@
-// This implements a select loop that runs in a special thread.
+// This implements an event loop that runs in a special thread and moves data between tasks, their
+// file descriptors, and coprocesses. See iTermEventPoller.h.
 
 #import <Foundation/Foundation.h>
 
@@ -9,9 +9,10 @@
 #import "TaskNotifier.h"
 #import "Coprocess.h"
 #import "DebugLogging.h"
+#import "iTermAdvancedSettingsModel.h"
+#import "iTermMalloc.h"
 
-#include <sys/time.h>
-#include <sys/select.h>
+#include "iTermEventPoller.h"
 
 #define PtyTaskDebugLog(args...)
 
@@ -20,6 +21,16 @@ NSString *const kCoprocessStatusChangeNotification = @"kCoprocessStatusChangeNot
 static int unblockPipeR;
 static int unblockPipeW;
 
+// Events beyond this are picked up by the next wait.
+static const int kTaskNotifierMaximumEventsPerWait = 256;
+
+// What a watched file descriptor belongs to. |owner| is the task itself or its coprocess.
+typedef struct {
+    id<iTermTask> task;
+    id owner;
+    NSUInteger generation;
+} iTermTaskNotifierRegistration;
+
 @implementation TaskNotifier
 {
     NSMutableArray<id<iTermTask>> *_tasks;
@@ -30,6 +41,17 @@ static int unblockPipeW;
 
     // A set of NSNumber*s holding pids of tasks that need to be wait()ed on
     NSMutableSet* deadpool;
+
+    // The following are only used on the notifier thread.
+    iTermEventPoller *_poller;
+    // Indexed by file descriptor. Retains the task and owner of each watched descriptor so they
+    // stay valid (and their addresses aren't reused) while the poller knows about them.
+    iTermTaskNotifierRegistration *_registrations;
+    int _registrationsCapacity;
+    // Incremented each time registrations are updated.
+    NSUInteger _generation;
+    // Set when tasks were added or removed while handling the current batch of events.
+    BOOL _tasksChangedDuringDispatch;
 }
 
 
@@ -52,6 +74,15 @@ static int unblockPipeW;
         _tasks = [[NSMutableArray alloc] init];
         tasksLock = [[NSRecursiveLock alloc] init];
         tasksChanged = NO;
+        if ([iTermAdvancedSettingsModel useKernelEventQueueForTaskNotifier]) {
+            _poller = iTermEventPollerCreate();
+        } else {
+            _poller = iTermEventPollerCreateWithBackend(iTermEventPollerBackendSelect);
+        }
+        if (!_poller) {
+            [self release];
+            return nil;
+        }
 
         int unblockPipe[2];
         if (pipe(unblockPipe) != 0) {
@@ -75,6 +106,12 @@ static int unblockPipeW;
     [_tasks release];
     [tasksLock release];
     [deadpool release];
+    for (int fd = 0; fd < _registrationsCapacity; fd++) {
+        [_registrations[fd].task release];
+        [_registrations[fd].owner release];
+    }
+    free(_registrations);
+    iTermEventPollerFree(_poller);
     close(unblockPipeR);
     close(unblockPipeW);
     [super dealloc];
@@ -153,42 +190,118 @@ void UnblockTaskNotifier(void) {
     write(unblockPipeW, &dummy, 1);
 }
 
-- (BOOL)handleReadOnFileDescriptor:(int)fd task:(id<iTermTask>)task fdSet:(fd_set *)fdSet {
-    if (FD_ISSET(fd, fdSet)) {
+#pragma mark - Registration
+
+- (void)setRegistrationForFileDescriptor:(int)fd task:(id<iTermTask>)task owner:(id)owner {
+    if (fd >= _registrationsCapacity) {
+        int capacity = MAX(64, _registrationsCapacity);
+        while (capacity <= fd) {
+            capacity *= 2;
+        }
+        _registrations = iTermRealloc(_registrations, capacity, sizeof(*_registrations));
+        memset(_registrations + _registrationsCapacity, 0, sizeof(*_registrations) * (capacity - _registrationsCapacity));
+        _registrationsCapacity = capacity;
+    }
+    iTermTaskNotifierRegistration *registration = &_registrations[fd];
+    if (registration->owner != owner) {
+        [registration->task release];
+        [registration->owner release];
+        registration->task = [task retain];
+        registration->owner = [owner retain];
+    }
+    registration->generation = _generation;
+}
+
+// Registers the file descriptor of |task| and of its coprocess, if any, with interest according to
+// their current state. The poller only makes a system call for the ones that changed.
+- (void)registerFileDescriptorsForTask:(id<iTermTask>)task {
+    const int fd = [task fd];
+    if (fd < 0) {
+        PtyTaskDebugLog(@"Task has fd of %d\n", fd);
+    } else if (iTermEventPollerSetInterest(_poller, fd, (uintptr_t)task, [task wantsRead], [task wantsWrite])) {
+        [self setRegistrationForFileDescriptor:fd task:task owner:task];
+    }
+
+    @synchronized (task) {
+        Coprocess *coprocess = [task coprocess];
+        if (!coprocess || [coprocess eof]) {
+            return;
+        }
+        const int rfd = [coprocess readFileDescriptor];
+        const int wfd = [coprocess writeFileDescriptor];
+        const BOOL wantToWrite = [coprocess wantToWrite];
+        // The read side is registered even when not reading so a hangup gets noticed (except with
+        // the select() backend; see iTermEventPollerEvent).
+        if (iTermEventPollerSetInterest(_poller,
+                                        rfd,
+                                        (uintptr_t)coprocess,
+                                        [coprocess wantToRead] && [task writeBufferHasRoom],
+                                        wantToWrite && wfd == rfd)) {
+            [self setRegistrationForFileDescriptor:rfd task:task owner:coprocess];
+        }
+        if (wantToWrite && wfd != rfd &&
+            iTermEventPollerSetInterest(_poller, wfd, (uintptr_t)coprocess, NO, YES)) {
+            [self setRegistrationForFileDescriptor:wfd task:task owner:coprocess];
+        }
+    }
+}
+
+- (void)updateRegistrations {
+    _generation++;
+    iTermEventPollerBeginUpdate(_poller);
+    // Unblock pipe to interrupt the wait whenever a PTYTask register/unregisters
+    iTermEventPollerSetInterest(_poller, unblockPipeR, (uintptr_t)self, YES, NO);
+    for (id<iTermTask> task in _tasks) {
+        [self registerFileDescriptorsForTask:task];
+    }
+    iTermEventPollerEndUpdate(_poller);
+
+    // Let go of objects whose file descriptors are no longer watched.
+    for (int fd = 0; fd < _registrationsCapacity; fd++) {
+        iTermTaskNotifierRegistration *registration = &_registrations[fd];
+        if (registration->owner && registration->generation != _generation) {
+            [registration->task release];
+            [registration->owner release];
+            registration->task = nil;
+            registration->owner = nil;
+        }
+    }
+}
+
+#pragma mark - Event Handling
+
+// Returns YES if |task| was deregistered while the lock was released.
+- (BOOL)taskIsGone:(id<iTermTask>)task {
+    if (tasksChanged) {
+        PtyTaskDebugLog(@"Tasks changed\n");
+        tasksChanged = NO;
+        _tasksChangedDuringDispatch = YES;
+    }
+    return _tasksChangedDuringDispatch && ![_tasks containsObject:task];
+}
+
+- (void)handleEvent:(const iTermEventPollerEvent *)event forTask:(id<iTermTask>)task {
+    if (event->readable) {
         PtyTaskDebugLog(@"run/processRead: unlock");
         [tasksLock unlock];
         [task processRead];
         PtyTaskDebugLog(@"run/processRead: lock");
         [tasksLock lock];
-        if (tasksChanged) {
-            PtyTaskDebugLog(@"Restart iteration\n");
-            tasksChanged = NO;
-            return YES;
+        if ([self taskIsGone:task]) {
+            return;
         }
     }
-    return NO;
-}
-
-- (BOOL)handleWriteOnFileDescriptor:(int)fd task:(id<iTermTask>)task fdSet:(fd_set *)fdSet {
-    if (FD_ISSET(fd, fdSet)) {
+    if (event->writable) {
         PtyTaskDebugLog(@"run/processWrite: unlock");
         [tasksLock unlock];
-        [task retain];
         [task processWrite];
-        [task release];
         PtyTaskDebugLog(@"run/processWrite: lock");
         [tasksLock lock];
-        if (tasksChanged) {
-            PtyTaskDebugLog(@"Restart iteration\n");
-            tasksChanged = NO;
-            return YES;
+        if ([self taskIsGone:task]) {
+            return;
         }
     }
-    return NO;
-}
-
-- (BOOL)handleErrorOnFileDescriptor:(int)fd task:(id<iTermTask>)task fdSet:(fd_set *)fdSet {
-    if (FD_ISSET(fd, fdSet)) {
+    if (event->error) {
         PtyTaskDebugLog(@"run/brokenPipe: unlock");
         [tasksLock unlock];
         // brokenPipe will call deregisterTask and add the pid to
@@ -196,249 +309,165 @@ void UnblockTaskNotifier(void) {
         [task brokenPipe];
         PtyTaskDebugLog(@"run/brokenPipe: lock");
         [tasksLock lock];
-        if (tasksChanged) {
-            PtyTaskDebugLog(@"Restart iteration\n");
-            tasksChanged = NO;
-            return YES;
-        }
+        [self taskIsGone:task];
     }
-    return NO;
 }
 
-- (void)handleReadOnFileDescriptor:(int)fd
-                              task:(id<iTermTask>)task
-                     withCoprocess:(Coprocess *)coprocess
-                             fdSet:(fd_set *)fdSet {
-    if (![coprocess eof] && FD_ISSET(fd, fdSet)) {
-        PtyTaskDebugLog(@"Reading from coprocess");
-        [coprocess read];
-        [task writeTask:coprocess.inputBuffer];
-        [coprocess.inputBuffer setLength:0];
+// Moves input around between a coprocess and its task. Returns YES if the coprocess was removed.
+- (BOOL)handleEvent:(const iTermEventPollerEvent *)event
+            forTask:(id<iTermTask>)task
+          coprocess:(Coprocess *)coprocess {
+    if ([task fd] < 0 || [task hasBrokenPipe]) {
+        // Make sure the pipe wasn't just broken.
+        return NO;
+    }
+    @synchronized (task) {
+        if ([task coprocess] != coprocess) {
+            return NO;
+        }
+        if (event->fd == [coprocess readFileDescriptor]) {
+            if (![coprocess eof] && event->readable) {
+                PtyTaskDebugLog(@"Reading from coprocess");
+                [coprocess read];
+                [task writeTask:coprocess.inputBuffer];
+                [coprocess.inputBuffer setLength:0];
+            }
+            if (event->error) {
+                PtyTaskDebugLog(@"EOF on coprocess %@", coprocess);
+                coprocess.eof = YES;
+            }
+        }
+        if (event->fd == [coprocess writeFileDescriptor] && event->writable && ![coprocess eof]) {
+            PtyTaskDebugLog(@"Write to coprocess %@", coprocess);
+            [coprocess write];
+        }
+        return [self removeCoprocessIfFinishedForTask:task];
     }
 }
 
-- (void)handleErrorOnFileDescriptor:(int)fd
-                      withCoprocess:(Coprocess *)coprocess
-                              fdSet:(fd_set *)fdSet {
-    if (FD_ISSET(fd, fdSet)) {
-        PtyTaskDebugLog(@"EOF on coprocess %@", coprocess);
-        coprocess.eof = YES;
+// Must be called while synchronized on |task|.
+- (BOOL)removeCoprocessIfFinishedForTask:(id<iTermTask>)task {
+    Coprocess *coprocess = [task coprocess];
+    if (![coprocess eof]) {
+        return NO;
     }
+    [deadpool addObject:@([coprocess pid])];
+    [coprocess terminate];
+    [task setCoprocess:nil];
+    return YES;
 }
 
-- (void)handleWriteOnFileDescriptor:(int)coprocessWriteFd
-                      withCoprocess:(Coprocess *)coprocess
-                              fdSet:(fd_set *)fdSet {
-    if (FD_ISSET(coprocessWriteFd, fdSet)) {
-        if (![coprocess eof]) {
-            PtyTaskDebugLog(@"Write to coprocess %@", coprocess);
-            [coprocess write];
+#pragma mark - Run Loop
+
+- (void)reapDeadTasksAndProcesses {
+    PtyTaskDebugLog(@"Begin cleaning out dead tasks");
+    NSMutableArray<id<iTermTask>> *tasksToDeregister = [NSMutableArray array];
+    for (id<iTermTask> theTask in _tasks) {
+        if ([theTask fd] < 0) {
+            PtyTaskDebugLog(@"Deregister dead task %@\n", theTask);
+            [tasksToDeregister addObject:theTask];
         }
     }
+    for (id<iTermTask> theTask in tasksToDeregister) {
+        [self deregisterTask:theTask];
+    }
+
+    if ([deadpool count] > 0) {
+        // waitpid() on pids that we think are dead or will be dead soon.
+        NSMutableSet* newDeadpool = [NSMutableSet setWithCapacity:[deadpool count]];
+        for (NSNumber* pid in deadpool) {
+            if ([pid intValue] < 0) {
+                continue;
+            }
+            int statLoc;
+            PtyTaskDebugLog(@"wait on %d", [pid intValue]);
+            pid_t waitresult = waitpid([pid intValue], &statLoc, WNOHANG);
+            if (waitresult == 0) {
+                // the process is not yet dead, so put it back in the pool
+                [newDeadpool addObject:pid];
+            } else if (waitresult < 0) {
+                if (errno != ECHILD) {
+                    PtyTaskDebugLog(@"  wait failed with %d (%s), adding back to deadpool", errno, strerror(errno));
+                    [newDeadpool addObject:pid];
+                } else {
+                    PtyTaskDebugLog(@"  wait failed with ECHILD, I guess we already waited on it.");
+                }
+            }
+        }
+        [deadpool release];
+        deadpool = [newDeadpool retain];
+    }
 }
 
 - (void)run {
-    fd_set rfds;
-    fd_set wfds;
-    fd_set efds;
-    int highfd;
-    NSEnumerator *iter;
     NSAutoreleasePool *autoreleasePool = [[NSAutoreleasePool alloc] init];
+    iTermEventPollerEvent events[kTaskNotifierMaximumEventsPerWait];
 
-    // FIXME: replace this with something better...
     for(;;) {
-
-        FD_ZERO(&rfds);
-        FD_ZERO(&wfds);
-        FD_ZERO(&efds);
-
-        // Unblock pipe to interrupt select() whenever a PTYTask register/unregisters
-        highfd = unblockPipeR;
-        FD_SET(unblockPipeR, &rfds);
-        NSMutableSet *handledFds = [[NSMutableSet alloc] initWithCapacity:256];
-
-        // Add all the PTYTask pipes
         PtyTaskDebugLog(@"run1: lock");
         [tasksLock lock];
-        PtyTaskDebugLog(@"Begin cleaning out dead tasks");
-        NSMutableArray<id<iTermTask>> *tasksToDeregister = [NSMutableArray array];
-        for (id<iTermTask> theTask in _tasks) {
-            if ([theTask fd] < 0) {
-                PtyTaskDebugLog(@"Deregister dead task %@\n", theTask);
-                [tasksToDeregister addObject:theTask];
-            }
-        }
-        for (id<iTermTask> theTask in tasksToDeregister) {
-            [self deregisterTask:theTask];
-        }
+        [self reapDeadTasksAndProcesses];
 
-        if ([deadpool count] > 0) {
-            // waitpid() on pids that we think are dead or will be dead soon.
-            NSMutableSet* newDeadpool = [NSMutableSet setWithCapacity:[deadpool count]];
-            for (NSNumber* pid in deadpool) {
-                if ([pid intValue] < 0) {
-                    continue;
-                }
-                int statLoc;
-                PtyTaskDebugLog(@"wait on %d", [pid intValue]);
-                pid_t waitresult = waitpid([pid intValue], &statLoc, WNOHANG);
-                if (waitresult == 0) {
-                    // the process is not yet dead, so put it back in the pool
-                    [newDeadpool addObject:pid];
-                } else if (waitresult < 0) {
-                    if (errno != ECHILD) {
-                        PtyTaskDebugLog(@"  wait failed with %d (%s), adding back to deadpool", errno, strerror(errno));
-                        [newDeadpool addObject:pid];
-                    } else {
-                        PtyTaskDebugLog(@"  wait failed with ECHILD, I guess we already waited on it.");
-                    }
-                }
-            }
-            [deadpool release];
-            deadpool = [newDeadpool retain];
-        }
-
-        // Figure out the file descriptors to select on.
-        PtyTaskDebugLog(@"Begin enumeration over %lu tasks\n", (unsigned long)[_tasks count]);
+        BOOL notifyOfCoprocessChange = NO;
         for (id<iTermTask> task in _tasks) {
-            PtyTaskDebugLog(@"Got task %@\n", task);
-            int fd = [task fd];
-            if (fd < 0) {
-                PtyTaskDebugLog(@"Task has fd of %d\n", fd);
-            } else {
-                // PtyTaskDebugLog(@"Select on fd %d\n", fd);
-                if (fd > highfd) {
-                    highfd = fd;
-                }
-                if ([task wantsRead]) {
-                    FD_SET(fd, &rfds);
-                }
-                if ([task wantsWrite]) {
-                    FD_SET(fd, &wfds);
-                }
-                FD_SET(fd, &efds);
-            }
-
             @synchronized (task) {
-                Coprocess *coprocess = [task coprocess];
-                if (coprocess) {
-                    if ([coprocess wantToRead] && [task writeBufferHasRoom]) {
-                        int rfd = [coprocess readFileDescriptor];
-                        if (rfd > highfd) {
-                            highfd = rfd;
-                        }
-                        FD_SET(rfd, &rfds);
-                    }
-                    if ([coprocess wantToWrite]) {
-                        int wfd = [coprocess writeFileDescriptor];
-                        if (wfd > highfd) {
-                            highfd = wfd;
-                        }
-                        FD_SET(wfd, &wfds);
-                    }
-                    if (![coprocess eof]) {
-                        int rfd = [coprocess readFileDescriptor];
-                        if (rfd > highfd) {
-                            highfd = rfd;
-                        }
-                        FD_SET(rfd, &efds);
-                    }
-                }
+                notifyOfCoprocessChange = [self removeCoprocessIfFinishedForTask:task] || notifyOfCoprocessChange;
             }
         }
 
+        // Figure out the file descriptors to wait on.
+        PtyTaskDebugLog(@"Update registrations for %lu tasks\n", (unsigned long)[_tasks count]);
+        [self updateRegistrations];
+        tasksChanged = NO;
+
         PtyTaskDebugLog(@"run1: unlock");
         [tasksLock unlock];
 
+        if (notifyOfCoprocessChange) {
+            [self performSelectorOnMainThread:@selector(notifyCoprocessChange)
+                                   withObject:nil
+                                waitUntilDone:YES];
+            notifyOfCoprocessChange = NO;
+        }
+
         [autoreleasePool drain];
         autoreleasePool = [[NSAutoreleasePool alloc] init];
 
         // Poll...
-        if (select(highfd+1, &rfds, &wfds, &efds, NULL) <= 0) {
-            switch(errno) {
-                case EAGAIN:
-                case EINTR:
-                default:
-                    goto breakloop;
-                    // If the file descriptor is closed in the main thread there's a race where sometimes you'll get an EBADF.
-            }
+        const int count = iTermEventPollerWait(_poller, events, kTaskNotifierMaximumEventsPerWait, -1);
+        if (count < 0) {
+            // EINTR, or if the file descriptor is closed in the main thread there's a race where
+            // sometimes you'll get an EBADF.
+            goto breakloop;
         }
 
-        // Interrupted?
-        if (FD_ISSET(unblockPipeR, &rfds)) {
-            char dummy[32];
-            do {
-                read(unblockPipeR, dummy, sizeof(dummy));
-            } while (errno != EAGAIN);
-        }
-
-        // Check for read events on PTYTask pipes
+        // Handle events on PTYTask file descriptors.
         PtyTaskDebugLog(@"run2: lock");
         [tasksLock lock];
-        PtyTaskDebugLog(@"Iterating over %lu tasks\n", (unsigned long)_tasks.count);
-        iter = [_tasks objectEnumerator];
-        BOOL notifyOfCoprocessChange = NO;
-
-        id<iTermTask> task;
-        while ((task = [iter nextObject])) {
-            PtyTaskDebugLog(@"Got task %@\n", task);
-            int fd = [task fd];
-
-            if (fd >= 0) {
-                // This is mostly paranoia, but if two threads
-                // end up with the same fd (because one closed
-                // and there was a race condition) then trying
-                // to read twice would hang.
-
-                if ([handledFds containsObject:@(fd)]) {
-                    PtyTaskDebugLog(@"Duplicate fd %d", fd);
-                    continue;
-                }
-                [[task retain] autorelease];
-                [handledFds addObject:@(fd)];
-
-                if ([self handleReadOnFileDescriptor:fd task:task fdSet:&rfds]) {
-                    iter = [_tasks objectEnumerator];
-                }
-                if ([self handleWriteOnFileDescriptor:fd task:task fdSet:&wfds]) {
-                    iter = [_tasks objectEnumerator];
-                }
-                if ([self handleErrorOnFileDescriptor:fd task:task fdSet:&efds]) {
-                    iter = [_tasks objectEnumerator];
-                }
-                // Move input around between coprocess and main process.
-                if ([task fd] >= 0 && ![task hasBrokenPipe]) {  // Make sure the pipe wasn't just broken.
-                    @synchronized (task) {
-                        Coprocess *coprocess = [task coprocess];
-                        if (coprocess) {
-                            fd = [coprocess readFileDescriptor];
-                            if ([handledFds containsObject:@(fd)]) {
-                                NSLog(@"Duplicate fd %d", fd);
-                                continue;
-                            }
-                            [handledFds addObject:@(fd)];
-
-                            [self handleReadOnFileDescriptor:fd task:task withCoprocess:coprocess fdSet:&rfds];
-                            [self handleErrorOnFileDescriptor:fd withCoprocess:coprocess fdSet:&efds];
-
-                            // Handle writes
-                            int coprocessWriteFd = [coprocess writeFileDescriptor];
-                            if ([handledFds containsObject:@(coprocessWriteFd)]) {
-                                NSLog(@"Duplicate fd %d", coprocessWriteFd);
-                                continue;
-                            }
-                            [handledFds addObject:@(coprocessWriteFd)];
-                            [self handleWriteOnFileDescriptor:coprocessWriteFd withCoprocess:coprocess fdSet:&wfds];
-
-                            if ([coprocess eof]) {
-                                [deadpool addObject:@([coprocess pid])];
-                                [coprocess terminate];
-                                [task setCoprocess:nil];
-                                notifyOfCoprocessChange = YES;
-                            }
-                        }
-                    }
-                }
+        PtyTaskDebugLog(@"Handling %d events\n", count);
+        _tasksChangedDuringDispatch = NO;
+        for (int i = 0; i < count; i++) {
+            const iTermEventPollerEvent *event = &events[i];
+            if (event->fd == unblockPipeR) {
+                // Interrupted
+                char dummy[32];
+                do {
+                    read(unblockPipeR, dummy, sizeof(dummy));
+                } while (errno != EAGAIN);
+                continue;
+            }
+            if (event->fd >= _registrationsCapacity || !_registrations[event->fd].owner) {
+                continue;
+            }
+            id<iTermTask> task = [[_registrations[event->fd].task retain] autorelease];
+            id owner = [[_registrations[event->fd].owner retain] autorelease];
+            if ([self taskIsGone:task]) {
+                continue;
+            }
+            if (owner == task) {
+                [self handleEvent:event forTask:task];
+            } else if ([self handleEvent:event forTask:task coprocess:owner]) {
+                notifyOfCoprocessChange = YES;
             }
         }
 
@@ -451,7 +480,6 @@ void UnblockTaskNotifier(void) {
         }
 
     breakloop:
-        [handledFds release];
         [autoreleasePool drain];
         autoreleasePool = [[NSAutoreleasePool alloc] init];
     }
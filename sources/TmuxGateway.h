@@ -96,6 +96,10 @@ typedef NS_ENUM(NSInteger, ControlCommand) {
 // The token must be TMUX_xxx.
 - (void)executeToken:(VT100Token *)token;
 
+// Delivers %output that executeToken: has been holding so consecutive notifications for a pane
+// reach the delegate together. Call after executing the tokens of a read.
+- (void)flushPendingOutput;
+
 - (void)sendCommand:(NSString *)command
      responseTarget:(id)target
    responseSelector:(SEL)selector;
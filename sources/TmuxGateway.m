@@ -9,6 +9,7 @@
 
 #import "iTermApplicationDelegate.h"
 #import "iTermAdvancedSettingsModel.h"
+#import "iTermTmuxOutputDecoder.h"
 #import "TmuxController.h"
 #import "NSArray+iTerm.h"
 #import "NSStringITerm.h"
@@ -100,6 +101,12 @@ static NSString *kCommandTimestamp = @"timestamp";
     // set to NO.
     BOOL _initialized;
     NSMutableDictionary<NSString *, iTermTmuxSubscriptionHandle *> *_subscriptions;
+
+    // Decoded %output for one pane that hasn't been given to the delegate yet. Consecutive
+    // notifications for the same pane are coalesced until -flushPendingOutput.
+    NSMutableData *_pendingOutput;
+    int _pendingOutputWindowPane;
+    NSNumber *_pendingOutputLatency;
 }
 
 @synthesize delegate = delegate_;
@@ -128,6 +135,8 @@ static NSString *kCommandTimestamp = @"timestamp";
     [_maximumServerVersion release];
     [_dcsID release];
     [_subscriptions release];
+    [_pendingOutput release];
+    [_pendingOutputLatency release];
 
     [super dealloc];
 }
@@ -152,82 +161,93 @@ static NSString *kCommandTimestamp = @"timestamp";
     [self.delegate tmuxDoubleAttachForSessionGUID:sessionGuid];
 }
 
-- (NSData *)decodeEscapedOutput:(const char *)bytes
-{
-    NSMutableData *data = [NSMutableData data];
-    unsigned char c;
-    for (int i = 0; bytes[i]; i++) {
-        c = bytes[i];
-        if (c < ' ') {
-            continue;
-        }
-        if (c == '\\') {
-            // Read exactly three bytes of octal values, or else set c to '?'.
-            c = 0;
-            for (int j = 0; j < 3; j++) {
-                i++;
-                if (bytes[i] == '\r') {
-                    // Ignore \r's that the line driver sprinkles in at its pleasure.
-                    continue;
-                }
-                if (bytes[i] < '0' || bytes[i] > '7') {
-                    c = '?';
-                    i--;  // Back up in case bytes[i] is a null; we don't want to go off the end.
-                    break;
-                }
-                c *= 8;
-                c += bytes[i] - '0';
-            }
-        }
-        [data appendBytes:&c length:1];
+// Decodes an escaped %output payload and appends it to the output waiting to be delivered. Output
+// for another pane is delivered first so that each pane sees its output in order.
+- (void)appendEscapedOutput:(const char *)bytes
+                     length:(NSUInteger)length
+               toWindowPane:(int)windowPane
+                    latency:(NSNumber *)latency {
+    if (_pendingOutput && _pendingOutputWindowPane != windowPane) {
+        [self flushPendingOutput];
+    }
+    if (!_pendingOutput) {
+        _pendingOutput = [[NSMutableData alloc] initWithCapacity:length];
+        _pendingOutputWindowPane = windowPane;
+    }
+    if (latency) {
+        [_pendingOutputLatency autorelease];
+        _pendingOutputLatency = [latency retain];
+    }
+    // Decode in place at the end of the pending output. Decoding never makes it longer.
+    const NSUInteger offset = _pendingOutput.length;
+    _pendingOutput.length = offset + length;
+    unsigned char *dest = (unsigned char *)_pendingOutput.mutableBytes + offset;
+    const size_t decodedLength = iTermTmuxDecodeEscapedOutput((const unsigned char *)bytes, length, dest);
+    _pendingOutput.length = offset + decodedLength;
+
+    TmuxLog(@"Run tmux command: \"%%%s \"%%%d\" %@ %.*s",
+            latency ? "extended-output" : "output", windowPane, latency, (int)decodedLength, dest);
+}
+
+- (void)flushPendingOutput {
+    if (!_pendingOutput) {
+        return;
+    }
+    NSData *data = [_pendingOutput autorelease];
+    NSNumber *latency = [_pendingOutputLatency autorelease];
+    _pendingOutput = nil;
+    _pendingOutputLatency = nil;
+    [delegate_ tmuxReadTask:data windowPane:_pendingOutputWindowPane latency:latency];
+}
+
+// Parses the pane ID in "%<pane id> " at |p|, which is before |end|. Returns -1 if it's malformed
+// and otherwise sets |*nextPtr| to the byte after the space.
+static int iTermTmuxParseWindowPane(const char *p, const char *end, const char **nextPtr) {
+    if (p >= end || *p != '%') {
+        return -1;
+    }
+    p++;
+    const char *space = memchr(p, ' ', end - p);
+    if (!space) {
+        return -1;
+    }
+    char *endptr = NULL;
+    const int windowPane = strtol(p, &endptr, 10);
+    if (windowPane < 0 || endptr != space) {
+        return -1;
     }
-    return data;
+    *nextPtr = space + 1;
+    return windowPane;
 }
 
 // %extended-output %<pane id> <latency> [more args?] : <data...><newline>
 - (void)parseExtendedOutputCommandData:(NSData *)input {
-    // Null terminate so we can do some string parsing without too much pain.
-    NSMutableData *data = [NSMutableData dataWithData:input];
-    [data appendBytes:"" length:1];
-
     // This one is tricky to parse because the string version of the command could have bogus UTF-8.
     // 3.1 and earlier:
     //   %output %<pane id> <data...><newline>
     // 3.2 and later, when pause mode is enabled:
     //   %output %<pane id> <latency> <data...><newline>
-    const char *command = [data bytes];
-    char *space = strchr(command, ' ');
-    if (!space) {
-        goto error;
-    }
-    const char *outputCommand = "%extended-output";
-    if (strncmp(outputCommand, command, strlen(outputCommand))) {
+    const char *command = [input bytes];
+    const char *end = command + input.length;
+    const char *outputCommand = "%extended-output ";
+    const size_t outputCommandLength = strlen(outputCommand);
+    if (input.length < outputCommandLength || strncmp(outputCommand, command, outputCommandLength)) {
         goto error;
     }
 
     // Pane ID
-    const char *paneId = space + 1;
-    if (*paneId != '%') {
-        goto error;
-    }
-    paneId++;
-    space = strchr(paneId, ' ');
-    if (!space) {
-        goto error;
-    }
-    char *endptr = NULL;
-    int windowPane = strtol(paneId, &endptr, 10);
-    if (windowPane < 0 || endptr != space) {
+    const char *latency;
+    const int windowPane = iTermTmuxParseWindowPane(command + outputCommandLength, end, &latency);
+    if (windowPane < 0) {
         goto error;
     }
 
     // Latency
-    const char *latency = space + 1;
-    space = strchr(latency, ' ');
+    const char *space = memchr(latency, ' ', end - latency);
     if (!space) {
         goto error;
     }
-    endptr = NULL;
+    char *endptr = NULL;
     NSNumber *ms = @(strtoll(latency, &endptr, 10));
     ms = @(ms.doubleValue / 1000.0);
     if (endptr != space) {
@@ -235,73 +255,53 @@ static NSString *kCommandTimestamp = @"timestamp";
     }
 
     // Skip unknown params
-    const char *colon = strchr(space + 1, ':');
+    const char *colon = memchr(space + 1, ':', end - (space + 1));
     if (!colon) {
         goto error;
     }
-    if (colon[1] != ' ') {
+    if (colon + 1 == end || colon[1] != ' ') {
         goto error;
     }
 
-    const char *encodedData = colon + 2;
-
     // Payload
-    NSData *decodedData = [self decodeEscapedOutput:encodedData];
-
-    TmuxLog(@"Run tmux command: \"%%extended-output \"%%%d\" %@ %.*s",
-            windowPane, ms, (int)[decodedData length], [decodedData bytes]);
-
-    [delegate_ tmuxReadTask:decodedData windowPane:windowPane latency:ms];
-
+    const char *encodedData = colon + 2;
+    [self appendEscapedOutput:encodedData
+                       length:end - encodedData
+                 toWindowPane:windowPane
+                      latency:ms];
     return;
 error:
-    [self abortWithErrorMessage:[NSString stringWithFormat:@"Malformed command (expected %%num data): \"%s\"", command]];
+    [self abortWithErrorMessage:[NSString stringWithFormat:@"Malformed command (expected %%num data): \"%.*s\"",
+                                 (int)input.length, command]];
 }
 
 // %output %<pane id> <data...><newline>
 - (void)parseOutputCommandData:(NSData *)input {
-    // Null terminate so we can do some string parsing without too much pain.
-    NSMutableData *data = [NSMutableData dataWithData:input];
-    [data appendBytes:"" length:1];
-
     // This one is tricky to parse because the string version of the command could have bogus UTF-8.
-    const char *command = [data bytes];
-    char *space = strchr(command, ' ');
-    if (!space) {
-        goto error;
-    }
-    const char *outputCommand = "%output";
-    if (strncmp(outputCommand, command, strlen(outputCommand))) {
+    const char *command = [input bytes];
+    const char *end = command + input.length;
+    const char *outputCommand = "%output ";
+    const size_t outputCommandLength = strlen(outputCommand);
+    if (input.length < outputCommandLength || strncmp(outputCommand, command, outputCommandLength)) {
         goto error;
     }
 
     // Pane ID
-    const char *paneId = space + 1;
-    if (*paneId != '%') {
-        goto error;
-    }
-    paneId++;
-    space = strchr(paneId, ' ');
-    if (!space) {
-        goto error;
-    }
-    char *endptr = NULL;
-    int windowPane = strtol(paneId, &endptr, 10);
-    if (windowPane < 0 || endptr != space) {
+    const char *encodedData;
+    const int windowPane = iTermTmuxParseWindowPane(command + outputCommandLength, end, &encodedData);
+    if (windowPane < 0) {
         goto error;
     }
 
     // Payload
-    NSData *decodedData = [self decodeEscapedOutput:space + 1];
-
-    TmuxLog(@"Run tmux command: \"%%output \"%%%d\" %.*s",
-            windowPane, (int)[decodedData length], [decodedData bytes]);
-
-    [delegate_ tmuxReadTask:decodedData windowPane:windowPane latency:nil];
-
+    [self appendEscapedOutput:encodedData
+                       length:end - encodedData
+                 toWindowPane:windowPane
+                      latency:nil];
     return;
 error:
-    [self abortWithErrorMessage:[NSString stringWithFormat:@"Malformed command (expected %%num data): \"%s\"", command]];
+    [self abortWithErrorMessage:[NSString stringWithFormat:@"Malformed command (expected %%num data): \"%.*s\"",
+                                 (int)input.length, command]];
 }
 
 - (void)parseLayoutChangeCommand:(NSString *)command
@@ -651,6 +651,11 @@ error:
 - (void)executeToken:(VT100Token *)token {
     NSString *command = token.string;
     NSData *data = token.savedData;
+    if (currentCommand_ ||
+        !([command hasPrefix:@"%output "] || [command hasPrefix:@"%extended-output "])) {
+        // Anything else might depend on the output before it having been delivered.
+        [self flushPendingOutput];
+    }
     if (_tmuxLogging) {
         [delegate_ tmuxPrintLine:[@"< " stringByAppendingString:command]];
     }
@@ -10,8 +10,19 @@
 @interface TmuxHistoryParser : NSObject
 
 + (instancetype)sharedInstance;
-- (NSArray<NSData *> *)parseDumpHistoryResponse:(NSString *)response
-                         ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
-                                 unicodeVersion:(NSInteger)unicodeVersion;
+
+// Converts the output of capture-pane into an array of NSData's, one per line. Each NSData is an
+// array of screen_char_t's. Returns nil on error. The response is streamed through a terminal's
+// parser a chunk at a time and cells are written straight into each line's data.
+- (NSArray<NSData *> *)parseDumpHistoryResponseData:(NSData *)response
+                             ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
+                                     unicodeVersion:(NSInteger)unicodeVersion;
+
+// Does the same on a background queue and then calls |completion| on the main queue. Several
+// panes' histories may be parsed at once.
+- (void)parseDumpHistoryResponseData:(NSData *)response
+              ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
+                      unicodeVersion:(NSInteger)unicodeVersion
+                          completion:(void (^)(NSArray<NSData *> *history))completion;
 
 @end
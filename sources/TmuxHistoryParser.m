@@ -7,10 +7,13 @@
 
 #import "TmuxHistoryParser.h"
 
-#import "iTermMalloc.h"
 #import "ScreenChar.h"
 #import "VT100Terminal.h"
 
+// How many bytes of a response to give the parser at a time. This bounds how many tokens exist at
+// once when a pane has a long history.
+static const NSUInteger iTermTmuxHistoryChunkSize = 64 * 1024;
+
 @implementation TmuxHistoryParser
 
 + (TmuxHistoryParser *)sharedInstance
@@ -22,83 +25,109 @@
     return instance;
 }
 
-// Returns nil on error
-// TODO: Test with italics
-- (NSData *)dataForHistoryLine:(NSString *)hist
-                  withTerminal:(VT100Terminal *)terminal
-        ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
-                unicodeVersion:(NSInteger)unicodeVersion {
-    screen_char_t *screenChars;
-    NSMutableData *result = [NSMutableData data];
-    NSData *histData = [hist dataUsingEncoding:NSUTF8StringEncoding];
-    [terminal.parser putStreamData:histData.bytes
-                            length:histData.length];
-
-    CVector vector;
-    CVectorCreate(&vector, 100);
-    [terminal.parser addParsedTokensToVector:&vector];
-    int n = CVectorCount(&vector);
-    for (int i = 0; i < n; i++) {
-        VT100Token *token = CVectorGetObject(&vector, i);
-        [terminal executeToken:token];
-        NSString *string = token.isStringType ? token.string : nil;
-        if (!string && token->type == VT100_ASCIISTRING) {
-            string = [token stringForAsciiData];
-        }
-
-        if (string) {
-            // Allocate double space in case they're all double-width characters.
-            screenChars = iTermMalloc(sizeof(screen_char_t) * 2 * string.length);
-            int len = 0;
-            StringToScreenChars(string,
-                                screenChars,
-                                [terminal foregroundColorCode],
-                                [terminal backgroundColorCode],
-                                &len,
-                                ambiguousIsDoubleWidth,
-                                NULL,
-                                NULL,
-                                NO,
-                                unicodeVersion);
-            if ([token isAscii] && [terminal charset]) {
-                ConvertCharsToGraphicsCharset(screenChars, len);
-            }
-            [result appendBytes:screenChars
-                         length:sizeof(screen_char_t) * len];
-            free(screenChars);
-        }
-        [token release];
+// Appends the cells for a string token to |line| using the terminal's current attributes. The
+// line's data grows in place so no intermediate buffer is needed.
+static void TmuxHistoryAppendStringToken(VT100Token *token,
+                                         VT100Terminal *terminal,
+                                         NSMutableData *line,
+                                         BOOL ambiguousIsDoubleWidth,
+                                         NSInteger unicodeVersion) {
+    const NSUInteger offset = line.length;
+    if (token->type == VT100_ASCIISTRING) {
+        AsciiData *asciiData = token.asciiData;
+        screen_char_t templateChar = { 0 };
+        InitializeScreenChar(&templateChar, [terminal foregroundColorCode], [terminal backgroundColorCode]);
+        line.length = offset + sizeof(screen_char_t) * asciiData->length;
+        ExpandASCIIToScreenChars(asciiData->buffer,
+                                 asciiData->length,
+                                 templateChar,
+                                 [terminal charset] != 0,
+                                 (screen_char_t *)((char *)line.mutableBytes + offset));
+        return;
     }
-    CVectorDestroy(&vector);
 
-    return result;
+    NSString *string = token.string;
+    // Allocate double space in case they're all double-width characters.
+    line.length = offset + sizeof(screen_char_t) * 2 * string.length;
+    screen_char_t *dest = (screen_char_t *)((char *)line.mutableBytes + offset);
+    int len = 0;
+    StringToScreenChars(string,
+                        dest,
+                        [terminal foregroundColorCode],
+                        [terminal backgroundColorCode],
+                        &len,
+                        ambiguousIsDoubleWidth,
+                        NULL,
+                        NULL,
+                        NO,
+                        unicodeVersion);
+    line.length = offset + sizeof(screen_char_t) * len;
 }
 
-// Return an NSArray of NSData's. Each NSData is an array of screen_char_t's,
-// with the last element in each being the newline. Returns nil on error.
-- (NSArray *)parseDumpHistoryResponse:(NSString *)response
-               ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
-                       unicodeVersion:(NSInteger)unicodeVersion {
+- (NSArray<NSData *> *)parseDumpHistoryResponseData:(NSData *)response
+                             ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
+                                     unicodeVersion:(NSInteger)unicodeVersion {
     if (![response length]) {
         return [NSArray array];
     }
-    NSArray *lines = [response componentsSeparatedByString:@"\n"];
-    NSMutableArray *screenLines = [NSMutableArray array];
     VT100Terminal *terminal = [[[VT100Terminal alloc] init] autorelease];
     terminal.tmuxMode = YES;
     [terminal setEncoding:NSUTF8StringEncoding];
-    for (NSString *line in lines) {
-        NSData *data = [self dataForHistoryLine:line
-                                   withTerminal:terminal
-                         ambiguousIsDoubleWidth:ambiguousIsDoubleWidth
-                                 unicodeVersion:unicodeVersion];
-        if (!data) {
-            return nil;
+
+    NSMutableArray<NSData *> *screenLines = [NSMutableArray array];
+    NSMutableData *line = [[NSMutableData alloc] init];
+    CVector vector;
+    CVectorCreate(&vector, 100);
+    const char *bytes = response.bytes;
+    for (NSUInteger offset = 0; offset < response.length; offset += iTermTmuxHistoryChunkSize) {
+        @autoreleasepool {
+            const NSUInteger length = MIN(iTermTmuxHistoryChunkSize, response.length - offset);
+            [terminal.parser putStreamData:bytes + offset length:(int)length];
+            [terminal.parser addParsedTokensToVector:&vector];
+            const int n = CVectorCount(&vector);
+            for (int i = 0; i < n; i++) {
+                VT100Token *token = CVectorGetObject(&vector, i);
+                if (token->type == VT100CC_LF) {
+                    // Lines are separated by newlines.
+                    [screenLines addObject:line];
+                    [line release];
+                    line = [[NSMutableData alloc] init];
+                } else {
+                    [terminal executeToken:token];
+                    if (token.isStringType) {
+                        TmuxHistoryAppendStringToken(token,
+                                                     terminal,
+                                                     line,
+                                                     ambiguousIsDoubleWidth,
+                                                     unicodeVersion);
+                    }
+                }
+                [token release];
+            }
+            vector.count = 0;
         }
-        [screenLines addObject:data];
     }
+    [screenLines addObject:line];
+    [line release];
+    CVectorDestroy(&vector);
 
     return screenLines;
 }
 
+- (void)parseDumpHistoryResponseData:(NSData *)response
+              ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
+                      unicodeVersion:(NSInteger)unicodeVersion
+                          completion:(void (^)(NSArray<NSData *> *history))completion {
+    completion = [[completion copy] autorelease];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        NSArray<NSData *> *history = [[self parseDumpHistoryResponseData:response
+                                                  ambiguousIsDoubleWidth:ambiguousIsDoubleWidth
+                                                          unicodeVersion:unicodeVersion] retain];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(history);
+            [history release];
+        });
+    });
+}
+
 @end
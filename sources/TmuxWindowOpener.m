@@ -276,7 +276,8 @@ NSString *const kTmuxWindowOpenerWindowOptionStyleValueFullScreen = @"FullScreen
                                            wp,
                                            [NSNumber numberWithBool:alternate],
                                            nil]
-                                    flags:kTmuxGatewayCommandShouldTolerateErrors];
+                                    flags:(kTmuxGatewayCommandShouldTolerateErrors |
+                                           kTmuxGatewayCommandWantsData)];
 }
 
 - (void)didReceiveError {
@@ -298,7 +299,9 @@ NSString *const kTmuxWindowOpenerWindowOptionStyleValueFullScreen = @"FullScreen
 
 // Command response handler for dump-history
 // info is an array: [window pane number, isAlternate flag]
-- (void)dumpHistoryResponse:(NSString *)response
+// Each pane's history is parsed in the background, concurrently with the others. The request
+// completes when its parse finishes.
+- (void)dumpHistoryResponse:(NSData *)response
            paneAndAlternate:(NSArray *)info {
     if (!response) {
         [self didReceiveError];
@@ -307,22 +310,24 @@ NSString *const kTmuxWindowOpenerWindowOptionStyleValueFullScreen = @"FullScreen
 
     NSNumber *wp = [info objectAtIndex:0];
     NSNumber *alt = [info objectAtIndex:1];
-    NSArray *history = [[TmuxHistoryParser sharedInstance] parseDumpHistoryResponse:response
-                                                             ambiguousIsDoubleWidth:ambiguousIsDoubleWidth_
-                                                                     unicodeVersion:self.unicodeVersion];
-    if (history) {
-        if ([alt boolValue]) {
-            [altHistories_ setObject:history forKey:wp];
+    [[TmuxHistoryParser sharedInstance] parseDumpHistoryResponseData:response
+                                              ambiguousIsDoubleWidth:ambiguousIsDoubleWidth_
+                                                      unicodeVersion:self.unicodeVersion
+                                                          completion:^(NSArray<NSData *> *history) {
+        if (history) {
+            if ([alt boolValue]) {
+                [altHistories_ setObject:history forKey:wp];
+            } else {
+                [histories_ setObject:history forKey:wp];
+            }
         } else {
-            [histories_ setObject:history forKey:wp];
+            NSAlert *alert = [[[NSAlert alloc] init] autorelease];
+            alert.messageText = @"Error: malformed history line from tmux.";
+            alert.informativeText = @"See Console.app for details";
+            [alert runModal];
         }
-    } else {
-        NSAlert *alert = [[[NSAlert alloc] init] autorelease];
-        alert.messageText = @"Error: malformed history line from tmux.";
-        alert.informativeText = @"See Console.app for details";
-        [alert runModal];
-    }
-    [self requestDidComplete];
+        [self requestDidComplete];
+    }];
 }
 
 - (NSArray<NSData *> *)historyLinesForWindowPane:(int)wp alternateScreen:(BOOL)altScreen {
@@ -18,6 +18,17 @@ extern NSString * const kTriggerActionKey;
 extern NSString * const kTriggerParameterKey;
 extern NSString * const kTriggerPartialLineKey;
 
+// A match of a trigger's regex, found ahead of time (possibly on another thread) so the action can
+// be performed later on the main thread.
+@interface iTermTriggerMatch : NSObject
+@property (nonatomic, readonly) NSArray<NSString *> *capturedStrings;
+@property (nonatomic, readonly) const NSRange *capturedRanges;
+
+- (instancetype)initWithCapturedStrings:(NSString *const *)capturedStrings
+                         capturedRanges:(const NSRange *)capturedRanges
+                                  count:(NSInteger)count;
+@end
+
 @interface Trigger : NSObject
 
 @property (nonatomic, copy) NSString *regex;
@@ -77,6 +88,24 @@ extern NSString * const kTriggerPartialLineKey;
        lineNumber:(long long)lineNumber
  useInterpolation:(BOOL)useInterpolation;
 
+// Call instead of -tryString:... when the regex is already known not to match the line. Updates
+// the per-line state the same way a failed match would.
+- (void)didNotMatchLineNumber:(long long)lineNumber partialLine:(BOOL)partialLine;
+
+// Returns every match of the regex in |string|. Safe to call on any thread. Returns an empty
+// array without running the regex if |partialLine| is set and this trigger doesn't run on partial
+// lines.
+- (NSArray<iTermTriggerMatch *> *)matchesInString:(NSString *)string partialLine:(BOOL)partialLine;
+
+// Main thread only. Equivalent to -tryString:... with matches from -matchesInString:partialLine:
+// for the same string. Returns YES if no more triggers should be processed.
+- (BOOL)performActionsForMatches:(NSArray<iTermTriggerMatch *> *)matches
+                        onString:(iTermStringLine *)stringLine
+                       inSession:(PTYSession *)aSession
+                     partialLine:(BOOL)partialLine
+                      lineNumber:(long long)lineNumber
+                useInterpolation:(BOOL)useInterpolation;
+
 // Subclasses must override this. Return YES if it can fire again on this line.
 - (BOOL)performActionWithCapturedStrings:(NSString *const *)capturedStrings
                           capturedRanges:(const NSRange *)capturedRanges
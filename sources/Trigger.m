@@ -21,6 +21,27 @@ NSString * const kTriggerActionKey = @"action";
 NSString * const kTriggerParameterKey = @"parameter";
 NSString * const kTriggerPartialLineKey = @"partial";
 
+@implementation iTermTriggerMatch {
+    NSData *_capturedRangesData;
+}
+
+- (instancetype)initWithCapturedStrings:(NSString *const *)capturedStrings
+                         capturedRanges:(const NSRange *)capturedRanges
+                                  count:(NSInteger)count {
+    self = [super init];
+    if (self) {
+        _capturedStrings = [[NSArray alloc] initWithObjects:capturedStrings count:count];
+        _capturedRangesData = [NSData dataWithBytes:capturedRanges length:sizeof(NSRange) * count];
+    }
+    return self;
+}
+
+- (const NSRange *)capturedRanges {
+    return _capturedRangesData.bytes;
+}
+
+@end
+
 @interface Trigger()<iTermObject>
 @end
 
@@ -133,11 +154,8 @@ NSString * const kTriggerPartialLineKey = @"partial";
     return NO;
 }
 
-- (BOOL)tryString:(iTermStringLine *)stringLine
-        inSession:(PTYSession *)aSession
-      partialLine:(BOOL)partialLine
-       lineNumber:(long long)lineNumber
- useInterpolation:(BOOL)useInterpolation {
+// Returns YES if the trigger shouldn't be tried on this line at all.
+- (BOOL)shouldSkipLineNumber:(long long)lineNumber partialLine:(BOOL)partialLine {
     if (_partialLine &&
         !self.instantTriggerCanFireMultipleTimesPerLine &&
         _lastLineNumber == lineNumber) {
@@ -145,10 +163,71 @@ NSString * const kTriggerPartialLineKey = @"partial";
         if (!partialLine) {
             _lastLineNumber = -1;
         }
-        return NO;
+        return YES;
     }
     if (partialLine && !_partialLine) {
         // This trigger doesn't support partial lines.
+        return YES;
+    }
+    return NO;
+}
+
+- (NSArray<iTermTriggerMatch *> *)matchesInString:(NSString *)string partialLine:(BOOL)partialLine {
+    if (partialLine && !_partialLine) {
+        return @[];
+    }
+    NSMutableArray<iTermTriggerMatch *> *matches = [NSMutableArray array];
+    [string enumerateStringsMatchedByRegex:regex_
+                                usingBlock:^(NSInteger captureCount,
+                                             NSString *const __unsafe_unretained *capturedStrings,
+                                             const NSRange *capturedRanges,
+                                             volatile BOOL *const stopEnumerating) {
+                                    [matches addObject:[[iTermTriggerMatch alloc] initWithCapturedStrings:capturedStrings
+                                                                                           capturedRanges:capturedRanges
+                                                                                                    count:captureCount]];
+                                }];
+    return matches;
+}
+
+- (BOOL)performActionsForMatches:(NSArray<iTermTriggerMatch *> *)matches
+                        onString:(iTermStringLine *)stringLine
+                       inSession:(PTYSession *)aSession
+                     partialLine:(BOOL)partialLine
+                      lineNumber:(long long)lineNumber
+                useInterpolation:(BOOL)useInterpolation {
+    if ([self shouldSkipLineNumber:lineNumber partialLine:partialLine]) {
+        return NO;
+    }
+    BOOL stopFutureTriggersFromRunningOnThisLine = NO;
+    for (iTermTriggerMatch *match in matches) {
+        _lastLineNumber = lineNumber;
+        DLog(@"Trigger %@ matched string %@", self, stringLine.stringValue);
+        const NSInteger count = match.capturedStrings.count;
+        __unsafe_unretained NSString *capturedStrings[MAX(1, count)];
+        [match.capturedStrings getObjects:capturedStrings range:NSMakeRange(0, count)];
+        if (![self performActionWithCapturedStrings:capturedStrings
+                                     capturedRanges:match.capturedRanges
+                                       captureCount:count
+                                          inSession:aSession
+                                           onString:stringLine
+                               atAbsoluteLineNumber:lineNumber
+                                   useInterpolation:useInterpolation
+                                               stop:&stopFutureTriggersFromRunningOnThisLine]) {
+            break;
+        }
+    }
+    if (!partialLine) {
+        _lastLineNumber = -1;
+    }
+    return stopFutureTriggersFromRunningOnThisLine;
+}
+
+- (BOOL)tryString:(iTermStringLine *)stringLine
+        inSession:(PTYSession *)aSession
+      partialLine:(BOOL)partialLine
+       lineNumber:(long long)lineNumber
+ useInterpolation:(BOOL)useInterpolation {
+    if ([self shouldSkipLineNumber:lineNumber partialLine:partialLine]) {
         return NO;
     }
 
@@ -178,6 +257,12 @@ NSString * const kTriggerPartialLineKey = @"partial";
     return stopFutureTriggersFromRunningOnThisLine;
 }
 
+- (void)didNotMatchLineNumber:(long long)lineNumber partialLine:(BOOL)partialLine {
+    if (!partialLine) {
+        _lastLineNumber = -1;
+    }
+}
+
 - (void)paramWithBackreferencesReplacedWithValues:(NSArray *)strings
                                             scope:(iTermVariableScope *)scope
                                  useInterpolation:(BOOL)useInterpolation
@@ -173,6 +173,20 @@
                       ansi:(BOOL)ansi
                     insert:(BOOL)insert;
 
+// Like appendCharsAtCursor:... but takes ASCII bytes, which are expanded with |templateChar| (and
+// translated to the graphics charset if |graphics| is set) directly into the grid's lines.
+// Returns number of scrollback lines dropped from lineBuffer.
+- (int)appendASCIIBytesAtCursor:(const char *)bytes
+                         length:(int)len
+                   templateChar:(screen_char_t)templateChar
+                       graphics:(BOOL)graphics
+        scrollingIntoLineBuffer:(LineBuffer *)lineBuffer
+            unlimitedScrollback:(BOOL)unlimitedScrollback
+        useScrollbackWithRegion:(BOOL)useScrollbackWithRegion
+                     wraparound:(BOOL)wraparound
+                           ansi:(BOOL)ansi
+                         insert:(BOOL)insert;
+
 // Delete some number of chars starting at a given location, moving chars to the right of them back.
 - (void)deleteChars:(int)num
          startingAt:(VT100GridCoord)startCoord;
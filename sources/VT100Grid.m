@@ -24,6 +24,43 @@ static NSString *const kGridScrollRegionColumnsKey = @"Scroll Region Columns";
 static NSString *const kGridUseScrollRegionColumnsKey = @"Use Scroll Region Columns";
 static NSString *const kGridSizeKey = @"Size";
 
+// Characters to append come from either an array of screen_char_t or from ASCII bytes that get
+// expanded with a template as they are written into the grid, so they're only touched once.
+typedef struct {
+    screen_char_t *chars;
+    const char *ascii;
+    screen_char_t templateChar;
+    BOOL graphics;
+} VT100GridAppendSource;
+
+// Callers only compare the result against DWC_RIGHT and DWC_SKIP, which never occur in ASCII, so
+// there's no need to translate graphics characters here.
+static inline unichar VT100GridAppendSourceCodeAt(const VT100GridAppendSource *source, int i) {
+    return source->chars ? source->chars[i].code : (unsigned char)source->ascii[i];
+}
+
+static inline void VT100GridAppendSourceCopy(const VT100GridAppendSource *source,
+                                             int offset,
+                                             int count,
+                                             screen_char_t *dest) {
+    if (source->chars) {
+        memcpy(dest, source->chars + offset, count * sizeof(screen_char_t));
+    } else {
+        ExpandASCIIToScreenChars(source->ascii + offset, count, source->templateChar, source->graphics, dest);
+    }
+}
+
+static inline BOOL VT100GridAppendSourceMatches(const VT100GridAppendSource *source,
+                                                int offset,
+                                                const screen_char_t *existing) {
+    if (source->chars) {
+        return !memcmp(existing, source->chars + offset, sizeof(screen_char_t));
+    }
+    screen_char_t c;
+    ExpandASCIIToScreenChars(source->ascii + offset, 1, source->templateChar, source->graphics, &c);
+    return !memcmp(existing, &c, sizeof(screen_char_t));
+}
+
 @interface VT100Grid ()
 @property(nonatomic, readonly) NSArray *lines;  // Warning: not in order found on screen!
 @end
@@ -715,8 +752,54 @@ static NSString *const kGridSizeKey = @"Size";
                 wraparound:(BOOL)wraparound
                       ansi:(BOOL)ansi
                     insert:(BOOL)insert {
-    int numDropped = 0;
     assert(buffer);
+    const VT100GridAppendSource source = { .chars = buffer };
+    return [self appendCharsFromSource:&source
+                                length:len
+               scrollingIntoLineBuffer:lineBuffer
+                   unlimitedScrollback:unlimitedScrollback
+               useScrollbackWithRegion:useScrollbackWithRegion
+                            wraparound:wraparound
+                                  ansi:ansi
+                                insert:insert];
+}
+
+- (int)appendASCIIBytesAtCursor:(const char *)bytes
+                         length:(int)len
+                   templateChar:(screen_char_t)templateChar
+                       graphics:(BOOL)graphics
+        scrollingIntoLineBuffer:(LineBuffer *)lineBuffer
+            unlimitedScrollback:(BOOL)unlimitedScrollback
+        useScrollbackWithRegion:(BOOL)useScrollbackWithRegion
+                     wraparound:(BOOL)wraparound
+                           ansi:(BOOL)ansi
+                         insert:(BOOL)insert {
+    assert(bytes);
+    const VT100GridAppendSource source = {
+        .ascii = bytes,
+        .templateChar = templateChar,
+        .graphics = graphics
+    };
+    return [self appendCharsFromSource:&source
+                                length:len
+               scrollingIntoLineBuffer:lineBuffer
+                   unlimitedScrollback:unlimitedScrollback
+               useScrollbackWithRegion:useScrollbackWithRegion
+                            wraparound:wraparound
+                                  ansi:ansi
+                                insert:insert];
+}
+
+- (int)appendCharsFromSource:(const VT100GridAppendSource *)source
+                      length:(int)len
+     scrollingIntoLineBuffer:(LineBuffer *)lineBuffer
+         unlimitedScrollback:(BOOL)unlimitedScrollback
+     useScrollbackWithRegion:(BOOL)useScrollbackWithRegion
+                  wraparound:(BOOL)wraparound
+                        ansi:(BOOL)ansi
+                      insert:(BOOL)insert {
+    int numDropped = 0;
+    assert(source->chars || source->ascii);
     int idx;  // Index into buffer
     int charsToInsert;
     int newx;
@@ -734,14 +817,14 @@ static NSString *const kGridSizeKey = @"Size";
         NSLog(@"Begin inserting line. cursor_.x=%d, WIDTH=%d", cursor_.x, WIDTH);
 #endif
 
-        if (buffer[idx].code == DWC_SKIP) {
+        if (source->chars && source->chars[idx].code == DWC_SKIP) {
             // I'm pretty sure this can never happen and that this code is just a historical leftover.
             // This is an invalid unicode character that iTerm2 has appropriated
             // for internal use. Change it to something invalid but safe.
-            buffer[idx].code = BOGUS_CHAR;
+            source->chars[idx].code = BOGUS_CHAR;
         }
         int widthOffset;
-        if (idx + 1 < len && buffer[idx + 1].code == DWC_RIGHT) {
+        if (idx + 1 < len && VT100GridAppendSourceCodeAt(source, idx + 1) == DWC_RIGHT) {
             // If we're about to insert a double width character then reduce the
             // line width for the purposes of testing if the cursor is in the
             // rightmost position.
@@ -804,7 +887,7 @@ static NSString *const kGridSizeKey = @"Size";
                 int newCursorX = rightMargin - 1;
 
                 idx = len - 1;
-                if (buffer[idx].code == DWC_RIGHT && idx > startIdx) {
+                if (VT100GridAppendSourceCodeAt(source, idx) == DWC_RIGHT && idx > startIdx) {
                     // The last character to insert is double width. Back up one
                     // byte in buffer and move the cursor left one position.
                     idx--;
@@ -837,7 +920,9 @@ static NSString *const kGridSizeKey = @"Size";
         const int charsLeftToAppend = len - idx;
 
 #ifdef VERBOSE_STRING
-        DumpBuf(buffer + idx, charsLeftToAppend);
+        if (source->chars) {
+            DumpBuf(source->chars + idx, charsLeftToAppend);
+        }
 #endif
         BOOL wrapDwc = NO;
 #ifdef VERBOSE_STRING
@@ -858,7 +943,7 @@ static NSString *const kGridSizeKey = @"Size";
             // at the end of the line.
             int potentialCharsToInsert = spaceRemainingInLine;
             if (idx + potentialCharsToInsert < len &&
-                buffer[idx + potentialCharsToInsert].code == DWC_RIGHT) {
+                VT100GridAppendSourceCodeAt(source, idx + potentialCharsToInsert) == DWC_RIGHT) {
                 // If we filled the line all the way out to WIDTH a DWC would be
                 // split. Wrap the DWC around to the next line.
 #ifdef VERBOSE_STRING
@@ -973,11 +1058,9 @@ static NSString *const kGridSizeKey = @"Size";
         // change anything (because the memcmp is really cheap). In particular, this helps vim out because
         // it really likes redrawing pane separators when it doesn't need to.
         if (charsToInsert > 1 ||
-            memcmp(aLine + cursor_.x, buffer + idx, charsToInsert * sizeof(screen_char_t))) {
+            !VT100GridAppendSourceMatches(source, idx, aLine + cursor_.x)) {
             // copy charsToInsert characters into the line and set them dirty.
-            memcpy(aLine + cursor_.x,
-                   buffer + idx,
-                   charsToInsert * sizeof(screen_char_t));
+            VT100GridAppendSourceCopy(source, idx, charsToInsert, aLine + cursor_.x);
             [self markCharsDirty:YES
                       inRectFrom:VT100GridCoordMake(cursor_.x, lineNumber)
                               to:VT100GridCoordMake(cursor_.x + charsToInsert - 1, lineNumber)];
@@ -1011,7 +1094,7 @@ static NSString *const kGridSizeKey = @"Size";
 
         // The next char in the buffer shouldn't be DWC_RIGHT because we
         // wouldn't have inserted its first half due to a check at the top.
-        assert(!(idx < len && buffer[idx].code == DWC_RIGHT));
+        assert(!(idx < len && VT100GridAppendSourceCodeAt(source, idx) == DWC_RIGHT));
 
         // ANSI terminals will go to a new line after displaying a character at
         // the rightmost column.
@@ -148,6 +148,11 @@ extern const NSInteger VT100ScreenBigFileDownloadThreshold;
 // storeLastPositionInLineBufferAsFindContextSavedPosition).
 - (void)restoreSavedPositionToFindContext:(FindContext *)context;
 
+// Returns a copy of the scrollback buffer with the screen's used lines appended,
+// numbered as they are here. It shares no mutable state with the screen, so it
+// may be searched on another thread.
+- (LineBuffer *)newLineBufferSnapshotIncludingScreen;
+
 - (NSString *)compactLineDump;
 - (NSString *)compactLineDumpWithHistory;
 - (NSString *)compactLineDumpWithHistoryAndContinuationMarks;
@@ -204,8 +204,14 @@ const NSInteger VT100ScreenBigFileDownloadThreshold = 1024 * 1024 * 1024;
 
         [iTermNotificationController sharedInstance];
 
-        dvr_ = [DVR alloc];
-        [dvr_ initWithBufferCapacity:[iTermPreferences intForKey:kPreferenceKeyInstantReplayMemoryMegabytes] * 1024 * 1024];
+        const int diskBudgetMB = [iTermAdvancedSettingsModel instantReplayDiskBudgetMB];
+        if (diskBudgetMB > 0) {
+            dvr_ = [[DVR alloc] initWithTemporaryFileOfCapacity:(long long)diskBudgetMB * 1024 * 1024];
+        }
+        if (!dvr_) {
+            dvr_ = [DVR alloc];
+            [dvr_ initWithBufferCapacity:[iTermPreferences intForKey:kPreferenceKeyInstantReplayMemoryMegabytes] * 1024 * 1024];
+        }
 
         for (int i = 0; i < NUM_CHARSETS; i++) {
             charsetUsesLineDrawingMode_[i] = NO;
@@ -1269,30 +1275,31 @@ const NSInteger VT100ScreenBigFileDownloadThreshold = 1024 * 1024 * 1024;
          currentGrid_.cursorY,
          currentGrid_.cursorY + [linebuffer_ numLinesWithWidth:currentGrid_.size.width]);
 
-    screen_char_t *buffer;
-    buffer = asciiData->screenChars->buffer;
-
-    screen_char_t fg = [terminal_ foregroundColorCode];
-    screen_char_t bg = [terminal_ backgroundColorCode];
-    screen_char_t zero = { 0 };
-    if (memcmp(&fg, &zero, sizeof(fg)) || memcmp(&bg, &zero, sizeof(bg))) {
-        STOPWATCH_START(setUpScreenCharArray);
-        for (int i = 0; i < len; i++) {
-            CopyForegroundColor(&buffer[i], fg);
-            CopyBackgroundColor(&buffer[i], bg);
-        }
-        STOPWATCH_LAP(setUpScreenCharArray);
-    }
+    // Expand the bytes straight into the grid with the current SGR attributes instead of building a
+    // screen_char_t array first. If a graphics character set was selected then the characters are
+    // translated into graphics characters along the way.
+    screen_char_t templateChar = { 0 };
+    CopyForegroundColor(&templateChar, [terminal_ foregroundColorCode]);
+    CopyBackgroundColor(&templateChar, [terminal_ backgroundColorCode]);
+    const BOOL graphics = charsetUsesLineDrawingMode_[[terminal_ charset]];
+
+    ExpandASCIIToScreenChars(asciiData->buffer + len - 1, 1, templateChar, graphics, &_lastCharacter);
+    _lastCharacterIsDoubleWidth = NO;
+
+    [self incrementOverflowBy:[currentGrid_ appendASCIIBytesAtCursor:asciiData->buffer
+                                                              length:len
+                                                        templateChar:templateChar
+                                                            graphics:graphics
+                                             scrollingIntoLineBuffer:[self lineBufferForAppending]
+                                                 unlimitedScrollback:unlimitedScrollback_
+                                             useScrollbackWithRegion:_appendToScrollbackWithStatusBar
+                                                          wraparound:_wraparoundMode
+                                                                ansi:_ansi
+                                                              insert:_insert]];
 
-    // If a graphics character set was selected then translate buffer
-    // characters into graphics characters.
-    if (charsetUsesLineDrawingMode_[[terminal_ charset]]) {
-        ConvertCharsToGraphicsCharset(buffer, len);
+    if (commandStartX_ != -1) {
+        [delegate_ screenCommandDidChangeWithRange:[self commandRange]];
     }
-
-    [self appendScreenCharArrayAtCursor:buffer
-                                 length:len
-                             shouldFree:NO];
     STOPWATCH_LAP(appendAsciiDataAtCursor);
 }
 
@@ -1387,6 +1394,14 @@ const NSInteger VT100ScreenBigFileDownloadThreshold = 1024 * 1024 * 1024;
     }
 }
 
+- (LineBuffer *)lineBufferForAppending {
+    if (currentGrid_ != altGrid_ || saveToScrollbackInAlternateScreen_) {
+        // Not in alt screen or it's ok to scroll into line buffer while in alt screen.
+        return linebuffer_;
+    }
+    return nil;
+}
+
 - (void)appendScreenCharArrayAtCursor:(screen_char_t *)buffer
                                length:(int)len
                            shouldFree:(BOOL)shouldFree {
@@ -1403,14 +1418,9 @@ const NSInteger VT100ScreenBigFileDownloadThreshold = 1024 * 1024 * 1024;
             _lastCharacter = buffer[len - 1];
             _lastCharacterIsDoubleWidth = NO;
         }
-        LineBuffer *lineBuffer = nil;
-        if (currentGrid_ != altGrid_ || saveToScrollbackInAlternateScreen_) {
-            // Not in alt screen or it's ok to scroll into line buffer while in alt screen.k
-            lineBuffer = linebuffer_;
-        }
         [self incrementOverflowBy:[currentGrid_ appendCharsAtCursor:buffer
                                                              length:len
-                                            scrollingIntoLineBuffer:lineBuffer
+                                            scrollingIntoLineBuffer:[self lineBufferForAppending]
                                                 unlimitedScrollback:unlimitedScrollback_
                                             useScrollbackWithRegion:_appendToScrollbackWithStatusBar
                                                          wraparound:_wraparoundMode
@@ -1999,6 +2009,12 @@ basedAtAbsoluteLineNumber:(long long)absoluteLineNumber
     [self popScrollbackLines:linesPushed];
 }
 
+- (LineBuffer *)newLineBufferSnapshotIncludingScreen {
+    LineBuffer *snapshot = [linebuffer_ newDetachedCopy];
+    [currentGrid_ appendLines:[currentGrid_ numberOfLinesUsed] toLineBuffer:snapshot];
+    return snapshot;
+}
+
 - (void)saveFindContextAbsPos
 {
     int linesPushed;
@@ -11,47 +11,32 @@
 #import "DebugLogging.h"
 #import "NSStringITerm.h"
 #import "ScreenChar.h"
+#import "iTermUTF8Scanner.h"
 
 static void DecodeUTF8Bytes(unsigned char *datap,
                             int datalen,
                             int *rmlen,
                             VT100Token *token)
 {
-    unsigned char *p = datap;
-    int len = datalen;
-    int utf8DecodeResult;
-    int theChar = 0;
-
-    while (true) {
-        utf8DecodeResult = decode_utf8_char(p, len, &theChar);
-        // Stop on error or end of stream.
-        if (utf8DecodeResult <= 0) {
-            break;
-        }
-        // Intentionally break out at ASCII characters. They are
-        // processed separately, e.g. they might get converted into
-        // line drawing characters.
-        if (theChar < 0x80) {
-            break;
-        }
-        p += utf8DecodeResult;
-        len -= utf8DecodeResult;
-    }
-
-    if (p > datap) {
+    // Intentionally stop at ASCII characters. They are processed separately, e.g. they might get
+    // converted into line drawing characters.
+    const int length = (int)iTermUTF8ScanMultibyte(datap, datalen);
+    if (length > 0) {
         // If some characters were successfully decoded, just return them
         // and ignore the error or end of stream for now.
-        *rmlen = p - datap;
-        assert(p >= datap);
+        *rmlen = length;
         token->type = VT100_STRING;
+        return;
+    }
+
+    // Report error or waiting state.
+    int theChar = 0;
+    const int utf8DecodeResult = decode_utf8_char(datap, datalen, &theChar);
+    if (utf8DecodeResult == 0) {
+        token->type = VT100_WAIT;
     } else {
-        // Report error or waiting state.
-        if (utf8DecodeResult == 0) {
-            token->type = VT100_WAIT;
-        } else {
-            *rmlen = -utf8DecodeResult;
-            token->type = VT100_INVALID_SEQUENCE;
-        }
+        *rmlen = -utf8DecodeResult;
+        token->type = VT100_INVALID_SEQUENCE;
     }
 }
 
@@ -284,28 +269,16 @@ static void DecodeASCIIBytes(unsigned char *datap,
                              int datalen,
                              int *rmlen,
                              VT100Token *token) {
-    unsigned char *p = datap;
-    int len = datalen;
-
-    // I tried the ideas mentioned here:
-    // http://stackoverflow.com/questions/22218605/is-this-function-a-good-candidate-for-simd-on-intel
-    // (using 8-bytes-at-a-time bit twiddling and SIMD)
-    // and although this while loop completed faster, the overall benchmark speed on spam.cc did
-    // not improve.
-    while (len > 0) {
-        if (*p >= 0x20 && *p <= 0x7f) {
-            p++;
-            len--;
-        } else {
-            break;
-        }
-    }
-    if (len == datalen) {
+    // Earlier experiments with 8-bytes-at-a-time bit twiddling didn't move the spam.cc benchmark
+    // because the rest of the pipeline dominated. Now that long runs are common (see
+    // tests/parser_throughput_bench.c) the vectorized scan is worthwhile.
+    const int length = (int)iTermUTF8ScanPrintableASCII(datap, datalen);
+    if (length == 0) {
         *rmlen = 0;
         token->type = VT100_WAIT;
     } else {
-        *rmlen = datalen - len;
-        assert(datalen >= len);
+        *rmlen = length;
+        assert(datalen >= length);
         token->type = VT100_ASCIISTRING;
     }
 }
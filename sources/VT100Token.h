@@ -213,8 +213,8 @@ typedef enum {
     ISO2022_SELECT_UTF_8
 } VT100TerminalTokenType;
 
-// A preinitialized array of screen_char_t. When ASCII data is present, it will have the codes
-// populated and all other fields zeroed out.
+// An array of screen_char_t built on demand by -[VT100Token screenChars]. When ASCII data is
+// present, it will have the codes populated and all other fields zeroed out.
 #define kStaticScreenCharsCount 16
 typedef struct {
     screen_char_t *buffer;
@@ -224,7 +224,7 @@ typedef struct {
 
 // Tokens with type VT100_ASCIISTRING are stored in |asciiData| with this type.
 // |buffer| will point at |staticBuffer| or a malloc()ed buffer, depending on
-// |length|.
+// |length|. |screenChars| is NULL until the token's screen chars are first requested.
 typedef struct {
     char *buffer;
     int length;
@@ -257,8 +257,6 @@
         _asciiData.buffer = _asciiData.staticBuffer;
     }
     memcpy(_asciiData.buffer, bytes, length);
-
-    [self preInitializeScreenChars];
 }
 
 - (AsciiData *)asciiData {
@@ -272,6 +270,10 @@
 }
 
 - (ScreenChars *)screenChars {
+    // VT100Screen expands ASCII directly into the grid, so only build this if someone asks for it.
+    if (!_asciiData.screenChars && _asciiData.length > 0) {
+        [self preInitializeScreenChars];
+    }
     return &_screenChars;
 }
 
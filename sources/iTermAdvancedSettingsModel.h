@@ -67,6 +67,9 @@ extern NSString *const iTermAdvancedSettingsDidChange;
 + (double)coloredSelectedTabOutlineStrength;
 + (double)coloredUnselectedTabTextProminence;
 + (double)compactMinimalTabBarHeight;
++ (BOOL)compactScrollback;
++ (BOOL)compressColdScrollback;
++ (BOOL)computeGitStatusInProcess;
 + (BOOL)conservativeURLGuessing;
 + (BOOL)convertItalicsToReverseVideoForTmux;
 + (BOOL)convertTabDragToWindowDragForSolitaryTabInCompactOrMinimalTheme;
@@ -110,6 +113,7 @@ extern NSString *const iTermAdvancedSettingsDidChange;
 + (BOOL)enableSemanticHistoryOnNetworkMounts;
 + (BOOL)enableUnderlineSemanticHistoryOnCmdHover;
 + (BOOL)escapeWithQuotes;
++ (BOOL)evaluateTriggersInBackground;
 + (BOOL)excludeBackgroundColorsFromCopiedStyle;
 + (BOOL)experimentalKeyHandling;
 + (double)extraSpaceBeforeCompactTopTabBar;
@@ -139,8 +143,11 @@ extern NSString *const iTermAdvancedSettingsDidChange;
 + (double)idleTimeSeconds;
 + (BOOL)ignoreHardNewlinesInURLs;
 + (BOOL)includePasteHistoryInAdvancedPaste;
++ (BOOL)indexScrollbackForSearch;
 + (BOOL)indicateBellsInDockBadgeLabel;
 + (double)indicatorFlashInitialAlpha;
++ (int)instantReplayDiskBudgetMB;
++ (BOOL)compressInstantReplayKeyFrames;
 + (double)invalidateShadowTimesPerSecond;
 + (BOOL)jiggleTTYSizeOnClearBuffer;
 + (BOOL)killJobsInServersOnQuit;
@@ -245,6 +252,7 @@ extern NSString *const iTermAdvancedSettingsDidChange;
 + (BOOL)retinaInlineImages;
 + (BOOL)runJobsInServers;
 + (BOOL)saveToPasteHistoryWhenSecureInputEnabled;
++ (int)scrollbackMemoryBudgetMB;
 + (NSString *)searchCommand;
 + (BOOL)selectsTabsOnMouseDown;
 + (BOOL)sensitiveScrollWheel;
@@ -306,6 +314,7 @@ extern NSString *const iTermAdvancedSettingsDidChange;
 + (const BOOL *)tmuxWindowsShouldCloseAfterDetach;
 + (void)setTmuxWindowsShouldCloseAfterDetach:(const BOOL *)value;
 + (BOOL)tolerateUnrecognizedTmuxCommands;
++ (BOOL)trackProcessTreesIncrementally;
 + (BOOL)trackingRunloopForLiveResize;
 + (BOOL)traditionalVisualBell;
 + (NSString *)trailingPunctuationMarks;
@@ -327,6 +336,7 @@ extern NSString *const iTermAdvancedSettingsDidChange;
 + (BOOL)useDivorcedProfileToSplit;
 + (BOOL)useExperimentalFontMetrics;
 + (BOOL)useGCDUpdateTimer;
++ (BOOL)useKernelEventQueueForTaskNotifier;
 
 #if ENABLE_LOW_POWER_GPU_DETECTION
 + (BOOL)useLowPowerGPUWhenUnplugged;
@@ -286,6 +286,7 @@ DEFINE_BOOL(noSyncSilenceAnnoyingBellAutomatically, NO, SECTION_TERMINAL @"Autom
 DEFINE_SETTABLE_STRING(noSyncVariablesToReport, NoSyncVariablesToReport, @"", SECTION_TERMINAL @"Variables to report via control sequence\nThis is a comma-delimited list of variables that can be reported with the OSC 1337 ReportVariable=name control sequence. Each variable name must be prefixed with “allow:” or “deny:”.");
 DEFINE_BOOL(restoreWindowContents, YES, SECTION_TERMINAL @"Restore window contents at startup.\nThis requires “System Prefs>General>Close windows when quitting an app” to be off.");
 DEFINE_INT(numberOfLinesForAccessibility, 1000, SECTION_TERMINAL @"Maximum number of lines of history to expose to Accessibility.\nAccessibility APIs can make iTerm2 slow. In order to limit the effect, you can restrict the number of lines in each session that are visible to accessibility. The last lines of each session will be made accessible.");
+DEFINE_BOOL(evaluateTriggersInBackground, NO, SECTION_TERMINAL @"Match trigger regular expressions on a background thread.\nA slow regular expression then can't stall input or drawing, but trigger actions happen after later output has already changed the screen, so actions that depend on the cursor or screen contents (such as highlighting, marks, and capturing output) may act on the wrong text.");
 DEFINE_INT(triggerRadius, 3, SECTION_TERMINAL @"Number of screen lines to match against trigger regular expressions.\nTrigger regular expressions are matched against the last logical line of text when a newline is received. A search is performed to find the start of the line. Since very long lines would cause performance problems, the search (and consequently the regular expression match, highlighting, and so on) is limited to this many screen lines.");
 DEFINE_BOOL(requireCmdForDraggingText, NO, SECTION_TERMINAL @"To drag images or selected text, you must hold ⌘. This prevents accidental drags.");
 DEFINE_BOOL(focusReportingEnabled, YES, SECTION_TERMINAL @"Apps may turn on Focus Reporting.\nFocus reporting causes iTerm2 to send an escape sequence when a session gains or loses focus. It can cause problems when an ssh session dies unexpectedly because it gets left on, so some users prefer to disable it.");
@@ -372,6 +373,7 @@ DEFINE_BOOL(loadFromFindPasteboard, YES, SECTION_GENERAL @"Synchronize search qu
 DEFINE_STRING(dynamicProfilesPath, @"", SECTION_GENERAL @"Path to folder with dynamic profiles.\nWhen empty, ~/Library/Application Support/iTerm2/DynamicProfiles will be used. You must restart iTerm2 after modifying this setting.");
 DEFINE_STRING(gitSearchPath, @"", SECTION_GENERAL @"$PATH used when running git for the status bar component.\nChange this to use a custom install of git. You must restart iTerm2 for a change here to take effect.");
 DEFINE_FLOAT(gitTimeout, 4, SECTION_GENERAL @"Timeout in seconds when running git for the status bar component.");
+DEFINE_BOOL(computeGitStatusInProcess, YES, SECTION_GENERAL @"Compute git status for the status bar component without running git.\nRepositories using features this doesn't understand, like split indexes, still run git.");
 
 #pragma mark - Drawing
 
@@ -569,6 +571,7 @@ DEFINE_INT(badgeTopMargin, 10, SECTION_BADGE @"Default value for the top margin
 DEFINE_BOOL(killSessionsOnLogout, NO, SECTION_EXPERIMENTAL @"Kill sessions on logout.\nA possible fix for issue 4147.");
 DEFINE_BOOL(useExperimentalFontMetrics, NO, SECTION_EXPERIMENTAL @"Use a more theoretically correct technique to measure line height.\nYou must restart iTerm2 or adjust a session's font size for this change to take effect.");
 DEFINE_BOOL(fastForegroundJobUpdates, NO, SECTION_EXPERIMENTAL @"Enable low-latency updates of the current foreground job");
+DEFINE_BOOL(trackProcessTreesIncrementally, YES, SECTION_EXPERIMENTAL @"Track the processes in each session by watching for forks and exits instead of listing every process on the system.\nYou must restart iTerm2 for a change here to take effect.");
 
 // Experiments currently under test
 DEFINE_BOOL(tmuxVariableWindowSizesSupported, YES, SECTION_EXPERIMENTAL @"Allow variable window sizes in tmux integration.\nRequres tmux version 2.9 or later.");
@@ -608,6 +611,13 @@ DEFINE_BOOL(allowTabbarInTitlebarAccessoryBigSur, NO, SECTION_EXPERIMENTAL @"Mak
 DEFINE_BOOL(storeStateInSqlite, YES, SECTION_EXPERIMENTAL @"Store window restoration state in SQLite");
 DEFINE_BOOL(useNewContentFormat, YES, SECTION_EXPERIMENTAL @"Save unlimited amount of window contents.\nThis is going to be slow unless you enable SQLite-based window restoration too.");
 DEFINE_BOOL(vs16Supported, NO, SECTION_EXPERIMENTAL @"Support variation selector 16 making emoji fullwidth?");
+DEFINE_BOOL(compactScrollback, YES, SECTION_EXPERIMENTAL @"Store full blocks of scrollback history in a compact format.\nThis greatly reduces memory use for large scrollback buffers. Blocks are expanded as needed when you scroll back or search.");
+DEFINE_BOOL(compressColdScrollback, YES, SECTION_EXPERIMENTAL @"Compress blocks of scrollback history that haven't been used recently.\nThis takes effect only when scrollback is stored in a compact format. Compression happens in the background.");
+DEFINE_BOOL(useKernelEventQueueForTaskNotifier, YES, SECTION_EXPERIMENTAL @"Use kqueue to wait for output from sessions.\nThis scales better than select() when there are many sessions. You must restart iTerm2 for this change to take effect.");
+DEFINE_INT(scrollbackMemoryBudgetMB, 256, SECTION_EXPERIMENTAL @"Megabytes of compressed scrollback history to keep in memory per session.\nOlder compressed history is moved to a temporary file and read back as needed. This normally only matters with unlimited scrollback. It takes effect only when scrollback is stored in a compact format and cold blocks are compressed, since only compressed history is moved. Set to 0 to always keep history in memory.");
+DEFINE_INT(instantReplayDiskBudgetMB, 0, SECTION_EXPERIMENTAL @"Megabytes of instant replay history to keep on disk per session.\nWhen nonzero, instant replay frames are kept in a temporary file of this size instead of in memory, so hours of history can be saved. Takes effect for new sessions. Set to 0 to use the memory limit in General settings.");
+DEFINE_BOOL(compressInstantReplayKeyFrames, NO, SECTION_EXPERIMENTAL @"Compress instant replay key frames with zlib.\nKey frames take several times less space, so more history fits, but recording fast-scrolling output takes more CPU time.");
+DEFINE_BOOL(indexScrollbackForSearch, NO, SECTION_EXPERIMENTAL @"Index scrollback to speed up Find.\nEach block of history keeps a small summary of its text so searches can skip blocks that can’t contain a match. Takes effect for new history.");
 
 #pragma mark - Scripting
 #define SECTION_SCRIPTING @"Scripting: "
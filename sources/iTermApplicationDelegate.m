@@ -1880,6 +1880,17 @@ static BOOL hasBecomeActive = NO;
 
 - (IBAction)debugLogging:(id)sender {
     ToggleDebugLogging();
+    if (gDebugLogging) {
+        // Helps find triggers with pathological regexes.
+        for (PseudoTerminal *term in [self terminals]) {
+            for (PTYSession *session in [term allSessions]) {
+                NSString *report = [session triggerTimingReport];
+                if (report.length) {
+                    DLog(@"Trigger timing for %@:\n%@", session, report);
+                }
+            }
+        }
+    }
 }
 
 - (IBAction)openQuickly:(id)sender {
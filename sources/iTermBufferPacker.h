@@ -0,0 +1,35 @@
+//
+//  iTermBufferPacker.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Encodes lines of screen_char_t in the compact binary format described at
+//  GetBufferResponse.packed_contents in api.proto. This avoids allocating a
+//  protobuf object (and an NSString) for each line, which dominates the cost
+//  of returning large ranges of scrollback to API clients.
+//
+
+#import <Foundation/Foundation.h>
+#import "ScreenChar.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface iTermBufferPacker : NSObject
+
+@property (nonatomic, readonly) int numberOfLines;
+
+// Number of bytes encoded so far, including the header.
+@property (nonatomic, readonly) NSUInteger length;
+
+// |continuation| is EOL_HARD, EOL_SOFT, or EOL_DWC.
+- (void)appendLine:(const screen_char_t *)line
+            length:(int)length
+      continuation:(unichar)continuation;
+
+// The encoded lines. Further appends are not allowed.
+- (NSData *)data;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,251 @@
+//
+//  iTermBufferPacker.m
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import "iTermBufferPacker.h"
+
+static const uint32_t iTermBufferPackerMagic = 0x42505469;  // "iTPB"
+static const uint32_t iTermBufferPackerVersion = 1;
+static const NSUInteger iTermBufferPackerHeaderSize = 12;
+
+typedef NS_OPTIONS(uint16_t, iTermBufferPackerFlags) {
+    iTermBufferPackerFlagBold = 1 << 0,
+    iTermBufferPackerFlagFaint = 1 << 1,
+    iTermBufferPackerFlagItalic = 1 << 2,
+    iTermBufferPackerFlagBlink = 1 << 3,
+    iTermBufferPackerFlagUnderline = 1 << 4,
+    iTermBufferPackerFlagStrikethrough = 1 << 5,
+    iTermBufferPackerFlagImage = 1 << 6,
+    iTermBufferPackerFlagCurlyUnderline = 1 << 7
+};
+
+typedef struct {
+    uint32_t length;
+    uint32_t foreground;
+    uint32_t background;
+    uint16_t flags;
+} iTermBufferPackerStyleRun;
+
+typedef struct {
+    uint32_t repeats;
+    uint8_t codePoints;
+} iTermBufferPackerCodePointRun;
+
+static uint32_t iTermBufferPackerColor(unsigned int mode, unsigned int red, unsigned int green, unsigned int blue) {
+    return (mode << 24) | (red << 16) | (green << 8) | blue;
+}
+
+static iTermBufferPackerStyleRun iTermBufferPackerStyleForCell(const screen_char_t *c) {
+    iTermBufferPackerFlags flags = 0;
+    if (c->bold) {
+        flags |= iTermBufferPackerFlagBold;
+    }
+    if (c->faint) {
+        flags |= iTermBufferPackerFlagFaint;
+    }
+    if (c->italic) {
+        flags |= iTermBufferPackerFlagItalic;
+    }
+    if (c->blink) {
+        flags |= iTermBufferPackerFlagBlink;
+    }
+    if (c->underline) {
+        flags |= iTermBufferPackerFlagUnderline;
+        if (c->underlineStyle == VT100UnderlineStyleCurly) {
+            flags |= iTermBufferPackerFlagCurlyUnderline;
+        }
+    }
+    if (c->strikethrough) {
+        flags |= iTermBufferPackerFlagStrikethrough;
+    }
+    if (c->image) {
+        flags |= iTermBufferPackerFlagImage;
+    }
+    return (iTermBufferPackerStyleRun){
+        .length = 1,
+        .foreground = iTermBufferPackerColor(c->foregroundColorMode, c->foregroundColor, c->fgGreen, c->fgBlue),
+        .background = iTermBufferPackerColor(c->backgroundColorMode, c->backgroundColor, c->bgGreen, c->bgBlue),
+        .flags = flags
+    };
+}
+
+// Appends the UTF-8 encoding of |characters| to |dest| and returns the number of code points.
+static int iTermBufferPackerAppendUTF8(const unichar *characters, int count, NSMutableData *dest) {
+    uint8_t buffer[kMaxParts * 4];
+    int length = 0;
+    int codePoints = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t c = characters[i];
+        if (CFStringIsSurrogateHighCharacter(c) &&
+            i + 1 < count &&
+            CFStringIsSurrogateLowCharacter(characters[i + 1])) {
+            c = CFStringGetLongCharacterForSurrogatePair(c, characters[i + 1]);
+            i++;
+        }
+        if (c < 0x80) {
+            buffer[length++] = c;
+        } else if (c < 0x800) {
+            buffer[length++] = 0xc0 | (c >> 6);
+            buffer[length++] = 0x80 | (c & 0x3f);
+        } else if (c < 0x10000) {
+            buffer[length++] = 0xe0 | (c >> 12);
+            buffer[length++] = 0x80 | ((c >> 6) & 0x3f);
+            buffer[length++] = 0x80 | (c & 0x3f);
+        } else {
+            buffer[length++] = 0xf0 | (c >> 18);
+            buffer[length++] = 0x80 | ((c >> 12) & 0x3f);
+            buffer[length++] = 0x80 | ((c >> 6) & 0x3f);
+            buffer[length++] = 0x80 | (c & 0x3f);
+        }
+        codePoints++;
+    }
+    [dest appendBytes:buffer length:length];
+    return codePoints;
+}
+
+@implementation iTermBufferPacker {
+    NSMutableData *_data;
+    // Scratch space reused for each line.
+    NSMutableData *_text;
+    NSMutableData *_codePointRuns;
+    NSMutableData *_styleRuns;
+    BOOL _finished;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _data = [[NSMutableData alloc] initWithCapacity:4096];
+        _data.length = iTermBufferPackerHeaderSize;
+        _text = [[NSMutableData alloc] init];
+        _codePointRuns = [[NSMutableData alloc] init];
+        _styleRuns = [[NSMutableData alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_data release];
+    [_text release];
+    [_codePointRuns release];
+    [_styleRuns release];
+    [super dealloc];
+}
+
+- (NSUInteger)length {
+    return _data.length;
+}
+
+- (void)appendUInt32:(uint32_t)value to:(NSMutableData *)data {
+    const uint32_t littleEndian = CFSwapInt32HostToLittle(value);
+    [data appendBytes:&littleEndian length:sizeof(littleEndian)];
+}
+
+- (void)appendUInt16:(uint16_t)value to:(NSMutableData *)data {
+    const uint16_t littleEndian = CFSwapInt16HostToLittle(value);
+    [data appendBytes:&littleEndian length:sizeof(littleEndian)];
+}
+
+- (void)appendUInt8:(uint8_t)value to:(NSMutableData *)data {
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+- (void)appendLine:(const screen_char_t *)line
+            length:(int)length
+      continuation:(unichar)continuation {
+    assert(!_finished);
+    _text.length = 0;
+    _codePointRuns.length = 0;
+    _styleRuns.length = 0;
+
+    uint32_t numberOfCodePointRuns = 0;
+    uint32_t numberOfStyleRuns = 0;
+    iTermBufferPackerCodePointRun codePointRun = { 0, 0 };
+    iTermBufferPackerStyleRun styleRun = { 0 };
+    unichar characters[kMaxParts];
+    for (int i = 0; i < length; i++) {
+        screen_char_t c = line[i];
+        int codePoints = 0;
+        if (c.image) {
+            codePoints = 0;
+        } else if (!c.complexChar && c.code >= ITERM2_PRIVATE_BEGIN && c.code <= ITERM2_PRIVATE_END) {
+            // DWC_RIGHT and friends occupy a cell but have no text.
+            codePoints = 0;
+        } else if (!c.complexChar && c.code < 0x80) {
+            // Fast path for ASCII.
+            const uint8_t byte = c.code ? c.code : ' ';
+            [_text appendBytes:&byte length:1];
+            codePoints = 1;
+        } else {
+            const int count = ExpandScreenChar(&c, characters);
+            codePoints = iTermBufferPackerAppendUTF8(characters, count, _text);
+        }
+
+        if (codePointRun.repeats > 0 && codePointRun.codePoints != codePoints) {
+            [self appendUInt32:codePointRun.repeats to:_codePointRuns];
+            [self appendUInt8:codePointRun.codePoints to:_codePointRuns];
+            numberOfCodePointRuns++;
+            codePointRun.repeats = 0;
+        }
+        codePointRun.codePoints = codePoints;
+        codePointRun.repeats++;
+
+        const iTermBufferPackerStyleRun style = iTermBufferPackerStyleForCell(&c);
+        if (styleRun.length > 0 &&
+            styleRun.foreground == style.foreground &&
+            styleRun.background == style.background &&
+            styleRun.flags == style.flags) {
+            styleRun.length++;
+        } else {
+            if (styleRun.length > 0) {
+                [self appendStyleRun:styleRun];
+                numberOfStyleRuns++;
+            }
+            styleRun = style;
+        }
+    }
+    if (codePointRun.repeats > 0) {
+        [self appendUInt32:codePointRun.repeats to:_codePointRuns];
+        [self appendUInt8:codePointRun.codePoints to:_codePointRuns];
+        numberOfCodePointRuns++;
+    }
+    if (styleRun.length > 0) {
+        [self appendStyleRun:styleRun];
+        numberOfStyleRuns++;
+    }
+
+    [self appendUInt8:continuation to:_data];
+    [self appendUInt32:length to:_data];
+    [self appendUInt32:_text.length to:_data];
+    [_data appendData:_text];
+    [self appendUInt32:numberOfCodePointRuns to:_data];
+    [_data appendData:_codePointRuns];
+    [self appendUInt32:numberOfStyleRuns to:_data];
+    [_data appendData:_styleRuns];
+    _numberOfLines++;
+}
+
+- (void)appendStyleRun:(iTermBufferPackerStyleRun)run {
+    [self appendUInt32:run.length to:_styleRuns];
+    [self appendUInt32:run.foreground to:_styleRuns];
+    [self appendUInt32:run.background to:_styleRuns];
+    [self appendUInt16:run.flags to:_styleRuns];
+}
+
+- (NSData *)data {
+    if (!_finished) {
+        _finished = YES;
+        const uint32_t header[3] = {
+            CFSwapInt32HostToLittle(iTermBufferPackerMagic),
+            CFSwapInt32HostToLittle(iTermBufferPackerVersion),
+            CFSwapInt32HostToLittle(_numberOfLines)
+        };
+        [_data replaceBytesInRange:NSMakeRange(0, sizeof(header)) withBytes:header];
+    }
+    return _data;
+}
+
+@end
@@ -0,0 +1,76 @@
+//
+//  iTermCellBitset.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  One bit per cell of a row, for masks like the selection and annotations that are checked for
+//  every cell while a frame is prepared. Testing a bit is a shift and a mask, where
+//  -[NSIndexSet containsIndex:] is a message send and a binary search over ranges. The caller
+//  supplies the words, so they can live on the stack.
+//
+//  Plain C with no Foundation dependency so it can be benchmarked anywhere (see
+//  tests/metal_row_prep_bench.c).
+//
+
+#ifndef iTermCellBitset_h
+#define iTermCellBitset_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ITERM_CELL_BITSET_WORDS(width) (((width) + 63) / 64)
+
+typedef struct {
+    uint64_t *words;  // ITERM_CELL_BITSET_WORDS(width) of them
+    int width;
+} iTermCellBitset;
+
+// Clears |words| and makes an empty bitset that uses them.
+static inline void iTermCellBitsetInit(iTermCellBitset *bitset, uint64_t *words, int width) {
+    bitset->words = words;
+    bitset->width = width > 0 ? width : 0;
+    memset(words, 0, sizeof(uint64_t) * ITERM_CELL_BITSET_WORDS(bitset->width));
+}
+
+// Sets the bits in [location, location + length). Anything past the width is ignored.
+static inline void iTermCellBitsetAddRange(iTermCellBitset *bitset, long long location, long long length) {
+    long long start = location < 0 ? 0 : location;
+    long long end = location + length;
+    if (end > bitset->width) {
+        end = bitset->width;
+    }
+    if (start >= end) {
+        return;
+    }
+    const long long firstWord = start >> 6;
+    const long long lastWord = (end - 1) >> 6;
+    const uint64_t firstMask = ~0ULL << (start & 63);
+    const uint64_t lastMask = ~0ULL >> (63 - ((end - 1) & 63));
+    if (firstWord == lastWord) {
+        bitset->words[firstWord] |= (firstMask & lastMask);
+        return;
+    }
+    bitset->words[firstWord] |= firstMask;
+    for (long long i = firstWord + 1; i < lastWord; i++) {
+        bitset->words[i] = ~0ULL;
+    }
+    bitset->words[lastWord] |= lastMask;
+}
+
+static inline bool iTermCellBitsetContains(const iTermCellBitset *bitset, int index) {
+    return (index >= 0 &&
+            index < bitset->width &&
+            ((bitset->words[index >> 6] >> (index & 63)) & 1));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermCellBitset_h
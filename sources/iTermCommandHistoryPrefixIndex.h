@@ -0,0 +1,40 @@
+//
+//  iTermCommandHistoryPrefixIndex.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Finds the highest-scoring commands that start with a prefix, ignoring case,
+// without looking at commands that don't match or sorting the ones that do.
+// Commands are kept sorted by their case-folded text so the matches for any
+// prefix are contiguous, and a max-tree over their scores yields the best K
+// matches in O(K log n) after an O(|prefix| log n) search. A command's score is
+// its number of uses, with ties going to the most recent use, as in
+// -[iTermCommandHistoryEntryMO compare:]. Updated incrementally as commands
+// are used.
+@interface iTermCommandHistoryPrefixIndex<ObjectType> : NSObject
+
+@property (nonatomic, readonly) NSUInteger count;
+
+// Adds |command| or updates its object and score.
+- (void)setObject:(ObjectType)object
+       forCommand:(NSString *)command
+             uses:(NSInteger)uses
+          lastUse:(NSTimeInterval)lastUse;
+
+- (nullable ObjectType)objectForCommand:(NSString *)command;
+- (void)removeCommand:(NSString *)command;
+- (void)removeAllCommands;
+
+// Returns the objects of up to |limit| commands having |prefix| (ignoring
+// case), from highest to lowest score.
+- (NSArray<ObjectType> *)objectsWithPrefix:(NSString *)prefix limit:(NSUInteger)limit;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,326 @@
+//
+//  iTermCommandHistoryPrefixIndex.m
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import "iTermCommandHistoryPrefixIndex.h"
+
+#import "NSStringITerm.h"
+
+@interface iTermCommandHistoryPrefixIndexItem : NSObject
+@property (nonatomic, copy) NSString *folded;
+@property (nonatomic, copy) NSString *command;
+@property (nonatomic, retain) id object;
+@property (nonatomic) NSInteger uses;
+@property (nonatomic) NSTimeInterval lastUse;
+@end
+
+@implementation iTermCommandHistoryPrefixIndexItem
+
+- (void)dealloc {
+    [_folded release];
+    [_command release];
+    [_object release];
+    [super dealloc];
+}
+
+// Order of the sorted array. Commands that differ only in case sort by their
+// exact text.
+- (NSComparisonResult)compareKey:(iTermCommandHistoryPrefixIndexItem *)other {
+    const NSComparisonResult result = [_folded compare:other.folded options:NSLiteralSearch];
+    if (result != NSOrderedSame) {
+        return result;
+    }
+    return [_command compare:other.command options:NSLiteralSearch];
+}
+
+// Higher score first.
+- (BOOL)isBetterThan:(iTermCommandHistoryPrefixIndexItem *)other {
+    if (_uses != other.uses) {
+        return _uses > other.uses;
+    }
+    return _lastUse > other.lastUse;
+}
+
+@end
+
+typedef struct {
+    NSUInteger lo;  // Inclusive
+    NSUInteger hi;  // Exclusive
+    NSUInteger best;
+} iTermCommandHistoryPrefixIndexInterval;
+
+@implementation iTermCommandHistoryPrefixIndex {
+    // Sorted by -compareKey:.
+    NSMutableArray<iTermCommandHistoryPrefixIndexItem *> *_items;
+    NSMutableDictionary<NSString *, iTermCommandHistoryPrefixIndexItem *> *_itemsByCommand;
+
+    // A bottom-up max-tree over indexes into _items. Leaves begin at
+    // _treeCapacity. Rebuilt lazily after insertions and removals.
+    NSUInteger *_tree;
+    NSUInteger _treeCapacity;
+    BOOL _treeValid;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _items = [[NSMutableArray alloc] init];
+        _itemsByCommand = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_items release];
+    [_itemsByCommand release];
+    free(_tree);
+    [super dealloc];
+}
+
+- (NSUInteger)count {
+    return _items.count;
+}
+
+#pragma mark - Mutation
+
+- (void)setObject:(id)object
+       forCommand:(NSString *)command
+             uses:(NSInteger)uses
+          lastUse:(NSTimeInterval)lastUse {
+    iTermCommandHistoryPrefixIndexItem *item = _itemsByCommand[command];
+    if (item) {
+        item.object = object;
+        item.uses = uses;
+        item.lastUse = lastUse;
+        if (_treeValid) {
+            [self updateTreeAtIndex:[self indexOfItem:item]];
+        }
+        return;
+    }
+
+    item = [[[iTermCommandHistoryPrefixIndexItem alloc] init] autorelease];
+    item.command = command;
+    item.folded = [self foldedString:command];
+    item.object = object;
+    item.uses = uses;
+    item.lastUse = lastUse;
+    const NSUInteger index = [_items indexOfObject:item
+                                     inSortedRange:NSMakeRange(0, _items.count)
+                                           options:NSBinarySearchingInsertionIndex
+                                   usingComparator:^NSComparisonResult(iTermCommandHistoryPrefixIndexItem *a,
+                                                                       iTermCommandHistoryPrefixIndexItem *b) {
+                                       return [a compareKey:b];
+                                   }];
+    [_items insertObject:item atIndex:index];
+    _itemsByCommand[command] = item;
+    _treeValid = NO;
+}
+
+- (id)objectForCommand:(NSString *)command {
+    return _itemsByCommand[command].object;
+}
+
+- (void)removeCommand:(NSString *)command {
+    iTermCommandHistoryPrefixIndexItem *item = _itemsByCommand[command];
+    if (!item) {
+        return;
+    }
+    [_items removeObjectAtIndex:[self indexOfItem:item]];
+    [_itemsByCommand removeObjectForKey:command];
+    _treeValid = NO;
+}
+
+- (void)removeAllCommands {
+    [_items removeAllObjects];
+    [_itemsByCommand removeAllObjects];
+    _treeValid = NO;
+}
+
+#pragma mark - Lookup
+
+- (NSArray *)objectsWithPrefix:(NSString *)prefix limit:(NSUInteger)limit {
+    // -hasPrefix: is false for an empty prefix, but every command matches it.
+    const BOOL matchAll = (prefix.length == 0);
+    NSString *folded = [self foldedString:prefix];
+    const NSUInteger lo = matchAll ? 0 : [self indexOfFirstItemNotLessThan:folded];
+    const NSUInteger hi = matchAll ? _items.count : [self indexOfFirstItemFrom:lo withoutPrefix:folded];
+    if (lo >= hi || limit == 0) {
+        return @[];
+    }
+    [self buildTreeIfNeeded];
+
+    // Repeatedly take the best item from the interval holding the best one and
+    // split that interval around it. Each pop adds at most one interval. Pops
+    // usually produce a result, but items rejected by the prefix check below
+    // don't, so the heap can outgrow limit + 1. The intervals are disjoint and
+    // nonempty, so it never holds more than hi - lo.
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:MIN(limit, hi - lo)];
+    NSUInteger heapCapacity = MIN(limit, hi - lo) + 1;
+    iTermCommandHistoryPrefixIndexInterval *heap = malloc(sizeof(*heap) * heapCapacity);
+    NSUInteger heapCount = 0;
+    heap[heapCount++] = (iTermCommandHistoryPrefixIndexInterval){ lo, hi, [self bestIndexFrom:lo to:hi] };
+    while (heapCount > 0 && result.count < limit) {
+        const iTermCommandHistoryPrefixIndexInterval top = heap[0];
+        heap[0] = heap[--heapCount];
+        [self siftDown:heap count:heapCount];
+
+        if (heapCount + 2 > heapCapacity) {
+            heapCapacity = MIN(heapCapacity * 2, hi - lo + 1);
+            heap = realloc(heap, sizeof(*heap) * heapCapacity);
+        }
+        iTermCommandHistoryPrefixIndexItem *item = _items[top.best];
+        // Folding can differ slightly from how -caseInsensitiveHasPrefix: compares.
+        if (matchAll || [item.command caseInsensitiveHasPrefix:prefix]) {
+            [result addObject:item.object];
+        }
+        if (top.best > top.lo) {
+            heap[heapCount++] = (iTermCommandHistoryPrefixIndexInterval){ top.lo, top.best, [self bestIndexFrom:top.lo to:top.best] };
+            [self siftUp:heap count:heapCount];
+        }
+        if (top.best + 1 < top.hi) {
+            heap[heapCount++] = (iTermCommandHistoryPrefixIndexInterval){ top.best + 1, top.hi, [self bestIndexFrom:top.best + 1 to:top.hi] };
+            [self siftUp:heap count:heapCount];
+        }
+    }
+    free(heap);
+    return result;
+}
+
+#pragma mark - Private
+
+- (NSString *)foldedString:(NSString *)string {
+    return [string stringByFoldingWithOptions:NSCaseInsensitiveSearch locale:nil];
+}
+
+- (NSUInteger)indexOfItem:(iTermCommandHistoryPrefixIndexItem *)item {
+    return [_items indexOfObject:item
+                   inSortedRange:NSMakeRange(0, _items.count)
+                         options:NSBinarySearchingFirstEqual
+                 usingComparator:^NSComparisonResult(iTermCommandHistoryPrefixIndexItem *a,
+                                                     iTermCommandHistoryPrefixIndexItem *b) {
+                     return [a compareKey:b];
+                 }];
+}
+
+- (NSUInteger)indexOfFirstItemNotLessThan:(NSString *)folded {
+    NSUInteger lo = 0;
+    NSUInteger hi = _items.count;
+    while (lo < hi) {
+        const NSUInteger mid = lo + (hi - lo) / 2;
+        if ([_items[mid].folded compare:folded options:NSLiteralSearch] == NSOrderedAscending) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Items with the prefix are contiguous, so this is a binary search too.
+- (NSUInteger)indexOfFirstItemFrom:(NSUInteger)start withoutPrefix:(NSString *)folded {
+    NSUInteger lo = start;
+    NSUInteger hi = _items.count;
+    while (lo < hi) {
+        const NSUInteger mid = lo + (hi - lo) / 2;
+        if ([_items[mid].folded hasPrefix:folded]) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+- (NSUInteger)betterIndex:(NSUInteger)a than:(NSUInteger)b {
+    if (a == NSNotFound) {
+        return b;
+    }
+    if (b == NSNotFound) {
+        return a;
+    }
+    return [_items[b] isBetterThan:_items[a]] ? b : a;
+}
+
+- (void)buildTreeIfNeeded {
+    if (_treeValid) {
+        return;
+    }
+    NSUInteger capacity = 1;
+    while (capacity < _items.count) {
+        capacity *= 2;
+    }
+    if (capacity != _treeCapacity) {
+        free(_tree);
+        _treeCapacity = capacity;
+        _tree = malloc(sizeof(NSUInteger) * 2 * capacity);
+    }
+    for (NSUInteger i = 0; i < capacity; i++) {
+        _tree[capacity + i] = i < _items.count ? i : NSNotFound;
+    }
+    for (NSUInteger i = capacity - 1; i > 0; i--) {
+        _tree[i] = [self betterIndex:_tree[2 * i] than:_tree[2 * i + 1]];
+    }
+    _treeValid = YES;
+}
+
+- (void)updateTreeAtIndex:(NSUInteger)index {
+    for (NSUInteger i = (_treeCapacity + index) / 2; i > 0; i /= 2) {
+        _tree[i] = [self betterIndex:_tree[2 * i] than:_tree[2 * i + 1]];
+    }
+}
+
+// Best item in [lo, hi).
+- (NSUInteger)bestIndexFrom:(NSUInteger)lo to:(NSUInteger)hi {
+    NSUInteger best = NSNotFound;
+    for (lo += _treeCapacity, hi += _treeCapacity; lo < hi; lo /= 2, hi /= 2) {
+        if (lo & 1) {
+            best = [self betterIndex:best than:_tree[lo++]];
+        }
+        if (hi & 1) {
+            best = [self betterIndex:best than:_tree[--hi]];
+        }
+    }
+    return best;
+}
+
+- (BOOL)interval:(iTermCommandHistoryPrefixIndexInterval)a isBetterThan:(iTermCommandHistoryPrefixIndexInterval)b {
+    return [self betterIndex:b.best than:a.best] == a.best;
+}
+
+- (void)siftUp:(iTermCommandHistoryPrefixIndexInterval *)heap count:(NSUInteger)count {
+    NSUInteger i = count - 1;
+    while (i > 0) {
+        const NSUInteger parent = (i - 1) / 2;
+        if (![self interval:heap[i] isBetterThan:heap[parent]]) {
+            break;
+        }
+        const iTermCommandHistoryPrefixIndexInterval temp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = temp;
+        i = parent;
+    }
+}
+
+- (void)siftDown:(iTermCommandHistoryPrefixIndexInterval *)heap count:(NSUInteger)count {
+    NSUInteger i = 0;
+    while (YES) {
+        NSUInteger best = i;
+        for (NSUInteger child = 2 * i + 1; child <= 2 * i + 2 && child < count; child++) {
+            if ([self interval:heap[child] isBetterThan:heap[best]]) {
+                best = child;
+            }
+        }
+        if (best == i) {
+            return;
+        }
+        const iTermCommandHistoryPrefixIndexInterval temp = heap[i];
+        heap[i] = heap[best];
+        heap[best] = temp;
+        i = best;
+    }
+}
+
+@end
@@ -0,0 +1,60 @@
+//
+//  iTermCompactCells.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  A compact encoding of an array of screen_char_t for cells that aren't being actively used, such
+//  as scrollback. Codes are kept in one array (two bytes per cell) and everything else about a cell
+//  is kept in a run-length encoded array of attribute runs. Typical log output, where long runs of
+//  cells share the same colors and flags, costs a little over two bytes per cell instead of
+//  sizeof(screen_char_t).
+//
+
+#import <Foundation/Foundation.h>
+#import "ScreenChar.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef struct {
+    // Number of consecutive cells that share these attributes.
+    int length;
+
+    // Every field except |code| is meaningful. |code| is always zero.
+    screen_char_t attributes;
+} iTermCompactCellRun;
+
+typedef struct {
+    int numberOfCells;
+    int numberOfRuns;
+    unichar *codes;
+    iTermCompactCellRun *runs;
+} iTermCompactCells;
+
+// Encodes |count| cells. The result must be released with iTermCompactCellsFree.
+iTermCompactCells *iTermCompactCellsCreate(const screen_char_t *cells, int count);
+
+// Returns a deep copy of |compact|.
+iTermCompactCells *iTermCompactCellsCopy(const iTermCompactCells *compact);
+
+// Writes all the cells in |compact| to |dest|, which must have room for compact->numberOfCells.
+void iTermCompactCellsExpand(const iTermCompactCells *compact, screen_char_t *dest);
+
+// Writes |count| cells starting at cell |start| to |dest|. The range must be within |compact|.
+void iTermCompactCellsExpandRange(const iTermCompactCells *compact, int start, int count, screen_char_t *dest);
+
+// Number of bytes of heap used by |compact|, including the struct itself.
+size_t iTermCompactCellsSize(const iTermCompactCells *compact);
+
+void iTermCompactCellsFree(iTermCompactCells *compact);
+
+// Serializes and deflates |compact| for blocks that haven't been used in a while. This is pure
+// computation on |compact| so it may be called on any thread as long as nobody frees it meanwhile.
+// Returns nil if compression fails.
+NSData * _Nullable iTermCompactCellsCompress(const iTermCompactCells *compact);
+
+// Inverse of iTermCompactCellsCompress. Returns NULL if |data| is malformed. The result must be
+// released with iTermCompactCellsFree.
+iTermCompactCells * _Nullable iTermCompactCellsDecompress(NSData *data);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,180 @@
+//
+//  iTermCompactCells.m
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import "iTermCompactCells.h"
+
+#import "DebugLogging.h"
+#import "iTermMalloc.h"
+#import "zlib.h"
+
+// Precedes the deflated codes and runs in the output of iTermCompactCellsCompress.
+typedef struct {
+    int numberOfCells;
+    int numberOfRuns;
+} iTermCompressedCompactCellsHeader;
+
+NS_INLINE screen_char_t iTermCompactCellAttributes(screen_char_t c) {
+    c.code = 0;
+    return c;
+}
+
+iTermCompactCells *iTermCompactCellsCreate(const screen_char_t *cells, int count) {
+    iTermCompactCells *compact = iTermCalloc(1, sizeof(iTermCompactCells));
+    compact->numberOfCells = count;
+    compact->codes = iTermMalloc(MAX(1, count) * sizeof(unichar));
+
+    // Count runs first so the runs array is allocated exactly once at its final size.
+    int numberOfRuns = 0;
+    screen_char_t previous = { 0 };
+    for (int i = 0; i < count; i++) {
+        const screen_char_t attributes = iTermCompactCellAttributes(cells[i]);
+        if (i == 0 || memcmp(&attributes, &previous, sizeof(attributes))) {
+            numberOfRuns++;
+            previous = attributes;
+        }
+    }
+    compact->numberOfRuns = numberOfRuns;
+    compact->runs = iTermMalloc(MAX(1, numberOfRuns) * sizeof(iTermCompactCellRun));
+
+    int run = -1;
+    for (int i = 0; i < count; i++) {
+        compact->codes[i] = cells[i].code;
+        const screen_char_t attributes = iTermCompactCellAttributes(cells[i]);
+        if (run < 0 || memcmp(&attributes, &compact->runs[run].attributes, sizeof(attributes))) {
+            run++;
+            compact->runs[run].length = 0;
+            compact->runs[run].attributes = attributes;
+        }
+        compact->runs[run].length++;
+    }
+    return compact;
+}
+
+iTermCompactCells *iTermCompactCellsCopy(const iTermCompactCells *compact) {
+    iTermCompactCells *copy = iTermMalloc(sizeof(iTermCompactCells));
+    *copy = *compact;
+    copy->codes = iTermMalloc(MAX(1, compact->numberOfCells) * sizeof(unichar));
+    memcpy(copy->codes, compact->codes, compact->numberOfCells * sizeof(unichar));
+    copy->runs = iTermMalloc(MAX(1, compact->numberOfRuns) * sizeof(iTermCompactCellRun));
+    memcpy(copy->runs, compact->runs, compact->numberOfRuns * sizeof(iTermCompactCellRun));
+    return copy;
+}
+
+void iTermCompactCellsExpand(const iTermCompactCells *compact, screen_char_t *dest) {
+    int i = 0;
+    for (int run = 0; run < compact->numberOfRuns; run++) {
+        const iTermCompactCellRun *r = &compact->runs[run];
+        const int limit = i + r->length;
+        for (; i < limit; i++) {
+            dest[i] = r->attributes;
+            dest[i].code = compact->codes[i];
+        }
+    }
+}
+
+void iTermCompactCellsExpandRange(const iTermCompactCells *compact, int start, int count, screen_char_t *dest) {
+    // Skip the runs that end before |start|. LineBlock decodes each line at most once per
+    // compaction, so a linear scan is cheap next to the allocation it's filling.
+    int run = 0;
+    int runStart = 0;
+    while (run < compact->numberOfRuns && runStart + compact->runs[run].length <= start) {
+        runStart += compact->runs[run].length;
+        run++;
+    }
+    int i = start;
+    const int end = start + count;
+    for (; run < compact->numberOfRuns && i < end; run++) {
+        const iTermCompactCellRun *r = &compact->runs[run];
+        const int limit = MIN(end, runStart + r->length);
+        for (; i < limit; i++) {
+            dest[i - start] = r->attributes;
+            dest[i - start].code = compact->codes[i];
+        }
+        runStart += r->length;
+    }
+}
+
+size_t iTermCompactCellsSize(const iTermCompactCells *compact) {
+    return (sizeof(*compact) +
+            compact->numberOfCells * sizeof(unichar) +
+            compact->numberOfRuns * sizeof(iTermCompactCellRun));
+}
+
+void iTermCompactCellsFree(iTermCompactCells *compact) {
+    free(compact->codes);
+    free(compact->runs);
+    free(compact);
+}
+
+NSData *iTermCompactCellsCompress(const iTermCompactCells *compact) {
+    const size_t codesSize = compact->numberOfCells * sizeof(unichar);
+    const size_t runsSize = compact->numberOfRuns * sizeof(iTermCompactCellRun);
+    const size_t sourceLength = codesSize + runsSize;
+
+    // Deflate wants one contiguous input. Codes come first because they compress best when
+    // adjacent to each other.
+    unsigned char *source = iTermMalloc(MAX(1, sourceLength));
+    memcpy(source, compact->codes, codesSize);
+    memcpy(source + codesSize, compact->runs, runsSize);
+
+    const iTermCompressedCompactCellsHeader header = {
+        .numberOfCells = compact->numberOfCells,
+        .numberOfRuns = compact->numberOfRuns
+    };
+    uLongf destLength = compressBound(sourceLength);
+    NSMutableData *result = [NSMutableData dataWithLength:sizeof(header) + destLength];
+    memcpy(result.mutableBytes, &header, sizeof(header));
+
+    // Speed matters more than ratio here since this runs every time a block goes cold. The
+    // fastest level still does well because codes are mostly ASCII and runs are repetitive.
+    const int status = compress2(((Bytef *)result.mutableBytes) + sizeof(header),
+                                 &destLength,
+                                 source,
+                                 sourceLength,
+                                 Z_BEST_SPEED);
+    free(source);
+    if (status != Z_OK) {
+        DLog(@"compress2 failed with %@", @(status));
+        return nil;
+    }
+    result.length = sizeof(header) + destLength;
+    return result;
+}
+
+iTermCompactCells *iTermCompactCellsDecompress(NSData *data) {
+    iTermCompressedCompactCellsHeader header;
+    if (data.length < sizeof(header)) {
+        return NULL;
+    }
+    memcpy(&header, data.bytes, sizeof(header));
+    if (header.numberOfCells < 0 || header.numberOfRuns < 0) {
+        return NULL;
+    }
+    const size_t codesSize = header.numberOfCells * sizeof(unichar);
+    const size_t runsSize = header.numberOfRuns * sizeof(iTermCompactCellRun);
+    unsigned char *dest = iTermMalloc(MAX(1, codesSize + runsSize));
+    uLongf destLength = codesSize + runsSize;
+    const int status = uncompress(dest,
+                                  &destLength,
+                                  ((const Bytef *)data.bytes) + sizeof(header),
+                                  data.length - sizeof(header));
+    if (status != Z_OK || destLength != codesSize + runsSize) {
+        DLog(@"uncompress failed with %@", @(status));
+        free(dest);
+        return NULL;
+    }
+
+    iTermCompactCells *compact = iTermMalloc(sizeof(iTermCompactCells));
+    compact->numberOfCells = header.numberOfCells;
+    compact->numberOfRuns = header.numberOfRuns;
+    compact->codes = iTermMalloc(MAX(1, codesSize));
+    memcpy(compact->codes, dest, codesSize);
+    compact->runs = iTermMalloc(MAX(1, runsSize));
+    memcpy(compact->runs, dest + codesSize, runsSize);
+    free(dest);
+    return compact;
+}
@@ -0,0 +1,731 @@
+//
+//  iTermDVRCodec.c
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Key frame:
+//    varint cellCount
+//    tokens, until cellCount cells are accounted for:
+//      0x00-0x7f                   a cell with that code and the current attributes
+//      0x80 <code:2>               a cell with that code and the current attributes
+//      0x81 varint(n) <code:2>     n such cells
+//      0x82 <attributes>           sets the current attributes (cellSize - 2 bytes)
+//
+//  Deflated key frame:
+//    varint cellCount
+//    varint length of the key frame's encoding
+//    the encoding, compressed with zlib
+//
+//  Diff frame:
+//    varint cellCount
+//    chunks, until the end of the input:
+//      varint unchanged cells to skip
+//      varint changed cells that follow, each:
+//        <mask:2>                  bit i is set if byte i of the XOR is nonzero
+//        the nonzero bytes of the XOR of the new cell with the old one
+//
+
+#include "iTermDVRCodec.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+// Identical cells repeated at least this many times are stored as a repeat.
+#define ITERM_DVR_MIN_REPEAT 4
+
+// Key frames look for each row this many rows further down the previous frame.
+#define ITERM_DVR_MAX_SCROLL 8
+
+enum {
+    iTermDVRTagCode = 0x80,
+    iTermDVRTagRepeat = 0x81,
+    iTermDVRTagAttributes = 0x82
+};
+
+typedef struct {
+    unsigned char *p;
+    unsigned char *end;
+} iTermDVRWriter;
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+} iTermDVRReader;
+
+static inline bool iTermDVRWriteVarint(iTermDVRWriter *w, uint32_t value) {
+    do {
+        if (w->p == w->end) {
+            return false;
+        }
+        const unsigned char byte = value & 0x7f;
+        value >>= 7;
+        *w->p++ = byte | (value ? 0x80 : 0);
+    } while (value);
+    return true;
+}
+
+static inline bool iTermDVRWriteBytes(iTermDVRWriter *w, const void *bytes, size_t length) {
+    if ((size_t)(w->end - w->p) < length) {
+        return false;
+    }
+    memcpy(w->p, bytes, length);
+    w->p += length;
+    return true;
+}
+
+static inline bool iTermDVRReadVarint(iTermDVRReader *r, uint32_t *value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (r->p == r->end) {
+            return false;
+        }
+        const unsigned char byte = *r->p++;
+        result |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool iTermDVRReadBytes(iTermDVRReader *r, void *bytes, size_t length) {
+    if ((size_t)(r->end - r->p) < length) {
+        return false;
+    }
+    memcpy(bytes, r->p, length);
+    r->p += length;
+    return true;
+}
+
+// Compares |length| bytes. screen_char_t has ten bytes of attributes and is twelve bytes long, so
+// those sizes get loads the compiler can inline.
+static inline bool iTermDVRBytesEqual(const unsigned char *a, const unsigned char *b, int length) {
+    uint64_t a8, b8;
+    uint16_t a2, b2;
+    uint32_t a4, b4;
+    switch (length) {
+        case 10:
+            memcpy(&a8, a, 8);
+            memcpy(&b8, b, 8);
+            memcpy(&a2, a + 8, 2);
+            memcpy(&b2, b + 8, 2);
+            return a8 == b8 && a2 == b2;
+        case 12:
+            memcpy(&a8, a, 8);
+            memcpy(&b8, b, 8);
+            memcpy(&a4, a + 8, 4);
+            memcpy(&b4, b + 8, 4);
+            return a8 == b8 && a4 == b4;
+        default:
+            return !memcmp(a, b, length);
+    }
+}
+
+#pragma mark - Key frames
+
+// Writes tokens for |cellCount| cells. |*attributesPtr| points at the current attributes, or is
+// NULL if none have been written yet, and is updated. Returns false if they might not fit.
+static inline bool iTermDVREncodeCells(const unsigned char *cells,
+                                       int cellCount,
+                                       int cellSize,
+                                       const unsigned char **attributesPtr,
+                                       iTermDVRWriter *w) {
+    const int attributesSize = cellSize - 2;
+    // No cell takes more than this many bytes, which lets the loop check for room once per cell.
+    const size_t maximumCellLength = 1 + attributesSize + 3;
+    const unsigned char *attributes = *attributesPtr;
+    unsigned char *p = w->p;
+    int i = 0;
+    while (i < cellCount) {
+        if ((size_t)(w->end - p) < maximumCellLength) {
+            return false;
+        }
+        const unsigned char *cell = cells + i * cellSize;
+        if (!attributes || !iTermDVRBytesEqual(cell + 2, attributes, attributesSize)) {
+            attributes = cell + 2;
+            *p++ = iTermDVRTagAttributes;
+            memcpy(p, attributes, attributesSize);
+            p += attributesSize;
+        }
+        uint16_t code;
+        memcpy(&code, cell, sizeof(code));
+
+        int n = 1;
+        // Text rarely repeats a character, so compare codes before whole cells.
+        while (i + n < cellCount &&
+               !memcmp(cell, cell + n * cellSize, sizeof(code)) &&
+               iTermDVRBytesEqual(cell, cell + n * cellSize, cellSize)) {
+            n++;
+            if (n == ITERM_DVR_MIN_REPEAT) {
+                // This is probably blank space, which can be long. Each block that equals the
+                // same block shifted back by one cell is made of copies of the cell before it.
+                const int blockSize = 16;
+                while (i + n + blockSize <= cellCount &&
+                       !memcmp(cell + n * cellSize, cell + (n - 1) * cellSize, blockSize * cellSize)) {
+                    n += blockSize;
+                }
+            }
+        }
+        if (n >= ITERM_DVR_MIN_REPEAT) {
+            *p++ = iTermDVRTagRepeat;
+            iTermDVRWriter varintWriter = { p, w->end };
+            if (!iTermDVRWriteVarint(&varintWriter, n) || w->end - varintWriter.p < 2) {
+                return false;
+            }
+            p = varintWriter.p;
+            memcpy(p, &code, sizeof(code));
+            p += sizeof(code);
+            i += n;
+            continue;
+        }
+        // A literal is cheaper than a short repeat.
+        if (code < 0x80) {
+            *p++ = code;
+        } else {
+            *p++ = iTermDVRTagCode;
+            memcpy(p, &code, sizeof(code));
+            p += sizeof(code);
+        }
+        i++;
+    }
+    w->p = p;
+    *attributesPtr = attributes;
+    return true;
+}
+
+static inline size_t iTermDVREncodeKeyFrameImpl(const void *frame,
+                                                int cellCount,
+                                                int cellSize,
+                                                void *dest,
+                                                size_t capacity) {
+    iTermDVRWriter w = { dest, (unsigned char *)dest + capacity };
+    const unsigned char *attributes = NULL;
+    if (!iTermDVRWriteVarint(&w, cellCount) ||
+        !iTermDVREncodeCells(frame, cellCount, cellSize, &attributes, &w)) {
+        return 0;
+    }
+    return w.p - (unsigned char *)dest;
+}
+
+size_t iTermDVREncodeKeyFrame(const void *frame,
+                              int cellCount,
+                              int cellSize,
+                              void *dest,
+                              size_t capacity) {
+    if (cellSize <= 2 || cellSize > ITERM_DVR_MAX_CELL_SIZE || cellCount < 0) {
+        return 0;
+    }
+    if (cellSize == 12) {
+        // Let the compiler specialize the loop for screen_char_t.
+        return iTermDVREncodeKeyFrameImpl(frame, cellCount, 12, dest, capacity);
+    }
+    return iTermDVREncodeKeyFrameImpl(frame, cellCount, cellSize, dest, capacity);
+}
+
+int iTermDVRKeyFrameCellCount(const void *src, size_t length) {
+    iTermDVRReader r = { src, (const unsigned char *)src + length };
+    uint32_t cellCount;
+    if (!iTermDVRReadVarint(&r, &cellCount) || cellCount > INT32_MAX) {
+        return -1;
+    }
+    return cellCount;
+}
+
+bool iTermDVRDecodeKeyFrame(const void *src,
+                            size_t length,
+                            int cellSize,
+                            void *frame,
+                            int cellCount) {
+    if (cellSize <= 2 || cellSize > ITERM_DVR_MAX_CELL_SIZE || cellCount < 0) {
+        return false;
+    }
+    unsigned char *cells = frame;
+    const int attributesSize = cellSize - 2;
+    iTermDVRReader r = { src, (const unsigned char *)src + length };
+    uint32_t encodedCellCount;
+    if (!iTermDVRReadVarint(&r, &encodedCellCount) || encodedCellCount != (uint32_t)cellCount) {
+        return false;
+    }
+    unsigned char attributes[ITERM_DVR_MAX_CELL_SIZE];
+    bool haveAttributes = false;
+    int i = 0;
+    while (i < cellCount) {
+        unsigned char tag;
+        if (!iTermDVRReadBytes(&r, &tag, 1)) {
+            return false;
+        }
+        if (tag == iTermDVRTagAttributes) {
+            if (!iTermDVRReadBytes(&r, attributes, attributesSize)) {
+                return false;
+            }
+            haveAttributes = true;
+            continue;
+        }
+        if (!haveAttributes) {
+            return false;
+        }
+        uint16_t code;
+        uint32_t n = 1;
+        if (tag < 0x80) {
+            code = tag;
+        } else if (tag == iTermDVRTagCode) {
+            if (!iTermDVRReadBytes(&r, &code, sizeof(code))) {
+                return false;
+            }
+        } else if (tag == iTermDVRTagRepeat) {
+            if (!iTermDVRReadVarint(&r, &n) ||
+                n == 0 ||
+                n > (uint32_t)(cellCount - i) ||
+                !iTermDVRReadBytes(&r, &code, sizeof(code))) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        for (uint32_t j = 0; j < n; j++) {
+            unsigned char *cell = cells + i * cellSize;
+            memcpy(cell, &code, sizeof(code));
+            memcpy(cell + 2, attributes, attributesSize);
+            i++;
+        }
+    }
+    return r.p == r.end;
+}
+
+#pragma mark - Deflated key frames
+
+size_t iTermDVRDeflateKeyFrame(const void *src, size_t length, void *dest, size_t capacity) {
+    iTermDVRReader r = { src, (const unsigned char *)src + length };
+    uint32_t cellCount;
+    if (!iTermDVRReadVarint(&r, &cellCount) || length > UINT32_MAX) {
+        return 0;
+    }
+    iTermDVRWriter w = { dest, (unsigned char *)dest + capacity };
+    if (!iTermDVRWriteVarint(&w, cellCount) || !iTermDVRWriteVarint(&w, (uint32_t)length)) {
+        return 0;
+    }
+    uLongf deflatedLength = w.end - w.p;
+    // The fastest level gets most of the benefit: key frames are mostly repeated rows.
+    if (compress2(w.p, &deflatedLength, src, length, Z_BEST_SPEED) != Z_OK) {
+        return 0;
+    }
+    const size_t total = (w.p - (unsigned char *)dest) + deflatedLength;
+    return total < length ? total : 0;
+}
+
+bool iTermDVRDecodeDeflatedKeyFrame(const void *src,
+                                    size_t length,
+                                    int cellSize,
+                                    void *frame,
+                                    int cellCount) {
+    iTermDVRReader r = { src, (const unsigned char *)src + length };
+    uint32_t encodedCellCount;
+    uint32_t encodedLength;
+    if (!iTermDVRReadVarint(&r, &encodedCellCount) ||
+        encodedCellCount != (uint32_t)cellCount ||
+        !iTermDVRReadVarint(&r, &encodedLength) ||
+        encodedLength > (size_t)cellCount * (1 + ITERM_DVR_MAX_CELL_SIZE + 3) + 5) {
+        return false;
+    }
+    unsigned char *encoding = malloc(encodedLength + 1);
+    if (!encoding) {
+        return false;
+    }
+    uLongf inflatedLength = encodedLength;
+    const bool ok = (uncompress(encoding, &inflatedLength, r.p, r.end - r.p) == Z_OK &&
+                     inflatedLength == encodedLength &&
+                     iTermDVRDecodeKeyFrame(encoding, encodedLength, cellSize, frame, cellCount));
+    free(encoding);
+    return ok;
+}
+
+#pragma mark - Row cache
+
+typedef struct {
+    bool valid;
+    // Where its tokens are in the cache's bytes. They begin with an attributes token.
+    size_t offset;
+    size_t length;
+    // The attributes of its last cell.
+    unsigned char lastAttributes[ITERM_DVR_MAX_CELL_SIZE];
+} iTermDVRCachedRow;
+
+struct iTermDVRRowCache {
+    int rowCount;
+    int cellsPerRow;
+    int cellSize;
+
+    // The previous frame. Row y is stored at physical row (firstRow + y) % rowCount, so when the
+    // screen scrolls up only firstRow has to change.
+    unsigned char *frame;
+    int firstRow;
+
+    // One per physical row of the previous frame.
+    iTermDVRCachedRow *rows;
+    unsigned char *bytes;
+    size_t capacity;
+
+    // The next generation is built here while the previous one is read, and then they're swapped.
+    iTermDVRCachedRow *nextRows;
+    unsigned char *nextBytes;
+    size_t nextCapacity;
+};
+
+iTermDVRRowCache *iTermDVRRowCacheCreate(void) {
+    return calloc(1, sizeof(iTermDVRRowCache));
+}
+
+void iTermDVRRowCacheFree(iTermDVRRowCache *cache) {
+    if (!cache) {
+        return;
+    }
+    free(cache->frame);
+    free(cache->rows);
+    free(cache->bytes);
+    free(cache->nextRows);
+    free(cache->nextBytes);
+    free(cache);
+}
+
+static inline int iTermDVRRowCachePhysicalRow(const iTermDVRRowCache *cache, int row) {
+    const int p = cache->firstRow + row;
+    return p < cache->rowCount ? p : p - cache->rowCount;
+}
+
+static inline size_t iTermDVRRowCacheRowLength(const iTermDVRRowCache *cache) {
+    return (size_t)cache->cellsPerRow * cache->cellSize;
+}
+
+static inline unsigned char *iTermDVRRowCachePhysicalRowBytes(const iTermDVRRowCache *cache, int p) {
+    return cache->frame + p * iTermDVRRowCacheRowLength(cache);
+}
+
+void iTermDVRRowCacheForgetRow(iTermDVRRowCache *cache, int row) {
+    if (row >= 0 && row < cache->rowCount) {
+        cache->rows[iTermDVRRowCachePhysicalRow(cache, row)].valid = false;
+    }
+}
+
+void iTermDVRRowCacheForgetAll(iTermDVRRowCache *cache) {
+    for (int y = 0; y < cache->rowCount; y++) {
+        cache->rows[y].valid = false;
+    }
+}
+
+void iTermDVRRowCacheCopyFrame(const iTermDVRRowCache *cache, void *dest) {
+    const size_t rowLength = iTermDVRRowCacheRowLength(cache);
+    for (int y = 0; y < cache->rowCount; y++) {
+        memcpy((unsigned char *)dest + y * rowLength,
+               iTermDVRRowCachePhysicalRowBytes(cache, iTermDVRRowCachePhysicalRow(cache, y)),
+               rowLength);
+    }
+}
+
+static void iTermDVRRowCacheSetGeometry(iTermDVRRowCache *cache, int rowCount, int cellsPerRow, int cellSize) {
+    if (cache->rowCount == rowCount && cache->cellsPerRow == cellsPerRow && cache->cellSize == cellSize) {
+        return;
+    }
+    free(cache->frame);
+    free(cache->rows);
+    free(cache->nextRows);
+    cache->frame = calloc((size_t)rowCount * cellsPerRow + 1, cellSize);
+    cache->firstRow = 0;
+    cache->rows = calloc(rowCount + 1, sizeof(iTermDVRCachedRow));
+    cache->nextRows = calloc(rowCount + 1, sizeof(iTermDVRCachedRow));
+    cache->rowCount = rowCount;
+    cache->cellsPerRow = cellsPerRow;
+    cache->cellSize = cellSize;
+}
+
+// Is row |o| of the previous frame the same as |row| and is its encoding known?
+static inline bool iTermDVRRowCacheMatches(const iTermDVRRowCache *cache,
+                                           int o,
+                                           const unsigned char *row,
+                                           size_t rowLength) {
+    if (o >= cache->rowCount) {
+        return false;
+    }
+    const int p = iTermDVRRowCachePhysicalRow(cache, o);
+    if (!cache->rows[p].valid) {
+        return false;
+    }
+    const unsigned char *candidate = iTermDVRRowCachePhysicalRowBytes(cache, p);
+    const size_t prefixLength = rowLength < 64 ? rowLength : 64;
+    return !memcmp(candidate, row, prefixLength) && !memcmp(candidate, row, rowLength);
+}
+
+size_t iTermDVREncodeKeyFrameRows(iTermDVRRowCache *cache,
+                                  const void *const *rows,
+                                  int rowCount,
+                                  int cellsPerRow,
+                                  int cellSize,
+                                  void *dest,
+                                  size_t capacity) {
+    if (cellSize <= 2 || cellSize > ITERM_DVR_MAX_CELL_SIZE || rowCount < 0 || cellsPerRow <= 0) {
+        return 0;
+    }
+    iTermDVRRowCacheSetGeometry(cache, rowCount, cellsPerRow, cellSize);
+    const size_t rowLength = (size_t)cellsPerRow * cellSize;
+    const int attributesSize = cellSize - 2;
+    const size_t maximumRowLength = (size_t)cellsPerRow * (1 + attributesSize + 3);
+    iTermDVRWriter w = { dest, (unsigned char *)dest + capacity };
+    bool fits = iTermDVRWriteVarint(&w, rowCount * cellsPerRow);
+
+    // The attributes most recently written to |dest|.
+    unsigned char attributes[ITERM_DVR_MAX_CELL_SIZE];
+    bool haveAttributes = false;
+    // If the screen scrolled up, rotate the ring so the rows that moved are already in place.
+    // Its last rows then hold the previous frame's first rows, which are probably overwritten.
+    // Unchanged rows must stay where they are, so it can't have scrolled if there are any.
+    bool mayHaveScrolled = true;
+    for (int y = 0; y < rowCount && mayHaveScrolled; y++) {
+        mayHaveScrolled = (rows[y] != NULL);
+    }
+    if (rowCount > 0 && mayHaveScrolled && !iTermDVRRowCacheMatches(cache, 0, rows[0], rowLength)) {
+        for (int o = 1; o < rowCount && o <= ITERM_DVR_MAX_SCROLL; o++) {
+            if (iTermDVRRowCacheMatches(cache, o, rows[0], rowLength)) {
+                cache->firstRow = iTermDVRRowCachePhysicalRow(cache, o);
+                break;
+            }
+        }
+    }
+
+    // How far rows have scrolled up since the previous frame, beyond the rotation.
+    int shift = 0;
+    size_t nextLength = 0;
+    int y;
+    for (y = 0; y < rowCount && fits; y++) {
+        const unsigned char *row = rows[y];
+        const int p = iTermDVRRowCachePhysicalRow(cache, y);
+        unsigned char *before = iTermDVRRowCachePhysicalRowBytes(cache, p);
+        // Rows below this one haven't been overwritten yet, so a row can be found even after part
+        // of the screen scrolls. Most rows differ from a wrong candidate in their first few cells,
+        // so candidates are checked that far before being compared in full.
+        int match = -1;
+        if (!row) {
+            // It's already in place.
+            row = before;
+            if (cache->rows[p].valid) {
+                match = y;
+            }
+        } else if (iTermDVRRowCacheMatches(cache, y + shift, row, rowLength)) {
+            match = y + shift;
+        } else {
+            for (int o = y; o < rowCount && o <= y + ITERM_DVR_MAX_SCROLL; o++) {
+                if (o != y + shift && iTermDVRRowCacheMatches(cache, o, row, rowLength)) {
+                    match = o;
+                    shift = o - y;
+                    break;
+                }
+            }
+        }
+
+        if (cache->nextCapacity < nextLength + maximumRowLength) {
+            cache->nextCapacity = (nextLength + maximumRowLength) * 2;
+            cache->nextBytes = realloc(cache->nextBytes, cache->nextCapacity);
+        }
+        iTermDVRCachedRow *entry = &cache->nextRows[p];
+        if (match >= 0) {
+            const int q = iTermDVRRowCachePhysicalRow(cache, match);
+            *entry = cache->rows[q];
+            memcpy(cache->nextBytes + nextLength, cache->bytes + entry->offset, entry->length);
+            if (q != p) {
+                memcpy(before, iTermDVRRowCachePhysicalRowBytes(cache, q), rowLength);
+            }
+        } else {
+            // Copy first so the encoder reads from the cache. It's encoded with no current
+            // attributes so its tokens can be copied anywhere later.
+            if (row != before) {
+                memcpy(before, row, rowLength);
+            }
+            iTermDVRWriter rowWriter = { cache->nextBytes + nextLength, cache->nextBytes + cache->nextCapacity };
+            const unsigned char *rowAttributes = NULL;
+            iTermDVREncodeCells(before, cellsPerRow, cellSize, &rowAttributes, &rowWriter);
+            entry->valid = true;
+            entry->length = rowWriter.p - (cache->nextBytes + nextLength);
+            memcpy(entry->lastAttributes, rowAttributes, attributesSize);
+        }
+        entry->offset = nextLength;
+        nextLength += entry->length;
+
+        // Leave out the leading attributes token if it sets what's already current.
+        const unsigned char *tokens = cache->nextBytes + entry->offset;
+        size_t length = entry->length;
+        if (haveAttributes && !memcmp(tokens + 1, attributes, attributesSize)) {
+            tokens += 1 + attributesSize;
+            length -= 1 + attributesSize;
+        }
+        fits = iTermDVRWriteBytes(&w, tokens, length);
+        memcpy(attributes, entry->lastAttributes, attributesSize);
+        haveAttributes = true;
+    }
+    if (!fits) {
+        // The caller stores the frame raw, so it must be complete.
+        for (; y < rowCount; y++) {
+            if (rows[y]) {
+                memcpy(iTermDVRRowCachePhysicalRowBytes(cache, iTermDVRRowCachePhysicalRow(cache, y)),
+                       rows[y],
+                       rowLength);
+            }
+        }
+        iTermDVRRowCacheForgetAll(cache);
+        return 0;
+    }
+
+    iTermDVRCachedRow *rowsTemp = cache->rows;
+    cache->rows = cache->nextRows;
+    cache->nextRows = rowsTemp;
+    unsigned char *bytesTemp = cache->bytes;
+    cache->bytes = cache->nextBytes;
+    cache->nextBytes = bytesTemp;
+    const size_t capacityTemp = cache->capacity;
+    cache->capacity = cache->nextCapacity;
+    cache->nextCapacity = capacityTemp;
+    return w.p - (unsigned char *)dest;
+}
+
+#pragma mark - Diff frames
+
+// Returns the index of the first cell at or after |i| that differs, or |count|.
+static int iTermDVRNextChangedCell(const unsigned char *before,
+                                   const unsigned char *after,
+                                   int i,
+                                   int count,
+                                   int cellSize) {
+    // Most of a changed row is usually unchanged, so compare a block of cells at a time.
+    const int blockSize = 16;
+    while (i + blockSize <= count &&
+           !memcmp(before + i * cellSize, after + i * cellSize, blockSize * cellSize)) {
+        i += blockSize;
+    }
+    while (i < count && iTermDVRBytesEqual(before + i * cellSize, after + i * cellSize, cellSize)) {
+        i++;
+    }
+    return i;
+}
+
+// Writes the XOR of a changed cell with the old one.
+static bool iTermDVRWriteCellDiff(iTermDVRWriter *w,
+                                  const unsigned char *before,
+                                  const unsigned char *after,
+                                  int cellSize) {
+    unsigned char bytes[2 + ITERM_DVR_MAX_CELL_SIZE];
+    uint16_t mask = 0;
+    int o = 2;
+    for (int k = 0; k < cellSize; k++) {
+        const unsigned char x = before[k] ^ after[k];
+        if (x) {
+            mask |= 1 << k;
+            bytes[o++] = x;
+        }
+    }
+    bytes[0] = mask & 0xff;
+    bytes[1] = mask >> 8;
+    return iTermDVRWriteBytes(w, bytes, o);
+}
+
+size_t iTermDVREncodeDiffFrame(iTermDVRRowCache *cache,
+                               const void *const *rows,
+                               int rowCount,
+                               int cellsPerRow,
+                               int cellSize,
+                               void *dest,
+                               size_t capacity) {
+    if (rowCount != cache->rowCount || cellsPerRow != cache->cellsPerRow || cellSize != cache->cellSize) {
+        return 0;
+    }
+    iTermDVRWriter w = { dest, (unsigned char *)dest + capacity };
+    if (!iTermDVRWriteVarint(&w, rowCount * cellsPerRow)) {
+        return 0;
+    }
+    // Unchanged cells since the last changed one.
+    uint32_t skip = 0;
+    for (int y = 0; y < rowCount; y++) {
+        const unsigned char *after = rows[y];
+        unsigned char *before = iTermDVRRowCachePhysicalRowBytes(cache, iTermDVRRowCachePhysicalRow(cache, y));
+        if (!after) {
+            skip += cellsPerRow;
+            continue;
+        }
+        int x = 0;
+        while (x < cellsPerRow) {
+            const int first = iTermDVRNextChangedCell(before, after, x, cellsPerRow, cellSize);
+            skip += first - x;
+            if (first == cellsPerRow) {
+                break;
+            }
+            int last = first + 1;
+            while (last < cellsPerRow &&
+                   !iTermDVRBytesEqual(before + last * cellSize, after + last * cellSize, cellSize)) {
+                last++;
+            }
+            if (!iTermDVRWriteVarint(&w, skip) ||
+                !iTermDVRWriteVarint(&w, last - first)) {
+                return 0;
+            }
+            for (int j = first; j < last; j++) {
+                if (!iTermDVRWriteCellDiff(&w, before + j * cellSize, after + j * cellSize, cellSize)) {
+                    return 0;
+                }
+            }
+            // Only the changed cells need to be copied.
+            memcpy(before + first * cellSize, after + first * cellSize, (last - first) * cellSize);
+            skip = 0;
+            x = last;
+            iTermDVRRowCacheForgetRow(cache, y);
+        }
+    }
+    return w.p - (unsigned char *)dest;
+}
+
+bool iTermDVRApplyDiffFrame(const void *src,
+                            size_t length,
+                            int cellSize,
+                            void *frame,
+                            int cellCount) {
+    if (cellSize <= 0 || cellSize > ITERM_DVR_MAX_CELL_SIZE || cellCount < 0) {
+        return false;
+    }
+    unsigned char *cells = frame;
+    iTermDVRReader r = { src, (const unsigned char *)src + length };
+    uint32_t encodedCellCount;
+    if (!iTermDVRReadVarint(&r, &encodedCellCount) || encodedCellCount != (uint32_t)cellCount) {
+        return false;
+    }
+    uint32_t i = 0;
+    while (r.p < r.end) {
+        uint32_t skip;
+        uint32_t count;
+        if (!iTermDVRReadVarint(&r, &skip) ||
+            !iTermDVRReadVarint(&r, &count) ||
+            skip > cellCount - i ||
+            count > cellCount - i - skip) {
+            return false;
+        }
+        i += skip;
+        for (uint32_t j = 0; j < count; j++, i++) {
+            unsigned char maskBytes[2];
+            if (!iTermDVRReadBytes(&r, maskBytes, 2)) {
+                return false;
+            }
+            const uint16_t mask = maskBytes[0] | (maskBytes[1] << 8);
+            if (mask >> cellSize) {
+                return false;
+            }
+            unsigned char *cell = cells + i * cellSize;
+            for (int k = 0; k < cellSize; k++) {
+                if (mask & (1 << k)) {
+                    if (r.p == r.end) {
+                        return false;
+                    }
+                    cell[k] ^= *r.p++;
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,119 @@
+//
+//  iTermDVRCodec.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Compact encodings for instant replay frames. A frame is an array of cells, each an opaque
+//  record of |cellSize| bytes (at most ITERM_DVR_MAX_CELL_SIZE) that begins with its 16-bit
+//  character code; for DVREncoder a cell is a screen_char_t. Key frames store attributes only
+//  where they differ from the previous cell's, codes in as little as one byte, and runs of
+//  identical cells once. Diff frames store only the cells that changed since the previous frame,
+//  each as the nonzero bytes of its XOR with the cell it replaces.
+//
+//  When every row is dirty (e.g., output scrolling by) each frame is a key frame. A row cache
+//  holds the previous frame and remembers how each of its rows was encoded, so rows that are
+//  unchanged or have only scrolled up are copied rather than encoded again. Its rows form a ring,
+//  so following a scroll doesn't move any cells.
+//
+//  Key frames may optionally be deflated with zlib as well.
+//
+//  Plain C with no Foundation dependency so it can be benchmarked anywhere (see
+//  tests/dvr_codec_bench.c).
+//
+
+#ifndef iTermDVRCodec_h
+#define iTermDVRCodec_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ITERM_DVR_MAX_CELL_SIZE 16
+
+// Holds the previous frame and the encoding of each of its rows. It's empty until the first key
+// frame is encoded with it, and is emptied again if the frame's size changes.
+typedef struct iTermDVRRowCache iTermDVRRowCache;
+
+iTermDVRRowCache *iTermDVRRowCacheCreate(void);
+void iTermDVRRowCacheFree(iTermDVRRowCache *cache);
+void iTermDVRRowCacheForgetRow(iTermDVRRowCache *cache, int row);
+void iTermDVRRowCacheForgetAll(iTermDVRRowCache *cache);
+
+// Copies the previous frame into |dest| with its rows in order.
+void iTermDVRRowCacheCopyFrame(const iTermDVRRowCache *cache, void *dest);
+
+// Encodes |cellCount| cells of |frame| into |dest|. Returns the number of bytes written, or 0 if
+// it might not fit in |capacity|.
+size_t iTermDVREncodeKeyFrame(const void *frame,
+                              int cellCount,
+                              int cellSize,
+                              void *dest,
+                              size_t capacity);
+
+// Encodes a key frame of |rowCount| rows of |cellsPerRow| cells, where |rows[y]| points at row y.
+// Rows found in the previous frame in |cache| are copied from there instead of encoded. |rows[y]|
+// may be NULL if row y is known to be the same as in the previous frame, which must then have
+// been the same size, and then the row isn't looked at unless it has to be encoded. |cache|
+// holds the new frame afterwards, even if 0 is returned because the encoding might not fit in
+// |capacity|, so the caller can store it raw. The output decodes with iTermDVRDecodeKeyFrame().
+size_t iTermDVREncodeKeyFrameRows(iTermDVRRowCache *cache,
+                                  const void *const *rows,
+                                  int rowCount,
+                                  int cellsPerRow,
+                                  int cellSize,
+                                  void *dest,
+                                  size_t capacity);
+
+// Returns the number of cells in an encoded or deflated key frame, or -1 if it's malformed.
+int iTermDVRKeyFrameCellCount(const void *src, size_t length);
+
+// Decodes a key frame into |frame|, which has room for |cellCount| cells. Returns false if the
+// input is malformed or doesn't have exactly |cellCount| cells.
+bool iTermDVRDecodeKeyFrame(const void *src,
+                            size_t length,
+                            int cellSize,
+                            void *frame,
+                            int cellCount);
+
+// Deflates the key frame encoding in |src| into |dest|. Returns the number of bytes written, or 0
+// if that wouldn't be smaller than |length| or fit in |capacity|; then store |src| as it is.
+size_t iTermDVRDeflateKeyFrame(const void *src, size_t length, void *dest, size_t capacity);
+
+// Decodes a key frame made by iTermDVRDeflateKeyFrame() like iTermDVRDecodeKeyFrame().
+bool iTermDVRDecodeDeflatedKeyFrame(const void *src,
+                                    size_t length,
+                                    int cellSize,
+                                    void *frame,
+                                    int cellCount);
+
+// Encodes how a frame differs from the previous one in |cache| into |dest|. |rows[y]| points at
+// row y of the new frame, or is NULL if that row is known to be unchanged, in which case it isn't
+// looked at. The new frame must have as many rows and cells as the previous one. Changed rows are
+// copied into |cache| as they're encoded so it holds the new frame afterwards. Returns the number
+// of bytes written, or 0 if that would be more than |capacity| or the frame's size changed; then
+// the caller should make a key frame.
+size_t iTermDVREncodeDiffFrame(iTermDVRRowCache *cache,
+                               const void *const *rows,
+                               int rowCount,
+                               int cellsPerRow,
+                               int cellSize,
+                               void *dest,
+                               size_t capacity);
+
+// Applies a diff frame to |frame|, which holds the previous frame's |cellCount| cells. Returns
+// false if the input is malformed or was encoded for a different number of cells.
+bool iTermDVRApplyDiffFrame(const void *src,
+                            size_t length,
+                            int cellSize,
+                            void *frame,
+                            int cellCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermDVRCodec_h
@@ -159,6 +159,8 @@
         [self close];
         return NO;
     }
+    // Saves run the same few inserts and updates many times per transaction, so keep them prepared.
+    _db.shouldCacheStatements = YES;
 
     DLog(@"Opened db and passed integrity check.");
     return YES;
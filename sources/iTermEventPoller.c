@@ -0,0 +1,457 @@
+//
+//  iTermEventPoller.c
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#include "iTermEventPoller.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#define ITERM_EVENT_POLLER_KQUEUE 1
+#include <sys/event.h>
+#elif defined(__linux__)
+#define ITERM_EVENT_POLLER_EPOLL 1
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#endif
+
+typedef struct {
+    uintptr_t owner;
+    // Value of the poller's generation when this was last registered.
+    unsigned int generation;
+    bool registered;
+    bool read;
+    bool write;
+    // epoll only: removed from the kernel after it hung up with data left while read interest was
+    // off, because epoll reports hangups whether you ask for them or not.
+    bool suspended;
+    // Index into the events being returned by the current wait, plus one; 0 if none.
+    int eventIndex;
+} iTermEventPollerEntry;
+
+struct iTermEventPoller {
+    iTermEventPollerBackend backend;
+    // The kqueue or epoll descriptor; -1 for select.
+    int kernelFD;
+    unsigned int generation;
+    // Indexed by file descriptor.
+    iTermEventPollerEntry *entries;
+    int capacity;
+    // One more than the largest registered file descriptor.
+    int limit;
+};
+
+#pragma mark - Backends
+
+#if ITERM_EVENT_POLLER_KQUEUE
+
+// The read filter is never disabled because a disabled filter doesn't report end of file either.
+// Without read interest it's edge-triggered instead, so data that nobody wants yet is reported
+// once rather than on every wait. EV_CLEAR can't be turned off in place, so changing read interest
+// replaces the filter.
+static bool iTermEventPollerKqueueApply(iTermEventPoller *poller,
+                                        int fd,
+                                        const iTermEventPollerEntry *entry,
+                                        bool add,
+                                        bool readChanged) {
+    struct kevent changes[3];
+    int n = 0;
+    if (readChanged && !add) {
+        EV_SET(&changes[n++], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    }
+    if (readChanged || add) {
+        EV_SET(&changes[n++], fd, EVFILT_READ, EV_ADD | EV_ENABLE | (entry->read ? 0 : EV_CLEAR), 0, 0, NULL);
+    }
+    EV_SET(&changes[n++], fd, EVFILT_WRITE, (add ? EV_ADD : 0) | (entry->write ? EV_ENABLE : EV_DISABLE), 0, 0, NULL);
+    return kevent(poller->kernelFD, changes, n, NULL, 0, NULL) == 0;
+}
+
+static void iTermEventPollerKqueueRemove(iTermEventPoller *poller, int fd) {
+    // Closing a descriptor removes its filters, so these may fail harmlessly. Delete them one at a
+    // time so one failure doesn't prevent the other.
+    struct kevent change;
+    EV_SET(&change, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    kevent(poller->kernelFD, &change, 1, NULL, 0, NULL);
+    EV_SET(&change, fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    kevent(poller->kernelFD, &change, 1, NULL, 0, NULL);
+}
+
+#endif
+
+#if ITERM_EVENT_POLLER_EPOLL
+
+static bool iTermEventPollerEpollApply(iTermEventPoller *poller, int fd, const iTermEventPollerEntry *entry, bool add) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = (entry->read ? EPOLLIN : 0) | (entry->write ? EPOLLOUT : 0);
+    event.data.fd = fd;
+    return epoll_ctl(poller->kernelFD, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+static void iTermEventPollerEpollRemove(iTermEventPoller *poller, int fd) {
+    struct epoll_event unused;
+    epoll_ctl(poller->kernelFD, EPOLL_CTL_DEL, fd, &unused);
+}
+
+#endif
+
+static bool iTermEventPollerApply(iTermEventPoller *poller,
+                                  int fd,
+                                  const iTermEventPollerEntry *entry,
+                                  bool add,
+                                  bool readChanged) {
+    switch (poller->backend) {
+        case iTermEventPollerBackendKqueue:
+#if ITERM_EVENT_POLLER_KQUEUE
+            return iTermEventPollerKqueueApply(poller, fd, entry, add, readChanged);
+#else
+            return false;
+#endif
+        case iTermEventPollerBackendEpoll:
+#if ITERM_EVENT_POLLER_EPOLL
+            return iTermEventPollerEpollApply(poller, fd, entry, add);
+#else
+            return false;
+#endif
+        case iTermEventPollerBackendSelect:
+            return fd < FD_SETSIZE;
+    }
+    return false;
+}
+
+static void iTermEventPollerRemove(iTermEventPoller *poller, int fd) {
+    iTermEventPollerEntry *entry = &poller->entries[fd];
+    if (!entry->suspended) {
+        switch (poller->backend) {
+            case iTermEventPollerBackendKqueue:
+#if ITERM_EVENT_POLLER_KQUEUE
+                iTermEventPollerKqueueRemove(poller, fd);
+#endif
+                break;
+            case iTermEventPollerBackendEpoll:
+#if ITERM_EVENT_POLLER_EPOLL
+                iTermEventPollerEpollRemove(poller, fd);
+#endif
+                break;
+            case iTermEventPollerBackendSelect:
+                break;
+        }
+    }
+    memset(entry, 0, sizeof(*entry));
+}
+
+#pragma mark - API
+
+iTermEventPoller *iTermEventPollerCreate(void) {
+#if ITERM_EVENT_POLLER_KQUEUE
+    return iTermEventPollerCreateWithBackend(iTermEventPollerBackendKqueue);
+#elif ITERM_EVENT_POLLER_EPOLL
+    return iTermEventPollerCreateWithBackend(iTermEventPollerBackendEpoll);
+#else
+    return iTermEventPollerCreateWithBackend(iTermEventPollerBackendSelect);
+#endif
+}
+
+iTermEventPoller *iTermEventPollerCreateWithBackend(iTermEventPollerBackend backend) {
+    int kernelFD = -1;
+    switch (backend) {
+        case iTermEventPollerBackendKqueue:
+#if ITERM_EVENT_POLLER_KQUEUE
+            kernelFD = kqueue();
+            break;
+#else
+            return NULL;
+#endif
+        case iTermEventPollerBackendEpoll:
+#if ITERM_EVENT_POLLER_EPOLL
+            kernelFD = epoll_create1(EPOLL_CLOEXEC);
+            break;
+#else
+            return NULL;
+#endif
+        case iTermEventPollerBackendSelect:
+            break;
+    }
+    if (backend != iTermEventPollerBackendSelect && kernelFD < 0) {
+        return NULL;
+    }
+    iTermEventPoller *poller = calloc(1, sizeof(*poller));
+    poller->backend = backend;
+    poller->kernelFD = kernelFD;
+    return poller;
+}
+
+iTermEventPollerBackend iTermEventPollerGetBackend(const iTermEventPoller *poller) {
+    return poller->backend;
+}
+
+void iTermEventPollerBeginUpdate(iTermEventPoller *poller) {
+    poller->generation++;
+}
+
+void iTermEventPollerEndUpdate(iTermEventPoller *poller) {
+    int limit = 0;
+    for (int fd = 0; fd < poller->limit; fd++) {
+        iTermEventPollerEntry *entry = &poller->entries[fd];
+        if (!entry->registered) {
+            continue;
+        }
+        if (entry->generation != poller->generation) {
+            iTermEventPollerRemove(poller, fd);
+        } else {
+            limit = fd + 1;
+        }
+    }
+    poller->limit = limit;
+}
+
+bool iTermEventPollerSetInterest(iTermEventPoller *poller,
+                                 int fd,
+                                 uintptr_t owner,
+                                 bool read,
+                                 bool write) {
+    if (fd < 0) {
+        return false;
+    }
+    if (fd >= poller->capacity) {
+        int capacity = poller->capacity ? poller->capacity : 64;
+        while (capacity <= fd) {
+            capacity *= 2;
+        }
+        poller->entries = realloc(poller->entries, sizeof(*poller->entries) * capacity);
+        memset(poller->entries + poller->capacity, 0, sizeof(*poller->entries) * (capacity - poller->capacity));
+        poller->capacity = capacity;
+    }
+    iTermEventPollerEntry *entry = &poller->entries[fd];
+    if (entry->registered && entry->owner != owner) {
+        // The descriptor was closed and its number reused.
+        iTermEventPollerRemove(poller, fd);
+    }
+    entry->generation = poller->generation;
+    if (entry->registered && entry->read == read && entry->write == write) {
+        return true;
+    }
+    if (entry->suspended) {
+        if (!read) {
+            entry->write = write;
+            return true;
+        }
+        entry->suspended = false;
+        entry->registered = false;
+    }
+    const bool add = !entry->registered;
+    const bool readChanged = entry->read != read;
+    entry->read = read;
+    entry->write = write;
+    if (!iTermEventPollerApply(poller, fd, entry, add, readChanged)) {
+        memset(entry, 0, sizeof(*entry));
+        return false;
+    }
+    entry->owner = owner;
+    entry->registered = true;
+    entry->generation = poller->generation;
+    if (fd >= poller->limit) {
+        poller->limit = fd + 1;
+    }
+    return true;
+}
+
+static int iTermEventPollerWaitSelect(iTermEventPoller *poller,
+                                      iTermEventPollerEvent *events,
+                                      int capacity,
+                                      int timeoutMS) {
+    fd_set rfds;
+    fd_set wfds;
+    fd_set efds;
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    FD_ZERO(&efds);
+    int highfd = -1;
+    for (int fd = 0; fd < poller->limit; fd++) {
+        const iTermEventPollerEntry *entry = &poller->entries[fd];
+        if (!entry->registered) {
+            continue;
+        }
+        if (entry->read) {
+            FD_SET(fd, &rfds);
+        }
+        if (entry->write) {
+            FD_SET(fd, &wfds);
+        }
+        FD_SET(fd, &efds);
+        highfd = fd;
+    }
+    struct timeval timeout = { timeoutMS / 1000, (timeoutMS % 1000) * 1000 };
+    if (select(highfd + 1, &rfds, &wfds, &efds, timeoutMS < 0 ? NULL : &timeout) < 0) {
+        return -1;
+    }
+    int count = 0;
+    for (int fd = 0; fd <= highfd && count < capacity; fd++) {
+        const bool r = FD_ISSET(fd, &rfds);
+        const bool w = FD_ISSET(fd, &wfds);
+        const bool e = FD_ISSET(fd, &efds);
+        if (r || w || e) {
+            events[count++] = (iTermEventPollerEvent){ .fd = fd, .readable = r, .writable = w, .error = e };
+        }
+    }
+    return count;
+}
+
+#if ITERM_EVENT_POLLER_KQUEUE
+// Returns the event for |fd| in |events|, adding it if needed. Returns NULL if there's no room.
+static iTermEventPollerEvent *iTermEventPollerEventForFD(iTermEventPoller *poller,
+                                                         int fd,
+                                                         iTermEventPollerEvent *events,
+                                                         int capacity,
+                                                         int *countPtr) {
+    iTermEventPollerEntry *entry = &poller->entries[fd];
+    if (entry->eventIndex) {
+        return &events[entry->eventIndex - 1];
+    }
+    if (*countPtr == capacity) {
+        return NULL;
+    }
+    iTermEventPollerEvent *event = &events[*countPtr];
+    memset(event, 0, sizeof(*event));
+    event->fd = fd;
+    *countPtr += 1;
+    entry->eventIndex = *countPtr;
+    return event;
+}
+
+static int iTermEventPollerWaitKqueue(iTermEventPoller *poller,
+                                      iTermEventPollerEvent *events,
+                                      int capacity,
+                                      int timeoutMS) {
+    struct kevent kevents[capacity];
+    const struct timespec timeout = { timeoutMS / 1000, (timeoutMS % 1000) * 1000000L };
+    const int n = kevent(poller->kernelFD, NULL, 0, kevents, capacity, timeoutMS < 0 ? NULL : &timeout);
+    if (n < 0) {
+        return -1;
+    }
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        const int fd = (int)kevents[i].ident;
+        if (fd >= poller->limit || !poller->entries[fd].registered) {
+            continue;
+        }
+        // At end of file, report readable while data remains so none is lost.
+        const bool hungUp = (kevents[i].flags & EV_EOF) && kevents[i].data == 0;
+        if (kevents[i].filter == EVFILT_READ &&
+            !(kevents[i].flags & EV_ERROR) &&
+            !hungUp &&
+            !poller->entries[fd].read) {
+            // Nobody wants the data yet. It gets reported when the filter is replaced.
+            continue;
+        }
+        iTermEventPollerEvent *event = iTermEventPollerEventForFD(poller, fd, events, capacity, &count);
+        if (!event) {
+            break;
+        }
+        if (kevents[i].flags & EV_ERROR) {
+            event->error = true;
+        } else if (kevents[i].filter == EVFILT_READ) {
+            if (hungUp) {
+                event->error = true;
+            } else {
+                event->readable = true;
+            }
+        } else if (kevents[i].filter == EVFILT_WRITE) {
+            event->writable = true;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        poller->entries[events[i].fd].eventIndex = 0;
+    }
+    return count;
+}
+#endif
+
+#if ITERM_EVENT_POLLER_EPOLL
+static int iTermEventPollerWaitEpoll(iTermEventPoller *poller,
+                                     iTermEventPollerEvent *events,
+                                     int capacity,
+                                     int timeoutMS) {
+    struct epoll_event epollEvents[capacity];
+    const int n = epoll_wait(poller->kernelFD, epollEvents, capacity, timeoutMS);
+    if (n < 0) {
+        return -1;
+    }
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        const int fd = epollEvents[i].data.fd;
+        const uint32_t flags = epollEvents[i].events;
+        if (fd >= poller->limit || !poller->entries[fd].registered) {
+            continue;
+        }
+        iTermEventPollerEntry *entry = &poller->entries[fd];
+        bool hungUp = (flags & EPOLLHUP) && !(flags & EPOLLIN);
+        if (hungUp && !entry->read) {
+            // EPOLLIN is only reported with read interest, so ask whether data is left.
+            int available = 0;
+            hungUp = ioctl(fd, FIONREAD, &available) == 0 && available == 0;
+        }
+        if ((flags & EPOLLHUP) && !hungUp && !entry->read) {
+            // Nobody wants to read the data that's left yet. Stop listening until they do or this
+            // would be reported on every wait.
+            iTermEventPollerEpollRemove(poller, fd);
+            entry->suspended = true;
+            continue;
+        }
+        events[count++] = (iTermEventPollerEvent){
+            .fd = fd,
+            .readable = entry->read && (flags & EPOLLIN),
+            .writable = !!(flags & EPOLLOUT),
+            .error = (flags & EPOLLERR) || hungUp
+        };
+    }
+    return count;
+}
+#endif
+
+int iTermEventPollerWait(iTermEventPoller *poller,
+                         iTermEventPollerEvent *events,
+                         int capacity,
+                         int timeoutMS) {
+    if (capacity <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    switch (poller->backend) {
+        case iTermEventPollerBackendKqueue:
+#if ITERM_EVENT_POLLER_KQUEUE
+            return iTermEventPollerWaitKqueue(poller, events, capacity, timeoutMS);
+#else
+            break;
+#endif
+        case iTermEventPollerBackendEpoll:
+#if ITERM_EVENT_POLLER_EPOLL
+            return iTermEventPollerWaitEpoll(poller, events, capacity, timeoutMS);
+#else
+            break;
+#endif
+        case iTermEventPollerBackendSelect:
+            return iTermEventPollerWaitSelect(poller, events, capacity, timeoutMS);
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+void iTermEventPollerFree(iTermEventPoller *poller) {
+    if (!poller) {
+        return;
+    }
+    if (poller->kernelFD >= 0) {
+        close(poller->kernelFD);
+    }
+    free(poller->entries);
+    free(poller);
+}
@@ -0,0 +1,86 @@
+//
+//  iTermEventPoller.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Waits for file descriptors to become readable or writable, for TaskNotifier.
+//  Registrations persist between waits and the kernel is only told about
+//  changes in interest, so the cost of a wait depends on how many descriptors
+//  are ready rather than how many are registered. Uses kqueue where available,
+//  epoll on Linux, and select() otherwise (which is subject to FD_SETSIZE).
+//  Plain C with no Foundation dependency so it can be benchmarked anywhere
+//  (see tests/task_notifier_bench.c).
+//
+
+#ifndef iTermEventPoller_h
+#define iTermEventPoller_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    iTermEventPollerBackendKqueue,
+    iTermEventPollerBackendEpoll,
+    iTermEventPollerBackendSelect
+} iTermEventPollerBackend;
+
+typedef struct {
+    int fd;
+    bool readable;
+    bool writable;
+    // The descriptor hung up with no data left to read, or has an error. With kqueue and epoll
+    // this is reported even without read interest. select() only notices a hangup when asked
+    // to read.
+    bool error;
+} iTermEventPollerEvent;
+
+typedef struct iTermEventPoller iTermEventPoller;
+
+// Creates a poller using the best backend for the platform. Returns NULL on
+// failure.
+iTermEventPoller *iTermEventPollerCreate(void);
+
+// Creates a poller with a specific backend. Returns NULL if it's not available.
+iTermEventPoller *iTermEventPollerCreateWithBackend(iTermEventPollerBackend backend);
+
+iTermEventPollerBackend iTermEventPollerGetBackend(const iTermEventPoller *poller);
+
+// Registrations made between these two calls are kept. Any descriptor that was
+// registered before the begin call but not again before the end call is
+// removed. This lets the caller describe the full set of descriptors it cares
+// about each time without worrying about what changed.
+void iTermEventPollerBeginUpdate(iTermEventPoller *poller);
+void iTermEventPollerEndUpdate(iTermEventPoller *poller);
+
+// Registers |fd| with the given interest. Does nothing if the interest and
+// owner haven't changed. |owner| identifies the object the descriptor belongs
+// to: if a descriptor is closed and its number reused by a different owner, it
+// is registered afresh. The caller must keep owners alive while they're
+// registered so their identities aren't reused. Returns false if the
+// descriptor can't be watched.
+bool iTermEventPollerSetInterest(iTermEventPoller *poller,
+                                 int fd,
+                                 uintptr_t owner,
+                                 bool read,
+                                 bool write);
+
+// Waits until at least one registered descriptor is ready, or for |timeoutMS|
+// milliseconds if it is not negative. Returns the number of events stored in
+// |events| (at most |capacity|), or -1 on error with errno set.
+int iTermEventPollerWait(iTermEventPoller *poller,
+                         iTermEventPollerEvent *events,
+                         int capacity,
+                         int timeoutMS);
+
+void iTermEventPollerFree(iTermEventPoller *poller);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermEventPoller_h
@@ -13,6 +13,7 @@
 #import "iTermCommandRunner.h"
 #import "iTermCommandRunnerPool.h"
 #import "iTermGitCache.h"
+#import "iTermGitStatusEngine.h"
 #import "iTermTuple.h"
 #import "NSArray+iTerm.h"
 #import "NSStringITerm.h"
@@ -81,6 +82,7 @@ typedef void (^iTermGitCallback)(iTermGitState * _Nullable);
 - (void)invalidateCacheForPath:(NSString *)path {
     DLog(@"git poll worker for bucket %d: remove cache entry for path %@", _bucket, path);
     [_cache removeStateForPath:path];
+    [[iTermGitStatusEngine sharedInstance] invalidateCacheForPath:path];
 }
 
 - (NSDictionary<NSString *, NSString *> *)environment {
@@ -98,6 +100,23 @@ typedef void (^iTermGitCallback)(iTermGitState * _Nullable);
 
 - (void)requestPath:(NSString *)path completion:(iTermGitCallback)completion {
     DLog(@"git poll worker for bucket %d: got request for path %@", _bucket, path);
+    if (![iTermAdvancedSettingsModel computeGitStatusInProcess]) {
+        [self runScriptForPath:path completion:completion];
+        return;
+    }
+    __weak __typeof(self) weakSelf = self;
+    const int bucket = _bucket;
+    [[iTermGitStatusEngine sharedInstance] requestPath:path completion:^(iTermGitState * _Nullable state) {
+        if (state) {
+            completion(state);
+            return;
+        }
+        DLog(@"git poll worker for bucket %d: in-process status unavailable for %@. Run the script.", bucket, path);
+        [weakSelf runScriptForPath:path completion:completion];
+    }];
+}
+
+- (void)runScriptForPath:(NSString *)path completion:(iTermGitCallback)completion {
     // This age limits the polling rate. If an older cache entry is around it will still be used
     // until expiry when the poll command fails.
     iTermGitState *cached = [_cache stateForPath:path maximumAge:[iTermAdvancedSettingsModel gitTimeout]];
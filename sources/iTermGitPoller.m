@@ -10,6 +10,7 @@
 #import "DebugLogging.h"
 #import "iTermGitPollWorker.h"
 #import "iTermGitState.h"
+#import "iTermGitStatusEngine.h"
 #import "iTermRateLimitedUpdate.h"
 #import "NSTimer+iTerm.h"
 
@@ -17,6 +18,8 @@ NS_ASSUME_NONNULL_BEGIN
 
 @implementation iTermGitPoller {
     iTermRateLimitedUpdate *_rateLimit;
+    // Limits how often a busy repository (e.g., during a build) causes a poll.
+    iTermRateLimitedUpdate *_repositoryChangeRateLimit;
     NSTimer *_timer;
     NSDate *_lastPollTime;
     void (^_update)(void);
@@ -27,15 +30,22 @@ NS_ASSUME_NONNULL_BEGIN
     if (self) {
         _rateLimit = [[iTermRateLimitedUpdate alloc] init];
         _rateLimit.minimumInterval = 0.5;
+        _repositoryChangeRateLimit = [[iTermRateLimitedUpdate alloc] init];
+        _repositoryChangeRateLimit.minimumInterval = 1;
         _cadence = cadence;
         _update = [update copy];
         [self startTimer];
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(repositoryDidChange:)
+                                                     name:iTermGitStatusEngineRepositoryDidChangeNotification
+                                                   object:nil];
     }
     return self;
 }
 
 - (void)dealloc {
     [_timer invalidate];
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
 }
 
 - (NSString *)description {
@@ -102,6 +112,18 @@ NS_ASSUME_NONNULL_BEGIN
     }];
 }
 
+- (void)repositoryDidChange:(NSNotification *)notification {
+    NSArray<NSString *> *paths = notification.userInfo[iTermGitStatusEngineInvalidatedPathsKey];
+    if (!_currentDirectory || ![paths containsObject:_currentDirectory]) {
+        return;
+    }
+    DLog(@"%@: Repository changed", self);
+    __weak __typeof(self) weakSelf = self;
+    [_repositoryChangeRateLimit performRateLimitedBlock:^{
+        [weakSelf bump];
+    }];
+}
+
 - (void)didPollWithUpdatedState:(iTermGitState *)state {
     self.state = state;
 }
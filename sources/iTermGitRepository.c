@@ -0,0 +1,2347 @@
+//
+//  iTermGitRepository.c
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#include "iTermGitRepository.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef __APPLE__
+#define ITERM_GIT_MTIME(st) ((st)->st_mtimespec)
+#define ITERM_GIT_CTIME(st) ((st)->st_ctimespec)
+#else
+#define ITERM_GIT_MTIME(st) ((st)->st_mtim)
+#define ITERM_GIT_CTIME(st) ((st)->st_ctim)
+#endif
+
+enum {
+    iTermGitObjectTypeCommit = 1,
+    iTermGitObjectTypeTree = 2,
+    iTermGitObjectTypeBlob = 3,
+    iTermGitObjectTypeTag = 4,
+    iTermGitObjectTypeOffsetDelta = 6,
+    iTermGitObjectTypeReferenceDelta = 7
+};
+
+// Delta chains are limited to 50 by default when packing.
+#define ITERM_GIT_MAXIMUM_DELTA_DEPTH 100
+
+// Tracked files are checked in chunks of this many index entries.
+#define ITERM_GIT_INDEX_CHUNK_SIZE 256
+
+typedef struct {
+    const uint8_t *index;
+    size_t indexLength;
+    const uint8_t *pack;
+    size_t packLength;
+    uint32_t count;
+} iTermGitPack;
+
+struct iTermGitRepository {
+    char *workTree;
+    // The directory passed to iTermGitRepositoryOpen() relative to the work tree, with a trailing
+    // slash unless it's empty.
+    char *prefix;
+    char *gitDirectory;
+    char *commonDirectory;
+
+    iTermGitPack *packs;
+    int numberOfPacks;
+
+    // Set if config or attributes can make the work tree's bytes differ from what's hashed into
+    // the index (line ending conversion, clean filters), so a hash mismatch doesn't prove a change.
+    bool contentMayBeFiltered;
+
+    // Set if the repository format needs something this doesn't implement, like reftable refs or
+    // SHA-256 objects. Everything is reported as unknown.
+    bool unsupported;
+};
+
+#pragma mark - Utilities
+
+static uint32_t iTermGitReadBigEndian32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t iTermGitReadBigEndian16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static int iTermGitHexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool iTermGitParseObjectID(const char *hex, uint8_t oid[20]) {
+    for (int i = 0; i < 20; i++) {
+        const int high = iTermGitHexValue(hex[i * 2]);
+        const int low = high < 0 ? -1 : iTermGitHexValue(hex[i * 2 + 1]);
+        if (low < 0) {
+            return false;
+        }
+        oid[i] = (uint8_t)((high << 4) | low);
+    }
+    return true;
+}
+
+void iTermGitFormatObjectID(const uint8_t oid[20], char hex[41]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 20; i++) {
+        hex[i * 2] = digits[oid[i] >> 4];
+        hex[i * 2 + 1] = digits[oid[i] & 15];
+    }
+    hex[40] = '\0';
+}
+
+// Reads a whole (small) file into a NUL-terminated buffer.
+static char *iTermGitReadFile(const char *path, size_t *lengthPtr) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+    char *buffer = malloc((size_t)st.st_size + 1);
+    size_t length = 0;
+    while (length < (size_t)st.st_size) {
+        const ssize_t n = read(fd, buffer + length, (size_t)st.st_size - length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        length += (size_t)n;
+    }
+    close(fd);
+    buffer[length] = '\0';
+    if (lengthPtr) {
+        *lengthPtr = length;
+    }
+    return buffer;
+}
+
+static void iTermGitTrimTrailingWhitespace(char *s) {
+    size_t length = strlen(s);
+    while (length > 0 && isspace((unsigned char)s[length - 1])) {
+        s[--length] = '\0';
+    }
+}
+
+static char *iTermGitJoinPath(const char *directory, const char *name) {
+    if (name[0] == '/') {
+        return strdup(name);
+    }
+    const size_t length = strlen(directory) + strlen(name) + 2;
+    char *result = malloc(length);
+    snprintf(result, length, "%s/%s", directory, name);
+    return result;
+}
+
+#pragma mark - SHA-1
+
+typedef struct {
+    uint32_t state[5];
+    uint64_t length;
+    uint8_t buffer[64];
+    size_t used;
+} iTermGitSHA1;
+
+#define ITERM_GIT_ROTATE(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void iTermGitSHA1Block(iTermGitSHA1 *sha, const uint8_t *block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = iTermGitReadBigEndian32(block + i * 4);
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = ITERM_GIT_ROTATE(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = sha->state[0], b = sha->state[1], c = sha->state[2], d = sha->state[3], e = sha->state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        const uint32_t temp = ITERM_GIT_ROTATE(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ITERM_GIT_ROTATE(b, 30);
+        b = a;
+        a = temp;
+    }
+    sha->state[0] += a;
+    sha->state[1] += b;
+    sha->state[2] += c;
+    sha->state[3] += d;
+    sha->state[4] += e;
+}
+
+static void iTermGitSHA1Init(iTermGitSHA1 *sha) {
+    sha->state[0] = 0x67452301;
+    sha->state[1] = 0xefcdab89;
+    sha->state[2] = 0x98badcfe;
+    sha->state[3] = 0x10325476;
+    sha->state[4] = 0xc3d2e1f0;
+    sha->length = 0;
+    sha->used = 0;
+}
+
+static void iTermGitSHA1Update(iTermGitSHA1 *sha, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    sha->length += length;
+    while (length > 0) {
+        const size_t n = 64 - sha->used < length ? 64 - sha->used : length;
+        memcpy(sha->buffer + sha->used, bytes, n);
+        sha->used += n;
+        bytes += n;
+        length -= n;
+        if (sha->used == 64) {
+            iTermGitSHA1Block(sha, sha->buffer);
+            sha->used = 0;
+        }
+    }
+}
+
+static void iTermGitSHA1Final(iTermGitSHA1 *sha, uint8_t digest[20]) {
+    const uint64_t bits = sha->length * 8;
+    const uint8_t pad = 0x80;
+    const uint8_t zero = 0;
+    iTermGitSHA1Update(sha, &pad, 1);
+    while (sha->used != 56) {
+        iTermGitSHA1Update(sha, &zero, 1);
+    }
+    uint8_t lengthBytes[8];
+    for (int i = 0; i < 8; i++) {
+        lengthBytes[i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+    iTermGitSHA1Update(sha, lengthBytes, 8);
+    for (int i = 0; i < 5; i++) {
+        digest[i * 4] = (uint8_t)(sha->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(sha->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(sha->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)sha->state[i];
+    }
+}
+
+#pragma mark - Config
+
+// Finds the last value of section[.subsection].key in a config file. Section and key names are
+// case-insensitive; subsections aren't. Includes aren't followed.
+static bool iTermGitConfigGet(const char *path,
+                              const char *section,
+                              const char *subsection,
+                              const char *key,
+                              char *value,
+                              size_t valueSize) {
+    char *contents = iTermGitReadFile(path, NULL);
+    if (!contents) {
+        return false;
+    }
+    bool found = false;
+    bool inSection = false;
+    char *saveptr = NULL;
+    for (char *line = strtok_r(contents, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr)) {
+        while (isspace((unsigned char)*line)) {
+            line++;
+        }
+        if (*line == '[') {
+            // [section] or [section "subsection"]
+            char *end = strchr(line, ']');
+            if (!end) {
+                inSection = false;
+                continue;
+            }
+            *end = '\0';
+            char *name = line + 1;
+            char *quote = strchr(name, '"');
+            char *sub = NULL;
+            if (quote) {
+                sub = quote + 1;
+                char *closeQuote = strrchr(sub, '"');
+                if (closeQuote) {
+                    *closeQuote = '\0';
+                }
+                *quote = '\0';
+            }
+            iTermGitTrimTrailingWhitespace(name);
+            inSection = (!strcasecmp(name, section) &&
+                         ((!subsection && !sub) || (subsection && sub && !strcmp(sub, subsection))));
+            continue;
+        }
+        if (!inSection || *line == '#' || *line == ';') {
+            continue;
+        }
+        char *equals = strchr(line, '=');
+        if (!equals) {
+            continue;
+        }
+        *equals = '\0';
+        iTermGitTrimTrailingWhitespace(line);
+        if (strcasecmp(line, key)) {
+            continue;
+        }
+        char *v = equals + 1;
+        while (isspace((unsigned char)*v)) {
+            v++;
+        }
+        // Drop a trailing comment and surrounding quotes.
+        bool quoted = false;
+        char *out = v;
+        for (char *p = v; *p; p++) {
+            if (*p == '"') {
+                quoted = !quoted;
+                continue;
+            }
+            if (!quoted && (*p == '#' || *p == ';')) {
+                break;
+            }
+            if (*p == '\\' && p[1]) {
+                p++;
+            }
+            *out++ = *p;
+        }
+        *out = '\0';
+        iTermGitTrimTrailingWhitespace(v);
+        snprintf(value, valueSize, "%s", v);
+        found = true;
+    }
+    free(contents);
+    return found;
+}
+
+// Is there any key in |section| (without a subsection)? Used for [extensions], where git refuses
+// to touch a repository that has one it doesn't know.
+static bool iTermGitConfigHasKeyInSection(const char *path, const char *section) {
+    char *contents = iTermGitReadFile(path, NULL);
+    if (!contents) {
+        return false;
+    }
+    bool found = false;
+    bool inSection = false;
+    char *saveptr = NULL;
+    for (char *line = strtok_r(contents, "\n", &saveptr); line && !found; line = strtok_r(NULL, "\n", &saveptr)) {
+        while (isspace((unsigned char)*line)) {
+            line++;
+        }
+        if (*line == '[') {
+            char *end = strchr(line, ']');
+            if (!end) {
+                inSection = false;
+                continue;
+            }
+            *end = '\0';
+            char *name = line + 1;
+            iTermGitTrimTrailingWhitespace(name);
+            inSection = !strcasecmp(name, section);
+            continue;
+        }
+        // A bare key is a boolean true, so anything that isn't blank or a comment counts.
+        found = inSection && *line && *line != '#' && *line != ';';
+    }
+    free(contents);
+    return found;
+}
+
+static char *iTermGitExpandTilde(const char *path) {
+    if (path[0] == '~' && path[1] == '/') {
+        const char *home = getenv("HOME");
+        if (home) {
+            return iTermGitJoinPath(home, path + 2);
+        }
+    }
+    return strdup(path);
+}
+
+// Where the user's global config and excludes live. Returns NULL if HOME is unset.
+static char *iTermGitUserConfigPath(const char *name, bool xdg) {
+    const char *home = getenv("HOME");
+    if (xdg) {
+        const char *configHome = getenv("XDG_CONFIG_HOME");
+        char buffer[PATH_MAX];
+        if (configHome && configHome[0]) {
+            snprintf(buffer, sizeof(buffer), "%s/git/%s", configHome, name);
+        } else if (home) {
+            snprintf(buffer, sizeof(buffer), "%s/.config/git/%s", home, name);
+        } else {
+            return NULL;
+        }
+        return strdup(buffer);
+    }
+    return home ? iTermGitJoinPath(home, name) : NULL;
+}
+
+// Looks a key up in the repository's config, then the user's.
+static bool iTermGitRepositoryConfigGet(const iTermGitRepository *repository,
+                                        const char *section,
+                                        const char *subsection,
+                                        const char *key,
+                                        char *value,
+                                        size_t valueSize) {
+    char *path = iTermGitJoinPath(repository->commonDirectory, "config");
+    bool found = iTermGitConfigGet(path, section, subsection, key, value, valueSize);
+    free(path);
+    if (found) {
+        return true;
+    }
+    const bool xdgOptions[] = { false, true };
+    for (int i = 0; i < 2 && !found; i++) {
+        path = iTermGitUserConfigPath(xdgOptions[i] ? "config" : ".gitconfig", xdgOptions[i]);
+        if (path) {
+            found = iTermGitConfigGet(path, section, subsection, key, value, valueSize);
+            free(path);
+        }
+    }
+    return found;
+}
+
+#pragma mark - Opening
+
+static void iTermGitRepositoryLoadPacks(iTermGitRepository *repository) {
+    char *packDirectory = iTermGitJoinPath(repository->commonDirectory, "objects/pack");
+    DIR *dir = opendir(packDirectory);
+    if (!dir) {
+        free(packDirectory);
+        return;
+    }
+    int capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        const size_t length = strlen(entry->d_name);
+        if (length < 5 || strcmp(entry->d_name + length - 4, ".idx")) {
+            continue;
+        }
+        char *indexPath = iTermGitJoinPath(packDirectory, entry->d_name);
+        char *packPath = strdup(indexPath);
+        strcpy(packPath + strlen(packPath) - 4, ".pack");
+
+        iTermGitPack pack = { 0 };
+        const int indexFD = open(indexPath, O_RDONLY | O_CLOEXEC);
+        const int packFD = open(packPath, O_RDONLY | O_CLOEXEC);
+        struct stat indexStat, packStat;
+        if (indexFD >= 0 && packFD >= 0 &&
+            fstat(indexFD, &indexStat) == 0 && fstat(packFD, &packStat) == 0 &&
+            indexStat.st_size >= 8 + 256 * 4 && packStat.st_size >= 12) {
+            void *indexMap = mmap(NULL, (size_t)indexStat.st_size, PROT_READ, MAP_PRIVATE, indexFD, 0);
+            void *packMap = mmap(NULL, (size_t)packStat.st_size, PROT_READ, MAP_PRIVATE, packFD, 0);
+            if (indexMap != MAP_FAILED && packMap != MAP_FAILED) {
+                pack.index = indexMap;
+                pack.indexLength = (size_t)indexStat.st_size;
+                pack.pack = packMap;
+                pack.packLength = (size_t)packStat.st_size;
+            } else {
+                if (indexMap != MAP_FAILED) {
+                    munmap(indexMap, (size_t)indexStat.st_size);
+                }
+                if (packMap != MAP_FAILED) {
+                    munmap(packMap, (size_t)packStat.st_size);
+                }
+            }
+        }
+        if (indexFD >= 0) {
+            close(indexFD);
+        }
+        if (packFD >= 0) {
+            close(packFD);
+        }
+        free(indexPath);
+        free(packPath);
+
+        // Only version 2 indexes ("\377tOc" 2) are supported; git hasn't written version 1 since
+        // 2008.
+        if (pack.index &&
+            !memcmp(pack.index, "\377tOc", 4) &&
+            iTermGitReadBigEndian32(pack.index + 4) == 2) {
+            pack.count = iTermGitReadBigEndian32(pack.index + 8 + 255 * 4);
+            if (8 + 256 * 4 + (size_t)pack.count * 28 <= pack.indexLength) {
+                if (repository->numberOfPacks == capacity) {
+                    capacity = capacity ? capacity * 2 : 4;
+                    repository->packs = realloc(repository->packs, sizeof(iTermGitPack) * (size_t)capacity);
+                }
+                repository->packs[repository->numberOfPacks++] = pack;
+                continue;
+            }
+        }
+        if (pack.index) {
+            munmap((void *)pack.index, pack.indexLength);
+            munmap((void *)pack.pack, pack.packLength);
+        }
+    }
+    closedir(dir);
+    free(packDirectory);
+}
+
+static bool iTermGitAttributesMayFilter(const char *path) {
+    char *contents = iTermGitReadFile(path, NULL);
+    if (!contents) {
+        return false;
+    }
+    const bool result = (strstr(contents, "filter") || strstr(contents, "eol") ||
+                         strstr(contents, "text") || strstr(contents, "ident"));
+    free(contents);
+    return result;
+}
+
+static void iTermGitRepositoryCheckForFilters(iTermGitRepository *repository) {
+    char value[64];
+    if (iTermGitRepositoryConfigGet(repository, "core", NULL, "autocrlf", value, sizeof(value)) &&
+        strcasecmp(value, "false")) {
+        repository->contentMayBeFiltered = true;
+        return;
+    }
+    char *path = iTermGitJoinPath(repository->workTree, ".gitattributes");
+    repository->contentMayBeFiltered = iTermGitAttributesMayFilter(path);
+    free(path);
+    if (!repository->contentMayBeFiltered) {
+        path = iTermGitJoinPath(repository->commonDirectory, "info/attributes");
+        repository->contentMayBeFiltered = iTermGitAttributesMayFilter(path);
+        free(path);
+    }
+}
+
+// Like git's check_repository_format(): version 0 ignores extensions, version 1 requires all of
+// them to be understood, and nothing later exists. None are implemented here, so any extension
+// means git has to be run.
+static bool iTermGitRepositoryFormatIsSupported(const iTermGitRepository *repository) {
+    char *path = iTermGitJoinPath(repository->commonDirectory, "config");
+    char value[64];
+    bool supported = true;
+    if (iTermGitConfigGet(path, "core", NULL, "repositoryformatversion", value, sizeof(value))) {
+        const long version = strtol(value, NULL, 10);
+        if (version > 1) {
+            supported = false;
+        } else if (version == 1) {
+            supported = !iTermGitConfigHasKeyInSection(path, "extensions");
+        }
+    }
+    free(path);
+    return supported;
+}
+
+// Replaces a path with its canonical form so it compares equal to paths reported by file system
+// events. Leaves it alone if it can't be resolved.
+static char *iTermGitResolvePath(char *path) {
+    char resolved[PATH_MAX];
+    if (!realpath(path, resolved)) {
+        return path;
+    }
+    free(path);
+    return strdup(resolved);
+}
+
+// If |directory|/.git is a repository, returns its git directory.
+static char *iTermGitDirectoryIn(const char *directory) {
+    char *dotGit = iTermGitJoinPath(directory, ".git");
+    struct stat st;
+    if (stat(dotGit, &st) != 0) {
+        free(dotGit);
+        return NULL;
+    }
+    char *gitDirectory = NULL;
+    if (S_ISDIR(st.st_mode)) {
+        gitDirectory = dotGit;
+        dotGit = NULL;
+    } else if (S_ISREG(st.st_mode)) {
+        // A linked work tree or submodule: "gitdir: <path>"
+        char *contents = iTermGitReadFile(dotGit, NULL);
+        if (contents && !strncmp(contents, "gitdir: ", 8)) {
+            iTermGitTrimTrailingWhitespace(contents);
+            gitDirectory = iTermGitJoinPath(directory, contents + 8);
+        }
+        free(contents);
+    }
+    free(dotGit);
+    if (gitDirectory) {
+        char *head = iTermGitJoinPath(gitDirectory, "HEAD");
+        const bool hasHead = access(head, R_OK) == 0;
+        free(head);
+        if (!hasHead) {
+            free(gitDirectory);
+            gitDirectory = NULL;
+        }
+    }
+    return gitDirectory;
+}
+
+iTermGitRepository *iTermGitRepositoryOpen(const char *path) {
+    char directory[PATH_MAX];
+    if (!realpath(path, directory)) {
+        return NULL;
+    }
+    char original[PATH_MAX];
+    memcpy(original, directory, sizeof(original));
+    char *gitDirectory = NULL;
+    while (1) {
+        gitDirectory = iTermGitDirectoryIn(directory);
+        if (gitDirectory) {
+            break;
+        }
+        char *slash = strrchr(directory, '/');
+        if (!slash || slash == directory) {
+            if (slash && directory[1]) {
+                // Try the root itself.
+                directory[1] = '\0';
+                continue;
+            }
+            return NULL;
+        }
+        *slash = '\0';
+    }
+
+    iTermGitRepository *repository = calloc(1, sizeof(*repository));
+    repository->workTree = strdup(directory);
+    const size_t workTreeLength = strlen(directory);
+    const char *relative = original + workTreeLength;
+    while (*relative == '/') {
+        relative++;
+    }
+    const size_t prefixLength = strlen(relative);
+    repository->prefix = malloc(prefixLength + 2);
+    memcpy(repository->prefix, relative, prefixLength + 1);
+    if (prefixLength) {
+        strcpy(repository->prefix + prefixLength, "/");
+    }
+    repository->gitDirectory = iTermGitResolvePath(gitDirectory);
+    gitDirectory = repository->gitDirectory;
+
+    char *commonPath = iTermGitJoinPath(gitDirectory, "commondir");
+    char *common = iTermGitReadFile(commonPath, NULL);
+    free(commonPath);
+    if (common) {
+        iTermGitTrimTrailingWhitespace(common);
+        repository->commonDirectory = iTermGitResolvePath(iTermGitJoinPath(gitDirectory, common));
+        free(common);
+    } else {
+        repository->commonDirectory = strdup(gitDirectory);
+    }
+
+    repository->unsupported = !iTermGitRepositoryFormatIsSupported(repository);
+    if (repository->unsupported) {
+        return repository;
+    }
+    iTermGitRepositoryLoadPacks(repository);
+    iTermGitRepositoryCheckForFilters(repository);
+    return repository;
+}
+
+void iTermGitRepositoryFree(iTermGitRepository *repository) {
+    if (!repository) {
+        return;
+    }
+    for (int i = 0; i < repository->numberOfPacks; i++) {
+        munmap((void *)repository->packs[i].index, repository->packs[i].indexLength);
+        munmap((void *)repository->packs[i].pack, repository->packs[i].packLength);
+    }
+    free(repository->packs);
+    free(repository->workTree);
+    free(repository->prefix);
+    free(repository->gitDirectory);
+    free(repository->commonDirectory);
+    free(repository);
+}
+
+const char *iTermGitRepositoryWorkTree(const iTermGitRepository *repository) {
+    return repository->workTree;
+}
+
+const char *iTermGitRepositoryGitDirectory(const iTermGitRepository *repository) {
+    return repository->gitDirectory;
+}
+
+const char *iTermGitRepositoryCommonDirectory(const iTermGitRepository *repository) {
+    return repository->commonDirectory;
+}
+
+const char *iTermGitRepositoryPrefix(const iTermGitRepository *repository) {
+    return repository->prefix;
+}
+
+#pragma mark - Refs
+
+// Resolves a full ref name like refs/heads/main through loose refs, symbolic refs, and
+// packed-refs.
+static bool iTermGitResolveRef(const iTermGitRepository *repository,
+                               const char *refName,
+                               uint8_t oid[20],
+                               int depth) {
+    if (depth > 5) {
+        return false;
+    }
+    char *path = iTermGitJoinPath(repository->commonDirectory, refName);
+    char *contents = iTermGitReadFile(path, NULL);
+    free(path);
+    if (contents) {
+        iTermGitTrimTrailingWhitespace(contents);
+        bool ok;
+        if (!strncmp(contents, "ref: ", 5)) {
+            ok = iTermGitResolveRef(repository, contents + 5, oid, depth + 1);
+        } else {
+            ok = strlen(contents) >= 40 && iTermGitParseObjectID(contents, oid);
+        }
+        free(contents);
+        return ok;
+    }
+
+    path = iTermGitJoinPath(repository->commonDirectory, "packed-refs");
+    contents = iTermGitReadFile(path, NULL);
+    free(path);
+    if (!contents) {
+        return false;
+    }
+    bool found = false;
+    const size_t refLength = strlen(refName);
+    char *saveptr = NULL;
+    for (char *line = strtok_r(contents, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr)) {
+        if (line[0] == '#' || line[0] == '^' || strlen(line) < 41 + refLength) {
+            continue;
+        }
+        iTermGitTrimTrailingWhitespace(line);
+        if (line[40] == ' ' && !strcmp(line + 41, refName) && iTermGitParseObjectID(line, oid)) {
+            found = true;
+            break;
+        }
+    }
+    free(contents);
+    return found;
+}
+
+bool iTermGitRepositoryReadHead(iTermGitRepository *repository, iTermGitHead *head) {
+    memset(head, 0, sizeof(*head));
+    if (repository->unsupported) {
+        return false;
+    }
+    char *path = iTermGitJoinPath(repository->gitDirectory, "HEAD");
+    char *contents = iTermGitReadFile(path, NULL);
+    free(path);
+    if (!contents) {
+        return false;
+    }
+    iTermGitTrimTrailingWhitespace(contents);
+    if (strncmp(contents, "ref: ", 5)) {
+        // Detached. `git rev-parse --short` gives seven digits unless that's ambiguous.
+        head->detached = true;
+        head->hasHead = strlen(contents) >= 40 && iTermGitParseObjectID(contents, head->head);
+        if (head->hasHead) {
+            char hex[41];
+            iTermGitFormatObjectID(head->head, hex);
+            snprintf(head->branch, sizeof(head->branch), "%.7s", hex);
+        }
+        free(contents);
+        return head->hasHead;
+    }
+    const char *refName = contents + 5;
+    const char *prefix = "refs/heads/";
+    const bool isBranch = !strncmp(refName, prefix, strlen(prefix));
+    snprintf(head->branch, sizeof(head->branch), "%s", isBranch ? refName + strlen(prefix) : refName);
+
+    // The ref lives in the common directory except for per-worktree refs, which HEAD never names.
+    head->hasHead = iTermGitResolveRef(repository, refName, head->head, 0);
+
+    if (isBranch) {
+        char remote[256];
+        char merge[256];
+        if (iTermGitRepositoryConfigGet(repository, "branch", head->branch, "remote", remote, sizeof(remote)) &&
+            iTermGitRepositoryConfigGet(repository, "branch", head->branch, "merge", merge, sizeof(merge))) {
+            char upstreamRef[PATH_MAX];
+            if (!strcmp(remote, ".")) {
+                snprintf(upstreamRef, sizeof(upstreamRef), "%s", merge);
+            } else {
+                const char *mergeBranch = !strncmp(merge, prefix, strlen(prefix)) ? merge + strlen(prefix) : merge;
+                snprintf(upstreamRef, sizeof(upstreamRef), "refs/remotes/%s/%s", remote, mergeBranch);
+            }
+            head->hasUpstream = iTermGitResolveRef(repository, upstreamRef, head->upstream, 0);
+        }
+    }
+    free(contents);
+    return true;
+}
+
+#pragma mark - Objects
+
+// Inflates |length| bytes of zlib data. If |expected| is nonzero exactly that many bytes must
+// come out.
+static uint8_t *iTermGitInflate(const uint8_t *data, size_t length, size_t expected, size_t *outLength) {
+    size_t capacity = expected ? expected : length * 4 + 64;
+    uint8_t *output = malloc(capacity + 1);
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        free(output);
+        return NULL;
+    }
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = (uInt)(length > UINT_MAX ? UINT_MAX : length);
+    size_t produced = 0;
+    int status;
+    do {
+        if (produced == capacity) {
+            if (expected) {
+                break;
+            }
+            capacity *= 2;
+            output = realloc(output, capacity + 1);
+        }
+        stream.next_out = output + produced;
+        stream.avail_out = (uInt)(capacity - produced);
+        status = inflate(&stream, Z_NO_FLUSH);
+        produced = capacity - stream.avail_out;
+    } while (status == Z_OK);
+    inflateEnd(&stream);
+    if (status != Z_STREAM_END || (expected && produced != expected)) {
+        free(output);
+        return NULL;
+    }
+    output[produced] = '\0';
+    *outLength = produced;
+    return output;
+}
+
+static bool iTermGitPackFind(const iTermGitPack *pack, const uint8_t oid[20], uint64_t *offsetPtr) {
+    const uint8_t *fanout = pack->index + 8;
+    uint32_t low = oid[0] ? iTermGitReadBigEndian32(fanout + (oid[0] - 1) * 4) : 0;
+    uint32_t high = iTermGitReadBigEndian32(fanout + oid[0] * 4);
+    const uint8_t *oids = fanout + 256 * 4;
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        const int comparison = memcmp(oids + (size_t)middle * 20, oid, 20);
+        if (comparison == 0) {
+            const uint8_t *offsets = oids + (size_t)pack->count * 24;
+            const uint32_t offset = iTermGitReadBigEndian32(offsets + (size_t)middle * 4);
+            if (offset & 0x80000000) {
+                const uint8_t *large = offsets + (size_t)pack->count * 4 + (size_t)(offset & 0x7fffffff) * 8;
+                if (large + 8 > pack->index + pack->indexLength) {
+                    return false;
+                }
+                *offsetPtr = ((uint64_t)iTermGitReadBigEndian32(large) << 32) | iTermGitReadBigEndian32(large + 4);
+            } else {
+                *offsetPtr = offset;
+            }
+            return true;
+        }
+        if (comparison < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return false;
+}
+
+static uint8_t *iTermGitReadObject(const iTermGitRepository *repository,
+                                   const uint8_t oid[20],
+                                   int *typePtr,
+                                   size_t *lengthPtr,
+                                   int depth);
+
+static uint8_t *iTermGitApplyDelta(const uint8_t *base,
+                                   size_t baseLength,
+                                   const uint8_t *delta,
+                                   size_t deltaLength,
+                                   size_t *outLength) {
+    const uint8_t *p = delta;
+    const uint8_t *end = delta + deltaLength;
+    size_t sizes[2] = { 0, 0 };
+    for (int i = 0; i < 2; i++) {
+        int shift = 0;
+        uint8_t c;
+        do {
+            if (p >= end) {
+                return NULL;
+            }
+            c = *p++;
+            sizes[i] |= (size_t)(c & 0x7f) << shift;
+            shift += 7;
+        } while (c & 0x80);
+    }
+    if (sizes[0] != baseLength) {
+        return NULL;
+    }
+    uint8_t *output = malloc(sizes[1] + 1);
+    size_t produced = 0;
+    while (p < end) {
+        const uint8_t op = *p++;
+        if (op & 0x80) {
+            size_t offset = 0;
+            size_t size = 0;
+            for (int i = 0; i < 4; i++) {
+                if (op & (1 << i)) {
+                    if (p >= end) {
+                        goto fail;
+                    }
+                    offset |= (size_t)*p++ << (i * 8);
+                }
+            }
+            for (int i = 0; i < 3; i++) {
+                if (op & (0x10 << i)) {
+                    if (p >= end) {
+                        goto fail;
+                    }
+                    size |= (size_t)*p++ << (i * 8);
+                }
+            }
+            if (size == 0) {
+                size = 0x10000;
+            }
+            if (offset + size > baseLength || produced + size > sizes[1]) {
+                goto fail;
+            }
+            memcpy(output + produced, base + offset, size);
+            produced += size;
+        } else if (op) {
+            if (p + op > end || produced + op > sizes[1]) {
+                goto fail;
+            }
+            memcpy(output + produced, p, op);
+            p += op;
+            produced += op;
+        } else {
+            goto fail;
+        }
+    }
+    if (produced != sizes[1]) {
+        goto fail;
+    }
+    output[produced] = '\0';
+    *outLength = produced;
+    return output;
+
+fail:
+    free(output);
+    return NULL;
+}
+
+static uint8_t *iTermGitReadPackedObject(const iTermGitRepository *repository,
+                                         const iTermGitPack *pack,
+                                         uint64_t offset,
+                                         int *typePtr,
+                                         size_t *lengthPtr,
+                                         int depth) {
+    if (depth > ITERM_GIT_MAXIMUM_DELTA_DEPTH || offset >= pack->packLength) {
+        return NULL;
+    }
+    const uint8_t *p = pack->pack + offset;
+    const uint8_t *end = pack->pack + pack->packLength;
+    uint8_t c = *p++;
+    const int type = (c >> 4) & 7;
+    size_t size = c & 15;
+    int shift = 4;
+    while (c & 0x80) {
+        if (p >= end) {
+            return NULL;
+        }
+        c = *p++;
+        size |= (size_t)(c & 0x7f) << shift;
+        shift += 7;
+    }
+    if (type == iTermGitObjectTypeOffsetDelta || type == iTermGitObjectTypeReferenceDelta) {
+        int baseType = 0;
+        size_t baseLength = 0;
+        uint8_t *base = NULL;
+        if (type == iTermGitObjectTypeOffsetDelta) {
+            if (p >= end) {
+                return NULL;
+            }
+            c = *p++;
+            uint64_t distance = c & 0x7f;
+            while (c & 0x80) {
+                if (p >= end) {
+                    return NULL;
+                }
+                c = *p++;
+                distance = ((distance + 1) << 7) | (c & 0x7f);
+            }
+            if (distance > offset) {
+                return NULL;
+            }
+            base = iTermGitReadPackedObject(repository, pack, offset - distance, &baseType, &baseLength, depth + 1);
+        } else {
+            if (p + 20 > end) {
+                return NULL;
+            }
+            base = iTermGitReadObject(repository, p, &baseType, &baseLength, depth + 1);
+            p += 20;
+        }
+        if (!base) {
+            return NULL;
+        }
+        size_t deltaLength = 0;
+        uint8_t *delta = iTermGitInflate(p, (size_t)(end - p), size, &deltaLength);
+        uint8_t *result = NULL;
+        if (delta) {
+            result = iTermGitApplyDelta(base, baseLength, delta, deltaLength, lengthPtr);
+            free(delta);
+        }
+        free(base);
+        *typePtr = baseType;
+        return result;
+    }
+    *typePtr = type;
+    return iTermGitInflate(p, (size_t)(end - p), size, lengthPtr);
+}
+
+// Returns the object's contents (without the loose object header) in a malloced, NUL-terminated
+// buffer, or NULL if it can't be found or read.
+static uint8_t *iTermGitReadObject(const iTermGitRepository *repository,
+                                   const uint8_t oid[20],
+                                   int *typePtr,
+                                   size_t *lengthPtr,
+                                   int depth) {
+    for (int i = 0; i < repository->numberOfPacks; i++) {
+        uint64_t offset;
+        if (iTermGitPackFind(&repository->packs[i], oid, &offset)) {
+            return iTermGitReadPackedObject(repository, &repository->packs[i], offset, typePtr, lengthPtr, depth);
+        }
+    }
+
+    char hex[41];
+    iTermGitFormatObjectID(oid, hex);
+    char name[64];
+    snprintf(name, sizeof(name), "objects/%.2s/%s", hex, hex + 2);
+    char *path = iTermGitJoinPath(repository->commonDirectory, name);
+    size_t compressedLength = 0;
+    char *compressed = iTermGitReadFile(path, &compressedLength);
+    free(path);
+    if (!compressed) {
+        return NULL;
+    }
+    size_t length = 0;
+    uint8_t *object = iTermGitInflate((const uint8_t *)compressed, compressedLength, 0, &length);
+    free(compressed);
+    if (!object) {
+        return NULL;
+    }
+    // "<type> <size>\0<contents>"
+    const uint8_t *nul = memchr(object, 0, length);
+    if (!nul) {
+        free(object);
+        return NULL;
+    }
+    static const char *const typeNames[] = { NULL, "commit ", "tree ", "blob ", "tag " };
+    int type = 0;
+    for (int i = 1; i <= 4; i++) {
+        if (!strncmp((const char *)object, typeNames[i], strlen(typeNames[i]))) {
+            type = i;
+        }
+    }
+    const size_t headerLength = (size_t)(nul - object) + 1;
+    memmove(object, nul + 1, length - headerLength + 1);
+    *typePtr = type;
+    *lengthPtr = length - headerLength;
+    return object;
+}
+
+typedef struct {
+    uint8_t tree[20];
+    long long date;
+    int numberOfParents;
+    uint8_t (*parents)[20];
+} iTermGitCommit;
+
+static bool iTermGitReadCommit(const iTermGitRepository *repository,
+                               const uint8_t oid[20],
+                               iTermGitCommit *commit) {
+    int type = 0;
+    size_t length = 0;
+    uint8_t *object = iTermGitReadObject(repository, oid, &type, &length, 0);
+    if (!object) {
+        return false;
+    }
+    if (type != iTermGitObjectTypeCommit) {
+        free(object);
+        return false;
+    }
+    memset(commit, 0, sizeof(*commit));
+    bool haveTree = false;
+    const char *line = (const char *)object;
+    while (*line && *line != '\n') {
+        const char *next = strchr(line, '\n');
+        if (!next) {
+            break;
+        }
+        if (!strncmp(line, "tree ", 5)) {
+            haveTree = iTermGitParseObjectID(line + 5, commit->tree);
+        } else if (!strncmp(line, "parent ", 7)) {
+            commit->parents = realloc(commit->parents, 20 * (size_t)(commit->numberOfParents + 1));
+            if (iTermGitParseObjectID(line + 7, commit->parents[commit->numberOfParents])) {
+                commit->numberOfParents++;
+            }
+        } else if (!strncmp(line, "committer ", 10)) {
+            // "committer Name <email> 1234567890 -0700"
+            const char *closeBracket = NULL;
+            for (const char *p = line; p < next; p++) {
+                if (*p == '>') {
+                    closeBracket = p;
+                }
+            }
+            if (closeBracket) {
+                commit->date = strtoll(closeBracket + 1, NULL, 10);
+            }
+        }
+        line = next + 1;
+    }
+    free(object);
+    if (!haveTree) {
+        free(commit->parents);
+        commit->parents = NULL;
+    }
+    return haveTree;
+}
+
+#pragma mark - Ahead and behind
+
+enum {
+    iTermGitCommitFlagLeft = 1,
+    iTermGitCommitFlagRight = 2,
+    iTermGitCommitFlagBoth = 3
+};
+
+typedef struct {
+    uint8_t oid[20];
+    long long date;
+    int numberOfParents;
+    uint8_t (*parents)[20];
+    uint8_t flags;
+    bool queued;
+} iTermGitWalkNode;
+
+typedef struct {
+    const iTermGitRepository *repository;
+    iTermGitWalkNode *nodes;
+    int count;
+    int maximum;
+
+    // Open-addressed table of node index + 1, keyed by the object ID.
+    int *table;
+    uint32_t tableMask;
+
+    // Max-heap of node indexes ordered by commit date.
+    int *heap;
+    int heapCount;
+
+    // Queued nodes that aren't yet known to be reachable from both sides.
+    int interesting;
+} iTermGitWalk;
+
+static int iTermGitWalkNodeFor(iTermGitWalk *walk, const uint8_t oid[20]) {
+    uint32_t hash;
+    memcpy(&hash, oid, sizeof(hash));
+    uint32_t i = hash & walk->tableMask;
+    while (walk->table[i]) {
+        const int index = walk->table[i] - 1;
+        if (!memcmp(walk->nodes[index].oid, oid, 20)) {
+            return index;
+        }
+        i = (i + 1) & walk->tableMask;
+    }
+    if (walk->count == walk->maximum) {
+        return -1;
+    }
+    iTermGitCommit commit;
+    if (!iTermGitReadCommit(walk->repository, oid, &commit)) {
+        return -1;
+    }
+    const int index = walk->count++;
+    iTermGitWalkNode *node = &walk->nodes[index];
+    memcpy(node->oid, oid, 20);
+    node->date = commit.date;
+    node->numberOfParents = commit.numberOfParents;
+    node->parents = commit.parents;
+    node->flags = 0;
+    node->queued = false;
+    walk->table[i] = index + 1;
+    return index;
+}
+
+static bool iTermGitWalkHeapLess(const iTermGitWalk *walk, int a, int b) {
+    return walk->nodes[walk->heap[a]].date < walk->nodes[walk->heap[b]].date;
+}
+
+static void iTermGitWalkHeapSwap(iTermGitWalk *walk, int a, int b) {
+    const int temp = walk->heap[a];
+    walk->heap[a] = walk->heap[b];
+    walk->heap[b] = temp;
+}
+
+static void iTermGitWalkPush(iTermGitWalk *walk, int index) {
+    iTermGitWalkNode *node = &walk->nodes[index];
+    node->queued = true;
+    if (node->flags != iTermGitCommitFlagBoth) {
+        walk->interesting++;
+    }
+    int i = walk->heapCount++;
+    walk->heap[i] = index;
+    while (i > 0 && iTermGitWalkHeapLess(walk, (i - 1) / 2, i)) {
+        iTermGitWalkHeapSwap(walk, (i - 1) / 2, i);
+        i = (i - 1) / 2;
+    }
+}
+
+static int iTermGitWalkPop(iTermGitWalk *walk) {
+    const int result = walk->heap[0];
+    walk->heap[0] = walk->heap[--walk->heapCount];
+    int i = 0;
+    while (1) {
+        const int left = i * 2 + 1;
+        const int right = left + 1;
+        int largest = i;
+        if (left < walk->heapCount && iTermGitWalkHeapLess(walk, largest, left)) {
+            largest = left;
+        }
+        if (right < walk->heapCount && iTermGitWalkHeapLess(walk, largest, right)) {
+            largest = right;
+        }
+        if (largest == i) {
+            break;
+        }
+        iTermGitWalkHeapSwap(walk, i, largest);
+        i = largest;
+    }
+    iTermGitWalkNode *node = &walk->nodes[result];
+    node->queued = false;
+    if (node->flags != iTermGitCommitFlagBoth) {
+        walk->interesting--;
+    }
+    return result;
+}
+
+static void iTermGitWalkAddFlags(iTermGitWalk *walk, int index, uint8_t flags) {
+    iTermGitWalkNode *node = &walk->nodes[index];
+    const uint8_t newFlags = node->flags | flags;
+    if (newFlags == node->flags) {
+        return;
+    }
+    if (node->queued && newFlags == iTermGitCommitFlagBoth) {
+        walk->interesting--;
+    }
+    node->flags = newFlags;
+    if (!node->queued) {
+        iTermGitWalkPush(walk, index);
+    }
+}
+
+bool iTermGitRepositoryCountAheadBehind(iTermGitRepository *repository,
+                                        const iTermGitHead *head,
+                                        int maximumCommits,
+                                        int *aheadPtr,
+                                        int *behindPtr) {
+    if (!head->hasHead || !head->hasUpstream) {
+        return false;
+    }
+    if (!memcmp(head->head, head->upstream, 20)) {
+        *aheadPtr = 0;
+        *behindPtr = 0;
+        return true;
+    }
+    iTermGitWalk walk = { 0 };
+    walk.repository = repository;
+    walk.maximum = maximumCommits;
+    walk.nodes = calloc((size_t)maximumCommits, sizeof(iTermGitWalkNode));
+    // Every queued node is distinct so the heap never holds more than all of them.
+    walk.heap = malloc(sizeof(int) * (size_t)maximumCommits);
+    uint32_t tableSize = 16;
+    while (tableSize < (uint32_t)maximumCommits * 2) {
+        tableSize *= 2;
+    }
+    walk.table = calloc(tableSize, sizeof(int));
+    walk.tableMask = tableSize - 1;
+
+    bool ok = false;
+    const int left = iTermGitWalkNodeFor(&walk, head->head);
+    const int right = iTermGitWalkNodeFor(&walk, head->upstream);
+    if (left >= 0 && right >= 0) {
+        iTermGitWalkAddFlags(&walk, left, iTermGitCommitFlagLeft);
+        iTermGitWalkAddFlags(&walk, right, iTermGitCommitFlagRight);
+        ok = true;
+        // Newest first, so by the time a commit is popped every descendant of it that's been
+        // seen has usually been processed. Stop once everything queued is reachable from both
+        // sides because so is everything they reach. A commit whose flags grow after it was
+        // processed (clock skew) is queued again.
+        while (walk.interesting > 0) {
+            const int index = iTermGitWalkPop(&walk);
+            const uint8_t flags = walk.nodes[index].flags;
+            for (int i = 0; i < walk.nodes[index].numberOfParents; i++) {
+                const int parent = iTermGitWalkNodeFor(&walk, walk.nodes[index].parents[i]);
+                if (parent < 0) {
+                    ok = false;
+                    break;
+                }
+                iTermGitWalkAddFlags(&walk, parent, flags);
+            }
+            if (!ok) {
+                break;
+            }
+        }
+    }
+    if (ok) {
+        int ahead = 0;
+        int behind = 0;
+        for (int i = 0; i < walk.count; i++) {
+            if (walk.nodes[i].flags == iTermGitCommitFlagLeft) {
+                ahead++;
+            } else if (walk.nodes[i].flags == iTermGitCommitFlagRight) {
+                behind++;
+            }
+        }
+        *aheadPtr = ahead;
+        *behindPtr = behind;
+    }
+    for (int i = 0; i < walk.count; i++) {
+        free(walk.nodes[i].parents);
+    }
+    free(walk.nodes);
+    free(walk.heap);
+    free(walk.table);
+    return ok;
+}
+
+#pragma mark - Index
+
+typedef struct {
+    uint32_t ctimeSeconds;
+    uint32_t ctimeNanoseconds;
+    uint32_t mtimeSeconds;
+    uint32_t mtimeNanoseconds;
+    uint32_t inode;
+    uint32_t mode;
+    uint32_t size;
+    uint8_t oid[20];
+    uint16_t flags;
+    uint16_t extendedFlags;
+    const char *path;
+} iTermGitIndexEntry;
+
+enum {
+    iTermGitIndexFlagAssumeValid = 0x8000,
+    iTermGitIndexFlagExtended = 0x4000,
+    iTermGitIndexFlagStageMask = 0x3000,
+    iTermGitIndexExtendedFlagSkipWorktree = 0x4000,
+    iTermGitIndexExtendedFlagIntentToAdd = 0x2000
+};
+
+// A node of the cached tree extension, which records the tree object for directories whose
+// index entries haven't changed since it was last written.
+typedef struct iTermGitCacheTree {
+    char *name;
+    bool valid;
+    uint8_t oid[20];
+    int numberOfChildren;
+    struct iTermGitCacheTree *children;
+} iTermGitCacheTree;
+
+typedef struct {
+    iTermGitIndexEntry *entries;
+    uint32_t count;
+    char *paths;
+    iTermGitCacheTree *cacheTree;
+    // Modification time of the index file. Files modified at or after it may have changed
+    // without their stat data changing ("racy git"), so they're hashed.
+    struct timespec mtime;
+} iTermGitIndex;
+
+static void iTermGitCacheTreeFree(iTermGitCacheTree *tree) {
+    if (!tree) {
+        return;
+    }
+    for (int i = 0; i < tree->numberOfChildren; i++) {
+        iTermGitCacheTree *child = &tree->children[i];
+        for (int j = 0; j < child->numberOfChildren; j++) {
+            iTermGitCacheTreeFree(&child->children[j]);
+        }
+        free(child->children);
+        free(child->name);
+    }
+    free(tree->children);
+    free(tree->name);
+    tree->children = NULL;
+    tree->name = NULL;
+    tree->numberOfChildren = 0;
+}
+
+// Parses one node and its descendants. Returns the position after them or NULL on error.
+static const uint8_t *iTermGitParseCacheTree(const uint8_t *p, const uint8_t *end, iTermGitCacheTree *tree) {
+    memset(tree, 0, sizeof(*tree));
+    const uint8_t *nul = memchr(p, 0, (size_t)(end - p));
+    if (!nul) {
+        return NULL;
+    }
+    tree->name = strndup((const char *)p, (size_t)(nul - p));
+    p = nul + 1;
+    const uint8_t *newline = memchr(p, '\n', (size_t)(end - p));
+    if (!newline) {
+        return NULL;
+    }
+    char numbers[32];
+    snprintf(numbers, sizeof(numbers), "%.*s", (int)(newline - p), (const char *)p);
+    int entryCount = 0;
+    int subtreeCount = 0;
+    if (sscanf(numbers, "%d %d", &entryCount, &subtreeCount) != 2 || subtreeCount < 0) {
+        return NULL;
+    }
+    p = newline + 1;
+    if (entryCount >= 0) {
+        if (p + 20 > end) {
+            return NULL;
+        }
+        tree->valid = true;
+        memcpy(tree->oid, p, 20);
+        p += 20;
+    }
+    tree->children = calloc((size_t)subtreeCount + 1, sizeof(iTermGitCacheTree));
+    for (int i = 0; i < subtreeCount; i++) {
+        p = iTermGitParseCacheTree(p, end, &tree->children[i]);
+        tree->numberOfChildren = i + 1;
+        if (!p) {
+            return NULL;
+        }
+    }
+    return p;
+}
+
+static void iTermGitIndexFree(iTermGitIndex *index) {
+    if (!index) {
+        return;
+    }
+    if (index->cacheTree) {
+        iTermGitCacheTreeFree(index->cacheTree);
+        free(index->cacheTree);
+    }
+    free(index->entries);
+    free(index->paths);
+    free(index);
+}
+
+// Reads versions 2, 3 and 4. Returns NULL for split or sparse indexes, which aren't supported.
+// Sets *missingPtr if there's no index at all (a new repository).
+static iTermGitIndex *iTermGitIndexRead(const iTermGitRepository *repository, bool *missingPtr) {
+    *missingPtr = false;
+    char *path = iTermGitJoinPath(repository->gitDirectory, "index");
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    if (fd < 0) {
+        *missingPtr = (errno == ENOENT);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 32) {
+        close(fd);
+        return NULL;
+    }
+    const size_t length = (size_t)st.st_size;
+    uint8_t *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    const uint8_t *end = map + length - 20;  // Trailing checksum
+    const uint32_t version = iTermGitReadBigEndian32(map + 4);
+    if (memcmp(map, "DIRC", 4) || version < 2 || version > 4) {
+        munmap(map, length);
+        return NULL;
+    }
+    iTermGitIndex *index = calloc(1, sizeof(*index));
+    index->mtime = ITERM_GIT_MTIME(&st);
+    index->count = iTermGitReadBigEndian32(map + 8);
+    index->entries = calloc(index->count ? index->count : 1, sizeof(iTermGitIndexEntry));
+
+    // Paths are copied into one buffer. Offsets are stored while it grows and turned into
+    // pointers at the end.
+    size_t pathsCapacity = length;
+    size_t pathsLength = 0;
+    index->paths = malloc(pathsCapacity);
+    size_t *pathOffsets = malloc(sizeof(size_t) * (index->count ? index->count : 1));
+    char previous[PATH_MAX] = "";
+    size_t previousLength = 0;
+
+    const uint8_t *p = map + 12;
+    bool ok = true;
+    for (uint32_t i = 0; i < index->count && ok; i++) {
+        const uint8_t *start = p;
+        if (p + 62 > end) {
+            ok = false;
+            break;
+        }
+        iTermGitIndexEntry *entry = &index->entries[i];
+        entry->ctimeSeconds = iTermGitReadBigEndian32(p);
+        entry->ctimeNanoseconds = iTermGitReadBigEndian32(p + 4);
+        entry->mtimeSeconds = iTermGitReadBigEndian32(p + 8);
+        entry->mtimeNanoseconds = iTermGitReadBigEndian32(p + 12);
+        entry->inode = iTermGitReadBigEndian32(p + 20);
+        entry->mode = iTermGitReadBigEndian32(p + 24);
+        entry->size = iTermGitReadBigEndian32(p + 36);
+        memcpy(entry->oid, p + 40, 20);
+        entry->flags = iTermGitReadBigEndian16(p + 60);
+        p += 62;
+        if ((entry->flags & iTermGitIndexFlagExtended) && version >= 3) {
+            if (p + 2 > end) {
+                ok = false;
+                break;
+            }
+            entry->extendedFlags = iTermGitReadBigEndian16(p);
+            p += 2;
+        }
+        if ((entry->mode & 0170000) == 0040000) {
+            // A sparse directory entry.
+            ok = false;
+            break;
+        }
+        if (version == 4) {
+            // The number of bytes to drop from the end of the previous path, then the suffix.
+            if (p >= end) {
+                ok = false;
+                break;
+            }
+            uint8_t c = *p++;
+            size_t strip = c & 0x7f;
+            while (c & 0x80) {
+                if (p >= end) {
+                    ok = false;
+                    break;
+                }
+                c = *p++;
+                strip = ((strip + 1) << 7) | (c & 0x7f);
+            }
+            const uint8_t *nul = ok ? memchr(p, 0, (size_t)(end - p)) : NULL;
+            if (!nul || strip > previousLength || previousLength - strip + (size_t)(nul - p) >= sizeof(previous)) {
+                ok = false;
+                break;
+            }
+            previousLength -= strip;
+            memcpy(previous + previousLength, p, (size_t)(nul - p));
+            previousLength += (size_t)(nul - p);
+            previous[previousLength] = '\0';
+            p = nul + 1;
+        } else {
+            const uint8_t *nul = memchr(p, 0, (size_t)(end - p));
+            if (!nul || (size_t)(nul - p) >= sizeof(previous)) {
+                ok = false;
+                break;
+            }
+            previousLength = (size_t)(nul - p);
+            memcpy(previous, p, previousLength + 1);
+            // Entries are padded with 1-8 NULs to a multiple of eight bytes.
+            const size_t entryLength = ((size_t)(nul - start) + 8) & ~(size_t)7;
+            p = start + entryLength;
+        }
+        if (pathsLength + previousLength + 1 > pathsCapacity) {
+            pathsCapacity = (pathsLength + previousLength + 1) * 2;
+            index->paths = realloc(index->paths, pathsCapacity);
+        }
+        pathOffsets[i] = pathsLength;
+        memcpy(index->paths + pathsLength, previous, previousLength + 1);
+        pathsLength += previousLength + 1;
+    }
+
+    // Extensions: a four byte signature and a four byte length.
+    while (ok && p + 8 <= end) {
+        const uint32_t extensionLength = iTermGitReadBigEndian32(p + 4);
+        const uint8_t *data = p + 8;
+        if (data + extensionLength > end) {
+            break;
+        }
+        if (!memcmp(p, "link", 4) || !memcmp(p, "sdir", 4)) {
+            // Split index or sparse directories.
+            ok = false;
+        } else if (!memcmp(p, "TREE", 4) && extensionLength > 0) {
+            index->cacheTree = calloc(1, sizeof(iTermGitCacheTree));
+            if (!iTermGitParseCacheTree(data, data + extensionLength, index->cacheTree)) {
+                iTermGitCacheTreeFree(index->cacheTree);
+                free(index->cacheTree);
+                index->cacheTree = NULL;
+            }
+        }
+        p = data + extensionLength;
+    }
+    munmap(map, length);
+
+    if (!ok) {
+        free(pathOffsets);
+        iTermGitIndexFree(index);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < index->count; i++) {
+        index->entries[i].path = index->paths + pathOffsets[i];
+    }
+    free(pathOffsets);
+    return index;
+}
+
+// Returns the index of the first entry whose path is >= |path|.
+static uint32_t iTermGitIndexLowerBound(const iTermGitIndex *index, const char *path) {
+    uint32_t low = 0;
+    uint32_t high = index->count;
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        if (strcmp(index->entries[middle].path, path) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static bool iTermGitIndexContains(const iTermGitIndex *index, const char *path) {
+    const uint32_t i = iTermGitIndexLowerBound(index, path);
+    return i < index->count && !strcmp(index->entries[i].path, path);
+}
+
+#pragma mark - Staged changes
+
+static const iTermGitCacheTree *iTermGitCacheTreeChild(const iTermGitCacheTree *tree, const char *name, size_t length) {
+    if (!tree) {
+        return NULL;
+    }
+    for (int i = 0; i < tree->numberOfChildren; i++) {
+        if (strlen(tree->children[i].name) == length && !memcmp(tree->children[i].name, name, length)) {
+            return &tree->children[i];
+        }
+    }
+    return NULL;
+}
+
+typedef enum {
+    iTermGitCompareSame,
+    iTermGitCompareDifferent,
+    iTermGitCompareUnknown
+} iTermGitCompareResult;
+
+// Compares a tree object with the index entries in [*cursorPtr, end) that lie under |prefix|,
+// advancing the cursor past them. Directories the cached tree vouches for are compared by object
+// ID alone.
+static iTermGitCompareResult iTermGitCompareTree(const iTermGitRepository *repository,
+                                                 const iTermGitIndex *index,
+                                                 const uint8_t treeOID[20],
+                                                 const iTermGitCacheTree *cacheTree,
+                                                 const char *prefix,
+                                                 size_t prefixLength,
+                                                 uint32_t *cursorPtr,
+                                                 uint32_t end) {
+    uint32_t cursor = *cursorPtr;
+    uint32_t subtreeEnd = cursor;
+    while (subtreeEnd < end && !strncmp(index->entries[subtreeEnd].path, prefix, prefixLength)) {
+        subtreeEnd++;
+    }
+    *cursorPtr = subtreeEnd;
+    if (cacheTree && cacheTree->valid) {
+        return memcmp(cacheTree->oid, treeOID, 20) ? iTermGitCompareDifferent : iTermGitCompareSame;
+    }
+
+    int type = 0;
+    size_t length = 0;
+    uint8_t *tree = iTermGitReadObject(repository, treeOID, &type, &length, 0);
+    if (!tree || type != iTermGitObjectTypeTree) {
+        free(tree);
+        return iTermGitCompareUnknown;
+    }
+    iTermGitCompareResult result = iTermGitCompareSame;
+    char path[PATH_MAX];
+    memcpy(path, prefix, prefixLength);
+    // Entries: "<octal mode> <name>\0<20 byte id>", sorted the same way as the index.
+    const uint8_t *p = tree;
+    const uint8_t *treeEnd = tree + length;
+    while (p < treeEnd && result == iTermGitCompareSame) {
+        const uint8_t *space = memchr(p, ' ', (size_t)(treeEnd - p));
+        const uint8_t *nul = space ? memchr(space, 0, (size_t)(treeEnd - space)) : NULL;
+        if (!nul || nul + 21 > treeEnd) {
+            result = iTermGitCompareUnknown;
+            break;
+        }
+        const uint32_t mode = (uint32_t)strtoul((const char *)p, NULL, 8);
+        const char *name = (const char *)space + 1;
+        const size_t nameLength = (size_t)(nul - (const uint8_t *)name);
+        const uint8_t *oid = nul + 1;
+        p = nul + 21;
+        if (prefixLength + nameLength + 2 >= sizeof(path)) {
+            result = iTermGitCompareUnknown;
+            break;
+        }
+        memcpy(path + prefixLength, name, nameLength);
+        if (mode == 040000) {
+            path[prefixLength + nameLength] = '/';
+            path[prefixLength + nameLength + 1] = '\0';
+            if (cursor >= subtreeEnd ||
+                strncmp(index->entries[cursor].path, path, prefixLength + nameLength + 1)) {
+                // The directory was removed, or something sorting before it was added.
+                result = iTermGitCompareDifferent;
+                break;
+            }
+            result = iTermGitCompareTree(repository,
+                                         index,
+                                         oid,
+                                         iTermGitCacheTreeChild(cacheTree, name, nameLength),
+                                         path,
+                                         prefixLength + nameLength + 1,
+                                         &cursor,
+                                         subtreeEnd);
+        } else {
+            path[prefixLength + nameLength] = '\0';
+            if (cursor >= subtreeEnd) {
+                result = iTermGitCompareDifferent;
+                break;
+            }
+            const iTermGitIndexEntry *entry = &index->entries[cursor];
+            if (strcmp(entry->path, path) ||
+                (entry->flags & iTermGitIndexFlagStageMask) ||
+                (entry->extendedFlags & iTermGitIndexExtendedFlagIntentToAdd) ||
+                entry->mode != mode ||
+                memcmp(entry->oid, oid, 20)) {
+                result = iTermGitCompareDifferent;
+                break;
+            }
+            cursor++;
+        }
+    }
+    free(tree);
+    if (result == iTermGitCompareSame && cursor != subtreeEnd) {
+        // Something was added after the last entry in the tree.
+        result = iTermGitCompareDifferent;
+    }
+    return result;
+}
+
+#pragma mark - Work tree
+
+typedef struct {
+    const iTermGitRepository *repository;
+    const iTermGitIndex *index;
+    int *modified;
+    int *deleted;
+    int *deletedInDirectory;
+    bool *unknown;
+    // One per index entry. Each chunk writes only its own entries.
+    bool *deletedEntries;
+} iTermGitCheckContext;
+
+static bool iTermGitHashFile(const char *path, const struct stat *st, uint8_t oid[20]) {
+    iTermGitSHA1 sha;
+    iTermGitSHA1Init(&sha);
+    char header[32];
+    if (S_ISLNK(st->st_mode)) {
+        char target[PATH_MAX];
+        const ssize_t length = readlink(path, target, sizeof(target));
+        if (length < 0) {
+            return false;
+        }
+        snprintf(header, sizeof(header), "blob %zd", length);
+        iTermGitSHA1Update(&sha, header, strlen(header) + 1);
+        iTermGitSHA1Update(&sha, target, (size_t)length);
+        iTermGitSHA1Final(&sha, oid);
+        return true;
+    }
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    snprintf(header, sizeof(header), "blob %lld", (long long)st->st_size);
+    iTermGitSHA1Update(&sha, header, strlen(header) + 1);
+    uint8_t buffer[65536];
+    long long total = 0;
+    while (1) {
+        const ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        iTermGitSHA1Update(&sha, buffer, (size_t)n);
+        total += n;
+    }
+    close(fd);
+    if (total != st->st_size) {
+        // Changed while reading.
+        return false;
+    }
+    iTermGitSHA1Final(&sha, oid);
+    return true;
+}
+
+static bool iTermGitTimespecIsAtOrAfter(uint32_t seconds, uint32_t nanoseconds, struct timespec when) {
+    if ((long long)seconds != (long long)when.tv_sec) {
+        return (long long)seconds > (long long)when.tv_sec;
+    }
+    return nanoseconds >= (uint32_t)when.tv_nsec;
+}
+
+// Compares one tracked file with its index entry like git's ie_match_stat() followed by a content
+// check when the stat data is inconclusive.
+static void iTermGitCheckEntry(const iTermGitCheckContext *context,
+                               size_t entryIndex,
+                               const iTermGitIndexEntry *entry,
+                               char *path,
+                               size_t workTreeLength,
+                               int *modifiedPtr,
+                               int *deletedPtr,
+                               int *deletedInDirectoryPtr,
+                               bool *unknownPtr) {
+    if ((entry->mode & 0170000) == 0160000) {
+        // Submodules are ignored, like --ignore-submodules.
+        return;
+    }
+    if ((entry->flags & iTermGitIndexFlagAssumeValid) ||
+        (entry->extendedFlags & iTermGitIndexExtendedFlagSkipWorktree)) {
+        return;
+    }
+    if (entry->flags & iTermGitIndexFlagStageMask) {
+        // Unmerged.
+        *modifiedPtr += 1;
+        return;
+    }
+    snprintf(path + workTreeLength, PATH_MAX - workTreeLength, "/%s", entry->path);
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        if (errno == ENOENT || errno == ENOTDIR) {
+            *deletedPtr += 1;
+            context->deletedEntries[entryIndex] = true;
+            const char *prefix = context->repository->prefix;
+            if (!strncmp(entry->path, prefix, strlen(prefix))) {
+                *deletedInDirectoryPtr += 1;
+            }
+        } else {
+            *unknownPtr = true;
+        }
+        return;
+    }
+    const bool isLink = S_ISLNK(st.st_mode);
+    if (!(S_ISREG(st.st_mode) || isLink) || ((entry->mode & 0170000) == 0120000) != isLink) {
+        *modifiedPtr += 1;
+        return;
+    }
+    if (!isLink && ((entry->mode & 0100) != 0) != ((st.st_mode & S_IXUSR) != 0)) {
+        *modifiedPtr += 1;
+        return;
+    }
+    const struct timespec mtime = ITERM_GIT_MTIME(&st);
+    const struct timespec ctime = ITERM_GIT_CTIME(&st);
+    // Nanoseconds are only compared if git recorded them.
+    const bool statMatches = ((uint32_t)mtime.tv_sec == entry->mtimeSeconds &&
+                              (!entry->mtimeNanoseconds || (uint32_t)mtime.tv_nsec == entry->mtimeNanoseconds) &&
+                              (uint32_t)ctime.tv_sec == entry->ctimeSeconds &&
+                              (!entry->ctimeNanoseconds || (uint32_t)ctime.tv_nsec == entry->ctimeNanoseconds) &&
+                              (uint32_t)st.st_ino == entry->inode &&
+                              (uint32_t)st.st_size == entry->size);
+    if (statMatches &&
+        !iTermGitTimespecIsAtOrAfter(entry->mtimeSeconds, entry->mtimeNanoseconds, context->index->mtime)) {
+        return;
+    }
+    if (!isLink && (uint32_t)st.st_size != entry->size && !context->repository->contentMayBeFiltered) {
+        // Different size means different contents, so don't bother hashing.
+        *modifiedPtr += 1;
+        return;
+    }
+    uint8_t oid[20];
+    if (!iTermGitHashFile(path, &st, oid)) {
+        *unknownPtr = true;
+        return;
+    }
+    if (memcmp(oid, entry->oid, 20)) {
+        if (context->repository->contentMayBeFiltered && !isLink) {
+            // Only git can say whether the filtered contents differ.
+            *unknownPtr = true;
+        } else {
+            *modifiedPtr += 1;
+        }
+    }
+}
+
+static void iTermGitCheckChunk(void *contextPointer, size_t chunk) {
+    const iTermGitCheckContext *context = contextPointer;
+    char path[PATH_MAX];
+    const size_t workTreeLength = strlen(context->repository->workTree);
+    if (workTreeLength + 2 >= sizeof(path)) {
+        context->unknown[chunk] = true;
+        return;
+    }
+    memcpy(path, context->repository->workTree, workTreeLength + 1);
+    const size_t begin = chunk * ITERM_GIT_INDEX_CHUNK_SIZE;
+    size_t end = begin + ITERM_GIT_INDEX_CHUNK_SIZE;
+    if (end > context->index->count) {
+        end = context->index->count;
+    }
+    int modified = 0;
+    int deleted = 0;
+    int deletedInDirectory = 0;
+    bool unknown = false;
+    for (size_t i = begin; i < end; i++) {
+        iTermGitCheckEntry(context, i, &context->index->entries[i], path, workTreeLength, &modified, &deleted, &deletedInDirectory, &unknown);
+    }
+    context->modified[chunk] = modified;
+    context->deleted[chunk] = deleted;
+    context->deletedInDirectory[chunk] = deletedInDirectory;
+    context->unknown[chunk] = unknown;
+}
+
+#pragma mark - Untracked files
+
+typedef struct {
+    char *pattern;
+    // The directory of the file it came from, relative to the work tree with a trailing slash, or
+    // empty.
+    char *base;
+    bool negated;
+    bool directoryOnly;
+    // Patterns with a slash other than a trailing one match the whole path relative to base.
+    // Others match just the last component.
+    bool anchored;
+} iTermGitIgnoreRule;
+
+typedef struct {
+    const iTermGitRepository *repository;
+    const iTermGitIndex *index;
+    iTermGitIgnoreRule *rules;
+    int numberOfRules;
+    int rulesCapacity;
+    int untracked;
+    int untrackedInDirectory;
+    char **untrackedPaths;
+    int untrackedCapacity;
+} iTermGitUntrackedWalk;
+
+static void iTermGitCountUntrackedPath(iTermGitUntrackedWalk *walk, const char *relativePath) {
+    if (walk->untracked == walk->untrackedCapacity) {
+        walk->untrackedCapacity = walk->untrackedCapacity ? walk->untrackedCapacity * 2 : 16;
+        walk->untrackedPaths = realloc(walk->untrackedPaths, sizeof(char *) * (size_t)walk->untrackedCapacity);
+    }
+    walk->untrackedPaths[walk->untracked] = strdup(relativePath);
+    walk->untracked++;
+    const char *prefix = walk->repository->prefix;
+    if (!strncmp(relativePath, prefix, strlen(prefix))) {
+        walk->untrackedInDirectory++;
+    }
+}
+
+// Matches gitignore-style globs: * and ? don't match slashes, ** matches across them, and
+// [...] is a character class.
+static bool iTermGitWildMatch(const char *pattern, const char *patternStart, const char *text) {
+    while (*pattern) {
+        switch (*pattern) {
+            case '*':
+                if (pattern[1] == '*' &&
+                    (pattern == patternStart || pattern[-1] == '/') &&
+                    (pattern[2] == '/' || pattern[2] == '\0')) {
+                    if (pattern[2] == '\0') {
+                        return true;
+                    }
+                    // "**/" matches zero or more directories.
+                    pattern += 3;
+                    while (1) {
+                        if (iTermGitWildMatch(pattern, patternStart, text)) {
+                            return true;
+                        }
+                        text = strchr(text, '/');
+                        if (!text) {
+                            return false;
+                        }
+                        text++;
+                    }
+                }
+                while (*pattern == '*') {
+                    pattern++;
+                }
+                while (1) {
+                    if (iTermGitWildMatch(pattern, patternStart, text)) {
+                        return true;
+                    }
+                    if (*text == '\0' || *text == '/') {
+                        return false;
+                    }
+                    text++;
+                }
+            case '?':
+                if (*text == '\0' || *text == '/') {
+                    return false;
+                }
+                pattern++;
+                text++;
+                break;
+            case '[': {
+                if (*text == '\0' || *text == '/') {
+                    return false;
+                }
+                const char *p = pattern + 1;
+                const bool negated = (*p == '!' || *p == '^');
+                if (negated) {
+                    p++;
+                }
+                bool matched = false;
+                bool first = true;
+                while (*p && (first || *p != ']')) {
+                    first = false;
+                    char low = *p;
+                    if (low == '\\' && p[1]) {
+                        low = *++p;
+                    }
+                    char high = low;
+                    if (p[1] == '-' && p[2] && p[2] != ']') {
+                        high = p[2];
+                        p += 2;
+                    }
+                    if (*text >= low && *text <= high) {
+                        matched = true;
+                    }
+                    p++;
+                }
+                if (*p != ']') {
+                    // Unterminated; treat the bracket literally.
+                    if (*text != '[') {
+                        return false;
+                    }
+                    pattern++;
+                    text++;
+                    break;
+                }
+                if (matched == negated) {
+                    return false;
+                }
+                pattern = p + 1;
+                text++;
+                break;
+            }
+            case '\\':
+                if (pattern[1]) {
+                    pattern++;
+                }
+                // Fall through
+            default:
+                if (*pattern != *text) {
+                    return false;
+                }
+                pattern++;
+                text++;
+                break;
+        }
+    }
+    return *text == '\0';
+}
+
+static void iTermGitLoadIgnoreFile(iTermGitUntrackedWalk *walk, const char *path, const char *base) {
+    char *contents = iTermGitReadFile(path, NULL);
+    if (!contents) {
+        return;
+    }
+    char *saveptr = NULL;
+    for (char *line = strtok_r(contents, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr)) {
+        size_t length = strlen(line);
+        if (length && line[length - 1] == '\r') {
+            line[--length] = '\0';
+        }
+        // Trailing spaces are ignored unless escaped.
+        while (length && line[length - 1] == ' ' && !(length >= 2 && line[length - 2] == '\\')) {
+            line[--length] = '\0';
+        }
+        if (!length || line[0] == '#') {
+            continue;
+        }
+        iTermGitIgnoreRule rule = { 0 };
+        if (line[0] == '!') {
+            rule.negated = true;
+            line++;
+            length--;
+        } else if (line[0] == '\\' && (line[1] == '!' || line[1] == '#')) {
+            line++;
+            length--;
+        }
+        if (length && line[length - 1] == '/') {
+            rule.directoryOnly = true;
+            line[--length] = '\0';
+        }
+        if (!length) {
+            continue;
+        }
+        rule.anchored = (strchr(line, '/') != NULL);
+        if (line[0] == '/') {
+            line++;
+        }
+        rule.pattern = strdup(line);
+        rule.base = strdup(base);
+        if (walk->numberOfRules == walk->rulesCapacity) {
+            walk->rulesCapacity = walk->rulesCapacity ? walk->rulesCapacity * 2 : 64;
+            walk->rules = realloc(walk->rules, sizeof(iTermGitIgnoreRule) * (size_t)walk->rulesCapacity);
+        }
+        walk->rules[walk->numberOfRules++] = rule;
+    }
+    free(contents);
+}
+
+static void iTermGitPopIgnoreRules(iTermGitUntrackedWalk *walk, int count) {
+    while (walk->numberOfRules > count) {
+        walk->numberOfRules--;
+        free(walk->rules[walk->numberOfRules].pattern);
+        free(walk->rules[walk->numberOfRules].base);
+    }
+}
+
+// |relativePath| is relative to the work tree. The last matching rule decides.
+static bool iTermGitIsIgnored(const iTermGitUntrackedWalk *walk,
+                              const char *relativePath,
+                              const char *name,
+                              bool isDirectory) {
+    for (int i = walk->numberOfRules - 1; i >= 0; i--) {
+        const iTermGitIgnoreRule *rule = &walk->rules[i];
+        if (rule->directoryOnly && !isDirectory) {
+            continue;
+        }
+        bool matches;
+        if (rule->anchored) {
+            const size_t baseLength = strlen(rule->base);
+            matches = (!strncmp(relativePath, rule->base, baseLength) &&
+                       iTermGitWildMatch(rule->pattern, rule->pattern, relativePath + baseLength));
+        } else {
+            matches = iTermGitWildMatch(rule->pattern, rule->pattern, name);
+        }
+        if (matches) {
+            return !rule->negated;
+        }
+    }
+    return false;
+}
+
+// |relativeDirectory| is empty or ends in a slash.
+static void iTermGitWalkUntracked(iTermGitUntrackedWalk *walk, char *relativeDirectory, size_t relativeLength) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", walk->repository->workTree, relativeDirectory);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+    const int savedRuleCount = walk->numberOfRules;
+    char *ignorePath = iTermGitJoinPath(walk->repository->workTree, relativeDirectory);
+    ignorePath = realloc(ignorePath, strlen(ignorePath) + sizeof(".gitignore"));
+    strcat(ignorePath, ".gitignore");
+    iTermGitLoadIgnoreFile(walk, ignorePath, relativeDirectory);
+    free(ignorePath);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        const char *name = entry->d_name;
+        if (!strcmp(name, ".") || !strcmp(name, "..") || !strcmp(name, ".git")) {
+            continue;
+        }
+        const size_t nameLength = strlen(name);
+        if (relativeLength + nameLength + 2 >= PATH_MAX) {
+            continue;
+        }
+        memcpy(relativeDirectory + relativeLength, name, nameLength + 1);
+        bool isDirectory;
+        if (entry->d_type == DT_DIR) {
+            isDirectory = true;
+        } else if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            snprintf(path + strlen(walk->repository->workTree) + 1,
+                     sizeof(path) - strlen(walk->repository->workTree) - 1,
+                     "%s",
+                     relativeDirectory);
+            isDirectory = (lstat(path, &st) == 0 && S_ISDIR(st.st_mode));
+        } else {
+            // Symlinks are files to git even if they point at directories.
+            isDirectory = false;
+        }
+        if (!isDirectory) {
+            if (!iTermGitIndexContains(walk->index, relativeDirectory) &&
+                !iTermGitIsIgnored(walk, relativeDirectory, name, false)) {
+                iTermGitCountUntrackedPath(walk, relativeDirectory);
+            }
+            continue;
+        }
+        if (iTermGitIndexContains(walk->index, relativeDirectory)) {
+            // A submodule.
+            continue;
+        }
+        if (iTermGitIsIgnored(walk, relativeDirectory, name, true)) {
+            continue;
+        }
+        char nested[PATH_MAX];
+        snprintf(nested, sizeof(nested), "%s/%s", walk->repository->workTree, relativeDirectory);
+        char *nestedGitDirectory = iTermGitDirectoryIn(nested);
+        if (nestedGitDirectory) {
+            // Another repository is listed as a single untracked entry.
+            free(nestedGitDirectory);
+            relativeDirectory[relativeLength + nameLength] = '/';
+            relativeDirectory[relativeLength + nameLength + 1] = '\0';
+            iTermGitCountUntrackedPath(walk, relativeDirectory);
+            continue;
+        }
+        relativeDirectory[relativeLength + nameLength] = '/';
+        relativeDirectory[relativeLength + nameLength + 1] = '\0';
+        iTermGitWalkUntracked(walk, relativeDirectory, relativeLength + nameLength + 1);
+    }
+    relativeDirectory[relativeLength] = '\0';
+    closedir(dir);
+    iTermGitPopIgnoreRules(walk, savedRuleCount);
+}
+
+static void iTermGitCountUntracked(const iTermGitRepository *repository,
+                                   const iTermGitIndex *index,
+                                   iTermGitWorkTreeStatus *status) {
+    iTermGitUntrackedWalk walk = { 0 };
+    walk.repository = repository;
+    walk.index = index;
+
+    // Lowest precedence first: core.excludesFile, then info/exclude. Each directory's .gitignore
+    // is pushed on top while walking it.
+    char value[PATH_MAX];
+    char *excludesFile = NULL;
+    if (iTermGitRepositoryConfigGet(repository, "core", NULL, "excludesfile", value, sizeof(value))) {
+        excludesFile = iTermGitExpandTilde(value);
+    } else {
+        excludesFile = iTermGitUserConfigPath("ignore", true);
+    }
+    if (excludesFile) {
+        iTermGitLoadIgnoreFile(&walk, excludesFile, "");
+        free(excludesFile);
+    }
+    char *exclude = iTermGitJoinPath(repository->commonDirectory, "info/exclude");
+    iTermGitLoadIgnoreFile(&walk, exclude, "");
+    free(exclude);
+
+    char relative[PATH_MAX] = "";
+    iTermGitWalkUntracked(&walk, relative, 0);
+    iTermGitPopIgnoreRules(&walk, 0);
+    free(walk.rules);
+    status->untracked = walk.untracked;
+    status->untrackedInDirectory = walk.untrackedInDirectory;
+    status->untrackedPaths = walk.untrackedPaths;
+    status->untrackedKnown = true;
+}
+
+#pragma mark - Status
+
+void iTermGitRepositoryGetWorkTreeStatus(iTermGitRepository *repository,
+                                         const iTermGitHead *head,
+                                         iTermGitParallelFor parallelFor,
+                                         iTermGitWorkTreeStatus *status) {
+    memset(status, 0, sizeof(*status));
+    if (repository->unsupported) {
+        return;
+    }
+    bool missing = false;
+    iTermGitIndex *index = iTermGitIndexRead(repository, &missing);
+    if (!index) {
+        if (!missing) {
+            return;
+        }
+        // No index yet. Everything in the work tree is untracked.
+        index = calloc(1, sizeof(*index));
+        index->entries = calloc(1, sizeof(iTermGitIndexEntry));
+    }
+
+    if (!head->hasHead) {
+        status->stagedKnown = true;
+        status->staged = index->count > 0;
+    } else {
+        iTermGitCommit commit;
+        if (iTermGitReadCommit(repository, head->head, &commit)) {
+            free(commit.parents);
+            uint32_t cursor = 0;
+            const iTermGitCompareResult result = iTermGitCompareTree(repository,
+                                                                     index,
+                                                                     commit.tree,
+                                                                     index->cacheTree,
+                                                                     "",
+                                                                     0,
+                                                                     &cursor,
+                                                                     index->count);
+            status->stagedKnown = (result != iTermGitCompareUnknown);
+            status->staged = (result == iTermGitCompareDifferent);
+        }
+    }
+
+    const size_t numberOfChunks = (index->count + ITERM_GIT_INDEX_CHUNK_SIZE - 1) / ITERM_GIT_INDEX_CHUNK_SIZE;
+    iTermGitCheckContext context = {
+        .repository = repository,
+        .index = index,
+        .modified = calloc(numberOfChunks + 1, sizeof(int)),
+        .deleted = calloc(numberOfChunks + 1, sizeof(int)),
+        .deletedInDirectory = calloc(numberOfChunks + 1, sizeof(int)),
+        .unknown = calloc(numberOfChunks + 1, sizeof(bool)),
+        .deletedEntries = calloc(index->count + 1, sizeof(bool))
+    };
+    if (parallelFor && numberOfChunks > 1) {
+        parallelFor(numberOfChunks, &context, iTermGitCheckChunk);
+    } else {
+        for (size_t i = 0; i < numberOfChunks; i++) {
+            iTermGitCheckChunk(&context, i);
+        }
+    }
+    status->workTreeKnown = true;
+    for (size_t i = 0; i < numberOfChunks; i++) {
+        status->modified += context.modified[i];
+        status->deleted += context.deleted[i];
+        status->deletedInDirectory += context.deletedInDirectory[i];
+        if (context.unknown[i]) {
+            status->workTreeKnown = false;
+        }
+    }
+    if (status->deleted > 0) {
+        // Index order is path order, so these come out sorted.
+        status->deletedPaths = malloc(sizeof(char *) * (size_t)status->deleted);
+        int count = 0;
+        for (uint32_t i = 0; i < index->count && count < status->deleted; i++) {
+            if (context.deletedEntries[i]) {
+                status->deletedPaths[count++] = strdup(index->entries[i].path);
+            }
+        }
+    }
+    free(context.modified);
+    free(context.deleted);
+    free(context.deletedInDirectory);
+    free(context.unknown);
+    free(context.deletedEntries);
+
+    iTermGitCountUntracked(repository, index, status);
+
+    iTermGitIndexFree(index);
+}
+
+void iTermGitWorkTreeStatusFree(iTermGitWorkTreeStatus *status) {
+    if (status->deletedPaths) {
+        for (int i = 0; i < status->deleted; i++) {
+            free(status->deletedPaths[i]);
+        }
+        free(status->deletedPaths);
+        status->deletedPaths = NULL;
+    }
+    if (status->untrackedPaths) {
+        for (int i = 0; i < status->untracked; i++) {
+            free(status->untrackedPaths[i]);
+        }
+        free(status->untrackedPaths);
+        status->untrackedPaths = NULL;
+    }
+}
@@ -0,0 +1,126 @@
+//
+//  iTermGitRepository.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Computes what the git status bar component shows (branch, commits ahead of and behind the
+//  upstream, whether the work tree is dirty, and counts of untracked and deleted files) by reading
+//  .git directly instead of running git. HEAD, refs and config are parsed as text, the index is
+//  read in place, tracked files are stat()ed and only hashed when their stat data doesn't match,
+//  and commits and trees are read from loose objects or packs.
+//
+//  Anything this doesn't understand (split indexes, sparse checkouts, missing objects, content
+//  filters that make hashes incomparable, repository format extensions like reftable) is reported
+//  as unknown so the caller can fall back to running git.
+//
+//  Plain C with no Foundation dependency so it can be benchmarked anywhere (see
+//  tests/git_status_bench.c).
+//
+
+#ifndef iTermGitRepository_h
+#define iTermGitRepository_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct iTermGitRepository iTermGitRepository;
+
+typedef struct {
+    // Short branch name, or the abbreviated commit if HEAD is detached.
+    char branch[256];
+    bool detached;
+
+    // False for a branch with no commits yet.
+    bool hasHead;
+    uint8_t head[20];
+
+    // The branch's configured upstream, if it has one that resolves to a commit.
+    bool hasUpstream;
+    uint8_t upstream[20];
+} iTermGitHead;
+
+typedef struct {
+    // Each is only meaningful if the corresponding "known" flag is set. Counts are for the whole
+    // work tree except the "InDirectory" ones, which only include files below the directory passed
+    // to iTermGitRepositoryOpen(), like `git ls-files` run there.
+    bool stagedKnown;
+    bool staged;
+
+    bool workTreeKnown;
+    int modified;
+    int deleted;
+    int deletedInDirectory;
+
+    bool untrackedKnown;
+    int untracked;
+    int untrackedInDirectory;
+
+    // The files counted in deleted and untracked, relative to the top of the work tree, so counts
+    // for any directory can be derived from one walk. Deleted paths are sorted. An untracked
+    // directory holding another repository is one path ending in a slash. Release them with
+    // iTermGitWorkTreeStatusFree().
+    char **deletedPaths;
+    char **untrackedPaths;
+} iTermGitWorkTreeStatus;
+
+// Runs work(context, i) for each i in [0, iterations), possibly concurrently, and returns when
+// all have finished. dispatch_apply_f() fits this.
+typedef void (*iTermGitParallelFor)(size_t iterations,
+                                    void *context,
+                                    void (*work)(void *context, size_t i));
+
+// Finds the repository whose work tree contains |path|. Returns NULL if there isn't one or it's
+// bare. Cheap enough to call for every status computation, which also picks up new packs.
+iTermGitRepository *iTermGitRepositoryOpen(const char *path);
+void iTermGitRepositoryFree(iTermGitRepository *repository);
+
+// The top of the work tree, without a trailing slash.
+const char *iTermGitRepositoryWorkTree(const iTermGitRepository *repository);
+
+// The directory holding HEAD and the index, with symlinks resolved. For a linked work tree or a
+// submodule it's outside the work tree, and for a linked work tree it's not the common directory.
+const char *iTermGitRepositoryGitDirectory(const iTermGitRepository *repository);
+
+// The directory holding objects, refs and config, with symlinks resolved.
+const char *iTermGitRepositoryCommonDirectory(const iTermGitRepository *repository);
+
+// The directory passed to iTermGitRepositoryOpen() relative to the work tree, with a trailing
+// slash, or empty at the top of the work tree.
+const char *iTermGitRepositoryPrefix(const iTermGitRepository *repository);
+
+// Reads HEAD and the current branch's upstream. Returns false if HEAD can't be parsed or the
+// repository uses a format extension, in which case nothing else can be answered either.
+bool iTermGitRepositoryReadHead(iTermGitRepository *repository, iTermGitHead *head);
+
+// Counts commits reachable only from head->head (ahead) and only from head->upstream (behind),
+// like `git rev-list --left-right --count HEAD...@{u}`. Gives up and returns false if a commit
+// can't be read or more than |maximumCommits| would have to be visited.
+bool iTermGitRepositoryCountAheadBehind(iTermGitRepository *repository,
+                                        const iTermGitHead *head,
+                                        int maximumCommits,
+                                        int *aheadPtr,
+                                        int *behindPtr);
+
+// Compares the index with HEAD's tree (staged), the work tree with the index (modified and
+// deleted), and finds files that are neither tracked nor ignored (untracked). Tracked files are
+// checked in parallel with |parallelFor|, which may be NULL to check them serially.
+void iTermGitRepositoryGetWorkTreeStatus(iTermGitRepository *repository,
+                                         const iTermGitHead *head,
+                                         iTermGitParallelFor parallelFor,
+                                         iTermGitWorkTreeStatus *status);
+void iTermGitWorkTreeStatusFree(iTermGitWorkTreeStatus *status);
+
+// Formats a SHA-1 as 40 lowercase hex digits plus a terminating NUL.
+void iTermGitFormatObjectID(const uint8_t oid[20], char hex[41]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermGitRepository_h
@@ -0,0 +1,36 @@
+//
+//  iTermGitStatusEngine.h
+//  iTerm2SharedARC
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Computes the git status bar component's state in-process with iTermGitRepository instead of
+//  running iterm2_git_poll.sh. Each work tree is walked once and the state for any directory in it
+//  is derived from that walk, which is cached until FSEvents reports a change in the work tree, its
+//  git directory, or its common directory. Polls between changes are free and sessions in the same
+//  repository share the work.
+//
+
+#import <Foundation/Foundation.h>
+#import "iTermGitState.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Posted on the main thread when a watched repository changes. The object is the engine.
+extern NSString *const iTermGitStatusEngineRepositoryDidChangeNotification;
+
+// userInfo key for the paths whose cached state was discarded (NSArray<NSString *>).
+extern NSString *const iTermGitStatusEngineInvalidatedPathsKey;
+
+@interface iTermGitStatusEngine : NSObject
+
++ (instancetype)sharedInstance;
+
+// Call on the main thread. The completion block is called on the main thread with nil if the
+// state couldn't be computed without running git or took longer than the git timeout.
+- (void)requestPath:(NSString *)path completion:(void (^)(iTermGitState * _Nullable))completion;
+- (void)invalidateCacheForPath:(NSString *)path;
+
+@end
+
+NS_ASSUME_NONNULL_END
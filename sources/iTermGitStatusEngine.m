@@ -0,0 +1,507 @@
+//
+//  iTermGitStatusEngine.m
+//  iTerm2SharedARC
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import "iTermGitStatusEngine.h"
+
+#import "DebugLogging.h"
+#import "SCEvents.h"
+#import "iTermAdvancedSettingsModel.h"
+#import "iTermGitCache.h"
+#import "iTermGitRepository.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+NSString *const iTermGitStatusEngineRepositoryDidChangeNotification = @"iTermGitStatusEngineRepositoryDidChangeNotification";
+NSString *const iTermGitStatusEngineInvalidatedPathsKey = @"paths";
+
+// Stop counting ahead/behind after visiting this many commits. The script had no limit, but it
+// also had a two second CPU limit.
+static const int iTermGitStatusEngineMaximumCommits = 100000;
+
+// Repositories are watched until this many others have been used more recently.
+static const NSUInteger iTermGitStatusEngineMaximumWatchedWorkTrees = 32;
+
+// In case FSEvents misses a change (e.g., on a network volume), cached states for a repository
+// are recomputed this often anyway.
+static const NSTimeInterval iTermGitStatusEngineRepositoryTTL = 60;
+
+typedef void (^iTermGitStatusEngineCallback)(iTermGitState * _Nullable);
+
+@class iTermGitStatusEngineResult;
+
+// Delivers a computation's result (nil on timeout) to one request.
+typedef void (^iTermGitStatusEngineDelivery)(iTermGitStatusEngineResult * _Nullable);
+
+// Where a repository keeps its files. For a linked work tree or a submodule the git directory and
+// the common directory are outside the work tree, and a change in any of them can change the status.
+@interface iTermGitStatusEngineRepositoryPaths : NSObject
+@property (nonatomic, copy) NSString *workTree;
+@property (nonatomic, copy) NSString *gitDirectory;
+@property (nonatomic, copy) NSString *commonDirectory;
+@property (nonatomic, readonly) NSArray<NSString *> *roots;
+@end
+
+@implementation iTermGitStatusEngineRepositoryPaths
+
+- (NSArray<NSString *> *)roots {
+    return @[ _workTree, _gitDirectory, _commonDirectory ];
+}
+
+@end
+
+static BOOL iTermGitStatusEnginePathIsInDirectory(NSString *path, NSString *directory) {
+    return [path isEqualToString:directory] || [path hasPrefix:[directory stringByAppendingString:@"/"]];
+}
+
+static NSString *iTermGitStatusEngineString(const char *path, size_t length) {
+    if (!length) {
+        return @"";
+    }
+    return [[NSFileManager defaultManager] stringWithFileSystemRepresentation:path length:length];
+}
+
+// Counts each path once for every directory above it.
+static NSCountedSet<NSString *> *iTermGitStatusEngineCountDirectories(char **paths, int count) {
+    NSCountedSet<NSString *> *directories = [[NSCountedSet alloc] init];
+    for (int i = 0; i < count; i++) {
+        const char *path = paths[i];
+        [directories addObject:@""];
+        for (const char *slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+            [directories addObject:iTermGitStatusEngineString(path, slash - path + 1)];
+        }
+    }
+    return directories;
+}
+
+// The status of a whole work tree from one walk. The state for any directory in it is derived
+// from this, so sessions in different directories of a repository don't each walk it.
+@interface iTermGitStatusEngineWorkTreeStatus : NSObject
+// Its adds and deletes are for the whole work tree.
+@property (nonatomic, strong) iTermGitState *state;
+// Untracked and deleted files counted under each directory, keyed by the directory relative to
+// the work tree with a trailing slash, or the empty string for the top.
+@property (nonatomic, strong) NSCountedSet<NSString *> *untrackedDirectories;
+@property (nonatomic, strong) NSCountedSet<NSString *> *deletedDirectories;
+// Younger than the TTL.
+@property (nonatomic, readonly) BOOL isFresh;
+
+- (instancetype)initWithState:(iTermGitState *)state status:(const iTermGitWorkTreeStatus *)status;
+- (iTermGitState *)stateForPrefix:(NSString *)prefix;
+@end
+
+@implementation iTermGitStatusEngineWorkTreeStatus
+
+- (instancetype)initWithState:(iTermGitState *)state status:(const iTermGitWorkTreeStatus *)status {
+    self = [super init];
+    if (self) {
+        _state = state;
+        _untrackedDirectories = iTermGitStatusEngineCountDirectories(status->untrackedPaths, status->untracked);
+        _deletedDirectories = iTermGitStatusEngineCountDirectories(status->deletedPaths, status->deleted);
+    }
+    return self;
+}
+
+// Like running the script in the directory |prefix|.
+- (iTermGitState *)stateForPrefix:(NSString *)prefix {
+    iTermGitState *state = [_state copy];
+    state.adds = [_untrackedDirectories countForObject:prefix];
+    state.deletes = [_deletedDirectories countForObject:prefix];
+    return state;
+}
+
+- (BOOL)isFresh {
+    return _state.age < iTermGitStatusEngineRepositoryTTL;
+}
+
+@end
+
+@interface iTermGitStatusEngineResult : NSObject
+// The path that was computed.
+@property (nonatomic, copy) NSString *path;
+// nil if git must be run instead.
+@property (nonatomic, strong, nullable) iTermGitState *state;
+// nil if the path isn't in a repository.
+@property (nonatomic, copy, nullable) NSString *workTree;
+@property (nonatomic, strong, nullable) iTermGitStatusEngineRepositoryPaths *repositoryPaths;
+// The path's directory relative to the work tree. See iTermGitRepositoryPrefix().
+@property (nonatomic, copy, nullable) NSString *prefix;
+// nil if the work tree's status is unknown.
+@property (nonatomic, strong, nullable) iTermGitStatusEngineWorkTreeStatus *workTreeStatus;
+// Memoized ahead/behind counts keyed by the pair of commits they were computed for.
+@property (nonatomic, copy, nullable) NSString *aheadBehindKey;
+@property (nonatomic, copy, nullable) NSArray<NSNumber *> *aheadBehind;
+@end
+
+@implementation iTermGitStatusEngineResult
+@end
+
+static void iTermGitStatusEngineParallelFor(size_t iterations,
+                                            void *context,
+                                            void (*work)(void *context, size_t i)) {
+    dispatch_apply_f(iterations, DISPATCH_APPLY_AUTO, context, work);
+}
+
+@interface iTermGitStatusEngine () <SCEventListenerProtocol>
+@end
+
+@implementation iTermGitStatusEngine {
+    dispatch_queue_t _queue;
+
+    // States for paths outside repositories.
+    iTermGitCache *_cache;
+
+    // Keyed by work tree if the requested path's is known, otherwise by path.
+    NSMutableDictionary<NSString *, NSMutableArray<iTermGitStatusEngineDelivery> *> *_outstanding;
+
+    // Requested path -> work tree root and prefix, for paths in a repository.
+    NSMutableDictionary<NSString *, NSString *> *_workTrees;
+    NSMutableDictionary<NSString *, NSString *> *_prefixes;
+
+    // Work tree root -> its status until FSEvents reports a change in it.
+    NSMutableDictionary<NSString *, iTermGitStatusEngineWorkTreeStatus *> *_workTreeStatuses;
+
+    // Incremented whenever statuses are discarded, so a walk that started before then isn't cached.
+    NSUInteger _generation;
+
+    // Most recently used last.
+    NSMutableArray<iTermGitStatusEngineRepositoryPaths *> *_watchedRepositories;
+    SCEvents *_events;
+
+    // Counting commits is the only part whose cost grows with history, and its inputs are two
+    // immutable commits.
+    NSMutableDictionary<NSString *, NSArray<NSNumber *> *> *_aheadBehindCache;
+}
+
++ (instancetype)sharedInstance {
+    static id instance;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        instance = [[self alloc] init];
+    });
+    return instance;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _queue = dispatch_queue_create("com.iterm2.git-status",
+                                       dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_CONCURRENT,
+                                                                               QOS_CLASS_UTILITY,
+                                                                               0));
+        _cache = [[iTermGitCache alloc] init];
+        _outstanding = [NSMutableDictionary dictionary];
+        _workTrees = [NSMutableDictionary dictionary];
+        _prefixes = [NSMutableDictionary dictionary];
+        _workTreeStatuses = [NSMutableDictionary dictionary];
+        _watchedRepositories = [NSMutableArray array];
+        _aheadBehindCache = [NSMutableDictionary dictionary];
+        _events = [[SCEvents alloc] init];
+        _events.delegate = self;
+        _events.notificationLatency = 0.5;
+    }
+    return self;
+}
+
+#pragma mark - APIs
+
+- (void)requestPath:(NSString *)path completion:(iTermGitStatusEngineCallback)completion {
+    NSString *workTree = _workTrees[path];
+    if (workTree) {
+        iTermGitStatusEngineWorkTreeStatus *workTreeStatus = _workTreeStatuses[workTree];
+        NSString *prefix = _prefixes[path];
+        if (workTreeStatus.isFresh && prefix) {
+            iTermGitState *state = [workTreeStatus stateForPrefix:prefix];
+            DLog(@"git status engine: return %@ for path %@ from cached status of %@", state, path, workTree);
+            completion(state);
+            return;
+        }
+    } else {
+        // Paths outside repositories can't be watched, so they're rechecked at the old polling
+        // rate in case one gets created.
+        iTermGitState *cached = [_cache stateForPath:path maximumAge:[iTermAdvancedSettingsModel gitTimeout]];
+        if (cached) {
+            DLog(@"git status engine: return cached value %@ for path %@", cached, path);
+            completion(cached);
+            return;
+        }
+    }
+
+    iTermGitStatusEngineDelivery delivery = ^(iTermGitStatusEngineResult * _Nullable result) {
+        completion(result ? [self stateForPath:path result:result] : nil);
+    };
+    // One walk answers every directory in a work tree.
+    NSString *key = workTree ?: path;
+    NSMutableArray<iTermGitStatusEngineDelivery> *deliveries = _outstanding[key];
+    if (deliveries) {
+        DLog(@"git status engine: attach request for %@ to existing computation for %@", path, key);
+        [deliveries addObject:delivery];
+        return;
+    }
+    deliveries = [NSMutableArray arrayWithObject:delivery];
+    _outstanding[key] = deliveries;
+
+    DLog(@"git status engine: compute status for %@", path);
+    NSDictionary<NSString *, NSArray<NSNumber *> *> *aheadBehindCache = [_aheadBehindCache copy];
+    NSDictionary<NSString *, iTermGitStatusEngineWorkTreeStatus *> *workTreeStatuses = [_workTreeStatuses copy];
+    const NSUInteger generation = _generation;
+    dispatch_async(_queue, ^{
+        iTermGitStatusEngineResult *result = [iTermGitStatusEngine resultForPath:path
+                                                                workTreeStatuses:workTreeStatuses
+                                                                aheadBehindCache:aheadBehindCache];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self didComputeResult:result key:key generation:generation deliveries:deliveries];
+        });
+    });
+
+    // A hung network file system shouldn't leave the component spinning forever. Report failure
+    // so the caller can fall back to its previous behavior.
+    const NSTimeInterval timeout = [iTermAdvancedSettingsModel gitTimeout];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        if (self->_outstanding[key] != deliveries) {
+            return;
+        }
+        DLog(@"git status engine: timed out computing status for %@", key);
+        [self->_outstanding removeObjectForKey:key];
+        for (iTermGitStatusEngineDelivery delivery in deliveries) {
+            delivery(nil);
+        }
+    });
+}
+
+- (void)invalidateCacheForPath:(NSString *)path {
+    DLog(@"git status engine: remove cache entry for path %@", path);
+    [_cache removeStateForPath:path];
+    NSString *workTree = _workTrees[path];
+    if (workTree) {
+        [_workTreeStatuses removeObjectForKey:workTree];
+        _generation += 1;
+    }
+}
+
+#pragma mark - Private
+
+- (void)didComputeResult:(iTermGitStatusEngineResult *)result
+                     key:(NSString *)key
+              generation:(NSUInteger)generation
+              deliveries:(NSArray<iTermGitStatusEngineDelivery> *)deliveries {
+    NSString *path = result.path;
+    DLog(@"git status engine: computed %@ for %@ in work tree %@", result.state, path, result.workTree);
+    if (result.aheadBehindKey && result.aheadBehind) {
+        _aheadBehindCache[result.aheadBehindKey] = result.aheadBehind;
+    }
+    if (result.workTree) {
+        _workTrees[path] = result.workTree;
+        _prefixes[path] = result.prefix;
+        [self watchRepository:result.repositoryPaths];
+        if (result.workTreeStatus && generation == _generation) {
+            _workTreeStatuses[result.workTree] = result.workTreeStatus;
+        }
+    } else {
+        [_workTrees removeObjectForKey:path];
+        [_prefixes removeObjectForKey:path];
+        if (result.state) {
+            [_cache setState:result.state forPath:path ttl:[iTermAdvancedSettingsModel gitTimeout]];
+        }
+    }
+    if (_outstanding[key] != deliveries) {
+        // Timed out.
+        return;
+    }
+    [_outstanding removeObjectForKey:key];
+    for (iTermGitStatusEngineDelivery delivery in deliveries) {
+        delivery(result);
+    }
+}
+
+// Other requests that waited on the same work tree get a state derived from its status.
+- (nullable iTermGitState *)stateForPath:(NSString *)path result:(iTermGitStatusEngineResult *)result {
+    if ([path isEqualToString:result.path]) {
+        return result.state;
+    }
+    NSString *prefix = _prefixes[path];
+    if (!result.workTreeStatus || !prefix || ![_workTrees[path] isEqualToString:result.workTree]) {
+        return nil;
+    }
+    return [result.workTreeStatus stateForPrefix:prefix];
+}
+
+// Runs on a background queue. The work tree isn't walked if |workTreeStatuses| has a fresh status
+// for it.
++ (iTermGitStatusEngineResult *)resultForPath:(NSString *)path
+                             workTreeStatuses:(NSDictionary<NSString *, iTermGitStatusEngineWorkTreeStatus *> *)workTreeStatuses
+                             aheadBehindCache:(NSDictionary<NSString *, NSArray<NSNumber *> *> *)aheadBehindCache {
+    iTermGitStatusEngineResult *result = [[iTermGitStatusEngineResult alloc] init];
+    result.path = path;
+    // Users might be using triggers to "Report Directory", which could pick up a path with a '~'.
+    iTermGitRepository *repository = iTermGitRepositoryOpen(path.stringByExpandingTildeInPath.fileSystemRepresentation);
+    if (!repository) {
+        // Same as what the script reports when git fails.
+        iTermGitState *state = [[iTermGitState alloc] init];
+        state.xcode = @"";
+        state.branch = @"";
+        state.pushArrow = @"error";
+        state.pullArrow = @"";
+        result.state = state;
+        return result;
+    }
+    NSString *(^string)(const char *) = ^NSString *(const char *cString) {
+        return iTermGitStatusEngineString(cString, strlen(cString));
+    };
+    result.workTree = string(iTermGitRepositoryWorkTree(repository));
+    result.prefix = string(iTermGitRepositoryPrefix(repository));
+    iTermGitStatusEngineRepositoryPaths *repositoryPaths = [[iTermGitStatusEngineRepositoryPaths alloc] init];
+    repositoryPaths.workTree = result.workTree;
+    repositoryPaths.gitDirectory = string(iTermGitRepositoryGitDirectory(repository));
+    repositoryPaths.commonDirectory = string(iTermGitRepositoryCommonDirectory(repository));
+    result.repositoryPaths = repositoryPaths;
+
+    iTermGitStatusEngineWorkTreeStatus *existing = workTreeStatuses[result.workTree];
+    if (existing.isFresh) {
+        iTermGitRepositoryFree(repository);
+        result.workTreeStatus = existing;
+        result.state = [existing stateForPrefix:result.prefix];
+        return result;
+    }
+
+    iTermGitHead head;
+    if (!iTermGitRepositoryReadHead(repository, &head)) {
+        iTermGitRepositoryFree(repository);
+        return result;
+    }
+    iTermGitState *state = [[iTermGitState alloc] init];
+    state.xcode = @"";
+    state.branch = [NSString stringWithUTF8String:head.branch] ?: @"";
+
+    if (head.hasHead && head.hasUpstream) {
+        char headHex[41];
+        char upstreamHex[41];
+        iTermGitFormatObjectID(head.head, headHex);
+        iTermGitFormatObjectID(head.upstream, upstreamHex);
+        NSString *key = [NSString stringWithFormat:@"%s...%s", headHex, upstreamHex];
+        NSArray<NSNumber *> *counts = aheadBehindCache[key];
+        if (!counts) {
+            int ahead = 0;
+            int behind = 0;
+            if (!iTermGitRepositoryCountAheadBehind(repository,
+                                                    &head,
+                                                    iTermGitStatusEngineMaximumCommits,
+                                                    &ahead,
+                                                    &behind)) {
+                iTermGitRepositoryFree(repository);
+                return result;
+            }
+            counts = @[ @(ahead), @(behind) ];
+            result.aheadBehindKey = key;
+            result.aheadBehind = counts;
+        }
+        state.pushArrow = [counts[0] stringValue];
+        state.pullArrow = [counts[1] stringValue];
+    } else {
+        state.pushArrow = @"error";
+        state.pullArrow = @"";
+    }
+
+    iTermGitWorkTreeStatus status;
+    iTermGitRepositoryGetWorkTreeStatus(repository, &head, iTermGitStatusEngineParallelFor, &status);
+    iTermGitRepositoryFree(repository);
+    if (!status.stagedKnown || !status.workTreeKnown || !status.untrackedKnown) {
+        iTermGitWorkTreeStatusFree(&status);
+        return result;
+    }
+    state.dirty = (status.staged || status.modified > 0 || status.deleted > 0 || status.untracked > 0);
+    state.adds = status.untracked;
+    state.deletes = status.deleted;
+    result.workTreeStatus = [[iTermGitStatusEngineWorkTreeStatus alloc] initWithState:state status:&status];
+    iTermGitWorkTreeStatusFree(&status);
+    result.state = [result.workTreeStatus stateForPrefix:result.prefix];
+    return result;
+}
+
+- (void)watchRepository:(iTermGitStatusEngineRepositoryPaths *)repositoryPaths {
+    const NSUInteger index = [_watchedRepositories indexOfObjectPassingTest:^BOOL(iTermGitStatusEngineRepositoryPaths *watched, NSUInteger idx, BOOL *stop) {
+        return [watched.workTree isEqualToString:repositoryPaths.workTree];
+    }];
+    if (index != NSNotFound) {
+        iTermGitStatusEngineRepositoryPaths *watched = _watchedRepositories[index];
+        [_watchedRepositories removeObjectAtIndex:index];
+        [_watchedRepositories addObject:repositoryPaths];
+        if ([watched.roots isEqualToArray:repositoryPaths.roots]) {
+            return;
+        }
+    } else {
+        [_watchedRepositories addObject:repositoryPaths];
+        while (_watchedRepositories.count > iTermGitStatusEngineMaximumWatchedWorkTrees) {
+            [_watchedRepositories removeObjectAtIndex:0];
+        }
+    }
+    if (_events.isWatchingPaths) {
+        [_events stopWatchingPaths];
+    }
+    NSMutableOrderedSet<NSString *> *paths = [NSMutableOrderedSet orderedSet];
+    NSMutableOrderedSet<NSString *> *excluded = [NSMutableOrderedSet orderedSet];
+    for (iTermGitStatusEngineRepositoryPaths *watched in _watchedRepositories) {
+        [paths addObject:watched.workTree];
+        for (NSString *directory in @[ watched.gitDirectory, watched.commonDirectory ]) {
+            if (!iTermGitStatusEnginePathIsInDirectory(directory, watched.workTree)) {
+                [paths addObject:directory];
+            }
+        }
+        // Writing objects never changes the status by itself; a ref or the index changes too.
+        [excluded addObject:[watched.commonDirectory stringByAppendingPathComponent:@"objects"]];
+    }
+    DLog(@"git status engine: now watching %@ excluding %@", paths, excluded);
+    _events.excludedPaths = excluded.array;
+    [_events startWatchingPaths:paths.array];
+}
+
+// A change in a common directory affects every work tree that shares it.
+- (NSArray<NSString *> *)workTreesContainingPath:(NSString *)path {
+    NSMutableArray<NSString *> *result = [NSMutableArray array];
+    for (iTermGitStatusEngineRepositoryPaths *watched in _watchedRepositories) {
+        for (NSString *root in watched.roots) {
+            if (iTermGitStatusEnginePathIsInDirectory(path, root)) {
+                [result addObject:watched.workTree];
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+#pragma mark - SCEventListenerProtocol
+
+- (void)pathWatcher:(SCEvents *)pathWatcher eventOccurred:(SCEvent *)event {
+    NSString *eventPath = event.eventPath;
+    if ([eventPath hasSuffix:@"/"]) {
+        eventPath = [eventPath substringToIndex:eventPath.length - 1];
+    }
+    NSArray<NSString *> *changedWorkTrees = [self workTreesContainingPath:eventPath];
+    if (!changedWorkTrees.count) {
+        return;
+    }
+    for (NSString *workTree in changedWorkTrees) {
+        [_workTreeStatuses removeObjectForKey:workTree];
+    }
+    _generation += 1;
+    NSMutableArray<NSString *> *invalidated = [NSMutableArray array];
+    [_workTrees enumerateKeysAndObjectsUsingBlock:^(NSString *path, NSString *workTree, BOOL *stop) {
+        if ([changedWorkTrees containsObject:workTree]) {
+            [invalidated addObject:path];
+        }
+    }];
+    DLog(@"git status engine: %@ changed. Invalidate %@", eventPath, invalidated);
+    if (!invalidated.count) {
+        return;
+    }
+    [[NSNotificationCenter defaultCenter] postNotificationName:iTermGitStatusEngineRepositoryDidChangeNotification
+                                                        object:self
+                                                      userInfo:@{ iTermGitStatusEngineInvalidatedPathsKey: invalidated }];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -8,18 +8,27 @@
 #import "iTermGlobalSearchEngine.h"
 
 #import "NSArray+iTerm.h"
-#import "NSTimer+iTerm.h"
 #import "PTYSession.h"
-#import "SearchResult.h"
-#import "iTermGlobalSearchEngineCursor.h"
+#import "VT100Screen.h"
 #import "iTermGlobalSearchResult.h"
-#import "iTermTextExtractor.h"
+#import "iTermGlobalSearchSnapshot.h"
+
+// How often each search reports results and progress.
+static const NSTimeInterval iTermGlobalSearchEngineBatchInterval = 0.1;
 
 @implementation iTermGlobalSearchEngine {
-    NSTimer *_timer;
-    NSMutableArray<iTermGlobalSearchEngineCursor *> *_cursors;
+    // Sessions that haven't been snapshotted yet. Snapshots are taken just before their search
+    // begins so that at most a few copies of scrollback exist at once.
+    NSMutableArray<PTYSession *> *_pendingSessions;
+    NSMutableArray<iTermGlobalSearchSnapshot *> *_activeSnapshots;
+    NSMapTable<iTermGlobalSearchSnapshot *, NSNumber *> *_progress;
+    dispatch_queue_t _queue;
+    NSUInteger _maximumConcurrentSearches;
     NSUInteger _retiredLines;
     NSUInteger _expectedLines;
+    NSDictionary *_regularAttributes;
+    NSDictionary *_matchAttributes;
+    BOOL _stopped;
 }
 
 - (instancetype)initWithQuery:(NSString *)query
@@ -33,97 +42,129 @@
         _query = [query copy];
         _handler = [handler copy];
         _mode = mode;
-        _cursors = [[sessions mapWithBlock:^id(PTYSession *session) {
-            FindContext *findContext = [[FindContext alloc] init];
-            [session.screen setFindString:query
-                         forwardDirection:NO
-                                     mode:mode
-                              startingAtX:0
-                              startingAtY:session.screen.numberOfLines + 1 + session.screen.totalScrollbackOverflow
-                               withOffset:0
-                                inContext:findContext
-                          multipleResults:YES];
-            iTermGlobalSearchEngineCursor *cursor = [[iTermGlobalSearchEngineCursor alloc] init];
-            cursor.session = session;
-            cursor.findContext = findContext;
+        _sessions = [sessions copy];
+        _pendingSessions = [sessions mutableCopy];
+        _activeSnapshots = [NSMutableArray array];
+        _progress = [NSMapTable strongToStrongObjectsMapTable];
+        for (PTYSession *session in sessions) {
             _expectedLines += session.screen.numberOfLines;
-            return cursor;
-        }] mutableCopy];
-        _timer = [NSTimer scheduledWeakTimerWithTimeInterval:0
-                                                      target:self
-                                                    selector:@selector(searchMore:)
-                                                    userInfo:nil
-                                                     repeats:YES];
+        }
+        // Leave a core for the main thread.
+        _maximumConcurrentSearches = MAX(1, (NSInteger)[[NSProcessInfo processInfo] activeProcessorCount] - 1);
+        _queue = dispatch_queue_create("com.iterm2.global-search",
+                                       dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_CONCURRENT,
+                                                                               QOS_CLASS_USER_INITIATED,
+                                                                               0));
+        // Fonts are made here because snippets are built off the main thread.
+        NSFont *font = [NSFont systemFontOfSize:[NSFont systemFontSize]];
+        _matchAttributes = @{
+            NSUnderlineStyleAttributeName: @(NSUnderlineStyleSingle),
+            NSBackgroundColorAttributeName: [NSColor colorWithRed:1 green:1 blue:0 alpha:0.35],
+            NSFontAttributeName: font
+        };
+        _regularAttributes = @{
+            NSFontAttributeName: font
+        };
+        // Report asynchronously, as the timer-driven search did, so the caller can store the
+        // engine before its handler runs.
+        __weak __typeof(self) weakSelf = self;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [weakSelf startSearchesIfNeeded];
+        });
     }
     return self;
 }
 
 - (void)stop {
+    if (_stopped) {
+        return;
+    }
+    _stopped = YES;
+    for (iTermGlobalSearchSnapshot *snapshot in _activeSnapshots) {
+        snapshot.canceled = YES;
+    }
+    [_activeSnapshots removeAllObjects];
+    [_pendingSessions removeAllObjects];
     self.handler(nil, nil, 1);
-    [_timer invalidate];
-    _timer = nil;
 }
 
-- (void)searchMore:(NSTimer *)timer {
-    iTermGlobalSearchEngineCursor *cursor = _cursors.firstObject;
-    if (!cursor) {
-        [self stop];
+#pragma mark - Private
+
+- (void)startSearchesIfNeeded {
+    if (_stopped) {
         return;
     }
-    [_cursors removeObjectAtIndex:0];
-    const BOOL more = [self searchWithCursor:cursor];
-    if (more) {
-        [_cursors addObject:cursor];
-        return;
+    while (_activeSnapshots.count < _maximumConcurrentSearches && _pendingSessions.count > 0) {
+        PTYSession *session = _pendingSessions.firstObject;
+        [_pendingSessions removeObjectAtIndex:0];
+        [self startSearchInSession:session];
     }
-    if (_cursors.count == 0) {
+    if (_activeSnapshots.count == 0) {
         [self stop];
     }
 }
 
-- (NSAttributedString *)snippetFromExtractor:(iTermTextExtractor *)extractor result:(SearchResult *)result {
-    const VT100GridAbsCoordRange range = VT100GridAbsCoordRangeMake(result.startX,
-                                                                    result.absStartY,
-                                                                    result.endX + 1,
-                                                                    result.absEndY);
-    NSDictionary *matchAttributes = @{
-        NSUnderlineStyleAttributeName: @(NSUnderlineStyleSingle),
-        NSBackgroundColorAttributeName: [NSColor colorWithRed:1 green:1 blue:0 alpha:0.35],
-        NSFontAttributeName: [NSFont systemFontOfSize:[NSFont systemFontSize]]
-    };
-    NSDictionary *regularAttributes = @{
-        NSFontAttributeName: [NSFont systemFontOfSize:[NSFont systemFontSize]]
-    };
-    return [extractor attributedStringForSnippetForRange:range
-                                       regularAttributes:regularAttributes
-                                         matchAttributes:matchAttributes
-                                     maximumPrefixLength:20
-                                     maximumSuffixLength:256];
+- (void)startSearchInSession:(PTYSession *)session {
+    iTermGlobalSearchSnapshot *snapshot = [[iTermGlobalSearchSnapshot alloc] initWithSession:session];
+    [_activeSnapshots addObject:snapshot];
+
+    // The background block must not use self.
+    NSString *query = _query;
+    const iTermFindMode mode = _mode;
+    NSDictionary *regularAttributes = _regularAttributes;
+    NSDictionary *matchAttributes = _matchAttributes;
+    __weak __typeof(self) weakSelf = self;
+    dispatch_async(_queue, ^{
+        [snapshot searchFor:query
+                       mode:mode
+          regularAttributes:regularAttributes
+            matchAttributes:matchAttributes
+              batchInterval:iTermGlobalSearchEngineBatchInterval
+                    handler:^(NSArray<iTermGlobalSearchResult *> *results, double progress) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [weakSelf snapshot:snapshot didFindResults:results progress:progress];
+            });
+        }];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [weakSelf snapshotDidFinish:snapshot];
+        });
+    });
+}
+
+- (void)snapshot:(iTermGlobalSearchSnapshot *)snapshot
+  didFindResults:(NSArray<iTermGlobalSearchResult *> *)results
+        progress:(double)progress {
+    if (_stopped || snapshot.canceled) {
+        return;
+    }
+    PTYSession *session = snapshot.session;
+    if (!session) {
+        return;
+    }
+    for (iTermGlobalSearchResult *result in results) {
+        result.session = session;
+    }
+    [_progress setObject:@(progress) forKey:snapshot];
+    self.handler(session, results, [self progress]);
 }
 
-- (BOOL)searchWithCursor:(iTermGlobalSearchEngineCursor *)cursor {
-    NSMutableArray<SearchResult *> *results = [NSMutableArray array];
-    const BOOL more = [cursor.session.screen continueFindAllResults:results inContext:cursor.findContext];
-    iTermTextExtractor *extractor = [[iTermTextExtractor alloc] initWithDataSource:cursor.session.screen];
-    NSArray<iTermGlobalSearchResult *> *mapped = [results mapWithBlock:^id(SearchResult *anObject) {
-        iTermGlobalSearchResult *result = [[iTermGlobalSearchResult alloc] init];
-        result.session = cursor.session;
-        result.result = anObject;
-        result.snippet = [self snippetFromExtractor:extractor result:anObject];
-        return result;
-    }];
-    self.handler(cursor.session, mapped, [self progressIncludingCursor:cursor]);
-    if (!more) {
-        _retiredLines += cursor.session.screen.numberOfLines;
+- (void)snapshotDidFinish:(iTermGlobalSearchSnapshot *)snapshot {
+    if (_stopped) {
+        return;
     }
-    return more;
+    [_activeSnapshots removeObjectIdenticalTo:snapshot];
+    [_progress removeObjectForKey:snapshot];
+    _retiredLines += snapshot.numberOfLines;
+    [self startSearchesIfNeeded];
 }
 
-- (double)progressIncludingCursor:(iTermGlobalSearchEngineCursor *)additionalCursor {
+- (double)progress {
+    if (_expectedLines == 0) {
+        return 0;
+    }
     double done = _retiredLines;
-
-    for (iTermGlobalSearchEngineCursor *cursor in [_cursors arrayByAddingObject:additionalCursor]) {
-        done += cursor.findContext.progress * cursor.session.screen.numberOfLines;
+    for (iTermGlobalSearchSnapshot *snapshot in _activeSnapshots) {
+        done += [[_progress objectForKey:snapshot] doubleValue] * snapshot.numberOfLines;
     }
     return MIN(1, MAX(0, done / _expectedLines));
 }
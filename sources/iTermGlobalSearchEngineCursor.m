@@ -1,12 +0,0 @@
-//
-//  iTermGlobalSearchEngineCursor.m
-//  iTerm2SharedARC
-//
-//  Created by George Nachman on 8/22/20.
-//
-
-#import "iTermGlobalSearchEngineCursor.h"
-
-@implementation iTermGlobalSearchEngineCursor
-
-@end
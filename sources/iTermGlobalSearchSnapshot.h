@@ -0,0 +1,45 @@
+//
+//  iTermGlobalSearchSnapshot.h
+//  iTerm2SharedARC
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "iTermFindDriver.h"
+#import "PTYTextViewDataSource.h"
+
+@class iTermGlobalSearchResult;
+@class PTYSession;
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A copy of a session's scrollback and screen, taken on the main thread, that
+// can be searched on a background thread while the session keeps running.
+// Snippets are built from the copy rather than the live screen, so it also
+// serves as the text extractor's data source.
+@interface iTermGlobalSearchSnapshot : NSObject<iTermTextDataSource>
+
+// Only use this on the main thread.
+@property (nonatomic, readonly, weak) PTYSession *session;
+
+// Set from any thread to make -searchFor:... return soon.
+@property (atomic) BOOL canceled;
+
+- (instancetype)initWithSession:(PTYSession *)session NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+// Searches from the bottom up, calling |handler| on the calling thread with
+// batches of results at most every |batchInterval| seconds and once at the end.
+// Results don't have their session set. |progress| is between 0 and 1.
+- (void)searchFor:(NSString *)query
+             mode:(iTermFindMode)mode
+regularAttributes:(NSDictionary *)regularAttributes
+  matchAttributes:(NSDictionary *)matchAttributes
+    batchInterval:(NSTimeInterval)batchInterval
+          handler:(void (^NS_NOESCAPE)(NSArray<iTermGlobalSearchResult *> *results, double progress))handler;
+
+@end
+
+NS_ASSUME_NONNULL_END
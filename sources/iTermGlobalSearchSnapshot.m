@@ -0,0 +1,157 @@
+//
+//  iTermGlobalSearchSnapshot.m
+//  iTerm2SharedARC
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import "iTermGlobalSearchSnapshot.h"
+
+#import "FindContext.h"
+#import "LineBuffer.h"
+#import "LineBufferHelpers.h"
+#import "NSDate+iTerm.h"
+#import "PTYSession.h"
+#import "SearchResult.h"
+#import "VT100Screen.h"
+#import "iTermGlobalSearchResult.h"
+#import "iTermTextExtractor.h"
+
+@implementation iTermGlobalSearchSnapshot {
+    LineBuffer *_lineBuffer;
+    int _width;
+    int _numberOfLines;
+    long long _totalScrollbackOverflow;
+    NSMutableData *_lineData;
+}
+
+- (instancetype)initWithSession:(PTYSession *)session {
+    self = [super init];
+    if (self) {
+        _session = session;
+        _lineBuffer = [session.screen newLineBufferSnapshotIncludingScreen];
+        _width = session.screen.width;
+        _numberOfLines = [_lineBuffer numLinesWithWidth:_width];
+        _totalScrollbackOverflow = session.screen.totalScrollbackOverflow;
+        _lineData = [NSMutableData dataWithLength:sizeof(screen_char_t) * (_width + 1)];
+    }
+    return self;
+}
+
+#pragma mark - Search
+
+- (void)searchFor:(NSString *)query
+             mode:(iTermFindMode)mode
+regularAttributes:(NSDictionary *)regularAttributes
+  matchAttributes:(NSDictionary *)matchAttributes
+    batchInterval:(NSTimeInterval)batchInterval
+          handler:(void (^NS_NOESCAPE)(NSArray<iTermGlobalSearchResult *> *, double))handler {
+    // Copies the scrollback blocks here rather than on the main thread.
+    [_lineBuffer finishDetachedCopy];
+    if (_numberOfLines == 0) {
+        handler(@[], 1);
+        return;
+    }
+    FindContext *context = [[FindContext alloc] init];
+    [_lineBuffer prepareToSearchFor:query
+                         startingAt:[[_lineBuffer lastPosition] predecessor]
+                            options:FindOptBackwards | FindMultipleResults
+                               mode:mode
+                        withContext:context];
+    LineBufferPosition *stopAt = [_lineBuffer firstPosition];
+    iTermTextExtractor *extractor = [[iTermTextExtractor alloc] initWithDataSource:self];
+    NSMutableArray<iTermGlobalSearchResult *> *batch = [NSMutableArray array];
+    NSTimeInterval lastBatchTime = [NSDate it_timeSinceBoot];
+
+    while (!self.canceled) {
+        [_lineBuffer findSubstring:context stopAt:stopAt];
+        if (context.status == NotFound) {
+            break;
+        }
+        if (context.status == Matched) {
+            for (XYRange *xyrange in [_lineBuffer convertPositions:context.results withWidth:_width]) {
+                SearchResult *searchResult = [[SearchResult alloc] init];
+                searchResult.startX = xyrange->xStart;
+                searchResult.endX = xyrange->xEnd;
+                searchResult.absStartY = xyrange->yStart + _totalScrollbackOverflow;
+                searchResult.absEndY = xyrange->yEnd + _totalScrollbackOverflow;
+
+                iTermGlobalSearchResult *result = [[iTermGlobalSearchResult alloc] init];
+                result.result = searchResult;
+                result.snippet = [self snippetFromExtractor:extractor
+                                                     result:searchResult
+                                          regularAttributes:regularAttributes
+                                            matchAttributes:matchAttributes];
+                [batch addObject:result];
+            }
+            [context.results removeAllObjects];
+            context.status = Searching;
+        }
+        const NSTimeInterval now = [NSDate it_timeSinceBoot];
+        if (now - lastBatchTime >= batchInterval) {
+            handler(batch, [self progressOfContext:context]);
+            batch = [NSMutableArray array];
+            lastBatchTime = now;
+        }
+    }
+    if (!self.canceled) {
+        handler(batch, 1);
+    }
+}
+
+- (double)progressOfContext:(FindContext *)context {
+    const int numDropped = [_lineBuffer numberOfDroppedBlocks];
+    const double current = context.absBlockNum - numDropped;
+    const double max = [_lineBuffer largestAbsoluteBlockNumber] - numDropped;
+    if (max <= 0) {
+        return 0;
+    }
+    return MIN(1, MAX(0, 1.0 - current / max));
+}
+
+- (NSAttributedString *)snippetFromExtractor:(iTermTextExtractor *)extractor
+                                      result:(SearchResult *)result
+                           regularAttributes:(NSDictionary *)regularAttributes
+                             matchAttributes:(NSDictionary *)matchAttributes {
+    const VT100GridAbsCoordRange range = VT100GridAbsCoordRangeMake(result.startX,
+                                                                    result.absStartY,
+                                                                    result.endX + 1,
+                                                                    result.absEndY);
+    return [extractor attributedStringForSnippetForRange:range
+                                       regularAttributes:regularAttributes
+                                         matchAttributes:matchAttributes
+                                     maximumPrefixLength:20
+                                     maximumSuffixLength:256];
+}
+
+#pragma mark - iTermTextDataSource
+
+- (int)width {
+    return _width;
+}
+
+- (int)numberOfLines {
+    return _numberOfLines;
+}
+
+- (long long)totalScrollbackOverflow {
+    return _totalScrollbackOverflow;
+}
+
+- (screen_char_t *)getLineAtIndex:(int)theIndex {
+    screen_char_t *buffer = _lineData.mutableBytes;
+    screen_char_t continuation;
+    int cont = [_lineBuffer copyLineToBuffer:buffer
+                                       width:_width
+                                     lineNum:theIndex
+                                continuation:&continuation];
+    if (cont == EOL_DWC) {
+        buffer[_width - 1].code = DWC_SKIP;
+        buffer[_width - 1].complexChar = NO;
+    }
+    buffer[_width] = continuation;
+    buffer[_width].code = cont;
+    return buffer;
+}
+
+@end
@@ -297,6 +297,10 @@
              state:(iTermGraphDatabaseState *)state {
     DLog(@"Start saving");
     NSDate *start = [NSDate date];
+    __block NSInteger inserts = 0;
+    __block NSInteger updates = 0;
+    __block NSInteger deletes = 0;
+    __block NSInteger bytes = 0;
     const BOOL ok =
     [encoder enumerateRecords:^(iTermEncoderGraphRecord * _Nullable before,
                                 iTermEncoderGraphRecord * _Nullable after,
@@ -313,14 +317,18 @@
                 *stop = YES;
                 return;
             }
+            deletes += 1;
             return;
         }
         if (!before && after) {
+            NSData *data = after.data ?: [NSData data];
             if (![state.db executeUpdate:@"insert into Node (key, identifier, parent, data) values (?, ?, ?, ?)",
-                  after.key, after.identifier, parent, after.data ?: [NSData data]]) {
+                  after.key, after.identifier, parent, data]) {
                 *stop = YES;
                 return;
             }
+            inserts += 1;
+            bytes += data.length;
             NSNumber *lastInsertRowID = state.db.lastInsertRowId;
             if (parent.integerValue == 0) {
                 DLog(@"Insert root node with path %@, rowid %@", path, lastInsertRowID);
@@ -348,18 +356,22 @@
                 }
             }
             assert(before.rowid.longLongValue == after.rowid.longLongValue);
-            if ([before.data isEqual:after.data]) {
+            NSData *data = after.data;
+            if ([before.data isEqual:data]) {
                 return;
             }
-            if (![state.db executeUpdate:@"update Node set data=? where rowid=?", after.data, before.rowid]) {
+            if (![state.db executeUpdate:@"update Node set data=? where rowid=?", data, before.rowid]) {
                 *stop = YES;
+                return;
             }
+            updates += 1;
+            bytes += data.length;
             return;
         }
         assert(NO);
     }];
-    NSDate *end = [NSDate date];
-    DLog(@"Save duration: %f0.1ms", (end.timeIntervalSinceNow - start.timeIntervalSinceNow) * 1000);
+    DLog(@"Save duration: %0.1fms. Inserted %@, updated %@, deleted %@ rows. Wrote %@ bytes.",
+         -start.timeIntervalSinceNow * 1000, @(inserts), @(updates), @(deletes), @(bytes));
     return ok;
 }
 
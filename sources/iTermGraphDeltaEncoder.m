@@ -11,6 +11,21 @@
 #import "NSArray+iTerm.h"
 #import "iTermOrderedDictionary.h"
 
+// Children are compared by identity, so this is only true when each child was carried over from the
+// previous revision.
+static BOOL iTermGraphRecordsAreEquivalent(iTermEncoderGraphRecord *before,
+                                           iTermEncoderGraphRecord *after) {
+    if (before.graphRecords.count != after.graphRecords.count) {
+        return NO;
+    }
+    for (NSUInteger i = 0; i < before.graphRecords.count; i++) {
+        if (before.graphRecords[i] != after.graphRecords[i]) {
+            return NO;
+        }
+    }
+    return [before.pod isEqualToDictionary:after.pod];
+}
+
 @implementation iTermGraphDeltaEncoder
 
 - (instancetype)initWithPreviousRevision:(iTermEncoderGraphRecord * _Nullable)previousRevision {
@@ -65,7 +80,17 @@
     if (!block(encoder)) {
         return NO;
     }
-    [self encodeGraph:encoder.record];
+    iTermEncoderGraphRecord *encoded = encoder.record;
+    if (generation == iTermGenerationAlwaysEncode &&
+        record.rowid &&
+        iTermGraphRecordsAreEquivalent(record, encoded)) {
+        // Nothing underneath it changed. Keeping the previous record lets the save skip this
+        // whole subtree without serializing or comparing it.
+        DLog(@"Record %@[%@] is unchanged after encoding", key, identifier);
+        [self encodeGraph:record];
+        return YES;
+    }
+    [self encodeGraph:encoded];
     return YES;
 }
 
@@ -120,6 +145,10 @@
                                BOOL *stop) {
         iTermEncoderGraphRecord *before = beforeDict[key];
         iTermEncoderGraphRecord *after = afterDict[key];
+        if (before == after && before.rowid) {
+            // Carried over from the previous revision, so neither it nor its descendants changed.
+            return;
+        }
         @try {
             block(before, after, parent, path, stop);
         } @catch (NSException *exception) {
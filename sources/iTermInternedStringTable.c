@@ -0,0 +1,270 @@
+//
+//  iTermInternedStringTable.c
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#include "iTermInternedStringTable.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Value of a slot in the reverse table that doesn't hold a code.
+#define ITERM_INTERNED_EMPTY 0
+
+struct iTermInternedStringTable {
+    uint32_t minCode;
+    uint32_t maxCode;
+    uint32_t reservedMin;
+    uint32_t reservedMax;
+
+    // Indexed by code. Entries are published with release stores after they're filled in and
+    // never change or go away after that.
+    _Atomic(const iTermInternedString *) *strings;
+
+    // Open-addressed table from string hash to code, with linear probing. It has room for every
+    // code at a load factor of at most one half and nothing is ever removed, so it's never rebuilt.
+    _Atomic uint32_t *slots;
+    uint32_t slotMask;
+
+    // Everything below is protected by the lock.
+    pthread_mutex_t lock;
+    uint32_t nextCode;
+    bool isFull;
+};
+
+static uint32_t iTermInternedStringHash(const uint32_t *codePoints, uint32_t length) {
+    // FNV-1a over the code points.
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        uint32_t c = codePoints[i];
+        for (int j = 0; j < 4; j++) {
+            hash ^= (c & 0xff);
+            hash *= 16777619u;
+            c >>= 8;
+        }
+    }
+    return hash;
+}
+
+static bool iTermInternedStringEquals(const iTermInternedString *string,
+                                      uint32_t hash,
+                                      const uint32_t *codePoints,
+                                      uint32_t length) {
+    return (string->hash == hash &&
+            string->length == length &&
+            !memcmp(string->codePoints, codePoints, sizeof(uint32_t) * length));
+}
+
+iTermInternedStringTable *iTermInternedStringTableCreate(uint32_t minCode,
+                                                         uint32_t maxCode,
+                                                         uint32_t reservedMin,
+                                                         uint32_t reservedMax) {
+    iTermInternedStringTable *table = calloc(1, sizeof(*table));
+    table->minCode = minCode > 0 ? minCode : 1;
+    table->maxCode = maxCode;
+    table->reservedMin = reservedMin;
+    table->reservedMax = reservedMax;
+    table->strings = calloc((size_t)maxCode + 1, sizeof(*table->strings));
+
+    // Keep the load factor under one half even when every code is in use.
+    uint32_t capacity = 16;
+    while (capacity < 2 * (maxCode - table->minCode + 1)) {
+        capacity *= 2;
+    }
+    table->slotMask = capacity - 1;
+    table->slots = calloc(capacity, sizeof(_Atomic uint32_t));
+
+    pthread_mutex_init(&table->lock, NULL);
+    table->nextCode = table->minCode;
+    return table;
+}
+
+const iTermInternedString *iTermInternedStringTableGet(const iTermInternedStringTable *table,
+                                                       uint32_t code) {
+    if (code < table->minCode || code > table->maxCode) {
+        return NULL;
+    }
+    return atomic_load_explicit(&table->strings[code], memory_order_acquire);
+}
+
+static uint32_t iTermInternedStringTableFindWithHash(const iTermInternedStringTable *table,
+                                                     uint32_t hash,
+                                                     const uint32_t *codePoints,
+                                                     uint32_t length) {
+    uint32_t i = hash & table->slotMask;
+    for (uint32_t probes = 0; probes <= table->slotMask; probes++) {
+        const uint32_t code = atomic_load_explicit(&table->slots[i], memory_order_acquire);
+        if (code == ITERM_INTERNED_EMPTY) {
+            return 0;
+        }
+        // A slot is filled only after its string is published, so the string is always there.
+        const iTermInternedString *string = iTermInternedStringTableGet(table, code);
+        if (string && iTermInternedStringEquals(string, hash, codePoints, length)) {
+            return code;
+        }
+        i = (i + 1) & table->slotMask;
+    }
+    return 0;
+}
+
+uint32_t iTermInternedStringTableFind(const iTermInternedStringTable *table,
+                                      const uint32_t *codePoints,
+                                      uint32_t length) {
+    return iTermInternedStringTableFindWithHash(table,
+                                                iTermInternedStringHash(codePoints, length),
+                                                codePoints,
+                                                length);
+}
+
+#pragma mark - Writing
+
+// Call with the lock held. The string must not already have a slot.
+static void iTermInternedStringTableAddSlot(iTermInternedStringTable *table,
+                                            uint32_t hash,
+                                            uint32_t code) {
+    uint32_t i = hash & table->slotMask;
+    while (atomic_load_explicit(&table->slots[i], memory_order_relaxed) != ITERM_INTERNED_EMPTY) {
+        i = (i + 1) & table->slotMask;
+    }
+    atomic_store_explicit(&table->slots[i], code, memory_order_release);
+}
+
+// Call with the lock held. |code| must not be assigned yet.
+static void iTermInternedStringTablePublish(iTermInternedStringTable *table,
+                                            uint32_t code,
+                                            uint32_t hash,
+                                            const uint32_t *codePoints,
+                                            uint32_t length,
+                                            uint32_t flags,
+                                            const void *object) {
+    iTermInternedString *string = malloc(sizeof(*string) + sizeof(uint32_t) * length);
+    string->object = object;
+    string->flags = flags;
+    string->hash = hash;
+    string->length = length;
+    memcpy(string->codePoints, codePoints, sizeof(uint32_t) * length);
+    atomic_store_explicit(&table->strings[code], string, memory_order_release);
+}
+
+static bool iTermInternedStringTableCodeIsReserved(const iTermInternedStringTable *table,
+                                                   uint32_t code) {
+    return code >= table->reservedMin && code <= table->reservedMax;
+}
+
+// Returns the first unassigned code at or after nextCode, wrapping around once, or 0 if every code
+// is taken. Codes are normally assigned in order so this looks at one code, but restored state can
+// leave gaps anywhere. Call with the lock held.
+static uint32_t iTermInternedStringTableAllocateCode(iTermInternedStringTable *table) {
+    if (table->isFull) {
+        return 0;
+    }
+    const uint32_t count = table->maxCode - table->minCode + 1;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t code = table->nextCode;
+        table->nextCode = (code == table->maxCode) ? table->minCode : code + 1;
+        if (!iTermInternedStringTableCodeIsReserved(table, code) &&
+            !atomic_load_explicit(&table->strings[code], memory_order_relaxed)) {
+            return code;
+        }
+    }
+    table->isFull = true;
+    return 0;
+}
+
+uint32_t iTermInternedStringTableIntern(iTermInternedStringTable *table,
+                                        const uint32_t *codePoints,
+                                        uint32_t length,
+                                        uint32_t flags,
+                                        const void *object,
+                                        bool *addedPtr) {
+    const uint32_t hash = iTermInternedStringHash(codePoints, length);
+    uint32_t code = iTermInternedStringTableFindWithHash(table, hash, codePoints, length);
+    if (code) {
+        if (addedPtr) {
+            *addedPtr = false;
+        }
+        return code;
+    }
+
+    pthread_mutex_lock(&table->lock);
+    // Another thread may have added it while this one waited for the lock.
+    code = iTermInternedStringTableFindWithHash(table, hash, codePoints, length);
+    bool added = false;
+    if (!code) {
+        code = iTermInternedStringTableAllocateCode(table);
+        if (code) {
+            iTermInternedStringTablePublish(table, code, hash, codePoints, length, flags, object);
+            iTermInternedStringTableAddSlot(table, hash, code);
+            added = true;
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    if (addedPtr) {
+        *addedPtr = added;
+    }
+    return code;
+}
+
+bool iTermInternedStringTableSet(iTermInternedStringTable *table,
+                                 uint32_t code,
+                                 const uint32_t *codePoints,
+                                 uint32_t length,
+                                 uint32_t flags,
+                                 const void *object) {
+    if (code < table->minCode || code > table->maxCode) {
+        return false;
+    }
+    const uint32_t hash = iTermInternedStringHash(codePoints, length);
+    pthread_mutex_lock(&table->lock);
+    const bool assigned = (!iTermInternedStringTableCodeIsReserved(table, code) &&
+                           !atomic_load_explicit(&table->strings[code], memory_order_relaxed));
+    if (assigned) {
+        // Restored state can give two codes the same string. Only the first gets a slot, so Find
+        // always returns the same one.
+        const bool hadCode = iTermInternedStringTableFindWithHash(table, hash, codePoints, length) != 0;
+        iTermInternedStringTablePublish(table, code, hash, codePoints, length, flags, object);
+        if (!hadCode) {
+            iTermInternedStringTableAddSlot(table, hash, code);
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+    return assigned;
+}
+
+void iTermInternedStringTableGetAllocationState(iTermInternedStringTable *table,
+                                                uint32_t *nextCodePtr,
+                                                bool *isFullPtr) {
+    pthread_mutex_lock(&table->lock);
+    *nextCodePtr = table->nextCode;
+    *isFullPtr = table->isFull;
+    pthread_mutex_unlock(&table->lock);
+}
+
+void iTermInternedStringTableSetNextCode(iTermInternedStringTable *table, uint32_t nextCode) {
+    pthread_mutex_lock(&table->lock);
+    if (nextCode >= table->minCode && nextCode <= table->maxCode) {
+        table->nextCode = nextCode;
+    }
+    pthread_mutex_unlock(&table->lock);
+}
+
+void iTermInternedStringTableEnumerate(iTermInternedStringTable *table,
+                                       void *context,
+                                       void (*callback)(void *context,
+                                                        uint32_t code,
+                                                        const iTermInternedString *string)) {
+    pthread_mutex_lock(&table->lock);
+    for (uint32_t code = table->minCode; code <= table->maxCode; code++) {
+        const iTermInternedString *string = atomic_load_explicit(&table->strings[code],
+                                                                 memory_order_relaxed);
+        if (string) {
+            callback(context, code, string);
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+}
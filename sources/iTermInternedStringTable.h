@@ -0,0 +1,96 @@
+//
+//  iTermInternedStringTable.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Maps short strings of code points to small integer codes and back. ScreenChar.m uses one to
+//  assign codes to complex characters (combining marks, surrogate pairs, emoji sequences) so they
+//  fit in a screen_char_t. Lookups in either direction never take a lock, so parsing threads and
+//  renderers can use it concurrently with a writer. Adding a string takes a mutex.
+//
+//  Codes are handed out in order and never reused, so a code means the same string for the life of
+//  the table and strings are never freed. Once the code space is used up, new strings don't get a
+//  code at all.
+//
+//  Plain C with no Foundation dependency so it can be benchmarked anywhere (see
+//  tests/interned_string_table_bench.c).
+//
+
+#ifndef iTermInternedStringTable_h
+#define iTermInternedStringTable_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct iTermInternedStringTable iTermInternedStringTable;
+
+typedef struct {
+    // Value passed to iTermInternedStringTableIntern(). The table doesn't interpret it.
+    const void *object;
+    uint32_t flags;
+    uint32_t hash;
+    uint32_t length;
+    uint32_t codePoints[];
+} iTermInternedString;
+
+// Codes are assigned from [minCode, maxCode], skipping [reservedMin, reservedMax]. Pass a reserved
+// range with reservedMin > reservedMax if there isn't one.
+iTermInternedStringTable *iTermInternedStringTableCreate(uint32_t minCode,
+                                                         uint32_t maxCode,
+                                                         uint32_t reservedMin,
+                                                         uint32_t reservedMax);
+
+// Returns the string for |code| or NULL if it isn't assigned. The result is immutable and lives as
+// long as the table. Lock free.
+const iTermInternedString *iTermInternedStringTableGet(const iTermInternedStringTable *table,
+                                                       uint32_t code);
+
+// Returns the code for a string or 0 if it doesn't have one. Lock free.
+uint32_t iTermInternedStringTableFind(const iTermInternedStringTable *table,
+                                      const uint32_t *codePoints,
+                                      uint32_t length);
+
+// Returns the code for a string, assigning the next free one if needed, or 0 if it needs one and
+// none are left. |object| and |flags| are stored with a newly added string; *addedPtr (if not NULL)
+// is set to whether that happened so the caller knows whether the table kept |object|.
+uint32_t iTermInternedStringTableIntern(iTermInternedStringTable *table,
+                                        const uint32_t *codePoints,
+                                        uint32_t length,
+                                        uint32_t flags,
+                                        const void *object,
+                                        bool *addedPtr);
+
+// Assigns a specific code to a string unless the code is already in use. Used when restoring
+// state. Returns whether it was assigned.
+bool iTermInternedStringTableSet(iTermInternedStringTable *table,
+                                 uint32_t code,
+                                 const uint32_t *codePoints,
+                                 uint32_t length,
+                                 uint32_t flags,
+                                 const void *object);
+
+// The next code Intern will try and whether every code has been assigned. Saved and restored along
+// with the strings. Intern skips codes that are already assigned, so restoring |nextCode| only
+// keeps codes in the same order as before.
+void iTermInternedStringTableGetAllocationState(iTermInternedStringTable *table,
+                                                uint32_t *nextCodePtr,
+                                                bool *isFullPtr);
+void iTermInternedStringTableSetNextCode(iTermInternedStringTable *table, uint32_t nextCode);
+
+// Calls |callback| for each assigned code in increasing order while holding the writer lock.
+void iTermInternedStringTableEnumerate(iTermInternedStringTable *table,
+                                       void *context,
+                                       void (*callback)(void *context,
+                                                        uint32_t code,
+                                                        const iTermInternedString *string));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermInternedStringTable_h
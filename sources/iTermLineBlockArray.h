@@ -28,6 +28,17 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)removeFirstBlocks:(NSInteger)count;
 - (void)removeLastBlock;
 - (void)replaceLastBlockWithCopy;
+
+// Arranges for every block but the last to be replaced with a private copy
+// and stops compressing cold blocks, since compressed cells are installed on
+// the main thread (see LineBlock.h). This is cheap: blocks are only copied in
+// -finishDetaching, or when the original array changes one of them first.
+// Until -finishDetaching the array may only be appended to, on the main thread.
+- (void)detachBlocks;
+
+// Call on the thread that will use a detached array before doing anything
+// else with it there. Afterwards the array may be used on that thread only.
+- (void)finishDetaching;
 - (void)setAllBlocksMayHaveDoubleWidthCharacters;
 - (NSInteger)indexOfBlockContainingLineNumber:(int)lineNumber width:(int)width remainder:(out nonnull int *)remainderPtr;
 - (nullable LineBlock *)blockContainingLineNumber:(int)lineNumber
@@ -8,7 +8,9 @@
 #import "iTermLineBlockArray.h"
 
 #import "DebugLogging.h"
+#import "iTermAdvancedSettingsModel.h"
 #import "iTermCumulativeSumCache.h"
+#import "iTermScrollbackSegmentFile.h"
 #import "iTermTuple.h"
 #import "LineBlock.h"
 #import "NSArray+iTerm.h"
@@ -125,6 +127,10 @@
 
 @end
 
+// How many blocks other than the last one may stay expanded. Beyond this, the least recently used
+// blocks are compacted and then compressed in the background.
+static const NSUInteger iTermLineBlockArrayMaximumWarmBlocks = 16;
+
 @implementation iTermLineBlockArray {
     NSMutableArray<LineBlock *> *_blocks;
     BOOL _mayHaveDoubleWidthCharacter;
@@ -137,6 +143,23 @@
     LineBlock *_tail;
     BOOL _headDirty;
     BOOL _tailDirty;
+
+    // Blocks that were recently expanded or touched, least recently used first.
+    NSMutableArray<LineBlock *> *_warmBlocks;
+
+    // Compressed blocks whose cells are still in memory, in the order they were compressed, along
+    // with the number of bytes each one was charged. Spilling starts from the front.
+    NSMutableArray<iTermTuple<LineBlock *, NSNumber *> *> *_compressedBlocks;
+    NSInteger _compressedBytes;
+
+    // Created when the first block is spilled. Shared with copies.
+    iTermScrollbackSegmentFile *_segmentFile;
+
+    // See -detachBlocks.
+    BOOL _detached;
+    // Blocks still shared with the original array, mapped to the copies that -finishDetaching
+    // will replace them with.
+    NSMapTable<LineBlock *, iTermDeferredLineBlockCopy *> *_deferredCopies;
     // NOTE: Update -copyWithZone: if you add member variables.
 }
 
@@ -144,6 +167,8 @@
     self = [super init];
     if (self) {
         _blocks = [NSMutableArray array];
+        _warmBlocks = [NSMutableArray array];
+        _compressedBlocks = [NSMutableArray array];
         _numLinesCaches = [[iTermLineBlockCacheCollection alloc] init];
     }
     return self;
@@ -154,6 +179,10 @@
     // When a LineBuffer is really gigantic, it can take
     // quite a bit of time to release all the blocks.
     for (LineBlock *block in _blocks) {
+        if ([_deferredCopies objectForKey:block]) {
+            // Not observed, and may belong to another thread.
+            continue;
+        }
         [block removeObserver:self];
     }
     NSMutableArray<LineBlock *> *blocks = _blocks;
@@ -292,6 +321,7 @@
         return nil;
     }
     LineBlock *block = _blocks[i];
+    [self touchBlock:block];
 
     if (remainderPtr) {
         *remainderPtr = remainder;
@@ -450,6 +480,7 @@
     if (indexPtr) {
         *indexPtr = index;
     }
+    [self touchBlock:_blocks[index]];
     return _blocks[index];
 }
 
@@ -478,6 +509,7 @@
             if (indexPtr) {
                 *indexPtr = index;
             }
+            [self touchBlock:block];
             return block;
         }
         index++;
@@ -485,6 +517,90 @@
     return nil;
 }
 
+#pragma mark - Cold blocks
+
++ (dispatch_queue_t)compressionQueue {
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("com.iterm2.line-block-compression",
+                                      dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+    });
+    return queue;
+}
+
+// Moves an already-warm block to the most recently used position.
+- (void)touchBlock:(LineBlock *)block {
+    if (_warmBlocks.lastObject == block) {
+        return;
+    }
+    const NSUInteger index = [_warmBlocks indexOfObjectIdenticalTo:block];
+    if (index == NSNotFound) {
+        return;
+    }
+    [_warmBlocks removeObjectAtIndex:index];
+    [_warmBlocks addObject:block];
+}
+
+- (void)addWarmBlock:(LineBlock *)block {
+    [_warmBlocks removeObjectIdenticalTo:block];
+    [_warmBlocks addObject:block];
+    while (_warmBlocks.count > iTermLineBlockArrayMaximumWarmBlocks) {
+        LineBlock *coldBlock = _warmBlocks.firstObject;
+        [_warmBlocks removeObjectAtIndex:0];
+        [self coolBlock:coldBlock];
+    }
+}
+
+- (void)coolBlock:(LineBlock *)block {
+    if (block == _blocks.lastObject || ![iTermAdvancedSettingsModel compactScrollback]) {
+        // The last block is still being appended to.
+        return;
+    }
+    if ([_deferredCopies objectForKey:block]) {
+        // Still shared with the array this one was detached from.
+        return;
+    }
+    // Compaction doesn't change line counts so the cumulative sum caches remain valid.
+    [block compact];
+    if ([iTermAdvancedSettingsModel compressColdScrollback] && !_detached) {
+        [block compressOnQueue:[iTermLineBlockArray compressionQueue]];
+    }
+}
+
+- (void)forgetCompressedBlock:(LineBlock *)block {
+    const NSUInteger index = [_compressedBlocks indexOfObjectPassingTest:^BOOL(iTermTuple<LineBlock *,NSNumber *> * _Nonnull tuple, NSUInteger idx, BOOL * _Nonnull stop) {
+        return tuple.firstObject == block;
+    }];
+    if (index == NSNotFound) {
+        return;
+    }
+    _compressedBytes -= _compressedBlocks[index].secondObject.integerValue;
+    [_compressedBlocks removeObjectAtIndex:index];
+}
+
+// Moves the oldest compressed blocks to disk until the ones left in memory fit in the budget.
+// Their line counts are unaffected so the cumulative sum caches don't change.
+- (void)spillIfNeeded {
+    const NSInteger budget = (NSInteger)[iTermAdvancedSettingsModel scrollbackMemoryBudgetMB] * 1024 * 1024;
+    if (budget <= 0) {
+        return;
+    }
+    while (_compressedBytes > budget && _compressedBlocks.count > 0) {
+        LineBlock *block = _compressedBlocks.firstObject.firstObject;
+        [self forgetCompressedBlock:block];
+        if (!_segmentFile) {
+            _segmentFile = [[iTermScrollbackSegmentFile alloc] init];
+            if (!_segmentFile) {
+                return;
+            }
+        }
+        if (![block spillToSegmentFile:_segmentFile]) {
+            DLog(@"Failed to spill block %@", block);
+        }
+    }
+}
+
 #pragma mark - Low level method
 
 - (id)objectAtIndexedSubscript:(NSUInteger)index {
@@ -499,14 +615,69 @@
     }
     index--;
     [_blocks[index] removeObserver:self];
-    _blocks[index] = [_blocks[index] copy];
+    LineBlock *copy = [_blocks[index] copy];
+    const NSUInteger warmIndex = [_warmBlocks indexOfObjectIdenticalTo:_blocks[index]];
+    if (warmIndex != NSNotFound) {
+        _warmBlocks[warmIndex] = copy;
+    }
+    _blocks[index] = copy;
     [_blocks[index] addObserver:self];
     _head = _blocks.firstObject;
     _tail = _blocks.lastObject;
 }
 
+- (void)detachBlocks {
+    [self updateCacheIfNeeded];
+    _deferredCopies = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality
+                                            valueOptions:NSPointerFunctionsStrongMemory];
+    // The last block is already a private copy (see -[LineBuffer newAppendOnlyCopy]) and may
+    // still be appended to on this thread, so it stays as it is.
+    for (NSInteger i = 0; i + 1 < (NSInteger)_blocks.count; i++) {
+        LineBlock *block = _blocks[i];
+        [block removeObserver:self];
+        [_deferredCopies setObject:[block newDeferredCopy] forKey:block];
+    }
+    _detached = YES;
+}
+
+- (void)finishDetaching {
+    if (_deferredCopies.count == 0) {
+        return;
+    }
+    NSMapTable<LineBlock *, LineBlock *> *copies = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality
+                                                                         valueOptions:NSPointerFunctionsStrongMemory];
+    for (NSUInteger i = 0; i < _blocks.count; i++) {
+        LineBlock *block = _blocks[i];
+        iTermDeferredLineBlockCopy *deferredCopy = [_deferredCopies objectForKey:block];
+        if (!deferredCopy) {
+            continue;
+        }
+        LineBlock *copy = deferredCopy.lineBlock;
+        [copy addObserver:self];
+        [copies setObject:copy forKey:block];
+        _blocks[i] = copy;
+    }
+    _deferredCopies = nil;
+    _warmBlocks = [[_warmBlocks mapWithBlock:^id(LineBlock *block) {
+        return [copies objectForKey:block] ?: block;
+    }] mutableCopy];
+    _compressedBlocks = [[_compressedBlocks mapWithBlock:^id(iTermTuple<LineBlock *, NSNumber *> *tuple) {
+        LineBlock *copy = [copies objectForKey:tuple.firstObject];
+        if (!copy) {
+            return tuple;
+        }
+        return [iTermTuple tupleWithObject:copy andObject:tuple.secondObject];
+    }] mutableCopy];
+    _head = _blocks.firstObject;
+    _tail = _blocks.lastObject;
+}
+
 - (void)addBlock:(LineBlock *)block {
     [self updateCacheIfNeeded];
+    if (_blocks.lastObject) {
+        // The old last block is now history. Let it age out of the warm set like any other.
+        [self addWarmBlock:_blocks.lastObject];
+    }
     [block addObserver:self];
     [_blocks addObject:block];
     if (_blocks.count == 1) {
@@ -528,6 +699,8 @@
     [_numLinesCaches removeFirstValue];
     [_rawSpaceCache removeFirstValue];
     [_rawLinesCache removeFirstValue];
+    [_warmBlocks removeObjectIdenticalTo:_blocks.firstObject];
+    [self forgetCompressedBlock:_blocks.firstObject];
     [_blocks removeObjectAtIndex:0];
     _head = _blocks.firstObject;
     _tail = _blocks.lastObject;
@@ -542,6 +715,8 @@
 - (void)removeLastBlock {
     [self updateCacheIfNeeded];
     [_blocks.lastObject removeObserver:self];
+    [_warmBlocks removeObjectIdenticalTo:_blocks.lastObject];
+    [self forgetCompressedBlock:_blocks.lastObject];
     [_blocks removeLastObject];
     [_numLinesCaches removeLastValue];
     [_rawSpaceCache removeLastValue];
@@ -626,6 +801,12 @@
     theCopy->_tail = _tail;
     theCopy->_tailDirty = _tailDirty;
     theCopy->_resizing = _resizing;
+    theCopy->_warmBlocks = [_warmBlocks mutableCopy];
+    theCopy->_compressedBlocks = [_compressedBlocks mutableCopy];
+    theCopy->_compressedBytes = _compressedBytes;
+    theCopy->_segmentFile = _segmentFile;
+    theCopy->_detached = _detached;
+    ITAssertWithMessage(_deferredCopies.count == 0, @"Copying an array that hasn't finished detaching");
     for (LineBlock *block in _blocks) {
         [block addObserver:theCopy];
     }
@@ -643,4 +824,19 @@
     }
 }
 
+- (void)lineBlockDidExpand:(LineBlock *)lineBlock {
+    [self forgetCompressedBlock:lineBlock];
+    if (lineBlock != _blocks.lastObject) {
+        [self addWarmBlock:lineBlock];
+    }
+}
+
+- (void)lineBlockDidCompress:(LineBlock *)lineBlock {
+    [self forgetCompressedBlock:lineBlock];
+    const NSUInteger size = lineBlock.compressedSize;
+    [_compressedBlocks addObject:[iTermTuple tupleWithObject:lineBlock andObject:@(size)]];
+    _compressedBytes += size;
+    [self spillIfNeeded];
+}
+
 @end
@@ -0,0 +1,199 @@
+//
+//  iTermLineSearchKernel.c
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#include "iTermLineSearchKernel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct iTermLiteralNeedle {
+    // Lowercase if case-insensitive.
+    uint16_t *units;
+    int length;
+    bool caseInsensitive;
+
+    // The scan looks for the needle's rarest character and then verifies around it.
+    int anchorOffset;
+    uint16_t anchor;
+
+    // Each lane of a 64-bit word holds a copy of |anchor| (resp. the bits to OR into a haystack
+    // unit before comparing it with |anchor|).
+    uint64_t anchorWord;
+    uint64_t foldWord;
+};
+
+#pragma mark - Scratch
+
+void iTermSearchScratchInit(iTermSearchScratch *scratch) {
+    scratch->units = NULL;
+    scratch->deltas = NULL;
+    scratch->capacity = 0;
+}
+
+void iTermSearchScratchReserve(iTermSearchScratch *scratch, int count) {
+    if (count <= scratch->capacity) {
+        return;
+    }
+    int capacity = scratch->capacity > 0 ? scratch->capacity : 256;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    free(scratch->units);
+    free(scratch->deltas);
+    scratch->units = malloc(sizeof(uint16_t) * capacity);
+    scratch->deltas = malloc(sizeof(int) * capacity);
+    if (!scratch->units || !scratch->deltas) {
+        abort();
+    }
+    scratch->capacity = capacity;
+}
+
+void iTermSearchScratchFree(iTermSearchScratch *scratch) {
+    free(scratch->units);
+    free(scratch->deltas);
+    iTermSearchScratchInit(scratch);
+}
+
+#pragma mark - Literal search
+
+bool iTermSearchUnitsArePrintableASCII(const uint16_t *units, int count) {
+    // Branch-free so the compiler can vectorize it.
+    uint16_t bad = 0;
+    for (int i = 0; i < count; i++) {
+        bad |= (uint16_t)(units[i] - 0x20) > 0x5e;
+    }
+    return !bad;
+}
+
+static inline uint16_t iTermLineSearchFoldASCII(uint16_t c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline bool iTermLineSearchIsASCIILetter(uint16_t c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Lower is rarer. Roughly how often each character turns up in terminal output: English letters
+// by frequency, plus the punctuation of paths, URLs, and log lines.
+static int iTermLineSearchCharacterFrequency(uint16_t c) {
+    static const char *const common = " etaoinsrlcdhu/.-_:mpfgw=0y1b2,v\"k'3()x[]45j6789q>z<";
+    const char *p = strchr(common, iTermLineSearchFoldASCII(c));
+    if (!p || c == 0) {
+        return 0;
+    }
+    return (int)(strlen(common) - (p - common));
+}
+
+iTermLiteralNeedle *iTermLiteralNeedleCreate(const uint16_t *units, int length, bool caseInsensitive) {
+    if (length <= 0 || !iTermSearchUnitsArePrintableASCII(units, length)) {
+        return NULL;
+    }
+    iTermLiteralNeedle *needle = calloc(1, sizeof(*needle));
+    needle->units = malloc(sizeof(uint16_t) * length);
+    needle->length = length;
+    needle->caseInsensitive = caseInsensitive;
+    int bestFrequency = -1;
+    for (int i = 0; i < length; i++) {
+        needle->units[i] = caseInsensitive ? iTermLineSearchFoldASCII(units[i]) : units[i];
+        const int frequency = iTermLineSearchCharacterFrequency(units[i]);
+        if (bestFrequency < 0 || frequency < bestFrequency) {
+            bestFrequency = frequency;
+            needle->anchorOffset = i;
+        }
+    }
+    needle->anchor = needle->units[needle->anchorOffset];
+    const uint16_t fold = (caseInsensitive && iTermLineSearchIsASCIILetter(needle->anchor)) ? 0x20 : 0;
+    needle->anchorWord = 0x0001000100010001ULL * needle->anchor;
+    needle->foldWord = 0x0001000100010001ULL * fold;
+    return needle;
+}
+
+void iTermLiteralNeedleFree(iTermLiteralNeedle *needle) {
+    if (!needle) {
+        return;
+    }
+    free(needle->units);
+    free(needle);
+}
+
+int iTermLiteralNeedleLength(const iTermLiteralNeedle *needle) {
+    return needle->length;
+}
+
+// Is the needle at |start|? The anchor is already known to match.
+static inline bool iTermLiteralNeedleMatchesAt(const iTermLiteralNeedle *needle,
+                                               const uint16_t *haystack,
+                                               int start) {
+    const uint16_t *h = haystack + start;
+    if (!needle->caseInsensitive) {
+        return memcmp(h, needle->units, sizeof(uint16_t) * needle->length) == 0;
+    }
+    for (int i = 0; i < needle->length; i++) {
+        if (iTermLineSearchFoldASCII(h[i]) != needle->units[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool iTermLiteralNeedleAnchorMatches(const iTermLiteralNeedle *needle, uint16_t c) {
+    return (uint16_t)(c | (uint16_t)needle->foldWord) == needle->anchor;
+}
+
+// Does any of the four units at |p| possibly match the anchor? SWAR: a lane of |v| is zero iff the
+// unit matches, and the expression below is nonzero iff some lane is zero.
+static inline bool iTermLiteralNeedleWordMayContainAnchor(const iTermLiteralNeedle *needle,
+                                                          const uint16_t *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    const uint64_t v = (word | needle->foldWord) ^ needle->anchorWord;
+    return ((v - 0x0001000100010001ULL) & ~v & 0x8000800080008000ULL) != 0;
+}
+
+int iTermLiteralNeedleFind(const iTermLiteralNeedle *needle,
+                           const uint16_t *haystack,
+                           int length,
+                           bool backwards) {
+    if (needle->length > length) {
+        return -1;
+    }
+    // Positions at which the anchor may be found.
+    const int first = needle->anchorOffset;
+    const int last = length - needle->length + needle->anchorOffset;
+    if (!backwards) {
+        int i = first;
+        while (i <= last) {
+            if (i + 3 <= last && !iTermLiteralNeedleWordMayContainAnchor(needle, haystack + i)) {
+                i += 4;
+                continue;
+            }
+            const int end = (i + 3 <= last) ? i + 4 : i + 1;
+            for (; i < end; i++) {
+                if (iTermLiteralNeedleAnchorMatches(needle, haystack[i]) &&
+                    iTermLiteralNeedleMatchesAt(needle, haystack, i - needle->anchorOffset)) {
+                    return i - needle->anchorOffset;
+                }
+            }
+        }
+    } else {
+        int i = last;
+        while (i >= first) {
+            if (i - 3 >= first && !iTermLiteralNeedleWordMayContainAnchor(needle, haystack + i - 3)) {
+                i -= 4;
+                continue;
+            }
+            const int end = (i - 3 >= first) ? i - 4 : i - 1;
+            for (; i > end; i--) {
+                if (iTermLiteralNeedleAnchorMatches(needle, haystack[i]) &&
+                    iTermLiteralNeedleMatchesAt(needle, haystack, i - needle->anchorOffset)) {
+                    return i - needle->anchorOffset;
+                }
+            }
+        }
+    }
+    return -1;
+}
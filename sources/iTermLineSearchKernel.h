@@ -0,0 +1,66 @@
+//
+//  iTermLineSearchKernel.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  The allocation-free core of find-in-scrollback. LineBlock converts each raw line's cells into a
+//  scratch buffer that is reused for every line of a search, and when both the line and the needle
+//  are printable ASCII it looks for the needle here instead of building an NSString. That is the
+//  common case for logs and compiler output, and in it case- and diacritic-insensitive search
+//  reduces to ASCII case folding. Everything else falls back to NSString and ICU.
+//
+//  Plain C with no Foundation dependency so it can be benchmarked anywhere (see
+//  tests/line_search_bench.c).
+//
+
+#ifndef iTermLineSearchKernel_h
+#define iTermLineSearchKernel_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Grows as needed and is freed once, at the end of a search.
+typedef struct {
+    uint16_t *units;
+    int *deltas;
+    // Number of elements |units| and |deltas| have room for.
+    int capacity;
+} iTermSearchScratch;
+
+void iTermSearchScratchInit(iTermSearchScratch *scratch);
+
+// Ensures both buffers have room for at least |count| elements. Existing contents are lost.
+void iTermSearchScratchReserve(iTermSearchScratch *scratch, int count);
+
+void iTermSearchScratchFree(iTermSearchScratch *scratch);
+
+// Returns whether every unit is in [0x20, 0x7e].
+bool iTermSearchUnitsArePrintableASCII(const uint16_t *units, int count);
+
+typedef struct iTermLiteralNeedle iTermLiteralNeedle;
+
+// Returns NULL if |units| is empty or isn't printable ASCII, in which case the kernel can't be
+// used. A case-insensitive needle matches ASCII letters of either case.
+iTermLiteralNeedle *iTermLiteralNeedleCreate(const uint16_t *units, int length, bool caseInsensitive);
+
+void iTermLiteralNeedleFree(iTermLiteralNeedle *needle);
+
+int iTermLiteralNeedleLength(const iTermLiteralNeedle *needle);
+
+// Returns the index in |haystack| of the first occurrence of |needle|, or of the last one if
+// |backwards| is set, or -1 if there is none.
+int iTermLiteralNeedleFind(const iTermLiteralNeedle *needle,
+                           const uint16_t *haystack,
+                           int length,
+                           bool backwards);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermLineSearchKernel_h
@@ -11,6 +11,7 @@
 #import "iTermAdvancedSettingsModel.h"
 #import "iTermAlphaBlendingHelper.h"
 #import "iTermBoxDrawingBezierCurveFactory.h"
+#import "iTermCellBitset.h"
 #import "iTermCharacterSource.h"
 #import "iTermColorMap.h"
 #import "iTermController.h"
@@ -80,6 +81,15 @@ typedef struct {
     vector_float4 previousForegroundColor;
 } iTermMetalPerFrameStateCaches;
 
+// Rows at least this wide use the heap for their cell masks instead of the stack.
+#define ITERM_METAL_MAX_STACK_BITSET_WORDS 64
+
+static void iTermCellBitsetAddIndexes(iTermCellBitset *bitset, NSIndexSet *indexes) {
+    [indexes enumerateRangesUsingBlock:^(NSRange range, BOOL * _Nonnull stop) {
+        iTermCellBitsetAddRange(bitset, range.location, range.length);
+    }];
+}
+
 @interface iTermMetalPerFrameState() {
     iTermMetalPerFrameStateConfiguration *_configuration;
 
@@ -684,7 +694,6 @@ ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
     }
     const iTermData *lineData = _rows[row]->_screenCharLine;
     const screen_char_t *const line = (const screen_char_t *const)lineData.bytes;
-    NSIndexSet *selectedIndexes = _rows[row]->_selectedIndexSet;
     NSData *findMatches = _rows[row]->_matches;
     iTermTextColorKey keys[2];
     iTermTextColorKey *currentColorKey = &keys[0];
@@ -694,17 +703,32 @@ ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
     int rles = 0;
     int previousImageCode = -1;
     VT100GridCoord previousImageCoord;
-    NSIndexSet *annotatedIndexes = _rowToAnnotationRanges[@(row)];
     vector_float4 lastUnprocessedBackgroundColor = simd_make_float4(0, 0, 0, 0);
     BOOL lastSelected = NO;
     const BOOL underlineHyperlinks = [iTermAdvancedSettingsModel underlineHyperlinks];
     iTermMetalPerFrameStateCaches caches;
     memset(&caches, 0, sizeof(caches));
 
+    // Cell masks go on the stack unless the row is very wide.
+    const int wordsPerBitset = ITERM_CELL_BITSET_WORDS(width);
+    uint64_t stackWords[2 * ITERM_METAL_MAX_STACK_BITSET_WORDS];
+    uint64_t *heapWords = NULL;
+    uint64_t *words = stackWords;
+    if (wordsPerBitset > ITERM_METAL_MAX_STACK_BITSET_WORDS) {
+        heapWords = malloc(2 * wordsPerBitset * sizeof(uint64_t));
+        words = heapWords;
+    }
+    iTermCellBitset selectedCells;
+    iTermCellBitsetInit(&selectedCells, words, width);
+    iTermCellBitsetAddIndexes(&selectedCells, _rows[row]->_selectedIndexSet);
+    iTermCellBitset annotatedCells;
+    iTermCellBitsetInit(&annotatedCells, words + wordsPerBitset, width);
+    iTermCellBitsetAddIndexes(&annotatedCells, _rowToAnnotationRanges[@(row)]);
+
     *markStylePtr = [_rows[row]->_markStyle intValue];
     int lastDrawableGlyph = -1;
     for (int x = 0; x < width; x++) {
-        BOOL selected = [selectedIndexes containsIndex:x];
+        BOOL selected = iTermCellBitsetContains(&selectedCells, x);
         BOOL findMatch = NO;
         if (findMatches && !selected) {
             findMatch = CheckFindMatchAtIndex(findMatches, x);
@@ -721,7 +745,7 @@ ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
             // Normal code path
             lastSelected = selected;
         }
-        const BOOL annotated = [annotatedIndexes containsIndex:x];
+        const BOOL annotated = iTermCellBitsetContains(&annotatedCells, x);
         const BOOL inUnderlinedRange = NSLocationInRange(x, underlinedRange) || annotated;
 
         // Background colors
@@ -889,6 +913,7 @@ ambiguousIsDoubleWidth:(BOOL)ambiguousIsDoubleWidth
         }
     }
 
+    free(heapWords);
     *rleCount = rles;
     *drawableGlyphsPtr = lastDrawableGlyph + 1;
 
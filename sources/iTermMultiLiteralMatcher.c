@@ -0,0 +1,652 @@
+//
+//  iTermMultiLiteralMatcher.c
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#include "iTermMultiLiteralMatcher.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark - Required literals
+
+static bool iTermIsASCIIAlphanumeric(uint16_t c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool iTermIsHighSurrogate(uint16_t c) {
+    return c >= 0xD800 && c <= 0xDBFF;
+}
+
+static bool iTermIsLowSurrogate(uint16_t c) {
+    return c >= 0xDC00 && c <= 0xDFFF;
+}
+
+static uint16_t iTermFoldASCII(uint16_t c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+typedef struct {
+    uint16_t c;
+    uint8_t length;
+    uint16_t folded[3];
+} iTermCaseFolding;
+
+// Every BMP character outside ASCII whose full case folding (CaseFolding.txt statuses C and F)
+// contains ASCII, sorted. ICU's (?i) compares literal strings by full case folding, so "(?i)k"
+// matches U+212A KELVIN SIGN and "(?i)ss" matches U+00DF. The rest of non-ASCII folds to
+// non-ASCII, which never occurs in a case-insensitive literal.
+static const iTermCaseFolding iTermNonASCIIFoldings[] = {
+    { 0x00DF, 2, { 's', 's' } },
+    { 0x0130, 2, { 'i', 0x0307 } },
+    { 0x0149, 2, { 0x02BC, 'n' } },
+    { 0x017F, 1, { 's' } },
+    { 0x01F0, 2, { 'j', 0x030C } },
+    { 0x1E96, 2, { 'h', 0x0331 } },
+    { 0x1E97, 2, { 't', 0x0308 } },
+    { 0x1E98, 2, { 'w', 0x030A } },
+    { 0x1E99, 2, { 'y', 0x030A } },
+    { 0x1E9A, 2, { 'a', 0x02BE } },
+    { 0x1E9E, 2, { 's', 's' } },
+    { 0x212A, 1, { 'k' } },
+    { 0xFB00, 2, { 'f', 'f' } },
+    { 0xFB01, 2, { 'f', 'i' } },
+    { 0xFB02, 2, { 'f', 'l' } },
+    { 0xFB03, 3, { 'f', 'f', 'i' } },
+    { 0xFB04, 3, { 'f', 'f', 'l' } },
+    { 0xFB05, 2, { 's', 't' } },
+    { 0xFB06, 2, { 's', 't' } },
+};
+
+static int iTermCompareCaseFolding(const void *key, const void *element) {
+    return (int)*(const uint16_t *)key - (int)((const iTermCaseFolding *)element)->c;
+}
+
+// Stores what |c| case-folds to in |folded| and returns its length. Folding the text and the
+// literals the same way means any match ICU finds is also found by the matcher.
+static int iTermFoldCase(uint16_t c, uint16_t folded[3]) {
+    if (c < 0x80) {
+        folded[0] = iTermFoldASCII(c);
+        return 1;
+    }
+    if (c >= 0x00DF && c <= 0xFB06 && !(c > 0x212A && c < 0xFB00)) {
+        const iTermCaseFolding *folding = bsearch(&c,
+                                                  iTermNonASCIIFoldings,
+                                                  sizeof(iTermNonASCIIFoldings) / sizeof(*iTermNonASCIIFoldings),
+                                                  sizeof(*iTermNonASCIIFoldings),
+                                                  iTermCompareCaseFolding);
+        if (folding) {
+            memcpy(folded, folding->folded, sizeof(uint16_t) * folding->length);
+            return folding->length;
+        }
+    }
+    folded[0] = c;
+    return 1;
+}
+
+// Returns the index just past a bracketed set that starts at |i| (which points at '['), or
+// |length| + 1 if it's unterminated. ICU allows nested sets like [a-z&&[^aeiou]].
+static size_t iTermSkipSet(const uint16_t *p, size_t length, size_t i) {
+    int depth = 0;
+    bool first = true;
+    while (i < length) {
+        const uint16_t c = p[i];
+        if (c == '\\') {
+            i += 2;
+            first = false;
+            continue;
+        }
+        if (c == '[') {
+            depth++;
+            i++;
+            // A ] right after [ or [^ is a literal.
+            if (i < length && p[i] == '^') {
+                i++;
+            }
+            first = true;
+            if (i < length && p[i] == ']') {
+                i++;
+                first = false;
+            }
+            continue;
+        }
+        if (c == ']' && !first) {
+            depth--;
+            i++;
+            if (depth == 0) {
+                return i;
+            }
+            continue;
+        }
+        first = false;
+        i++;
+    }
+    return length + 1;
+}
+
+// Returns the index just past a group that starts at |i| (which points at '('), or |length| + 1
+// if it's unterminated.
+static size_t iTermSkipGroup(const uint16_t *p, size_t length, size_t i) {
+    int depth = 0;
+    while (i < length) {
+        const uint16_t c = p[i];
+        if (c == '\\') {
+            i += 2;
+        } else if (c == '[') {
+            i = iTermSkipSet(p, length, i);
+        } else if (c == '(') {
+            depth++;
+            i++;
+        } else if (c == ')') {
+            depth--;
+            i++;
+            if (depth == 0) {
+                return i;
+            }
+        } else {
+            i++;
+        }
+    }
+    return length + 1;
+}
+
+// Returns the number of code units taken by an escape sequence starting at |i| (which points
+// just past the backslash) that does not stand for a literal character, or 0 if it is a literal.
+static size_t iTermNonLiteralEscapeLength(const uint16_t *p, size_t length, size_t i) {
+    const uint16_t c = p[i];
+    if (!iTermIsASCIIAlphanumeric(c)) {
+        return 0;
+    }
+    size_t j = i + 1;
+    switch (c) {
+        case 'x':
+        case 'N':
+        case 'p':
+        case 'P':
+            if (j < length && p[j] == '{') {
+                while (j < length && p[j] != '}') {
+                    j++;
+                }
+                return j + 1 - i;
+            }
+            return (c == 'x' ? 3 : 2);
+        case 'u':
+            return 5;
+        case 'U':
+            return 9;
+        case 'c':
+            return 2;
+        case '0':
+            while (j < length && j < i + 4 && p[j] >= '0' && p[j] <= '7') {
+                j++;
+            }
+            return j - i;
+        default:
+            // Backreferences, classes, assertions, and control escapes.
+            while (c >= '1' && c <= '9' && j < length && p[j] >= '0' && p[j] <= '9') {
+                j++;
+            }
+            return j - i;
+    }
+}
+
+typedef enum {
+    iTermQuantifierNone,
+    iTermQuantifierOptional,  // *, ?, {0...}
+    iTermQuantifierRepeat     // +, {n...} with n > 0
+} iTermQuantifier;
+
+// Parses a quantifier at |*i|, if present, advancing past it and any lazy/possessive suffix.
+static iTermQuantifier iTermParseQuantifier(const uint16_t *p, size_t length, size_t *i) {
+    if (*i >= length) {
+        return iTermQuantifierNone;
+    }
+    iTermQuantifier result;
+    const uint16_t c = p[*i];
+    if (c == '*' || c == '?') {
+        result = iTermQuantifierOptional;
+        *i += 1;
+    } else if (c == '+') {
+        result = iTermQuantifierRepeat;
+        *i += 1;
+    } else if (c == '{') {
+        size_t j = *i + 1;
+        unsigned minimum = 0;
+        bool sawDigit = false;
+        while (j < length && p[j] >= '0' && p[j] <= '9') {
+            minimum = minimum * 10 + (p[j] - '0');
+            sawDigit = true;
+            j++;
+        }
+        if (!sawDigit) {
+            // Not a quantifier; ICU treats it as a literal brace.
+            return iTermQuantifierNone;
+        }
+        while (j < length && p[j] != '}') {
+            j++;
+        }
+        *i = j + 1;
+        result = minimum > 0 ? iTermQuantifierRepeat : iTermQuantifierOptional;
+    } else {
+        return iTermQuantifierNone;
+    }
+    if (*i < length && (p[*i] == '?' || p[*i] == '+')) {
+        *i += 1;
+    }
+    return result;
+}
+
+bool iTermRegexRequiredLiteral(const uint16_t *p,
+                               size_t length,
+                               uint16_t *literal,
+                               size_t capacity,
+                               size_t *lengthPtr,
+                               bool *caseInsensitivePtr) {
+    uint16_t current[ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH];
+    size_t currentLength = 0;
+    size_t bestLength = 0;
+    bool caseInsensitive = false;
+    if (capacity > ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH) {
+        capacity = ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH;
+    }
+
+    // Flags can change mid-pattern, so the literal is only final at the end.
+#define END_RUN() do { \
+        if (currentLength > bestLength) { \
+            memcpy(literal, current, currentLength * sizeof(uint16_t)); \
+            bestLength = currentLength; \
+        } \
+        currentLength = 0; \
+    } while (0)
+
+    size_t i = 0;
+    while (i < length) {
+        const uint16_t c = p[i];
+        uint16_t literalChar;
+        if (c == '\\') {
+            if (i + 1 >= length) {
+                return false;
+            }
+            const uint16_t next = p[i + 1];
+            if (next == 'Q' || next == 'E') {
+                return false;
+            }
+            const size_t escapeLength = iTermNonLiteralEscapeLength(p, length, i + 1);
+            if (escapeLength > 0) {
+                END_RUN();
+                i += 1 + escapeLength;
+                iTermParseQuantifier(p, length, &i);
+                continue;
+            }
+            literalChar = next;
+            i += 2;
+        } else if (c == '[') {
+            END_RUN();
+            i = iTermSkipSet(p, length, i);
+            if (i > length) {
+                return false;
+            }
+            iTermParseQuantifier(p, length, &i);
+            continue;
+        } else if (c == '(') {
+            END_RUN();
+            if (i + 1 < length && p[i + 1] == '?') {
+                // Inline flags like (?i) or (?i-m:...). Lookarounds, named groups, and (?: don't
+                // start with letters.
+                for (size_t j = i + 2; j < length && iTermIsASCIIAlphanumeric(p[j]); j++) {
+                    if (p[j] == 'x') {
+                        return false;
+                    }
+                    if (p[j] == 'i') {
+                        caseInsensitive = true;
+                    }
+                }
+            }
+            i = iTermSkipGroup(p, length, i);
+            if (i > length) {
+                return false;
+            }
+            iTermParseQuantifier(p, length, &i);
+            continue;
+        } else if (c == '|' || c == ')') {
+            return false;
+        } else if (c == '.' || c == '^' || c == '$') {
+            END_RUN();
+            i++;
+            iTermParseQuantifier(p, length, &i);
+            continue;
+        } else if (c == '*' || c == '+' || c == '?') {
+            // Quantifier with nothing to quantify.
+            return false;
+        } else {
+            literalChar = c;
+            i++;
+        }
+        // A character outside the BMP is one atom, so a quantifier after it applies to both
+        // halves of the surrogate pair.
+        const bool isPair = iTermIsHighSurrogate(literalChar) && i < length && iTermIsLowSurrogate(p[i]);
+        const uint16_t lowSurrogate = isPair ? p[i++] : 0;
+
+        const iTermQuantifier quantifier = iTermParseQuantifier(p, length, &i);
+        if (quantifier == iTermQuantifierOptional) {
+            END_RUN();
+            continue;
+        }
+        if (isPair) {
+            if (currentLength + 2 > capacity) {
+                // Keep the run whole rather than splitting the pair.
+                END_RUN();
+                continue;
+            }
+            current[currentLength++] = literalChar;
+            current[currentLength++] = lowSurrogate;
+        } else if (currentLength < capacity) {
+            current[currentLength++] = literalChar;
+        }
+        if (quantifier == iTermQuantifierRepeat) {
+            END_RUN();
+        }
+    }
+    END_RUN();
+#undef END_RUN
+
+    if (caseInsensitive) {
+        // Non-ASCII characters in the pattern may match text that folds differently (e.g., U+00DF
+        // matches "SS"), so stop at the first one.
+        size_t n = 0;
+        while (n < bestLength && literal[n] < 0x80) {
+            literal[n] = iTermFoldASCII(literal[n]);
+            n++;
+        }
+        bestLength = n;
+    }
+    *lengthPtr = bestLength;
+    *caseInsensitivePtr = caseInsensitive;
+    return bestLength > 0;
+}
+
+#pragma mark - Matcher
+
+// States are numbered with uint16_t to keep the transition table small.
+#define ITERM_MULTI_LITERAL_MATCHER_MAX_STATES 65535
+
+typedef struct {
+    uint16_t characters[ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH];
+    int length;
+    int identifier;
+} iTermMultiLiteralMatcherLiteral;
+
+struct iTermMultiLiteralMatcher {
+    bool compiled;
+    bool foldCase;
+
+    // Literals added before compiling.
+    int numberOfLiterals;
+    int literalsCapacity;
+    int totalLength;
+    iTermMultiLiteralMatcherLiteral *literals;
+
+    // Trie, built by Compile. Children of a state form a linked list.
+    int numberOfStates;
+    int statesCapacity;
+    uint16_t *label;
+    int *firstChild;
+    int *nextSibling;
+
+    // Outputs. outputHead[s] is the first entry in a linked list of identifiers for literals that
+    // end at s. outputLink[s] is the nearest proper suffix state with outputs, or -1.
+    int *outputHead;
+    int numberOfOutputs;
+    int outputsCapacity;
+    int *outputIdentifier;
+    int *outputNext;
+    int *outputLink;
+
+    // Character classes. Class 0 is every character that doesn't appear in a literal.
+    int numberOfClasses;
+    uint8_t asciiClass[128];
+    int numberOfNonASCII;
+    uint16_t *nonASCIIChars;  // sorted
+    int *nonASCIIClasses;
+
+    // Dense DFA: delta[state * numberOfClasses + class].
+    uint16_t *delta;
+};
+
+iTermMultiLiteralMatcher *iTermMultiLiteralMatcherCreate(void) {
+    iTermMultiLiteralMatcher *matcher = calloc(1, sizeof(*matcher));
+    matcher->statesCapacity = 64;
+    matcher->label = malloc(sizeof(uint16_t) * matcher->statesCapacity);
+    matcher->firstChild = malloc(sizeof(int) * matcher->statesCapacity);
+    matcher->nextSibling = malloc(sizeof(int) * matcher->statesCapacity);
+    matcher->outputHead = malloc(sizeof(int) * matcher->statesCapacity);
+    matcher->numberOfStates = 1;
+    matcher->label[0] = 0;
+    matcher->firstChild[0] = -1;
+    matcher->nextSibling[0] = -1;
+    matcher->outputHead[0] = -1;
+    return matcher;
+}
+
+static int iTermMultiLiteralMatcherChild(const iTermMultiLiteralMatcher *matcher, int state, uint16_t c) {
+    for (int child = matcher->firstChild[state]; child >= 0; child = matcher->nextSibling[child]) {
+        if (matcher->label[child] == c) {
+            return child;
+        }
+    }
+    return -1;
+}
+
+static int iTermMultiLiteralMatcherAddState(iTermMultiLiteralMatcher *matcher, int parent, uint16_t c) {
+    if (matcher->numberOfStates == matcher->statesCapacity) {
+        matcher->statesCapacity *= 2;
+        matcher->label = realloc(matcher->label, sizeof(uint16_t) * matcher->statesCapacity);
+        matcher->firstChild = realloc(matcher->firstChild, sizeof(int) * matcher->statesCapacity);
+        matcher->nextSibling = realloc(matcher->nextSibling, sizeof(int) * matcher->statesCapacity);
+        matcher->outputHead = realloc(matcher->outputHead, sizeof(int) * matcher->statesCapacity);
+    }
+    const int state = matcher->numberOfStates++;
+    matcher->label[state] = c;
+    matcher->firstChild[state] = -1;
+    matcher->nextSibling[state] = matcher->firstChild[parent];
+    matcher->firstChild[parent] = state;
+    matcher->outputHead[state] = -1;
+    return state;
+}
+
+bool iTermMultiLiteralMatcherAddLiteral(iTermMultiLiteralMatcher *matcher,
+                                        const uint16_t *literal,
+                                        size_t length,
+                                        bool caseInsensitive,
+                                        int identifier) {
+    assert(!matcher->compiled);
+    if (length == 0) {
+        return false;
+    }
+    if (length > ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH) {
+        length = ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH;
+    }
+    if (1 + matcher->totalLength + (int)length > ITERM_MULTI_LITERAL_MATCHER_MAX_STATES) {
+        return false;
+    }
+    if (matcher->numberOfLiterals == matcher->literalsCapacity) {
+        matcher->literalsCapacity = matcher->literalsCapacity ? matcher->literalsCapacity * 2 : 16;
+        matcher->literals = realloc(matcher->literals,
+                                    sizeof(iTermMultiLiteralMatcherLiteral) * matcher->literalsCapacity);
+    }
+    iTermMultiLiteralMatcherLiteral *entry = &matcher->literals[matcher->numberOfLiterals++];
+    memcpy(entry->characters, literal, length * sizeof(uint16_t));
+    entry->length = (int)length;
+    entry->identifier = identifier;
+    matcher->totalLength += (int)length;
+
+    // Case-sensitive literals matched without regard to case give false positives, which the
+    // caller's regex weeds out. That's cheaper than keeping two automata.
+    matcher->foldCase = matcher->foldCase || caseInsensitive;
+    return true;
+}
+
+static void iTermMultiLiteralMatcherAddToTrie(iTermMultiLiteralMatcher *matcher,
+                                              const iTermMultiLiteralMatcherLiteral *literal) {
+    // Folding can lengthen a literal. Any prefix of it is still required, and keeping it to the
+    // original length keeps within the states budgeted when it was added.
+    uint16_t characters[ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH];
+    int length = 0;
+    for (int i = 0; i < literal->length && length < literal->length; i++) {
+        uint16_t folded[3] = { literal->characters[i] };
+        const int n = matcher->foldCase ? iTermFoldCase(literal->characters[i], folded) : 1;
+        for (int j = 0; j < n && length < literal->length; j++) {
+            characters[length++] = folded[j];
+        }
+    }
+    int state = 0;
+    for (int i = 0; i < length; i++) {
+        const uint16_t c = characters[i];
+        int child = iTermMultiLiteralMatcherChild(matcher, state, c);
+        if (child < 0) {
+            child = iTermMultiLiteralMatcherAddState(matcher, state, c);
+        }
+        state = child;
+    }
+    const int identifier = literal->identifier;
+
+    if (matcher->numberOfOutputs == matcher->outputsCapacity) {
+        matcher->outputsCapacity = matcher->outputsCapacity ? matcher->outputsCapacity * 2 : 16;
+        matcher->outputIdentifier = realloc(matcher->outputIdentifier, sizeof(int) * matcher->outputsCapacity);
+        matcher->outputNext = realloc(matcher->outputNext, sizeof(int) * matcher->outputsCapacity);
+    }
+    const int output = matcher->numberOfOutputs++;
+    matcher->outputIdentifier[output] = identifier;
+    matcher->outputNext[output] = matcher->outputHead[state];
+    matcher->outputHead[state] = output;
+}
+
+static int iTermCompareUInt16(const void *a, const void *b) {
+    return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+static int iTermMultiLiteralMatcherClassOf(const iTermMultiLiteralMatcher *matcher, uint16_t c) {
+    if (c < 128) {
+        return matcher->asciiClass[c];
+    }
+    if (matcher->numberOfNonASCII == 0) {
+        return 0;
+    }
+    const uint16_t *found = bsearch(&c,
+                                    matcher->nonASCIIChars,
+                                    matcher->numberOfNonASCII,
+                                    sizeof(uint16_t),
+                                    iTermCompareUInt16);
+    return found ? matcher->nonASCIIClasses[found - matcher->nonASCIIChars] : 0;
+}
+
+void iTermMultiLiteralMatcherCompile(iTermMultiLiteralMatcher *matcher) {
+    assert(!matcher->compiled);
+    matcher->compiled = true;
+    for (int i = 0; i < matcher->numberOfLiterals; i++) {
+        iTermMultiLiteralMatcherAddToTrie(matcher, &matcher->literals[i]);
+    }
+    const int n = matcher->numberOfStates;
+
+    // Assign a class to each distinct character in the trie.
+    matcher->numberOfClasses = 1;
+    uint16_t *nonASCII = malloc(sizeof(uint16_t) * n);
+    int numberOfNonASCII = 0;
+    for (int s = 1; s < n; s++) {
+        const uint16_t c = matcher->label[s];
+        if (c < 128) {
+            if (matcher->asciiClass[c] == 0) {
+                matcher->asciiClass[c] = matcher->numberOfClasses++;
+            }
+        } else {
+            nonASCII[numberOfNonASCII++] = c;
+        }
+    }
+    qsort(nonASCII, numberOfNonASCII, sizeof(uint16_t), iTermCompareUInt16);
+    matcher->nonASCIIChars = malloc(sizeof(uint16_t) * (numberOfNonASCII + 1));
+    matcher->nonASCIIClasses = malloc(sizeof(int) * (numberOfNonASCII + 1));
+    for (int i = 0; i < numberOfNonASCII; i++) {
+        if (i > 0 && nonASCII[i] == nonASCII[i - 1]) {
+            continue;
+        }
+        matcher->nonASCIIChars[matcher->numberOfNonASCII] = nonASCII[i];
+        matcher->nonASCIIClasses[matcher->numberOfNonASCII] = matcher->numberOfClasses++;
+        matcher->numberOfNonASCII++;
+    }
+    free(nonASCII);
+    if (matcher->foldCase) {
+        for (uint16_t c = 'A'; c <= 'Z'; c++) {
+            matcher->asciiClass[c] = matcher->asciiClass[c + ('a' - 'A')];
+        }
+    }
+
+    // Breadth-first construction of failure links and the dense transition table.
+    const int k = matcher->numberOfClasses;
+    matcher->delta = calloc((size_t)n * k, sizeof(uint16_t));
+    matcher->outputLink = malloc(sizeof(int) * n);
+    int *fail = calloc(n, sizeof(int));
+    int *queue = malloc(sizeof(int) * n);
+    int head = 0;
+    int tail = 0;
+    matcher->outputLink[0] = -1;
+    queue[tail++] = 0;
+    while (head < tail) {
+        const int s = queue[head++];
+        uint16_t *row = matcher->delta + (size_t)s * k;
+        if (s != 0) {
+            memcpy(row, matcher->delta + (size_t)fail[s] * k, sizeof(uint16_t) * k);
+        }
+        for (int child = matcher->firstChild[s]; child >= 0; child = matcher->nextSibling[child]) {
+            const int c = iTermMultiLiteralMatcherClassOf(matcher, matcher->label[child]);
+            // fail[s] is shallower than s so its row is already complete.
+            fail[child] = (s == 0) ? 0 : matcher->delta[(size_t)fail[s] * k + c];
+            row[c] = child;
+            const int f = fail[child];
+            matcher->outputLink[child] = matcher->outputHead[f] >= 0 ? f : matcher->outputLink[f];
+            queue[tail++] = child;
+        }
+    }
+    free(queue);
+    free(fail);
+}
+
+void iTermMultiLiteralMatcherScan(const iTermMultiLiteralMatcher *matcher,
+                                  const uint16_t *text,
+                                  size_t length,
+                                  bool *found) {
+    assert(matcher->compiled);
+    const int k = matcher->numberOfClasses;
+    const uint16_t *delta = matcher->delta;
+    const bool foldCase = matcher->foldCase;
+    int state = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint16_t folded[3] = { text[i] };
+        const int n = foldCase ? iTermFoldCase(text[i], folded) : 1;
+        for (int j = 0; j < n; j++) {
+            state = delta[(size_t)state * k + iTermMultiLiteralMatcherClassOf(matcher, folded[j])];
+            for (int s = state; s >= 0; s = matcher->outputLink[s]) {
+                for (int output = matcher->outputHead[s]; output >= 0; output = matcher->outputNext[output]) {
+                    found[matcher->outputIdentifier[output]] = true;
+                }
+            }
+        }
+    }
+}
+
+void iTermMultiLiteralMatcherFree(iTermMultiLiteralMatcher *matcher) {
+    free(matcher->literals);
+    free(matcher->label);
+    free(matcher->firstChild);
+    free(matcher->nextSibling);
+    free(matcher->outputHead);
+    free(matcher->outputIdentifier);
+    free(matcher->outputNext);
+    free(matcher->outputLink);
+    free(matcher->nonASCIIChars);
+    free(matcher->nonASCIIClasses);
+    free(matcher->delta);
+    free(matcher);
+}
@@ -0,0 +1,84 @@
+//
+//  iTermMultiLiteralMatcher.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Finds which of many literal strings occur in a line of text in a single pass (Aho-Corasick
+//  compiled to a dense DFA over the characters that appear in the literals). Combined with
+//  iTermRegexRequiredLiteral() this lets a large set of regular expressions be prefiltered so only
+//  the ones that can possibly match a line are run against it. Text is UTF-16 to match NSString.
+//  Plain C with no Foundation dependency so it can be benchmarked anywhere (see
+//  tests/trigger_prefilter_bench.c).
+//
+
+#ifndef iTermMultiLiteralMatcher_h
+#define iTermMultiLiteralMatcher_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Literals longer than this are truncated. Any prefix of a required literal is also required, so
+// this only makes the prefilter slightly less selective.
+#define ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH 32
+
+// Literals like ":" or "[" occur in most lines, so a literal shorter than this rarely rules out its
+// regex and isn't worth looking for.
+#define ITERM_MULTI_LITERAL_MATCHER_MIN_USEFUL_LITERAL_LENGTH 3
+
+// A scan costs about as much as running two or three simple regexes, which do their own literal
+// search. With fewer useful literals than this, don't scan at all.
+#define ITERM_MULTI_LITERAL_MATCHER_MIN_USEFUL_LITERALS 4
+
+// Finds a literal string that must occur in every match of an ICU regular expression. Stores up
+// to |capacity| UTF-16 code units of it in |literal| and its length in |lengthPtr|. Sets
+// |*caseInsensitivePtr| if the pattern turns on case-insensitive matching, in which case the
+// literal is lowercase ASCII.
+//
+// This is conservative: it returns false if the pattern has top-level alternation, extended
+// syntax, or anything else it doesn't fully understand, or if no literal is required. A false
+// return means the regex must always be run.
+bool iTermRegexRequiredLiteral(const uint16_t *pattern,
+                               size_t patternLength,
+                               uint16_t *literal,
+                               size_t capacity,
+                               size_t *lengthPtr,
+                               bool *caseInsensitivePtr);
+
+typedef struct iTermMultiLiteralMatcher iTermMultiLiteralMatcher;
+
+iTermMultiLiteralMatcher *iTermMultiLiteralMatcherCreate(void);
+
+// Adds a literal to search for. |identifier| must be in [0, number of identifiers) where the
+// number of identifiers is the size of the |found| array passed to the scan function. Several
+// literals may share an identifier. Must not be called after compiling. Returns false (and adds
+// nothing) if the matcher is full, in which case the caller must treat |identifier| as always
+// matching.
+bool iTermMultiLiteralMatcherAddLiteral(iTermMultiLiteralMatcher *matcher,
+                                        const uint16_t *literal,
+                                        size_t length,
+                                        bool caseInsensitive,
+                                        int identifier);
+
+// Builds the automaton. Must be called once, after all literals are added and before scanning.
+void iTermMultiLiteralMatcherCompile(iTermMultiLiteralMatcher *matcher);
+
+// Sets found[identifier] to true for the identifier of every literal that occurs in |text|.
+// Entries for identifiers that don't occur are left alone. Safe to call concurrently.
+void iTermMultiLiteralMatcherScan(const iTermMultiLiteralMatcher *matcher,
+                                  const uint16_t *text,
+                                  size_t length,
+                                  bool *found);
+
+void iTermMultiLiteralMatcherFree(iTermMultiLiteralMatcher *matcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermMultiLiteralMatcher_h
@@ -0,0 +1,101 @@
+//
+//  iTermPTYReadBuffer.c
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#include "iTermPTYReadBuffer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// One size class per power of two from the minimum to the maximum read size.
+#define ITERM_PTY_READ_NUMBER_OF_SIZE_CLASSES 7
+
+// Buffers are only held during a single read-and-parse pass, so a few per size
+// class is plenty even with many busy sessions.
+#define ITERM_PTY_READ_BUFFERS_PER_SIZE_CLASS 4
+
+static pthread_mutex_t gPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static char *gPool[ITERM_PTY_READ_NUMBER_OF_SIZE_CLASSES][ITERM_PTY_READ_BUFFERS_PER_SIZE_CLASS];
+static int gPoolCount[ITERM_PTY_READ_NUMBER_OF_SIZE_CLASSES];
+
+static int iTermPTYReadSizeClass(size_t size) {
+    int sizeClass = 0;
+    for (size_t s = ITERM_PTY_READ_MINIMUM_SIZE; s < size; s *= 2) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+char *iTermPTYReadBufferAcquire(size_t size) {
+    const int sizeClass = iTermPTYReadSizeClass(size);
+    char *buffer = NULL;
+    pthread_mutex_lock(&gPoolLock);
+    if (gPoolCount[sizeClass] > 0) {
+        buffer = gPool[sizeClass][--gPoolCount[sizeClass]];
+    }
+    pthread_mutex_unlock(&gPoolLock);
+    if (!buffer) {
+        buffer = malloc(size);
+    }
+    return buffer;
+}
+
+void iTermPTYReadBufferRelease(char *buffer, size_t size) {
+    if (!buffer) {
+        return;
+    }
+    const int sizeClass = iTermPTYReadSizeClass(size);
+    pthread_mutex_lock(&gPoolLock);
+    if (gPoolCount[sizeClass] < ITERM_PTY_READ_BUFFERS_PER_SIZE_CLASS) {
+        gPool[sizeClass][gPoolCount[sizeClass]++] = buffer;
+        buffer = NULL;
+    }
+    pthread_mutex_unlock(&gPoolLock);
+    free(buffer);
+}
+
+size_t iTermPTYReadSizeAdapt(size_t currentSize, size_t bytesRead, double bytesPerSecond) {
+    size_t size = currentSize;
+    if (bytesRead >= currentSize) {
+        // Filled the buffer, so there is probably more waiting.
+        size *= 2;
+    } else if (bytesRead < currentSize / 4) {
+        size /= 2;
+    }
+    // Try to take about one frame's worth of output per wakeup.
+    const double bytesPerFrame = bytesPerSecond / 60.0;
+    while (size < ITERM_PTY_READ_MAXIMUM_SIZE && size < bytesPerFrame) {
+        size *= 2;
+    }
+    if (size < ITERM_PTY_READ_MINIMUM_SIZE) {
+        return ITERM_PTY_READ_MINIMUM_SIZE;
+    }
+    if (size > ITERM_PTY_READ_MAXIMUM_SIZE) {
+        return ITERM_PTY_READ_MAXIMUM_SIZE;
+    }
+    return size;
+}
+
+ssize_t iTermPTYReadCoalesced(int fd, char *buffer, size_t capacity) {
+    size_t total = 0;
+    while (total < capacity) {
+        const ssize_t n = read(fd, buffer + total, capacity - total);
+        if (n > 0) {
+            total += n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR && total == 0) {
+            return -1;
+        }
+        // End of file, no more input for now, or an error to be reported on the
+        // next call. We could retry on EINTR, but the notifier will just call
+        // again.
+        break;
+    }
+    return total;
+}
@@ -0,0 +1,56 @@
+//
+//  iTermPTYReadBuffer.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Support for -[PTYTask processRead]: a pool of reusable read buffers, a
+//  policy for choosing how much to read per wakeup, and a read loop that
+//  drains a nonblocking file descriptor into one buffer. Plain C with no
+//  Foundation dependency so it can be benchmarked anywhere (see
+//  tests/pty_read_bench.c).
+//
+
+#ifndef iTermPTYReadBuffer_h
+#define iTermPTYReadBuffer_h
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Read sizes are always powers of two in this range. The minimum is what
+// processRead used to read per wakeup (four 1024-byte reads).
+#define ITERM_PTY_READ_MINIMUM_SIZE 4096
+#define ITERM_PTY_READ_MAXIMUM_SIZE (256 * 1024)
+
+// Returns a buffer of |size| bytes, which must be a valid read size. Reuses a
+// previously released buffer of the same size when one is available. Thread
+// safe.
+char *iTermPTYReadBufferAcquire(size_t size);
+
+// Returns a buffer from iTermPTYReadBufferAcquire() to the pool, or frees it if
+// the pool already holds enough buffers of that size. Thread safe.
+void iTermPTYReadBufferRelease(char *buffer, size_t size);
+
+// Chooses the size of the next read given the current size, how many bytes the
+// last call to iTermPTYReadCoalesced() returned, and the recent throughput in
+// bytes per second. Grows quickly while output is heavy so a wakeup picks up
+// about a frame's worth of data, and shrinks slowly once it lets up so idle
+// sessions don't hold big buffers.
+size_t iTermPTYReadSizeAdapt(size_t currentSize, size_t bytesRead, double bytesPerSecond);
+
+// Reads from the nonblocking |fd| until |capacity| bytes have been read or no
+// more input is available. Returns the number of bytes read, which may be 0. If
+// nothing was read because of an error other than EAGAIN or EINTR, returns -1
+// and leaves errno set. An error after some data was read is not reported; the
+// next call will hit it again.
+ssize_t iTermPTYReadCoalesced(int fd, char *buffer, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermPTYReadBuffer_h
@@ -8,9 +8,11 @@
 #import <Cocoa/Cocoa.h>
 
 #import "DebugLogging.h"
+#import "iTermAdvancedSettingsModel.h"
 #import "iTermLSOF.h"
 #import "iTermProcessCache.h"
 #import "iTermProcessMonitor.h"
+#import "iTermProcessTree.h"
 #import "iTermRateLimitedUpdate.h"
 #import "NSArray+iTerm.h"
 #import <stdatomic.h>
@@ -32,6 +34,19 @@
     iTermRateLimitedUpdate *_rateLimit;  // Main queue. keeps updateIfNeeded from eating all the CPU
     NSMutableIndexSet *_dirtyPIDsLQ;  // _lockQueue
     BOOL _forcingLQ;
+
+    // Follows only the trees under tracked PIDs. NULL if the trackProcessTreesIncrementally
+    // advanced setting is off, in which case every update lists all processes. _workQueue
+    iTermProcessTree *_processTree;
+    NSMutableIndexSet *_processTreeRoots;  // _workQueue
+    dispatch_source_t _processTreeEventSource;  // _workQueue
+    BOOL _processTreeEventSourceSuspended;  // _workQueue
+    // The tree owns the source. Only its stateless listChildren and readProcess are used directly,
+    // on any queue.
+    iTermProcessTreeSource _processTreeSource;
+    // Collections for untracked PIDs built on demand. They're kept until the next update because
+    // iTermProcessInfo only holds its collection weakly. _lockQueue
+    NSMutableDictionary<NSNumber *, iTermProcessCollection *> *_subtreeCollectionsLQ;
 }
 
 + (instancetype)sharedInstance {
@@ -52,6 +67,13 @@
         _rateLimit.minimumInterval = 0.5;
         _trackedPidsLQ = [NSMutableDictionary dictionary];
         _dirtyPIDsLQ = [NSMutableIndexSet indexSet];
+        _subtreeCollectionsLQ = [NSMutableDictionary dictionary];
+        if ([iTermAdvancedSettingsModel trackProcessTreesIncrementally] &&
+            iTermProcessTreeSourceInitSystem(&_processTreeSource)) {
+            _processTree = iTermProcessTreeCreate(&_processTreeSource);
+            _processTreeRoots = [NSMutableIndexSet indexSet];
+            [self watchProcessTreeEvents];
+        }
         [self setNeedsUpdate:YES];
         _blocksLQ = [NSMutableArray array];
         [[NSNotificationCenter defaultCenter] addObserver:self
@@ -139,8 +161,20 @@
 - (iTermProcessInfo *)processInfoForPid:(pid_t)pid {
     __block iTermProcessInfo *info = nil;
     dispatch_sync(_lockQueue, ^{
-        info = [self->_collectionLQ infoForProcessID:pid];
+        info = [self->_collectionLQ infoForProcessID:pid] ?: [self->_subtreeCollectionsLQ[@(pid)] infoForProcessID:pid];
     });
+    if (info || !_processTree) {
+        return info;
+    }
+    // The collection only has the tracked trees. Look up anything else, like a server process,
+    // directly.
+    iTermProcessCollection *collection = [self newProcessCollectionForSubtreeOfPid:pid];
+    info = [collection infoForProcessID:pid];
+    if (info) {
+        dispatch_sync(_lockQueue, ^{
+            self->_subtreeCollectionsLQ[@(pid)] = collection;
+        });
+    }
     return info;
 }
 
@@ -258,20 +292,126 @@
     return cache;
 }
 
+#pragma mark - Process Tree
+
+static void iTermProcessCacheAddProcess(void *context, pid_t processID, pid_t parentProcessID) {
+    iTermProcessCollection *collection = (__bridge iTermProcessCollection *)context;
+    [collection addProcessWithProcessID:processID parentProcessID:parentProcessID];
+}
+
+// init
+- (void)watchProcessTreeEvents {
+    const int fd = iTermProcessTreeFileDescriptor(_processTree);
+    if (fd < 0) {
+        return;
+    }
+    _processTreeEventSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0, _workQueue);
+    __weak __typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(_processTreeEventSource, ^{
+        [weakSelf processTreeEventsDidArrive];
+    });
+    dispatch_resume(_processTreeEventSource);
+}
+
+// _workQueue
+- (void)processTreeEventsDidArrive {
+    DLog(@"Process tree events arrived");
+    // The descriptor stays readable until reallyUpdate consumes the events.
+    dispatch_suspend(_processTreeEventSource);
+    _processTreeEventSourceSuspended = YES;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self setNeedsUpdate:YES];
+    });
+}
+
+// Any queue
+- (iTermProcessCollection *)newProcessCollectionForSubtreeOfPid:(pid_t)pid {
+    iTermProcessCollection *collection = [[iTermProcessCollection alloc] init];
+    if (!iTermProcessTreeSourceEnumerateSubtree(&_processTreeSource,
+                                                pid,
+                                                (__bridge void *)collection,
+                                                iTermProcessCacheAddProcess)) {
+        return nil;
+    }
+    [collection commit];
+    return collection;
+}
+
+// _workQueue
+- (iTermProcessCollection *)newProcessCollectionFromTreeWithTrackedPIDs:(NSArray<NSNumber *> *)trackedPIDs {
+    NSMutableIndexSet *roots = [NSMutableIndexSet indexSet];
+    for (NSNumber *pid in trackedPIDs) {
+        [roots addIndex:pid.intValue];
+        iTermProcessTreeAddRoot(_processTree, pid.intValue);
+    }
+    [_processTreeRoots enumerateIndexesUsingBlock:^(NSUInteger pid, BOOL * _Nonnull stop) {
+        if (![roots containsIndex:pid]) {
+            iTermProcessTreeRemoveRoot(self->_processTree, (pid_t)pid);
+        }
+    }];
+    _processTreeRoots = roots;
+
+    const int listed = iTermProcessTreeUpdate(_processTree, NULL, NULL);
+    DLog(@"Updated process tree for %@ roots, listing children of %@ processes", @(roots.count), @(listed));
+    if (_processTreeEventSourceSuspended) {
+        _processTreeEventSourceSuspended = NO;
+        dispatch_resume(_processTreeEventSource);
+    }
+
+    iTermProcessCollection *collection = [[iTermProcessCollection alloc] init];
+    for (NSNumber *pid in trackedPIDs) {
+        iTermProcessTreeEnumerateSubtree(_processTree,
+                                         pid.intValue,
+                                         (__bridge void *)collection,
+                                         iTermProcessCacheAddProcess);
+    }
+    [collection commit];
+    return collection;
+}
+
+// _workQueue
+- (NSDictionary<NSNumber *, iTermProcessInfo *> *)newDeepestForegroundJobCacheWithTree:(iTermProcessTree *)tree
+                                                                           trackedPIDs:(NSArray<NSNumber *> *)trackedPIDs
+                                                                            collection:(iTermProcessCollection *)collection {
+    NSMutableDictionary<NSNumber *, iTermProcessInfo *> *cache = [NSMutableDictionary dictionary];
+    for (NSNumber *root in trackedPIDs) {
+        const pid_t pid = iTermProcessTreeDeepestForegroundJob(tree, root.intValue);
+        iTermProcessInfo *info = pid > 0 ? [collection infoForProcessID:pid] : nil;
+        if (info) {
+            cache[root] = info;
+        }
+    }
+    return cache;
+}
+
 // _workQueue
 - (void)reallyUpdate {
     DLog(@"* DOING THE EXPENSIVE THING * Process cache reallyUpdate starting");
 
-    // Do expensive stuff
-    iTermProcessCollection *collection = [self.class newProcessCollection];
-
-    // Save the tracked PIDs in the cache
-    NSDictionary<NSNumber *, iTermProcessInfo *> *cachedDeepestForegroundJob = [self newDeepestForegroundJobCacheWithCollection:collection];
+    iTermProcessCollection *collection;
+    NSDictionary<NSNumber *, iTermProcessInfo *> *cachedDeepestForegroundJob;
+    if (_processTree) {
+        __block NSArray<NSNumber *> *trackedPIDs;
+        dispatch_sync(_lockQueue, ^{
+            trackedPIDs = [self->_trackedPidsLQ.allKeys copy];
+        });
+        collection = [self newProcessCollectionFromTreeWithTrackedPIDs:trackedPIDs];
+        cachedDeepestForegroundJob = [self newDeepestForegroundJobCacheWithTree:_processTree
+                                                                    trackedPIDs:trackedPIDs
+                                                                     collection:collection];
+    } else {
+        // Do expensive stuff
+        collection = [self.class newProcessCollection];
+
+        // Save the tracked PIDs in the cache
+        cachedDeepestForegroundJob = [self newDeepestForegroundJobCacheWithCollection:collection];
+    }
 
     // Flip to the new state.
     dispatch_sync(_lockQueue, ^{
         self->_cachedDeepestForegroundJobLQ = cachedDeepestForegroundJob;
         self->_collectionLQ = collection;
+        [self->_subtreeCollectionsLQ removeAllObjects];
         self->_needsUpdateFlagLQ = NO;
         [_trackedPidsLQ enumerateKeysAndObjectsUsingBlock:^(NSNumber * _Nonnull key, iTermProcessMonitor * _Nonnull monitor, BOOL * _Nonnull stop) {
             iTermProcessInfo *info = [collection infoForProcessID:key.intValue];
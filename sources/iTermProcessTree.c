@@ -0,0 +1,840 @@
+//
+//  iTermProcessTree.c
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#include "iTermProcessTree.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Same limit as -[iTermProcessInfo deepestForegroundJob], which also protects against cycles
+// from reused process IDs.
+#define ITERM_PROCESS_TREE_MAXIMUM_DEPTH 50
+
+#define ITERM_PROCESS_TREE_ALL_EVENTS (iTermProcessTreeEventFork | iTermProcessTreeEventExec | iTermProcessTreeEventExit)
+
+typedef struct iTermProcessTreeNode {
+    struct iTermProcessTreeNode *next;  // Hash chain
+    pid_t processID;
+    iTermProcessTreeProcess process;
+
+    // Sorted ascending.
+    pid_t *children;
+    int numberOfChildren;
+    int childrenCapacity;
+
+    // Set when an event says the list of children may be stale.
+    bool childrenDirty;
+    // Set by an exec event.
+    bool execed;
+    // Set when the process could not be read this update.
+    bool gone;
+    uint32_t watchedEvents;
+
+    // Generation in which the process was last read and last changed.
+    uint32_t readGeneration;
+    uint32_t changeGeneration;
+} iTermProcessTreeNode;
+
+typedef struct {
+    pid_t processID;
+    pid_t deepestForegroundJob;
+    bool deepestForegroundJobValid;
+} iTermProcessTreeRoot;
+
+struct iTermProcessTree {
+    iTermProcessTreeSource source;
+
+    iTermProcessTreeNode **buckets;
+    uint32_t bucketMask;
+    uint32_t numberOfNodes;
+
+    iTermProcessTreeRoot *roots;
+    int numberOfRoots;
+    int rootsCapacity;
+
+    uint32_t generation;
+    int listCount;
+
+    // Scratch space for listing children.
+    pid_t *scratch;
+    int scratchCapacity;
+};
+
+static int iTermProcessTreeComparePIDs(const void *a, const void *b) {
+    const pid_t lhs = *(const pid_t *)a;
+    const pid_t rhs = *(const pid_t *)b;
+    return lhs < rhs ? -1 : lhs > rhs ? 1 : 0;
+}
+
+// Lists children into a growable buffer, sorted ascending. Returns the count or -1.
+static int iTermProcessTreeSourceListChildren(const iTermProcessTreeSource *source,
+                                              pid_t processID,
+                                              pid_t **bufferPtr,
+                                              int *capacityPtr) {
+    while (1) {
+        const int count = source->listChildren(source->context, processID, *bufferPtr, *capacityPtr);
+        if (count < 0) {
+            return -1;
+        }
+        if (count <= *capacityPtr) {
+            qsort(*bufferPtr, (size_t)count, sizeof(pid_t), iTermProcessTreeComparePIDs);
+            return count;
+        }
+        *capacityPtr = count * 2;
+        *bufferPtr = realloc(*bufferPtr, sizeof(pid_t) * (size_t)*capacityPtr);
+    }
+}
+
+static bool iTermProcessTreeSourceEnumerateSubtreeAtDepth(const iTermProcessTreeSource *source,
+                                                          pid_t processID,
+                                                          int depth,
+                                                          void *context,
+                                                          void (*callback)(void *, pid_t, pid_t)) {
+    iTermProcessTreeProcess process;
+    if (depth > ITERM_PROCESS_TREE_MAXIMUM_DEPTH ||
+        !source->readProcess(source->context, processID, &process)) {
+        return false;
+    }
+    callback(context, processID, process.parentProcessID);
+    int capacity = 16;
+    pid_t *children = malloc(sizeof(pid_t) * (size_t)capacity);
+    const int count = iTermProcessTreeSourceListChildren(source, processID, &children, &capacity);
+    for (int i = 0; i < count; i++) {
+        iTermProcessTreeSourceEnumerateSubtreeAtDepth(source, children[i], depth + 1, context, callback);
+    }
+    free(children);
+    return true;
+}
+
+bool iTermProcessTreeSourceEnumerateSubtree(const iTermProcessTreeSource *source,
+                                            pid_t processID,
+                                            void *context,
+                                            void (*callback)(void *context,
+                                                             pid_t processID,
+                                                             pid_t parentProcessID)) {
+    return iTermProcessTreeSourceEnumerateSubtreeAtDepth(source, processID, 0, context, callback);
+}
+
+#pragma mark - Nodes
+
+static uint32_t iTermProcessTreeHash(pid_t processID) {
+    return (uint32_t)processID * 2654435761u;
+}
+
+static iTermProcessTreeNode *iTermProcessTreeFind(const iTermProcessTree *tree, pid_t processID) {
+    for (iTermProcessTreeNode *node = tree->buckets[iTermProcessTreeHash(processID) & tree->bucketMask];
+         node;
+         node = node->next) {
+        if (node->processID == processID) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static void iTermProcessTreeGrow(iTermProcessTree *tree) {
+    const uint32_t oldCount = tree->bucketMask + 1;
+    iTermProcessTreeNode **oldBuckets = tree->buckets;
+    tree->bucketMask = oldCount * 2 - 1;
+    tree->buckets = calloc(oldCount * 2, sizeof(iTermProcessTreeNode *));
+    for (uint32_t i = 0; i < oldCount; i++) {
+        iTermProcessTreeNode *node = oldBuckets[i];
+        while (node) {
+            iTermProcessTreeNode *next = node->next;
+            const uint32_t bucket = iTermProcessTreeHash(node->processID) & tree->bucketMask;
+            node->next = tree->buckets[bucket];
+            tree->buckets[bucket] = node;
+            node = next;
+        }
+    }
+    free(oldBuckets);
+}
+
+static iTermProcessTreeNode *iTermProcessTreeInsert(iTermProcessTree *tree, pid_t processID) {
+    if (tree->numberOfNodes >= tree->bucketMask + 1) {
+        iTermProcessTreeGrow(tree);
+    }
+    iTermProcessTreeNode *node = calloc(1, sizeof(*node));
+    node->processID = processID;
+    node->childrenDirty = true;
+    const uint32_t bucket = iTermProcessTreeHash(processID) & tree->bucketMask;
+    node->next = tree->buckets[bucket];
+    tree->buckets[bucket] = node;
+    tree->numberOfNodes++;
+    return node;
+}
+
+static void iTermProcessTreeFreeNode(iTermProcessTree *tree, iTermProcessTreeNode *node) {
+    if (node->watchedEvents && tree->source.unwatch) {
+        tree->source.unwatch(tree->source.context, node->processID);
+    }
+    free(node->children);
+    free(node);
+}
+
+#pragma mark - Lifecycle
+
+iTermProcessTree *iTermProcessTreeCreate(const iTermProcessTreeSource *source) {
+    iTermProcessTree *tree = calloc(1, sizeof(*tree));
+    tree->source = *source;
+    tree->bucketMask = 255;
+    tree->buckets = calloc(tree->bucketMask + 1, sizeof(iTermProcessTreeNode *));
+    tree->scratchCapacity = 64;
+    tree->scratch = malloc(sizeof(pid_t) * (size_t)tree->scratchCapacity);
+    return tree;
+}
+
+void iTermProcessTreeFree(iTermProcessTree *tree) {
+    if (!tree) {
+        return;
+    }
+    for (uint32_t i = 0; i <= tree->bucketMask; i++) {
+        iTermProcessTreeNode *node = tree->buckets[i];
+        while (node) {
+            iTermProcessTreeNode *next = node->next;
+            iTermProcessTreeFreeNode(tree, node);
+            node = next;
+        }
+    }
+    if (tree->source.destroy) {
+        tree->source.destroy(tree->source.context);
+    }
+    free(tree->buckets);
+    free(tree->roots);
+    free(tree->scratch);
+    free(tree);
+}
+
+int iTermProcessTreeFileDescriptor(const iTermProcessTree *tree) {
+    return tree->source.fileDescriptor;
+}
+
+#pragma mark - Roots
+
+static iTermProcessTreeRoot *iTermProcessTreeFindRoot(const iTermProcessTree *tree, pid_t processID) {
+    for (int i = 0; i < tree->numberOfRoots; i++) {
+        if (tree->roots[i].processID == processID) {
+            return &tree->roots[i];
+        }
+    }
+    return NULL;
+}
+
+void iTermProcessTreeAddRoot(iTermProcessTree *tree, pid_t processID) {
+    if (processID <= 0 || iTermProcessTreeFindRoot(tree, processID)) {
+        return;
+    }
+    if (tree->numberOfRoots == tree->rootsCapacity) {
+        tree->rootsCapacity = tree->rootsCapacity ? tree->rootsCapacity * 2 : 8;
+        tree->roots = realloc(tree->roots, sizeof(iTermProcessTreeRoot) * (size_t)tree->rootsCapacity);
+    }
+    iTermProcessTreeRoot *root = &tree->roots[tree->numberOfRoots++];
+    memset(root, 0, sizeof(*root));
+    root->processID = processID;
+}
+
+void iTermProcessTreeRemoveRoot(iTermProcessTree *tree, pid_t processID) {
+    iTermProcessTreeRoot *root = iTermProcessTreeFindRoot(tree, processID);
+    if (!root) {
+        return;
+    }
+    // Its nodes are freed by the next update unless another root reaches them.
+    *root = tree->roots[--tree->numberOfRoots];
+}
+
+bool iTermProcessTreeHasRoot(const iTermProcessTree *tree, pid_t processID) {
+    return iTermProcessTreeFindRoot(tree, processID) != NULL;
+}
+
+void iTermProcessTreeSetNeedsFullUpdate(iTermProcessTree *tree) {
+    for (uint32_t i = 0; i <= tree->bucketMask; i++) {
+        for (iTermProcessTreeNode *node = tree->buckets[i]; node; node = node->next) {
+            node->childrenDirty = true;
+        }
+    }
+}
+
+#pragma mark - Updating
+
+static void iTermProcessTreeHandleEvents(iTermProcessTree *tree) {
+    if (!tree->source.readEvents) {
+        return;
+    }
+    iTermProcessTreeEvent events[64];
+    int count;
+    do {
+        count = tree->source.readEvents(tree->source.context, events, 64);
+        for (int i = 0; i < count; i++) {
+            iTermProcessTreeNode *node = iTermProcessTreeFind(tree, events[i].processID);
+            if (!node) {
+                continue;
+            }
+            if (events[i].events & iTermProcessTreeEventFork) {
+                node->childrenDirty = true;
+            }
+            if (events[i].events & iTermProcessTreeEventExec) {
+                node->execed = true;
+            }
+            if (events[i].events & iTermProcessTreeEventExit) {
+                iTermProcessTreeNode *parent = iTermProcessTreeFind(tree, node->process.parentProcessID);
+                if (parent) {
+                    parent->childrenDirty = true;
+                }
+            }
+        }
+    } while (count == 64);
+}
+
+static bool iTermProcessTreeChildrenEqual(const iTermProcessTreeNode *node, const pid_t *children, int count) {
+    return (node->numberOfChildren == count &&
+            (count == 0 || !memcmp(node->children, children, sizeof(pid_t) * (size_t)count)));
+}
+
+static bool iTermProcessTreeProcessesDiffer(const iTermProcessTreeProcess *a, const iTermProcessTreeProcess *b) {
+    return (a->parentProcessID != b->parentProcessID ||
+            a->processGroupID != b->processGroupID ||
+            a->terminalProcessGroupID != b->terminalProcessGroupID);
+}
+
+// Rereads a node's process and, if needed, its children. Returns false if it no longer exists.
+static bool iTermProcessTreeRefreshNode(iTermProcessTree *tree, iTermProcessTreeNode *node, bool isNew) {
+    node->readGeneration = tree->generation;
+    if (isNew && tree->source.watch) {
+        // Watch before listing children so a fork in between isn't missed.
+        node->watchedEvents = tree->source.watch(tree->source.context, node->processID);
+    }
+    iTermProcessTreeProcess process;
+    if (!tree->source.readProcess(tree->source.context, node->processID, &process)) {
+        node->gone = true;
+        return false;
+    }
+    bool changed = isNew || node->execed;
+    node->execed = false;
+    if (!isNew && process.startTime != node->process.startTime) {
+        // The process ID was reused. Start over.
+        if (node->watchedEvents && tree->source.unwatch) {
+            tree->source.unwatch(tree->source.context, node->processID);
+        }
+        node->watchedEvents = tree->source.watch ? tree->source.watch(tree->source.context, node->processID) : 0;
+        node->childrenDirty = true;
+        changed = true;
+    } else if (!isNew && iTermProcessTreeProcessesDiffer(&process, &node->process)) {
+        changed = true;
+    }
+    node->process = process;
+
+    // Without fork events the only way to find new children is to look.
+    if (node->childrenDirty || !(node->watchedEvents & iTermProcessTreeEventFork)) {
+        tree->listCount++;
+        const int count = iTermProcessTreeSourceListChildren(&tree->source,
+                                                             node->processID,
+                                                             &tree->scratch,
+                                                             &tree->scratchCapacity);
+        if (count >= 0) {
+            if (!iTermProcessTreeChildrenEqual(node, tree->scratch, count)) {
+                if (count > node->childrenCapacity) {
+                    node->childrenCapacity = count;
+                    node->children = realloc(node->children, sizeof(pid_t) * (size_t)count);
+                }
+                memcpy(node->children, tree->scratch, sizeof(pid_t) * (size_t)count);
+                node->numberOfChildren = count;
+                changed = true;
+            }
+            node->childrenDirty = false;
+        }
+    }
+    if (changed) {
+        node->changeGeneration = tree->generation;
+    }
+    return true;
+}
+
+// Returns false if the process no longer exists. Sets *changedPtr if anything in the subtree
+// changed this generation.
+static bool iTermProcessTreeVisit(iTermProcessTree *tree, pid_t processID, int depth, bool *changedPtr) {
+    if (depth > ITERM_PROCESS_TREE_MAXIMUM_DEPTH) {
+        return true;
+    }
+    iTermProcessTreeNode *node = iTermProcessTreeFind(tree, processID);
+    const bool isNew = (node == NULL);
+    if (isNew) {
+        node = iTermProcessTreeInsert(tree, processID);
+    }
+    if (node->readGeneration != tree->generation) {
+        if (!iTermProcessTreeRefreshNode(tree, node, isNew)) {
+            *changedPtr = true;
+            return false;
+        }
+    } else if (node->gone) {
+        // Already found to be gone while visiting another root.
+        *changedPtr = true;
+        return false;
+    }
+    if (node->changeGeneration == tree->generation) {
+        *changedPtr = true;
+    }
+    int i = 0;
+    while (i < node->numberOfChildren) {
+        if (iTermProcessTreeVisit(tree, node->children[i], depth + 1, changedPtr)) {
+            i++;
+            continue;
+        }
+        // The child exited. Removing it here saves relisting when there's no exit event.
+        memmove(node->children + i,
+                node->children + i + 1,
+                sizeof(pid_t) * (size_t)(node->numberOfChildren - i - 1));
+        node->numberOfChildren--;
+        node->changeGeneration = tree->generation;
+        *changedPtr = true;
+    }
+    return true;
+}
+
+// Frees nodes no root reached this generation.
+static void iTermProcessTreeSweep(iTermProcessTree *tree) {
+    for (uint32_t i = 0; i <= tree->bucketMask; i++) {
+        iTermProcessTreeNode **link = &tree->buckets[i];
+        while (*link) {
+            iTermProcessTreeNode *node = *link;
+            if (node->readGeneration == tree->generation && !node->gone) {
+                link = &node->next;
+                continue;
+            }
+            *link = node->next;
+            iTermProcessTreeFreeNode(tree, node);
+            tree->numberOfNodes--;
+        }
+    }
+}
+
+int iTermProcessTreeUpdate(iTermProcessTree *tree,
+                           void *context,
+                           void (*rootDidChange)(void *context, pid_t root)) {
+    tree->generation++;
+    tree->listCount = 0;
+    iTermProcessTreeHandleEvents(tree);
+    for (int i = 0; i < tree->numberOfRoots; i++) {
+        iTermProcessTreeRoot *root = &tree->roots[i];
+        bool changed = false;
+        const bool exists = iTermProcessTreeVisit(tree, root->processID, 0, &changed);
+        if (changed || !exists || !root->deepestForegroundJobValid) {
+            root->deepestForegroundJobValid = false;
+            if (rootDidChange && (changed || !exists)) {
+                rootDidChange(context, root->processID);
+            }
+        }
+    }
+    iTermProcessTreeSweep(tree);
+    return tree->listCount;
+}
+
+#pragma mark - Queries
+
+static bool iTermProcessTreeNodeIsForeground(const iTermProcessTreeNode *node) {
+    return (node->process.terminalProcessGroupID > 0 &&
+            node->process.processGroupID == node->process.terminalProcessGroupID);
+}
+
+// A port of -[iTermProcessInfo deepestForegroundJob:visited:cycle:depth:]. Returns 0 if there's
+// none, or -1 for a cycle.
+static pid_t iTermProcessTreeDeepest(const iTermProcessTree *tree,
+                                     const iTermProcessTreeNode *node,
+                                     int *levelInOut,
+                                     int depth) {
+    if (depth > ITERM_PROCESS_TREE_MAXIMUM_DEPTH) {
+        return -1;
+    }
+    int bestLevel = *levelInOut;
+    pid_t best = 0;
+    const bool isForeground = iTermProcessTreeNodeIsForeground(node);
+    if (node->numberOfChildren == 0 && isForeground) {
+        return node->processID;
+    } else if (isForeground) {
+        best = node->processID;
+    }
+    for (int i = 0; i < node->numberOfChildren; i++) {
+        const iTermProcessTreeNode *child = iTermProcessTreeFind(tree, node->children[i]);
+        if (!child || child->gone) {
+            continue;
+        }
+        int level = *levelInOut + 1;
+        const pid_t candidate = iTermProcessTreeDeepest(tree, child, &level, depth + 1);
+        if (candidate < 0) {
+            return -1;
+        }
+        if (candidate > 0 && (level > bestLevel || best == 0)) {
+            bestLevel = level;
+            best = candidate;
+        }
+    }
+    *levelInOut = bestLevel;
+    return best;
+}
+
+pid_t iTermProcessTreeDeepestForegroundJob(iTermProcessTree *tree, pid_t processID) {
+    iTermProcessTreeRoot *root = iTermProcessTreeFindRoot(tree, processID);
+    if (!root) {
+        return 0;
+    }
+    if (!root->deepestForegroundJobValid) {
+        const iTermProcessTreeNode *node = iTermProcessTreeFind(tree, processID);
+        pid_t result = 0;
+        if (node && !node->gone) {
+            int level = 0;
+            result = iTermProcessTreeDeepest(tree, node, &level, 0);
+        }
+        root->deepestForegroundJob = result > 0 ? result : 0;
+        root->deepestForegroundJobValid = true;
+    }
+    return root->deepestForegroundJob;
+}
+
+static void iTermProcessTreeEnumerateNode(const iTermProcessTree *tree,
+                                          const iTermProcessTreeNode *node,
+                                          int depth,
+                                          void *context,
+                                          void (*callback)(void *, pid_t, pid_t)) {
+    if (depth > ITERM_PROCESS_TREE_MAXIMUM_DEPTH) {
+        return;
+    }
+    callback(context, node->processID, node->process.parentProcessID);
+    for (int i = 0; i < node->numberOfChildren; i++) {
+        const iTermProcessTreeNode *child = iTermProcessTreeFind(tree, node->children[i]);
+        if (child && !child->gone) {
+            iTermProcessTreeEnumerateNode(tree, child, depth + 1, context, callback);
+        }
+    }
+}
+
+bool iTermProcessTreeEnumerateSubtree(const iTermProcessTree *tree,
+                                      pid_t processID,
+                                      void *context,
+                                      void (*callback)(void *context,
+                                                       pid_t processID,
+                                                       pid_t parentProcessID)) {
+    const iTermProcessTreeNode *node = iTermProcessTreeFind(tree, processID);
+    if (!node || node->gone || node->readGeneration != tree->generation) {
+        return false;
+    }
+    iTermProcessTreeEnumerateNode(tree, node, 0, context, callback);
+    return true;
+}
+
+#pragma mark - macOS
+
+#if defined(__APPLE__)
+
+#include <libproc.h>
+#include <sys/event.h>
+#include <sys/sysctl.h>
+
+typedef struct {
+    int kqueue;
+} iTermProcessTreeKqueueSource;
+
+static int iTermProcessTreeKqueueListChildren(void *context, pid_t processID, pid_t *children, int capacity) {
+    // proc_listpids returns a byte count. A full buffer may mean there are more.
+    const int bytes = proc_listpids(PROC_PPID_ONLY, (uint32_t)processID, children, capacity * (int)sizeof(pid_t));
+    if (bytes < 0) {
+        return -1;
+    }
+    const int count = bytes / (int)sizeof(pid_t);
+    return count == capacity ? capacity + 1 : count;
+}
+
+static bool iTermProcessTreeKqueueReadProcess(void *context, pid_t processID, iTermProcessTreeProcess *process) {
+    int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, processID };
+    struct kinfo_proc kp;
+    size_t size = sizeof(kp);
+    if (sysctl(mib, 4, &kp, &size, NULL, 0) < 0 || size == 0) {
+        return false;
+    }
+    process->parentProcessID = kp.kp_eproc.e_ppid;
+    process->processGroupID = kp.kp_eproc.e_pgid;
+    // Same test as +[iTermLSOF nameOfProcessWithPid:isForeground:].
+    process->terminalProcessGroupID = (kp.kp_proc.p_flag & P_CONTROLT) ? kp.kp_eproc.e_tpgid : -1;
+    process->startTime = (uint64_t)kp.kp_proc.p_starttime.tv_sec * 1000000 + (uint64_t)kp.kp_proc.p_starttime.tv_usec;
+    return true;
+}
+
+static uint32_t iTermProcessTreeKqueueWatch(void *context, pid_t processID) {
+    iTermProcessTreeKqueueSource *source = context;
+    struct kevent change;
+    EV_SET(&change, processID, EVFILT_PROC, EV_ADD | EV_CLEAR, NOTE_FORK | NOTE_EXEC | NOTE_EXIT, 0, NULL);
+    if (kevent(source->kqueue, &change, 1, NULL, 0, NULL) < 0) {
+        return 0;
+    }
+    return ITERM_PROCESS_TREE_ALL_EVENTS;
+}
+
+static void iTermProcessTreeKqueueUnwatch(void *context, pid_t processID) {
+    iTermProcessTreeKqueueSource *source = context;
+    struct kevent change;
+    EV_SET(&change, processID, EVFILT_PROC, EV_DELETE, 0, 0, NULL);
+    // Fails harmlessly if the process already exited, which removes the filter.
+    kevent(source->kqueue, &change, 1, NULL, 0, NULL);
+}
+
+static int iTermProcessTreeKqueueReadEvents(void *context, iTermProcessTreeEvent *events, int capacity) {
+    iTermProcessTreeKqueueSource *source = context;
+    struct kevent kevents[64];
+    const struct timespec zero = { 0, 0 };
+    const int count = kevent(source->kqueue, NULL, 0, kevents, capacity < 64 ? capacity : 64, &zero);
+    for (int i = 0; i < count; i++) {
+        events[i].processID = (pid_t)kevents[i].ident;
+        events[i].events = 0;
+        if (kevents[i].fflags & NOTE_FORK) {
+            events[i].events |= iTermProcessTreeEventFork;
+        }
+        if (kevents[i].fflags & NOTE_EXEC) {
+            events[i].events |= iTermProcessTreeEventExec;
+        }
+        if (kevents[i].fflags & NOTE_EXIT) {
+            events[i].events |= iTermProcessTreeEventExit;
+        }
+    }
+    return count < 0 ? 0 : count;
+}
+
+static void iTermProcessTreeKqueueDestroy(void *context) {
+    iTermProcessTreeKqueueSource *source = context;
+    close(source->kqueue);
+    free(source);
+}
+
+bool iTermProcessTreeSourceInitSystem(iTermProcessTreeSource *source) {
+    const int kq = kqueue();
+    if (kq < 0) {
+        return false;
+    }
+    fcntl(kq, F_SETFD, FD_CLOEXEC);
+    iTermProcessTreeKqueueSource *context = calloc(1, sizeof(*context));
+    context->kqueue = kq;
+    memset(source, 0, sizeof(*source));
+    source->context = context;
+    source->listChildren = iTermProcessTreeKqueueListChildren;
+    source->readProcess = iTermProcessTreeKqueueReadProcess;
+    source->watch = iTermProcessTreeKqueueWatch;
+    source->unwatch = iTermProcessTreeKqueueUnwatch;
+    source->readEvents = iTermProcessTreeKqueueReadEvents;
+    source->fileDescriptor = kq;
+    source->destroy = iTermProcessTreeKqueueDestroy;
+    return true;
+}
+
+#pragma mark - Linux
+
+#elif defined(__linux__)
+
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// Unprivileged processes can't get fork or exec events on Linux (the proc connector needs
+// CAP_NET_ADMIN), so only exits are reported, through pidfds. Children are listed from
+// /proc/<pid>/task/<tid>/children.
+typedef struct {
+    int epoll;
+    // Process ID and pidfd pairs. Tracked trees are small, so a linear search is fine.
+    struct {
+        pid_t processID;
+        int fd;
+    } *pidfds;
+    int numberOfPidfds;
+    int pidfdsCapacity;
+} iTermProcessTreeProcSource;
+
+static bool iTermProcessTreeProcReadProcess(void *context, pid_t processID, iTermProcessTreeProcess *process) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)processID);
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char buffer[1024];
+    const ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+    // The command name is in parentheses and may contain anything, including ")".
+    const char *fields = strrchr(buffer, ')');
+    if (!fields) {
+        return false;
+    }
+    char state;
+    int parentProcessID, processGroupID, session, terminal, terminalProcessGroupID;
+    unsigned long long startTime;
+    if (sscanf(fields + 1,
+               " %c %d %d %d %d %d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+               &state, &parentProcessID, &processGroupID, &session, &terminal, &terminalProcessGroupID,
+               &startTime) != 7) {
+        return false;
+    }
+    process->parentProcessID = parentProcessID;
+    process->processGroupID = processGroupID;
+    process->terminalProcessGroupID = terminal ? terminalProcessGroupID : -1;
+    process->startTime = startTime;
+    return true;
+}
+
+// For kernels without CONFIG_PROC_CHILDREN.
+static int iTermProcessTreeProcScanForChildren(pid_t processID, pid_t *children, int capacity) {
+    DIR *dir = opendir("/proc");
+    if (!dir) {
+        return -1;
+    }
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        char *end;
+        const long pid = strtol(entry->d_name, &end, 10);
+        iTermProcessTreeProcess process;
+        if (*end || pid <= 0 || !iTermProcessTreeProcReadProcess(NULL, (pid_t)pid, &process)) {
+            continue;
+        }
+        if (process.parentProcessID == processID) {
+            if (count < capacity) {
+                children[count] = (pid_t)pid;
+            }
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+static int iTermProcessTreeProcListChildren(void *context, pid_t processID, pid_t *children, int capacity) {
+    // Each thread has its own list of children.
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)processID);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+    int count = 0;
+    bool supported = true;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) && supported) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char childrenPath[sizeof(entry->d_name) + 64];
+        snprintf(childrenPath, sizeof(childrenPath), "/proc/%d/task/%s/children", (int)processID, entry->d_name);
+        FILE *file = fopen(childrenPath, "re");
+        if (!file) {
+            supported = (errno != ENOENT);
+            continue;
+        }
+        int child;
+        while (fscanf(file, "%d", &child) == 1) {
+            if (count < capacity) {
+                children[count] = child;
+            }
+            count++;
+        }
+        fclose(file);
+    }
+    closedir(dir);
+    if (!supported) {
+        return iTermProcessTreeProcScanForChildren(processID, children, capacity);
+    }
+    return count;
+}
+
+static uint32_t iTermProcessTreeProcWatch(void *context, pid_t processID) {
+    iTermProcessTreeProcSource *source = context;
+    const int fd = (int)syscall(SYS_pidfd_open, processID, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.u32 = (uint32_t)processID;
+    if (epoll_ctl(source->epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+        close(fd);
+        return 0;
+    }
+    if (source->numberOfPidfds == source->pidfdsCapacity) {
+        source->pidfdsCapacity = source->pidfdsCapacity ? source->pidfdsCapacity * 2 : 16;
+        source->pidfds = realloc(source->pidfds, sizeof(*source->pidfds) * (size_t)source->pidfdsCapacity);
+    }
+    source->pidfds[source->numberOfPidfds].processID = processID;
+    source->pidfds[source->numberOfPidfds].fd = fd;
+    source->numberOfPidfds++;
+    return iTermProcessTreeEventExit;
+}
+
+static void iTermProcessTreeProcUnwatch(void *context, pid_t processID) {
+    iTermProcessTreeProcSource *source = context;
+    for (int i = 0; i < source->numberOfPidfds; i++) {
+        if (source->pidfds[i].processID == processID) {
+            // Closing the last reference removes it from the epoll set.
+            close(source->pidfds[i].fd);
+            source->pidfds[i] = source->pidfds[--source->numberOfPidfds];
+            return;
+        }
+    }
+}
+
+static int iTermProcessTreeProcReadEvents(void *context, iTermProcessTreeEvent *events, int capacity) {
+    iTermProcessTreeProcSource *source = context;
+    struct epoll_event epollEvents[64];
+    const int count = epoll_wait(source->epoll, epollEvents, capacity < 64 ? capacity : 64, 0);
+    for (int i = 0; i < count; i++) {
+        events[i].processID = (pid_t)epollEvents[i].data.u32;
+        events[i].events = iTermProcessTreeEventExit;
+    }
+    return count < 0 ? 0 : count;
+}
+
+static void iTermProcessTreeProcDestroy(void *context) {
+    iTermProcessTreeProcSource *source = context;
+    for (int i = 0; i < source->numberOfPidfds; i++) {
+        close(source->pidfds[i].fd);
+    }
+    free(source->pidfds);
+    close(source->epoll);
+    free(source);
+}
+
+bool iTermProcessTreeSourceInitSystem(iTermProcessTreeSource *source) {
+    const int epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0) {
+        return false;
+    }
+    iTermProcessTreeProcSource *context = calloc(1, sizeof(*context));
+    context->epoll = epoll;
+    memset(source, 0, sizeof(*source));
+    source->context = context;
+    source->listChildren = iTermProcessTreeProcListChildren;
+    source->readProcess = iTermProcessTreeProcReadProcess;
+    source->watch = iTermProcessTreeProcWatch;
+    source->unwatch = iTermProcessTreeProcUnwatch;
+    source->readEvents = iTermProcessTreeProcReadEvents;
+    source->fileDescriptor = epoll;
+    source->destroy = iTermProcessTreeProcDestroy;
+    return true;
+}
+
+#else
+
+bool iTermProcessTreeSourceInitSystem(iTermProcessTreeSource *source) {
+    return false;
+}
+
+#endif
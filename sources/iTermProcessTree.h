@@ -0,0 +1,130 @@
+//
+//  iTermProcessTree.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Keeps the process trees under a few root processes (one per session) up to date without
+//  scanning every process on the system. It subscribes to fork, exec, and exit events for each
+//  process it knows about and relists the children only of processes that forked or lost a child.
+//  Each update still rereads the process group of every tracked process because a change of
+//  terminal foreground process group produces no event, but that costs one read per tracked
+//  process, not one per process on the system.
+//
+//  Where events come from is abstracted by iTermProcessTreeSource. The system source uses kqueue on
+//  macOS and /proc (with pidfds for exits) on Linux.
+//
+//  Not thread safe. Plain C with no Foundation dependency so it can be benchmarked anywhere (see
+//  tests/process_tree_bench.c).
+//
+
+#ifndef iTermProcessTree_h
+#define iTermProcessTree_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    iTermProcessTreeEventFork = 1 << 0,
+    iTermProcessTreeEventExec = 1 << 1,
+    iTermProcessTreeEventExit = 1 << 2
+};
+
+typedef struct {
+    pid_t processID;
+    uint32_t events;
+} iTermProcessTreeEvent;
+
+typedef struct {
+    pid_t parentProcessID;
+    pid_t processGroupID;
+    // The foreground process group of the process's controlling terminal, or -1 if it has none.
+    pid_t terminalProcessGroupID;
+    // Distinguishes a process from an earlier one with the same process ID.
+    uint64_t startTime;
+} iTermProcessTreeProcess;
+
+typedef struct {
+    void *context;
+
+    // Stores up to |capacity| child process IDs and returns how many children there are, which
+    // may be more than |capacity|. Returns -1 on error.
+    int (*listChildren)(void *context, pid_t processID, pid_t *children, int capacity);
+
+    // Returns false if the process doesn't exist.
+    bool (*readProcess)(void *context, pid_t processID, iTermProcessTreeProcess *process);
+
+    // Begins reporting events for a process. Returns the iTermProcessTreeEvent flags that will be
+    // reported, which may be none. May be NULL.
+    uint32_t (*watch)(void *context, pid_t processID);
+    void (*unwatch)(void *context, pid_t processID);
+
+    // Returns up to |capacity| pending events without blocking. May be NULL.
+    int (*readEvents)(void *context, iTermProcessTreeEvent *events, int capacity);
+
+    // Readable while events are pending, or -1 if there are no events.
+    int fileDescriptor;
+
+    void (*destroy)(void *context);
+} iTermProcessTreeSource;
+
+// Fills in the source for the current platform. Returns false if there isn't one.
+bool iTermProcessTreeSourceInitSystem(iTermProcessTreeSource *source);
+
+// Calls |callback| for |processID| and each descendant in preorder without tracking anything.
+// Safe to call on any thread with the system source. Returns false if the process doesn't exist.
+bool iTermProcessTreeSourceEnumerateSubtree(const iTermProcessTreeSource *source,
+                                            pid_t processID,
+                                            void *context,
+                                            void (*callback)(void *context,
+                                                             pid_t processID,
+                                                             pid_t parentProcessID));
+
+typedef struct iTermProcessTree iTermProcessTree;
+
+// Takes ownership of |source|.
+iTermProcessTree *iTermProcessTreeCreate(const iTermProcessTreeSource *source);
+void iTermProcessTreeFree(iTermProcessTree *tree);
+
+// Pollable descriptor for the source's events, or -1. When it's readable, call
+// iTermProcessTreeUpdate().
+int iTermProcessTreeFileDescriptor(const iTermProcessTree *tree);
+
+void iTermProcessTreeAddRoot(iTermProcessTree *tree, pid_t processID);
+void iTermProcessTreeRemoveRoot(iTermProcessTree *tree, pid_t processID);
+bool iTermProcessTreeHasRoot(const iTermProcessTree *tree, pid_t processID);
+
+// Forgets what events said and relists every tracked process's children on the next update.
+void iTermProcessTreeSetNeedsFullUpdate(iTermProcessTree *tree);
+
+// Consumes pending events and brings the tracked trees up to date. Calls |rootDidChange| for
+// each root whose tree or foreground job changed since the last update. Returns the number of
+// processes whose children had to be listed.
+int iTermProcessTreeUpdate(iTermProcessTree *tree,
+                           void *context,
+                           void (*rootDidChange)(void *context, pid_t root));
+
+// The process under |root| (inclusive) in the terminal's foreground process group with the most
+// ancestors, preferring lower process IDs among equals. Returns 0 if there is none or |root|
+// isn't tracked. Cached between updates.
+pid_t iTermProcessTreeDeepestForegroundJob(iTermProcessTree *tree, pid_t root);
+
+// Calls |callback| for |processID| and each descendant in preorder. Returns false if the process
+// isn't in a tracked tree.
+bool iTermProcessTreeEnumerateSubtree(const iTermProcessTree *tree,
+                                      pid_t processID,
+                                      void *context,
+                                      void (*callback)(void *context,
+                                                       pid_t processID,
+                                                       pid_t parentProcessID));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermProcessTree_h
@@ -0,0 +1,33 @@
+//
+//  iTermRegexPrefilter.h
+//  iTerm2SharedARC
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Decides, in one pass over a string, which of a set of regular expressions might match it.
+// Each regex contributes a literal that every match must contain (see iTermMultiLiteralMatcher.h);
+// all the literals are searched for at once and only regexes whose literal occurs are candidates.
+// Regexes without a usable literal are always candidates. This never rules out a regex that would
+// match, so callers still run the real regex on every candidate.
+@interface iTermRegexPrefilter : NSObject
+
+@property (nonatomic, readonly) NSArray<NSString *> *regexes;
+
+// Number of regexes that can be ruled out by the prefilter (as opposed to always being candidates).
+@property (nonatomic, readonly) NSInteger numberOfPrefilteredRegexes;
+
+- (instancetype)initWithRegexes:(NSArray<NSString *> *)regexes NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+// Calls |block| once for each regex, in order. |mayMatch| is NO if the regex can't match |string|.
+- (void)enumerateRegexesForString:(NSString *)string
+                            block:(void (NS_NOESCAPE ^)(NSUInteger index, BOOL mayMatch, BOOL *stop))block;
+
+@end
+
+NS_ASSUME_NONNULL_END
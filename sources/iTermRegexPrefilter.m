@@ -0,0 +1,113 @@
+//
+//  iTermRegexPrefilter.m
+//  iTerm2SharedARC
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import "iTermRegexPrefilter.h"
+
+#import "DebugLogging.h"
+#import "iTermMalloc.h"
+#import "iTermMultiLiteralMatcher.h"
+
+@implementation iTermRegexPrefilter {
+    // NULL if scanning wouldn't pay off, in which case every regex is always a candidate.
+    iTermMultiLiteralMatcher *_matcher;
+    // One entry per regex. YES if the regex has no required literal and must always run.
+    bool *_alwaysCandidate;
+}
+
+- (instancetype)initWithRegexes:(NSArray<NSString *> *)regexes {
+    self = [super init];
+    if (self) {
+        _regexes = [regexes copy];
+        const NSUInteger count = regexes.count;
+        _alwaysCandidate = iTermCalloc(MAX(1, count), sizeof(bool));
+        uint16_t (*literals)[ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH] =
+            iTermMalloc(MAX(1, count) * sizeof(*literals));
+        size_t *literalLengths = iTermCalloc(MAX(1, count), sizeof(size_t));
+        bool *caseInsensitive = iTermCalloc(MAX(1, count), sizeof(bool));
+        NSInteger numberOfUsefulLiterals = 0;
+        for (NSUInteger i = 0; i < count; i++) {
+            NSString *regex = regexes[i];
+            const NSUInteger length = regex.length;
+            unichar *pattern = iTermMalloc(MAX(1, length) * sizeof(unichar));
+            [regex getCharacters:pattern range:NSMakeRange(0, length)];
+            if (iTermRegexRequiredLiteral(pattern,
+                                          length,
+                                          literals[i],
+                                          ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH,
+                                          &literalLengths[i],
+                                          &caseInsensitive[i]) &&
+                literalLengths[i] >= ITERM_MULTI_LITERAL_MATCHER_MIN_USEFUL_LITERAL_LENGTH) {
+                numberOfUsefulLiterals += 1;
+            } else {
+                DLog(@"No useful prefilter literal for regex %@", regex);
+                literalLengths[i] = 0;
+            }
+            free(pattern);
+        }
+
+        if (numberOfUsefulLiterals >= ITERM_MULTI_LITERAL_MATCHER_MIN_USEFUL_LITERALS) {
+            _matcher = iTermMultiLiteralMatcherCreate();
+        }
+        for (NSUInteger i = 0; i < count; i++) {
+            if (_matcher &&
+                literalLengths[i] > 0 &&
+                iTermMultiLiteralMatcherAddLiteral(_matcher, literals[i], literalLengths[i], caseInsensitive[i], (int)i)) {
+                _numberOfPrefilteredRegexes += 1;
+            } else {
+                _alwaysCandidate[i] = true;
+            }
+        }
+        if (_matcher) {
+            iTermMultiLiteralMatcherCompile(_matcher);
+        }
+        free(literals);
+        free(literalLengths);
+        free(caseInsensitive);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_matcher) {
+        iTermMultiLiteralMatcherFree(_matcher);
+    }
+    free(_alwaysCandidate);
+}
+
+- (void)enumerateRegexesForString:(NSString *)string
+                            block:(void (NS_NOESCAPE ^)(NSUInteger, BOOL, BOOL *))block {
+    const NSUInteger count = _regexes.count;
+    if (count == 0) {
+        return;
+    }
+    bool stackCandidates[64];
+    bool *candidates = count <= 64 ? stackCandidates : iTermMalloc(count * sizeof(bool));
+    memcpy(candidates, _alwaysCandidate, count * sizeof(bool));
+
+    if (_numberOfPrefilteredRegexes > 0) {
+        const NSUInteger length = string.length;
+        const unichar *characters = CFStringGetCharactersPtr((CFStringRef)string);
+        unichar *buffer = NULL;
+        if (!characters) {
+            buffer = iTermMalloc(MAX(1, length) * sizeof(unichar));
+            [string getCharacters:buffer range:NSMakeRange(0, length)];
+            characters = buffer;
+        }
+        iTermMultiLiteralMatcherScan(_matcher, characters, length, candidates);
+        free(buffer);
+    }
+
+    BOOL stop = NO;
+    for (NSUInteger i = 0; i < count && !stop; i++) {
+        block(i, candidates[i], &stop);
+    }
+    if (candidates != stackCandidates) {
+        free(candidates);
+    }
+}
+
+@end
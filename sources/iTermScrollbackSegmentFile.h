@@ -0,0 +1,37 @@
+//
+//  iTermScrollbackSegmentFile.h
+//  iTerm2SharedARC
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  A temporary file that holds the compressed cells of scrollback blocks that don't fit in the
+//  memory budget. Data is read back through mmap so the kernel can page it in and out as needed
+//  instead of it counting against the app's dirty memory. When a mapping is deallocated its space
+//  is reused by later writes, and the file shrinks if the space was at the end. The file is
+//  unlinked as soon as it's created, so it disappears when the last reference to it goes away,
+//  even after a crash.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface iTermScrollbackSegmentFile : NSObject
+
+// Size of the file, including space that's free for reuse.
+@property (atomic, readonly) unsigned long long length;
+
+// Number of bytes in the file that are still mapped.
+@property (atomic, readonly) unsigned long long liveLength;
+
+// Returns nil if a temporary file can't be created.
+- (nullable instancetype)init NS_DESIGNATED_INITIALIZER;
+
+// Writes |data| to the first free space that's big enough, or else the end of the file, and returns
+// a read-only mapping of it. The mapping remains valid after the segment file is deallocated, and
+// may be deallocated on any thread. Returns nil on I/O error.
+- (nullable NSData *)appendData:(NSData *)data;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,146 @@
+//
+//  iTermScrollbackSegmentFile.m
+//  iTerm2SharedARC
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import "iTermScrollbackSegmentFile.h"
+
+#import "DebugLogging.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+@implementation iTermScrollbackSegmentFile {
+    int _fd;
+    unsigned long long _length;
+    // Byte ranges before _length that no mapping refers to. Guarded by @synchronized(self) because
+    // mappings may be deallocated on any thread.
+    NSMutableIndexSet *_free;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        NSString *template = [NSTemporaryDirectory() stringByAppendingPathComponent:@"iTerm2-scrollback.XXXXXX"];
+        char *path = strdup(template.fileSystemRepresentation);
+        _fd = mkstemp(path);
+        if (_fd < 0) {
+            XLog(@"mkstemp failed with template %s: %s", path, strerror(errno));
+            free(path);
+            return nil;
+        }
+        // Nothing else ever needs to open it by name.
+        unlink(path);
+        free(path);
+        _free = [[NSMutableIndexSet alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    // Existing mappings stay valid after the descriptor is closed.
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+- (unsigned long long)length {
+    @synchronized (self) {
+        return _length;
+    }
+}
+
+- (unsigned long long)liveLength {
+    @synchronized (self) {
+        return _length - _free.count;
+    }
+}
+
+- (NSData *)appendData:(NSData *)data {
+    if (data.length == 0) {
+        return [NSData data];
+    }
+    const NSRange range = [self reserveRangeOfLength:data.length];
+    const off_t offset = range.location;
+    const unsigned char *bytes = data.bytes;
+    size_t written = 0;
+    while (written < data.length) {
+        const ssize_t n = pwrite(_fd, bytes + written, data.length - written, offset + written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            DLog(@"pwrite of %@ bytes at %@ failed: %s", @(data.length), @(offset), strerror(errno));
+            [self freeRange:range];
+            return nil;
+        }
+        written += n;
+    }
+
+    // mmap needs a page-aligned offset, so map from the start of the page containing the data.
+    const off_t pageSize = getpagesize();
+    const off_t alignedOffset = offset - (offset % pageSize);
+    const size_t slop = offset - alignedOffset;
+    const size_t mappingLength = slop + data.length;
+    void *mapping = mmap(NULL, mappingLength, PROT_READ, MAP_SHARED, _fd, alignedOffset);
+    if (mapping == MAP_FAILED) {
+        DLog(@"mmap of %@ bytes at %@ failed: %s", @(mappingLength), @(alignedOffset), strerror(errno));
+        [self freeRange:range];
+        return nil;
+    }
+    __weak __typeof(self) weakSelf = self;
+    return [[NSData alloc] initWithBytesNoCopy:((unsigned char *)mapping) + slop
+                                        length:data.length
+                                   deallocator:^(void *bytes, NSUInteger length) {
+                                       munmap(mapping, mappingLength);
+                                       [weakSelf freeRange:range];
+                                   }];
+}
+
+#pragma mark - Private
+
+// Takes the first free range that's big enough, or else grows the file.
+- (NSRange)reserveRangeOfLength:(NSUInteger)length {
+    @synchronized (self) {
+        __block NSRange range = NSMakeRange(NSNotFound, length);
+        [_free enumerateRangesUsingBlock:^(NSRange freeRange, BOOL * _Nonnull stop) {
+            if (freeRange.length >= length) {
+                range.location = freeRange.location;
+                *stop = YES;
+            }
+        }];
+        if (range.location != NSNotFound) {
+            [_free removeIndexesInRange:range];
+            return range;
+        }
+        range.location = _length;
+        _length += length;
+        return range;
+    }
+}
+
+- (void)freeRange:(NSRange)range {
+    @synchronized (self) {
+        [_free addIndexesInRange:range];
+        // Give free space at the end back to the file system. A live mapping's last page holds its
+        // last byte, so no mapping is left with a page entirely past the end of the file.
+        __block NSRange last = NSMakeRange(NSNotFound, 0);
+        [_free enumerateRangesWithOptions:NSEnumerationReverse usingBlock:^(NSRange freeRange, BOOL * _Nonnull stop) {
+            last = freeRange;
+            *stop = YES;
+        }];
+        if (last.location == NSNotFound || NSMaxRange(last) != _length) {
+            return;
+        }
+        if (ftruncate(_fd, last.location) != 0) {
+            DLog(@"ftruncate to %@ failed: %s", @(last.location), strerror(errno));
+            return;
+        }
+        [_free removeIndexesInRange:last];
+        _length = last.location;
+    }
+}
+
+@end
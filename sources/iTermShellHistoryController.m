@@ -9,6 +9,7 @@
 #import "iTermShellHistoryController.h"
 
 #import "DebugLogging.h"
+#import "iTermCommandHistoryPrefixIndex.h"
 #import "iTermCommandHistoryEntryMO+Additions.h"
 #import "iTermDirectoryTree.h"
 #import "iTermHostRecordMO.h"
@@ -53,6 +54,10 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
 
     // Keys are remote host keys, "user@hostname".
     NSMutableDictionary<NSString *, NSMutableArray<iTermCommandHistoryCommandUseMO *> *> *_expandedCache;
+
+    // Keys are remote host keys. Built lazily on the first lookup for a host and then kept
+    // up to date as commands are added.
+    NSMutableDictionary<NSString *, iTermCommandHistoryPrefixIndex<iTermCommandHistoryEntryMO *> *> *_prefixIndexes;
     NSManagedObjectContext *_managedObjectContext;
     iTermDirectoryTree *_tree;
 
@@ -99,6 +104,7 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
     }
     _records = [[NSMutableDictionary alloc] init];
     _expandedCache = [[NSMutableDictionary alloc] init];
+    _prefixIndexes = [[NSMutableDictionary alloc] init];
     _tree = [[iTermDirectoryTree alloc] init];
 
     [self removeOldData];
@@ -111,6 +117,7 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
 - (void)dealloc {
     [_records release];
     [_expandedCache release];
+    [_prefixIndexes release];
     [_managedObjectContext release];
     [_tree release];
     [super dealloc];
@@ -351,6 +358,7 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
     // Reload everything.
     [_records removeAllObjects];
     [_expandedCache removeAllObjects];
+    [_prefixIndexes removeAllObjects];
     [_tree release];
     _tree = [[iTermDirectoryTree alloc] init];
     [self loadObjectGraph];
@@ -436,6 +444,7 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
     if (commandHistory) {
         [self deleteObjectsWithEntityName:[iTermCommandHistoryEntryMO entityName]];
         [self deleteObjectsWithEntityName:[iTermCommandHistoryCommandUseMO entityName]];
+        [_prefixIndexes removeAllObjects];
     }
     if (directories) {
         [self deleteObjectsWithEntityName:[iTermRecentDirectoryMO entityName]];
@@ -471,13 +480,9 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
         [self setRecord:hostRecord forHost:host];
     }
 
-    iTermCommandHistoryEntryMO *theEntry = nil;
-    for (iTermCommandHistoryEntryMO *entry in hostRecord.entries) {
-        if ([entry.command isEqualToString:command]) {
-            theEntry = entry;
-            break;
-        }
-    }
+    NSString *key = host.key ?: @"";
+    iTermCommandHistoryPrefixIndex<iTermCommandHistoryEntryMO *> *prefixIndex = [self prefixIndexForHostRecord:hostRecord key:key];
+    iTermCommandHistoryEntryMO *theEntry = [prefixIndex objectForCommand:command];
 
     if (!theEntry) {
         theEntry = [iTermCommandHistoryEntryMO commandHistoryEntryInContext:_managedObjectContext];
@@ -487,6 +492,10 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
 
     theEntry.numberOfUses = @(theEntry.numberOfUses.integerValue + 1);
     theEntry.timeOfLastUse = @([self now]);
+    [prefixIndex setObject:theEntry
+                forCommand:theEntry.command
+                      uses:theEntry.numberOfUses.integerValue
+                   lastUse:theEntry.timeOfLastUse.doubleValue];
 
     iTermCommandHistoryCommandUseMO *commandUse =
     [iTermCommandHistoryCommandUseMO commandHistoryCommandUseInContext:_managedObjectContext];
@@ -496,7 +505,6 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
     commandUse.command = theEntry.command;
     [theEntry addUsesObject:commandUse];
 
-    NSString *key = host.key ?: @"";
     if (_expandedCache[key]) {
         [_expandedCache[key] addObject:commandUse];
     }
@@ -525,22 +533,21 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
 
 - (NSArray<iTermCommandHistoryEntryMO *> *)commandHistoryEntriesWithPrefix:(NSString *)partialCommand
                                                                     onHost:(VT100RemoteHost *)host {
-    BOOL emptyPartialCommand = (partialCommand.length == 0);
-    NSMutableArray<iTermCommandHistoryEntryMO *> *result = [NSMutableArray array];
     iTermHostRecordMO *hostRecord = [self recordForHost:host];
-    for (iTermCommandHistoryEntryMO *entry in hostRecord.entries) {
-        if (emptyPartialCommand || [entry.command caseInsensitiveHasPrefix:partialCommand]) {
-            // The FinalTerm algorithm doesn't require |partialCommand| to be a prefix of the
-            // history entry, but based on how our autocomplete works, it makes sense to only
-            // accept prefixes. Their scoring algorithm is implemented in case this should change.
-            entry.matchLocation = @0;
-            [result addObject:entry];
-        }
+    if (!hostRecord) {
+        return @[];
+    }
+    iTermCommandHistoryPrefixIndex<iTermCommandHistoryEntryMO *> *prefixIndex =
+        [self prefixIndexForHostRecord:hostRecord key:host.key ?: @""];
+    NSArray<iTermCommandHistoryEntryMO *> *result = [prefixIndex objectsWithPrefix:partialCommand
+                                                                             limit:kMaxResults];
+    for (iTermCommandHistoryEntryMO *entry in result) {
+        // The FinalTerm algorithm doesn't require |partialCommand| to be a prefix of the
+        // history entry, but based on how our autocomplete works, it makes sense to only
+        // accept prefixes. Their scoring algorithm is implemented in case this should change.
+        entry.matchLocation = @0;
     }
-
-    // TODO: Cache this.
-    NSArray *sortedEntries = [result sortedArrayUsingSelector:@selector(compare:)];
-    return [sortedEntries subarrayWithRange:NSMakeRange(0, MIN(kMaxResults, sortedEntries.count))];
+    return result;
 }
 
 - (NSArray<iTermCommandHistoryCommandUseMO *> *)autocompleteSuggestionsWithPartialCommand:(NSString *)partialCommand
@@ -657,6 +664,7 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
     if (hostRecord) {
         [hostRecord removeEntries:hostRecord.entries];
         [_expandedCache removeObjectForKey:key];
+        [_prefixIndexes removeObjectForKey:key];
         [self saveCommandHistory];
     }
 }
@@ -749,6 +757,7 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
 - (void)loadObjectGraph {
     [self loadObjectGraphIntoDictionary:_records];
     [_expandedCache removeAllObjects];
+    [_prefixIndexes removeAllObjects];
     for (NSString *hostKey in _records) {
         iTermHostRecordMO *hostRecord = _records[hostKey];
         for (iTermRecentDirectoryMO *directory in hostRecord.directories) {
@@ -765,6 +774,26 @@ static const NSTimeInterval kMaxTimeToRememberDirectories = 60 * 60 * 24 * 90;
     _records[host.key ?: @""] = record;
 }
 
+- (iTermCommandHistoryPrefixIndex<iTermCommandHistoryEntryMO *> *)prefixIndexForHostRecord:(iTermHostRecordMO *)hostRecord
+                                                                                       key:(NSString *)key {
+    iTermCommandHistoryPrefixIndex<iTermCommandHistoryEntryMO *> *prefixIndex = _prefixIndexes[key];
+    if (prefixIndex) {
+        return prefixIndex;
+    }
+    prefixIndex = [[[iTermCommandHistoryPrefixIndex alloc] init] autorelease];
+    for (iTermCommandHistoryEntryMO *entry in hostRecord.entries) {
+        if (!entry.command) {
+            continue;
+        }
+        [prefixIndex setObject:entry
+                    forCommand:entry.command
+                          uses:entry.numberOfUses.integerValue
+                       lastUse:entry.timeOfLastUse.doubleValue];
+    }
+    _prefixIndexes[key] = prefixIndex;
+    return prefixIndex;
+}
+
 #pragma mark Private Command History
 
 - (NSMutableArray<iTermCommandHistoryCommandUseMO *> *)commandUsesByExpandingEntries:(NSArray<iTermCommandHistoryEntryMO *> *)array {
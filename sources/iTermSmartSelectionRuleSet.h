@@ -0,0 +1,48 @@
+//
+//  iTermSmartSelectionRuleSet.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Smart selection rules (as in SmartSelectionController) with their regular
+// expressions compiled once. Finds candidate matches by searching ranges of a
+// single string rather than copying a suffix of the text for each starting
+// offset, and gets capture groups from the same match instead of matching a
+// second time.
+@interface iTermSmartSelectionRuleSet : NSObject
+
+@property (nonatomic, readonly) NSArray<NSDictionary *> *rules;
+
+// Returns a rule set for |rules|. Recently used rule sets are cached, so this is
+// cheap to call each time smart selection is performed.
++ (instancetype)ruleSetWithRules:(NSArray<NSDictionary *> *)rules;
+
+- (instancetype)initWithRules:(NSArray<NSDictionary *> *)rules NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+// Calls |block| with each match containing |targetOffset|. For each rule,
+// searching starts at the beginning of |string|. After a match containing the
+// target the next search begins at its end; after any other match it begins
+// one character past the match's start. Each search sees only the text from
+// its starting offset onward, so ^ and \b behave as they would at the start of
+// the string. |score| is the rule's precision times the match's length.
+// |components| holds the whole match followed by each capture group, with
+// empty strings for groups that did not participate. Rules without actions
+// are skipped when |actionRequired| is set, as are rules whose regex does not
+// compile.
+- (void)enumerateMatchesInString:(NSString *)string
+                  coveringOffset:(NSUInteger)targetOffset
+                  actionRequired:(BOOL)actionRequired
+                           block:(void (^NS_NOESCAPE)(NSDictionary *rule,
+                                                      NSRange range,
+                                                      double score,
+                                                      NSArray<NSString *> *components))block;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,156 @@
+//
+//  iTermSmartSelectionRuleSet.m
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import "iTermSmartSelectionRuleSet.h"
+
+#import "DebugLogging.h"
+#import "SmartSelectionController.h"
+
+// Profiles rarely use more than a couple of distinct rule lists.
+static const NSUInteger iTermSmartSelectionRuleSetCacheSize = 4;
+
+@interface iTermSmartSelectionCompiledRule : NSObject
+@property (nonatomic, retain) NSDictionary *rule;
+// nil if the regex failed to compile.
+@property (nonatomic, retain) NSRegularExpression *regex;
+@property (nonatomic) double precision;
+@property (nonatomic) BOOL hasActions;
+@end
+
+@implementation iTermSmartSelectionCompiledRule
+
+- (void)dealloc {
+    [_rule release];
+    [_regex release];
+    [super dealloc];
+}
+
+@end
+
+@implementation iTermSmartSelectionRuleSet {
+    NSArray<iTermSmartSelectionCompiledRule *> *_compiledRules;
+}
+
++ (instancetype)ruleSetWithRules:(NSArray<NSDictionary *> *)rules {
+    static NSMutableArray<iTermSmartSelectionRuleSet *> *cache;
+    @synchronized (self) {
+        if (!cache) {
+            cache = [[NSMutableArray alloc] init];
+        }
+        // Rule lists come from profiles or the defaults, so they are usually
+        // the very same object as last time.
+        NSUInteger index = [cache indexOfObjectPassingTest:^BOOL(iTermSmartSelectionRuleSet *ruleSet, NSUInteger idx, BOOL *stop) {
+            return ruleSet.rules == rules;
+        }];
+        if (index == NSNotFound) {
+            index = [cache indexOfObjectPassingTest:^BOOL(iTermSmartSelectionRuleSet *ruleSet, NSUInteger idx, BOOL *stop) {
+                return [ruleSet.rules isEqualToArray:rules];
+            }];
+        }
+        iTermSmartSelectionRuleSet *ruleSet;
+        if (index == NSNotFound) {
+            ruleSet = [[[self alloc] initWithRules:rules] autorelease];
+        } else {
+            ruleSet = [[cache[index] retain] autorelease];
+            [cache removeObjectAtIndex:index];
+        }
+        [cache insertObject:ruleSet atIndex:0];
+        while (cache.count > iTermSmartSelectionRuleSetCacheSize) {
+            [cache removeLastObject];
+        }
+        return ruleSet;
+    }
+}
+
+- (instancetype)initWithRules:(NSArray<NSDictionary *> *)rules {
+    self = [super init];
+    if (self) {
+        _rules = [rules copy];
+        NSMutableArray<iTermSmartSelectionCompiledRule *> *compiledRules = [NSMutableArray array];
+        for (NSDictionary *rule in _rules) {
+            iTermSmartSelectionCompiledRule *compiledRule = [[[iTermSmartSelectionCompiledRule alloc] init] autorelease];
+            compiledRule.rule = rule;
+            compiledRule.precision = [SmartSelectionController precisionInRule:rule];
+            compiledRule.hasActions = [[SmartSelectionController actionsInRule:rule] count] > 0;
+            NSString *pattern = [SmartSelectionController regexInRule:rule];
+            if (pattern) {
+                NSError *error = nil;
+                compiledRule.regex = [NSRegularExpression regularExpressionWithPattern:pattern
+                                                                               options:0
+                                                                                 error:&error];
+                if (!compiledRule.regex) {
+                    DLog(@"Smart selection regex %@ failed to compile: %@", pattern, error);
+                }
+            }
+            [compiledRules addObject:compiledRule];
+        }
+        _compiledRules = [compiledRules copy];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_rules release];
+    [_compiledRules release];
+    [super dealloc];
+}
+
+- (NSArray<NSString *> *)componentsOfResult:(NSTextCheckingResult *)result inString:(NSString *)string {
+    NSMutableArray<NSString *> *components = [NSMutableArray arrayWithCapacity:result.numberOfRanges];
+    for (NSUInteger i = 0; i < result.numberOfRanges; i++) {
+        const NSRange range = [result rangeAtIndex:i];
+        if (range.location == NSNotFound) {
+            [components addObject:@""];
+        } else {
+            [components addObject:[string substringWithRange:range]];
+        }
+    }
+    return components;
+}
+
+- (void)enumerateMatchesInString:(NSString *)string
+                  coveringOffset:(NSUInteger)targetOffset
+                  actionRequired:(BOOL)actionRequired
+                           block:(void (^NS_NOESCAPE)(NSDictionary *rule,
+                                                      NSRange range,
+                                                      double score,
+                                                      NSArray<NSString *> *components))block {
+    const NSUInteger length = string.length;
+    for (iTermSmartSelectionCompiledRule *compiledRule in _compiledRules) {
+        if (actionRequired && !compiledRule.hasActions) {
+            DLog(@"Ignore smart selection rule because it has no action: %@", compiledRule.rule);
+            continue;
+        }
+        NSRegularExpression *regex = compiledRule.regex;
+        if (!regex) {
+            continue;
+        }
+        NSUInteger start = 0;
+        while (start <= targetOffset && start <= length) {
+            // Without transparent bounds the regex can't look behind |start|, and
+            // anchors match at |start|, just as if the text began there.
+            NSTextCheckingResult *result = [regex firstMatchInString:string
+                                                             options:0
+                                                               range:NSMakeRange(start, length - start)];
+            if (!result) {
+                break;
+            }
+            const NSRange range = result.range;
+            if (range.location <= targetOffset && NSMaxRange(range) > targetOffset) {
+                block(compiledRule.rule,
+                      range,
+                      compiledRule.precision * range.length,
+                      [self componentsOfResult:result inString:string]);
+                start = NSMaxRange(range);
+            } else {
+                start = range.location + 1;
+            }
+        }
+    }
+}
+
+@end
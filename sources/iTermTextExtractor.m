@@ -15,10 +15,10 @@
 #import "iTermURLStore.h"
 #import "NSStringITerm.h"
 #import "NSMutableAttributedString+iTerm.h"
-#import "RegexKitLite.h"
 #import "PreferencePanel.h"
 #import "SmartMatch.h"
 #import "SmartSelectionController.h"
+#import "iTermSmartSelectionRuleSet.h"
 
 typedef NS_ENUM(NSUInteger, iTermAlphaNumericDefinition) {
     iTermAlphaNumericDefinitionNarrow,
@@ -721,8 +721,8 @@ const NSInteger kLongMaximumWordLength = 100000;
                                      coords:coords
                            ignoringNewlines:ignoringNewlines || [self hasLogicalWindow]];
 
-    NSArray* rulesArray = rules ?: [SmartSelectionController defaultRules];
-    const int numRules = [rulesArray count];
+    iTermSmartSelectionRuleSet *ruleSet =
+        [iTermSmartSelectionRuleSet ruleSetWithRules:rules ?: [SmartSelectionController defaultRules]];
 
     NSMutableDictionary* matches = [NSMutableDictionary dictionaryWithCapacity:13];
     int numCoords = [coords count];
@@ -731,63 +731,35 @@ const NSInteger kLongMaximumWordLength = 100000;
     if (debug) {
         NSLog(@"Perform smart selection on text: %@", textWindow);
     }
-    for (int j = 0; j < numRules; j++) {
-        NSDictionary *rule = [rulesArray objectAtIndex:j];
-        if (actionRequired && [[SmartSelectionController actionsInRule:rule] count] == 0) {
-            DLog(@"Ignore smart selection rule because it has no action: %@", rule);
-            continue;
+    [ruleSet enumerateMatchesInString:textWindow
+                       coveringOffset:targetOffset
+                       actionRequired:actionRequired
+                                block:^(NSDictionary *rule, NSRange matchRange, double score, NSArray<NSString *> *components) {
+        NSString *result = components[0];
+        SmartMatch *oldMatch = [matches objectForKey:result];
+        if (oldMatch && score <= oldMatch.score) {
+            return;
         }
-        NSString *regex = [SmartSelectionController regexInRule:rule];
-        double precision = [SmartSelectionController precisionInRule:rule];
+        SmartMatch *match = [[[SmartMatch alloc] init] autorelease];
+        match.score = score;
+        VT100GridCoord startCoord = [coords[matchRange.location] gridCoordValue];
+        VT100GridCoord endCoord = [coords[MIN(numCoords - 1, (int)NSMaxRange(matchRange) - 1)] gridCoordValue];
+        endCoord = [self successorOfCoord:endCoord];
+        match.startX = startCoord.x;
+        match.absStartY = startCoord.y + [_dataSource totalScrollbackOverflow];
+        match.endX = endCoord.x;
+        match.absEndY = endCoord.y + [_dataSource totalScrollbackOverflow];
+        match.rule = rule;
+        match.components = components;
+        [matches setObject:match forKey:result];
+
         if (debug) {
-            NSLog(@"Try regex %@", regex);
+            NSLog(@"Regex %@ matched. Add result %@ at %d,%lld -> %d,%lld with score %lf",
+                  [SmartSelectionController regexInRule:rule], result,
+                  match.startX, match.absStartY, match.endX, match.absEndY,
+                  match.score);
         }
-        for (int i = 0; i <= targetOffset; i++) {
-            NSString* substring = [textWindow substringWithRange:NSMakeRange(i, [textWindow length] - i)];
-            NSError* regexError = nil;
-            NSRange temp = [substring rangeOfRegex:regex
-                                           options:0
-                                           inRange:NSMakeRange(0, [substring length])
-                                           capture:0
-                                             error:&regexError];
-            if (temp.location != NSNotFound) {
-                if (i + temp.location <= targetOffset && i + temp.location + temp.length > targetOffset) {
-                    NSString* result = [substring substringWithRange:temp];
-                    double score = precision * (double) temp.length;
-                    SmartMatch* oldMatch = [matches objectForKey:result];
-                    if (!oldMatch || score > oldMatch.score) {
-                        SmartMatch* match = [[[SmartMatch alloc] init] autorelease];
-                        match.score = score;
-                        VT100GridCoord startCoord = [coords[i + temp.location] gridCoordValue];
-                        VT100GridCoord endCoord = [coords[MIN(numCoords - 1,
-                                                              i + temp.location + temp.length - 1)] gridCoordValue];
-                        endCoord = [self successorOfCoord:endCoord];
-                        match.startX = startCoord.x;
-                        match.absStartY = startCoord.y + [_dataSource totalScrollbackOverflow];
-                        match.endX = endCoord.x;
-                        match.absEndY = endCoord.y + [_dataSource totalScrollbackOverflow];
-                        match.rule = rule;
-                        match.components = [substring captureComponentsMatchedByRegex:regex
-                                                                              options:0
-                                                                                range:NSMakeRange(0, [substring length])
-                                                                                error:&regexError];
-                        [matches setObject:match forKey:result];
-
-                        if (debug) {
-                            NSLog(@"Regex matched. Add result %@ at %d,%lld -> %d,%lld with score %lf", result,
-                                  match.startX, match.absStartY, match.endX, match.absEndY,
-                                  match.score);
-                        }
-                    }
-                    i += temp.location + temp.length - 1;
-                } else {
-                    i += temp.location;
-                }
-            } else {
-                break;
-            }
-        }
-    }
+    }];
 
     if ([matches count]) {
         NSArray* sortedMatches = [[matches allValues] sortedArrayUsingSelector:@selector(compare:)];
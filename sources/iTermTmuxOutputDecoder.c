@@ -0,0 +1,77 @@
+//
+//  iTermTmuxOutputDecoder.c
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#include "iTermTmuxOutputDecoder.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// Is any byte of |word| a control character (including NUL) or a backslash? From "Bit Twiddling
+// Hacks": the first term finds bytes less than 0x20, the second finds bytes equal to '\\'.
+static inline int iTermTmuxWordHasSpecialByte(uint64_t word) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    const uint64_t backslashes = word ^ (ones * '\\');
+    return (((word - ones * 0x20) & ~word) | ((backslashes - ones) & ~backslashes)) & highs ? 1 : 0;
+}
+
+static inline int iTermTmuxByteIsSpecial(unsigned char c) {
+    return c < ' ' || c == '\\';
+}
+
+size_t iTermTmuxDecodeEscapedOutput(const unsigned char *src, size_t length, unsigned char *dest) {
+    size_t i = 0;
+    size_t o = 0;
+    while (i < length) {
+        // Copy ordinary bytes in bulk.
+        while (i + 8 <= length) {
+            uint64_t word;
+            memcpy(&word, src + i, sizeof(word));
+            if (iTermTmuxWordHasSpecialByte(word)) {
+                break;
+            }
+            memcpy(dest + o, &word, sizeof(word));
+            i += 8;
+            o += 8;
+        }
+        while (i < length && !iTermTmuxByteIsSpecial(src[i])) {
+            dest[o++] = src[i++];
+        }
+        if (i == length) {
+            break;
+        }
+
+        unsigned char c = src[i];
+        if (c == 0) {
+            break;
+        }
+        if (c < ' ') {
+            i++;
+            continue;
+        }
+
+        // Read exactly three bytes of octal values, or else use '?'.
+        c = 0;
+        for (int j = 0; j < 3; j++) {
+            i++;
+            const unsigned char digit = i < length ? src[i] : 0;
+            if (digit == '\r') {
+                // Ignore \r's that the line driver sprinkles in at its pleasure.
+                continue;
+            }
+            if (digit < '0' || digit > '7') {
+                c = '?';
+                i--;  // Reconsider this byte after the escape.
+                break;
+            }
+            c = c * 8 + (digit - '0');
+        }
+        dest[o++] = c;
+        i++;
+    }
+    return o;
+}
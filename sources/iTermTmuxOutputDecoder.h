@@ -0,0 +1,35 @@
+//
+//  iTermTmuxOutputDecoder.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Decodes the payload of a tmux control mode %output or %extended-output notification. tmux
+//  escapes backslashes and control characters as \ooo (three octal digits); everything else is
+//  passed through. Runs of ordinary bytes, which are nearly all of a busy pane's output, are found
+//  eight bytes at a time and copied in bulk.
+//
+//  Plain C with no Foundation dependency so it can be benchmarked anywhere (see
+//  tests/tmux_output_bench.c).
+//
+
+#ifndef iTermTmuxOutputDecoder_h
+#define iTermTmuxOutputDecoder_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decodes up to |length| bytes of |src| into |dest|, which must have room for |length| bytes (the
+// output is never longer than the input). Stops early at a NUL. Unescaped control characters,
+// such as the carriage returns a line driver may insert, are dropped, and a malformed escape
+// decodes to '?'. Returns the number of bytes written.
+size_t iTermTmuxDecodeEscapedOutput(const unsigned char *src, size_t length, unsigned char *dest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermTmuxOutputDecoder_h
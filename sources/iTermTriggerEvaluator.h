@@ -0,0 +1,54 @@
+//
+//  iTermTriggerEvaluator.h
+//  iTerm2SharedARC
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class iTermRegexPrefilter;
+@class iTermStringLine;
+@class iTermTriggerMatch;
+@class Trigger;
+
+// Cumulative cost of one trigger's regex.
+@interface iTermTriggerTiming : NSObject
+@property (nonatomic, readonly) NSInteger numberOfEvaluations;
+@property (nonatomic, readonly) NSTimeInterval totalTime;
+@property (nonatomic, readonly) NSTimeInterval maximumTime;
+@end
+
+// Runs the regexes of a fixed list of triggers against lines on a private serial queue, so a
+// slow regex doesn't stall the main thread. Only matching happens on the queue; the caller performs
+// the actions on the main queue. Keeps per-trigger timing so pathological regexes can be found.
+@interface iTermTriggerEvaluator : NSObject
+
+@property (nonatomic, readonly) NSArray<Trigger *> *triggers;
+@property (nonatomic, readonly) iTermRegexPrefilter *prefilter;
+
+- (instancetype)initWithTriggers:(NSArray<Trigger *> *)triggers NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+// Finds the matches of every trigger in |stringLine| on the evaluator's queue, then calls
+// |completion| on the main queue with one array per trigger (empty for triggers that didn't
+// match). Completions are called in the order requests were made. |stringLine| must not be
+// modified afterwards.
+- (void)findMatchesInStringLine:(iTermStringLine *)stringLine
+                    partialLine:(BOOL)partialLine
+                     completion:(void (^)(NSArray<NSArray<iTermTriggerMatch *> *> *matches))completion;
+
+// Records time spent evaluating the trigger at |index| by a caller on another queue.
+- (void)recordTime:(NSTimeInterval)elapsed forTriggerAtIndex:(NSUInteger)index;
+
+// Thread safe.
+- (iTermTriggerTiming *)timingForTriggerAtIndex:(NSUInteger)index;
+
+// One line per trigger, most expensive first.
+- (NSString *)timingReport;
+
+@end
+
+NS_ASSUME_NONNULL_END
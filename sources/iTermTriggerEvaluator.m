@@ -0,0 +1,134 @@
+//
+//  iTermTriggerEvaluator.m
+//  iTerm2SharedARC
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import "iTermTriggerEvaluator.h"
+
+#import "DebugLogging.h"
+#import "iTermMalloc.h"
+#import "iTermRegexPrefilter.h"
+#import "NSArray+iTerm.h"
+#import "ScreenChar.h"
+#import "Trigger.h"
+
+// A single evaluation slower than this is logged.
+static const NSTimeInterval iTermTriggerEvaluatorSlowRegexThreshold = 0.05;
+
+typedef struct {
+    NSInteger count;
+    NSTimeInterval total;
+    NSTimeInterval maximum;
+} iTermTriggerTimingData;
+
+@interface iTermTriggerTiming()
+- (instancetype)initWithData:(iTermTriggerTimingData)data;
+@end
+
+@implementation iTermTriggerTiming
+
+- (instancetype)initWithData:(iTermTriggerTimingData)data {
+    self = [super init];
+    if (self) {
+        _numberOfEvaluations = data.count;
+        _totalTime = data.total;
+        _maximumTime = data.maximum;
+    }
+    return self;
+}
+
+@end
+
+@implementation iTermTriggerEvaluator {
+    dispatch_queue_t _queue;
+    // Guarded by @synchronized(self). One entry per trigger.
+    iTermTriggerTimingData *_timings;
+}
+
+- (instancetype)initWithTriggers:(NSArray<Trigger *> *)triggers {
+    self = [super init];
+    if (self) {
+        _triggers = [triggers copy];
+        _prefilter = [[iTermRegexPrefilter alloc] initWithRegexes:[triggers mapWithBlock:^id(Trigger *trigger) {
+            return trigger.regex ?: @"";
+        }]];
+        _queue = dispatch_queue_create("com.iterm2.triggers", DISPATCH_QUEUE_SERIAL);
+        _timings = iTermCalloc(MAX(1, triggers.count), sizeof(iTermTriggerTimingData));
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_timings);
+}
+
+- (void)findMatchesInStringLine:(iTermStringLine *)stringLine
+                    partialLine:(BOOL)partialLine
+                     completion:(void (^)(NSArray<NSArray<iTermTriggerMatch *> *> *))completion {
+    dispatch_async(_queue, ^{
+        NSArray<NSArray<iTermTriggerMatch *> *> *matches = [self matchesInString:stringLine.stringValue
+                                                                     partialLine:partialLine];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(matches);
+        });
+    });
+}
+
+- (NSArray<NSArray<iTermTriggerMatch *> *> *)matchesInString:(NSString *)string partialLine:(BOOL)partialLine {
+    NSMutableArray<NSArray<iTermTriggerMatch *> *> *result = [NSMutableArray arrayWithCapacity:_triggers.count];
+    [_prefilter enumerateRegexesForString:string block:^(NSUInteger i, BOOL mayMatch, BOOL *stop) {
+        if (!mayMatch) {
+            [result addObject:@[]];
+            return;
+        }
+        Trigger *trigger = self->_triggers[i];
+        const NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+        [result addObject:[trigger matchesInString:string partialLine:partialLine]];
+        [self recordTime:[NSDate timeIntervalSinceReferenceDate] - start forTriggerAtIndex:i];
+    }];
+    return result;
+}
+
+- (void)recordTime:(NSTimeInterval)elapsed forTriggerAtIndex:(NSUInteger)index {
+    @synchronized(self) {
+        iTermTriggerTimingData *timing = &_timings[index];
+        timing->count += 1;
+        timing->total += elapsed;
+        timing->maximum = MAX(timing->maximum, elapsed);
+    }
+    if (elapsed > iTermTriggerEvaluatorSlowRegexThreshold) {
+        DLog(@"Slow trigger took %@ ms: %@", @(elapsed * 1000), _triggers[index]);
+    }
+}
+
+- (iTermTriggerTiming *)timingForTriggerAtIndex:(NSUInteger)index {
+    @synchronized(self) {
+        return [[iTermTriggerTiming alloc] initWithData:_timings[index]];
+    }
+}
+
+- (NSString *)timingReport {
+    NSMutableArray<NSNumber *> *indexes = [NSMutableArray array];
+    NSMutableArray<iTermTriggerTiming *> *timings = [NSMutableArray array];
+    for (NSUInteger i = 0; i < _triggers.count; i++) {
+        [indexes addObject:@(i)];
+        [timings addObject:[self timingForTriggerAtIndex:i]];
+    }
+    [indexes sortUsingComparator:^NSComparisonResult(NSNumber *lhs, NSNumber *rhs) {
+        return [@(timings[rhs.integerValue].totalTime) compare:@(timings[lhs.integerValue].totalTime)];
+    }];
+    NSMutableString *report = [NSMutableString string];
+    for (NSNumber *index in indexes) {
+        iTermTriggerTiming *timing = timings[index.integerValue];
+        [report appendFormat:@"%8.2f ms total  %6.3f ms max  %8ld runs  %@\n",
+         timing.totalTime * 1000,
+         timing.maximumTime * 1000,
+         (long)timing.numberOfEvaluations,
+         _triggers[index.integerValue].regex];
+    }
+    return report;
+}
+
+@end
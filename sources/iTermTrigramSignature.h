@@ -0,0 +1,65 @@
+//
+//  iTermTrigramSignature.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  A Bloom filter of the trigrams in a line block's text. Find consults it to
+//  skip blocks that can't contain the needle without expanding, converting, or
+//  scanning them.
+//
+//  Text is folded the way case-, diacritic-, and width-insensitive search
+//  compares it, and combining marks are ignored, so one signature serves every
+//  find mode: anything a stricter mode matches, the folded needle matches too.
+//  Characters that don't fold to ASCII (CJK, emoji, and so on) break the chain
+//  of trigrams, so only the ASCII runs of a needle constrain a search. A
+//  signature never forgets text that was removed from its block, so it can
+//  yield false positives but never false negatives.
+//
+
+#import <Foundation/Foundation.h>
+#import "iTermFindViewController.h"
+#import "ScreenChar.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// 8192 bits. A full block has a few thousand distinct trigrams at most, so a
+// needle with a few trigrams rarely passes a block that doesn't contain it.
+#define ITERM_TRIGRAM_SIGNATURE_WORDS 128
+
+typedef struct {
+    uint64_t bits[ITERM_TRIGRAM_SIGNATURE_WORDS];
+} iTermTrigramSignature;
+
+// The last two folded characters of the line being indexed, so a line that is
+// appended in pieces is indexed as if it were appended at once.
+typedef struct {
+    unsigned char previous[2];
+    int count;
+} iTermTrigramChain;
+
+NS_INLINE void iTermTrigramChainReset(iTermTrigramChain *chain) {
+    chain->count = 0;
+}
+
+// Adds the trigrams of |cells| as they would appear in a search haystack.
+// Characters are appended to |chain|; reset it at the start of each raw line.
+void iTermTrigramSignatureAddCells(iTermTrigramSignature *signature,
+                                   iTermTrigramChain *chain,
+                                   const screen_char_t *cells,
+                                   int count);
+
+// The trigrams that every match of a needle must contain.
+@interface iTermTrigramQuery : NSObject
+
+// Returns nil when nothing can be required of a match, as for short needles or
+// regexes without a literal prefix.
++ (nullable instancetype)queryWithNeedle:(NSString *)needle mode:(iTermFindMode)mode;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (BOOL)mayMatchSignature:(const iTermTrigramSignature *)signature;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,260 @@
+//
+//  iTermTrigramSignature.m
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#import "iTermTrigramSignature.h"
+
+#include <stdatomic.h>
+
+// How a UTF-16 code unit contributes to the folded text. Entries are computed on first use.
+// Bit 31 means the entry is valid, bits 0-1 hold the kind, bits 2-3 the number of characters
+// emitted, and bits 8-14, 15-21, and 22-28 the characters themselves.
+typedef NS_ENUM(uint32_t, iTermTrigramFoldKind) {
+    // Ends the chain of trigrams.
+    iTermTrigramFoldKindBreak = 0,
+    // Contributes nothing.
+    iTermTrigramFoldKindSkip = 1,
+    // Contributes one to three ASCII characters.
+    iTermTrigramFoldKindEmit = 2
+};
+
+static const uint32_t iTermTrigramFoldValid = 1u << 31;
+static _Atomic uint32_t gFoldTable[65536];
+
+static uint32_t iTermTrigramFoldMake(iTermTrigramFoldKind kind, const char *chars) {
+    uint32_t entry = iTermTrigramFoldValid | kind;
+    if (kind == iTermTrigramFoldKindEmit) {
+        const size_t length = strlen(chars);
+        entry |= (uint32_t)length << 2;
+        for (size_t i = 0; i < length; i++) {
+            entry |= (uint32_t)(chars[i] & 0x7f) << (8 + 7 * i);
+        }
+    }
+    return entry;
+}
+
+static uint32_t iTermTrigramComputeFold(unichar unit) {
+    // Full case foldings that expand to ASCII. ICU's case-insensitive regex matching performs
+    // these even where NSString's folding does not.
+    switch (unit) {
+        case 0x00DF:  // ß
+        case 0x1E9E:  // ẞ
+            return iTermTrigramFoldMake(iTermTrigramFoldKindEmit, "ss");
+        case 0xFB00:
+            return iTermTrigramFoldMake(iTermTrigramFoldKindEmit, "ff");
+        case 0xFB01:
+            return iTermTrigramFoldMake(iTermTrigramFoldKindEmit, "fi");
+        case 0xFB02:
+            return iTermTrigramFoldMake(iTermTrigramFoldKindEmit, "fl");
+        case 0xFB03:
+            return iTermTrigramFoldMake(iTermTrigramFoldKindEmit, "ffi");
+        case 0xFB04:
+            return iTermTrigramFoldMake(iTermTrigramFoldKindEmit, "ffl");
+        case 0xFB05:
+        case 0xFB06:
+            return iTermTrigramFoldMake(iTermTrigramFoldKindEmit, "st");
+    }
+    if (unit >= 0xD800 && unit <= 0xDFFF) {
+        return iTermTrigramFoldMake(iTermTrigramFoldKindBreak, NULL);
+    }
+    // Combining marks and format characters may be ignored when comparing, so they must not
+    // break the chain.
+    static NSCharacterSet *ignorableCharacters;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableCharacterSet *set = [[NSCharacterSet nonBaseCharacterSet] mutableCopy];
+        [set formUnionWithCharacterSet:[NSCharacterSet controlCharacterSet]];
+        ignorableCharacters = [set copy];
+        [set release];
+    });
+    if ([ignorableCharacters characterIsMember:unit]) {
+        return iTermTrigramFoldMake(iTermTrigramFoldKindSkip, NULL);
+    }
+    @autoreleasepool {
+        NSString *string = [NSString stringWithCharacters:&unit length:1];
+        NSString *folded = [string stringByFoldingWithOptions:(NSCaseInsensitiveSearch |
+                                                               NSDiacriticInsensitiveSearch |
+                                                               NSWidthInsensitiveSearch)
+                                                       locale:nil];
+        if (folded.length == 0) {
+            return iTermTrigramFoldMake(iTermTrigramFoldKindSkip, NULL);
+        }
+        if (folded.length > 3) {
+            return iTermTrigramFoldMake(iTermTrigramFoldKindBreak, NULL);
+        }
+        char chars[4] = { 0 };
+        for (NSUInteger i = 0; i < folded.length; i++) {
+            const unichar c = [folded characterAtIndex:i];
+            if (c == 0 || c >= 0x80) {
+                return iTermTrigramFoldMake(iTermTrigramFoldKindBreak, NULL);
+            }
+            chars[i] = tolower(c);
+        }
+        return iTermTrigramFoldMake(iTermTrigramFoldKindEmit, chars);
+    }
+}
+
+static uint32_t iTermTrigramFold(unichar unit) {
+    uint32_t entry = atomic_load_explicit(&gFoldTable[unit], memory_order_relaxed);
+    if (!(entry & iTermTrigramFoldValid)) {
+        // Racing threads compute the same value.
+        entry = iTermTrigramComputeFold(unit);
+        atomic_store_explicit(&gFoldTable[unit], entry, memory_order_relaxed);
+    }
+    return entry;
+}
+
+NS_INLINE uint32_t iTermTrigramBit(unsigned char a, unsigned char b, unsigned char c) {
+    const uint32_t trigram = ((uint32_t)a << 14) | ((uint32_t)b << 7) | c;
+    // Fibonacci hashing spreads similar trigrams across the 13-bit range.
+    return (trigram * 2654435761u) >> 19;
+}
+
+// Appends one folded ASCII character to the chain, calling |block| with each completed trigram.
+NS_INLINE void iTermTrigramChainAppend(iTermTrigramChain *chain,
+                                       unsigned char c,
+                                       void (^NS_NOESCAPE block)(uint32_t bit)) {
+    if (chain->count == 2) {
+        block(iTermTrigramBit(chain->previous[0], chain->previous[1], c));
+    }
+    if (chain->count == 0) {
+        chain->previous[1] = c;
+        chain->count = 1;
+    } else {
+        chain->previous[0] = chain->previous[1];
+        chain->previous[1] = c;
+        chain->count = 2;
+    }
+}
+
+static void iTermTrigramChainAppendUnit(iTermTrigramChain *chain,
+                                        unichar unit,
+                                        void (^NS_NOESCAPE block)(uint32_t bit)) {
+    if (unit < 0x80) {
+        iTermTrigramChainAppend(chain, tolower(unit), block);
+        return;
+    }
+    const uint32_t entry = iTermTrigramFold(unit);
+    switch ((iTermTrigramFoldKind)(entry & 3)) {
+        case iTermTrigramFoldKindBreak:
+            iTermTrigramChainReset(chain);
+            return;
+        case iTermTrigramFoldKindSkip:
+            return;
+        case iTermTrigramFoldKindEmit: {
+            const int count = (entry >> 2) & 3;
+            for (int i = 0; i < count; i++) {
+                iTermTrigramChainAppend(chain, (entry >> (8 + 7 * i)) & 0x7f, block);
+            }
+            return;
+        }
+    }
+}
+
+void iTermTrigramSignatureAddCells(iTermTrigramSignature *signature,
+                                   iTermTrigramChain *chain,
+                                   const screen_char_t *cells,
+                                   int count) {
+    void (^setBit)(uint32_t) = ^(uint32_t bit) {
+        signature->bits[bit / 64] |= 1ull << (bit % 64);
+    };
+    for (int i = 0; i < count; i++) {
+        const unichar code = cells[i].code;
+        // Mirror ScreenCharArrayToString, which builds search haystacks.
+        if (code >= ITERM2_PRIVATE_BEGIN && code <= ITERM2_PRIVATE_END) {
+            continue;
+        }
+        if (!cells[i].complexChar && code != UNICODE_REPLACEMENT_CHAR) {
+            iTermTrigramChainAppendUnit(chain, code, setBit);
+            continue;
+        }
+        unichar units[kMaxParts];
+        const int length = ExpandScreenChar((screen_char_t *)&cells[i], units);
+        for (int j = 0; j < length; j++) {
+            iTermTrigramChainAppendUnit(chain, units[j], setBit);
+        }
+    }
+}
+
+@implementation iTermTrigramQuery {
+    NSData *_bits;
+}
+
+// Returns the literal text at the start of |regex| that every match must contain, or nil.
++ (NSString *)requiredLiteralPrefixOfRegex:(NSString *)regex {
+    if ([regex rangeOfString:@"|"].location != NSNotFound) {
+        // An alternative might not contain the prefix.
+        return nil;
+    }
+    NSMutableString *literal = [NSMutableString string];
+    NSUInteger i = [regex hasPrefix:@"^"] ? 1 : 0;
+    for (; i < regex.length; i++) {
+        const unichar c = [regex characterAtIndex:i];
+        if (c < 0x80 && strchr("\\.^$|?*+()[]{}", c)) {
+            if ((c == '?' || c == '*' || c == '{') && literal.length > 0) {
+                // The last character is optional.
+                [literal deleteCharactersInRange:NSMakeRange(literal.length - 1, 1)];
+            }
+            break;
+        }
+        [literal appendFormat:@"%C", c];
+    }
+    return literal;
+}
+
++ (instancetype)queryWithNeedle:(NSString *)needle mode:(iTermFindMode)mode {
+    NSString *literal = needle;
+    if (mode == iTermFindModeCaseSensitiveRegex || mode == iTermFindModeCaseInsensitiveRegex) {
+        literal = [self requiredLiteralPrefixOfRegex:needle];
+    }
+    if (literal.length < 3) {
+        return nil;
+    }
+    NSMutableIndexSet *bits = [NSMutableIndexSet indexSet];
+    iTermTrigramChain chain;
+    iTermTrigramChainReset(&chain);
+    for (NSUInteger i = 0; i < literal.length; i++) {
+        iTermTrigramChainAppendUnit(&chain, [literal characterAtIndex:i], ^(uint32_t bit) {
+            [bits addIndex:bit];
+        });
+    }
+    if (bits.count == 0) {
+        return nil;
+    }
+    return [[[self alloc] initWithBits:bits] autorelease];
+}
+
+- (instancetype)initWithBits:(NSIndexSet *)bits {
+    self = [super init];
+    if (self) {
+        NSMutableData *data = [NSMutableData dataWithLength:sizeof(uint32_t) * bits.count];
+        uint32_t *values = data.mutableBytes;
+        __block NSUInteger i = 0;
+        [bits enumerateIndexesUsingBlock:^(NSUInteger bit, BOOL *stop) {
+            values[i++] = (uint32_t)bit;
+        }];
+        _bits = [data retain];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_bits release];
+    [super dealloc];
+}
+
+- (BOOL)mayMatchSignature:(const iTermTrigramSignature *)signature {
+    const uint32_t *values = _bits.bytes;
+    const NSUInteger count = _bits.length / sizeof(uint32_t);
+    for (NSUInteger i = 0; i < count; i++) {
+        if (!(signature->bits[values[i] / 64] & (1ull << (values[i] % 64)))) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+@end
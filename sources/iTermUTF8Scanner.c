@@ -0,0 +1,229 @@
+//
+//  iTermUTF8Scanner.c
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+
+#include "iTermUTF8Scanner.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ITERM_UTF8_SCANNER_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define ITERM_UTF8_SCANNER_NEON 1
+#include <arm_neon.h>
+#endif
+
+#pragma mark - Scalar
+
+size_t iTermUTF8ScanPrintableASCIIScalar(const unsigned char *bytes, size_t length) {
+    size_t i = 0;
+    while (i < length && bytes[i] >= 0x20 && bytes[i] <= 0x7f) {
+        i++;
+    }
+    return i;
+}
+
+// Returns the number of leading bytes with the high bit set.
+static size_t iTermUTF8HighRunLengthScalar(const unsigned char *bytes, size_t length) {
+    size_t i = 0;
+    while (i < length && bytes[i] >= 0x80) {
+        i++;
+    }
+    return i;
+}
+
+// Validates the sequences in a run of bytes that all have their high bit set. Because every byte
+// is >= 0x80, a byte is a continuation byte iff it is < 0xc0. The ranges come from table 3-7 of
+// the Unicode standard ("Well-Formed UTF-8 Byte Sequences"), which is exactly what
+// decode_utf8_char() accepts.
+static size_t iTermUTF8ValidateHighRun(const unsigned char *bytes, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        const unsigned char c = bytes[i];
+        size_t n;
+        unsigned char min1 = 0x80;
+        unsigned char max1 = 0xbf;
+        if (c >= 0xc2 && c <= 0xdf) {
+            n = 2;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            n = 3;
+            if (c == 0xe0) {
+                min1 = 0xa0;
+            } else if (c == 0xed) {
+                max1 = 0x9f;
+            }
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            n = 4;
+            if (c == 0xf0) {
+                min1 = 0x90;
+            } else if (c == 0xf4) {
+                max1 = 0x8f;
+            }
+        } else {
+            // Stray continuation byte, C0/C1, or F5 and up.
+            return i;
+        }
+        if (length - i < n) {
+            // Truncated, either by the end of the input or by an ASCII byte.
+            return i;
+        }
+        if (bytes[i + 1] < min1 || bytes[i + 1] > max1) {
+            return i;
+        }
+        for (size_t j = 2; j < n; j++) {
+            if (bytes[i + j] > 0xbf) {
+                return i;
+            }
+        }
+        i += n;
+    }
+    return i;
+}
+
+size_t iTermUTF8ScanMultibyteScalar(const unsigned char *bytes, size_t length) {
+    return iTermUTF8ValidateHighRun(bytes, iTermUTF8HighRunLengthScalar(bytes, length));
+}
+
+#pragma mark - x86
+
+#if ITERM_UTF8_SCANNER_X86
+
+static inline size_t iTermUTF8CountTrailingZeros(uint32_t x) {
+    return (size_t)__builtin_ctz(x);
+}
+
+// Signed comparison against 0x1f accepts exactly [0x20, 0x7f] because bytes >= 0x80 are negative.
+static size_t iTermUTF8ScanPrintableASCIISSE2(const unsigned char *bytes, size_t length) {
+    const __m128i threshold = _mm_set1_epi8(0x1f);
+    size_t i = 0;
+    while (i + 16 <= length) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(bytes + i));
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(v, threshold));
+        if (mask != 0xffff) {
+            return i + iTermUTF8CountTrailingZeros(~mask);
+        }
+        i += 16;
+    }
+    return i + iTermUTF8ScanPrintableASCIIScalar(bytes + i, length - i);
+}
+
+static size_t iTermUTF8HighRunLengthSSE2(const unsigned char *bytes, size_t length) {
+    size_t i = 0;
+    while (i + 16 <= length) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(bytes + i));
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(v);
+        if (mask != 0xffff) {
+            return i + iTermUTF8CountTrailingZeros(~mask);
+        }
+        i += 16;
+    }
+    return i + iTermUTF8HighRunLengthScalar(bytes + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static size_t iTermUTF8ScanPrintableASCIIAVX2(const unsigned char *bytes, size_t length) {
+    const __m256i threshold = _mm256_set1_epi8(0x1f);
+    size_t i = 0;
+    while (i + 32 <= length) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(bytes + i));
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, threshold));
+        if (mask != 0xffffffff) {
+            return i + iTermUTF8CountTrailingZeros(~mask);
+        }
+        i += 32;
+    }
+    return i + iTermUTF8ScanPrintableASCIISSE2(bytes + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static size_t iTermUTF8HighRunLengthAVX2(const unsigned char *bytes, size_t length) {
+    size_t i = 0;
+    while (i + 32 <= length) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(bytes + i));
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(v);
+        if (mask != 0xffffffff) {
+            return i + iTermUTF8CountTrailingZeros(~mask);
+        }
+        i += 32;
+    }
+    return i + iTermUTF8HighRunLengthSSE2(bytes + i, length - i);
+}
+
+static bool iTermUTF8ScannerHasAVX2(void) {
+    // 0 = unknown, 1 = no, 2 = yes. Racing initializers compute the same value.
+    static volatile int state;
+    if (state == 0) {
+        __builtin_cpu_init();
+        state = __builtin_cpu_supports("avx2") ? 2 : 1;
+    }
+    return state == 2;
+}
+
+#endif  // ITERM_UTF8_SCANNER_X86
+
+#pragma mark - NEON
+
+#if ITERM_UTF8_SCANNER_NEON
+
+// NEON has no movemask, so test a whole block with a horizontal min and let the scalar code find
+// the exact position within the first block that fails.
+static size_t iTermUTF8ScanPrintableASCIINEON(const unsigned char *bytes, size_t length) {
+    const int8x16_t threshold = vdupq_n_s8(0x1f);
+    size_t i = 0;
+    while (i + 16 <= length) {
+        const int8x16_t v = vreinterpretq_s8_u8(vld1q_u8(bytes + i));
+        if (vminvq_u8(vcgtq_s8(v, threshold)) != 0xff) {
+            break;
+        }
+        i += 16;
+    }
+    return i + iTermUTF8ScanPrintableASCIIScalar(bytes + i, length - i);
+}
+
+static size_t iTermUTF8HighRunLengthNEON(const unsigned char *bytes, size_t length) {
+    size_t i = 0;
+    while (i + 16 <= length) {
+        if (vminvq_u8(vld1q_u8(bytes + i)) < 0x80) {
+            break;
+        }
+        i += 16;
+    }
+    return i + iTermUTF8HighRunLengthScalar(bytes + i, length - i);
+}
+
+#endif  // ITERM_UTF8_SCANNER_NEON
+
+#pragma mark - API
+
+size_t iTermUTF8ScanPrintableASCII(const unsigned char *bytes, size_t length) {
+#if ITERM_UTF8_SCANNER_X86
+    if (length >= 32 && iTermUTF8ScannerHasAVX2()) {
+        return iTermUTF8ScanPrintableASCIIAVX2(bytes, length);
+    }
+    return iTermUTF8ScanPrintableASCIISSE2(bytes, length);
+#elif ITERM_UTF8_SCANNER_NEON
+    return iTermUTF8ScanPrintableASCIINEON(bytes, length);
+#else
+    return iTermUTF8ScanPrintableASCIIScalar(bytes, length);
+#endif
+}
+
+size_t iTermUTF8ScanMultibyte(const unsigned char *bytes, size_t length) {
+    // Finding the end of the non-ASCII run is the part that vectorizes well. Validation of the
+    // sequences within the run is a short table-driven loop that never revisits a byte.
+#if ITERM_UTF8_SCANNER_X86
+    const size_t run = (length >= 32 && iTermUTF8ScannerHasAVX2()) ?
+        iTermUTF8HighRunLengthAVX2(bytes, length) :
+        iTermUTF8HighRunLengthSSE2(bytes, length);
+#elif ITERM_UTF8_SCANNER_NEON
+    const size_t run = iTermUTF8HighRunLengthNEON(bytes, length);
+#else
+    const size_t run = iTermUTF8HighRunLengthScalar(bytes, length);
+#endif
+    return iTermUTF8ValidateHighRun(bytes, run);
+}
@@ -0,0 +1,44 @@
+//
+//  iTermUTF8Scanner.h
+//  iTerm2
+//
+//  Created by George Nachman on 10/17/26.
+//
+//  Bulk scanners used by VT100StringParser to find the extent of runs of
+//  printable ASCII and well-formed non-ASCII UTF-8 in one call instead of
+//  examining one byte per loop iteration. These are plain C with no
+//  Foundation dependency so they can be built and benchmarked anywhere (see
+//  tests/parser_throughput_bench.c).
+//
+
+#ifndef iTermUTF8Scanner_h
+#define iTermUTF8Scanner_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the number of leading bytes in [0x20, 0x7f]. Uses AVX2, SSE2, or
+// NEON when available to test 16-32 bytes at a time.
+size_t iTermUTF8ScanPrintableASCII(const unsigned char *bytes, size_t length);
+
+// Returns the number of leading bytes that form complete, well-formed UTF-8
+// sequences of two or more bytes (that is, no ASCII). The scan stops before
+// the first ASCII byte, the first ill-formed sequence, or a truncated
+// sequence at the end of the input. The definition of well-formed matches
+// decode_utf8_char(): overlong encodings, surrogates, and code points above
+// U+10FFFF are rejected.
+size_t iTermUTF8ScanMultibyte(const unsigned char *bytes, size_t length);
+
+// Portable reference implementations. The vectorized versions must always
+// return the same values as these.
+size_t iTermUTF8ScanPrintableASCIIScalar(const unsigned char *bytes, size_t length);
+size_t iTermUTF8ScanMultibyteScalar(const unsigned char *bytes, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // iTermUTF8Scanner_h
@@ -772,6 +772,27 @@ GPBEnumDescriptor *ITMFocusChangedNotification_Window_WindowStatus_EnumDescripto
  **/
 BOOL ITMFocusChangedNotification_Window_WindowStatus_IsValidValue(int32_t value);
 
+#pragma mark - Enum ITMGetBufferRequest_Encoding
+
+typedef GPB_ENUM(ITMGetBufferRequest_Encoding) {
+  /** Return lines in `GetBufferResponse.contents`. */
+  ITMGetBufferRequest_Encoding_LineContents = 0,
+
+  /**
+   * Return lines in `GetBufferResponse.packed_contents`, which is much faster to produce and
+   * parse for large ranges. See `GetBufferResponse.packed_contents` for the format.
+   **/
+  ITMGetBufferRequest_Encoding_Packed = 1,
+};
+
+GPBEnumDescriptor *ITMGetBufferRequest_Encoding_EnumDescriptor(void);
+
+/**
+ * Checks to see if the given value is defined by the enum or was not known at
+ * the time this source was generated.
+ **/
+BOOL ITMGetBufferRequest_Encoding_IsValidValue(int32_t value);
+
 #pragma mark - Enum ITMGetBufferResponse_Status
 
 typedef GPB_ENUM(ITMGetBufferResponse_Status) {
@@ -4186,6 +4207,9 @@ typedef GPB_ENUM(ITMLayoutChangedNotification_FieldNumber) {
 typedef GPB_ENUM(ITMGetBufferRequest_FieldNumber) {
   ITMGetBufferRequest_FieldNumber_Session = 1,
   ITMGetBufferRequest_FieldNumber_LineRange = 2,
+  ITMGetBufferRequest_FieldNumber_Encoding = 3,
+  ITMGetBufferRequest_FieldNumber_MaxPackedSize = 4,
+  ITMGetBufferRequest_FieldNumber_SinceGeneration = 5,
 };
 
 /**
@@ -4203,6 +4227,27 @@ typedef GPB_ENUM(ITMGetBufferRequest_FieldNumber) {
 /** Test to see if @c lineRange has been set. */
 @property(nonatomic, readwrite) BOOL hasLineRange;
 
+@property(nonatomic, readwrite) ITMGetBufferRequest_Encoding encoding;
+
+@property(nonatomic, readwrite) BOOL hasEncoding;
+/**
+ * For PACKED only. Stop adding lines once the packed contents exceed this many bytes and set
+ * `more_available` in the response. Fetch the rest with another request whose range begins at
+ * the end of the returned `windowed_coord_range`. At least one line is always returned. If 0
+ * or unset, 1 MB is used.
+ **/
+@property(nonatomic, readwrite) int32_t maxPackedSize;
+
+@property(nonatomic, readwrite) BOOL hasMaxPackedSize;
+/**
+ * If set to the `generation` of an earlier response, lines that were already returned then
+ * and could not have changed since are skipped. If the skip happened, `incremental` is set in
+ * the response and its range begins after the skipped lines. Lines that were on screen may
+ * have changed, so they are always returned again.
+ **/
+@property(nonatomic, readwrite) int64_t sinceGeneration;
+
+@property(nonatomic, readwrite) BOOL hasSinceGeneration;
 @end
 
 #pragma mark - ITMGetBufferResponse
@@ -4214,6 +4259,10 @@ typedef GPB_ENUM(ITMGetBufferResponse_FieldNumber) {
   ITMGetBufferResponse_FieldNumber_Cursor = 4,
   ITMGetBufferResponse_FieldNumber_NumLinesAboveScreen = 5,
   ITMGetBufferResponse_FieldNumber_WindowedCoordRange = 6,
+  ITMGetBufferResponse_FieldNumber_PackedContents = 7,
+  ITMGetBufferResponse_FieldNumber_MoreAvailable = 8,
+  ITMGetBufferResponse_FieldNumber_Generation = 9,
+  ITMGetBufferResponse_FieldNumber_Incremental = 10,
 };
 
 /**
@@ -4251,6 +4300,44 @@ typedef GPB_ENUM(ITMGetBufferResponse_FieldNumber) {
 /** Test to see if @c windowedCoordRange has been set. */
 @property(nonatomic, readwrite) BOOL hasWindowedCoordRange;
 
+/**
+ * Set when PACKED encoding was requested. Whole lines are returned; the column window of the
+ * requested range is ignored. All integers are little-endian.
+ *   Header: uint32 magic 'iTPB' (0x42505469), uint32 version (1), uint32 number of lines.
+ *   Each line:
+ *     uint8 continuation: 0 for a hard newline, 1 for a soft wrap, 2 for a soft wrap before a
+ *           double-width character.
+ *     uint32 number of cells.
+ *     uint32 length of text in bytes, followed by the text as UTF-8.
+ *     uint32 number of code-points-per-cell runs, followed by that many
+ *           (uint32 repeats, uint8 code points) pairs, as in LineContents.
+ *     uint32 number of style runs, followed by that many
+ *           (uint32 cells, uint32 foreground, uint32 background, uint16 flags) tuples.
+ *   Colors are (mode << 24) | (red << 16) | (green << 8) | blue. In mode 0 red holds 0 for the
+ *   default color, 1 for the selected-text color, or 3 for the reversed default color. In mode 1
+ *   red holds an index into the 256-color palette. Mode 2 is 24-bit color.
+ *   Flags are 1: bold, 2: faint, 4: italic, 8: blink, 16: underline, 32: strikethrough,
+ *   64: image, 128: curly underline.
+ **/
+@property(nonatomic, readwrite, copy, null_resettable) NSData *packedContents;
+/** Test to see if @c packedContents has been set. */
+@property(nonatomic, readwrite) BOOL hasPackedContents;
+
+/**
+ * For PACKED only. There were more lines in the requested range than fit in
+ * `max_packed_size`.
+ **/
+@property(nonatomic, readwrite) BOOL moreAvailable;
+
+@property(nonatomic, readwrite) BOOL hasMoreAvailable;
+/** Pass this as `since_generation` in a later request to fetch only what may have changed. */
+@property(nonatomic, readwrite) int64_t generation;
+
+@property(nonatomic, readwrite) BOOL hasGeneration;
+/** Lines were skipped because of `since_generation`. */
+@property(nonatomic, readwrite) BOOL incremental;
+
+@property(nonatomic, readwrite) BOOL hasIncremental;
 @end
 
 #pragma mark - ITMGetPromptRequest
@@ -9674,11 +9674,17 @@ typedef struct ITMLayoutChangedNotification__storage_ {
 
 @dynamic hasSession, session;
 @dynamic hasLineRange, lineRange;
+@dynamic hasEncoding, encoding;
+@dynamic hasMaxPackedSize, maxPackedSize;
+@dynamic hasSinceGeneration, sinceGeneration;
 
 typedef struct ITMGetBufferRequest__storage_ {
   uint32_t _has_storage_[1];
+  ITMGetBufferRequest_Encoding encoding;
+  int32_t maxPackedSize;
   NSString *session;
   ITMLineRange *lineRange;
+  int64_t sinceGeneration;
 } ITMGetBufferRequest__storage_;
 
 // This method is threadsafe because it is initially called
@@ -9705,6 +9711,33 @@ typedef struct ITMGetBufferRequest__storage_ {
         .flags = GPBFieldOptional,
         .dataType = GPBDataTypeMessage,
       },
+      {
+        .name = "encoding",
+        .dataTypeSpecific.enumDescFunc = ITMGetBufferRequest_Encoding_EnumDescriptor,
+        .number = ITMGetBufferRequest_FieldNumber_Encoding,
+        .hasIndex = 2,
+        .offset = (uint32_t)offsetof(ITMGetBufferRequest__storage_, encoding),
+        .flags = (GPBFieldFlags)(GPBFieldOptional | GPBFieldHasDefaultValue | GPBFieldHasEnumDescriptor),
+        .dataType = GPBDataTypeEnum,
+      },
+      {
+        .name = "maxPackedSize",
+        .dataTypeSpecific.className = NULL,
+        .number = ITMGetBufferRequest_FieldNumber_MaxPackedSize,
+        .hasIndex = 3,
+        .offset = (uint32_t)offsetof(ITMGetBufferRequest__storage_, maxPackedSize),
+        .flags = GPBFieldOptional,
+        .dataType = GPBDataTypeInt32,
+      },
+      {
+        .name = "sinceGeneration",
+        .dataTypeSpecific.className = NULL,
+        .number = ITMGetBufferRequest_FieldNumber_SinceGeneration,
+        .hasIndex = 4,
+        .offset = (uint32_t)offsetof(ITMGetBufferRequest__storage_, sinceGeneration),
+        .flags = GPBFieldOptional,
+        .dataType = GPBDataTypeInt64,
+      },
     };
     GPBDescriptor *localDescriptor =
         [GPBDescriptor allocDescriptorForClass:[ITMGetBufferRequest class]
@@ -9722,6 +9755,40 @@ typedef struct ITMGetBufferRequest__storage_ {
 
 @end
 
+#pragma mark - Enum ITMGetBufferRequest_Encoding
+
+GPBEnumDescriptor *ITMGetBufferRequest_Encoding_EnumDescriptor(void) {
+  static GPBEnumDescriptor *descriptor = NULL;
+  if (!descriptor) {
+    static const char *valueNames =
+        "LineContents\000Packed\000";
+    static const int32_t values[] = {
+        ITMGetBufferRequest_Encoding_LineContents,
+        ITMGetBufferRequest_Encoding_Packed,
+    };
+    GPBEnumDescriptor *worker =
+        [GPBEnumDescriptor allocDescriptorForName:GPBNSStringifySymbol(ITMGetBufferRequest_Encoding)
+                                       valueNames:valueNames
+                                           values:values
+                                            count:(uint32_t)(sizeof(values) / sizeof(int32_t))
+                                     enumVerifier:ITMGetBufferRequest_Encoding_IsValidValue];
+    if (!OSAtomicCompareAndSwapPtrBarrier(nil, worker, (void * volatile *)&descriptor)) {
+      [worker release];
+    }
+  }
+  return descriptor;
+}
+
+BOOL ITMGetBufferRequest_Encoding_IsValidValue(int32_t value__) {
+  switch (value__) {
+    case ITMGetBufferRequest_Encoding_LineContents:
+    case ITMGetBufferRequest_Encoding_Packed:
+      return YES;
+    default:
+      return NO;
+  }
+}
+
 #pragma mark - ITMGetBufferResponse
 
 @implementation ITMGetBufferResponse
@@ -9732,6 +9799,10 @@ typedef struct ITMGetBufferRequest__storage_ {
 @dynamic hasCursor, cursor;
 @dynamic hasNumLinesAboveScreen, numLinesAboveScreen;
 @dynamic hasWindowedCoordRange, windowedCoordRange;
+@dynamic hasPackedContents, packedContents;
+@dynamic hasMoreAvailable, moreAvailable;
+@dynamic hasGeneration, generation;
+@dynamic hasIncremental, incremental;
 
 typedef struct ITMGetBufferResponse__storage_ {
   uint32_t _has_storage_[1];
@@ -9740,7 +9811,9 @@ typedef struct ITMGetBufferResponse__storage_ {
   NSMutableArray *contentsArray;
   ITMCoord *cursor;
   ITMWindowedCoordRange *windowedCoordRange;
+  NSData *packedContents;
   int64_t numLinesAboveScreen;
+  int64_t generation;
 } ITMGetBufferResponse__storage_;
 
 // This method is threadsafe because it is initially called
@@ -9803,6 +9876,42 @@ typedef struct ITMGetBufferResponse__storage_ {
         .flags = GPBFieldOptional,
         .dataType = GPBDataTypeMessage,
       },
+      {
+        .name = "packedContents",
+        .dataTypeSpecific.className = NULL,
+        .number = ITMGetBufferResponse_FieldNumber_PackedContents,
+        .hasIndex = 5,
+        .offset = (uint32_t)offsetof(ITMGetBufferResponse__storage_, packedContents),
+        .flags = GPBFieldOptional,
+        .dataType = GPBDataTypeBytes,
+      },
+      {
+        .name = "moreAvailable",
+        .dataTypeSpecific.className = NULL,
+        .number = ITMGetBufferResponse_FieldNumber_MoreAvailable,
+        .hasIndex = 6,
+        .offset = 7,  // Stored in _has_storage_ to save space.
+        .flags = GPBFieldOptional,
+        .dataType = GPBDataTypeBool,
+      },
+      {
+        .name = "generation",
+        .dataTypeSpecific.className = NULL,
+        .number = ITMGetBufferResponse_FieldNumber_Generation,
+        .hasIndex = 8,
+        .offset = (uint32_t)offsetof(ITMGetBufferResponse__storage_, generation),
+        .flags = GPBFieldOptional,
+        .dataType = GPBDataTypeInt64,
+      },
+      {
+        .name = "incremental",
+        .dataTypeSpecific.className = NULL,
+        .number = ITMGetBufferResponse_FieldNumber_Incremental,
+        .hasIndex = 9,
+        .offset = 10,  // Stored in _has_storage_ to save space.
+        .flags = GPBFieldOptional,
+        .dataType = GPBDataTypeBool,
+      },
     };
     GPBDescriptor *localDescriptor =
         [GPBDescriptor allocDescriptorForClass:[ITMGetBufferResponse class]
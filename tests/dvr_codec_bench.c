@@ -0,0 +1,458 @@
+// Benchmark and round-trip check for iTermDVRCodec: bytes and encode time per frame for synthetic
+// 300x100 sessions, old DVREncoder format against new, with and without deflated key frames.
+//   cc -O2 -Isources -o /tmp/dvr_codec_bench tests/dvr_codec_bench.c sources/iTermDVRCodec.c -lz
+
+#include "iTermDVRCodec.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WIDTH 300
+#define HEIGHT 100
+#define NUMBER_OF_FRAMES 2000
+
+// Lines have an extra cell at the end for the continuation mark, like screen_char_t lines.
+#define LINE_CELLS (WIDTH + 1)
+#define FRAME_CELLS (LINE_CELLS * HEIGHT)
+
+// The same size as screen_char_t. The character code comes first.
+typedef struct {
+    uint16_t code;
+    uint8_t foreground[3];
+    uint8_t background[3];
+    uint8_t flags[2];
+    uint16_t urlCode;
+} Cell;
+
+typedef struct {
+    const char *name;
+    void (*step)(Cell screen[HEIGHT][LINE_CELLS], int frame, int dirty[HEIGHT]);
+} Session;
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static Cell MakeCell(uint16_t code, uint8_t foreground) {
+    Cell cell;
+    memset(&cell, 0, sizeof(cell));
+    cell.code = code;
+    cell.foreground[0] = foreground;
+    cell.background[0] = 1;
+    return cell;
+}
+
+static void WriteText(Cell *line, int x, const char *text, uint8_t foreground) {
+    for (; *text && x < WIDTH; text++, x++) {
+        line[x] = MakeCell((unsigned char)*text, foreground);
+    }
+}
+
+static void ClearLine(Cell *line) {
+    for (int x = 0; x < LINE_CELLS; x++) {
+        line[x] = MakeCell(0, 0);
+    }
+}
+
+// A build log scrolling by a few lines per frame. Every line is dirty.
+static void StepBuildLog(Cell screen[HEIGHT][LINE_CELLS], int frame, int dirty[HEIGHT]) {
+    const int scroll = 1 + random() % 4;
+    memmove(screen[0], screen[scroll], sizeof(Cell) * LINE_CELLS * (HEIGHT - scroll));
+    for (int y = HEIGHT - scroll; y < HEIGHT; y++) {
+        char text[128];
+        snprintf(text, sizeof(text), "[%5d] Compiling sources/module_%ld.m -o build/module_%ld.o",
+                 frame, random() % 500, random() % 500);
+        ClearLine(screen[y]);
+        WriteText(screen[y], 0, text, random() % 50 == 0 ? 9 : 7);
+    }
+    for (int y = 0; y < HEIGHT; y++) {
+        dirty[y] = 1;
+    }
+}
+
+// A process monitor redrawing numbers in place. About a tenth of the lines change per frame.
+static void StepTop(Cell screen[HEIGHT][LINE_CELLS], int frame, int dirty[HEIGHT]) {
+    if (frame == 0) {
+        for (int y = 0; y < HEIGHT; y++) {
+            ClearLine(screen[y]);
+            char text[128];
+            snprintf(text, sizeof(text), "%6d  user  20  0  %7ld  %6ld  S  0.0  0.1  0:00.%02d  process_%d",
+                     1000 + y, random() % 9999999, random() % 999999, y, y);
+            WriteText(screen[y], 0, text, y == 0 ? 15 : 7);
+        }
+    }
+    for (int y = 0; y < HEIGHT; y++) {
+        dirty[y] = 0;
+    }
+    for (int i = 0; i < HEIGHT / 10; i++) {
+        const int y = random() % HEIGHT;
+        char text[16];
+        snprintf(text, sizeof(text), "%4.1f", (random() % 1000) / 10.0);
+        WriteText(screen[y], 51, text, 7);
+        dirty[y] = 1;
+    }
+}
+
+// Typing in a full-screen editor: one character and the status line change per frame.
+static void StepEditor(Cell screen[HEIGHT][LINE_CELLS], int frame, int dirty[HEIGHT]) {
+    if (frame == 0) {
+        for (int y = 0; y < HEIGHT; y++) {
+            ClearLine(screen[y]);
+            WriteText(screen[y], 0, "~", 4);
+        }
+    }
+    for (int y = 0; y < HEIGHT; y++) {
+        dirty[y] = 0;
+    }
+    const int y = (frame / 80) % (HEIGHT - 1);
+    const int x = frame % 80;
+    screen[y][x] = MakeCell('a' + frame % 26, 7);
+    char status[64];
+    snprintf(status, sizeof(status), "-- INSERT --  %d,%d", y + 1, x + 1);
+    WriteText(screen[HEIGHT - 1], 0, status, 15);
+    dirty[y] = 1;
+    dirty[HEIGHT - 1] = 1;
+}
+
+static int CountClean(const int dirty[HEIGHT]) {
+    int clean = 0;
+    for (int y = 0; y < HEIGHT; y++) {
+        clean += !dirty[y];
+    }
+    return clean;
+}
+
+// Encodes a recording the new way, timing only the encoding, and checks that every frame decodes
+// to what was recorded. Key frames are also deflated if |deflate| is set.
+static int EncodeNew(const Session *session,
+                     const Cell *recording,
+                     const int *recordedDirty,
+                     int deflate,
+                     double *seconds,
+                     size_t *bytes) {
+    const size_t frameBytes = sizeof(Cell) * FRAME_CELLS;
+    Cell *lines = malloc(frameBytes);
+    char *scratch = malloc(frameBytes);
+    char *deflated = malloc(frameBytes);
+    iTermDVRRowCache *cache = iTermDVRRowCacheCreate();
+    const void *rows[HEIGHT];
+    size_t *offsets = malloc(sizeof(size_t) * (NUMBER_OF_FRAMES + 1));
+    // 0 for a diff frame, 1 for a key frame, 2 for a deflated key frame.
+    int *types = malloc(sizeof(int) * NUMBER_OF_FRAMES);
+    // Room for every encoded frame, as though the DVR buffer were large enough to keep them all.
+    const size_t encodedCapacity = frameBytes * 64;
+    char *encoded = malloc(encodedCapacity);
+    size_t used = 0;
+    *seconds = 0;
+    for (int f = 0; f < NUMBER_OF_FRAMES; f++) {
+        memcpy(lines, recording + (size_t)f * FRAME_CELLS, frameBytes);
+        const int *frameDirty = recordedDirty + f * HEIGHT;
+        const double start = Now();
+        size_t n = 0;
+        types[f] = (f % 100 == 0 || CountClean(frameDirty) <= HEIGHT * 0.8);
+        if (!types[f]) {
+            for (int y = 0; y < HEIGHT; y++) {
+                rows[y] = frameDirty[y] ? lines + y * LINE_CELLS : NULL;
+            }
+            n = iTermDVREncodeDiffFrame(cache, rows, HEIGHT, LINE_CELLS, sizeof(Cell), scratch, frameBytes);
+            types[f] = (n == 0);
+        }
+        const char *frame = scratch;
+        if (types[f]) {
+            // Like DVREncoder, leave out clean rows unless the previous frame was a different size.
+            for (int y = 0; y < HEIGHT; y++) {
+                rows[y] = (f > 0 && !frameDirty[y]) ? NULL : lines + y * LINE_CELLS;
+            }
+            n = iTermDVREncodeKeyFrameRows(cache, rows, HEIGHT, LINE_CELLS, sizeof(Cell), scratch, frameBytes);
+            const size_t deflatedLength = (deflate && n) ? iTermDVRDeflateKeyFrame(scratch, n, deflated, frameBytes) : 0;
+            if (deflatedLength) {
+                types[f] = 2;
+                frame = deflated;
+                n = deflatedLength;
+            }
+        }
+        if (n == 0 || used + n > encodedCapacity) {
+            fprintf(stderr, "%s: frame %d didn't fit\n", session->name, f);
+            return 0;
+        }
+        offsets[f] = used;
+        memcpy(encoded + used, frame, n);
+        used += n;
+        *seconds += Now() - start;
+    }
+    offsets[NUMBER_OF_FRAMES] = used;
+    *bytes = used;
+
+    for (int f = 0; f < NUMBER_OF_FRAMES; f++) {
+        const size_t length = offsets[f + 1] - offsets[f];
+        const char *frame = encoded + offsets[f];
+        int ok;
+        switch (types[f]) {
+            case 0:
+                ok = iTermDVRApplyDiffFrame(frame, length, sizeof(Cell), lines, FRAME_CELLS);
+                break;
+            case 1:
+                ok = iTermDVRDecodeKeyFrame(frame, length, sizeof(Cell), lines, FRAME_CELLS);
+                break;
+            default:
+                ok = iTermDVRDecodeDeflatedKeyFrame(frame, length, sizeof(Cell), lines, FRAME_CELLS);
+                break;
+        }
+        if (!ok || memcmp(lines, recording + (size_t)f * FRAME_CELLS, frameBytes)) {
+            fprintf(stderr, "%s: frame %d doesn't round trip\n", session->name, f);
+            return 0;
+        }
+    }
+
+    free(encoded);
+    free(types);
+    free(offsets);
+    iTermDVRRowCacheFree(cache);
+    free(deflated);
+    free(scratch);
+    free(lines);
+    return 1;
+}
+
+static int Benchmark(const Session *session) {
+    static Cell screen[HEIGHT][LINE_CELLS];
+    int dirty[HEIGHT];
+    const size_t frameBytes = sizeof(Cell) * FRAME_CELLS;
+    const size_t lineBytes = sizeof(Cell) * LINE_CELLS;
+
+    // Record the session first so every encoder sees the same frames.
+    Cell *recording = malloc(frameBytes * NUMBER_OF_FRAMES);
+    int *recordedDirty = malloc(sizeof(int) * HEIGHT * NUMBER_OF_FRAMES);
+    srandom(1);
+    for (int f = 0; f < NUMBER_OF_FRAMES; f++) {
+        session->step(screen, f, dirty);
+        memcpy(recording + (size_t)f * FRAME_CELLS, screen, frameBytes);
+        memcpy(recordedDirty + f * HEIGHT, dirty, sizeof(dirty));
+    }
+
+    // The old way: key frames are the lines combined into a new buffer and copied into the DVR
+    // buffer, and diff frames are a sequence of unchanged lines and copies of changed lines.
+    // VT100Screen copies the grid's lines right before each frame is encoded, so they're in the
+    // cache. Each recorded frame is copied to |lines| first and only the encoding is timed.
+    char *scratch = malloc(frameBytes);
+    Cell *lines = malloc(frameBytes);
+    long long oldBytes = 0;
+    double oldSeconds = 0;
+    for (int f = 0; f < NUMBER_OF_FRAMES; f++) {
+        memcpy(lines, recording + (size_t)f * FRAME_CELLS, frameBytes);
+        const int *frameDirty = recordedDirty + f * HEIGHT;
+        const double start = Now();
+        if (f % 100 == 0 || CountClean(frameDirty) <= HEIGHT * 0.8) {
+            char *combined = malloc(frameBytes);
+            for (int y = 0; y < HEIGHT; y++) {
+                memcpy(combined + y * lineBytes, lines + y * LINE_CELLS, lineBytes);
+            }
+            memcpy(scratch, combined, frameBytes);
+            free(combined);
+            oldBytes += frameBytes;
+        } else {
+            int o = 0;
+            const int n = (int)lineBytes;
+            for (int y = 0; y < HEIGHT; y++) {
+                scratch[o++] = frameDirty[y];
+                memcpy(scratch + o, &n, sizeof(n));
+                o += sizeof(n);
+                if (frameDirty[y]) {
+                    memcpy(scratch + o, lines + y * LINE_CELLS, lineBytes);
+                    o += n;
+                }
+            }
+            oldBytes += o;
+        }
+        oldSeconds += Now() - start;
+    }
+
+    double newSeconds, zlibSeconds;
+    size_t newBytes, zlibBytes;
+    const int ok = (EncodeNew(session, recording, recordedDirty, 0, &newSeconds, &newBytes) &&
+                    EncodeNew(session, recording, recordedDirty, 1, &zlibSeconds, &zlibBytes));
+    if (ok) {
+        printf("%-10s %10.0f %10.0f %10.0f %9.1f %9.1f %9.1f\n",
+               session->name,
+               (double)oldBytes / NUMBER_OF_FRAMES,
+               (double)newBytes / NUMBER_OF_FRAMES,
+               (double)zlibBytes / NUMBER_OF_FRAMES,
+               oldSeconds / NUMBER_OF_FRAMES * 1e6,
+               newSeconds / NUMBER_OF_FRAMES * 1e6,
+               zlibSeconds / NUMBER_OF_FRAMES * 1e6);
+    }
+
+    free(lines);
+    free(scratch);
+    free(recordedDirty);
+    free(recording);
+    return ok;
+}
+
+// Scrolls, edits, and diffs a ten-row screen so key frames copy some rows from the row cache and
+// encode others, and checks that each one decodes to the screen.
+static int VerifyRowCache(void) {
+    enum { rowCount = 10, cellsPerRow = 20, count = rowCount * cellsPerRow };
+    Cell screen[count];
+    Cell previous[count];
+    Cell decoded[count];
+    unsigned char buffer[count * sizeof(Cell) * 2];
+    const void *rows[rowCount];
+    iTermDVRRowCache *cache = iTermDVRRowCacheCreate();
+    srandom(3);
+    for (int i = 0; i < count; i++) {
+        screen[i] = MakeCell('a' + random() % 3, random() % 2);
+    }
+    for (int y = 0; y < rowCount; y++) {
+        rows[y] = screen + y * cellsPerRow;
+    }
+    int ok = iTermDVREncodeKeyFrameRows(cache, rows, rowCount, cellsPerRow, sizeof(Cell), buffer, sizeof(buffer)) > 0;
+    memcpy(previous, screen, sizeof(screen));
+    for (int trial = 0; trial < 2000 && ok; trial++) {
+        const int scroll = random() % 4;
+        memmove(screen, screen + scroll * cellsPerRow, sizeof(Cell) * (count - scroll * cellsPerRow));
+        for (int i = count - scroll * cellsPerRow; i < count; i++) {
+            screen[i] = MakeCell(random() % 4 ? 0 : 'a' + random() % 3, random() % 2);
+        }
+        for (int i = 0; i < count; i++) {
+            if (random() % 100 == 0) {
+                screen[i] = MakeCell('x', random() % 3);
+            }
+        }
+        for (int y = 0; y < rowCount; y++) {
+            rows[y] = screen + y * cellsPerRow;
+            if (!scroll && !memcmp(rows[y], previous + y * cellsPerRow, sizeof(Cell) * cellsPerRow) && random() % 2) {
+                rows[y] = NULL;
+            }
+        }
+        if (random() % 3 == 0) {
+            // A diff changes the previous frame behind the cache's back unless it's told.
+            const size_t n = iTermDVREncodeDiffFrame(cache, rows, rowCount, cellsPerRow, sizeof(Cell), buffer, sizeof(buffer));
+            iTermDVRRowCacheCopyFrame(cache, previous);
+            ok = n > 0 && !memcmp(previous, screen, sizeof(screen));
+            continue;
+        }
+        const size_t capacity = random() % 20 ? sizeof(buffer) : 40;
+        const size_t n = iTermDVREncodeKeyFrameRows(cache, rows, rowCount, cellsPerRow, sizeof(Cell), buffer, capacity);
+        iTermDVRRowCacheCopyFrame(cache, previous);
+        ok = !memcmp(previous, screen, sizeof(screen));
+        if (ok && n > 0) {
+            ok = (iTermDVRDecodeKeyFrame(buffer, n, sizeof(Cell), decoded, count) &&
+                  !memcmp(decoded, screen, sizeof(screen)));
+        }
+        if (!ok) {
+            fprintf(stderr, "Key frame from the row cache doesn't round trip on trial %d\n", trial);
+        }
+    }
+    iTermDVRRowCacheFree(cache);
+    return ok;
+}
+
+// Round trips a deflated key frame and checks that damaged or truncated ones are rejected.
+static int VerifyDeflate(void) {
+    enum { count = 2000 };
+    static Cell frame[count];
+    static Cell decoded[count];
+    static unsigned char encoded[count * sizeof(Cell) * 2];
+    static unsigned char deflated[count * sizeof(Cell) * 2];
+    for (int i = 0; i < count; i++) {
+        frame[i] = MakeCell("make: Entering directory "[i % 25], i % 50 < 25 ? 7 : 9);
+    }
+    const size_t n = iTermDVREncodeKeyFrame(frame, count, sizeof(Cell), encoded, sizeof(encoded));
+    const size_t d = iTermDVRDeflateKeyFrame(encoded, n, deflated, sizeof(deflated));
+    const int ok = (n > 0 &&
+                    d > 0 &&
+                    d < n &&
+                    iTermDVRKeyFrameCellCount(deflated, d) == count &&
+                    iTermDVRDecodeDeflatedKeyFrame(deflated, d, sizeof(Cell), decoded, count) &&
+                    !memcmp(decoded, frame, sizeof(frame)) &&
+                    !iTermDVRDecodeDeflatedKeyFrame(deflated, d - 1, sizeof(Cell), decoded, count) &&
+                    !iTermDVRDecodeDeflatedKeyFrame(deflated, d, sizeof(Cell), decoded, count - 1) &&
+                    iTermDVRDeflateKeyFrame(encoded, n, deflated, 8) == 0);
+    if (!ok) {
+        fprintf(stderr, "Deflated key frame doesn't round trip\n");
+    }
+    return ok;
+}
+
+// Round trips random frames made of a few distinct cells, so runs of every length occur, and
+// checks that truncated input is rejected.
+static int Verify(void) {
+    enum { count = 200 };
+    Cell before[count];
+    Cell after[count];
+    Cell decoded[count];
+    unsigned char buffer[count * sizeof(Cell) * 2];
+    srandom(2);
+    for (int trial = 0; trial < 2000; trial++) {
+        for (int i = 0; i < count; i++) {
+            before[i] = MakeCell(random() % 3 ? 'a' + random() % 2 : 0x4e00 + random() % 2, random() % 2);
+            after[i] = before[i];
+            if (random() % 40 == 0) {
+                after[i] = MakeCell(random() % 200, random() % 3);
+            }
+        }
+        size_t n = iTermDVREncodeKeyFrame(before, count, sizeof(Cell), buffer, sizeof(buffer));
+        if (!n ||
+            iTermDVRKeyFrameCellCount(buffer, n) != count ||
+            !iTermDVRDecodeKeyFrame(buffer, n, sizeof(Cell), decoded, count) ||
+            memcmp(decoded, before, sizeof(before)) ||
+            iTermDVRDecodeKeyFrame(buffer, n - 1, sizeof(Cell), decoded, count)) {
+            fprintf(stderr, "Key frame doesn't round trip on trial %d\n", trial);
+            return 0;
+        }
+        // Ten rows of twenty cells. Unchanged rows are sometimes passed as NULL.
+        iTermDVRRowCache *cache = iTermDVRRowCacheCreate();
+        Cell previous[count];
+        const void *rows[10];
+        for (int y = 0; y < 10; y++) {
+            rows[y] = before + y * 20;
+        }
+        iTermDVREncodeKeyFrameRows(cache, rows, 10, 20, sizeof(Cell), buffer, sizeof(buffer));
+        for (int y = 0; y < 10; y++) {
+            rows[y] = after + y * 20;
+            if (!memcmp(before + y * 20, after + y * 20, sizeof(Cell) * 20) && random() % 2) {
+                rows[y] = NULL;
+            }
+        }
+        n = iTermDVREncodeDiffFrame(cache, rows, 10, 20, sizeof(Cell), buffer, sizeof(buffer));
+        iTermDVRRowCacheCopyFrame(cache, previous);
+        iTermDVRRowCacheFree(cache);
+        if (!n ||
+            memcmp(previous, after, sizeof(after)) ||
+            !iTermDVRApplyDiffFrame(buffer, n, sizeof(Cell), decoded, count) ||
+            memcmp(decoded, after, sizeof(after))) {
+            fprintf(stderr, "Diff frame doesn't round trip on trial %d\n", trial);
+            return 0;
+        }
+        if (iTermDVREncodeKeyFrame(before, count, sizeof(Cell), buffer, 10) != 0) {
+            fprintf(stderr, "Encoding overflowed its capacity on trial %d\n", trial);
+            return 0;
+        }
+    }
+    return VerifyRowCache() && VerifyDeflate();
+}
+
+int main(int argc, char *argv[]) {
+    if (!Verify()) {
+        return 1;
+    }
+    static const Session sessions[] = {
+        { "build log", StepBuildLog },
+        { "top", StepTop },
+        { "editor", StepEditor },
+    };
+    printf("%-10s %10s %10s %10s %9s %9s %9s\n",
+           "", "old B/fr", "new B/fr", "zlib B/fr", "old us", "new us", "zlib us");
+    for (int i = 0; i < 3; i++) {
+        if (!Benchmark(&sessions[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
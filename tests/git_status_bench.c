@@ -0,0 +1,241 @@
+// Compares running iterm2_git_poll.sh's git commands with iTermGitRepository on a directory in a git
+// repository, and checks that both report the same status.
+//   cc -O2 -Isources -o /tmp/git_status_bench tests/git_status_bench.c sources/iTermGitRepository.c -lz -lpthread
+
+#include "iTermGitRepository.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ITERATIONS 5
+#define MAX_THREADS 8
+
+typedef struct {
+    char branch[256];
+    int ahead;
+    int behind;
+    int hasUpstream;
+    int dirty;
+    int untracked;
+    int deleted;
+} Status;
+
+static const char *gPath;
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#pragma mark - Old
+
+// Runs a git command in gPath and returns its first line of output, or counts its lines.
+static int RunGit(const char *arguments, char *firstLine, size_t size) {
+    char command[4096];
+    snprintf(command, sizeof(command), "git -C '%s' %s 2>/dev/null", gPath, arguments);
+    FILE *pipe = popen(command, "r");
+    if (!pipe) {
+        return -1;
+    }
+    char line[4096];
+    int count = 0;
+    if (firstLine) {
+        firstLine[0] = '\0';
+    }
+    while (fgets(line, sizeof(line), pipe)) {
+        if (count == 0 && firstLine) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(firstLine, size, "%s", line);
+        }
+        count++;
+    }
+    pclose(pipe);
+    return count;
+}
+
+static void OldStatus(Status *status) {
+    memset(status, 0, sizeof(*status));
+    char line[4096];
+    status->dirty = RunGit("status --porcelain --ignore-submodules -unormal", NULL, 0) > 0;
+    if (RunGit("rev-list --left-right --count HEAD...@{u}", line, sizeof(line)) > 0) {
+        status->hasUpstream = 1;
+        sscanf(line, "%d %d", &status->ahead, &status->behind);
+    }
+    if (RunGit("symbolic-ref -q --short HEAD", status->branch, sizeof(status->branch)) <= 0) {
+        RunGit("rev-parse --short HEAD", status->branch, sizeof(status->branch));
+    }
+    status->untracked = RunGit("ls-files --others --exclude-standard", NULL, 0);
+    status->deleted = RunGit("ls-files --deleted", NULL, 0);
+}
+
+#pragma mark - New
+
+typedef struct {
+    size_t next;
+    size_t iterations;
+    void *context;
+    void (*work)(void *, size_t);
+    pthread_mutex_t lock;
+} ParallelFor;
+
+static void *ParallelForWorker(void *arg) {
+    ParallelFor *parallelFor = arg;
+    while (1) {
+        pthread_mutex_lock(&parallelFor->lock);
+        const size_t i = parallelFor->next++;
+        pthread_mutex_unlock(&parallelFor->lock);
+        if (i >= parallelFor->iterations) {
+            return NULL;
+        }
+        parallelFor->work(parallelFor->context, i);
+    }
+}
+
+// Stands in for dispatch_apply_f().
+static void PthreadParallelFor(size_t iterations, void *context, void (*work)(void *, size_t)) {
+    ParallelFor parallelFor = {
+        .next = 0,
+        .iterations = iterations,
+        .context = context,
+        .work = work,
+        .lock = PTHREAD_MUTEX_INITIALIZER
+    };
+    pthread_t threads[MAX_THREADS];
+    for (int i = 0; i < MAX_THREADS; i++) {
+        pthread_create(&threads[i], NULL, ParallelForWorker, &parallelFor);
+    }
+    for (int i = 0; i < MAX_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+static int CountInDirectory(char **paths, int count, const char *prefix) {
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+        if (!strncmp(paths[i], prefix, strlen(prefix))) {
+            result++;
+        }
+    }
+    return result;
+}
+
+// Returns 0 if the answer is unknown and git would have to be run.
+static int NewStatus(Status *status, int parallel) {
+    memset(status, 0, sizeof(*status));
+    iTermGitRepository *repository = iTermGitRepositoryOpen(gPath);
+    if (!repository) {
+        return 0;
+    }
+    iTermGitHead head;
+    int ok = iTermGitRepositoryReadHead(repository, &head);
+    if (ok) {
+        snprintf(status->branch, sizeof(status->branch), "%s", head.branch);
+        status->hasUpstream = iTermGitRepositoryCountAheadBehind(repository,
+                                                                 &head,
+                                                                 100000,
+                                                                 &status->ahead,
+                                                                 &status->behind);
+        iTermGitWorkTreeStatus workTree;
+        iTermGitRepositoryGetWorkTreeStatus(repository,
+                                            &head,
+                                            parallel ? PthreadParallelFor : NULL,
+                                            &workTree);
+        ok = workTree.stagedKnown && workTree.workTreeKnown && workTree.untrackedKnown;
+        status->dirty = workTree.staged || workTree.modified > 0 || workTree.deleted > 0 || workTree.untracked > 0;
+        const char *prefix = iTermGitRepositoryPrefix(repository);
+        status->untracked = CountInDirectory(workTree.untrackedPaths, workTree.untracked, prefix);
+        status->deleted = CountInDirectory(workTree.deletedPaths, workTree.deleted, prefix);
+        if (status->untracked != workTree.untrackedInDirectory || status->deleted != workTree.deletedInDirectory) {
+            printf("Path lists disagree with the counts for the directory\n");
+            ok = 0;
+        }
+        iTermGitWorkTreeStatusFree(&workTree);
+    }
+    iTermGitRepositoryFree(repository);
+    return ok;
+}
+
+static int Verify(void) {
+    Status old;
+    Status new;
+    OldStatus(&old);
+    if (!NewStatus(&new, 1)) {
+        printf("Native status is unknown for %s\n", gPath);
+        return 0;
+    }
+    printf("branch %s, ahead %d, behind %d, upstream %s, dirty %d, untracked %d, deleted %d\n",
+           old.branch, old.ahead, old.behind, old.hasUpstream ? "yes" : "no", old.dirty, old.untracked, old.deleted);
+    if (strcmp(old.branch, new.branch) ||
+        old.hasUpstream != new.hasUpstream ||
+        old.ahead != new.ahead ||
+        old.behind != new.behind ||
+        old.dirty != new.dirty ||
+        old.untracked != new.untracked ||
+        old.deleted != new.deleted) {
+        printf("Mismatch: new says branch %s, ahead %d, behind %d, upstream %s, dirty %d, untracked %d, deleted %d\n",
+               new.branch, new.ahead, new.behind, new.hasUpstream ? "yes" : "no", new.dirty, new.untracked, new.deleted);
+        return 0;
+    }
+    return 1;
+}
+
+// git 2.29 and later can make a repository with SHA-256 objects, which needs the objectformat
+// extension. Skipped if git can't.
+static int VerifyExtensionIsUnknown(void) {
+    char directory[] = "/tmp/git_status_bench.XXXXXX";
+    if (!mkdtemp(directory)) {
+        return 0;
+    }
+    char command[4096];
+    snprintf(command, sizeof(command), "git init -q --object-format=sha256 '%s' 2>/dev/null", directory);
+    int ok = 1;
+    if (system(command) == 0) {
+        iTermGitRepository *repository = iTermGitRepositoryOpen(directory);
+        iTermGitHead head;
+        if (!repository || iTermGitRepositoryReadHead(repository, &head)) {
+            printf("A repository with an extension wasn't reported as unknown\n");
+            ok = 0;
+        }
+        iTermGitRepositoryFree(repository);
+    }
+    snprintf(command, sizeof(command), "rm -rf '%s'", directory);
+    system(command);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    gPath = argc > 1 ? argv[1] : ".";
+    if (!Verify() || !VerifyExtensionIsUnknown()) {
+        return 1;
+    }
+
+    Status status;
+    double start = Now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        OldStatus(&status);
+    }
+    const double oldTime = (Now() - start) / ITERATIONS;
+
+    start = Now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        NewStatus(&status, 0);
+    }
+    const double serialTime = (Now() - start) / ITERATIONS;
+
+    start = Now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        NewStatus(&status, 1);
+    }
+    const double parallelTime = (Now() - start) / ITERATIONS;
+
+    printf("method              ms/poll   speedup\n");
+    printf("git processes  %12.1f %8.1fx\n", oldTime * 1000, 1.0);
+    printf("native serial  %12.1f %8.1fx\n", serialTime * 1000, oldTime / serialTime);
+    printf("native parallel%12.1f %8.1fx\n", parallelTime * 1000, oldTime / parallelTime);
+    return 0;
+}
@@ -0,0 +1,332 @@
+// Compares iTermInternedStringTable with a mutex-guarded table that boxes every key, like the
+// NSMutableDictionaries it replaced, on every emoji sequence in tests/emoji-test.txt.
+//   cc -O2 -Isources -o /tmp/interned_string_table_bench tests/interned_string_table_bench.c sources/iTermInternedStringTable.c -lpthread && /tmp/interned_string_table_bench
+
+#include "iTermInternedStringTable.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_SEQUENCES 8192
+#define MAX_LENGTH 16
+#define ITERATIONS 50
+#define MAX_THREADS 8
+
+typedef struct {
+    uint32_t codePoints[MAX_LENGTH];
+    uint32_t length;
+} Sequence;
+
+static Sequence gSequences[MAX_SEQUENCES];
+static int gNumberOfSequences;
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Reads lines like "1F468 200D 1F469 ; fully-qualified # ..." and keeps the sequences of more
+// than one code point or outside the BMP, which are the ones that become complex characters.
+static void LoadSequences(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), file) && gNumberOfSequences < MAX_SEQUENCES) {
+        if (line[0] == '#' || !strchr(line, ';')) {
+            continue;
+        }
+        Sequence *sequence = &gSequences[gNumberOfSequences];
+        sequence->length = 0;
+        char *p = line;
+        while (*p != ';' && sequence->length < MAX_LENGTH) {
+            char *end;
+            const unsigned long value = strtoul(p, &end, 16);
+            if (end == p) {
+                p++;
+                continue;
+            }
+            sequence->codePoints[sequence->length++] = (uint32_t)value;
+            p = end;
+        }
+        if (sequence->length > 1 || (sequence->length == 1 && sequence->codePoints[0] > 0xffff)) {
+            gNumberOfSequences++;
+        }
+    }
+    fclose(file);
+}
+
+#pragma mark - Old
+
+typedef struct OldEntry {
+    struct OldEntry *next;
+    uint32_t code;
+    Sequence sequence;
+} OldEntry;
+
+#define OLD_BUCKETS 4096
+
+typedef struct {
+    pthread_mutex_t lock;
+    OldEntry *byString[OLD_BUCKETS];
+    OldEntry *codeToEntry[0x10000];
+    uint32_t nextCode;
+} OldTable;
+
+static OldTable gOldTable = { .lock = PTHREAD_MUTEX_INITIALIZER, .nextCode = 1 };
+
+static uint32_t OldHash(const Sequence *sequence) {
+    uint32_t hash = 0;
+    for (uint32_t i = 0; i < sequence->length; i++) {
+        hash = hash * 31 + sequence->codePoints[i];
+    }
+    return hash;
+}
+
+// Not inlined, like a message send.
+__attribute__((noinline)) static void *Box(const void *bytes, size_t length) {
+    void *box = malloc(length);
+    memcpy(box, bytes, length);
+    return box;
+}
+
+static uint32_t OldGetOrSet(const Sequence *sequence) {
+    pthread_mutex_lock(&gOldTable.lock);
+    Sequence *key = Box(sequence, sizeof(*sequence));
+    const uint32_t bucket = OldHash(key) % OLD_BUCKETS;
+    uint32_t code = 0;
+    for (OldEntry *entry = gOldTable.byString[bucket]; entry; entry = entry->next) {
+        if (entry->sequence.length == key->length &&
+            !memcmp(entry->sequence.codePoints, key->codePoints, sizeof(uint32_t) * key->length)) {
+            code = entry->code;
+            break;
+        }
+    }
+    if (!code) {
+        OldEntry *entry = calloc(1, sizeof(*entry));
+        entry->code = gOldTable.nextCode++;
+        entry->sequence = *sequence;
+        entry->next = gOldTable.byString[bucket];
+        gOldTable.byString[bucket] = entry;
+        gOldTable.codeToEntry[entry->code] = entry;
+        code = entry->code;
+    }
+    free(key);
+    pthread_mutex_unlock(&gOldTable.lock);
+    return code;
+}
+
+static const Sequence *OldLookup(uint32_t code) {
+    pthread_mutex_lock(&gOldTable.lock);
+    uint32_t *key = Box(&code, sizeof(code));
+    const Sequence *result = gOldTable.codeToEntry[*key] ? &gOldTable.codeToEntry[*key]->sequence : NULL;
+    free(key);
+    pthread_mutex_unlock(&gOldTable.lock);
+    return result;
+}
+
+#pragma mark - New
+
+static iTermInternedStringTable *gNewTable;
+
+static uint32_t NewGetOrSet(const Sequence *sequence) {
+    return iTermInternedStringTableIntern(gNewTable, sequence->codePoints, sequence->length, 0, NULL, NULL);
+}
+
+static const iTermInternedString *NewLookup(uint32_t code) {
+    return iTermInternedStringTableGet(gNewTable, code);
+}
+
+#pragma mark - Threads
+
+typedef struct {
+    int useNew;
+    unsigned long long checksum;
+} Work;
+
+static void *Worker(void *arg) {
+    Work *work = arg;
+    unsigned long long checksum = 0;
+    for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+        for (int i = 0; i < gNumberOfSequences; i++) {
+            if (work->useNew) {
+                const uint32_t code = NewGetOrSet(&gSequences[i]);
+                checksum += NewLookup(code)->codePoints[0];
+            } else {
+                const uint32_t code = OldGetOrSet(&gSequences[i]);
+                checksum += OldLookup(code)->codePoints[0];
+            }
+        }
+    }
+    work->checksum = checksum;
+    return NULL;
+}
+
+static double Run(int useNew, int numberOfThreads) {
+    pthread_t threads[MAX_THREADS];
+    Work work[MAX_THREADS];
+    const double start = Now();
+    for (int i = 0; i < numberOfThreads; i++) {
+        work[i].useNew = useNew;
+        pthread_create(&threads[i], NULL, Worker, &work[i]);
+    }
+    for (int i = 0; i < numberOfThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    const double elapsed = Now() - start;
+    // Two lookups per sequence per iteration.
+    return 2.0 * ITERATIONS * gNumberOfSequences * numberOfThreads / elapsed / 1e6;
+}
+
+static int Verify(void) {
+    for (int i = 0; i < gNumberOfSequences; i++) {
+        const Sequence *sequence = &gSequences[i];
+        const uint32_t code = NewGetOrSet(sequence);
+        const iTermInternedString *string = NewLookup(code);
+        if (!string ||
+            string->length != sequence->length ||
+            memcmp(string->codePoints, sequence->codePoints, sizeof(uint32_t) * sequence->length) ||
+            iTermInternedStringTableFind(gNewTable, sequence->codePoints, sequence->length) != code) {
+            printf("Mismatch for sequence %d\n", i);
+            return 0;
+        }
+        const Sequence *old = OldLookup(OldGetOrSet(sequence));
+        if (old->length != string->length ||
+            memcmp(old->codePoints, string->codePoints, sizeof(uint32_t) * old->length)) {
+            printf("Old and new disagree for sequence %d\n", i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int StringIsSequence(const iTermInternedString *string, const Sequence *sequence) {
+    return (string &&
+            string->length == sequence->length &&
+            !memcmp(string->codePoints, sequence->codePoints, sizeof(uint32_t) * sequence->length));
+}
+
+// Uses a tiny code space. Once it's used up new strings get no code, and the old ones keep theirs.
+// A restored code in a gap is skipped over.
+static int VerifyExhaustion(void) {
+    iTermInternedStringTable *table = iTermInternedStringTableCreate(1, 100, 50, 59);
+    if (!iTermInternedStringTableSet(table, 3, gSequences[0].codePoints, gSequences[0].length, 0, NULL)) {
+        printf("Couldn't restore a code\n");
+        return 0;
+    }
+    uint32_t codes[MAX_SEQUENCES];
+    for (int i = 0; i < gNumberOfSequences; i++) {
+        const Sequence *sequence = &gSequences[i];
+        codes[i] = iTermInternedStringTableIntern(table, sequence->codePoints, sequence->length, 0, NULL, NULL);
+        // 90 codes are usable and the first sequence already has one.
+        const int shouldHaveCode = (i < 90);
+        if (!!codes[i] != shouldHaveCode ||
+            (codes[i] && (codes[i] > 100 || (codes[i] >= 50 && codes[i] <= 59))) ||
+            (i > 0 && codes[i] == 3) ||
+            (i == 0 && codes[i] != 3)) {
+            printf("Unexpected code %u for sequence %d\n", codes[i], i);
+            return 0;
+        }
+    }
+    for (int i = 0; i < 90 && i < gNumberOfSequences; i++) {
+        if (!StringIsSequence(iTermInternedStringTableGet(table, codes[i]), &gSequences[i]) ||
+            iTermInternedStringTableFind(table, gSequences[i].codePoints, gSequences[i].length) != codes[i]) {
+            printf("Sequence %d lost its code\n", i);
+            return 0;
+        }
+    }
+    uint32_t nextCode = 0;
+    bool isFull = false;
+    iTermInternedStringTableGetAllocationState(table, &nextCode, &isFull);
+    if (gNumberOfSequences > 90 && !isFull) {
+        printf("Table should be full\n");
+        return 0;
+    }
+    return 1;
+}
+
+typedef struct {
+    iTermInternedStringTable *table;
+    _Atomic int *done;
+    int failed;
+} ConcurrentReader;
+
+// Looks up every code over and over while another thread fills the table. Each string's object is
+// the sequence it was made from, so the reader can check that what it sees is intact. A code must
+// keep its string once it has one.
+static void *ReadWhileInterning(void *arg) {
+    ConcurrentReader *reader = arg;
+    const iTermInternedString *seen[101] = { 0 };
+    while (!atomic_load(reader->done)) {
+        for (uint32_t code = 1; code <= 100; code++) {
+            const iTermInternedString *string = iTermInternedStringTableGet(reader->table, code);
+            if (!string) {
+                if (seen[code]) {
+                    reader->failed = 1;
+                }
+                continue;
+            }
+            if ((seen[code] && seen[code] != string) || !StringIsSequence(string, string->object)) {
+                reader->failed = 1;
+            }
+            seen[code] = string;
+            if (iTermInternedStringTableFind(reader->table, string->codePoints, string->length) != code) {
+                reader->failed = 1;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int VerifyConcurrentInterning(void) {
+    iTermInternedStringTable *table = iTermInternedStringTableCreate(1, 100, 50, 59);
+    _Atomic int done = 0;
+    pthread_t threads[4];
+    ConcurrentReader readers[4];
+    for (int i = 0; i < 4; i++) {
+        readers[i] = (ConcurrentReader){ table, &done, 0 };
+        pthread_create(&threads[i], NULL, ReadWhileInterning, &readers[i]);
+    }
+    for (int iteration = 0; iteration < 20; iteration++) {
+        for (int i = 0; i < gNumberOfSequences; i++) {
+            const Sequence *sequence = &gSequences[i];
+            iTermInternedStringTableIntern(table, sequence->codePoints, sequence->length, 0, sequence, NULL);
+        }
+    }
+    atomic_store(&done, 1);
+    int ok = 1;
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        if (readers[i].failed) {
+            ok = 0;
+        }
+    }
+    if (!ok) {
+        printf("A reader saw a string change or go away\n");
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    LoadSequences(argc > 1 ? argv[1] : "tests/emoji-test.txt");
+    gNewTable = iTermInternedStringTableCreate(1, 0xefff, 0x2500, 0x2580);
+    printf("%d sequences\n", gNumberOfSequences);
+    if (!Verify() || !VerifyExhaustion() || !VerifyConcurrentInterning()) {
+        return 1;
+    }
+
+    printf("threads   old Mlookups/s   new Mlookups/s   speedup\n");
+    for (int numberOfThreads = 1; numberOfThreads <= MAX_THREADS; numberOfThreads *= 2) {
+        const double oldRate = Run(0, numberOfThreads);
+        const double newRate = Run(1, numberOfThreads);
+        printf("%7d %16.1f %16.1f %8.1fx\n", numberOfThreads, oldRate, newRate, newRate / oldRate);
+    }
+    return 0;
+}
@@ -0,0 +1,386 @@
+// Compares find's search of each line with the paths it replaced, backwards over compiler output.
+// Substrings are compared with CFStringFind(), which -[NSString rangeOfString:options:] calls, on
+// macOS and with ICU's collation search elsewhere. Regexes are compared with re-running ICU after
+// each match, as -rangeOfRegex: was used to search backwards.
+//   cc -O2 -Isources -o /tmp/line_search_bench tests/line_search_bench.c sources/iTermLineSearchKernel.c -licui18n -licuuc && /tmp/line_search_bench
+// On macOS also pass -framework CoreFoundation and ICU's include and library paths.
+
+#include "iTermLineSearchKernel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unicode/uregex.h>
+#include <unicode/usearch.h>
+#include <unicode/ustring.h>
+#ifdef __APPLE__
+#include <CoreFoundation/CoreFoundation.h>
+#endif
+
+#define NUMBER_OF_LINES 50000
+#define REPETITIONS 5
+
+// Matches LineBlock.mm and ScreenChar.h.
+#define MAX_PARTS 20
+#define TAB_FILLER 0xf001
+#define PRIVATE_BEGIN 0xf000
+#define PRIVATE_END 0xf003
+
+// The same size as screen_char_t. Only |code| matters here.
+typedef struct {
+    uint16_t code;
+    uint8_t attributes[10];
+} Cell;
+
+typedef struct {
+    Cell *cells;
+    int length;
+} Line;
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Compiler output with the occasional error, with a tab (as tab fillers) now and then.
+static Line *MakeLines(void) {
+    Line *lines = malloc(sizeof(Line) * NUMBER_OF_LINES);
+    srandom(1);
+    for (int i = 0; i < NUMBER_OF_LINES; i++) {
+        char buffer[256];
+        const int r = random() % 100;
+        if (r == 0) {
+            snprintf(buffer, sizeof(buffer), "sources/module_%d.m:%d:%d: error: use of undeclared identifier 'x%d'",
+                     (int)(random() % 500), (int)(random() % 2000), (int)(random() % 80), i);
+        } else if (r == 1) {
+            snprintf(buffer, sizeof(buffer), "zsh: Segmentation fault  ./build/test_%d", i);
+        } else {
+            snprintf(buffer, sizeof(buffer), "[%5d/%5d] Compiling sources/module_%d.m -o build/module_%d.o",
+                     i, NUMBER_OF_LINES, (int)(random() % 500), i);
+        }
+        const int length = (int)strlen(buffer);
+        lines[i].cells = calloc(length + 4, sizeof(Cell));
+        int o = 0;
+        for (int j = 0; j < length; j++) {
+            if (buffer[j] == ' ' && random() % 50 == 0) {
+                // A tab is stored as fillers followed by the tab itself.
+                lines[i].cells[o++].code = TAB_FILLER;
+                lines[i].cells[o++].code = TAB_FILLER;
+                lines[i].cells[o++].code = '\t';
+                continue;
+            }
+            lines[i].cells[o++].code = buffer[j];
+        }
+        lines[i].length = o;
+    }
+    return lines;
+}
+
+// Like ScreenCharArrayToString for cells without complex characters.
+static int Convert(const Cell *cells, int length, uint16_t *units, int *deltas) {
+    int delta = 0;
+    int o = 0;
+    for (int i = 0; i < length; i++) {
+        const uint16_t c = cells[i].code;
+        if (c >= PRIVATE_BEGIN && c <= PRIVATE_END) {
+            ++delta;
+        } else {
+            deltas[o] = delta;
+            units[o++] = c;
+        }
+    }
+    deltas[o] = delta;
+    return o;
+}
+
+static uint16_t Fold(uint16_t c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Returns the last occurrence, comparing at every position.
+static int NaiveFindLast(const uint16_t *needle, int needleLength, const uint16_t *haystack, int length, int caseInsensitive) {
+    for (int i = length - needleLength; i >= 0; i--) {
+        int j = 0;
+        while (j < needleLength &&
+               (caseInsensitive ? Fold(haystack[i + j]) == Fold(needle[j]) : haystack[i + j] == needle[j])) {
+            j++;
+        }
+        if (j == needleLength) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// The search -[NSString rangeOfString:options:] does with find's options, on a string made from
+// the line's units the way CharArrayToString() makes one. Returns the last occurrence or -1.
+#ifdef __APPLE__
+static int SystemFindLast(const uint16_t *needle, int needleLength, const uint16_t *units, int count, int caseInsensitive) {
+    CFStringRef string = CFStringCreateWithCharacters(NULL, units, count);
+    CFStringRef needleString = CFStringCreateWithCharactersNoCopy(NULL, needle, needleLength, kCFAllocatorNull);
+    CFStringCompareFlags flags = kCFCompareBackwards;
+    if (caseInsensitive) {
+        flags |= kCFCompareCaseInsensitive | kCFCompareDiacriticInsensitive | kCFCompareWidthInsensitive;
+    }
+    CFRange range;
+    const int found = CFStringFindWithOptions(string, needleString, CFRangeMake(0, count), flags, &range);
+    CFRelease(needleString);
+    CFRelease(string);
+    return found ? (int)range.location : -1;
+}
+#else
+static UCollator *gCollator;
+static UStringSearch *gStringSearch;
+
+static int SystemFindLast(const uint16_t *needle, int needleLength, const uint16_t *units, int count, int caseInsensitive) {
+    UChar *string = malloc(sizeof(UChar) * (count + 1));
+    memcpy(string, units, sizeof(UChar) * count);
+    int location = -1;
+    if (!caseInsensitive) {
+        const UChar *found = u_strFindLast(string, count, needle, needleLength);
+        location = found ? (int)(found - string) : -1;
+    } else if (count > 0) {
+        // Primary strength ignores case, diacritics, and width.
+        UErrorCode status = U_ZERO_ERROR;
+        usearch_setText(gStringSearch, string, count, &status);
+        location = usearch_last(gStringSearch, &status);
+        if (location == USEARCH_DONE || U_FAILURE(status)) {
+            location = -1;
+        }
+    }
+    free(string);
+    return location;
+}
+#endif
+
+static int Benchmark(const char *needleString, int caseInsensitive, const Line *lines) {
+    uint16_t needle[64];
+    const int needleLength = (int)strlen(needleString);
+    for (int i = 0; i < needleLength; i++) {
+        needle[i] = (unsigned char)needleString[i];
+    }
+#ifndef __APPLE__
+    UErrorCode status = U_ZERO_ERROR;
+    gCollator = ucol_open("", &status);
+    ucol_setStrength(gCollator, UCOL_PRIMARY);
+    const UChar placeholder = ' ';
+    gStringSearch = usearch_openFromCollator(needle, needleLength, &placeholder, 1, gCollator, NULL, &status);
+    if (U_FAILURE(status)) {
+        fprintf(stderr, "usearch_openFromCollator: %s\n", u_errorName(status));
+        return 0;
+    }
+#endif
+
+    // Old: allocate per line and search with the system.
+    long oldMatches = 0;
+    double start = Now();
+    for (int rep = 0; rep < REPETITIONS; rep++) {
+        for (int i = 0; i < NUMBER_OF_LINES; i++) {
+            uint16_t *units = malloc(sizeof(uint16_t) * lines[i].length * MAX_PARTS + 1);
+            int *deltas = malloc(sizeof(int) * (lines[i].length * MAX_PARTS + 1));
+            const int count = Convert(lines[i].cells, lines[i].length, units, deltas);
+            const int location = SystemFindLast(needle, needleLength, units, count, caseInsensitive);
+            if (location >= 0) {
+                oldMatches += (long)i * 1000 + location + deltas[location];
+            }
+            free(deltas);
+            free(units);
+        }
+    }
+    const double before = Now() - start;
+
+    // New: reuse the scratch buffer and use the kernel for printable ASCII.
+    long newMatches = 0;
+    iTermLiteralNeedle *literal = iTermLiteralNeedleCreate(needle, needleLength, caseInsensitive);
+    iTermSearchScratch scratch;
+    iTermSearchScratchInit(&scratch);
+    start = Now();
+    for (int rep = 0; rep < REPETITIONS; rep++) {
+        for (int i = 0; i < NUMBER_OF_LINES; i++) {
+            iTermSearchScratchReserve(&scratch, lines[i].length * MAX_PARTS + 2);
+            const int count = Convert(lines[i].cells, lines[i].length, scratch.units + 1, scratch.deltas);
+            int location;
+            if (iTermSearchUnitsArePrintableASCII(scratch.units + 1, count)) {
+                location = iTermLiteralNeedleFind(literal, scratch.units + 1, count, true);
+            } else {
+                location = SystemFindLast(needle, needleLength, scratch.units + 1, count, caseInsensitive);
+            }
+            if (location >= 0) {
+                newMatches += (long)i * 1000 + location + scratch.deltas[location];
+            }
+        }
+    }
+    const double after = Now() - start;
+    iTermSearchScratchFree(&scratch);
+    iTermLiteralNeedleFree(literal);
+#ifndef __APPLE__
+    usearch_close(gStringSearch);
+    ucol_close(gCollator);
+#endif
+
+    const double linesSearched = (double)NUMBER_OF_LINES * REPETITIONS;
+    printf("%-22s %6s %14.0f %14.0f %8.2fx\n",
+           needleString, caseInsensitive ? "no" : "yes", linesSearched / before, linesSearched / after, before / after);
+    if (oldMatches != newMatches) {
+        fprintf(stderr, "Matches differ for %s\n", needleString);
+        return 0;
+    }
+    return 1;
+}
+
+// Returns the last non-empty match's location in the sandwich, or -1, the way the regex branch of
+// CoreSearch() used to: make a string of the sandwich, then run the regex again from the end of
+// each match over the rest of the string until there are no more.
+static int OldRegexFindLast(URegularExpression *regex, const uint16_t *sandwich, int length, int *lengthPtr) {
+    UChar *string = malloc(sizeof(UChar) * (length + 1));
+    memcpy(string, sandwich, sizeof(UChar) * length);
+    int best = -1;
+    int from = 0;
+    while (from < length) {
+        UErrorCode status = U_ZERO_ERROR;
+        // -rangeOfRegex:inRange: gives ICU only the range.
+        uregex_setText(regex, string + from, length - from, &status);
+        if (!uregex_find(regex, 0, &status) || U_FAILURE(status)) {
+            break;
+        }
+        const int location = from + uregex_start(regex, 0, &status);
+        const int matchLength = from + uregex_end(regex, 0, &status) - location;
+        if (matchLength > 0) {
+            best = location;
+            *lengthPtr = matchLength;
+        }
+        from = location + (matchLength > 0 ? matchLength : 1);
+    }
+    free(string);
+    return best;
+}
+
+// Same, but with one pass over the sandwich in place, as CoreSearch() does now.
+static int NewRegexFindLast(URegularExpression *regex, const uint16_t *sandwich, int length, int *lengthPtr) {
+    UErrorCode status = U_ZERO_ERROR;
+    uregex_setText(regex, sandwich, length, &status);
+    int best = -1;
+    while (uregex_findNext(regex, &status) && U_SUCCESS(status)) {
+        const int location = uregex_start(regex, 0, &status);
+        const int matchLength = uregex_end(regex, 0, &status) - location;
+        if (matchLength > 0) {
+            best = location;
+            *lengthPtr = matchLength;
+        }
+    }
+    return best;
+}
+
+// |pattern| is already rewritten, with \x01 for ^ and \x02 for $.
+static int BenchmarkRegex(const char *pattern, const Line *lines) {
+    UErrorCode status = U_ZERO_ERROR;
+    URegularExpression *regex = uregex_openC(pattern, 0, NULL, &status);
+    if (U_FAILURE(status)) {
+        fprintf(stderr, "uregex_openC(%s): %s\n", pattern, u_errorName(status));
+        return 0;
+    }
+    double elapsed[2];
+    long matches[2] = { 0, 0 };
+    iTermSearchScratch scratch;
+    iTermSearchScratchInit(&scratch);
+    for (int useNew = 0; useNew < 2; useNew++) {
+        const double start = Now();
+        for (int rep = 0; rep < REPETITIONS; rep++) {
+            for (int i = 0; i < NUMBER_OF_LINES; i++) {
+                iTermSearchScratchReserve(&scratch, lines[i].length * MAX_PARTS + 2);
+                const int count = Convert(lines[i].cells, lines[i].length, scratch.units + 1, scratch.deltas);
+                scratch.units[0] = 1;
+                scratch.units[count + 1] = 2;
+                int length = 0;
+                const int location = (useNew ? NewRegexFindLast : OldRegexFindLast)(regex, scratch.units, count + 2, &length);
+                if (location >= 0) {
+                    matches[useNew] += (long)i * 1000000 + location * 1000 + length;
+                }
+            }
+        }
+        elapsed[useNew] = Now() - start;
+    }
+    iTermSearchScratchFree(&scratch);
+    uregex_close(regex);
+
+    // Show the pattern as the user would have typed it.
+    char name[64];
+    snprintf(name, sizeof(name), "%s", pattern);
+    for (char *c = name; *c; c++) {
+        *c = (*c == 1) ? '^' : (*c == 2) ? '$' : *c;
+    }
+    const double linesSearched = (double)NUMBER_OF_LINES * REPETITIONS;
+    printf("%-22s %6s %14.0f %14.0f %8.2fx\n",
+           name, "regex", linesSearched / elapsed[0], linesSearched / elapsed[1], elapsed[0] / elapsed[1]);
+    if (matches[0] != matches[1]) {
+        fprintf(stderr, "Matches differ for %s\n", pattern);
+        return 0;
+    }
+    return 1;
+}
+
+// Compares the kernel with the naive search on short random strings over a small alphabet, where
+// overlapping and adjacent matches are common.
+static int Verify(void) {
+    static const char alphabet[] = "aAbB ";
+    srandom(2);
+    for (int trial = 0; trial < 20000; trial++) {
+        uint16_t haystack[40];
+        uint16_t needle[6];
+        const int length = random() % 40;
+        const int needleLength = 1 + random() % 6;
+        for (int i = 0; i < length; i++) {
+            haystack[i] = alphabet[random() % 5];
+        }
+        for (int i = 0; i < needleLength; i++) {
+            needle[i] = alphabet[random() % 5];
+        }
+        for (int caseInsensitive = 0; caseInsensitive < 2; caseInsensitive++) {
+            iTermLiteralNeedle *literal = iTermLiteralNeedleCreate(needle, needleLength, caseInsensitive);
+            const int last = iTermLiteralNeedleFind(literal, haystack, length, true);
+            int first = -1;
+            for (int i = 0; i + needleLength <= length && first < 0; i++) {
+                if (NaiveFindLast(needle, needleLength, haystack + i, needleLength, caseInsensitive) == 0) {
+                    first = i;
+                }
+            }
+            if (last != NaiveFindLast(needle, needleLength, haystack, length, caseInsensitive) ||
+                first != iTermLiteralNeedleFind(literal, haystack, length, false)) {
+                fprintf(stderr, "Kernel disagrees with naive search on trial %d\n", trial);
+                return 0;
+            }
+            iTermLiteralNeedleFree(literal);
+        }
+    }
+    const uint16_t nonASCII[] = { 'a', 0xe9 };
+    if (iTermLiteralNeedleCreate(nonASCII, 2, 0) != NULL || iTermSearchUnitsArePrintableASCII(nonASCII, 2)) {
+        fprintf(stderr, "Non-ASCII needle accepted\n");
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (!Verify()) {
+        return 1;
+    }
+    Line *lines = MakeLines();
+    static const char *needles[] = { "error", "e", "Segmentation fault", "module_42.o", "zzz" };
+    printf("%-22s %6s %14s %14s %9s\n", "needle", "case", "old lines/s", "new lines/s", "speedup");
+    for (int i = 0; i < 5; i++) {
+        for (int caseInsensitive = 0; caseInsensitive < 2; caseInsensitive++) {
+            if (!Benchmark(needles[i], caseInsensitive, lines)) {
+                return 1;
+            }
+        }
+    }
+    static const char *patterns[] = { "error: .*", "module_\\d+\\.o", "\\d+", "\x01zsh", "fault\x02", "zzz" };
+    for (int i = 0; i < sizeof(patterns) / sizeof(*patterns); i++) {
+        if (!BenchmarkRegex(patterns[i], lines)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,463 @@
+// Benchmarks -[iTermMetalPerFrameState metalGetGlyphKeys:...] with the selection and annotations
+// as searched ranges (old) and as iTermCellBitsets (new), on a synthetic grid, and checks that both
+// produce the same output.
+//   cc -O2 -Isources -o /tmp/metal_row_prep_bench tests/metal_row_prep_bench.c
+
+#include "iTermCellBitset.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAMES 50
+#define DWC_RIGHT 0xef01
+#define MAX_STACK_BITSET_WORDS 64
+
+typedef struct {
+    uint16_t code;
+    uint8_t foregroundColor;
+    uint8_t backgroundColor;
+    uint8_t bold;
+    uint8_t faint;
+    uint8_t italic;
+    uint8_t underline;
+    uint8_t strikethrough;
+    uint8_t urlCode;
+} Cell;
+
+typedef struct {
+    float r, g, b, a;
+} Color;
+
+typedef struct {
+    uint16_t code;
+    uint8_t boxDrawing;
+    uint8_t thinStrokes;
+    uint8_t typeface;
+    uint8_t drawable;
+} GlyphKey;
+
+typedef struct {
+    Color foregroundColor;
+    Color backgroundColor;
+    uint8_t underlineStyle;
+    uint8_t annotation;
+} Attributes;
+
+typedef struct {
+    Color color;
+    int origin;
+    int count;
+} BackgroundRLE;
+
+// Sorted, disjoint ranges, like NSIndexSet.
+typedef struct {
+    long long location;
+    long long length;
+} Range;
+
+typedef struct {
+    Range *ranges;
+    int count;
+} RangeSet;
+
+typedef struct {
+    Cell *cells;
+    RangeSet selection;
+    RangeSet annotations;
+    unsigned char *findMatches;  // One bit per cell, like the NSData from drawingHelperMatchesOnLine:.
+} Row;
+
+typedef struct {
+    GlyphKey *glyphKeys;
+    Attributes *attributes;
+    BackgroundRLE *backgroundRLEs;
+    int numberOfBackgroundRLEs;
+    int numberOfDrawableGlyphs;
+} RowOutput;
+
+static int gColumns = 400;
+static int gRows = 120;
+static Row *gGrid;
+static Color gPalette[256];
+static Color gSelectionColor = { 0.7f, 0.85f, 1, 1 };
+static Color gDefaultBackground = { 0.1f, 0.1f, 0.1f, 1 };
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#pragma mark - Grid
+
+static void AddRange(RangeSet *set, long long location, long long length) {
+    set->ranges = realloc(set->ranges, sizeof(Range) * (set->count + 1));
+    set->ranges[set->count].location = location;
+    set->ranges[set->count].length = length;
+    set->count++;
+}
+
+static void MakeGrid(void) {
+    srand(1);
+    for (int i = 0; i < 256; i++) {
+        gPalette[i] = (Color){ (i * 37 % 256) / 255.0f, (i * 91 % 256) / 255.0f, (i * 53 % 256) / 255.0f, 1 };
+    }
+    gGrid = calloc(gRows, sizeof(Row));
+    for (int y = 0; y < gRows; y++) {
+        Row *row = &gGrid[y];
+        row->cells = calloc(gColumns + 1, sizeof(Cell));
+        int fg = 7;
+        int bg = 0;
+        int bold = 0;
+        for (int x = 0; x < gColumns; x++) {
+            // Runs of attributes like syntax-highlighted code or ls --color.
+            if (rand() % 12 == 0) {
+                fg = rand() % 16;
+                bold = rand() % 4 == 0;
+            }
+            if (rand() % 40 == 0) {
+                bg = rand() % 5 == 0 ? rand() % 256 : 0;
+            }
+            Cell *cell = &row->cells[x];
+            const int r = rand() % 100;
+            if (r < 15) {
+                cell->code = ' ';
+            } else if (r < 17 && x + 1 < gColumns) {
+                // A double-width character and its right half.
+                cell->code = 0x4e00 + rand() % 100;
+                cell[1] = *cell;
+                cell[1].code = DWC_RIGHT;
+            } else if (r < 18) {
+                cell->code = 0x2500 + rand() % 0x80;  // Box drawing
+            } else if (cell->code != DWC_RIGHT) {
+                cell->code = 'a' + rand() % 26;
+            }
+            cell->foregroundColor = fg;
+            cell->backgroundColor = bg;
+            cell->bold = bold;
+            cell->faint = rand() % 50 == 0;
+            cell->italic = rand() % 30 == 0;
+            cell->underline = rand() % 60 == 0;
+            cell->strikethrough = rand() % 200 == 0;
+            cell->urlCode = rand() % 100 == 0;
+        }
+        // A selection from the middle of one row to the middle of another, plus a box selection.
+        if (y >= gRows / 3 && y <= gRows / 2) {
+            const int start = y == gRows / 3 ? gColumns / 2 : 0;
+            const int end = y == gRows / 2 ? gColumns / 3 : gColumns;
+            AddRange(&row->selection, start, end - start);
+        } else if (y % 7 == 0) {
+            AddRange(&row->selection, 10, 30);
+            AddRange(&row->selection, 60, 5);
+        }
+        // Annotations here and there.
+        for (int x = rand() % 50; x < gColumns; x += 40 + rand() % 80) {
+            AddRange(&row->annotations, x, 1 + rand() % 12);
+        }
+        row->findMatches = calloc((gColumns + 7) / 8, 1);
+        if (y % 5 == 0) {
+            for (int x = 20; x < 26 && x < gColumns; x++) {
+                row->findMatches[x / 8] |= 1 << (x & 7);
+            }
+        }
+    }
+}
+
+#pragma mark - Row preparation
+
+static int RangeSetContains(const RangeSet *set, long long index) {
+    int lo = 0;
+    int hi = set->count - 1;
+    while (lo <= hi) {
+        const int mid = (lo + hi) / 2;
+        const Range *range = &set->ranges[mid];
+        if (index < range->location) {
+            hi = mid - 1;
+        } else if (index >= range->location + range->length) {
+            lo = mid + 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int CheckFindMatchAtIndex(const unsigned char *findMatches, int index) {
+    return !!(findMatches[index / 8] & (1 << (index & 7)));
+}
+
+// Stands in for -[iTermColorMap fastProcessedBackgroundColorForBackgroundColor:].
+static Color ProcessBackground(Color color) {
+    const float muting = 0.1f;
+    return (Color){
+        color.r * (1 - muting) + gDefaultBackground.r * muting,
+        color.g * (1 - muting) + gDefaultBackground.g * muting,
+        color.b * (1 - muting) + gDefaultBackground.b * muting,
+        1
+    };
+}
+
+static float Brightness(Color c) {
+    return 0.30f * c.r + 0.59f * c.g + 0.11f * c.b;
+}
+
+// Stands in for -[iTermColorMap processedTextColorForTextColor:overBackgroundColor:...] with
+// minimum contrast on.
+static Color ProcessText(Color text, Color background, int faint) {
+    const float delta = Brightness(text) - Brightness(background);
+    Color result = text;
+    if (delta > -0.3f && delta < 0.3f) {
+        const float target = Brightness(background) > 0.5f ? 0 : 1;
+        result.r = text.r * 0.5f + target * 0.5f;
+        result.g = text.g * 0.5f + target * 0.5f;
+        result.b = text.b * 0.5f + target * 0.5f;
+    }
+    result.a = faint ? 0.5f : 1;
+    return result;
+}
+
+static int ColorsEqual(Color a, Color b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+typedef struct {
+    int foregroundColor;
+    int bold;
+    int faint;
+    int selected;
+    int findMatch;
+    int inUnderlinedRange;
+    int boxDrawing;
+    Color background;
+} TextColorKey;
+
+// The per-cell loop of metalGetGlyphKeys. useBitsets is a constant in each caller so the compiler
+// makes two versions.
+static inline void PrepareRow(int y, RowOutput *output, int useBitsets) {
+    const Row *row = &gGrid[y];
+    const Cell *line = row->cells;
+    const int width = gColumns;
+    uint64_t stackWords[2 * MAX_STACK_BITSET_WORDS];
+    uint64_t *heapWords = NULL;
+    iTermCellBitset selectedCells;
+    iTermCellBitset annotatedCells;
+    if (useBitsets) {
+        const int wordsPerBitset = ITERM_CELL_BITSET_WORDS(width);
+        uint64_t *words = stackWords;
+        if (wordsPerBitset > MAX_STACK_BITSET_WORDS) {
+            heapWords = malloc(2 * wordsPerBitset * sizeof(uint64_t));
+            words = heapWords;
+        }
+        iTermCellBitsetInit(&selectedCells, words, width);
+        for (int i = 0; i < row->selection.count; i++) {
+            iTermCellBitsetAddRange(&selectedCells, row->selection.ranges[i].location, row->selection.ranges[i].length);
+        }
+        iTermCellBitsetInit(&annotatedCells, words + wordsPerBitset, width);
+        for (int i = 0; i < row->annotations.count; i++) {
+            iTermCellBitsetAddRange(&annotatedCells, row->annotations.ranges[i].location, row->annotations.ranges[i].length);
+        }
+    }
+
+    TextColorKey keys[2];
+    TextColorKey *currentKey = &keys[0];
+    TextColorKey *previousKey = &keys[1];
+    int lastSelected = 0;
+    int lastBackgroundColor = -1;
+    int lastBackgroundSelected = 0;
+    int lastBackgroundMatch = 0;
+    int rles = 0;
+    int lastDrawableGlyph = -1;
+    for (int x = 0; x < width; x++) {
+        int selected = useBitsets ? iTermCellBitsetContains(&selectedCells, x) : RangeSetContains(&row->selection, x);
+        const int findMatch = !selected && CheckFindMatchAtIndex(row->findMatches, x);
+        if (lastSelected && line[x].code == DWC_RIGHT) {
+            lastSelected = selected;
+            selected = 1;
+        } else if (!lastSelected && selected && line[x].code == DWC_RIGHT) {
+            lastSelected = 1;
+            selected = 0;
+        } else {
+            lastSelected = selected;
+        }
+        const int annotated = useBitsets ? iTermCellBitsetContains(&annotatedCells, x) : RangeSetContains(&row->annotations, x);
+
+        // Background colors
+        Color backgroundColor;
+        if (x > 0 &&
+            line[x].backgroundColor == lastBackgroundColor &&
+            selected == lastBackgroundSelected &&
+            findMatch == lastBackgroundMatch) {
+            backgroundColor = output->backgroundRLEs[rles - 1].color;
+            output->backgroundRLEs[rles - 1].count++;
+        } else {
+            Color unprocessed;
+            if (selected) {
+                unprocessed = gSelectionColor;
+            } else if (findMatch) {
+                unprocessed = (Color){ 1, 1, 0, 1 };
+            } else if (line[x].backgroundColor == 0) {
+                unprocessed = gDefaultBackground;
+            } else {
+                unprocessed = gPalette[line[x].backgroundColor];
+            }
+            backgroundColor = ProcessBackground(unprocessed);
+            output->backgroundRLEs[rles].color = backgroundColor;
+            output->backgroundRLEs[rles].origin = x;
+            output->backgroundRLEs[rles].count = 1;
+            rles++;
+        }
+        lastBackgroundColor = line[x].backgroundColor;
+        lastBackgroundSelected = selected;
+        lastBackgroundMatch = findMatch;
+        Attributes *attributes = &output->attributes[x];
+        attributes->backgroundColor = backgroundColor;
+        attributes->annotation = annotated;
+
+        const int drawable = line[x].code != DWC_RIGHT && line[x].code >= ' ';
+        const int boxDrawing = drawable && line[x].code >= 0x2500 && line[x].code < 0x2580;
+
+        // Foreground colors
+        currentKey->foregroundColor = line[x].foregroundColor;
+        currentKey->bold = line[x].bold;
+        currentKey->faint = line[x].faint;
+        currentKey->selected = selected;
+        currentKey->findMatch = findMatch;
+        currentKey->inUnderlinedRange = annotated;
+        currentKey->boxDrawing = boxDrawing;
+        currentKey->background = backgroundColor;
+        if (x > 0 &&
+            currentKey->foregroundColor == previousKey->foregroundColor &&
+            currentKey->bold == previousKey->bold &&
+            currentKey->faint == previousKey->faint &&
+            currentKey->selected == previousKey->selected &&
+            currentKey->findMatch == previousKey->findMatch &&
+            currentKey->inUnderlinedRange == previousKey->inUnderlinedRange &&
+            currentKey->boxDrawing == previousKey->boxDrawing &&
+            ColorsEqual(currentKey->background, previousKey->background)) {
+            attributes->foregroundColor = output->attributes[x - 1].foregroundColor;
+        } else if (findMatch) {
+            attributes->foregroundColor = (Color){ 0, 0, 0, 1 };
+        } else if (selected) {
+            attributes->foregroundColor = (Color){ 0, 0, 0, 1 };
+        } else {
+            const int index = line[x].bold && line[x].foregroundColor < 8 ? line[x].foregroundColor | 8 : line[x].foregroundColor;
+            attributes->foregroundColor = ProcessText(gPalette[index], backgroundColor, line[x].faint);
+        }
+        if (annotated) {
+            attributes->underlineStyle = 1;
+        } else if (line[x].underline) {
+            attributes->underlineStyle = line[x].urlCode ? 2 : 1;
+        } else if (line[x].urlCode) {
+            attributes->underlineStyle = 3;
+        } else {
+            attributes->underlineStyle = 0;
+        }
+        if (line[x].strikethrough) {
+            attributes->underlineStyle |= 0x80;
+        }
+        TextColorKey *temp = currentKey;
+        currentKey = previousKey;
+        previousKey = temp;
+
+        GlyphKey *glyphKey = &output->glyphKeys[x];
+        if (attributes->underlineStyle || drawable) {
+            lastDrawableGlyph = x;
+            glyphKey->code = drawable ? line[x].code : ' ';
+            glyphKey->boxDrawing = boxDrawing;
+            glyphKey->thinStrokes = Brightness(attributes->backgroundColor) < Brightness(attributes->foregroundColor);
+            glyphKey->typeface = (line[x].bold ? 1 : 0) | (line[x].italic ? 2 : 0);
+            glyphKey->drawable = 1;
+        } else {
+            memset(glyphKey, 0, sizeof(*glyphKey));
+        }
+    }
+    free(heapWords);
+    output->numberOfBackgroundRLEs = rles;
+    output->numberOfDrawableGlyphs = lastDrawableGlyph + 1;
+}
+
+static void OldPrepareRow(int y, RowOutput *output) {
+    PrepareRow(y, output, 0);
+}
+
+static void NewPrepareRow(int y, RowOutput *output) {
+    PrepareRow(y, output, 1);
+}
+
+#pragma mark - Main
+
+static RowOutput *NewOutputs(void) {
+    RowOutput *outputs = calloc(gRows, sizeof(RowOutput));
+    for (int y = 0; y < gRows; y++) {
+        outputs[y].glyphKeys = calloc(gColumns, sizeof(GlyphKey));
+        outputs[y].attributes = calloc(gColumns, sizeof(Attributes));
+        outputs[y].backgroundRLEs = calloc(gColumns, sizeof(BackgroundRLE));
+    }
+    return outputs;
+}
+
+static int Verify(const RowOutput *old, const RowOutput *new) {
+    for (int y = 0; y < gRows; y++) {
+        if (old[y].numberOfBackgroundRLEs != new[y].numberOfBackgroundRLEs ||
+            old[y].numberOfDrawableGlyphs != new[y].numberOfDrawableGlyphs ||
+            memcmp(old[y].glyphKeys, new[y].glyphKeys, sizeof(GlyphKey) * gColumns) ||
+            memcmp(old[y].attributes, new[y].attributes, sizeof(Attributes) * gColumns) ||
+            memcmp(old[y].backgroundRLEs, new[y].backgroundRLEs, sizeof(BackgroundRLE) * old[y].numberOfBackgroundRLEs)) {
+            printf("Mismatch on row %d\n", y);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "c:r:")) != -1) {
+        switch (opt) {
+            case 'c':
+                gColumns = atoi(optarg);
+                break;
+            case 'r':
+                gRows = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-c columns] [-r rows]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (gColumns < 1 || gRows < 1) {
+        fprintf(stderr, "The grid must have at least one row and column\n");
+        return 1;
+    }
+    MakeGrid();
+
+    RowOutput *old = NewOutputs();
+    RowOutput *new = NewOutputs();
+    double start = Now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        for (int y = 0; y < gRows; y++) {
+            OldPrepareRow(y, &old[y]);
+        }
+    }
+    const double oldTime = (Now() - start) / FRAMES;
+
+    start = Now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        for (int y = 0; y < gRows; y++) {
+            NewPrepareRow(y, &new[y]);
+        }
+    }
+    const double newTime = (Now() - start) / FRAMES;
+    if (!Verify(old, new)) {
+        return 1;
+    }
+
+    printf("%dx%d grid\n", gColumns, gRows);
+    printf("method          ms/frame   speedup\n");
+    printf("index sets  %10.3f %8.1fx\n", oldTime * 1000, 1.0);
+    printf("bitsets     %10.3f %8.1fx\n", newTime * 1000, oldTime / newTime);
+    return 0;
+}
@@ -0,0 +1,231 @@
+// Compares VT100StringParser's bulk UTF-8 scanners with the old byte-at-a-time tokenizer, on
+// tests/UTF-8-demo.txt, tests/perf3.txt, and spam.cc-like corpora (or the files given), and checks
+// that both split the input the same way.
+//   cc -O2 -Isources -o /tmp/parser_throughput_bench tests/parser_throughput_bench.c sources/iTermUTF8Scanner.c
+
+#include "iTermUTF8Scanner.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef size_t (*ScanFunction)(const unsigned char *, size_t);
+
+typedef struct {
+    const char *name;
+    unsigned char *bytes;
+    size_t length;
+} Corpus;
+
+// Equivalent to the old loop in DecodeUTF8Bytes, which called decode_utf8_char() once per code
+// point and stopped at ASCII, errors, or the end of the input.
+static int DecodeOneUTF8Char(const unsigned char *p, size_t len) {
+    static const unsigned int smallest[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (len == 0) {
+        return 0;
+    }
+    unsigned int c = p[0];
+    unsigned int theChar;
+    int n;
+    if (c < 0x80) {
+        return 1;
+    } else if ((c & 0xe0) == 0xc0) {
+        theChar = c & 0x1f;
+        n = 2;
+    } else if ((c & 0xf0) == 0xe0) {
+        theChar = c & 0x0f;
+        n = 3;
+    } else if ((c & 0xf8) == 0xf0) {
+        theChar = c & 0x07;
+        n = 4;
+    } else {
+        return -1;
+    }
+    for (int i = 1; i < n; i++) {
+        if ((size_t)i >= len) {
+            return 0;
+        }
+        if ((p[i] & 0xc0) != 0x80) {
+            return -1;
+        }
+        theChar = (theChar << 6) | (p[i] & 0x3f);
+    }
+    if (theChar < smallest[n] || (theChar >= 0xd800 && theChar <= 0xdfff) || theChar > 0x10ffff) {
+        return -1;
+    }
+    return n;
+}
+
+static size_t ByteAtATimeMultibyte(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && p[i] >= 0x80) {
+        const int n = DecodeOneUTF8Char(p + i, len - i);
+        if (n <= 0) {
+            break;
+        }
+        i += n;
+    }
+    return i;
+}
+
+// Returns a checksum of token boundaries so different implementations can be compared.
+static uint64_t Tokenize(const unsigned char *p, size_t len, ScanFunction ascii, ScanFunction utf8, size_t *tokens) {
+    uint64_t hash = 1469598103934665603ULL;
+    size_t i = 0;
+    size_t count = 0;
+    while (i < len) {
+        size_t n;
+        if (p[i] >= 0x20 && p[i] <= 0x7f) {
+            n = ascii(p + i, len - i);
+        } else if (p[i] >= 0x80) {
+            n = utf8(p + i, len - i);
+            if (n == 0) {
+                n = 1;
+            }
+        } else {
+            n = 1;
+        }
+        i += n;
+        count++;
+        hash = (hash ^ i) * 1099511628211ULL;
+    }
+    *tokens = count;
+    return hash;
+}
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double MeasureMBPerSecond(const Corpus *corpus, ScanFunction ascii, ScanFunction utf8, uint64_t *hash) {
+    // Repeat until at least 256 MB has gone by so small files give stable numbers.
+    const size_t iterations = corpus->length ? (256 << 20) / corpus->length + 1 : 1;
+    size_t tokens;
+    const double start = Now();
+    for (size_t i = 0; i < iterations; i++) {
+        *hash = Tokenize(corpus->bytes, corpus->length, ascii, utf8, &tokens);
+    }
+    const double elapsed = Now() - start;
+    return (double)corpus->length * iterations / elapsed / (1 << 20);
+}
+
+static int LoadFile(const char *path, Corpus *corpus) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    corpus->name = path;
+    corpus->bytes = malloc(size > 0 ? size : 1);
+    corpus->length = fread(corpus->bytes, 1, size, f);
+    fclose(f);
+    return 1;
+}
+
+// Mirrors tests/spam.cc: random-length lines of letters, or of Thai letters with combining marks.
+static Corpus MakeSpam(const char *name, int combining, size_t lines) {
+    Corpus corpus = { name, NULL, 0 };
+    size_t capacity = lines * 4096;
+    corpus.bytes = malloc(capacity);
+    srandom(1);
+    for (size_t line = 0; line < lines; line++) {
+        const int n = random() % 800;
+        for (int j = 0; j < n && corpus.length + 8 < capacity; j++) {
+            if (combining) {
+                corpus.bytes[corpus.length++] = 0xe0;
+                corpus.bytes[corpus.length++] = 0xb8;
+                corpus.bytes[corpus.length++] = 0x80 | (random() % 30 + 1);
+                corpus.bytes[corpus.length++] = 0xcc;
+                corpus.bytes[corpus.length++] = 0x80;
+            } else {
+                corpus.bytes[corpus.length++] = 'A' + (random() % 60);
+            }
+        }
+        corpus.bytes[corpus.length++] = '\r';
+        corpus.bytes[corpus.length++] = '\n';
+    }
+    return corpus;
+}
+
+// Short colored lines like compiler output: lots of tokens, few long runs.
+static Corpus MakeColoredLog(size_t lines) {
+    Corpus corpus = { "synthetic: colored build log", NULL, 0 };
+    corpus.bytes = malloc(lines * 128);
+    for (size_t i = 0; i < lines; i++) {
+        corpus.length += sprintf((char *)corpus.bytes + corpus.length,
+                                 "\x1b[1;32m[%5zu/%5zu]\x1b[0m Compiling src/module_%zu.c \xe2\x9c\x93\r\n",
+                                 i, lines, i % 97);
+    }
+    return corpus;
+}
+
+static int Verify(void) {
+    // Random and adversarial inputs, including truncated and ill-formed sequences at every offset.
+    unsigned char buffer[257];
+    srandom(2);
+    for (int trial = 0; trial < 200000; trial++) {
+        const size_t len = random() % sizeof(buffer);
+        for (size_t i = 0; i < len; i++) {
+            const int kind = random() % 4;
+            buffer[i] = kind == 0 ? random() % 0x80 : kind == 1 ? 0x80 + random() % 0x40 : 0xc0 + random() % 0x40;
+        }
+        if (iTermUTF8ScanMultibyte(buffer, len) != ByteAtATimeMultibyte(buffer, len) ||
+            iTermUTF8ScanMultibyteScalar(buffer, len) != ByteAtATimeMultibyte(buffer, len) ||
+            iTermUTF8ScanPrintableASCII(buffer, len) != iTermUTF8ScanPrintableASCIIScalar(buffer, len)) {
+            fprintf(stderr, "Mismatch on trial %d\n", trial);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (!Verify()) {
+        return 1;
+    }
+
+    Corpus corpora[16];
+    int count = 0;
+    if (argc > 1) {
+        for (int i = 1; i < argc && count < 16; i++) {
+            if (LoadFile(argv[i], &corpora[count])) {
+                count++;
+            } else {
+                fprintf(stderr, "Can't read %s\n", argv[i]);
+            }
+        }
+    } else {
+        const char *defaults[] = { "tests/UTF-8-demo.txt", "tests/perf3.txt" };
+        for (int i = 0; i < 2; i++) {
+            if (LoadFile(defaults[i], &corpora[count])) {
+                count++;
+            } else {
+                fprintf(stderr, "Can't read %s (run from the repository root)\n", defaults[i]);
+            }
+        }
+        corpora[count++] = MakeSpam("synthetic: spam.cc ASCII", 0, 20000);
+        corpora[count++] = MakeSpam("synthetic: spam.cc combining marks", 1, 5000);
+        corpora[count++] = MakeColoredLog(200000);
+    }
+
+    printf("%-40s %10s %12s %12s %8s\n", "corpus", "bytes", "old MB/s", "new MB/s", "speedup");
+    for (int i = 0; i < count; i++) {
+        uint64_t oldHash = 0;
+        uint64_t newHash = 0;
+        const double before = MeasureMBPerSecond(&corpora[i], iTermUTF8ScanPrintableASCIIScalar, ByteAtATimeMultibyte, &oldHash);
+        const double after = MeasureMBPerSecond(&corpora[i], iTermUTF8ScanPrintableASCII, iTermUTF8ScanMultibyte, &newHash);
+        if (oldHash != newHash) {
+            fprintf(stderr, "Token boundaries differ for %s\n", corpora[i].name);
+            return 1;
+        }
+        printf("%-40s %10zu %12.1f %12.1f %7.2fx\n", corpora[i].name, corpora[i].length, before, after, after / before);
+        free(corpora[i].bytes);
+    }
+    return 0;
+}
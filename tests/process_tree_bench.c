@@ -0,0 +1,355 @@
+// Compares reading every process on the system, like iTermProcessCache, with iTermProcessTree
+// watching only the sessions' processes, and checks that both find the same foreground jobs.
+//   cc -O2 -Isources -o /tmp/process_tree_bench tests/process_tree_bench.c sources/iTermProcessTree.c -lutil
+
+#include "iTermProcessTree.h"
+
+#include <dirent.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <libproc.h>
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+#define ITERATIONS 50
+#define MAX_SESSIONS 64
+#define MAX_PROCESSES 65536
+#define MAX_DEPTH 50
+
+typedef struct {
+    pid_t pids[1024];
+    int count;
+    pid_t deepest;
+} Session;
+
+static iTermProcessTreeSource gSource;
+static pid_t gRoots[MAX_SESSIONS];
+static int gMasters[MAX_SESSIONS];
+static int gNumberOfSessions = 8;
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Sleep(int milliseconds) {
+    struct timespec ts = { milliseconds / 1000, (milliseconds % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int ComparePIDs(const void *a, const void *b) {
+    const pid_t lhs = *(const pid_t *)a;
+    const pid_t rhs = *(const pid_t *)b;
+    return lhs < rhs ? -1 : lhs > rhs ? 1 : 0;
+}
+
+#pragma mark - Processes
+
+static volatile sig_atomic_t gShouldFork;
+
+static void HandleSignal(int sig) {
+    if (sig == SIGUSR1) {
+        gShouldFork = 1;
+    }
+}
+
+static void Idle(void) {
+    while (1) {
+        pause();
+    }
+}
+
+// Acts like a shell: puts a job in the foreground, reaps children, and forks another idle child
+// on SIGUSR1.
+static void RunSessionLeader(void) {
+    signal(SIGCHLD, HandleSignal);
+    signal(SIGUSR1, HandleSignal);
+    const pid_t job = fork();
+    if (job == 0) {
+        setpgid(0, 0);
+        signal(SIGTTOU, SIG_IGN);
+        tcsetpgrp(0, getpid());
+        if (fork() == 0) {
+            Idle();
+        }
+        Idle();
+    }
+    while (1) {
+        pause();
+        while (waitpid(-1, NULL, WNOHANG) > 0) {
+        }
+        if (gShouldFork) {
+            gShouldFork = 0;
+            if (fork() == 0) {
+                Idle();
+            }
+        }
+    }
+}
+
+#pragma mark - Old
+
+typedef struct {
+    pid_t pid;
+    iTermProcessTreeProcess process;
+} Entry;
+
+static Entry gEntries[MAX_PROCESSES];
+static int gNumberOfEntries;
+
+// Reads every process on the system, like -[iTermProcessCache newProcessCollection].
+static void ScanAllProcesses(void) {
+    gNumberOfEntries = 0;
+#ifdef __APPLE__
+    static pid_t pids[MAX_PROCESSES];
+    const int bytes = proc_listallpids(pids, sizeof(pids));
+    const int count = bytes < 0 ? 0 : bytes;
+    for (int i = 0; i < count && gNumberOfEntries < MAX_PROCESSES; i++) {
+        Entry *entry = &gEntries[gNumberOfEntries];
+        entry->pid = pids[i];
+        if (gSource.readProcess(gSource.context, pids[i], &entry->process)) {
+            gNumberOfEntries++;
+        }
+    }
+#else
+    DIR *dir = opendir("/proc");
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) && gNumberOfEntries < MAX_PROCESSES) {
+        char *end;
+        const long pid = strtol(dirent->d_name, &end, 10);
+        if (*end || pid <= 0) {
+            continue;
+        }
+        Entry *entry = &gEntries[gNumberOfEntries];
+        entry->pid = (pid_t)pid;
+        if (gSource.readProcess(gSource.context, entry->pid, &entry->process)) {
+            gNumberOfEntries++;
+        }
+    }
+    closedir(dir);
+#endif
+}
+
+static const Entry *FindEntry(pid_t pid) {
+    for (int i = 0; i < gNumberOfEntries; i++) {
+        if (gEntries[i].pid == pid) {
+            return &gEntries[i];
+        }
+    }
+    return NULL;
+}
+
+static int ChildrenOf(pid_t pid, pid_t *children) {
+    int count = 0;
+    for (int i = 0; i < gNumberOfEntries; i++) {
+        if (gEntries[i].process.parentProcessID == pid && gEntries[i].pid != pid) {
+            children[count++] = gEntries[i].pid;
+        }
+    }
+    qsort(children, (size_t)count, sizeof(pid_t), ComparePIDs);
+    return count;
+}
+
+// The same algorithm as -[iTermProcessInfo deepestForegroundJob].
+static pid_t OldDeepest(const Entry *entry, int *levelInOut, int depth, Session *session) {
+    if (depth > MAX_DEPTH) {
+        return 0;
+    }
+    session->pids[session->count++] = entry->pid;
+    pid_t children[1024];
+    const int numberOfChildren = ChildrenOf(entry->pid, children);
+    const int isForeground = (entry->process.terminalProcessGroupID > 0 &&
+                              entry->process.processGroupID == entry->process.terminalProcessGroupID);
+    if (numberOfChildren == 0 && isForeground) {
+        return entry->pid;
+    }
+    int bestLevel = *levelInOut;
+    pid_t best = isForeground ? entry->pid : 0;
+    for (int i = 0; i < numberOfChildren; i++) {
+        int level = *levelInOut + 1;
+        const pid_t candidate = OldDeepest(FindEntry(children[i]), &level, depth + 1, session);
+        if (candidate > 0 && (level > bestLevel || best == 0)) {
+            bestLevel = level;
+            best = candidate;
+        }
+    }
+    *levelInOut = bestLevel;
+    return best;
+}
+
+static void OldUpdate(Session *sessions) {
+    ScanAllProcesses();
+    for (int i = 0; i < gNumberOfSessions; i++) {
+        Session *session = &sessions[i];
+        session->count = 0;
+        session->deepest = 0;
+        const Entry *root = FindEntry(gRoots[i]);
+        if (root) {
+            int level = 0;
+            session->deepest = OldDeepest(root, &level, 0, session);
+        }
+        qsort(session->pids, (size_t)session->count, sizeof(pid_t), ComparePIDs);
+    }
+}
+
+#pragma mark - New
+
+static void AddToSession(void *context, pid_t pid, pid_t parentPID) {
+    Session *session = context;
+    session->pids[session->count++] = pid;
+}
+
+static int NewUpdate(iTermProcessTree *tree, Session *sessions) {
+    const int listed = iTermProcessTreeUpdate(tree, NULL, NULL);
+    if (!sessions) {
+        return listed;
+    }
+    for (int i = 0; i < gNumberOfSessions; i++) {
+        Session *session = &sessions[i];
+        session->count = 0;
+        iTermProcessTreeEnumerateSubtree(tree, gRoots[i], session, AddToSession);
+        qsort(session->pids, (size_t)session->count, sizeof(pid_t), ComparePIDs);
+        session->deepest = iTermProcessTreeDeepestForegroundJob(tree, gRoots[i]);
+    }
+    return listed;
+}
+
+static int Verify(iTermProcessTree *tree, const char *label) {
+    static Session old[MAX_SESSIONS];
+    static Session new[MAX_SESSIONS];
+    // Give processes time to fork and exit, and signals time to arrive.
+    Sleep(200);
+    NewUpdate(tree, new);
+    OldUpdate(old);
+    for (int i = 0; i < gNumberOfSessions; i++) {
+        if (old[i].count != new[i].count ||
+            memcmp(old[i].pids, new[i].pids, sizeof(pid_t) * (size_t)old[i].count) ||
+            old[i].deepest != new[i].deepest) {
+            printf("Mismatch %s in session %d: old has %d processes and deepest job %d, new has %d and %d\n",
+                   label, i, old[i].count, (int)old[i].deepest, new[i].count, (int)new[i].deepest);
+            return 0;
+        }
+    }
+    printf("%-20s session 0 has %d processes, deepest foreground job %d\n", label, old[0].count, (int)old[0].deepest);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int numberOfNoiseProcesses = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+        switch (opt) {
+            case 's':
+                gNumberOfSessions = atoi(optarg);
+                break;
+            case 'n':
+                numberOfNoiseProcesses = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s sessions] [-n unrelated processes]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (gNumberOfSessions < 1 || gNumberOfSessions > MAX_SESSIONS) {
+        gNumberOfSessions = 8;
+    }
+    if (!iTermProcessTreeSourceInitSystem(&gSource)) {
+        printf("No process tree source on this platform\n");
+        return 1;
+    }
+
+    pid_t *noise = calloc((size_t)numberOfNoiseProcesses, sizeof(pid_t));
+    for (int i = 0; i < numberOfNoiseProcesses; i++) {
+        noise[i] = fork();
+        if (noise[i] == 0) {
+            Idle();
+        }
+    }
+    for (int i = 0; i < gNumberOfSessions; i++) {
+        gRoots[i] = forkpty(&gMasters[i], NULL, NULL, NULL);
+        if (gRoots[i] < 0) {
+            perror("forkpty");
+            return 1;
+        }
+        if (gRoots[i] == 0) {
+            RunSessionLeader();
+        }
+    }
+
+    iTermProcessTree *tree = iTermProcessTreeCreate(&gSource);
+    for (int i = 0; i < gNumberOfSessions; i++) {
+        iTermProcessTreeAddRoot(tree, gRoots[i]);
+    }
+    int ok = Verify(tree, "initially");
+    if (ok) {
+        kill(gRoots[0], SIGUSR1);
+        ok = Verify(tree, "after a fork");
+    }
+
+    double oldTime = 0;
+    double newTime = 0;
+    int listed = 0;
+    if (ok) {
+        static Session sessions[MAX_SESSIONS];
+        double start = Now();
+        for (int i = 0; i < ITERATIONS; i++) {
+            OldUpdate(sessions);
+        }
+        oldTime = (Now() - start) / ITERATIONS;
+
+        start = Now();
+        for (int i = 0; i < ITERATIONS; i++) {
+            listed = NewUpdate(tree, sessions);
+        }
+        newTime = (Now() - start) / ITERATIONS;
+    }
+
+    if (ok) {
+        // Kill the foreground job and its child. The session leader reaps the job.
+        static Session sessions[MAX_SESSIONS];
+        NewUpdate(tree, sessions);
+        for (int i = 0; i < sessions[0].count; i++) {
+            if (sessions[0].pids[i] != gRoots[0]) {
+                kill(sessions[0].pids[i], SIGKILL);
+            }
+        }
+        ok = Verify(tree, "after exits");
+    }
+
+    for (int i = 0; i < gNumberOfSessions; i++) {
+        static Session session;
+        session.count = 0;
+        iTermProcessTreeSourceEnumerateSubtree(&gSource, gRoots[i], &session, AddToSession);
+        for (int j = session.count - 1; j >= 0; j--) {
+            kill(session.pids[j], SIGKILL);
+        }
+        close(gMasters[i]);
+    }
+    for (int i = 0; i < numberOfNoiseProcesses; i++) {
+        kill(noise[i], SIGKILL);
+    }
+    while (wait(NULL) > 0) {
+    }
+    iTermProcessTreeFree(tree);
+    free(noise);
+    if (!ok) {
+        return 1;
+    }
+
+    printf("%d sessions, %d processes on the system\n", gNumberOfSessions, gNumberOfEntries);
+    printf("method              ms/update   speedup\n");
+    printf("scan all processes %10.3f %8.1fx\n", oldTime * 1000, 1.0);
+    printf("process tree       %10.3f %8.1fx  (%d child lists read per update)\n",
+           newTime * 1000, oldTime / newTime, listed);
+    return 0;
+}
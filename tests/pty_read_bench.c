@@ -0,0 +1,333 @@
+// Benchmarks the read loop in -[PTYTask processRead], old (four 1 KB reads) versus new (adaptive,
+// coalesced), reading tests/spam.cc under a PTY. Each batch gets the per-batch work of
+// -[PTYSession threadedReadTask:]: it's tokenized with the real scanners into a new token vector,
+// which is handed to a "main" thread with at most four batches outstanding.
+//   c++ -O2 -o /tmp/spam tests/spam.cc
+//   cc -O2 -Isources -o /tmp/pty_read_bench tests/pty_read_bench.c sources/iTermPTYReadBuffer.c sources/iTermUTF8Scanner.c -lutil -lpthread
+
+#include "iTermPTYReadBuffer.h"
+#include "iTermUTF8Scanner.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+typedef struct {
+    size_t bytes;
+    size_t batches;
+    size_t wakeups;
+    double seconds;
+} Result;
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#pragma mark - Per-batch work
+
+// Same limit as kMaxOutstandingExecuteCalls in PTYSession.
+#define MAX_OUTSTANDING_BATCHES 4
+
+typedef struct {
+    unsigned int offset;
+    unsigned int length;
+    int type;
+} Token;
+
+typedef struct {
+    Token *tokens;
+    size_t count;
+} TokenVector;
+
+// Stands in for the main queue: a FIFO of token vectors drained by one thread.
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    TokenVector queue[MAX_OUTSTANDING_BATCHES];
+    int head;
+    int count;
+    int quit;
+} gMain = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .changed = PTHREAD_COND_INITIALIZER
+};
+
+static unsigned long gSink;
+
+// Splits the batch the way ParseString() does: runs of printable ASCII, runs of multibyte UTF-8,
+// and single control bytes. Like CVectorCreate(&vector, 100), the vector is new for each batch.
+static TokenVector Tokenize(const unsigned char *bytes, size_t length) {
+    size_t capacity = 100;
+    TokenVector vector = { malloc(capacity * sizeof(Token)), 0 };
+    size_t i = 0;
+    while (i < length) {
+        size_t n;
+        int type;
+        if (bytes[i] >= 0x20 && bytes[i] <= 0x7f) {
+            n = iTermUTF8ScanPrintableASCII(bytes + i, length - i);
+            type = 0;
+        } else if (bytes[i] >= 0x80) {
+            n = iTermUTF8ScanMultibyte(bytes + i, length - i);
+            type = 1;
+            if (n == 0) {
+                n = 1;
+            }
+        } else {
+            n = 1;
+            type = 2;
+        }
+        if (vector.count == capacity) {
+            capacity *= 2;
+            vector.tokens = realloc(vector.tokens, capacity * sizeof(Token));
+        }
+        vector.tokens[vector.count++] = (Token){ (unsigned int)i, (unsigned int)n, type };
+        i += n;
+    }
+    return vector;
+}
+
+static void *MainThread(void *arg) {
+    pthread_mutex_lock(&gMain.lock);
+    for (;;) {
+        while (gMain.count == 0 && !gMain.quit) {
+            pthread_cond_wait(&gMain.changed, &gMain.lock);
+        }
+        if (gMain.count == 0) {
+            break;
+        }
+        TokenVector vector = gMain.queue[gMain.head];
+        pthread_mutex_unlock(&gMain.lock);
+
+        // Executing the tokens.
+        for (size_t i = 0; i < vector.count; i++) {
+            gSink += vector.tokens[i].length * (vector.tokens[i].type + 1);
+        }
+        free(vector.tokens);
+
+        pthread_mutex_lock(&gMain.lock);
+        gMain.head = (gMain.head + 1) % MAX_OUTSTANDING_BATCHES;
+        gMain.count--;
+        pthread_cond_broadcast(&gMain.changed);
+    }
+    pthread_mutex_unlock(&gMain.lock);
+    return NULL;
+}
+
+static void ConsumeBatch(const char *buffer, size_t length) {
+    TokenVector vector = Tokenize((const unsigned char *)buffer, length);
+    pthread_mutex_lock(&gMain.lock);
+    while (gMain.count == MAX_OUTSTANDING_BATCHES) {
+        pthread_cond_wait(&gMain.changed, &gMain.lock);
+    }
+    gMain.queue[(gMain.head + gMain.count) % MAX_OUTSTANDING_BATCHES] = vector;
+    gMain.count++;
+    pthread_cond_broadcast(&gMain.changed);
+    pthread_mutex_unlock(&gMain.lock);
+}
+
+// Returns once the main thread has executed every batch.
+static void DrainMainThread(void) {
+    pthread_mutex_lock(&gMain.lock);
+    while (gMain.count > 0) {
+        pthread_cond_wait(&gMain.changed, &gMain.lock);
+    }
+    pthread_mutex_unlock(&gMain.lock);
+}
+
+#pragma mark - Reading
+
+static pid_t Spawn(char **argv, int *fdPtr) {
+    struct termios term;
+    memset(&term, 0, sizeof(term));
+    cfmakeraw(&term);
+    struct winsize size = { .ws_row = 24, .ws_col = 80 };
+    const pid_t pid = forkpty(fdPtr, NULL, &term, &size);
+    if (pid == 0) {
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    if (pid > 0) {
+        fcntl(*fdPtr, F_SETFL, O_NONBLOCK);
+    }
+    return pid;
+}
+
+// Returns 0 when the child has closed the pseudoterminal.
+static int Wait(int fd) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(fd, &readSet);
+    return select(fd + 1, &readSet, NULL, NULL, NULL) >= 0;
+}
+
+static int OldRead(int fd, Result *result) {
+    const int iterations = 4;
+    size_t bytesRead = 0;
+    char buffer[1024 * iterations];
+    for (int i = 0; i < iterations; i++) {
+        ssize_t n = read(fd, buffer + bytesRead, 1024);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                return 0;
+            }
+            n = 0;
+        }
+        bytesRead += n;
+        if (n < 1024) {
+            if (n == 0 && bytesRead == 0 && errno != EAGAIN && errno != EINTR) {
+                return 0;
+            }
+            break;
+        }
+    }
+    if (bytesRead) {
+        result->bytes += bytesRead;
+        result->batches++;
+        ConsumeBatch(buffer, bytesRead);
+    }
+    return 1;
+}
+
+typedef struct {
+    size_t size;
+    double bytesPerSecond;
+    double lastTime;
+} Adaptive;
+
+static int NewRead(int fd, Result *result, Adaptive *state) {
+    char *buffer = iTermPTYReadBufferAcquire(state->size);
+    const ssize_t n = iTermPTYReadCoalesced(fd, buffer, state->size);
+    if (n <= 0) {
+        iTermPTYReadBufferRelease(buffer, state->size);
+        return n == 0 && errno == EAGAIN;
+    }
+    // Exponentially weighted estimate standing in for iTermThroughputEstimator.
+    const double now = Now();
+    const double dt = now - state->lastTime;
+    state->lastTime = now;
+    if (dt > 0) {
+        const double alpha = dt > 1.0 / 30 ? 1 : dt * 30;
+        state->bytesPerSecond = state->bytesPerSecond * (1 - alpha) + (n / dt) * alpha;
+    }
+    result->bytes += n;
+    result->batches++;
+    ConsumeBatch(buffer, n);
+    iTermPTYReadBufferRelease(buffer, state->size);
+    state->size = iTermPTYReadSizeAdapt(state->size, n, state->bytesPerSecond);
+    return 1;
+}
+
+static int Run(char **argv, int adaptive, Result *result) {
+    memset(result, 0, sizeof(*result));
+    int fd;
+    const pid_t pid = Spawn(argv, &fd);
+    if (pid < 0) {
+        perror("forkpty");
+        return 0;
+    }
+    Adaptive state = { ITERM_PTY_READ_MINIMUM_SIZE, 0, Now() };
+    const double start = Now();
+    for (;;) {
+        if (!Wait(fd)) {
+            break;
+        }
+        result->wakeups++;
+        errno = 0;
+        if (!(adaptive ? NewRead(fd, result, &state) : OldRead(fd, result))) {
+            // EOF or EIO: the child is gone.
+            break;
+        }
+    }
+    DrainMainThread();
+    result->seconds = Now() - start;
+    close(fd);
+    int status;
+    waitpid(pid, &status, 0);
+    return 1;
+}
+
+static int VerifySizing(void) {
+    size_t size = ITERM_PTY_READ_MINIMUM_SIZE;
+    for (int i = 0; i < 20; i++) {
+        size = iTermPTYReadSizeAdapt(size, size, 0);
+    }
+    if (size != ITERM_PTY_READ_MAXIMUM_SIZE) {
+        fprintf(stderr, "Didn't grow to the maximum: %zu\n", size);
+        return 0;
+    }
+    for (int i = 0; i < 20; i++) {
+        size = iTermPTYReadSizeAdapt(size, 10, 100);
+    }
+    if (size != ITERM_PTY_READ_MINIMUM_SIZE) {
+        fprintf(stderr, "Didn't shrink to the minimum: %zu\n", size);
+        return 0;
+    }
+    if (iTermPTYReadSizeAdapt(size, 10, 60.0 * 100000) != 128 * 1024) {
+        fprintf(stderr, "Didn't jump to a frame's worth\n");
+        return 0;
+    }
+    char *a = iTermPTYReadBufferAcquire(8192);
+    iTermPTYReadBufferRelease(a, 8192);
+    char *b = iTermPTYReadBufferAcquire(8192);
+    iTermPTYReadBufferRelease(b, 8192);
+    if (b != a) {
+        fprintf(stderr, "Pool didn't reuse a buffer\n");
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (!VerifySizing()) {
+        return 1;
+    }
+    const int first = 1;
+    char *defaultArgv[] = { "/tmp/spam", NULL };
+    char **spamArgv = argc > first ? argv + first : defaultArgv;
+    if (access(spamArgv[0], X_OK) != 0) {
+        fprintf(stderr, "Can't run %s. Build tests/spam.cc first.\n", spamArgv[0]);
+        return 1;
+    }
+
+    pthread_t mainThread;
+    pthread_create(&mainThread, NULL, MainThread, NULL);
+
+    Result results[2];
+    const char *names[2] = { "old (4 x 1 KB)", "new (adaptive)" };
+    printf("%-16s %12s %10s %10s %12s %10s\n", "reader", "bytes", "wakeups", "batches", "bytes/batch", "MB/s");
+    for (int i = 0; i < 2; i++) {
+        if (!Run(spamArgv, i, &results[i])) {
+            return 1;
+        }
+        printf("%-16s %12zu %10zu %10zu %12.0f %10.1f\n",
+               names[i], results[i].bytes, results[i].wakeups, results[i].batches,
+               results[i].batches ? (double)results[i].bytes / results[i].batches : 0,
+               results[i].bytes / results[i].seconds / (1 << 20));
+    }
+    pthread_mutex_lock(&gMain.lock);
+    gMain.quit = 1;
+    pthread_cond_broadcast(&gMain.changed);
+    pthread_mutex_unlock(&gMain.lock);
+    pthread_join(mainThread, NULL);
+
+    if (results[0].bytes != results[1].bytes) {
+        fprintf(stderr, "Byte counts differ\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,289 @@
+// Measures TaskNotifier's wakeup latency with N idle PTYs plus one busy one, for the old select()
+// loop and for iTermEventPoller (kqueue or epoll).
+//   cc -O2 -Isources -o /tmp/task_notifier_bench tests/task_notifier_bench.c sources/iTermEventPoller.c -lutil
+
+#include "iTermEventPoller.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+#define ROUND_TRIPS 5000
+
+typedef struct {
+    int master;
+    int slave;
+} Terminal;
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int OpenTerminal(Terminal *terminal) {
+    if (openpty(&terminal->master, &terminal->slave, NULL, NULL, NULL) != 0) {
+        return 0;
+    }
+    fcntl(terminal->master, F_SETFL, O_NONBLOCK);
+    return 1;
+}
+
+static void Ping(const Terminal *busy) {
+    if (write(busy->slave, "x", 1) != 1) {
+        perror("write");
+        exit(1);
+    }
+}
+
+static void Pong(int fd) {
+    char c;
+    while (read(fd, &c, 1) < 0 && errno == EINTR) {
+    }
+}
+
+// Returns microseconds per round trip, or -1 if it can't run.
+static double SelectLoop(const Terminal *terminals, int n, const Terminal *busy) {
+    int highest = busy->master;
+    for (int i = 0; i < n; i++) {
+        if (terminals[i].master > highest) {
+            highest = terminals[i].master;
+        }
+    }
+    if (highest >= FD_SETSIZE) {
+        return -1;
+    }
+    const double start = Now();
+    for (int trip = 0; trip < ROUND_TRIPS; trip++) {
+        Ping(busy);
+        fd_set rfds;
+        fd_set efds;
+        FD_ZERO(&rfds);
+        FD_ZERO(&efds);
+        FD_SET(busy->master, &rfds);
+        FD_SET(busy->master, &efds);
+        for (int i = 0; i < n; i++) {
+            FD_SET(terminals[i].master, &rfds);
+            FD_SET(terminals[i].master, &efds);
+        }
+        if (select(highest + 1, &rfds, NULL, &efds, NULL) <= 0) {
+            return -1;
+        }
+        for (int fd = 0; fd <= highest; fd++) {
+            if (FD_ISSET(fd, &rfds)) {
+                Pong(fd);
+            }
+        }
+    }
+    return (Now() - start) / ROUND_TRIPS * 1e6;
+}
+
+static double PollerLoop(iTermEventPoller *poller, const Terminal *terminals, int n, const Terminal *busy) {
+    iTermEventPollerEvent events[64];
+    const double start = Now();
+    for (int trip = 0; trip < ROUND_TRIPS; trip++) {
+        Ping(busy);
+        iTermEventPollerBeginUpdate(poller);
+        iTermEventPollerSetInterest(poller, busy->master, 1, true, false);
+        for (int i = 0; i < n; i++) {
+            if (!iTermEventPollerSetInterest(poller, terminals[i].master, 1, true, false)) {
+                return -1;
+            }
+        }
+        iTermEventPollerEndUpdate(poller);
+        const int count = iTermEventPollerWait(poller, events, 64, -1);
+        if (count <= 0) {
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (events[i].readable) {
+                Pong(events[i].fd);
+            }
+        }
+    }
+    return (Now() - start) / ROUND_TRIPS * 1e6;
+}
+
+// A pipe whose writer goes away is reported even when nobody wants to read it, as long as there's
+// nothing left to read. Data that's left is only reported once there's read interest again.
+// select() can't tell without asking to read, so it's exempt.
+static int VerifyHangupWithoutReadInterest(iTermEventPoller *poller, int b) {
+    if (iTermEventPollerGetBackend(poller) == iTermEventPollerBackendSelect) {
+        return 1;
+    }
+    iTermEventPollerEvent events[8];
+    int empty[2];
+    int full[2];
+    if (pipe(empty) != 0 || pipe(full) != 0 || write(full[1], "x", 1) != 1) {
+        return 0;
+    }
+    iTermEventPollerBeginUpdate(poller);
+    iTermEventPollerSetInterest(poller, empty[0], 4, false, false);
+    iTermEventPollerSetInterest(poller, full[0], 5, false, false);
+    iTermEventPollerEndUpdate(poller);
+    if (iTermEventPollerWait(poller, events, 8, 10) > 0) {
+        fprintf(stderr, "Backend %d reported data nobody wanted\n", b);
+        return 0;
+    }
+    close(empty[1]);
+    close(full[1]);
+    int sawEmpty = 0;
+    const double deadline = Now() + 1;
+    while (!sawEmpty && Now() < deadline) {
+        const int count = iTermEventPollerWait(poller, events, 8, 100);
+        for (int i = 0; i < count; i++) {
+            if (events[i].fd == full[0] || events[i].readable) {
+                fprintf(stderr, "Backend %d reported data nobody wanted at hangup\n", b);
+                return 0;
+            }
+            sawEmpty |= events[i].fd == empty[0] && events[i].error;
+        }
+    }
+    if (!sawEmpty) {
+        fprintf(stderr, "Backend %d missed a hangup without read interest\n", b);
+        return 0;
+    }
+
+    // Reading again gets the byte and then the hangup.
+    iTermEventPollerBeginUpdate(poller);
+    iTermEventPollerSetInterest(poller, full[0], 5, true, false);
+    iTermEventPollerEndUpdate(poller);
+    int count = iTermEventPollerWait(poller, events, 8, 1000);
+    if (count != 1 || events[0].fd != full[0] || !events[0].readable) {
+        fprintf(stderr, "Backend %d didn't report data left at hangup\n", b);
+        return 0;
+    }
+    Pong(full[0]);
+    count = iTermEventPollerWait(poller, events, 8, 1000);
+    if (count != 1 || events[0].fd != full[0] || !events[0].error) {
+        fprintf(stderr, "Backend %d didn't report hangup after reading\n", b);
+        return 0;
+    }
+    iTermEventPollerBeginUpdate(poller);
+    iTermEventPollerEndUpdate(poller);
+    close(empty[0]);
+    close(full[0]);
+    return 1;
+}
+
+// Checks that each backend reports the same events for readable, writable, and hung-up
+// descriptors, and drops descriptors that aren't registered again. Events may arrive over several
+// waits (the pty's byte takes a moment to get through the line discipline), so it keeps waiting
+// until it has seen them all or a second has passed.
+static int Verify(void) {
+    const iTermEventPollerBackend backends[] = { iTermEventPollerBackendKqueue, iTermEventPollerBackendEpoll, iTermEventPollerBackendSelect };
+    for (int b = 0; b < 3; b++) {
+        iTermEventPoller *poller = iTermEventPollerCreateWithBackend(backends[b]);
+        if (!poller) {
+            continue;
+        }
+        Terminal a, c;
+        int p[2];
+        if (!OpenTerminal(&a) || !OpenTerminal(&c) || pipe(p) != 0) {
+            return 0;
+        }
+        iTermEventPollerEvent events[8];
+        iTermEventPollerBeginUpdate(poller);
+        iTermEventPollerSetInterest(poller, a.master, 1, true, false);
+        iTermEventPollerSetInterest(poller, c.master, 2, true, true);
+        iTermEventPollerSetInterest(poller, p[0], 3, true, false);
+        iTermEventPollerEndUpdate(poller);
+        Ping(&a);
+        close(p[1]);
+        int count;
+        int sawA = 0, sawC = 0, sawPipe = 0;
+        const double deadline = Now() + 1;
+        while (!(sawA && sawC && sawPipe) && Now() < deadline) {
+            count = iTermEventPollerWait(poller, events, 8, 100);
+            for (int i = 0; i < count; i++) {
+                sawA |= events[i].fd == a.master && events[i].readable;
+                sawC |= events[i].fd == c.master && events[i].writable && !events[i].readable;
+                sawPipe |= events[i].fd == p[0] && (events[i].readable || events[i].error);
+            }
+        }
+        if (!sawA || !sawC || !sawPipe) {
+            fprintf(stderr, "Backend %d missed an event (%d %d %d)\n", b, sawA, sawC, sawPipe);
+            return 0;
+        }
+        // Stop watching all but |a|, which still has a byte waiting.
+        iTermEventPollerBeginUpdate(poller);
+        iTermEventPollerSetInterest(poller, a.master, 1, true, false);
+        iTermEventPollerEndUpdate(poller);
+        count = iTermEventPollerWait(poller, events, 8, 1000);
+        if (count != 1 || events[0].fd != a.master) {
+            fprintf(stderr, "Backend %d reported an unregistered descriptor\n", b);
+            return 0;
+        }
+        Pong(a.master);
+        // Nothing left: should time out.
+        if (iTermEventPollerWait(poller, events, 8, 10) != 0) {
+            fprintf(stderr, "Backend %d reported an idle descriptor\n", b);
+            return 0;
+        }
+        close(a.master);
+        close(a.slave);
+        close(c.master);
+        close(c.slave);
+        close(p[0]);
+        if (!VerifyHangupWithoutReadInterest(poller, b)) {
+            return 0;
+        }
+        iTermEventPollerFree(poller);
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (!Verify()) {
+        return 1;
+    }
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    static const int sizes[] = { 0, 10, 50, 150, 500, 1000, 2000 };
+    Terminal busy;
+    if (!OpenTerminal(&busy)) {
+        perror("openpty");
+        return 1;
+    }
+    Terminal *terminals = calloc(2000, sizeof(Terminal));
+    int opened = 0;
+    iTermEventPoller *poller = iTermEventPollerCreate();
+    const char *backend = iTermEventPollerGetBackend(poller) == iTermEventPollerBackendKqueue ? "kqueue" :
+                          iTermEventPollerGetBackend(poller) == iTermEventPollerBackendEpoll ? "epoll" : "select";
+
+    printf("%10s %16s %16s\n", "idle ttys", "select us/wake", "poller us/wake");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+        while (opened < sizes[s]) {
+            if (!OpenTerminal(&terminals[opened])) {
+                fprintf(stderr, "Can only open %d pseudoterminals\n", opened);
+                return 0;
+            }
+            opened++;
+        }
+        const double before = SelectLoop(terminals, opened, &busy);
+        const double after = PollerLoop(poller, terminals, opened, &busy);
+        char beforeString[32];
+        if (before < 0) {
+            snprintf(beforeString, sizeof(beforeString), "n/a");
+        } else {
+            snprintf(beforeString, sizeof(beforeString), "%.2f", before);
+        }
+        printf("%10d %16s %9.2f (%s)\n", opened, beforeString, after, backend);
+    }
+    iTermEventPollerFree(poller);
+    return 0;
+}
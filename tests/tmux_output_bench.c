@@ -0,0 +1,184 @@
+// Compares decoding tmux %output payloads one byte at a time into fresh buffers with
+// iTermTmuxDecodeEscapedOutput() into one growing buffer, and checks that both give the same bytes.
+//   cc -O2 -Isources -o /tmp/tmux_output_bench tests/tmux_output_bench.c sources/iTermTmuxOutputDecoder.c
+
+#include "iTermTmuxOutputDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUMBER_OF_NOTIFICATIONS 200000
+#define REPETITIONS 5
+
+typedef struct {
+    char *bytes;
+    size_t length;
+} Payload;
+
+typedef struct {
+    unsigned char *bytes;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void BufferReserve(Buffer *buffer, size_t capacity) {
+    if (capacity <= buffer->capacity) {
+        return;
+    }
+    size_t newCapacity = buffer->capacity ? buffer->capacity : 16;
+    while (newCapacity < capacity) {
+        newCapacity *= 2;
+    }
+    buffer->bytes = realloc(buffer->bytes, newCapacity);
+    buffer->capacity = newCapacity;
+}
+
+// Not inlined, like a message send.
+__attribute__((noinline)) static void BufferAppend(Buffer *buffer, const void *bytes, size_t length) {
+    BufferReserve(buffer, buffer->length + length);
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+static Payload *MakePayloads(void) {
+    Payload *payloads = malloc(sizeof(Payload) * NUMBER_OF_NOTIFICATIONS);
+    srandom(1);
+    for (int i = 0; i < NUMBER_OF_NOTIFICATIONS; i++) {
+        char buffer[256];
+        if (random() % 20 == 0) {
+            // SGR colors around a word.
+            snprintf(buffer, sizeof(buffer), "\\033[1;31merror\\033[0m: build step %d failed\\015\\012", i);
+        } else {
+            snprintf(buffer, sizeof(buffer), "[%6d] Compiling sources/module_%d.m -o build/module_%d.o\\015\\012",
+                     i, (int)(random() % 500), i);
+        }
+        payloads[i].length = strlen(buffer);
+        payloads[i].bytes = malloc(payloads[i].length);
+        memcpy(payloads[i].bytes, buffer, payloads[i].length);
+    }
+    return payloads;
+}
+
+// The algorithm -[TmuxGateway decodeEscapedOutput:] used, on a NUL-terminated string.
+static void OldDecode(const char *bytes, Buffer *data) {
+    unsigned char c;
+    for (int i = 0; bytes[i]; i++) {
+        c = bytes[i];
+        if (c < ' ') {
+            continue;
+        }
+        if (c == '\\') {
+            c = 0;
+            for (int j = 0; j < 3; j++) {
+                i++;
+                if (bytes[i] == '\r') {
+                    continue;
+                }
+                if (bytes[i] < '0' || bytes[i] > '7') {
+                    c = '?';
+                    i--;
+                    break;
+                }
+                c *= 8;
+                c += bytes[i] - '0';
+            }
+        }
+        BufferAppend(data, &c, 1);
+    }
+}
+
+// Compares the decoder with the old algorithm on short random strings that are mostly escapes,
+// stray carriage returns, and malformed escapes, including ones cut off by the end.
+static int Verify(void) {
+    static const char alphabet[] = "\\\\\\0123789ab\r\n\t\x80\xff ";
+    srandom(2);
+    for (int trial = 0; trial < 200000; trial++) {
+        char input[48];
+        const int length = random() % 40;
+        for (int i = 0; i < length; i++) {
+            input[i] = alphabet[random() % (sizeof(alphabet) - 1)];
+        }
+        input[length] = 0;
+        Buffer expected = { 0 };
+        OldDecode(input, &expected);
+        unsigned char actual[48];
+        const size_t actualLength = iTermTmuxDecodeEscapedOutput((const unsigned char *)input, length, actual);
+        if (actualLength != expected.length || memcmp(actual, expected.bytes, actualLength)) {
+            fprintf(stderr, "Decoder disagrees with the old algorithm on trial %d\n", trial);
+            return 0;
+        }
+        free(expected.bytes);
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (!Verify()) {
+        return 1;
+    }
+    Payload *payloads = MakePayloads();
+    size_t totalLength = 0;
+    for (int i = 0; i < NUMBER_OF_NOTIFICATIONS; i++) {
+        totalLength += payloads[i].length;
+    }
+
+    // Old: one copy and one delivery per notification. Keep a checksum of what's delivered.
+    unsigned long oldChecksum = 0;
+    size_t oldLength = 0;
+    double start = Now();
+    for (int rep = 0; rep < REPETITIONS; rep++) {
+        for (int i = 0; i < NUMBER_OF_NOTIFICATIONS; i++) {
+            Buffer copy = { 0 };
+            BufferAppend(&copy, payloads[i].bytes, payloads[i].length);
+            BufferAppend(&copy, "", 1);
+            Buffer decoded = { 0 };
+            OldDecode((const char *)copy.bytes, &decoded);
+            oldChecksum = oldChecksum * 31 + decoded.bytes[decoded.length - 1];
+            oldLength += decoded.length;
+            free(decoded.bytes);
+            free(copy.bytes);
+        }
+    }
+    const double before = Now() - start;
+
+    // New: decode straight from the token into the pending output, delivered every 64
+    // notifications as though that many arrived per read.
+    unsigned long newChecksum = 0;
+    size_t newLength = 0;
+    start = Now();
+    for (int rep = 0; rep < REPETITIONS; rep++) {
+        Buffer pending = { 0 };
+        for (int i = 0; i < NUMBER_OF_NOTIFICATIONS; i++) {
+            BufferReserve(&pending, pending.length + payloads[i].length);
+            const size_t n = iTermTmuxDecodeEscapedOutput((const unsigned char *)payloads[i].bytes,
+                                                          payloads[i].length,
+                                                          pending.bytes + pending.length);
+            pending.length += n;
+            newChecksum = newChecksum * 31 + pending.bytes[pending.length - 1];
+            if (i % 64 == 63) {
+                newLength += pending.length;
+                pending.length = 0;
+            }
+        }
+        newLength += pending.length;
+        free(pending.bytes);
+    }
+    const double after = Now() - start;
+
+    const double megabytes = (double)totalLength * REPETITIONS / 1e6;
+    printf("%14s %14s %9s\n", "old MB/s", "new MB/s", "speedup");
+    printf("%14.0f %14.0f %8.2fx\n", megabytes / before, megabytes / after, before / after);
+    if (oldChecksum != newChecksum || oldLength != newLength) {
+        fprintf(stderr, "Decoded output differs\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,295 @@
+// Compares the trigger prefilter with running every regex on every line, with POSIX regcomp()
+// standing in for ICU.
+//   cc -O2 -Isources -o /tmp/trigger_prefilter_bench tests/trigger_prefilter_bench.c sources/iTermMultiLiteralMatcher.c && /tmp/trigger_prefilter_bench
+
+#include "iTermMultiLiteralMatcher.h"
+
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUMBER_OF_LINES 20000
+
+typedef struct {
+    char icu[128];    // As a user would type it into the trigger editor.
+    char posix[128];  // Equivalent POSIX ERE.
+    int icase;
+    regex_t compiled;
+} Trigger;
+
+// Converts UTF-8 to UTF-16.
+static size_t ToUTF16(const char *s, uint16_t *out) {
+    size_t n = 0;
+    const unsigned char *u = (const unsigned char *)s;
+    while (*u) {
+        uint32_t c = *u++;
+        if (c >= 0xf0) {
+            c = ((c & 0x07) << 18) | ((u[0] & 0x3f) << 12) | ((u[1] & 0x3f) << 6) | (u[2] & 0x3f);
+            u += 3;
+        } else if (c >= 0xe0) {
+            c = ((c & 0x0f) << 12) | ((u[0] & 0x3f) << 6) | (u[1] & 0x3f);
+            u += 2;
+        } else if (c >= 0xc0) {
+            c = ((c & 0x1f) << 6) | (u[0] & 0x3f);
+            u += 1;
+        }
+        if (c >= 0x10000) {
+            out[n++] = 0xd800 + ((c - 0x10000) >> 10);
+            out[n++] = 0xdc00 + ((c - 0x10000) & 0x3ff);
+        } else {
+            out[n++] = c;
+        }
+    }
+    return n;
+}
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A mix of the kinds of triggers people write: tagged log lines, host names (case-insensitive),
+// job status lines, and one with no usable literal.
+static void MakeTrigger(int i, Trigger *trigger) {
+    trigger->icase = 0;
+    switch (i % 4) {
+        case 0:
+            snprintf(trigger->icu, sizeof(trigger->icu), "tag%03d: ([0-9]+) items", i);
+            snprintf(trigger->posix, sizeof(trigger->posix), "tag%03d: ([0-9]+) items", i);
+            break;
+        case 1:
+            snprintf(trigger->icu, sizeof(trigger->icu), "(?i)host%03d\\.example\\.com", i);
+            snprintf(trigger->posix, sizeof(trigger->posix), "host%03d\\.example\\.com", i);
+            trigger->icase = 1;
+            break;
+        case 2:
+            snprintf(trigger->icu, sizeof(trigger->icu), "^\\[job %d\\] (done|failed)$", i);
+            snprintf(trigger->posix, sizeof(trigger->posix), "^\\[job %d\\] (done|failed)$", i);
+            break;
+        default:
+            if (i == 3) {
+                snprintf(trigger->icu, sizeof(trigger->icu), "[0-9]+[.][0-9]+[.][0-9]+ released");
+                snprintf(trigger->posix, sizeof(trigger->posix), "[0-9]+[.][0-9]+[.][0-9]+ released");
+            } else {
+                snprintf(trigger->icu, sizeof(trigger->icu), "(warning|error) W%d", i);
+                snprintf(trigger->posix, sizeof(trigger->posix), "(warning|error) W%d", i);
+            }
+            break;
+    }
+    const int status = regcomp(&trigger->compiled, trigger->posix, REG_EXTENDED | REG_NOSUB | (trigger->icase ? REG_ICASE : 0));
+    if (status) {
+        fprintf(stderr, "Bad regex %s\n", trigger->posix);
+        exit(1);
+    }
+}
+
+// Mostly compiler output with occasional lines that some trigger is interested in.
+static char **MakeLines(void) {
+    char **lines = malloc(sizeof(char *) * NUMBER_OF_LINES);
+    srandom(1);
+    for (int i = 0; i < NUMBER_OF_LINES; i++) {
+        char buffer[256];
+        const int r = random() % 100;
+        if (r == 0) {
+            snprintf(buffer, sizeof(buffer), "tag%03d: %d items", (int)(random() % 200) / 4 * 4, (int)(random() % 1000));
+        } else if (r == 1) {
+            snprintf(buffer, sizeof(buffer), "Connecting to HOST%03d.Example.com port 22", (int)(random() % 200) / 4 * 4 + 1);
+        } else if (r == 2) {
+            snprintf(buffer, sizeof(buffer), "[job %d] done", (int)(random() % 200) / 4 * 4 + 2);
+        } else {
+            snprintf(buffer, sizeof(buffer), "[%5d/%5d] Compiling sources/module_%d.m -o build/module_%d.o",
+                     i, NUMBER_OF_LINES, (int)(random() % 500), i);
+        }
+        lines[i] = strdup(buffer);
+    }
+    return lines;
+}
+
+static int CheckLiteral(const char *pattern, const char *expected, int expectedCaseInsensitive) {
+    uint16_t p[256];
+    uint16_t literal[ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH];
+    size_t length = 0;
+    bool caseInsensitive = false;
+    const bool ok = iTermRegexRequiredLiteral(p, ToUTF16(pattern, p), literal, ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH, &length, &caseInsensitive);
+    uint16_t expectedUTF16[256];
+    const size_t expectedLength = expected ? ToUTF16(expected, expectedUTF16) : 0;
+    if ((expected == NULL) != !ok ||
+        (ok && (length != expectedLength || memcmp(literal, expectedUTF16, length * sizeof(uint16_t)))) ||
+        (ok && caseInsensitive != expectedCaseInsensitive)) {
+        fprintf(stderr, "Required literal for %s: got %zu code units, expected %s\n", pattern, ok ? length : 0, expected ?: "(none)");
+        return 0;
+    }
+    return 1;
+}
+
+static int VerifyLiterals(void) {
+    return (CheckLiteral("error: (.*)", "error: ", 0) &&
+            CheckLiteral("colou?r", "colo", 0) &&
+            CheckLiteral("ab+c", "ab", 0) &&
+            CheckLiteral("x{0,3}yz", "yz", 0) &&
+            CheckLiteral("\\d+ files? changed", " changed", 0) &&
+            CheckLiteral("\\x41BC", "BC", 0) &&
+            CheckLiteral("\\[job \\d+\\]", "[job ", 0) &&
+            CheckLiteral("(?i)Password:", "password:", 1) &&
+            CheckLiteral("[a-z]+@[a-z]+\\.com", ".com", 0) &&
+            CheckLiteral("(?<=user )root", "root", 0) &&
+            CheckLiteral("foo|bar", NULL, 0) &&
+            CheckLiteral("(?x) a b c", NULL, 0) &&
+            CheckLiteral("\\Qa.b\\E", NULL, 0) &&
+            CheckLiteral(".*", NULL, 0) &&
+            CheckLiteral("[]x]yz", "yz", 0) &&
+            // Quantifiers apply to a whole character outside the BMP, not its low surrogate.
+            CheckLiteral("a😀?b", "a", 0) &&
+            CheckLiteral("x😀+yz", "x😀", 0) &&
+            CheckLiteral("ab\\😀*cd", "ab", 0) &&
+            CheckLiteral("😀{0,2}xyz", "xyz", 0) &&
+            CheckLiteral("a\\x{1F600}?bc", "bc", 0));
+}
+
+static int VerifyMatcher(void) {
+    static const char *literals[] = { "he", "she", "his", "hers", "Mixed" };
+    iTermMultiLiteralMatcher *matcher = iTermMultiLiteralMatcherCreate();
+    for (int i = 0; i < 5; i++) {
+        uint16_t u[16];
+        iTermMultiLiteralMatcherAddLiteral(matcher, u, ToUTF16(literals[i], u), i == 4, i);
+    }
+    iTermMultiLiteralMatcherCompile(matcher);
+    uint16_t text[64];
+    bool found[5] = { false };
+    iTermMultiLiteralMatcherScan(matcher, text, ToUTF16("ushers MIXED", text), found);
+    iTermMultiLiteralMatcherFree(matcher);
+    if (!found[0] || !found[1] || found[2] || !found[3] || !found[4]) {
+        fprintf(stderr, "Matcher failed on the classic example\n");
+        return 0;
+    }
+
+    // ICU's (?i) uses full case folding, so these lines match "(?i)kiss" and "(?i)stuff", and a
+    // case-sensitive literal with a character that folds to several must still be found.
+    static const uint16_t kelvin[] = { 0x212A, 'I', 0x00DF };
+    static const uint16_t ligatures[] = { 'x', 0xFB06, 'u', 0xFB00 };
+    static const uint16_t strasse[] = { 's', 't', 'r', 'a', 0x00DF, 'e' };
+    matcher = iTermMultiLiteralMatcherCreate();
+    uint16_t u[16];
+    iTermMultiLiteralMatcherAddLiteral(matcher, u, ToUTF16("kiss", u), true, 0);
+    iTermMultiLiteralMatcherAddLiteral(matcher, u, ToUTF16("stuff", u), true, 1);
+    iTermMultiLiteralMatcherAddLiteral(matcher, strasse, 6, false, 2);
+    iTermMultiLiteralMatcherCompile(matcher);
+    bool folded[3] = { false };
+    iTermMultiLiteralMatcherScan(matcher, kelvin, 3, folded);
+    iTermMultiLiteralMatcherScan(matcher, ligatures, 4, folded);
+    iTermMultiLiteralMatcherScan(matcher, strasse, 6, folded);
+    iTermMultiLiteralMatcherFree(matcher);
+    if (!folded[0] || !folded[1] || !folded[2]) {
+        fprintf(stderr, "Matcher missed text that only matches with full case folding\n");
+        return 0;
+    }
+    return 1;
+}
+
+static int Benchmark(int n, char **lines, uint16_t **utf16, size_t *lengths) {
+    Trigger *triggers = calloc(n, sizeof(Trigger));
+    uint16_t (*literals)[ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH] = malloc(n * sizeof(*literals));
+    size_t *literalLengths = calloc(n, sizeof(size_t));
+    bool *caseInsensitive = calloc(n, sizeof(bool));
+    int useful = 0;
+    for (int i = 0; i < n; i++) {
+        MakeTrigger(i, &triggers[i]);
+        uint16_t pattern[256];
+        if (iTermRegexRequiredLiteral(pattern, ToUTF16(triggers[i].icu, pattern), literals[i], ITERM_MULTI_LITERAL_MATCHER_MAX_LITERAL_LENGTH, &literalLengths[i], &caseInsensitive[i]) &&
+            literalLengths[i] >= ITERM_MULTI_LITERAL_MATCHER_MIN_USEFUL_LITERAL_LENGTH) {
+            useful++;
+        } else {
+            literalLengths[i] = 0;
+        }
+    }
+    // Same policy as -[iTermRegexPrefilter initWithRegexes:].
+    iTermMultiLiteralMatcher *matcher = NULL;
+    if (useful >= ITERM_MULTI_LITERAL_MATCHER_MIN_USEFUL_LITERALS) {
+        matcher = iTermMultiLiteralMatcherCreate();
+    }
+    bool *alwaysRun = calloc(n, sizeof(bool));
+    int prefiltered = 0;
+    for (int i = 0; i < n; i++) {
+        if (matcher && literalLengths[i] > 0 &&
+            iTermMultiLiteralMatcherAddLiteral(matcher, literals[i], literalLengths[i], caseInsensitive[i], i)) {
+            prefiltered++;
+        } else {
+            alwaysRun[i] = true;
+        }
+    }
+    if (matcher) {
+        iTermMultiLiteralMatcherCompile(matcher);
+    }
+    free(literals);
+    free(literalLengths);
+    free(caseInsensitive);
+
+    long oldMatches = 0;
+    double start = Now();
+    for (int line = 0; line < NUMBER_OF_LINES; line++) {
+        for (int i = 0; i < n; i++) {
+            if (regexec(&triggers[i].compiled, lines[line], 0, NULL, 0) == 0) {
+                oldMatches += line * n + i;
+            }
+        }
+    }
+    const double before = Now() - start;
+
+    long newMatches = 0;
+    bool *candidates = malloc(n);
+    start = Now();
+    for (int line = 0; line < NUMBER_OF_LINES; line++) {
+        memcpy(candidates, alwaysRun, n);
+        if (matcher) {
+            iTermMultiLiteralMatcherScan(matcher, utf16[line], lengths[line], candidates);
+        }
+        for (int i = 0; i < n; i++) {
+            if (candidates[i] && regexec(&triggers[i].compiled, lines[line], 0, NULL, 0) == 0) {
+                newMatches += line * n + i;
+            }
+        }
+    }
+    const double after = Now() - start;
+
+    printf("%8d %12d %14.0f %14.0f %8.2fx\n",
+           n, prefiltered, NUMBER_OF_LINES / before, NUMBER_OF_LINES / after, before / after);
+    for (int i = 0; i < n; i++) {
+        regfree(&triggers[i].compiled);
+    }
+    free(candidates);
+    free(alwaysRun);
+    free(triggers);
+    if (matcher) {
+        iTermMultiLiteralMatcherFree(matcher);
+    }
+    if (oldMatches != newMatches) {
+        fprintf(stderr, "Matches differ for N=%d\n", n);
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (!VerifyLiterals() || !VerifyMatcher()) {
+        return 1;
+    }
+    char **lines = MakeLines();
+    uint16_t **utf16 = malloc(sizeof(uint16_t *) * NUMBER_OF_LINES);
+    size_t *lengths = malloc(sizeof(size_t) * NUMBER_OF_LINES);
+    for (int i = 0; i < NUMBER_OF_LINES; i++) {
+        utf16[i] = malloc(sizeof(uint16_t) * (strlen(lines[i]) + 1));
+        lengths[i] = ToUTF16(lines[i], utf16[i]);
+    }
+
+    static const int sizes[] = { 1, 3, 4, 10, 50, 200 };
+    printf("%8s %12s %14s %14s %9s\n", "triggers", "prefiltered", "old lines/s", "new lines/s", "speedup");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+        if (!Benchmark(sizes[i], lines, utf16, lengths)) {
+            return 1;
+        }
+    }
+    return 0;
+}
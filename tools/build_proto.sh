@@ -5,3 +5,4 @@
 SOURCE=proto
 GENFILES=sources/proto
 tools/protoc --proto_path="$SOURCE" --objc_out="$GENFILES" --python_out=api/library/python/iterm2/iterm2 "$SOURCE"/api.proto --mypy_out=api/library/python/iterm2/iterm2
+tools/downgrade_objc_proto.py "$GENFILES"/Api.pbobjc.h "$GENFILES"/Api.pbobjc.m
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+# Rewrites Objective-C protobuf sources from a current protoc into the form
+# expected by the runtime in ThirdParty/ProtobufRuntime (version 30002), which
+# predates class references, stdatomic and GPB_FINAL.
+#
+# Usage: tools/downgrade_objc_proto.py sources/proto/Api.pbobjc.h sources/proto/Api.pbobjc.m
+
+import re
+import sys
+
+RUNTIME_VERSION = "30002"
+
+
+def downgrade_header(text):
+    text = re.sub(r"(#if GOOGLE_PROTOBUF_OBJC_VERSION < )\d+", r"\g<1>" + RUNTIME_VERSION, text)
+    text = re.sub(r"(#if )\d+( < GOOGLE_PROTOBUF_OBJC_MIN_SUPPORTED_VERSION)",
+                  r"\g<1>" + RUNTIME_VERSION + r"\g<2>", text)
+    text = re.sub(r'GPB_DEPRECATED_MSG\("[^"]*"\)', "DEPRECATED_ATTRIBUTE", text)
+    text = re.sub(r"^GPB_FINAL @interface", "@interface", text, flags=re.M)
+    return text
+
+
+def downgrade_descriptor_flags(match):
+    flags = [f.strip() for f in match.group(1).split("|")]
+    flags = [f for f in flags
+             if f not in ("GPBDescriptorInitializationFlag_UsesClassRefs",
+                          "GPBDescriptorInitializationFlag_Proto3OptionalKnown")]
+    if not flags:
+        return "flags:GPBDescriptorInitializationFlag_None]"
+    if len(flags) == 1:
+        return "flags:%s]" % flags[0]
+    return "flags:(GPBDescriptorInitializationFlags)(%s)]" % " | ".join(flags)
+
+
+def downgrade_source(text):
+    text = text.replace("#import <stdatomic.h>\n\n#import \"", " #import \"")
+    text = text.replace('#pragma clang diagnostic ignored "-Wdollar-in-identifier-extension"\n', "")
+    text = re.sub(r"\n#pragma mark - Objective C Class declarations\n(//.*\n)*(GPBObjCClassDeclaration\(\w+\);\n)+",
+                  "", text)
+
+    text = re.sub(r"dataTypeSpecific\.clazz = Nil,", "dataTypeSpecific.className = NULL,", text)
+    text = re.sub(r"dataTypeSpecific\.clazz = GPBObjCClass\((\w+)\),",
+                  r"dataTypeSpecific.className = GPBStringifySymbol(\1),", text)
+    text = re.sub(r"setupContainingMessageClass:GPBObjCClass\((\w+)\)",
+                  r"setupContainingMessageClassName:GPBStringifySymbol(\1)", text)
+    text = re.sub(r"flags:\(GPBDescriptorInitializationFlags\)\(([^)]*)\)\]",
+                  downgrade_descriptor_flags, text)
+    text = re.sub(r"    #if defined\(DEBUG\) && DEBUG\n      (NSAssert\(descriptor == nil, @\"Startup recursed!\"\);)\n    #endif  // DEBUG\n",
+                  r"    \1\n", text)
+
+    text = text.replace("static _Atomic(GPBEnumDescriptor*) descriptor = nil;",
+                        "static GPBEnumDescriptor *descriptor = NULL;")
+    text = re.sub(r"    GPBEnumDescriptor \*expected = nil;\n    if \(!atomic_compare_exchange_strong\(&descriptor, &expected, worker\)\) \{",
+                  "    if (!OSAtomicCompareAndSwapPtrBarrier(nil, worker, (void * volatile *)&descriptor)) {",
+                  text)
+
+    text = re.sub(r"  GPBDescriptor \*descriptor = \[\w+ descriptor\];\n(  GPBOneofDescriptor \*oneof = .*\n)  GPBClearOneof\(message, oneof\);",
+                  r"  GPBDescriptor *descriptor = [message descriptor];\n\1  GPBMaybeClearOneof(message, oneof, -1, 0);",
+                  text)
+    return text
+
+
+def main(paths):
+    for path in paths:
+        with open(path) as f:
+            text = f.read()
+        if path.endswith(".h"):
+            text = downgrade_header(text)
+        else:
+            text = downgrade_source(text)
+        with open(path, "w") as f:
+            f.write(text)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])